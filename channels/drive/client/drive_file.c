@@ -34,6 +34,7 @@
 #include <time.h>
 
 #include <winpr/wtypes.h>
+#include <winpr/assert.h>
 #include <winpr/crt.h>
 #include <winpr/string.h>
 #include <winpr/path.h>
@@ -59,6 +60,8 @@
 	} while (0)
 #endif
 
+#define DRIVE_FILE_READ_AHEAD (1024u * 1024u)
+
 static BOOL drive_file_fix_path(WCHAR* path, size_t length)
 {
 	if ((length == 0) || (length > UINT32_MAX))
@@ -357,6 +360,7 @@ DRIVE_FILE* drive_file_new(const WCHAR* base_path, const WCHAR* path, UINT32 Pat
 	file->CreateDisposition = CreateDisposition;
 	file->CreateOptions = CreateOptions;
 	file->SharedAccess = SharedAccess;
+	file->read_ahead_enabled = (SharedAccess & FILE_SHARE_WRITE) == 0;
 
 	WCHAR* p = drive_file_combine_fullpath(base_path, path, PathWCharLength);
 	(void)drive_file_set_fullpath(file, p);
@@ -409,6 +413,7 @@ BOOL drive_file_free(DRIVE_FILE* file)
 	rc = TRUE;
 fail:
 	DEBUG_WSTR("Free %s", file->fullpath);
+	free(file->read_ahead);
 	free(file->fullpath);
 	free(file);
 	return rc;
@@ -430,20 +435,103 @@ BOOL drive_file_seek(DRIVE_FILE* file, UINT64 Offset)
 
 BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer, UINT32* Length)
 {
-	DWORD read = 0;
+	UINT32 total = 0;
 
 	if (!file || !buffer || !Length)
 		return FALSE;
 
 	DEBUG_WSTR("Read file %s", file->fullpath);
 
-	if (ReadFile(file->file_handle, buffer, *Length, &read, nullptr))
+	/* Fill the whole request, a short read is only returned at the end of the file */
+	while (total < *Length)
+	{
+		DWORD read = 0;
+		if (!ReadFile(file->file_handle, &buffer[total], *Length - total, &read, nullptr))
+			return FALSE;
+
+		if (read == 0)
+			break;
+		total += read;
+	}
+
+	*Length = total;
+	return TRUE;
+}
+
+static void drive_file_discard_read_ahead(DRIVE_FILE* file)
+{
+	WINPR_ASSERT(file);
+	file->read_ahead_length = 0;
+	file->read_ahead_eof = FALSE;
+}
+
+static BOOL drive_file_copy_read_ahead(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer,
+                                       UINT32* Length)
+{
+	WINPR_ASSERT(file);
+	WINPR_ASSERT(Length);
+
+	if ((file->read_ahead_length == 0) || (Offset < file->read_ahead_offset) ||
+	    (Offset - file->read_ahead_offset >= file->read_ahead_length))
+		return FALSE;
+
+	const size_t pos = (size_t)(Offset - file->read_ahead_offset);
+	const size_t available = file->read_ahead_length - pos;
+	if ((available < *Length) && !file->read_ahead_eof)
+		return FALSE;
+
+	*Length = (UINT32)MIN(available, *Length);
+	memcpy(buffer, &file->read_ahead[pos], *Length);
+	file->read_position = Offset + *Length;
+	return TRUE;
+}
+
+BOOL drive_file_read_at(DRIVE_FILE* file, UINT64 Offset, BYTE* buffer, UINT32* Length)
+{
+	if (!file || !buffer || !Length)
+		return FALSE;
+
+	if (drive_file_copy_read_ahead(file, Offset, buffer, Length))
+		return TRUE;
+
+	drive_file_discard_read_ahead(file);
+	if (!drive_file_seek(file, Offset))
+		return FALSE;
+
+	/* Random access and large requests go straight to the file */
+	if (!file->read_ahead_enabled || (Offset != file->read_position) ||
+	    (*Length >= DRIVE_FILE_READ_AHEAD))
 	{
-		*Length = read;
+		if (!drive_file_read(file, buffer, Length))
+			return FALSE;
+		file->read_position = Offset + *Length;
 		return TRUE;
 	}
 
-	return FALSE;
+	if (!file->read_ahead)
+	{
+		file->read_ahead = malloc(DRIVE_FILE_READ_AHEAD);
+		if (!file->read_ahead)
+		{
+			file->read_ahead_enabled = FALSE;
+			return drive_file_read_at(file, Offset, buffer, Length);
+		}
+	}
+
+	UINT32 length = DRIVE_FILE_READ_AHEAD;
+	if (!drive_file_read(file, file->read_ahead, &length))
+		return FALSE;
+
+	file->read_ahead_offset = Offset;
+	file->read_ahead_length = length;
+	file->read_ahead_eof = length < DRIVE_FILE_READ_AHEAD;
+	if (!drive_file_copy_read_ahead(file, Offset, buffer, Length))
+	{
+		/* Offset is at or behind the end of the file */
+		*Length = 0;
+		file->read_position = Offset;
+	}
+	return TRUE;
 }
 
 BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer, UINT32 Length)
@@ -454,6 +542,7 @@ BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer, UINT32 Length)
 		return FALSE;
 
 	DEBUG_WSTR("Write file %s", file->fullpath);
+	drive_file_discard_read_ahead(file);
 
 	while (Length > 0)
 	{
@@ -885,6 +974,7 @@ BOOL drive_file_set_information(DRIVE_FILE* file, UINT32 FsInformationClass, UIN
 	if (!Stream_CheckAndLogRequiredLength(TAG, input, Length))
 		return FALSE;
 
+	drive_file_discard_read_ahead(file);
 	switch (FsInformationClass)
 	{
 		case FileBasicInformation:
@@ -49,6 +49,12 @@ typedef struct
 	UINT32 DesiredAccess;
 	UINT32 CreateDisposition;
 	UINT32 CreateOptions;
+	BOOL read_ahead_enabled;  /* no other handle may write while the file is open */
+	BYTE* read_ahead;         /* data read beyond the last sequential request */
+	size_t read_ahead_length; /* valid bytes in read_ahead */
+	BOOL read_ahead_eof;      /* read_ahead ends at the end of the file */
+	UINT64 read_ahead_offset; /* file offset of read_ahead[0] */
+	UINT64 read_position;     /* end of the last read, used to detect sequential reads */
 } DRIVE_FILE;
 
 FREERDP_LOCAL BOOL drive_file_free(DRIVE_FILE* file);
@@ -66,6 +72,13 @@ WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL drive_file_seek(DRIVE_FILE* file, UINT64
 WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL drive_file_read(DRIVE_FILE* file, BYTE* buffer,
                                                         UINT32* Length);
 
+/**
+ * Reads at \b Offset, serving sequential reads from a read-ahead buffer if the file can not be
+ * modified through other handles.
+ */
+WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL drive_file_read_at(DRIVE_FILE* file, UINT64 Offset,
+                                                           BYTE* buffer, UINT32* Length);
+
 WINPR_ATTR_NODISCARD FREERDP_LOCAL BOOL drive_file_write(DRIVE_FILE* file, const BYTE* buffer,
                                                          UINT32 Length);
 
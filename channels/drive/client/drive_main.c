@@ -48,7 +48,26 @@
 
 #include "drive_file.h"
 
+/* Number of threads processing IRPs of a drive concurrently */
+#define DRIVE_IRP_WORKERS 4
+
+typedef struct drive_device DRIVE_DEVICE;
+
 typedef struct
+{
+	DRIVE_DEVICE* drive;
+	HANDLE thread;
+	wMessageQueue* IrpQueue;
+	size_t pending; /* IRPs queued or in progress, protected by the device lock */
+} DRIVE_WORKER;
+
+typedef struct
+{
+	size_t worker;
+	size_t pending;
+} DRIVE_FILE_WORKER;
+
+struct drive_device
 {
 	DEVICE device;
 
@@ -57,14 +76,15 @@ typedef struct
 	UINT32 PathLength;
 	wListDictionary* files;
 
-	HANDLE thread;
 	BOOL async;
-	wMessageQueue* IrpQueue;
+	CRITICAL_SECTION lock;
+	DRIVE_WORKER workers[DRIVE_IRP_WORKERS];
+	wListDictionary* fileWorkers; /* FileId -> DRIVE_FILE_WORKER while IRPs are pending */
 
 	DEVMAN* devman;
 
 	rdpContext* rdpcontext;
-} DRIVE_DEVICE;
+};
 
 static NTSTATUS drive_map_windows_err(DWORD fs_errno)
 {
@@ -178,7 +198,9 @@ static UINT drive_process_irp_create(DRIVE_DEVICE* drive, IRP* irp)
 		return ERROR_INVALID_DATA;
 
 	const WCHAR* path = Stream_ConstPointer(irp->input);
+	EnterCriticalSection(&drive->lock);
 	UINT32 FileId = irp->devman->id_sequence++;
+	LeaveCriticalSection(&drive->lock);
 	DRIVE_FILE* file =
 	    drive_file_new(drive->path, path, PathLength / sizeof(WCHAR), FileId, DesiredAccess,
 	                   CreateDisposition, CreateOptions, FileAttributes, SharedAccess);
@@ -293,11 +315,6 @@ static UINT drive_process_irp_read(DRIVE_DEVICE* drive, IRP* irp)
 		irp->IoStatus = STATUS_UNSUCCESSFUL;
 		Length = 0;
 	}
-	else if (!drive_file_seek(file, Offset))
-	{
-		irp->IoStatus = drive_map_windows_err(GetLastError());
-		Length = 0;
-	}
 
 	if (!Stream_EnsureRemainingCapacity(irp->output, 4ull + Length))
 	{
@@ -310,7 +327,7 @@ static UINT drive_process_irp_read(DRIVE_DEVICE* drive, IRP* irp)
 	{
 		BYTE* buffer = Stream_PointerAs(irp->output, BYTE) + sizeof(UINT32);
 
-		if (!drive_file_read(file, buffer, &Length))
+		if (!drive_file_read_at(file, Offset, buffer, &Length))
 		{
 			irp->IoStatus = drive_map_windows_err(GetLastError());
 			Stream_Write_UINT32(irp->output, 0);
@@ -814,31 +831,86 @@ static BOOL drive_poll_run(DRIVE_DEVICE* drive, IRP* irp)
 	return TRUE;
 }
 
+/* ListDictionary does not take a null key, IRP_MJ_CREATE is sent with FileId 0 */
+static void* drive_file_worker_key(UINT32 FileId)
+{
+	return (void*)((size_t)FileId + 1);
+}
+
+/* IRPs of a file are processed in order by the worker it is bound to while IRPs are pending */
+static DRIVE_WORKER* drive_irp_acquire_worker(DRIVE_DEVICE* drive, UINT32 FileId)
+{
+	WINPR_ASSERT(drive);
+
+	void* key = drive_file_worker_key(FileId);
+	DRIVE_FILE_WORKER* fw = ListDictionary_GetItemValue(drive->fileWorkers, key);
+	if (!fw)
+	{
+		fw = calloc(1, sizeof(DRIVE_FILE_WORKER));
+		if (!fw)
+			return nullptr;
+
+		for (size_t x = 1; x < ARRAYSIZE(drive->workers); x++)
+		{
+			if (drive->workers[x].pending < drive->workers[fw->worker].pending)
+				fw->worker = x;
+		}
+
+		if (!ListDictionary_Add(drive->fileWorkers, key, fw))
+		{
+			free(fw);
+			return nullptr;
+		}
+	}
+
+	DRIVE_WORKER* worker = &drive->workers[fw->worker];
+	fw->pending++;
+	worker->pending++;
+	return worker;
+}
+
+static void drive_irp_release_worker(DRIVE_DEVICE* drive, DRIVE_WORKER* worker, UINT32 FileId)
+{
+	WINPR_ASSERT(drive);
+	WINPR_ASSERT(worker);
+
+	void* key = drive_file_worker_key(FileId);
+	DRIVE_FILE_WORKER* fw = ListDictionary_GetItemValue(drive->fileWorkers, key);
+	WINPR_ASSERT(fw);
+	WINPR_ASSERT(fw->pending > 0);
+	WINPR_ASSERT(worker->pending > 0);
+
+	worker->pending--;
+	if (--fw->pending == 0)
+		ListDictionary_Remove(drive->fileWorkers, key);
+}
+
 static DWORD WINAPI drive_thread_func(LPVOID arg)
 {
-	DRIVE_DEVICE* drive = (DRIVE_DEVICE*)arg;
+	DRIVE_WORKER* worker = (DRIVE_WORKER*)arg;
 	UINT error = CHANNEL_RC_OK;
 
-	if (!drive)
+	if (!worker || !worker->drive)
 	{
 		error = ERROR_INVALID_PARAMETER;
 		goto fail;
 	}
 
+	DRIVE_DEVICE* drive = worker->drive;
 	while (1)
 	{
-		if (!MessageQueue_Wait(drive->IrpQueue))
+		if (!MessageQueue_Wait(worker->IrpQueue))
 		{
 			WLog_ERR(TAG, "MessageQueue_Wait failed!");
 			error = ERROR_INTERNAL_ERROR;
 			break;
 		}
 
-		if (MessageQueue_Size(drive->IrpQueue) < 1)
+		if (MessageQueue_Size(worker->IrpQueue) < 1)
 			continue;
 
 		wMessage message = WINPR_C_ARRAY_INIT;
-		if (!MessageQueue_Peek(drive->IrpQueue, &message, TRUE))
+		if (!MessageQueue_Peek(worker->IrpQueue, &message, TRUE))
 		{
 			WLog_ERR(TAG, "MessageQueue_Peek failed!");
 			continue;
@@ -848,14 +920,21 @@ static DWORD WINAPI drive_thread_func(LPVOID arg)
 			break;
 
 		IRP* irp = (IRP*)message.wParam;
-		if (!drive_poll_run(drive, irp))
+		const UINT32 FileId = irp->FileId;
+		const BOOL rc = drive_poll_run(drive, irp);
+
+		EnterCriticalSection(&drive->lock);
+		drive_irp_release_worker(drive, worker, FileId);
+		LeaveCriticalSection(&drive->lock);
+
+		if (!rc)
 			break;
 	}
 
 fail:
 
-	if (error && drive && drive->rdpcontext)
-		setChannelError(drive->rdpcontext, error, "drive_thread_func reported an error");
+	if (error && worker && worker->drive && worker->drive->rdpcontext)
+		setChannelError(worker->drive->rdpcontext, error, "drive_thread_func reported an error");
 
 	ExitThread(error);
 	return error;
@@ -870,16 +949,26 @@ static UINT drive_irp_request(DEVICE* device, IRP* irp)
 {
 	DRIVE_DEVICE* drive = (DRIVE_DEVICE*)device;
 
-	if (!drive)
+	if (!drive || !irp)
 		return ERROR_INVALID_PARAMETER;
 
 	if (drive->async)
 	{
-		if (!MessageQueue_Post(drive->IrpQueue, nullptr, 0, (void*)irp, nullptr))
+		UINT error = CHANNEL_RC_OK;
+		const UINT32 FileId = irp->FileId;
+
+		EnterCriticalSection(&drive->lock);
+		DRIVE_WORKER* worker = drive_irp_acquire_worker(drive, FileId);
+		if (!worker)
+			error = CHANNEL_RC_NO_MEMORY;
+		else if (!MessageQueue_Post(worker->IrpQueue, nullptr, 0, (void*)irp, nullptr))
 		{
 			WLog_ERR(TAG, "MessageQueue_Post failed!");
-			return ERROR_INTERNAL_ERROR;
+			drive_irp_release_worker(drive, worker, FileId);
+			error = ERROR_INTERNAL_ERROR;
 		}
+		LeaveCriticalSection(&drive->lock);
+		return error;
 	}
 	else
 	{
@@ -897,9 +986,16 @@ static UINT drive_free_int(DRIVE_DEVICE* drive)
 	if (!drive)
 		return ERROR_INVALID_PARAMETER;
 
-	(void)CloseHandle(drive->thread);
+	for (size_t x = 0; x < ARRAYSIZE(drive->workers); x++)
+	{
+		DRIVE_WORKER* worker = &drive->workers[x];
+		(void)CloseHandle(worker->thread);
+		MessageQueue_Free(worker->IrpQueue);
+	}
+
+	ListDictionary_Free(drive->fileWorkers);
 	ListDictionary_Free(drive->files);
-	MessageQueue_Free(drive->IrpQueue);
+	DeleteCriticalSection(&drive->lock);
 	Stream_Free(drive->device.data, TRUE);
 	free(drive->path);
 	free(drive);
@@ -919,12 +1015,21 @@ static UINT drive_free(DEVICE* device)
 	if (!drive)
 		return ERROR_INVALID_PARAMETER;
 
-	if (MessageQueue_PostQuit(drive->IrpQueue, 0) &&
-	    (WaitForSingleObject(drive->thread, INFINITE) == WAIT_FAILED))
+	for (size_t x = 0; x < ARRAYSIZE(drive->workers); x++)
 	{
-		error = GetLastError();
-		WLog_ERR(TAG, "WaitForSingleObject failed with error %" PRIu32 "", error);
-		return error;
+		DRIVE_WORKER* worker = &drive->workers[x];
+		if (!worker->thread)
+			continue;
+
+		/* IRPs not started yet are discarded, the one in progress is completed */
+		(void)MessageQueue_Clear(worker->IrpQueue);
+		if (MessageQueue_PostQuit(worker->IrpQueue, 0) &&
+		    (WaitForSingleObject(worker->thread, INFINITE) == WAIT_FAILED))
+		{
+			error = GetLastError();
+			WLog_ERR(TAG, "WaitForSingleObject failed with error %" PRIu32 "", error);
+			return error;
+		}
 	}
 
 	return drive_free_int(drive);
@@ -987,6 +1092,13 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 			return CHANNEL_RC_NO_MEMORY;
 		}
 
+		if (!InitializeCriticalSectionAndSpinCount(&drive->lock, 4000))
+		{
+			WLog_ERR(TAG, "InitializeCriticalSectionAndSpinCount failed!");
+			free(drive);
+			return ERROR_INTERNAL_ERROR;
+		}
+
 		drive->device.type = RDPDR_DTYP_FILESYSTEM;
 		drive->device.IRPRequest = drive_irp_request;
 		drive->device.Free = drive_free;
@@ -1048,18 +1160,33 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 		}
 
 		ListDictionary_ValueObject(drive->files)->fnObjectFree = drive_file_objfree;
-		drive->IrpQueue = MessageQueue_New(nullptr);
-
-		if (!drive->IrpQueue)
+		drive->fileWorkers = ListDictionary_New(FALSE);
+		if (!drive->fileWorkers)
 		{
 			WLog_ERR(TAG, "ListDictionary_New failed!");
 			error = CHANNEL_RC_NO_MEMORY;
 			goto out_error;
 		}
 
-		wObject* obj = MessageQueue_Object(drive->IrpQueue);
-		WINPR_ASSERT(obj);
-		obj->fnObjectFree = drive_message_free;
+		ListDictionary_ValueObject(drive->fileWorkers)->fnObjectFree = free;
+
+		for (size_t x = 0; x < ARRAYSIZE(drive->workers); x++)
+		{
+			DRIVE_WORKER* worker = &drive->workers[x];
+			worker->drive = drive;
+			worker->IrpQueue = MessageQueue_New(nullptr);
+
+			if (!worker->IrpQueue)
+			{
+				WLog_ERR(TAG, "MessageQueue_New failed!");
+				error = CHANNEL_RC_NO_MEMORY;
+				goto out_error;
+			}
+
+			wObject* obj = MessageQueue_Object(worker->IrpQueue);
+			WINPR_ASSERT(obj);
+			obj->fnObjectFree = drive_message_free;
+		}
 
 		if ((error = pEntryPoints->RegisterDevice(pEntryPoints->devman, &drive->device)))
 		{
@@ -1072,14 +1199,19 @@ static UINT drive_register_drive_path(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints,
 		                                          FreeRDP_SynchronousStaticChannels);
 		if (drive->async)
 		{
-			if (!(drive->thread = CreateThread(nullptr, 0, drive_thread_func, drive,
-			                                   CREATE_SUSPENDED, nullptr)))
+			for (size_t x = 0; x < ARRAYSIZE(drive->workers); x++)
 			{
-				WLog_ERR(TAG, "CreateThread failed!");
-				goto out_error;
+				DRIVE_WORKER* worker = &drive->workers[x];
+				if (!(worker->thread = CreateThread(nullptr, 0, drive_thread_func, worker,
+				                                    CREATE_SUSPENDED, nullptr)))
+				{
+					/* The device is owned by devman now, drive_free stops the started workers */
+					WLog_ERR(TAG, "CreateThread failed!");
+					return ERROR_INTERNAL_ERROR;
+				}
+
+				ResumeThread(worker->thread);
 			}
-
-			ResumeThread(drive->thread);
 		}
 	}
 
@@ -0,0 +1,612 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Drive redirection IRP processing test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/file.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/crypto.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/channels/rdpdr.h>
+
+#define TEST_CHUNK (16u * 1024u)
+#define TEST_CHUNKS 16u
+#define TEST_FILES 3u
+#define TEST_QUEUED 8u
+#define TEST_MAX_IRPS 256u
+#define TEST_TIMEOUT 10000
+
+extern UINT VCAPITYPE drive_DeviceServiceEntry(PDEVICE_SERVICE_ENTRY_POINTS pEntryPoints);
+
+typedef struct test_drive test_drive;
+
+typedef struct
+{
+	IRP irp; /* The callbacks get a pointer to this member */
+	test_drive* test;
+	HANDLE block; /* Complete waits for it if set */
+	size_t completed;
+	size_t discarded;
+} test_irp;
+
+struct test_drive
+{
+	char* path;
+	rdpContext* context;
+	RDPDR_DRIVE drive;
+	DEVMAN devman;
+	DEVICE* device;
+	UINT32 completionId;
+
+	CRITICAL_SECTION lock;
+	HANDLE event;
+	test_irp* irps[TEST_MAX_IRPS];
+	size_t irpCount;
+	test_irp* done[TEST_MAX_IRPS]; /* IRPs in the order Complete was called */
+	size_t doneCount;
+	size_t discardCount;
+};
+
+static BYTE test_pattern(UINT32 file, UINT64 offset, UINT32 generation)
+{
+	return (BYTE)(offset * 7 + (offset >> 10) * 31 + file * 101 + generation * 53);
+}
+
+static UINT test_irp_complete(IRP* irp)
+{
+	test_irp* tirp = (test_irp*)irp;
+	WINPR_ASSERT(tirp);
+	test_drive* test = tirp->test;
+
+	EnterCriticalSection(&test->lock);
+	tirp->completed++;
+	if (test->doneCount < ARRAYSIZE(test->done))
+		test->done[test->doneCount] = tirp;
+	test->doneCount++;
+	LeaveCriticalSection(&test->lock);
+	(void)SetEvent(test->event);
+
+	if (tirp->block)
+		(void)WaitForSingleObject(tirp->block, INFINITE);
+	return CHANNEL_RC_OK;
+}
+
+static UINT test_irp_discard(IRP* irp)
+{
+	test_irp* tirp = (test_irp*)irp;
+	WINPR_ASSERT(tirp);
+	test_drive* test = tirp->test;
+
+	EnterCriticalSection(&test->lock);
+	tirp->discarded++;
+	test->discardCount++;
+	LeaveCriticalSection(&test->lock);
+	(void)SetEvent(test->event);
+	return CHANNEL_RC_OK;
+}
+
+/* Waits until the counter \b value, protected by the test lock, reached \b expect */
+static BOOL test_wait(test_drive* test, const size_t* value, size_t expect)
+{
+	const UINT64 end = GetTickCount64() + TEST_TIMEOUT;
+
+	while (TRUE)
+	{
+		/* The callbacks signal after updating the counters, no wakeup is lost */
+		(void)ResetEvent(test->event);
+		EnterCriticalSection(&test->lock);
+		const size_t current = *value;
+		LeaveCriticalSection(&test->lock);
+		if (current >= expect)
+			return TRUE;
+
+		const UINT64 now = GetTickCount64();
+		if (now >= end)
+		{
+			(void)fprintf(stderr, "timeout waiting for %" PRIuz " of %" PRIuz "\n", current,
+			              expect);
+			return FALSE;
+		}
+		(void)WaitForSingleObject(test->event, (DWORD)(end - now));
+	}
+}
+
+static UINT test_register_device(DEVMAN* devman, DEVICE* device)
+{
+	WINPR_ASSERT(devman);
+	test_drive* test = devman->plugin;
+	WINPR_ASSERT(test);
+
+	if (test->device)
+		return ERROR_INVALID_PARAMETER;
+	device->id = 1;
+	test->device = device;
+	return CHANNEL_RC_OK;
+}
+
+static void test_drive_free(test_drive* test)
+{
+	if (!test)
+		return;
+
+	if (test->device)
+		(void)test->device->Free(test->device);
+
+	for (size_t x = 0; x < test->irpCount; x++)
+	{
+		test_irp* tirp = test->irps[x];
+		Stream_Free(tirp->irp.input, TRUE);
+		Stream_Free(tirp->irp.output, TRUE);
+		(void)CloseHandle(tirp->block);
+		free(tirp);
+	}
+
+	if (test->path)
+	{
+		const BOOL rc = winpr_RemoveDirectory_RecursiveA(test->path);
+		WINPR_UNUSED(rc);
+	}
+
+	if (test->context)
+		freerdp_settings_free(test->context->settings);
+	free(test->context);
+	(void)CloseHandle(test->event);
+	DeleteCriticalSection(&test->lock);
+	free(test->path);
+	free(test);
+}
+
+/* Registers a drive for a new temporary directory, IRPs are processed by the worker threads */
+static test_drive* test_drive_new(void)
+{
+	BYTE tmp[16] = WINPR_C_ARRAY_INIT;
+	char name[64] = WINPR_C_ARRAY_INIT;
+	test_drive* test = calloc(1, sizeof(test_drive));
+
+	if (!test)
+		return nullptr;
+
+	InitializeCriticalSection(&test->lock);
+	test->event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	test->context = calloc(1, sizeof(rdpContext));
+	if (!test->event || !test->context)
+		goto fail;
+
+	test->context->settings = freerdp_settings_new(0);
+	if (!test->context->settings ||
+	    !freerdp_settings_set_bool(test->context->settings, FreeRDP_SynchronousStaticChannels,
+	                               FALSE))
+		goto fail;
+
+	if (winpr_RAND(tmp, sizeof(tmp)) < 0)
+		goto fail;
+	for (size_t x = 0; x < sizeof(tmp); x++)
+		(void)_snprintf(&name[x * 2], sizeof(name) - 2 * x, "%02" PRIx8, tmp[x]);
+
+	test->path = GetKnownSubPath(KNOWN_PATH_TEMP, name);
+	if (!test->path || !winpr_PathMakePath(test->path, nullptr))
+		goto fail;
+
+	test->drive.device.Type = RDPDR_DTYP_FILESYSTEM;
+	test->drive.device.Name = "test";
+	test->drive.Path = test->path;
+	test->devman.plugin = test;
+	test->devman.id_sequence = 1;
+
+	DEVICE_SERVICE_ENTRY_POINTS entryPoints = WINPR_C_ARRAY_INIT;
+	entryPoints.devman = &test->devman;
+	entryPoints.RegisterDevice = test_register_device;
+	entryPoints.device = &test->drive.device;
+	entryPoints.rdpcontext = test->context;
+
+	if ((drive_DeviceServiceEntry(&entryPoints) != CHANNEL_RC_OK) || !test->device)
+		goto fail;
+	return test;
+
+fail:
+	test_drive_free(test);
+	return nullptr;
+}
+
+static test_irp* test_irp_new(test_drive* test, UINT32 MajorFunction, UINT32 FileId, size_t size)
+{
+	WINPR_ASSERT(test);
+
+	if (test->irpCount >= ARRAYSIZE(test->irps))
+		return nullptr;
+
+	test_irp* tirp = calloc(1, sizeof(test_irp));
+	if (!tirp)
+		return nullptr;
+	test->irps[test->irpCount++] = tirp;
+
+	tirp->test = test;
+	tirp->irp.device = test->device;
+	tirp->irp.devman = &test->devman;
+	tirp->irp.FileId = FileId;
+	tirp->irp.CompletionId = test->completionId++;
+	tirp->irp.MajorFunction = MajorFunction;
+	tirp->irp.Complete = test_irp_complete;
+	tirp->irp.Discard = test_irp_discard;
+	tirp->irp.input = Stream_New(nullptr, size + 1);
+	tirp->irp.output = Stream_New(nullptr, 64);
+	if (!tirp->irp.input || !tirp->irp.output)
+		return nullptr;
+	return tirp;
+}
+
+static BOOL test_irp_submit(test_drive* test, test_irp* tirp)
+{
+	WINPR_ASSERT(test);
+	WINPR_ASSERT(tirp);
+
+	Stream_SealLength(tirp->irp.input);
+	Stream_ResetPosition(tirp->irp.input);
+	return test->device->IRPRequest(test->device, &tirp->irp) == CHANNEL_RC_OK;
+}
+
+static BOOL test_irp_run(test_drive* test, test_irp* tirp)
+{
+	if (!test_irp_submit(test, tirp) || !test_wait(test, &tirp->completed, 1))
+		return FALSE;
+	return tirp->irp.IoStatus == STATUS_SUCCESS;
+}
+
+/* Opens \b name without FILE_SHARE_WRITE, so reads of the file may use read-ahead */
+static BOOL test_create(test_drive* test, const char* name, UINT32* FileId)
+{
+	BOOL rc = FALSE;
+	size_t length = 0;
+	WCHAR* path = ConvertUtf8ToWCharAlloc(name, &length);
+	const size_t size = (length + 1) * sizeof(WCHAR);
+	test_irp* tirp = test_irp_new(test, IRP_MJ_CREATE, 0, 6 * 4 + 8 + size);
+
+	if (!path || !tirp)
+		goto fail;
+
+	Stream_Write_UINT32(tirp->irp.input, GENERIC_READ | GENERIC_WRITE); /* DesiredAccess */
+	Stream_Write_UINT64(tirp->irp.input, 0);                             /* AllocationSize */
+	Stream_Write_UINT32(tirp->irp.input, FILE_ATTRIBUTE_NORMAL);         /* FileAttributes */
+	Stream_Write_UINT32(tirp->irp.input, FILE_SHARE_READ);               /* SharedAccess */
+	Stream_Write_UINT32(tirp->irp.input, FILE_OVERWRITE_IF);             /* CreateDisposition */
+	Stream_Write_UINT32(tirp->irp.input, FILE_NON_DIRECTORY_FILE);       /* CreateOptions */
+	Stream_Write_UINT32(tirp->irp.input, (UINT32)size);                  /* PathLength */
+	Stream_Write(tirp->irp.input, path, size);
+
+	if (!test_irp_run(test, tirp))
+		goto fail;
+
+	Stream_SealLength(tirp->irp.output);
+	Stream_ResetPosition(tirp->irp.output);
+	if (!Stream_CheckAndLogRequiredLength("test", tirp->irp.output, 5))
+		goto fail;
+	Stream_Read_UINT32(tirp->irp.output, *FileId);
+	rc = *FileId != 0;
+fail:
+	free(path);
+	return rc;
+}
+
+static test_irp* test_write(test_drive* test, UINT32 FileId, UINT64 Offset, UINT32 Length,
+                            UINT32 generation)
+{
+	test_irp* tirp = test_irp_new(test, IRP_MJ_WRITE, FileId, 32ull + Length);
+	if (!tirp)
+		return nullptr;
+
+	Stream_Write_UINT32(tirp->irp.input, Length);
+	Stream_Write_UINT64(tirp->irp.input, Offset);
+	Stream_Zero(tirp->irp.input, 20); /* Padding */
+	for (UINT32 x = 0; x < Length; x++)
+		Stream_Write_UINT8(tirp->irp.input, test_pattern(FileId, Offset + x, generation));
+	return tirp;
+}
+
+static test_irp* test_read(test_drive* test, UINT32 FileId, UINT64 Offset, UINT32 Length)
+{
+	test_irp* tirp = test_irp_new(test, IRP_MJ_READ, FileId, 32);
+	if (!tirp)
+		return nullptr;
+
+	Stream_Write_UINT32(tirp->irp.input, Length);
+	Stream_Write_UINT64(tirp->irp.input, Offset);
+	Stream_Zero(tirp->irp.input, 20); /* Padding */
+	return tirp;
+}
+
+/* The read returned \b Length bytes, the part before \b split from \b before, the rest from
+ * \b after generation */
+static BOOL test_check_read(const test_irp* tirp, UINT64 Offset, UINT32 Length, UINT64 split,
+                            UINT32 before, UINT32 after)
+{
+	WINPR_ASSERT(tirp);
+
+	const IRP* irp = &tirp->irp;
+	const BYTE* data = Stream_Buffer(irp->output);
+	UINT32 length = 0;
+
+	if ((irp->IoStatus != STATUS_SUCCESS) || (Stream_GetPosition(irp->output) < 4))
+		return FALSE;
+
+	memcpy(&length, data, sizeof(length));
+	if ((length != Length) || (Stream_GetPosition(irp->output) != 4ull + length))
+	{
+		(void)fprintf(stderr, "read at %" PRIu64 ": expected %" PRIu32 " bytes, got %" PRIu32 "\n",
+		              Offset, Length, length);
+		return FALSE;
+	}
+
+	for (UINT32 x = 0; x < length; x++)
+	{
+		const UINT64 offset = Offset + x;
+		const UINT32 generation = (offset < split) ? before : after;
+		if (data[4 + x] != test_pattern(irp->FileId, offset, generation))
+		{
+			(void)fprintf(stderr, "read at %" PRIu64 ": wrong data at %" PRIu64 "\n", Offset,
+			              offset);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* IRPs of several files are processed in parallel, the IRPs of every file in the order they
+ * were sent */
+static BOOL test_ordering(void)
+{
+	BOOL rc = FALSE;
+	UINT32 files[TEST_FILES] = WINPR_C_ARRAY_INIT;
+	test_irp* reads[TEST_FILES][TEST_CHUNKS] = WINPR_C_ARRAY_INIT;
+	test_drive* test = test_drive_new();
+
+	if (!test)
+		return FALSE;
+
+	for (size_t f = 0; f < TEST_FILES; f++)
+	{
+		char name[32] = WINPR_C_ARRAY_INIT;
+		(void)_snprintf(name, sizeof(name), "\\ordering-%" PRIuz ".bin", f);
+		if (!test_create(test, name, &files[f]))
+			goto fail;
+	}
+
+	const size_t first = test->doneCount;
+	for (UINT32 k = 0; k < TEST_CHUNKS; k++)
+	{
+		for (size_t f = 0; f < TEST_FILES; f++)
+		{
+			test_irp* tirp = test_write(test, files[f], 1ull * k * TEST_CHUNK, TEST_CHUNK, 0);
+			if (!tirp || !test_irp_submit(test, tirp))
+				goto fail;
+		}
+	}
+
+	/* Every read must see all writes sent before it */
+	for (UINT32 k = 0; k < TEST_CHUNKS; k++)
+	{
+		for (size_t f = 0; f < TEST_FILES; f++)
+		{
+			reads[f][k] = test_read(test, files[f], 1ull * k * TEST_CHUNK, TEST_CHUNK);
+			if (!reads[f][k] || !test_irp_submit(test, reads[f][k]))
+				goto fail;
+		}
+	}
+
+	if (!test_wait(test, &test->doneCount, first + 2ull * TEST_FILES * TEST_CHUNKS))
+		goto fail;
+
+	for (size_t f = 0; f < TEST_FILES; f++)
+	{
+		UINT32 last = 0;
+		for (size_t x = first; x < test->doneCount; x++)
+		{
+			const IRP* irp = &test->done[x]->irp;
+			if (irp->FileId != files[f])
+				continue;
+
+			if ((irp->IoStatus != STATUS_SUCCESS) || (irp->CompletionId < last))
+			{
+				(void)fprintf(stderr,
+				              "file %" PRIu32 ": IRP %" PRIu32 " completed after %" PRIu32 "\n",
+				              files[f], irp->CompletionId, last);
+				goto fail;
+			}
+			last = irp->CompletionId;
+		}
+
+		for (UINT32 k = 0; k < TEST_CHUNKS; k++)
+		{
+			if (!test_check_read(reads[f][k], 1ull * k * TEST_CHUNK, TEST_CHUNK, UINT64_MAX, 0,
+			                     0))
+				goto fail;
+		}
+	}
+
+	rc = (test->discardCount == 0) && (test->doneCount == test->irpCount);
+fail:
+	test_drive_free(test);
+	return rc;
+}
+
+/* Writes drop the data read ahead, later reads see the new content and the new end */
+static BOOL test_read_ahead(void)
+{
+	BOOL rc = FALSE;
+	UINT32 file = 0;
+	const UINT64 size = 1ull * TEST_CHUNKS * TEST_CHUNK;
+	test_drive* test = test_drive_new();
+
+	if (!test || !test_create(test, "\\read-ahead.bin", &file))
+		goto fail;
+
+	test_irp* tirp = test_write(test, file, 0, (UINT32)size, 0);
+	if (!tirp || !test_irp_run(test, tirp))
+		goto fail;
+
+	/* A sequential read fetches the rest of the file */
+	tirp = test_read(test, file, 0, TEST_CHUNK);
+	if (!tirp || !test_irp_run(test, tirp) ||
+	    !test_check_read(tirp, 0, TEST_CHUNK, UINT64_MAX, 0, 0))
+		goto fail;
+
+	/* Overwrite data that was read ahead */
+	tirp = test_write(test, file, TEST_CHUNK, TEST_CHUNK, 1);
+	if (!tirp || !test_irp_run(test, tirp))
+		goto fail;
+
+	tirp = test_read(test, file, TEST_CHUNK, TEST_CHUNK);
+	if (!tirp || !test_irp_run(test, tirp) ||
+	    !test_check_read(tirp, TEST_CHUNK, TEST_CHUNK, UINT64_MAX, 1, 1))
+		goto fail;
+
+	tirp = test_read(test, file, 2ull * TEST_CHUNK, TEST_CHUNK);
+	if (!tirp || !test_irp_run(test, tirp) ||
+	    !test_check_read(tirp, 2ull * TEST_CHUNK, TEST_CHUNK, UINT64_MAX, 0, 0))
+		goto fail;
+
+	/* Extend the file, the read ahead data ended at the old end of the file */
+	tirp = test_write(test, file, size, TEST_CHUNK, 1);
+	if (!tirp || !test_irp_run(test, tirp))
+		goto fail;
+
+	tirp = test_read(test, file, size - TEST_CHUNK / 2, TEST_CHUNK);
+	if (!tirp || !test_irp_run(test, tirp) ||
+	    !test_check_read(tirp, size - TEST_CHUNK / 2, TEST_CHUNK, size, 0, 1))
+		goto fail;
+
+	tirp = test_read(test, file, size + TEST_CHUNK, TEST_CHUNK);
+	if (!tirp || !test_irp_run(test, tirp) ||
+	    !test_check_read(tirp, size + TEST_CHUNK, 0, UINT64_MAX, 0, 0))
+		goto fail;
+
+	rc = test->discardCount == 0;
+fail:
+	test_drive_free(test);
+	return rc;
+}
+
+static DWORD WINAPI test_free_thread(LPVOID arg)
+{
+	test_drive* test = arg;
+	WINPR_ASSERT(test);
+
+	const UINT error = test->device->Free(test->device);
+	return error;
+}
+
+/* Freeing the drive discards the IRPs still queued, the one in progress is completed. IRPs of
+ * other files do not wait for a blocked file. */
+static BOOL test_cancel(void)
+{
+	BOOL rc = FALSE;
+	HANDLE thread = nullptr;
+	HANDLE block = nullptr;
+	UINT32 busy = 0;
+	UINT32 other = 0;
+	test_irp* queued[TEST_QUEUED] = WINPR_C_ARRAY_INIT;
+	test_drive* test = test_drive_new();
+
+	if (!test || !test_create(test, "\\busy.bin", &busy) ||
+	    !test_create(test, "\\other.bin", &other))
+		goto fail;
+
+	test_irp* blocker = test_write(test, busy, 0, TEST_CHUNK, 0);
+	if (!blocker)
+		goto fail;
+	blocker->block = block = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!block || !test_irp_submit(test, blocker) || !test_wait(test, &blocker->completed, 1))
+		goto fail;
+
+	for (size_t x = 0; x < ARRAYSIZE(queued); x++)
+	{
+		queued[x] = test_read(test, busy, 0, TEST_CHUNK);
+		if (!queued[x] || !test_irp_submit(test, queued[x]))
+			goto fail;
+	}
+
+	test_irp* tirp = test_write(test, other, 0, TEST_CHUNK, 0);
+	if (!tirp || !test_irp_run(test, tirp))
+		goto fail;
+
+	thread = CreateThread(nullptr, 0, test_free_thread, test, 0, nullptr);
+	if (!thread || !test_wait(test, &test->discardCount, ARRAYSIZE(queued)))
+		goto fail;
+
+	(void)SetEvent(block);
+	if ((WaitForSingleObject(thread, TEST_TIMEOUT) != WAIT_OBJECT_0))
+		goto fail;
+
+	DWORD error = 0;
+	if (!GetExitCodeThread(thread, &error) || (error != CHANNEL_RC_OK))
+		goto fail;
+	test->device = nullptr;
+
+	if ((blocker->completed != 1) || (blocker->discarded != 0) || (tirp->completed != 1))
+		goto fail;
+
+	for (size_t x = 0; x < ARRAYSIZE(queued); x++)
+	{
+		if ((queued[x]->completed != 0) || (queued[x]->discarded != 1))
+			goto fail;
+	}
+
+	rc = test->discardCount == ARRAYSIZE(queued);
+fail:
+	if (block)
+		(void)SetEvent(block);
+	if (thread)
+	{
+		if (!rc && test && test->device)
+		{
+			(void)WaitForSingleObject(thread, INFINITE);
+			test->device = nullptr;
+		}
+		(void)CloseHandle(thread);
+	}
+	test_drive_free(test);
+	return rc;
+}
+
+int TestDriveIrp(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_ordering())
+	{
+		(void)fprintf(stderr, "IRP ordering failed\n");
+		return -1;
+	}
+
+	if (!test_read_ahead())
+	{
+		(void)fprintf(stderr, "read-ahead invalidation failed\n");
+		return -1;
+	}
+
+	if (!test_cancel())
+	{
+		(void)fprintf(stderr, "IRP cancellation failed\n");
+		return -1;
+	}
+	return 0;
+}
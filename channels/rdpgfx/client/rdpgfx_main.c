@@ -28,6 +28,7 @@
 
 #include <winpr/crt.h>
 #include <winpr/wlog.h>
+#include <winpr/path.h>
 #include <winpr/print.h>
 #include <winpr/synch.h>
 #include <winpr/thread.h>
@@ -189,6 +190,90 @@ static UINT evict_cache_slots(RdpgfxClientContext* context, UINT16 MaxCacheSlots
 	return error;
 }
 
+/* Records a use of a cache slot, the saved cache starts with the most recently used slots */
+static void rdpgfx_touch_cache_slot(RDPGFX_PLUGIN* gfx, UINT16 cacheSlot)
+{
+	WINPR_ASSERT(gfx);
+
+	if ((cacheSlot == 0) || (cacheSlot > gfx->MaxCacheSlots))
+		return;
+
+	gfx->CacheSlotImports[cacheSlot - 1] = 0;
+	gfx->CacheSlotStamps[cacheSlot - 1] = ++gfx->CacheSlotClock;
+}
+
+static void rdpgfx_free_persistent_cache(RDPGFX_PLUGIN* gfx)
+{
+	WINPR_ASSERT(gfx);
+
+	persistent_cache_free(gfx->persistent);
+	gfx->persistent = nullptr;
+	gfx->CacheSlotsAppended = 0;
+	ZeroMemory(gfx->CacheSlotImports, sizeof(gfx->CacheSlotImports));
+	ZeroMemory(gfx->CacheSlotStamps, sizeof(gfx->CacheSlotStamps));
+	gfx->CacheSlotClock = 0;
+}
+
+/**
+ * Appends a slot filled by the server to the persistent cache file in the background, so the
+ * entries of a session are not lost if it does not end with a save. A session appends at most
+ * as many entries as the cache has slots, keys already in the file are skipped.
+ */
+static void rdpgfx_journal_cache_slot(RDPGFX_PLUGIN* gfx, UINT16 cacheSlot)
+{
+	PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(gfx);
+	RdpgfxClientContext* context = gfx->context;
+
+	if (!gfx->persistent || !context || !context->ExportCacheEntry ||
+	    (gfx->CacheSlotsAppended >= gfx->MaxCacheSlots))
+		return;
+
+	if (context->ExportCacheEntry(context, cacheSlot, &entry) != CHANNEL_RC_OK)
+		return;
+
+	if ((entry.width == 0) || (entry.height == 0))
+		return;
+
+	const int status = persistent_cache_append_entry(gfx->persistent, &entry);
+	if (status > 0)
+		gfx->CacheSlotsAppended++;
+	else if (status < 0)
+		WLog_Print(gfx->base.log, WLOG_DEBUG, "Failed to append cache slot %" PRIu16, cacheSlot);
+}
+
+/**
+ * Imports a slot offered from the persistent cache on its first use, entries the server never
+ * draws are not read from disk at all.
+ *
+ * @return 0 on success, otherwise a Win32 error code
+ */
+static UINT rdpgfx_load_cache_slot(RDPGFX_PLUGIN* gfx, UINT16 cacheSlot)
+{
+	PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(gfx);
+	RdpgfxClientContext* context = gfx->context;
+
+	if ((cacheSlot == 0) || (cacheSlot > gfx->MaxCacheSlots))
+		return CHANNEL_RC_OK;
+
+	const UINT32 index = gfx->CacheSlotImports[cacheSlot - 1];
+	if (index == 0)
+		return CHANNEL_RC_OK;
+
+	gfx->CacheSlotImports[cacheSlot - 1] = 0;
+
+	if (!gfx->persistent || (persistent_cache_get_entry(gfx->persistent, index - 1, &entry) < 1))
+		return ERROR_INVALID_DATA;
+
+	if (!context || !context->ImportCacheEntry)
+		return CHANNEL_RC_OK;
+
+	return context->ImportCacheEntry(context, cacheSlot, &entry);
+}
+
 /**
  * Function description
  *
@@ -815,6 +900,12 @@ static UINT rdpgfx_recv_evict_cache_entry_pdu(GENERIC_CHANNEL_CALLBACK* callback
 	WLog_Print(gfx->base.log, WLOG_DEBUG, "RecvEvictCacheEntryPdu: cacheSlot: %" PRIu16 "",
 	           pdu.cacheSlot);
 
+	if ((pdu.cacheSlot > 0) && (pdu.cacheSlot <= gfx->MaxCacheSlots))
+	{
+		gfx->CacheSlotImports[pdu.cacheSlot - 1] = 0;
+		gfx->CacheSlotStamps[pdu.cacheSlot - 1] = 0;
+	}
+
 	if (context)
 	{
 		IFCALLRET(context->EvictCacheEntry, error, context, &pdu);
@@ -827,6 +918,25 @@ static UINT rdpgfx_recv_evict_cache_entry_pdu(GENERIC_CHANNEL_CALLBACK* callback
 	return error;
 }
 
+typedef struct
+{
+	UINT64 stamp;
+	UINT16 cacheSlot;
+} RDPGFX_CACHE_SLOT_ORDER;
+
+static int rdpgfx_compare_cache_slot_order(const void* pva, const void* pvb)
+{
+	const RDPGFX_CACHE_SLOT_ORDER* a = pva;
+	const RDPGFX_CACHE_SLOT_ORDER* b = pvb;
+
+	WINPR_ASSERT(a);
+	WINPR_ASSERT(b);
+
+	if (a->stamp != b->stamp)
+		return (a->stamp > b->stamp) ? -1 : 1;
+	return (a->cacheSlot < b->cacheSlot) ? -1 : 1;
+}
+
 /**
  * Function description
  *
@@ -835,6 +945,8 @@ static UINT rdpgfx_recv_evict_cache_entry_pdu(GENERIC_CHANNEL_CALLBACK* callback
 static UINT rdpgfx_save_persistent_cache(RDPGFX_PLUGIN* gfx)
 {
 	UINT error = CHANNEL_RC_OK;
+	size_t count = 0;
+	RDPGFX_CACHE_SLOT_ORDER* order = nullptr;
 
 	WINPR_ASSERT(gfx);
 	WINPR_ASSERT(gfx->rdpcontext);
@@ -860,6 +972,13 @@ static UINT rdpgfx_save_persistent_cache(RDPGFX_PLUGIN* gfx)
 	if (!persistent)
 		return CHANNEL_RC_NO_MEMORY;
 
+	order = calloc(gfx->MaxCacheSlots, sizeof(RDPGFX_CACHE_SLOT_ORDER));
+	if (!order)
+	{
+		error = CHANNEL_RC_NO_MEMORY;
+		goto fail;
+	}
+
 	if (persistent_cache_open(persistent, BitmapCachePersistFile, TRUE, 3) < 1)
 	{
 		error = CHANNEL_RC_INITIALIZATION_ERROR;
@@ -868,23 +987,49 @@ static UINT rdpgfx_save_persistent_cache(RDPGFX_PLUGIN* gfx)
 
 	for (UINT16 idx = 0; idx < gfx->MaxCacheSlots; idx++)
 	{
-		if (gfx->CacheSlots[idx])
+		if (gfx->CacheSlots[idx] || gfx->CacheSlotImports[idx])
 		{
-			const UINT16 cacheSlot = idx;
-			PERSISTENT_CACHE_ENTRY cacheEntry = WINPR_C_ARRAY_INIT;
+			RDPGFX_CACHE_SLOT_ORDER* cur = &order[count++];
+			cur->cacheSlot = WINPR_ASSERTING_INT_CAST(UINT16, idx + 1);
+			cur->stamp = gfx->CacheSlotStamps[idx];
+		}
+	}
 
-			if (context->ExportCacheEntry(context, cacheSlot, &cacheEntry) != CHANNEL_RC_OK)
+	/* The next connection offers the first entries, so the recently used ones go first */
+	qsort(order, count, sizeof(RDPGFX_CACHE_SLOT_ORDER), rdpgfx_compare_cache_slot_order);
+
+	for (size_t x = 0; x < count; x++)
+	{
+		const UINT16 cacheSlot = order[x].cacheSlot;
+		const UINT32 index = gfx->CacheSlotImports[cacheSlot - 1];
+		PERSISTENT_CACHE_ENTRY cacheEntry = WINPR_C_ARRAY_INIT;
+
+		if (index != 0)
+		{
+			/* Not used in this session, copy the entry over from the previous cache */
+			if (!gfx->persistent ||
+			    (persistent_cache_get_entry(gfx->persistent, index - 1, &cacheEntry) < 1))
 				continue;
+		}
+		else if (context->ExportCacheEntry(context, cacheSlot, &cacheEntry) != CHANNEL_RC_OK)
+			continue;
+
+		/* placeholders of imported slots that failed to load */
+		if ((cacheEntry.width == 0) || (cacheEntry.height == 0))
+			continue;
 
-			if (persistent_cache_write_entry(persistent, &cacheEntry) < 0)
-				goto fail;
+		if (persistent_cache_write_entry(persistent, &cacheEntry) < 0)
+		{
+			error = ERROR_INTERNAL_ERROR;
+			goto fail;
 		}
 	}
 
-	persistent_cache_free(persistent);
-
-	return error;
 fail:
+	free(order);
+
+	/* The previous cache must be unmapped before the new one replaces it */
+	rdpgfx_free_persistent_cache(gfx);
 	persistent_cache_free(persistent);
 	return error;
 }
@@ -965,7 +1110,6 @@ static UINT rdpgfx_send_cache_offer(RDPGFX_PLUGIN* gfx)
 {
 	int count = 0;
 	UINT error = CHANNEL_RC_OK;
-	PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
 	RDPGFX_CACHE_IMPORT_OFFER_PDU* offer = nullptr;
 
 	WINPR_ASSERT(gfx);
@@ -982,11 +1126,28 @@ static UINT rdpgfx_send_cache_offer(RDPGFX_PLUGIN* gfx)
 	if (!BitmapCachePersistFile)
 		return CHANNEL_RC_OK;
 
+	/* The cache stays open until the session ends, offered entries are imported on demand */
+	rdpgfx_free_persistent_cache(gfx);
 	rdpPersistentCache* persistent = persistent_cache_new();
 
 	if (!persistent)
 		return CHANNEL_RC_NO_MEMORY;
 
+	/* An empty cache takes the entries of this session until it is saved */
+	if (!winpr_PathFileExists(BitmapCachePersistFile))
+	{
+		const int rc = persistent_cache_open(persistent, BitmapCachePersistFile, TRUE, 3);
+		if ((persistent_cache_close(persistent) < 1) || (rc < 1))
+		{
+			error = CHANNEL_RC_INITIALIZATION_ERROR;
+			goto fail;
+		}
+		persistent_cache_free(persistent);
+		persistent = persistent_cache_new();
+		if (!persistent)
+			return CHANNEL_RC_NO_MEMORY;
+	}
+
 	if (persistent_cache_open(persistent, BitmapCachePersistFile, FALSE, 3) < 1)
 	{
 		error = CHANNEL_RC_INITIALIZATION_ERROR;
@@ -1026,7 +1187,9 @@ static UINT rdpgfx_send_cache_offer(RDPGFX_PLUGIN* gfx)
 
 	for (int idx = 0; idx < count; idx++)
 	{
-		if (persistent_cache_read_entry(persistent, &entry) < 1)
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+
+		if (persistent_cache_get_entry(persistent, (size_t)idx, &entry) < 1)
 		{
 			error = ERROR_INVALID_DATA;
 			goto fail;
@@ -1046,6 +1209,9 @@ static UINT rdpgfx_send_cache_offer(RDPGFX_PLUGIN* gfx)
 		}
 	}
 
+	gfx->persistent = persistent;
+	persistent = nullptr;
+
 fail:
 	persistent_cache_free(persistent);
 	free(offer);
@@ -1060,70 +1226,34 @@ fail:
 static UINT rdpgfx_load_cache_import_reply(RDPGFX_PLUGIN* gfx,
                                            const RDPGFX_CACHE_IMPORT_REPLY_PDU* reply)
 {
-	UINT error = CHANNEL_RC_OK;
-	rdpPersistentCache* persistent = nullptr;
 	WINPR_ASSERT(gfx);
-	WINPR_ASSERT(gfx->rdpcontext);
-	rdpSettings* settings = gfx->rdpcontext->settings;
-	RdpgfxClientContext* context = gfx->context;
-
-	WINPR_ASSERT(settings);
 	WINPR_ASSERT(reply);
-	if (!freerdp_settings_get_bool(settings, FreeRDP_BitmapCachePersistEnabled))
-		return CHANNEL_RC_OK;
 
-	const char* BitmapCachePersistFile =
-	    freerdp_settings_get_string(settings, FreeRDP_BitmapCachePersistFile);
-	if (!BitmapCachePersistFile)
+	if (!gfx->persistent)
 		return CHANNEL_RC_OK;
 
-	persistent = persistent_cache_new();
-
-	if (!persistent)
-		return CHANNEL_RC_NO_MEMORY;
-
-	if (persistent_cache_open(persistent, BitmapCachePersistFile, FALSE, 3) < 1)
-	{
-		error = CHANNEL_RC_INITIALIZATION_ERROR;
-		goto fail;
-	}
-
-	if (persistent_cache_get_version(persistent) != 3)
-	{
-		error = ERROR_INVALID_DATA;
-		goto fail;
-	}
-
-	int count = persistent_cache_get_count(persistent);
+	int count = persistent_cache_get_count(gfx->persistent);
 
 	count = (count < reply->importedEntriesCount) ? count : reply->importedEntriesCount;
 
 	WLog_Print(gfx->base.log, WLOG_DEBUG, "Receiving Cache Import Reply: %d", count);
 
+	/* Imported slots rank below every slot used in this session, in the order of the file */
+	if (gfx->CacheSlotClock < RDPGFX_CACHE_ENTRY_MAX_COUNT)
+		gfx->CacheSlotClock = RDPGFX_CACHE_ENTRY_MAX_COUNT;
+
 	for (int idx = 0; idx < count; idx++)
 	{
-		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
-		if (persistent_cache_read_entry(persistent, &entry) < 1)
-		{
-			error = ERROR_INVALID_DATA;
-			goto fail;
-		}
-
 		const UINT16 cacheSlot = reply->cacheSlots[idx];
-		if (context && context->ImportCacheEntry)
-		{
-			error = context->ImportCacheEntry(context, cacheSlot, &entry);
-			if (error != CHANNEL_RC_OK)
-				break;
-		}
-	}
 
-	persistent_cache_free(persistent);
+		if ((cacheSlot == 0) || (cacheSlot > gfx->MaxCacheSlots))
+			continue;
 
-	return error;
-fail:
-	persistent_cache_free(persistent);
-	return error;
+		gfx->CacheSlotImports[cacheSlot - 1] = (UINT32)idx + 1;
+		gfx->CacheSlotStamps[cacheSlot - 1] = (UINT64)(count - idx);
+	}
+
+	return CHANNEL_RC_OK;
 }
 
 /**
@@ -1837,6 +1967,8 @@ static UINT rdpgfx_recv_surface_to_cache_pdu(GENERIC_CHANNEL_CALLBACK* callback,
 	           pdu.surfaceId, pdu.cacheKey, pdu.cacheSlot, pdu.rectSrc.left, pdu.rectSrc.top,
 	           pdu.rectSrc.right, pdu.rectSrc.bottom);
 
+	rdpgfx_touch_cache_slot(gfx, pdu.cacheSlot);
+
 	if (context)
 	{
 		IFCALLRET(context->SurfaceToCache, error, context, &pdu);
@@ -1844,6 +1976,8 @@ static UINT rdpgfx_recv_surface_to_cache_pdu(GENERIC_CHANNEL_CALLBACK* callback,
 		if (error)
 			WLog_Print(gfx->base.log, WLOG_ERROR,
 			           "context->SurfaceToCache failed with error %" PRIu32 "", error);
+		else
+			rdpgfx_journal_cache_slot(gfx, pdu.cacheSlot);
 	}
 
 	return error;
@@ -1900,6 +2034,17 @@ static UINT rdpgfx_recv_cache_to_surface_pdu(GENERIC_CHANNEL_CALLBACK* callback,
 	           " destPtsCount: %" PRIu16 "",
 	           pdu.cacheSlot, pdu.surfaceId, pdu.destPtsCount);
 
+	error = rdpgfx_load_cache_slot(gfx, pdu.cacheSlot);
+	if (error)
+	{
+		WLog_Print(gfx->base.log, WLOG_ERROR,
+		           "rdpgfx_load_cache_slot failed with error %" PRIu32 "", error);
+		free(pdu.destPts);
+		return error;
+	}
+
+	rdpgfx_touch_cache_slot(gfx, pdu.cacheSlot);
+
 	if (context)
 	{
 		IFCALLRET(context->CacheToSurface, error, context, &pdu);
@@ -2419,6 +2564,7 @@ static UINT rdpgfx_on_close(IWTSVirtualChannelCallback* pChannelCallback)
 		WLog_Print(gfx->base.log, WLOG_ERROR,
 		           "rdpgfx_save_persistent_cache failed with error %" PRIu32 "", error);
 	}
+	rdpgfx_free_persistent_cache(gfx);
 
 	free_surfaces(context, gfx->SurfaceTable);
 	error = evict_cache_slots(context, gfx->MaxCacheSlots, gfx->CacheSlots);
@@ -2639,6 +2785,7 @@ void rdpgfx_client_context_free(RdpgfxClientContext* context)
 
 	free_surfaces(context, gfx->SurfaceTable);
 	evict_cache_slots(context, gfx->MaxCacheSlots, gfx->CacheSlots);
+	rdpgfx_free_persistent_cache(gfx);
 
 	if (gfx->zgfx)
 	{
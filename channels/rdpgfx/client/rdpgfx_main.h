@@ -49,7 +49,11 @@ typedef struct
 
 	UINT16 MaxCacheSlots;
 	void* CacheSlots[25600];
-	rdpPersistentCache* persistent;
+	UINT64 CacheSlotStamps[25600];  /* last use of a slot, orders the saved cache */
+	UINT32 CacheSlotImports[25600]; /* 1-based entry of persistent not imported yet */
+	UINT64 CacheSlotClock;
+	rdpPersistentCache* persistent; /* cache file offered to the server */
+	UINT32 CacheSlotsAppended;      /* entries appended to persistent, up to MaxCacheSlots */
 
 	rdpContext* rdpcontext;
 
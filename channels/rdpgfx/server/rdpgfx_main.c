@@ -153,20 +153,22 @@ WINPR_ATTR_NODISCARD static UINT rdpgfx_server_packet_send(RdpgfxServerContext*
 	{
 		const size_t pos = Stream_GetPosition(fs);
 		WINPR_ASSERT(pos <= UINT32_MAX);
-		if (!WTSVirtualChannelWrite(context->priv->rdpgfx_channel, Stream_BufferAs(fs, char),
-		                            (UINT32)pos, &written))
+
+		/* The channel manager sends from the stream and releases it */
+		wStream* packet = fs;
+		fs = nullptr;
+		if (!WTSVirtualChannelWriteStream(context->priv->rdpgfx_channel, packet, &written))
 		{
-			WLog_Print(context->priv->log, WLOG_ERROR, "WTSVirtualChannelWrite failed!");
+			WLog_Print(context->priv->log, WLOG_ERROR, "WTSVirtualChannelWriteStream failed!");
 			error = ERROR_INTERNAL_ERROR;
 			goto out;
 		}
-	}
 
-	if (written < Stream_GetPosition(fs))
-	{
-		WLog_Print(context->priv->log, WLOG_WARN,
-		           "Unexpected bytes written: %" PRIu32 "/%" PRIuz "", written,
-		           Stream_GetPosition(fs));
+		if (written < pos)
+		{
+			WLog_Print(context->priv->log, WLOG_WARN,
+			           "Unexpected bytes written: %" PRIu32 "/%" PRIuz "", written, pos);
+		}
 	}
 
 	error = CHANNEL_RC_OK;
@@ -913,8 +915,6 @@ rdpgfx_send_surface_frame_command(RdpgfxServerContext* context, const RDPGFX_SUR
 
 	WINPR_ASSERT(context->priv);
 	WINPR_ASSERT(cmd);
-	WINPR_ASSERT(startFrame);
-	WINPR_ASSERT(endFrame);
 
 	UINT error = CHANNEL_RC_OK;
 	size_t size = rdpgfx_pdu_length(rdpgfx_estimate_surface_command(cmd));
@@ -0,0 +1,261 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 MIT-SHM image presentation test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#include <freerdp/log.h>
+
+#include "../xf_shm.h"
+#include "../xfreerdp.h"
+
+#define TEST_WIDTH 96
+#define TEST_HEIGHT 64
+#define TEST_CONTEXTS 4
+#define TEST_ROUNDS 8
+
+typedef struct
+{
+	xfContext* xfc;
+	Pixmap pixmap;
+	BOOL fallback; /* The server was started without MIT-SHM */
+	BOOL rc;
+} test_context;
+
+static unsigned long test_pixel(const Visual* visual, int x, int y, UINT32 seed)
+{
+	const unsigned long value = (1ul * (UINT32)x * 0x9E3779B1u) ^ (1ul * (UINT32)y * 0x85EBCA77u) ^
+	                            (1ul * seed * 0xC2B2AE3Du);
+	return value & (visual->red_mask | visual->green_mask | visual->blue_mask);
+}
+
+static void test_context_free(test_context* test)
+{
+	WINPR_ASSERT(test);
+
+	xfContext* xfc = test->xfc;
+	if (!xfc)
+		return;
+
+	if (xfc->display)
+	{
+		if (xfc->gc)
+			XFreeGC(xfc->display, xfc->gc);
+		if (test->pixmap)
+			XFreePixmap(xfc->display, test->pixmap);
+		XCloseDisplay(xfc->display);
+	}
+
+	(void)CloseHandle(xfc->mutex);
+	free(xfc);
+	test->xfc = nullptr;
+}
+
+/* The parts of a client context the image functions use, every context has its own display */
+static BOOL test_context_new(test_context* test)
+{
+	WINPR_ASSERT(test);
+
+	xfContext* xfc = test->xfc = calloc(1, sizeof(xfContext));
+	if (!xfc)
+		return FALSE;
+
+	xfc->log = WLog_Get(CLIENT_TAG("x11.test"));
+	xfc->mutex = CreateMutex(nullptr, FALSE, nullptr);
+	xfc->display = XOpenDisplay(nullptr);
+	if (!xfc->mutex || !xfc->display)
+	{
+		(void)fprintf(stderr, "unable to open the display\n");
+		return FALSE;
+	}
+
+	xfc->screen_number = DefaultScreen(xfc->display);
+	xfc->visual = DefaultVisual(xfc->display, xfc->screen_number);
+	xfc->depth = DefaultDepth(xfc->display, xfc->screen_number);
+	xfc->scanline_pad = 32;
+	test->pixmap = XCreatePixmap(xfc->display, RootWindow(xfc->display, xfc->screen_number),
+	                             TEST_WIDTH, TEST_HEIGHT, (unsigned)xfc->depth);
+	xfc->gc = XCreateGC(xfc->display, test->pixmap, 0, nullptr);
+	return xfc->gc != nullptr;
+}
+
+/* Puts a part of image to the pixmap and reads it back */
+static BOOL test_put(test_context* test, XImage* image, UINT32 seed)
+{
+	BOOL rc = FALSE;
+	xfContext* xfc = test->xfc;
+	const int srcX = 5;
+	const int srcY = 3;
+	const int dstX = 11;
+	const int dstY = 7;
+	const int width = MIN(image->width - srcX, TEST_WIDTH - dstX);
+	const int height = MIN(image->height - srcY, TEST_HEIGHT - dstY);
+
+	for (int y = 0; y < image->height; y++)
+	{
+		for (int x = 0; x < image->width; x++)
+			XPutPixel(image, x, y, test_pixel(xfc->visual, x, y, seed));
+	}
+
+	xf_lock_x11(xfc);
+	const BOOL put = xf_shm_put_image(xfc, test->pixmap, xfc->gc, image, srcX, srcY, dstX, dstY,
+	                                  (UINT32)width, (UINT32)height);
+	XSync(xfc->display, False);
+	XImage* result = XGetImage(xfc->display, test->pixmap, dstX, dstY, (unsigned)width,
+	                           (unsigned)height, AllPlanes, ZPixmap);
+	xf_unlock_x11(xfc);
+
+	if (!put || !result)
+		goto fail;
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			const unsigned long expect = test_pixel(xfc->visual, srcX + x, srcY + y, seed);
+			const unsigned long pixel = XGetPixel(result, x, y) & (xfc->visual->red_mask |
+			                                                       xfc->visual->green_mask |
+			                                                       xfc->visual->blue_mask);
+			if (pixel != expect)
+			{
+				(void)fprintf(stderr, "pixel %dx%d: expected 0x%08lx, got 0x%08lx\n", x, y,
+				              expect, pixel);
+				goto fail;
+			}
+		}
+	}
+
+	rc = TRUE;
+fail:
+	if (result)
+		XDestroyImage(result);
+	return rc;
+}
+
+/* A shared image sized for a padded decoder buffer, only the mapped part is visible */
+static BOOL test_shared(test_context* test, UINT32 seed)
+{
+	xfContext* xfc = test->xfc;
+	const UINT32 stride = TEST_WIDTH * 4 + 64;
+	const UINT32 rows = TEST_HEIGHT + 16;
+	XImage* image = xf_shm_image_new(xfc, TEST_WIDTH - 3, TEST_HEIGHT - 5, stride, rows);
+
+	if (test->fallback)
+	{
+		xf_shm_image_free(xfc, image);
+		return !image && !xfc->xshmAvailable;
+	}
+
+	if (!image || !xf_shm_image_is_shared(image) || (image->width != TEST_WIDTH - 3) ||
+	    (image->height != TEST_HEIGHT - 5) || (image->bytes_per_line < (int)stride))
+	{
+		(void)fprintf(stderr, "unexpected shared image\n");
+		xf_shm_image_free(xfc, image);
+		return FALSE;
+	}
+
+	/* The padding below the image belongs to the segment */
+	memset(&image->data[1ull * (rows - 1) * (UINT32)image->bytes_per_line], 0xA5,
+	       (UINT32)image->bytes_per_line);
+
+	const BOOL rc = test_put(test, image, seed);
+	xf_shm_image_free(xfc, image);
+	return rc;
+}
+
+/* Images not allocated by xf_shm_image_new are sent with XPutImage */
+static BOOL test_unshared(test_context* test, UINT32 seed)
+{
+	xfContext* xfc = test->xfc;
+	XImage* image = XCreateImage(xfc->display, xfc->visual, (unsigned)xfc->depth, ZPixmap, 0,
+	                             nullptr, TEST_WIDTH, TEST_HEIGHT, xfc->scanline_pad, 0);
+	if (!image)
+		return FALSE;
+
+	BOOL rc = FALSE;
+	image->data = calloc((size_t)image->bytes_per_line, TEST_HEIGHT);
+	if (image->data && !xf_shm_image_is_shared(image))
+		rc = test_put(test, image, seed);
+	XDestroyImage(image);
+	return rc;
+}
+
+static DWORD WINAPI test_thread(LPVOID arg)
+{
+	test_context* test = arg;
+	WINPR_ASSERT(test);
+
+	if (!test_context_new(test))
+		return 0;
+
+	if (xf_shm_init(test->xfc) == test->fallback)
+	{
+		(void)fprintf(stderr, "MIT-SHM %s\n", test->fallback ? "available" : "not available");
+		return 0;
+	}
+
+	for (UINT32 x = 0; x < TEST_ROUNDS; x++)
+	{
+		if (!test_shared(test, x) || !test_unshared(test, x))
+			return 0;
+	}
+
+	test->rc = TRUE;
+	return 0;
+}
+
+int TestXfShm(int argc, char* argv[])
+{
+	int rc = -1;
+	HANDLE threads[TEST_CONTEXTS] = WINPR_C_ARRAY_INIT;
+	test_context tests[TEST_CONTEXTS] = WINPR_C_ARRAY_INIT;
+	const BOOL fallback = (argc > 1) && (strcmp(argv[1], "fallback") == 0);
+
+	if (!XInitThreads())
+		return -1;
+
+	/* Every context checks its attach requests on its own display at the same time */
+	for (size_t x = 0; x < ARRAYSIZE(tests); x++)
+	{
+		tests[x].fallback = fallback;
+		threads[x] = CreateThread(nullptr, 0, test_thread, &tests[x], 0, nullptr);
+		if (!threads[x])
+			goto fail;
+	}
+
+	rc = 0;
+fail:
+	for (size_t x = 0; x < ARRAYSIZE(tests); x++)
+	{
+		if (threads[x])
+		{
+			(void)WaitForSingleObject(threads[x], INFINITE);
+			(void)CloseHandle(threads[x]);
+		}
+
+		if (!tests[x].rc)
+			rc = -1;
+		test_context_free(&tests[x]);
+	}
+
+	if (rc != 0)
+		(void)fprintf(stderr, "%s failed\n", fallback ? "XPutImage fallback" : "MIT-SHM");
+	return rc;
+}
@@ -100,6 +100,7 @@
 #include "xf_video.h"
 #include "xf_monitor.h"
 #include "xf_graphics.h"
+#include "xf_shm.h"
 #include "xf_keyboard.h"
 #include "xf_channels.h"
 #include "xf_client.h"
@@ -404,6 +405,51 @@ static BOOL xf_desktop_resize(rdpContext* context)
 	return TRUE;
 }
 
+/* The MIT-SHM staging image has the size of xfc->image, the primary buffer as it is mapped to
+ * the primary pixmap */
+static void xf_create_shm_image(xfContext* xfc)
+{
+	WINPR_ASSERT(xfc);
+
+	xf_shm_image_free(xfc, xfc->shm_image);
+	xfc->shm_image = nullptr;
+	if (!xfc->image || xfc->remote_app)
+		return;
+
+	xfc->shm_image = xf_shm_image_new(xfc, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->image->width),
+	                                  WINPR_ASSERTING_INT_CAST(uint32_t, xfc->image->height), 0,
+	                                  0);
+}
+
+/* Copies the area to the MIT-SHM staging image, XShmPutImage then does not send the pixels */
+static XImage* xf_paint_image(xfContext* xfc, const GDI_RGN* region)
+{
+	rdpGdi* gdi = xfc->common.context.gdi;
+	WINPR_ASSERT(gdi);
+
+	XImage* image = xfc->shm_image;
+	const XImage* mapped = xfc->image;
+	if (!image || !mapped || (image->width != mapped->width) ||
+	    (image->height != mapped->height))
+		return xfc->image;
+
+	if ((region->x < 0) || (region->y < 0) || (region->w <= 0) || (region->h <= 0) ||
+	    (region->w > image->width - region->x) || (region->h > image->height - region->y))
+		return xfc->image;
+
+	const UINT32 x = WINPR_ASSERTING_INT_CAST(UINT32, region->x);
+	const UINT32 y = WINPR_ASSERTING_INT_CAST(UINT32, region->y);
+	const UINT32 w = WINPR_ASSERTING_INT_CAST(UINT32, region->w);
+	const UINT32 h = WINPR_ASSERTING_INT_CAST(UINT32, region->h);
+	const UINT32 step = WINPR_ASSERTING_INT_CAST(UINT32, image->bytes_per_line);
+	if (!freerdp_image_copy_no_overlap((BYTE*)image->data, gdi->dstFormat, step, x, y, w, h,
+	                                   gdi->primary_buffer, gdi->dstFormat, gdi->stride, x, y,
+	                                   nullptr, FREERDP_FLIP_NONE))
+		return xfc->image;
+
+	return image;
+}
+
 static BOOL xf_paint(xfContext* xfc, const GDI_RGN* region)
 {
 	WINPR_ASSERT(xfc);
@@ -421,15 +467,24 @@ static BOOL xf_paint(xfContext* xfc, const GDI_RGN* region)
 	}
 	else
 	{
-		LogDynAndXPutImage(xfc->log, xfc->display, xfc->primary, xfc->gc, xfc->image, region->x,
-		                   region->y, region->x, region->y,
-		                   WINPR_ASSERTING_INT_CAST(UINT16, region->w),
-		                   WINPR_ASSERTING_INT_CAST(UINT16, region->h));
+		XImage* image = xf_paint_image(xfc, region);
+		xf_shm_put_image(xfc, xfc->primary, xfc->gc, image, region->x, region->y, region->x,
+		                 region->y, WINPR_ASSERTING_INT_CAST(UINT16, region->w),
+		                 WINPR_ASSERTING_INT_CAST(UINT16, region->h));
 		xf_draw_screen(xfc, region->x, region->y, region->w, region->h);
 	}
 	return TRUE;
 }
 
+static void xf_paint_flush(xfContext* xfc)
+{
+	/* The server reads the staging image asynchronously, wait for it once per frame */
+	if (xfc->shm_image)
+		LogDynAndXSync(xfc->log, xfc->display, False);
+	else
+		LogDynAndXFlush(xfc->log, xfc->display);
+}
+
 static BOOL xf_end_paint(rdpContext* context)
 {
 	xfContext* xfc = (xfContext*)context;
@@ -454,6 +509,7 @@ static BOOL xf_end_paint(rdpContext* context)
 		xf_lock_x11(xfc);
 		if (!xf_paint(xfc, rgn))
 			return FALSE;
+		xf_paint_flush(xfc);
 		xf_unlock_x11(xfc);
 	}
 	else
@@ -473,7 +529,7 @@ static BOOL xf_end_paint(rdpContext* context)
 				return FALSE;
 		}
 
-		LogDynAndXFlush(xfc->log, xfc->display);
+		xf_paint_flush(xfc);
 		xf_unlock_x11(xfc);
 	}
 
@@ -525,6 +581,8 @@ static BOOL xf_sw_desktop_resize(rdpContext* context)
 
 	xfc->image->byte_order = LSBFirst;
 	xfc->image->bitmap_bit_order = LSBFirst;
+
+	xf_create_shm_image(xfc);
 	ret = xf_desktop_resize(context);
 out:
 	xf_unlock_x11(xfc);
@@ -762,6 +820,9 @@ BOOL xf_create_image(xfContext* xfc)
 		xfc->image->byte_order = LSBFirst;
 		xfc->image->bitmap_bit_order = LSBFirst;
 	}
+
+	if (!xfc->shm_image)
+		xf_create_shm_image(xfc);
 	return TRUE;
 }
 
@@ -788,6 +849,9 @@ void xf_destroy_window(xfContext* xfc)
 		xfc->image = nullptr;
 	}
 
+	xf_shm_image_free(xfc, xfc->shm_image);
+	xfc->shm_image = nullptr;
+
 	if (xfc->bitmap_mono)
 	{
 		LogDynAndXFreePixmap(xfc->log, xfc->display, xfc->bitmap_mono);
@@ -971,6 +1035,8 @@ static void xf_check_extensions(xfContext* context)
 		}
 	}
 #endif
+
+	(void)xf_shm_init(context);
 }
 
 #ifdef WITH_XI
@@ -29,6 +29,7 @@
 #include <freerdp/log.h>
 #include "xf_gfx.h"
 #include "xf_rail.h"
+#include "xf_shm.h"
 #include "xf_utils.h"
 #include "xf_window.h"
 
@@ -98,11 +99,11 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 
 		if (xfc->remote_app)
 		{
-			LogDynAndXPutImage(xfc->log, xfc->display, xfc->primary, xfc->gc, surface->image,
-			                   WINPR_ASSERTING_INT_CAST(int, nXSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nYSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nXDst),
-			                   WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
+			xf_shm_put_image(xfc, xfc->primary, xfc->gc, surface->image,
+			                 WINPR_ASSERTING_INT_CAST(int, nXSrc),
+			                 WINPR_ASSERTING_INT_CAST(int, nYSrc),
+			                 WINPR_ASSERTING_INT_CAST(int, nXDst),
+			                 WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
 			xf_rail_paint_surface(xfc, surface->gdi.windowId, rect);
 		}
 		else
@@ -110,11 +111,11 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 		    if (freerdp_settings_get_bool(settings, FreeRDP_SmartSizing) ||
 		        freerdp_settings_get_bool(settings, FreeRDP_MultiTouchGestures))
 		{
-			LogDynAndXPutImage(xfc->log, xfc->display, xfc->primary, xfc->gc, surface->image,
-			                   WINPR_ASSERTING_INT_CAST(int, nXSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nYSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nXDst),
-			                   WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
+			xf_shm_put_image(xfc, xfc->primary, xfc->gc, surface->image,
+			                 WINPR_ASSERTING_INT_CAST(int, nXSrc),
+			                 WINPR_ASSERTING_INT_CAST(int, nYSrc),
+			                 WINPR_ASSERTING_INT_CAST(int, nXDst),
+			                 WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
 			xf_draw_screen(xfc, WINPR_ASSERTING_INT_CAST(int32_t, nXDst),
 			               WINPR_ASSERTING_INT_CAST(int32_t, nYDst),
 			               WINPR_ASSERTING_INT_CAST(int32_t, dwidth),
@@ -123,11 +124,11 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 		else
 #endif
 		{
-			LogDynAndXPutImage(xfc->log, xfc->display, xfc->drawable, xfc->gc, surface->image,
-			                   WINPR_ASSERTING_INT_CAST(int, nXSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nYSrc),
-			                   WINPR_ASSERTING_INT_CAST(int, nXDst),
-			                   WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
+			xf_shm_put_image(xfc, xfc->drawable, xfc->gc, surface->image,
+			                 WINPR_ASSERTING_INT_CAST(int, nXSrc),
+			                 WINPR_ASSERTING_INT_CAST(int, nYSrc),
+			                 WINPR_ASSERTING_INT_CAST(int, nXDst),
+			                 WINPR_ASSERTING_INT_CAST(int, nYDst), dwidth, dheight);
 		}
 	}
 
@@ -135,7 +136,6 @@ static UINT xf_OutputUpdate(xfContext* xfc, xfGfxSurface* surface)
 fail:
 	region16_clear(&surface->gdi.invalidRegion);
 	LogDynAndXSetClipMask(xfc->log, xfc->display, xfc->gc, None);
-	LogDynAndXSync(xfc->log, xfc->display, False);
 	xf_unlock_x11(xfc);
 	return rc;
 }
@@ -154,6 +154,7 @@ static UINT xf_UpdateSurfaces(RdpgfxClientContext* context)
 	UINT16* pSurfaceIds = nullptr;
 	rdpGdi* gdi = (rdpGdi*)context->custom;
 	xfContext* xfc = nullptr;
+	BOOL output = FALSE;
 
 	if (!gdi)
 		return status;
@@ -182,7 +183,10 @@ static UINT xf_UpdateSurfaces(RdpgfxClientContext* context)
 		}
 
 		if (surface->gdi.outputMapped)
+		{
 			status = xf_OutputUpdate(xfc, surface);
+			output = TRUE;
+		}
 		else if (surface->gdi.windowMapped)
 			status = xf_WindowUpdate(context, surface);
 
@@ -190,6 +194,15 @@ static UINT xf_UpdateSurfaces(RdpgfxClientContext* context)
 			break;
 	}
 
+	/* Surface images are read by the server asynchronously, wait for it once per frame and not
+	 * per surface before they are decoded to again */
+	if (output)
+	{
+		xf_lock_x11(xfc);
+		LogDynAndXSync(xfc->log, xfc->display, False);
+		xf_unlock_x11(xfc);
+	}
+
 fail:
 	free(pSurfaceIds);
 	LeaveCriticalSection(&context->mux);
@@ -288,6 +301,32 @@ static UINT32 x11_pad_scanline(UINT32 scanline, UINT32 inPad)
 	return scanline;
 }
 
+/* Frees the image and pixel buffers of a surface, one of them might be owned by the image */
+static void xf_gfx_surface_free_image(xfContext* xfc, xfGfxSurface* surface)
+{
+	WINPR_ASSERT(surface);
+
+	if (xf_shm_image_is_shared(surface->image))
+	{
+		if (surface->stage)
+			surface->stage = nullptr;
+		else
+			surface->gdi.data = nullptr;
+		xf_shm_image_free(xfc, surface->image);
+	}
+	else if (surface->image)
+	{
+		surface->image->data = nullptr;
+		XDestroyImage(surface->image);
+	}
+
+	surface->image = nullptr;
+	winpr_aligned_free(surface->stage);
+	surface->stage = nullptr;
+	winpr_aligned_free(surface->gdi.data);
+	surface->gdi.data = nullptr;
+}
+
 /**
  * Function description
  *
@@ -341,25 +380,46 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 	surface->gdi.scanline = surface->gdi.width * FreeRDPGetBytesPerPixel(surface->gdi.format);
 	surface->gdi.scanline = x11_pad_scanline(surface->gdi.scanline,
 	                                         WINPR_ASSERTING_INT_CAST(uint32_t, xfc->scanline_pad));
-	size = 1ull * surface->gdi.scanline * surface->gdi.height;
-	surface->gdi.data = (BYTE*)winpr_aligned_malloc(size, 16);
+	const BOOL direct = FreeRDPAreColorFormatsEqualNoAlpha(gdi->dstFormat, surface->gdi.format);
+
+	/* Decode directly to the shared memory image if possible. The image has the mapped size,
+	 * the segment holds the padded surface. */
+	if (direct)
+		surface->image =
+		    xf_shm_image_new(xfc, surface->gdi.mappedWidth, surface->gdi.mappedHeight,
+		                     surface->gdi.scanline, surface->gdi.height);
 
-	if (!surface->gdi.data)
+	if (surface->image)
 	{
-		WLog_ERR(TAG, "unable to allocate GDI data");
-		goto out_free;
+		WINPR_ASSERT(surface->image->bytes_per_line >= 0);
+		surface->gdi.scanline = (UINT32)surface->image->bytes_per_line;
+		surface->gdi.data = (BYTE*)surface->image->data;
 	}
+	else
+	{
+		size = 1ull * surface->gdi.scanline * surface->gdi.height;
+		surface->gdi.data = (BYTE*)winpr_aligned_malloc(size, 16);
 
-	ZeroMemory(surface->gdi.data, size);
+		if (!surface->gdi.data)
+		{
+			WLog_ERR(TAG, "unable to allocate GDI data");
+			goto out_free;
+		}
 
-	if (FreeRDPAreColorFormatsEqualNoAlpha(gdi->dstFormat, surface->gdi.format))
+		ZeroMemory(surface->gdi.data, size);
+	}
+
+	if (direct)
 	{
-		WINPR_ASSERT(xfc->depth != 0);
-		surface->image = LogDynAndXCreateImage(
-		    xfc->log, xfc->display, xfc->visual, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth),
-		    ZPixmap, 0, (char*)surface->gdi.data, surface->gdi.mappedWidth,
-		    surface->gdi.mappedHeight, xfc->scanline_pad,
-		    WINPR_ASSERTING_INT_CAST(int, surface->gdi.scanline));
+		if (!surface->image)
+		{
+			WINPR_ASSERT(xfc->depth != 0);
+			surface->image = LogDynAndXCreateImage(
+			    xfc->log, xfc->display, xfc->visual,
+			    WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap, 0,
+			    (char*)surface->gdi.data, surface->gdi.mappedWidth, surface->gdi.mappedHeight,
+			    xfc->scanline_pad, WINPR_ASSERTING_INT_CAST(int, surface->gdi.scanline));
+		}
 	}
 	else
 	{
@@ -368,27 +428,41 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 		surface->stageScanline = width * bytes;
 		surface->stageScanline = x11_pad_scanline(
 		    surface->stageScanline, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->scanline_pad));
-		size = 1ull * surface->stageScanline * surface->gdi.height;
-		surface->stage = (BYTE*)winpr_aligned_malloc(size, 16);
+		surface->image =
+		    xf_shm_image_new(xfc, surface->gdi.mappedWidth, surface->gdi.mappedHeight,
+		                     surface->stageScanline, surface->gdi.height);
 
-		if (!surface->stage)
+		if (surface->image)
 		{
-			WLog_ERR(TAG, "unable to allocate stage buffer");
-			goto out_free_gdidata;
+			WINPR_ASSERT(surface->image->bytes_per_line >= 0);
+			surface->stageScanline = (UINT32)surface->image->bytes_per_line;
+			surface->stage = (BYTE*)surface->image->data;
 		}
+		else
+		{
+			size = 1ull * surface->stageScanline * surface->gdi.height;
+			surface->stage = (BYTE*)winpr_aligned_malloc(size, 16);
+
+			if (!surface->stage)
+			{
+				WLog_ERR(TAG, "unable to allocate stage buffer");
+				goto out_free_gdidata;
+			}
 
-		ZeroMemory(surface->stage, size);
-		WINPR_ASSERT(xfc->depth != 0);
-		surface->image = LogDynAndXCreateImage(
-		    xfc->log, xfc->display, xfc->visual, WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth),
-		    ZPixmap, 0, (char*)surface->stage, surface->gdi.mappedWidth, surface->gdi.mappedHeight,
-		    xfc->scanline_pad, WINPR_ASSERTING_INT_CAST(int, surface->stageScanline));
+			ZeroMemory(surface->stage, size);
+			WINPR_ASSERT(xfc->depth != 0);
+			surface->image = LogDynAndXCreateImage(
+			    xfc->log, xfc->display, xfc->visual,
+			    WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap, 0, (char*)surface->stage,
+			    surface->gdi.mappedWidth, surface->gdi.mappedHeight, xfc->scanline_pad,
+			    WINPR_ASSERTING_INT_CAST(int, surface->stageScanline));
+		}
 	}
 
 	if (!surface->image)
 	{
 		WLog_ERR(TAG, "an error occurred when creating the XImage");
-		goto error_surface_image;
+		goto out_free_gdidata;
 	}
 
 	surface->image->byte_order = LSBFirst;
@@ -399,17 +473,12 @@ static UINT xf_CreateSurface(RdpgfxClientContext* context,
 	if (context->SetSurfaceData(context, surface->gdi.surfaceId, (void*)surface) != CHANNEL_RC_OK)
 	{
 		WLog_ERR(TAG, "an error occurred during SetSurfaceData");
-		goto error_set_surface_data;
+		goto out_free_gdidata;
 	}
 
 	return CHANNEL_RC_OK;
-error_set_surface_data:
-	surface->image->data = nullptr;
-	XDestroyImage(surface->image);
-error_surface_image:
-	winpr_aligned_free(surface->stage);
 out_free_gdidata:
-	winpr_aligned_free(surface->gdi.data);
+	xf_gfx_surface_free_image(xfc, surface);
 out_free:
 	free(surface);
 	return ret;
@@ -424,6 +493,8 @@ static UINT xf_DeleteSurface(RdpgfxClientContext* context,
                              const RDPGFX_DELETE_SURFACE_PDU* deleteSurface)
 {
 	rdpCodecs* codecs = nullptr;
+	rdpGdi* gdi = (rdpGdi*)context->custom;
+	WINPR_ASSERT(gdi);
 
 	UINT status = 0;
 	EnterCriticalSection(&context->mux);
@@ -446,10 +517,7 @@ static UINT xf_DeleteSurface(RdpgfxClientContext* context,
 #if defined(WITH_GFX_AV1)
 		freerdp_av1_context_free(surface->gdi.av1);
 #endif
-		surface->image->data = nullptr;
-		XDestroyImage(surface->image);
-		winpr_aligned_free(surface->gdi.data);
-		winpr_aligned_free(surface->stage);
+		xf_gfx_surface_free_image((xfContext*)gdi->context, surface);
 		region16_uninit(&surface->gdi.invalidRegion);
 		codecs = surface->gdi.codecs;
 		free(surface);
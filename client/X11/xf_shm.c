@@ -0,0 +1,277 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 MIT-SHM Image Presentation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+
+#include <freerdp/log.h>
+
+#include "xf_shm.h"
+#include "xf_utils.h"
+#include "xfreerdp.h"
+
+#if defined(WITH_XSHM)
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+
+/* The error hook needs the wire error, Xmd.h collides with the WinPR BOOL and BYTE */
+#define BOOL XBOOL
+#define BYTE XBYTE
+#include <X11/Xlibint.h>
+#include <X11/extensions/shmproto.h>
+#undef BOOL
+#undef BYTE
+#endif
+
+#define TAG CLIENT_TAG("x11")
+
+#if defined(WITH_XSHM)
+/* State of the XShmAttach check, kept on the extension data list of the display */
+typedef struct
+{
+	int opcode;           /* major opcode of MIT-SHM */
+	unsigned long serial; /* XShmAttach request being checked, 0 if none */
+	BOOL failed;
+} xfShmDisplay;
+
+static xfShmDisplay* xf_shm_display_get(Display* display, int extension)
+{
+	XEDataObject object = { .display = display };
+
+	if (extension == 0)
+		return nullptr;
+
+	XExtData* data = XFindOnExtensionList(XEHeadOfExtensionList(object), extension);
+	if (!data)
+		return nullptr;
+	return (xfShmDisplay*)data->private_data;
+}
+
+static int xf_shm_display_free(XExtData* data)
+{
+	free(data->private_data);
+	return 0;
+}
+
+/* Called by Xlib for every error of the display, before the process wide error handler */
+static int xf_shm_error_hook(Display* display, xError* error, XExtCodes* codes, int* ret_code)
+{
+	xfShmDisplay* state = xf_shm_display_get(display, codes->extension);
+
+	if (!state || (state->serial == 0) || (error->majorCode != state->opcode) ||
+	    (error->minorCode != X_ShmAttach) || (error->sequenceNumber != (state->serial & 0xFFFF)))
+		return 0;
+
+	state->failed = TRUE;
+	*ret_code = 0;
+	return 1;
+}
+
+/* Registers the error hook for the display of xfc, once per display */
+static BOOL xf_shm_display_register(xfContext* xfc, int opcode)
+{
+	if (xf_shm_display_get(xfc->display, xfc->xshmExtension))
+		return TRUE;
+
+	XExtCodes* codes = XAddExtension(xfc->display);
+	XExtData* data = calloc(1, sizeof(XExtData));
+	xfShmDisplay* state = calloc(1, sizeof(xfShmDisplay));
+	if (!codes || !data || !state)
+	{
+		free(data);
+		free(state);
+		return FALSE;
+	}
+
+	XEDataObject object = { .display = xfc->display };
+	state->opcode = opcode;
+	data->number = codes->extension;
+	data->free_private = xf_shm_display_free;
+	data->private_data = (XPointer)state;
+	(void)XAddToExtensionList(XEHeadOfExtensionList(object), data);
+	(void)XESetError(xfc->display, codes->extension, xf_shm_error_hook);
+	xfc->xshmExtension = codes->extension;
+	return TRUE;
+}
+
+/* XShmAttach errors are reported asynchronously, e.g. for a display on another host. The hook
+ * only takes the error of this request, other contexts and displays are not affected. */
+static BOOL xf_shm_attach(xfContext* xfc, XShmSegmentInfo* info)
+{
+	BOOL attached = FALSE;
+
+	xf_lock_x11(xfc);
+	xfShmDisplay* state = xf_shm_display_get(xfc->display, xfc->xshmExtension);
+	if (state)
+	{
+		state->failed = FALSE;
+		state->serial = NextRequest(xfc->display);
+		const Status status = XShmAttach(xfc->display, info);
+		XSync(xfc->display, False);
+		attached = status && !state->failed;
+		state->serial = 0;
+	}
+	xf_unlock_x11(xfc);
+	return attached;
+}
+#endif
+
+BOOL xf_shm_init(xfContext* xfc)
+{
+	WINPR_ASSERT(xfc);
+
+	xfc->xshmAvailable = FALSE;
+#if defined(WITH_XSHM)
+	int opcode = 0;
+	int event = 0;
+	int error = 0;
+
+	xf_lock_x11(xfc);
+	if (XQueryExtension(xfc->display, "MIT-SHM", &opcode, &event, &error) &&
+	    XShmQueryExtension(xfc->display) && xf_shm_display_register(xfc, opcode))
+		xfc->xshmAvailable = TRUE;
+	xf_unlock_x11(xfc);
+
+	if (!xfc->xshmAvailable)
+		WLog_DBG(TAG, "MIT-SHM not available, using XPutImage");
+#endif
+	return xfc->xshmAvailable;
+}
+
+XImage* xf_shm_image_new(xfContext* xfc, UINT32 width, UINT32 height, UINT32 stride, UINT32 rows)
+{
+	WINPR_ASSERT(xfc);
+
+	if (!xfc->xshmAvailable || (width == 0) || (height == 0))
+		return nullptr;
+
+#if defined(WITH_XSHM)
+	XImage* image = nullptr;
+	XShmSegmentInfo* info = calloc(1, sizeof(XShmSegmentInfo));
+	if (!info)
+		return nullptr;
+
+	info->shmid = -1;
+	info->shmaddr = (char*)-1;
+
+	WINPR_ASSERT(xfc->depth != 0);
+	image = XShmCreateImage(xfc->display, xfc->visual,
+	                        WINPR_ASSERTING_INT_CAST(uint32_t, xfc->depth), ZPixmap, nullptr, info,
+	                        width, height);
+	if (!image)
+		goto fail;
+
+	if (stride > WINPR_ASSERTING_INT_CAST(uint32_t, image->bytes_per_line))
+		image->bytes_per_line = WINPR_ASSERTING_INT_CAST(int, stride);
+
+	const size_t size =
+	    1ull * WINPR_ASSERTING_INT_CAST(uint32_t, image->bytes_per_line) * MAX(height, rows);
+	info->shmid = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+	if (info->shmid < 0)
+		goto fail;
+
+	info->shmaddr = shmat(info->shmid, nullptr, 0);
+	if (info->shmaddr == (char*)-1)
+		goto fail;
+
+	info->readOnly = False;
+	image->data = info->shmaddr;
+
+	const BOOL attached = xf_shm_attach(xfc, info);
+
+	/* The segment is released with the last detach */
+	(void)shmctl(info->shmid, IPC_RMID, nullptr);
+	info->shmid = -1;
+
+	if (!attached)
+	{
+		WLog_WARN(TAG, "XShmAttach failed, falling back to XPutImage");
+		xfc->xshmAvailable = FALSE;
+		goto fail;
+	}
+
+	image->byte_order = LSBFirst;
+	image->bitmap_bit_order = LSBFirst;
+	return image;
+
+fail:
+	if (info->shmaddr != (char*)-1)
+		(void)shmdt(info->shmaddr);
+	if (info->shmid >= 0)
+		(void)shmctl(info->shmid, IPC_RMID, nullptr);
+	if (image)
+	{
+		image->data = nullptr;
+		image->obdata = nullptr;
+		XDestroyImage(image);
+	}
+	free(info);
+	return nullptr;
+#else
+	return nullptr;
+#endif
+}
+
+void xf_shm_image_free(xfContext* xfc, XImage* image)
+{
+	WINPR_ASSERT(xfc);
+
+	if (!image)
+		return;
+
+#if defined(WITH_XSHM)
+	XShmSegmentInfo* info = (XShmSegmentInfo*)image->obdata;
+	if (info)
+	{
+		xf_lock_x11(xfc);
+		XShmDetach(xfc->display, info);
+		LogDynAndXSync(xfc->log, xfc->display, False);
+		xf_unlock_x11(xfc);
+		(void)shmdt(info->shmaddr);
+		free(info);
+	}
+#endif
+
+	/* XDestroyImage would free both with the wrong allocator */
+	image->data = nullptr;
+	image->obdata = nullptr;
+	XDestroyImage(image);
+}
+
+BOOL xf_shm_image_is_shared(const XImage* image)
+{
+	return image && image->obdata;
+}
+
+BOOL xf_shm_put_image(xfContext* xfc, Drawable d, GC gc, XImage* image, int src_x, int src_y,
+                      int dest_x, int dest_y, UINT32 width, UINT32 height)
+{
+	WINPR_ASSERT(xfc);
+	WINPR_ASSERT(image);
+
+#if defined(WITH_XSHM)
+	if (xf_shm_image_is_shared(image))
+		return XShmPutImage(xfc->display, d, gc, image, src_x, src_y, dest_x, dest_y, width,
+		                    height, False) != 0;
+#endif
+
+	return LogDynAndXPutImage(xfc->log, xfc->display, d, gc, image, src_x, src_y, dest_x, dest_y,
+	                          width, height) == Success;
+}
@@ -0,0 +1,59 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * X11 MIT-SHM Image Presentation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_CLIENT_X11_SHM_H
+#define FREERDP_CLIENT_X11_SHM_H
+
+#include <X11/Xlib.h>
+
+#include "xf_types.h"
+
+/** @brief Checks if the display supports MIT-SHM, the result is kept in xfc->xshmAvailable */
+BOOL xf_shm_init(xfContext* xfc);
+
+/** @brief Frees an image allocated with xf_shm_image_new */
+void xf_shm_image_free(xfContext* xfc, XImage* image);
+
+/**
+ * @brief Allocates an XImage of the visual of the display backed by a shared memory segment.
+ *
+ * The image is \b width x \b height pixels. The segment holds at least \b rows lines of at
+ * least \b stride bytes, so a buffer padded beyond the visible area can be decoded to directly.
+ * Pass 0 to size the segment for the image only.
+ *
+ * The pixel data is owned by the image, image->bytes_per_line is the stride to use.
+ * Returns nullptr if MIT-SHM is not usable, callers fall back to XCreateImage then.
+ */
+WINPR_ATTR_MALLOC(xf_shm_image_free, 2)
+WINPR_ATTR_NODISCARD
+XImage* xf_shm_image_new(xfContext* xfc, UINT32 width, UINT32 height, UINT32 stride, UINT32 rows);
+
+/** @brief Returns TRUE if image was allocated with xf_shm_image_new */
+WINPR_ATTR_NODISCARD
+BOOL xf_shm_image_is_shared(const XImage* image);
+
+/**
+ * @brief Puts an area of image to a drawable, with XShmPutImage for shared images and
+ * XPutImage otherwise.
+ *
+ * The server reads shared images asynchronously, the caller must XSync before the pixel data
+ * of the area is modified again.
+ */
+BOOL xf_shm_put_image(xfContext* xfc, Drawable d, GC gc, XImage* image, int src_x, int src_y,
+                      int dest_x, int dest_y, UINT32 width, UINT32 height);
+
+#endif /* FREERDP_CLIENT_X11_SHM_H */
@@ -151,6 +151,7 @@ struct xf_context
 	BOOL invert;
 	Screen* screen;
 	XImage* image;
+	XImage* shm_image;
 	Pixmap primary;
 	Pixmap drawing;
 	Visual* visual;
@@ -296,6 +297,8 @@ struct xf_context
 
 	BOOL xkbAvailable;
 	BOOL xrenderAvailable;
+	BOOL xshmAvailable;
+	int xshmExtension; /* extension number of the MIT-SHM error hook, 0 if none */
 
 	/* value to be sent over wire for each logical client mouse button */
 	button_map button_map[NUM_BUTTONS_MAPPED];
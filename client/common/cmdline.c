@@ -2234,6 +2234,13 @@ static int parse_tls_secrets_file(rdpSettings* settings, const char* Value)
 	return 0;
 }
 
+static int parse_tls_kernel_offload(rdpSettings* settings)
+{
+	if (!freerdp_settings_set_bool(settings, FreeRDP_TlsKernelOffload, TRUE))
+		return COMMAND_LINE_ERROR;
+	return 0;
+}
+
 static int parse_tls_enforce(rdpSettings* settings, const char* Value)
 {
 	UINT16 version = TLS1_2_VERSION;
@@ -2298,6 +2305,8 @@ static int parse_tls_cipher_options(rdpSettings* settings, const COMMAND_LINE_AR
 			rc = fail_at(arg, parse_tls_secrets_file(settings, &arg->Value[13]));
 		else if (option_starts_with("enforce:", arg->Value))
 			rc = fail_at(arg, parse_tls_enforce(settings, &arg->Value[8]));
+		else if (option_equals("kernel-offload", arg->Value))
+			rc = fail_at(arg, parse_tls_kernel_offload(settings));
 	}
 
 #if defined(WITH_FREERDP_DEPRECATED_COMMANDLINE)
@@ -496,8 +496,8 @@ static const COMMAND_LINE_ARGUMENT_A global_cmd_args[] = {
 	{ "timezone", COMMAND_LINE_VALUE_REQUIRED, "<windows timezone>", nullptr, nullptr, -1, nullptr,
 	  "Use supplied windows timezone for connection (requires server support), see /list:timezones "
 	  "for allowed values" },
-	{ "tls", COMMAND_LINE_VALUE_REQUIRED, "[ciphers|seclevel|secrets-file|enforce]", nullptr,
-	  nullptr, -1, nullptr,
+	{ "tls", COMMAND_LINE_VALUE_REQUIRED,
+	  "[ciphers|seclevel|secrets-file|enforce|kernel-offload]", nullptr, nullptr, -1, nullptr,
 	  "TLS configuration options:"
 	  " * ciphers:[netmon|ma|<cipher names>]\n"
 	  " * seclevel:<level>, default: 1, range: [0-5] Override the default TLS security level, "
@@ -507,7 +507,9 @@ static const COMMAND_LINE_ARGUMENT_A global_cmd_args[] = {
 	  " * enforce[:[ssl3|1.0|1.1|1.2|1.3]] Force use of SSL/TLS version for a connection. Some "
 	  "servers have a buggy TLS "
 	  "version negotiation and might fail without this. Defaults to TLS 1.2 if no argument is "
-	  "supplied. Use 1.0 for windows 7" },
+	  "supplied. Use 1.0 for windows 7\n"
+	  " * kernel-offload Let the kernel encrypt the TLS records sent once the handshake "
+	  "is done (Linux kTLS), falls back to OpenSSL if not available" },
 #if defined(WITH_FREERDP_DEPRECATED_COMMANDLINE)
 	{ "tls-ciphers", COMMAND_LINE_VALUE_REQUIRED, "[netmon|ma|ciphers]", nullptr, nullptr, -1,
 	  nullptr, "[DEPRECATED, use /tls:ciphers] Allowed TLS ciphers" },
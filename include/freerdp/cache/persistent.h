@@ -86,10 +86,43 @@ extern "C"
 	FREERDP_API int persistent_cache_read_entry(rdpPersistentCache* persistent,
 	                                            PERSISTENT_CACHE_ENTRY* entry);
 
+	/** @brief Get an entry of a cache opened for reading without reading the entries before it
+	 *
+	 *  @param persistent The persistent cache
+	 *  @param index The index of the entry, must be less than \ref persistent_cache_get_count
+	 *  @param entry The entry to fill, \b data points to memory owned by the cache that is valid
+	 * until the next call. Bitmap data is only read from disk when accessed.
+	 *
+	 *  @return \b 1 on success, \b -1 on failure
+	 *  @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API int persistent_cache_get_entry(rdpPersistentCache* persistent, size_t index,
+	                                           PERSISTENT_CACHE_ENTRY* entry);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API int persistent_cache_write_entry(rdpPersistentCache* persistent,
 	                                             const PERSISTENT_CACHE_ENTRY* entry);
 
+	/** @brief Append an entry to a version 3 cache opened for reading
+	 *
+	 *  The entry is copied and written to the end of the file by a background thread, so
+	 *  entries added during a session survive a crash. Appended entries are found the next time
+	 *  the cache is opened, \ref persistent_cache_close waits until all are written.
+	 *
+	 *  Entries with a key the file already holds are skipped. Entries are also dropped while
+	 *  the data waiting to be written exceeds a fixed limit.
+	 *
+	 *  @param persistent The persistent cache
+	 *  @param entry The entry to append, \b size must match \b width and \b height
+	 *
+	 *  @return \b 1 if the entry was queued, \b 0 if it was skipped, \b -1 on failure
+	 *  @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API int persistent_cache_append_entry(rdpPersistentCache* persistent,
+	                                              const PERSISTENT_CACHE_ENTRY* entry);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API int persistent_cache_open(rdpPersistentCache* persistent, const char* filename,
 	                                      BOOL write, UINT32 version);
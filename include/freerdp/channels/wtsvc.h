@@ -38,6 +38,7 @@
 #include <winpr/winpr.h>
 #include <winpr/wtypes.h>
 #include <winpr/wtsapi.h>
+#include <winpr/stream.h>
 
 #ifdef __cplusplus
 extern "C"
@@ -55,6 +56,35 @@ extern "C"
 	typedef BOOL (*psDVCCreationStatusCallback)(void* userdata, UINT32 channelId,
 	                                            INT32 creationStatus);
 
+	/** @brief Send priority of a virtual channel, lower values are sent first
+	 *
+	 *  Every channel may send a number of bytes per priority class on each
+	 *  WTSVirtualChannelManagerCheckFileDescriptor call, data exceeding that is
+	 *  sent on the next call.
+	 *
+	 *  @since version 3.32.0
+	 */
+	typedef enum
+	{
+		WTS_CHANNEL_PRIORITY_GRAPHICS = 0,
+		WTS_CHANNEL_PRIORITY_INPUT = 1,
+		WTS_CHANNEL_PRIORITY_AUDIO = 2,
+		WTS_CHANNEL_PRIORITY_BULK = 3
+	} WTS_CHANNEL_PRIORITY;
+
+	/** @brief Send queue statistics of a virtual channel
+	 *  @since version 3.32.0
+	 */
+	typedef struct
+	{
+		WTS_CHANNEL_PRIORITY priority;
+		size_t queuedMessages; /**< Messages not yet (completely) sent */
+		size_t queuedBytes;    /**< Bytes not yet sent */
+		size_t maxQueuedBytes; /**< Highest value \b queuedBytes had */
+		UINT64 sentMessages;
+		UINT64 sentBytes;
+	} WTS_CHANNEL_QUEUE_STATS;
+
 	/**
 	 * WTSVirtualChannelManager functions are FreeRDP extensions to the API.
 	 */
@@ -122,6 +152,42 @@ extern "C"
 	WINPR_ATTR_NODISCARD
 	FREERDP_API UINT32 WTSChannelGetIdByHandle(HANDLE hChannelHandle);
 
+	/** @brief Queue the data of a stream for sending without copying it
+	 *
+	 *  The data from the start of the stream up to the current position is sent.
+	 *  The function takes over one reference of \b s, which is released with
+	 *  \b Stream_Release once the data was sent or on failure. The stream must not
+	 *  be modified until then.
+	 *
+	 *  @param hChannelHandle The channel to write to
+	 *  @param s The stream holding the data
+	 *  @param pBytesWritten Optional, receives the number of bytes queued
+	 *
+	 *  @return \b TRUE for success, \b FALSE otherwise
+	 *  @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL WTSVirtualChannelWriteStream(HANDLE hChannelHandle, wStream* s,
+	                                              PULONG pBytesWritten);
+
+	/** @brief Change the send priority of a channel
+	 *
+	 *  The default is derived from the channel name and the \b WTS_CHANNEL_OPTION_DYNAMIC_PRI_*
+	 *  flags used to open the channel.
+	 *
+	 *  @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL WTSVirtualChannelSetPriority(HANDLE hChannelHandle,
+	                                              WTS_CHANNEL_PRIORITY priority);
+
+	/** @brief Get the send queue statistics of a channel
+	 *  @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL WTSVirtualChannelGetQueueStats(HANDLE hChannelHandle,
+	                                                WTS_CHANNEL_QUEUE_STATS* stats);
+
 #ifdef __cplusplus
 }
 #endif
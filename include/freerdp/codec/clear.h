@@ -37,7 +37,7 @@ extern "C"
 	/** @brief compress an image to clear codec data
 	 *  @warning not implemented
 	 *  @bug The API does not allow to properly pass an image
-	 *  @deprecated should not be used
+	 *  @deprecated should not be used, use \ref clear_compose_message instead
 	 */
 #if !defined(WITHOUT_FREERDP_3x_DEPRECATED)
 	WINPR_DEPRECATED_VAR("Broken API definition, compression was never implemented",
@@ -47,6 +47,30 @@ extern "C"
 	                         BYTE** WINPR_RESTRICT ppDstData, UINT32* WINPR_RESTRICT pDstSize));
 #endif
 
+	/** @brief compress an image to clear codec data
+	 *
+	 *  The encoder splits the image into a residual layer, bands of vBars and subcodec
+	 *  rectangles (RLEX for palette like content, NSCodec otherwise). The vBar caches are
+	 *  mirrored so every message must be sent to the peer, in order.
+	 *
+	 *  @param clear The context to use for compression, must not be \b nullptr, must have been
+	 * created with \ref Compressor = TRUE
+	 *  @param s The stream to append the encoded data to, must not be \b nullptr
+	 *  @param pSrcData A pointer to the image to encode, must not be \b nullptr
+	 *  @param SrcFormat The bitmap format of the source image
+	 *  @param nSrcStep The size in bytes of a source image line, \b 0 to calculate from \b nWidth
+	 *  @param nWidth The width in pixels of the image
+	 *  @param nHeight The height in lines of the image
+	 *
+	 *  @return \b TRUE for success, \b FALSE otherwise
+	 *  @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL clear_compose_message(CLEAR_CONTEXT* WINPR_RESTRICT clear,
+	                                       wStream* WINPR_RESTRICT s,
+	                                       const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcFormat,
+	                                       UINT32 nSrcStep, UINT32 nWidth, UINT32 nHeight);
+
 	/** @brief decompress clear codec data
 	 *
 	 *  @param clear The context to use for decompression, must not be \b nullptr, must have been
@@ -59,6 +59,26 @@ extern "C"
 	FREERDP_API BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, UINT32 width,
 	                                                                     UINT32 height);
 
+	/** @brief Allocates a planar codec context
+	 *
+	 *  Large images are split in horizontal bands and planes that are encoded and decoded on
+	 *  the thread pool unless \b THREADING_FLAGS_DISABLE_THREADS is set in \b ThreadingFlags.
+	 *
+	 *  @param flags A combination of \b PLANAR_FORMAT_HEADER_* flags
+	 *  @param width The maximum width of images processed
+	 *  @param height The maximum height of images processed
+	 *  @param ThreadingFlags A combination of \b THREADING_FLAGS_* flags
+	 *
+	 *  @return A new context or \b nullptr
+	 *  @since version 3.32.0
+	 */
+	WINPR_ATTR_MALLOC(freerdp_bitmap_planar_context_free, 1)
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new_ex(DWORD flags,
+	                                                                        UINT32 width,
+	                                                                        UINT32 height,
+	                                                                        UINT32 ThreadingFlags);
+
 	FREERDP_API void freerdp_planar_switch_bgr(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
 	                                           BOOL bgr);
 	FREERDP_API void freerdp_planar_topdown_image(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
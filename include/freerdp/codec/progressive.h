@@ -46,6 +46,44 @@ extern "C"
 	                                     BYTE** WINPR_RESTRICT ppDstData,
 	                                     UINT32* WINPR_RESTRICT pDstSize);
 
+	/** Set the number of quality passes used by \link progressive_compress
+	 *
+	 *  With a single pass (the default) every tile is sent as RFX_PROGRESSIVE_TILE_SIMPLE.
+	 *  With more passes tiles are sent as RFX_PROGRESSIVE_TILE_FIRST with a coarse
+	 *  quantization and refined to full quality by \link progressive_compress_upgrade
+	 *  Changing the number of passes drops pending upgrades.
+	 *
+	 *  @param progressive The progressive codec context, must be a compressor
+	 *  @param passes The number of quality passes, 1 to 4
+	 *
+	 *  @since version 3.32.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL
+	progressive_compress_set_passes(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive, UINT32 passes);
+
+	/** Encode the next quality pass of tiles not yet at full quality as
+	 *  RFX_PROGRESSIVE_TILE_UPGRADE blocks.
+	 *
+	 *  The coarsest tiles are refined first. The returned buffer is owned by the context
+	 *  and valid until the next call to \link progressive_compress or this function.
+	 *
+	 *  @param progressive The progressive codec context, must be a compressor
+	 *  @param maxSize The tile data budget in bytes, \b 0 for no limit. At least one tile is
+	 *  always encoded.
+	 *  @param ppDstData A pointer receiving the encoded message
+	 *  @param pDstSize A pointer receiving the size of the encoded message
+	 *
+	 *  @since version 3.32.0
+	 *  @return \b 1 if a message was encoded, \b 0 if all tiles are at full quality, a
+	 *  negative value for any error
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API int progressive_compress_upgrade(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+	                                             UINT32 maxSize, BYTE** WINPR_RESTRICT ppDstData,
+	                                             UINT32* WINPR_RESTRICT pDstSize);
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API INT32 progressive_decompress(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
 	                                         const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
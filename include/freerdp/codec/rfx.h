@@ -138,6 +138,23 @@ extern "C"
 	                                   wStream* WINPR_RESTRICT s,
 	                                   const RFX_MESSAGE* WINPR_RESTRICT message);
 
+	/** Write a message that was encoded with another context
+	 *
+	 *  The tiles and quantization values are taken from \b message, the headers and the frame
+	 *  index from \b context. The frame index of \b context is advanced.
+	 *
+	 *  @param context The RFX codec context of the receiver
+	 *  @param s The stream to write to
+	 *  @param message The message to write
+	 *
+	 *  @since version 3.32.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL rfx_write_shared_message(RFX_CONTEXT* WINPR_RESTRICT context,
+	                                          wStream* WINPR_RESTRICT s,
+	                                          const RFX_MESSAGE* WINPR_RESTRICT message);
+
 	FREERDP_API void rfx_context_free(RFX_CONTEXT* context);
 
 	WINPR_ATTR_MALLOC(rfx_context_free, 1)
@@ -165,6 +182,37 @@ extern "C"
 	WINPR_ATTR_NODISCARD
 	FREERDP_API RLGR_MODE rfx_context_get_mode(RFX_CONTEXT* WINPR_RESTRICT context);
 
+	/** Set the quantization values used by the encoder for all color components
+	 *
+	 *  The values apply to messages encoded after this call.
+	 *
+	 *  @param context The RFX encoder context
+	 *  @param quantVals The 10 quantization values in the order LL3, LH3, HL3, HH3, LH2, HL2,
+	 *  HH2, LH1, HL1, HH1, each in the range 6 to 15
+	 *  @param count The number of values, must be 10
+	 *
+	 *  @since version 3.32.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL rfx_context_set_quantization(RFX_CONTEXT* WINPR_RESTRICT context,
+	                                              const UINT32* WINPR_RESTRICT quantVals,
+	                                              size_t count);
+
+	/** Getter for the quantization values used by the encoder
+	 *
+	 *  @param context The RFX encoder context
+	 *  @param quantVals A buffer receiving the 10 quantization values, see
+	 *  \link rfx_context_set_quantization
+	 *  @param count The number of values the buffer holds, must be 10
+	 *
+	 *  @since version 3.32.0
+	 *  @return \b TRUE in case of success, \b FALSE for any error
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL rfx_context_get_quantization(RFX_CONTEXT* WINPR_RESTRICT context,
+	                                              UINT32* WINPR_RESTRICT quantVals, size_t count);
+
 	FREERDP_API void rfx_context_set_pixel_format(RFX_CONTEXT* WINPR_RESTRICT context,
 	                                              UINT32 pixel_format);
 
@@ -39,6 +39,18 @@ extern "C"
 
 	typedef struct S_ZGFX_CONTEXT ZGFX_CONTEXT;
 
+	/**
+	 * @brief Compression levels of the ZGFX (RDP8) compressor
+	 * @since version 3.32.0
+	 */
+	typedef enum
+	{
+		ZGFX_COMPRESSION_LEVEL_NONE = 0, /** only emit uncompressed segments */
+		ZGFX_COMPRESSION_LEVEL_FAST,     /** short match search, no lazy matching */
+		ZGFX_COMPRESSION_LEVEL_DEFAULT,  /** default for compressor contexts */
+		ZGFX_COMPRESSION_LEVEL_BEST      /** long match search, best ratio */
+	} ZGFX_COMPRESSION_LEVEL;
+
 	WINPR_ATTR_NODISCARD
 	FREERDP_API int zgfx_decompress(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
 	                                const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
@@ -59,6 +71,20 @@ extern "C"
 
 	FREERDP_API void zgfx_context_reset(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, BOOL flush);
 
+	/**
+	 * @brief Select the compression level of a compressor context
+	 *
+	 * @param zgfx A context created with \b Compressor set to \b TRUE
+	 * @param level The level to use for subsequent segments
+	 *
+	 * @return \b TRUE for success, \b FALSE if the context is not a compressor or the level is
+	 * invalid
+	 * @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API BOOL zgfx_context_set_compression_level(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+	                                                    ZGFX_COMPRESSION_LEVEL level);
+
 	FREERDP_API void zgfx_context_free(ZGFX_CONTEXT* zgfx);
 
 	WINPR_ATTR_MALLOC(zgfx_context_free, 1)
@@ -30,6 +30,29 @@ extern "C"
 {
 #endif
 
+	/** @brief Number of entries in \ref rdpMetrics::Compressors, indexed by PACKET_COMPR_TYPE_*
+	 *  @since version 3.32.0
+	 */
+#define FREERDP_METRICS_COMPRESSORS 5
+
+	/** @brief Number of entries in \ref rdpMetrics::UpdateTypes, indexed by the fastpath update
+	 * code
+	 *  @since version 3.32.0
+	 */
+#define FREERDP_METRICS_UPDATE_TYPES 16
+
+	/** @brief Bulk compressor statistics
+	 *  @since version 3.32.0
+	 */
+	typedef struct
+	{
+		UINT64 Packets;           /**< PDUs handed to the bulk compressor */
+		UINT64 SkippedPackets;    /**< PDUs sent uncompressed as they looked incompressible */
+		UINT64 UncompressedBytes; /**< Input bytes */
+		UINT64 CompressedBytes;   /**< Bytes put on the wire */
+		UINT64 CompressionTimeNS; /**< Time spent in the compressor and entropy estimation */
+	} rdpCompressionMetrics;
+
 	struct rdp_metrics
 	{
 		rdpContext* context;
@@ -37,6 +60,11 @@ extern "C"
 		UINT64 TotalCompressedBytes;
 		UINT64 TotalUncompressedBytes;
 		double TotalCompressionRatio;
+
+		/** @since version 3.32.0 */
+		rdpCompressionMetrics Compressors[FREERDP_METRICS_COMPRESSORS];
+		/** @since version 3.32.0 */
+		rdpCompressionMetrics UpdateTypes[FREERDP_METRICS_UPDATE_TYPES];
 	};
 	typedef struct rdp_metrics rdpMetrics;
 
@@ -44,6 +72,32 @@ extern "C"
 	FREERDP_API double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes,
 	                                       UINT32 CompressedBytes);
 
+	/**
+	 * @brief Account a PDU passed through the bulk compressor
+	 *
+	 * @param metrics The metrics instance to update
+	 * @param CompressionType The PACKET_COMPR_TYPE_* used
+	 * @param UpdateType The fastpath update code of the PDU
+	 * @param UncompressedBytes The size of the PDU
+	 * @param CompressedBytes The size put on the wire
+	 * @param TimeNS The time spent compressing in nanoseconds
+	 * @param Skipped \b TRUE if compression was skipped for the PDU
+	 * @since version 3.32.0
+	 */
+	FREERDP_API void metrics_write_compression(rdpMetrics* metrics, UINT32 CompressionType,
+	                                           UINT32 UpdateType, UINT32 UncompressedBytes,
+	                                           UINT32 CompressedBytes, UINT64 TimeNS,
+	                                           BOOL Skipped);
+
+	/**
+	 * @brief Get the compression ratio (compressed / uncompressed) of a statistics entry
+	 *
+	 * @return The ratio or \b 0.0 if nothing was accounted yet
+	 * @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_API double metrics_compression_ratio(const rdpCompressionMetrics* entry);
+
 	FREERDP_API void metrics_free(rdpMetrics* metrics);
 
 	WINPR_ATTR_MALLOC(metrics_free, 1)
@@ -212,6 +212,19 @@ typedef pstatus_t (*fn_andC_32u_t)(const UINT32* WINPR_RESTRICT pSrc, UINT32 val
 	                               UINT32* WINPR_RESTRICT pDst, INT32 len);
 typedef pstatus_t (*fn_orC_32u_t)(const UINT32* WINPR_RESTRICT pSrc, UINT32 val,
 	                              UINT32* WINPR_RESTRICT pDst, INT32 len);
+
+/** \brief Compares two 32bpp images in tiles of 16x16 pixels
+ *
+ *  For every tile one byte is written to \b pTiles, \b 1 if any pixel of the tile differs,
+ *  \b 0 otherwise. A line of the tile map holds (width + 15) / 16 entries, the right and
+ *  bottom tiles are partial if the dimensions are not a multiple of 16.
+ *
+ *  @since version 3.32.0
+ */
+typedef pstatus_t (*fn_compare_tiles_32u_t)(const BYTE* WINPR_RESTRICT pSrc1, UINT32 src1Step,
+	                                        const BYTE* WINPR_RESTRICT pSrc2, UINT32 src2Step,
+	                                        UINT32 width, UINT32 height,
+	                                        BYTE* WINPR_RESTRICT pTiles, UINT32 tilesStep);
 typedef pstatus_t (*primitives_uninit_t)(void);
 
 #if defined(WITH_FREERDP_3x_DEPRECATED)
@@ -303,6 +316,7 @@ typedef struct
 	WINPR_ATTR_NODISCARD fn_lShiftC_16s_inplace_t lShiftC_16s_inplace; /** @since version 3.6.0 */
 	WINPR_ATTR_NODISCARD fn_copy_no_overlap_t copy_no_overlap;         /** @since version 3.6.0 */
 	WINPR_ATTR_NODISCARD fn_RGBToYUV444_8u_P3AC4R_t RGBToI444_8u;      /** @since version 3.25.0 */
+	WINPR_ATTR_NODISCARD fn_compare_tiles_32u_t compare_tiles_32u;     /** @since version 3.32.0 */
 } primitives_t;
 
 typedef enum
@@ -133,6 +133,15 @@ extern "C"
 		size_t TargetSmartcardCertLength; /** @since version 3.25.0 */
 		char* TargetSmartcardKey;  /** @since version 3.25.0 */
 		size_t TargetSmartcardKeyLength; /** @since version 3.25.0 */
+
+		/* server I/O workers, 0 runs every session in its own threads */
+		UINT32 IoWorkers; /** @since version 3.32.0 */
+
+		/* seconds a peer may take to become active with IoWorkers, 0 for the default */
+		UINT32 HandshakeTimeout; /** @since version 3.32.0 */
+
+		/* kernel TLS offload for both the client and the target connection */
+		BOOL TlsKernelOffload; /** @since version 3.32.0 */
 	};
 
 	/**
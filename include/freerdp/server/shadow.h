@@ -59,6 +59,9 @@ extern "C"
 	typedef struct rdp_shadow_capture rdpShadowCapture;
 	typedef struct rdp_shadow_subsystem rdpShadowSubsystem;
 	typedef struct rdp_shadow_multiclient_event rdpShadowMultiClientEvent;
+	typedef struct rdp_shadow_encode_cache rdpShadowEncodeCache; /** @since version 3.32.0 */
+	typedef struct rdp_shadow_tile_cache rdpShadowTileCache;     /** @since version 3.32.0 */
+	typedef struct rdp_shadow_tile_frame rdpShadowTileFrame;     /** @since version 3.32.0 */
 
 	typedef struct S_RDP_SHADOW_ENTRY_POINTS RDP_SHADOW_ENTRY_POINTS;
 	typedef int (*pfnShadowSubsystemEntry)(RDP_SHADOW_ENTRY_POINTS* pEntryPoints);
@@ -140,7 +143,8 @@ extern "C"
 		UINT32 resizeWidth;
 		UINT32 resizeHeight;
 		BOOL areGfxCapsReady; /** @since version 3.3.0 */
-		RDPGFX_CAPSET confirmedCaps; /** @since version 3.25.0 */
+		RDPGFX_CAPSET confirmedCaps;   /** @since version 3.25.0 */
+		rdpShadowTileCache* tileCache; /** @since version 3.32.0 */
 	};
 
 	struct rdp_shadow_server
@@ -187,6 +191,12 @@ extern "C"
 #else
 	    UINT32 reservedAV1[2];
 #endif
+		BOOL GfxClearCodec;                /** @since version 3.32.0 */
+		rdpShadowEncodeCache* encodeCache; /** @since version 3.32.0 */
+		BOOL GfxTileCache;                 /** @since version 3.32.0 */
+		BOOL RateControl;                  /** @since version 3.32.0 */
+		rdpShadowTileFrame* tileFrame;     /** @since version 3.32.0 */
+		UINT32 GfxProgressivePasses;       /** @since version 3.32.0 */
 	};
 
 	struct rdp_shadow_surface
@@ -216,7 +216,10 @@ struct rdp_settings
 	SETTINGS_DEPRECATED(ALIGN64 BOOL HiDefRemoteApp);         /* 720 */
 	SETTINGS_DEPRECATED(ALIGN64 UINT32 CompressionLevel);     /* 721 */
 	SETTINGS_DEPRECATED(ALIGN64 UINT32 RemoteAppFeatureFlags); /* 722 */
-	UINT64 padding0768[768 - 723];                             /* 723 */
+	SETTINGS_DEPRECATED(ALIGN64 BOOL CompressionAdaptive);     /** 723
+		                                                        * @since version 3.32.0
+		                                                        */
+	UINT64 padding0768[768 - 724];                             /* 724 */
 
 	/* Client Info (Extra) */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL IPv6Enabled);       /* 768 */
@@ -303,7 +306,9 @@ struct rdp_settings
 	SETTINGS_DEPRECATED(ALIGN64 BOOL RemoteCredentialGuard);        /* 1114 */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL RestrictedAdminModeSupported); /** 1115
 		                                                             * @since version 3.16.0 */
-	UINT64 padding1152[1152 - 1116];                                /* 1116 */
+	SETTINGS_DEPRECATED(ALIGN64 BOOL TlsKernelOffload);             /** 1116
+		                                                             * @since version 3.32.0 */
+	UINT64 padding1152[1152 - 1117];                                /* 1117 */
 
 	/* Connection Cookie */
 	SETTINGS_DEPRECATED(ALIGN64 BOOL MstscCookieMode);      /* 1152 */
@@ -20,27 +20,98 @@
 #include <freerdp/config.h>
 
 #include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/file.h>
 #include <winpr/stream.h>
 #include <winpr/assert.h>
+#include <winpr/thread.h>
+#include <winpr/interlocked.h>
+#include <winpr/collections.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 #include <freerdp/freerdp.h>
 #include <freerdp/constants.h>
 
 #include <freerdp/cache/persistent.h>
 
+#define PERSIST_V2_DATA_SIZE 0x4000
+
+/* Entry data waiting for the journal thread, more is dropped instead of buffered */
+#define PERSIST_JOURNAL_MAX_QUEUED (32 * 1024 * 1024)
+
+typedef struct
+{
+	UINT64 key64;
+	UINT16 width;
+	UINT16 height;
+	UINT32 flags;
+	INT64 offset; /* file offset of the bitmap data */
+} PERSISTENT_CACHE_INDEX;
+
+/* Header of the key index saved next to the cache, followed by the index entries */
+typedef struct
+{
+	BYTE sig[8];
+	UINT32 version; /* version of the cache */
+	UINT32 count;
+	UINT32 checksum; /* CRC32 of the index entries */
+	UINT32 reserved;
+	INT64 size; /* end of the last indexed entry */
+} PERSISTENT_CACHE_INDEX_HEADER;
+
 struct rdp_persistent_cache
 {
 	FILE* fp;
 	BOOL write;
+	BOOL failed;
 	int version;
 	int count;
 	char* filename;
+	char* tmpname;
 	BYTE* bmpData;
 	size_t bmpSize;
+
+	/* read mode: copy-on-write mapping of the file and the entry headers found in it */
+	BYTE* map;
+	size_t mapSize;
+#if defined(_WIN32)
+	HANDLE mapHandle;
+#endif
+	PERSISTENT_CACHE_INDEX* index;
+	size_t capacity;
+	size_t next;
+	INT64 end; /* end of the last complete entry */
+
+	/* read mode: entries appended during the session, written by a background thread */
+	FILE* journal;
+	wMessageQueue* journalQueue;
+	HANDLE journalThread;
+	volatile LONG journalQueued; /* bytes of entry data in journalQueue */
+	wHashTable* keys;            /* set of the keys in the file or queued */
 };
 
 static const size_t PERSIST_ALIGN = 32;
 static const char sig_str[] = "RDP8bmp";
+static const char index_sig_str[] = "FRDPidx";
+
+static char* persistent_cache_name(const char* filename, const char* suffix)
+{
+	WINPR_ASSERT(filename);
+	WINPR_ASSERT(suffix);
+
+	const size_t size = strlen(filename) + strlen(suffix) + 1;
+	char* name = calloc(size, sizeof(char));
+	if (!name)
+		return nullptr;
+	(void)_snprintf(name, size, "%s%s", filename, suffix);
+	return name;
+}
 
 int persistent_cache_get_version(rdpPersistentCache* persistent)
 {
@@ -54,123 +125,246 @@ int persistent_cache_get_count(rdpPersistentCache* persistent)
 	return persistent->count;
 }
 
-static int persistent_cache_read_entry_v2(rdpPersistentCache* persistent,
-                                          PERSISTENT_CACHE_ENTRY* entry)
+static BOOL persistent_cache_map(rdpPersistentCache* persistent, INT64 size)
 {
-	PERSISTENT_CACHE_ENTRY_V2 entry2 = WINPR_C_ARRAY_INIT;
+	WINPR_ASSERT(persistent);
+
+	if ((size <= 0) || ((UINT64)size > SIZE_MAX))
+		return FALSE;
+
+#if defined(_WIN32)
+	HANDLE handle = (HANDLE)_get_osfhandle(_fileno(persistent->fp));
+	if (handle == INVALID_HANDLE_VALUE)
+		return FALSE;
+
+	persistent->mapHandle = CreateFileMappingA(handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	if (!persistent->mapHandle)
+		return FALSE;
+
+	persistent->map = MapViewOfFile(persistent->mapHandle, FILE_MAP_COPY, 0, 0, 0);
+	if (!persistent->map)
+	{
+		(void)CloseHandle(persistent->mapHandle);
+		persistent->mapHandle = nullptr;
+		return FALSE;
+	}
+#else
+	/* private mapping, callers get writable entry data without touching the file */
+	void* map = mmap(nullptr, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+	                 fileno(persistent->fp), 0);
+	if (map == MAP_FAILED)
+		return FALSE;
+	persistent->map = map;
+#endif
+
+	persistent->mapSize = (size_t)size;
+	return TRUE;
+}
+
+static void persistent_cache_unmap(rdpPersistentCache* persistent)
+{
+	WINPR_ASSERT(persistent);
+
+	if (!persistent->map)
+		return;
+
+#if defined(_WIN32)
+	(void)UnmapViewOfFile(persistent->map);
+	(void)CloseHandle(persistent->mapHandle);
+	persistent->mapHandle = nullptr;
+#else
+	(void)munmap(persistent->map, persistent->mapSize);
+#endif
+
+	persistent->map = nullptr;
+	persistent->mapSize = 0;
+}
+
+static BOOL persistent_cache_read_at(rdpPersistentCache* persistent, INT64 offset, void* data,
+                                     size_t size)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(offset >= 0);
+
+	if (persistent->map)
+	{
+		if (((UINT64)offset > persistent->mapSize) ||
+		    (persistent->mapSize - (size_t)offset < size))
+			return FALSE;
+		memcpy(data, &persistent->map[offset], size);
+		return TRUE;
+	}
+
+	if (_fseeki64(persistent->fp, offset, SEEK_SET) != 0)
+		return FALSE;
+	return fread(data, size, 1, persistent->fp) == 1;
+}
+
+static BYTE* persistent_cache_entry_data(rdpPersistentCache* persistent,
+                                         const PERSISTENT_CACHE_INDEX* index, size_t size)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(index);
 
+	/* The index only holds entries that are complete in the file */
+	if (persistent->map)
+		return &persistent->map[index->offset];
+
+	if (size > persistent->bmpSize)
+	{
+		BYTE* bmpData =
+		    (BYTE*)winpr_aligned_recalloc(persistent->bmpData, size, sizeof(BYTE), PERSIST_ALIGN);
+
+		if (!bmpData)
+			return nullptr;
+
+		persistent->bmpData = bmpData;
+		persistent->bmpSize = size;
+	}
+
+	if ((size > 0) &&
+	    !persistent_cache_read_at(persistent, index->offset, persistent->bmpData, size))
+		return nullptr;
+
+	return persistent->bmpData;
+}
+
+int persistent_cache_get_entry(rdpPersistentCache* persistent, size_t index,
+                               PERSISTENT_CACHE_ENTRY* entry)
+{
 	WINPR_ASSERT(persistent);
 	WINPR_ASSERT(entry);
 
-	if (fread((void*)&entry2, sizeof(entry2), 1, persistent->fp) != 1)
+	if (persistent->write || (persistent->count < 0) || (index >= (size_t)persistent->count))
 		return -1;
 
-	entry->key64 = entry2.key64;
-	entry->width = entry2.width;
-	entry->height = entry2.height;
-	entry->size = entry2.width * entry2.height * 4;
-	entry->flags = entry2.flags;
+	const PERSISTENT_CACHE_INDEX* cur = &persistent->index[index];
+	const UINT64 size = 4ull * cur->width * cur->height;
+	if (size > UINT32_MAX)
+		return -1;
 
-	entry->data = persistent->bmpData;
+	entry->key64 = cur->key64;
+	entry->width = cur->width;
+	entry->height = cur->height;
+	entry->size = (UINT32)size;
+	entry->flags = cur->flags;
 
-	if (fread((void*)entry->data, 0x4000, 1, persistent->fp) != 1)
+	/* v2 entries always occupy the full data region */
+	entry->data = persistent_cache_entry_data(
+	    persistent, cur, (persistent->version == 2) ? PERSIST_V2_DATA_SIZE : entry->size);
+	if (!entry->data)
 		return -1;
 
 	return 1;
 }
 
-static int persistent_cache_write_entry_v2(rdpPersistentCache* persistent,
-                                           const PERSISTENT_CACHE_ENTRY* entry)
+int persistent_cache_read_entry(rdpPersistentCache* persistent, PERSISTENT_CACHE_ENTRY* entry)
 {
-	PERSISTENT_CACHE_ENTRY_V2 entry2 = WINPR_C_ARRAY_INIT;
-
 	WINPR_ASSERT(persistent);
 	WINPR_ASSERT(entry);
-	entry2.key64 = entry->key64;
-	entry2.width = entry->width;
-	entry2.height = entry->height;
-	entry2.size = entry->size;
-	entry2.flags = entry->flags;
 
-	if (!entry2.flags)
-		entry2.flags = 0x00000011;
-
-	if (fwrite(&entry2, sizeof(entry2), 1, persistent->fp) != 1)
+	if ((persistent->version != 2) && (persistent->version != 3))
 		return -1;
 
-	if (fwrite(entry->data, entry->size, 1, persistent->fp) != 1)
-		return -1;
+	const size_t index = persistent->next++;
+	return persistent_cache_get_entry(persistent, index, entry);
+}
 
-	if (0x4000 > entry->size)
-	{
-		const size_t padding = 0x4000 - entry->size;
+static int persistent_cache_write(rdpPersistentCache* persistent, const void* data, size_t size)
+{
+	WINPR_ASSERT(persistent);
 
-		if (fwrite(persistent->bmpData, padding, 1, persistent->fp) != 1)
-			return -1;
+	if ((size > 0) && (fwrite(data, size, 1, persistent->fp) != 1))
+	{
+		/* a partially written file must not replace the previous cache */
+		persistent->failed = TRUE;
+		return -1;
 	}
 
-	persistent->count++;
-
 	return 1;
 }
 
-static int persistent_cache_read_v2(rdpPersistentCache* persistent)
+static BOOL persistent_cache_add_index(rdpPersistentCache* persistent,
+                                       const PERSISTENT_CACHE_INDEX* index)
 {
 	WINPR_ASSERT(persistent);
-	while (1)
+	WINPR_ASSERT(index);
+
+	if (persistent->count == INT32_MAX)
+		return FALSE;
+
+	if ((size_t)persistent->count >= persistent->capacity)
 	{
-		PERSISTENT_CACHE_ENTRY_V2 entry = WINPR_C_ARRAY_INIT;
+		const size_t size = (persistent->capacity > 0) ? persistent->capacity * 2 : 1024;
+		PERSISTENT_CACHE_INDEX* tmp =
+		    realloc(persistent->index, size * sizeof(PERSISTENT_CACHE_INDEX));
 
-		if (fread((void*)&entry, sizeof(entry), 1, persistent->fp) != 1)
-			break;
+		if (!tmp)
+			return FALSE;
 
-		if (fseek(persistent->fp, 0x4000, SEEK_CUR) != 0)
-			break;
+		persistent->index = tmp;
+		persistent->capacity = size;
+	}
+
+	persistent->index[persistent->count++] = *index;
+	return TRUE;
+}
+
+/* Records a written entry for the key index saved on close */
+static int persistent_cache_add_written(rdpPersistentCache* persistent,
+                                        const PERSISTENT_CACHE_ENTRY* entry, size_t headerSize,
+                                        size_t dataSize)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(entry);
+
+	const PERSISTENT_CACHE_INDEX index = { .key64 = entry->key64,
+		                                   .width = entry->width,
+		                                   .height = entry->height,
+		                                   .flags = entry->flags,
+		                                   .offset = persistent->end + (INT64)headerSize };
 
-		persistent->count++;
+	if (!persistent_cache_add_index(persistent, &index))
+	{
+		persistent->failed = TRUE;
+		return -1;
 	}
 
+	persistent->end = index.offset + (INT64)dataSize;
 	return 1;
 }
 
-static int persistent_cache_read_entry_v3(rdpPersistentCache* persistent,
-                                          PERSISTENT_CACHE_ENTRY* entry)
+static int persistent_cache_write_entry_v2(rdpPersistentCache* persistent,
+                                           const PERSISTENT_CACHE_ENTRY* entry)
 {
-	PERSISTENT_CACHE_ENTRY_V3 entry3 = WINPR_C_ARRAY_INIT;
+	PERSISTENT_CACHE_ENTRY_V2 entry2 = WINPR_C_ARRAY_INIT;
 
 	WINPR_ASSERT(persistent);
 	WINPR_ASSERT(entry);
 
-	if (fread(&entry3, sizeof(entry3), 1, persistent->fp) != 1)
+	if (entry->size > PERSIST_V2_DATA_SIZE)
 		return -1;
 
-	entry->key64 = entry3.key64;
-	entry->width = entry3.width;
-	entry->height = entry3.height;
-	const UINT64 size = 4ull * entry3.width * entry3.height;
-	if (size > UINT32_MAX)
-		return -1;
-	entry->flags = 0;
-
-	if (size > persistent->bmpSize)
-	{
-		persistent->bmpSize = size;
-		BYTE* bmpData = (BYTE*)winpr_aligned_recalloc(persistent->bmpData, persistent->bmpSize,
-		                                              sizeof(BYTE), PERSIST_ALIGN);
+	entry2.key64 = entry->key64;
+	entry2.width = entry->width;
+	entry2.height = entry->height;
+	entry2.size = entry->size;
+	entry2.flags = entry->flags;
 
-		if (!bmpData)
-			return -1;
+	if (!entry2.flags)
+		entry2.flags = 0x00000011;
 
-		persistent->bmpData = bmpData;
-	}
-	entry->size = WINPR_ASSERTING_INT_CAST(UINT32, size);
+	if (persistent_cache_write(persistent, &entry2, sizeof(entry2)) < 1)
+		return -1;
 
-	entry->data = persistent->bmpData;
+	if (persistent_cache_write(persistent, entry->data, entry->size) < 1)
+		return -1;
 
-	if (fread((void*)entry->data, entry->size, 1, persistent->fp) != 1)
+	if (persistent_cache_write(persistent, persistent->bmpData,
+	                           PERSIST_V2_DATA_SIZE - entry->size) < 1)
 		return -1;
 
-	return 1;
+	return persistent_cache_add_written(persistent, entry, sizeof(entry2), PERSIST_V2_DATA_SIZE);
 }
 
 static int persistent_cache_write_entry_v3(rdpPersistentCache* persistent,
@@ -185,68 +379,250 @@ static int persistent_cache_write_entry_v3(rdpPersistentCache* persistent,
 	entry3.width = entry->width;
 	entry3.height = entry->height;
 
-	if (fwrite((void*)&entry3, sizeof(entry3), 1, persistent->fp) != 1)
+	if (persistent_cache_write(persistent, &entry3, sizeof(entry3)) < 1)
 		return -1;
 
-	if (fwrite((void*)entry->data, entry->size, 1, persistent->fp) != 1)
+	if (persistent_cache_write(persistent, entry->data, entry->size) < 1)
 		return -1;
 
-	persistent->count++;
+	return persistent_cache_add_written(persistent, entry, sizeof(entry3), entry->size);
+}
 
-	return 1;
+int persistent_cache_write_entry(rdpPersistentCache* persistent,
+                                 const PERSISTENT_CACHE_ENTRY* entry)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(entry);
+
+	if (!persistent->write || !persistent->fp || (persistent->count == INT32_MAX))
+		return -1;
+
+	if (persistent->version == 3)
+		return persistent_cache_write_entry_v3(persistent, entry);
+	else if (persistent->version == 2)
+		return persistent_cache_write_entry_v2(persistent, entry);
+
+	return -1;
 }
 
-static int persistent_cache_read_v3(rdpPersistentCache* persistent)
+static INT64 persistent_cache_entry_header_size(const rdpPersistentCache* persistent)
 {
 	WINPR_ASSERT(persistent);
-	while (1)
-	{
-		PERSISTENT_CACHE_ENTRY_V3 entry = WINPR_C_ARRAY_INIT;
 
-		if (fread((void*)&entry, sizeof(entry), 1, persistent->fp) != 1)
-			break;
+	if (persistent->version == 3)
+		return sizeof(PERSISTENT_CACHE_ENTRY_V3);
+	return sizeof(PERSISTENT_CACHE_ENTRY_V2);
+}
 
-		if (_fseeki64(persistent->fp, (4LL * entry.width * entry.height), SEEK_CUR) != 0)
-			break;
+static INT64 persistent_cache_entry_data_size(const rdpPersistentCache* persistent,
+                                              const PERSISTENT_CACHE_INDEX* index)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(index);
 
-		persistent->count++;
+	if (persistent->version == 3)
+		return 4LL * index->width * index->height;
+	return PERSIST_V2_DATA_SIZE;
+}
+
+static UINT32 persistent_cache_checksum(const void* data, size_t length)
+{
+	const BYTE* bytes = data;
+	UINT32 crc = 0xFFFFFFFF;
+
+	for (size_t x = 0; x < length; x++)
+	{
+		crc ^= bytes[x];
+		for (size_t bit = 0; bit < 8; bit++)
+			crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
 	}
+	return ~crc;
+}
 
-	return 1;
+/* The key index must describe this file: compare an entry with its header in the cache */
+static BOOL persistent_cache_check_index(rdpPersistentCache* persistent,
+                                         const PERSISTENT_CACHE_INDEX* index)
+{
+	PERSISTENT_CACHE_ENTRY_V2 entry = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(index);
+
+	/* The key and the dimensions are at the same place in both versions */
+	const INT64 headerSize = persistent_cache_entry_header_size(persistent);
+	if (!persistent_cache_read_at(persistent, index->offset - headerSize, &entry,
+	                              (size_t)headerSize))
+		return FALSE;
+
+	return (entry.key64 == index->key64) && (entry.width == index->width) &&
+	       (entry.height == index->height);
 }
 
-int persistent_cache_read_entry(rdpPersistentCache* persistent, PERSISTENT_CACHE_ENTRY* entry)
+/**
+ * Loads the key index saved with the cache, so the keys are known without reading the entry
+ * headers spread over the whole file.
+ *
+ * @return The end of the indexed entries, \b offset if there is no usable index
+ */
+static INT64 persistent_cache_load_index(rdpPersistentCache* persistent, INT64 offset, INT64 size)
 {
+	PERSISTENT_CACHE_INDEX_HEADER header = WINPR_C_ARRAY_INIT;
+	PERSISTENT_CACHE_INDEX* index = nullptr;
+	INT64 end = offset;
+
 	WINPR_ASSERT(persistent);
-	WINPR_ASSERT(entry);
 
-	if (persistent->version == 3)
-		return persistent_cache_read_entry_v3(persistent, entry);
-	else if (persistent->version == 2)
-		return persistent_cache_read_entry_v2(persistent, entry);
+	char* name = persistent_cache_name(persistent->filename, ".idx");
+	if (!name)
+		return offset;
 
-	return -1;
+	FILE* fp = winpr_fopen(name, "rb");
+	free(name);
+	if (!fp)
+		return offset;
+
+	if ((fread(&header, sizeof(header), 1, fp) != 1) ||
+	    (memcmp(header.sig, index_sig_str, sizeof(index_sig_str)) != 0) ||
+	    (header.version != (UINT32)persistent->version) || (header.count == 0) ||
+	    (header.count > INT32_MAX) || (header.size > size))
+		goto fail;
+
+	index = calloc(header.count, sizeof(PERSISTENT_CACHE_INDEX));
+	if (!index || (fread(index, sizeof(PERSISTENT_CACHE_INDEX), header.count, fp) != header.count))
+		goto fail;
+
+	if (persistent_cache_checksum(index, header.count * sizeof(PERSISTENT_CACHE_INDEX)) !=
+	    header.checksum)
+		goto fail;
+
+	/* Entries follow each other up to the recorded end of the cache */
+	for (size_t x = 0; x < header.count; x++)
+	{
+		const PERSISTENT_CACHE_INDEX* cur = &index[x];
+		if ((persistent->version == 2) && (4LL * cur->width * cur->height > PERSIST_V2_DATA_SIZE))
+			goto fail;
+		if (cur->offset != end + persistent_cache_entry_header_size(persistent))
+			goto fail;
+		end = cur->offset + persistent_cache_entry_data_size(persistent, cur);
+	}
+
+	if ((end != header.size) || !persistent_cache_check_index(persistent, &index[0]) ||
+	    !persistent_cache_check_index(persistent, &index[header.count - 1]))
+		goto fail;
+
+	persistent->index = index;
+	persistent->capacity = header.count;
+	persistent->count = (int)header.count;
+	index = nullptr;
+fail:
+	free(index);
+	(void)fclose(fp);
+	return (persistent->count > 0) ? end : offset;
 }
 
-int persistent_cache_write_entry(rdpPersistentCache* persistent,
-                                 const PERSISTENT_CACHE_ENTRY* entry)
+/* Saves the key index of a completely written cache */
+static BOOL persistent_cache_save_index(rdpPersistentCache* persistent)
 {
+	BOOL rc = FALSE;
+	FILE* fp = nullptr;
+	PERSISTENT_CACHE_INDEX_HEADER header = WINPR_C_ARRAY_INIT;
+
 	WINPR_ASSERT(persistent);
-	WINPR_ASSERT(entry);
 
-	if (persistent->version == 3)
-		return persistent_cache_write_entry_v3(persistent, entry);
-	else if (persistent->version == 2)
-		return persistent_cache_write_entry_v2(persistent, entry);
+	char* name = persistent_cache_name(persistent->filename, ".idx");
+	char* tmpname = persistent_cache_name(persistent->filename, ".idx.tmp");
+	if (!name || !tmpname || (persistent->count <= 0))
+		goto fail;
+
+	memcpy(header.sig, index_sig_str, MIN(sizeof(header.sig), sizeof(index_sig_str)));
+	header.version = (UINT32)persistent->version;
+	header.count = (UINT32)persistent->count;
+	header.size = persistent->end;
+	header.checksum =
+	    persistent_cache_checksum(persistent->index, header.count * sizeof(PERSISTENT_CACHE_INDEX));
+
+	fp = winpr_fopen(tmpname, "wb");
+	if (!fp)
+		goto fail;
+
+	rc = (fwrite(&header, sizeof(header), 1, fp) == 1) &&
+	     (fwrite(persistent->index, sizeof(PERSISTENT_CACHE_INDEX), header.count, fp) ==
+	      header.count);
+	if (fclose(fp) != 0)
+		rc = FALSE;
+	fp = nullptr;
+
+	if (rc)
+		rc = winpr_MoveFileEx(tmpname, name, MOVEFILE_REPLACE_EXISTING);
+	if (!rc)
+	{
+		const BOOL deleted = winpr_DeleteFile(tmpname);
+		WINPR_UNUSED(deleted);
+	}
+fail:
+	free(name);
+	free(tmpname);
+	return rc;
+}
 
-	return -1;
+/* Collects the entry headers, a truncated or corrupt tail ends the cache */
+static int persistent_cache_read_index(rdpPersistentCache* persistent, INT64 offset, INT64 size)
+{
+	WINPR_ASSERT(persistent);
+
+	while (1)
+	{
+		PERSISTENT_CACHE_INDEX index = WINPR_C_ARRAY_INIT;
+		INT64 dataSize = 0;
+
+		if (persistent->version == 3)
+		{
+			PERSISTENT_CACHE_ENTRY_V3 entry = WINPR_C_ARRAY_INIT;
+
+			if (!persistent_cache_read_at(persistent, offset, &entry, sizeof(entry)))
+				break;
+
+			index.key64 = entry.key64;
+			index.width = entry.width;
+			index.height = entry.height;
+			index.offset = offset + (INT64)sizeof(entry);
+			dataSize = 4LL * entry.width * entry.height;
+		}
+		else
+		{
+			PERSISTENT_CACHE_ENTRY_V2 entry = WINPR_C_ARRAY_INIT;
+
+			if (!persistent_cache_read_at(persistent, offset, &entry, sizeof(entry)))
+				break;
+
+			if (4LL * entry.width * entry.height > PERSIST_V2_DATA_SIZE)
+				break;
+
+			index.key64 = entry.key64;
+			index.width = entry.width;
+			index.height = entry.height;
+			index.flags = entry.flags;
+			index.offset = offset + (INT64)sizeof(entry);
+			dataSize = PERSIST_V2_DATA_SIZE;
+		}
+
+		if (index.offset + dataSize > size)
+			break;
+
+		if (!persistent_cache_add_index(persistent, &index))
+			return -1;
+
+		offset = index.offset + dataSize;
+	}
+
+	persistent->end = offset;
+	return 1;
 }
 
 static int persistent_cache_open_read(rdpPersistentCache* persistent)
 {
 	BYTE sig[8] = WINPR_C_ARRAY_INIT;
-	int status = 1;
-	long offset = 0;
+	INT64 offset = 0;
 
 	WINPR_ASSERT(persistent);
 	persistent->fp = winpr_fopen(persistent->filename, "rb");
@@ -254,7 +630,17 @@ static int persistent_cache_open_read(rdpPersistentCache* persistent)
 	if (!persistent->fp)
 		return -1;
 
-	if (fread(sig, 8, 1, persistent->fp) != 1)
+	if (_fseeki64(persistent->fp, 0, SEEK_END) != 0)
+		return -1;
+
+	const INT64 size = _ftelli64(persistent->fp);
+	if (size < 0)
+		return -1;
+
+	/* Entries are only paged in when used, stdio is the fallback if the file can not be mapped */
+	(void)persistent_cache_map(persistent, size);
+
+	if (!persistent_cache_read_at(persistent, 0, sig, sizeof(sig)))
 		return -1;
 
 	if (memcmp(sig, sig_str, sizeof(sig_str)) == 0)
@@ -262,34 +648,31 @@ static int persistent_cache_open_read(rdpPersistentCache* persistent)
 	else
 		persistent->version = 2;
 
-	(void)fseek(persistent->fp, 0, SEEK_SET);
-
 	if (persistent->version == 3)
 	{
 		PERSISTENT_CACHE_HEADER_V3 header;
 
-		if (fread(&header, sizeof(header), 1, persistent->fp) != 1)
+		if (!persistent_cache_read_at(persistent, 0, &header, sizeof(header)))
 			return -1;
 
-		status = persistent_cache_read_v3(persistent);
 		offset = sizeof(header);
 	}
-	else
-	{
-		status = persistent_cache_read_v2(persistent);
-		offset = 0;
-	}
-
-	(void)fseek(persistent->fp, offset, SEEK_SET);
 
-	return status;
+	/* Entries appended after the index was saved are still read from their headers */
+	offset = persistent_cache_load_index(persistent, offset, size);
+	return persistent_cache_read_index(persistent, offset, size);
 }
 
 static int persistent_cache_open_write(rdpPersistentCache* persistent)
 {
 	WINPR_ASSERT(persistent);
 
-	persistent->fp = winpr_fopen(persistent->filename, "w+b");
+	/* The cache is written next to the old one and replaces it once complete */
+	persistent->tmpname = persistent_cache_name(persistent->filename, ".tmp");
+	if (!persistent->tmpname)
+		return -1;
+
+	persistent->fp = winpr_fopen(persistent->tmpname, "w+b");
 
 	if (!persistent->fp)
 		return -1;
@@ -300,8 +683,9 @@ static int persistent_cache_open_write(rdpPersistentCache* persistent)
 		memcpy(header.sig, sig_str, MIN(sizeof(header.sig), sizeof(sig_str)));
 		header.flags = 0x00000006;
 
-		if (fwrite(&header, sizeof(header), 1, persistent->fp) != 1)
+		if (persistent_cache_write(persistent, &header, sizeof(header)) < 1)
 			return -1;
+		persistent->end = sizeof(header);
 	}
 
 	ZeroMemory(persistent->bmpData, persistent->bmpSize);
@@ -309,6 +693,247 @@ static int persistent_cache_open_write(rdpPersistentCache* persistent)
 	return 1;
 }
 
+static void persistent_cache_journal_message_free(void* obj)
+{
+	wMessage* msg = obj;
+	if (msg && (msg->id == 0))
+		free(msg->wParam);
+}
+
+/* Accounts entry data entering or leaving the journal queue */
+static void persistent_cache_journal_queued(rdpPersistentCache* persistent, LONG size)
+{
+	WINPR_ASSERT(persistent);
+
+	const LONG queued = InterlockedExchangeAdd(&persistent->journalQueued, size);
+	WINPR_UNUSED(queued);
+}
+
+static BOOL persistent_cache_journal_write(rdpPersistentCache* persistent,
+                                           const PERSISTENT_CACHE_ENTRY* entry)
+{
+	PERSISTENT_CACHE_ENTRY_V3 entry3 = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(entry);
+
+	entry3.key64 = entry->key64;
+	entry3.width = entry->width;
+	entry3.height = entry->height;
+
+	if (fwrite(&entry3, sizeof(entry3), 1, persistent->journal) != 1)
+		return FALSE;
+	return fwrite(entry->data, entry->size, 1, persistent->journal) == 1;
+}
+
+/* Appends the queued entries to the cache file, a crash leaves at most a truncated entry */
+static DWORD WINAPI persistent_cache_journal_thread(LPVOID arg)
+{
+	rdpPersistentCache* persistent = arg;
+	BOOL failed = FALSE;
+
+	WINPR_ASSERT(persistent);
+
+	while (MessageQueue_Wait(persistent->journalQueue))
+	{
+		wMessage message = WINPR_C_ARRAY_INIT;
+
+		if (MessageQueue_Peek(persistent->journalQueue, &message, TRUE) < 1)
+			continue;
+
+		if (message.id == WMQ_QUIT)
+			break;
+
+		/* After a failed write the file ends with a truncated entry, later ones are lost */
+		PERSISTENT_CACHE_ENTRY* entry = message.wParam;
+		if (!failed)
+			failed = !persistent_cache_journal_write(persistent, entry);
+		persistent_cache_journal_queued(persistent, -(LONG)entry->size);
+		free(entry);
+
+		if (!failed && (MessageQueue_Size(persistent->journalQueue) == 0))
+			failed = fflush(persistent->journal) != 0;
+	}
+
+	return 0;
+}
+
+static BOOL persistent_cache_journal_start(rdpPersistentCache* persistent)
+{
+	WINPR_ASSERT(persistent);
+
+	persistent->journal = winpr_fopen(persistent->filename, "r+b");
+	if (!persistent->journal)
+		return FALSE;
+
+	if (_fseeki64(persistent->journal, 0, SEEK_END) != 0)
+		return FALSE;
+
+	/* Drop the truncated entry of a session that ended while appending */
+	const INT64 size = _ftelli64(persistent->journal);
+	if (size > persistent->end)
+	{
+#if defined(_WIN32)
+		if (_chsize_s(_fileno(persistent->journal), persistent->end) != 0)
+			return FALSE;
+#else
+		if (ftruncate(fileno(persistent->journal), (off_t)persistent->end) != 0)
+			return FALSE;
+#endif
+	}
+
+	if (_fseeki64(persistent->journal, persistent->end, SEEK_SET) != 0)
+		return FALSE;
+
+	persistent->journalQueue = MessageQueue_New(nullptr);
+	if (!persistent->journalQueue)
+		return FALSE;
+
+	wObject* obj = MessageQueue_Object(persistent->journalQueue);
+	WINPR_ASSERT(obj);
+	obj->fnObjectFree = persistent_cache_journal_message_free;
+
+	persistent->journalThread =
+	    CreateThread(nullptr, 0, persistent_cache_journal_thread, persistent, 0, nullptr);
+	return persistent->journalThread != nullptr;
+}
+
+static void persistent_cache_journal_stop(rdpPersistentCache* persistent)
+{
+	WINPR_ASSERT(persistent);
+
+	/* Entries queued so far are written before the thread quits */
+	if (persistent->journalThread)
+	{
+		if (MessageQueue_PostQuit(persistent->journalQueue, 0))
+			(void)WaitForSingleObject(persistent->journalThread, INFINITE);
+		(void)CloseHandle(persistent->journalThread);
+		persistent->journalThread = nullptr;
+	}
+
+	if (persistent->journalQueue)
+	{
+		(void)MessageQueue_Clear(persistent->journalQueue);
+		MessageQueue_Free(persistent->journalQueue);
+		persistent->journalQueue = nullptr;
+	}
+
+	if (persistent->journal)
+	{
+		(void)fclose(persistent->journal);
+		persistent->journal = nullptr;
+	}
+
+	HashTable_Free(persistent->keys);
+	persistent->keys = nullptr;
+	persistent->journalQueued = 0;
+}
+
+static UINT32 persistent_cache_key_hash(const void* key)
+{
+	const UINT64 key64 = *(const UINT64*)key;
+	return (UINT32)(key64 ^ (key64 >> 32));
+}
+
+static BOOL persistent_cache_key_equals(const void* key1, const void* key2)
+{
+	return *(const UINT64*)key1 == *(const UINT64*)key2;
+}
+
+static void* persistent_cache_key_clone(const void* key)
+{
+	UINT64* copy = malloc(sizeof(UINT64));
+	if (copy)
+		*copy = *(const UINT64*)key;
+	return copy;
+}
+
+static BOOL persistent_cache_add_key(rdpPersistentCache* persistent, UINT64 key64)
+{
+	WINPR_ASSERT(persistent);
+
+	/* Values must not be nullptr, the table is only used as a set */
+	return HashTable_Insert(persistent->keys, &key64, persistent);
+}
+
+/* Collects the keys of the file, an entry the file already holds is not appended again */
+static BOOL persistent_cache_load_keys(rdpPersistentCache* persistent)
+{
+	WINPR_ASSERT(persistent);
+
+	persistent->keys = HashTable_New(FALSE);
+	if (!persistent->keys ||
+	    !HashTable_SetHashFunction(persistent->keys, persistent_cache_key_hash))
+		return FALSE;
+
+	wObject* obj = HashTable_KeyObject(persistent->keys);
+	WINPR_ASSERT(obj);
+	obj->fnObjectNew = persistent_cache_key_clone;
+	obj->fnObjectFree = free;
+	obj->fnObjectEquals = persistent_cache_key_equals;
+
+	for (int x = 0; x < persistent->count; x++)
+	{
+		if (!persistent_cache_add_key(persistent, persistent->index[x].key64))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+int persistent_cache_append_entry(rdpPersistentCache* persistent,
+                                  const PERSISTENT_CACHE_ENTRY* entry)
+{
+	WINPR_ASSERT(persistent);
+	WINPR_ASSERT(entry);
+
+	if (persistent->write || !persistent->fp || (persistent->version != 3) || !entry->data ||
+	    (entry->size != 4ull * entry->width * entry->height))
+		return -1;
+
+	if (!persistent->journalThread)
+	{
+		if (!persistent_cache_load_keys(persistent) || !persistent_cache_journal_start(persistent))
+		{
+			persistent_cache_journal_stop(persistent);
+			return -1;
+		}
+	}
+
+	if (HashTable_Contains(persistent->keys, &entry->key64))
+		return 0;
+
+	/* A disk slower than the session loses entries instead of buffering them */
+	if ((entry->size > PERSIST_JOURNAL_MAX_QUEUED) ||
+	    (persistent->journalQueued > PERSIST_JOURNAL_MAX_QUEUED - (LONG)entry->size))
+		return 0;
+
+	/* The caller may reuse the data right away, the write happens in the background */
+	PERSISTENT_CACHE_ENTRY* copy = malloc(sizeof(PERSISTENT_CACHE_ENTRY) + entry->size);
+	if (!copy)
+		return -1;
+
+	*copy = *entry;
+	copy->data = (BYTE*)&copy[1];
+	memcpy(copy->data, entry->data, entry->size);
+
+	if (!persistent_cache_add_key(persistent, entry->key64))
+	{
+		free(copy);
+		return -1;
+	}
+
+	persistent_cache_journal_queued(persistent, (LONG)entry->size);
+	if (!MessageQueue_Post(persistent->journalQueue, persistent, 0, copy, nullptr))
+	{
+		persistent_cache_journal_queued(persistent, -(LONG)entry->size);
+		(void)HashTable_Remove(persistent->keys, &entry->key64);
+		free(copy);
+		return -1;
+	}
+
+	return 1;
+}
+
 int persistent_cache_open(rdpPersistentCache* persistent, const char* filename, BOOL write,
                           UINT32 version)
 {
@@ -333,14 +958,47 @@ int persistent_cache_open(rdpPersistentCache* persistent, const char* filename,
 
 int persistent_cache_close(rdpPersistentCache* persistent)
 {
+	int status = 1;
+
 	WINPR_ASSERT(persistent);
+	persistent_cache_journal_stop(persistent);
+	persistent_cache_unmap(persistent);
+
 	if (persistent->fp)
 	{
-		(void)fclose(persistent->fp);
+		if (fclose(persistent->fp) != 0)
+			persistent->failed = TRUE;
 		persistent->fp = nullptr;
+
+		if (persistent->write)
+		{
+			/* The index of the previous cache must never describe the new one */
+			char* index = persistent_cache_name(persistent->filename, ".idx");
+			if (index)
+			{
+				const BOOL rc = winpr_DeleteFile(index);
+				WINPR_UNUSED(rc);
+				free(index);
+			}
+
+			if (persistent->failed ||
+			    !winpr_MoveFileEx(persistent->tmpname, persistent->filename,
+			                      MOVEFILE_REPLACE_EXISTING))
+			{
+				const BOOL rc = winpr_DeleteFile(persistent->tmpname);
+				WINPR_UNUSED(rc);
+				status = -1;
+			}
+			else
+			{
+				/* Without an index the keys are read from the entry headers */
+				const BOOL rc = persistent_cache_save_index(persistent);
+				WINPR_UNUSED(rc);
+			}
+		}
 	}
 
-	return 1;
+	return status;
 }
 
 rdpPersistentCache* persistent_cache_new(void)
@@ -370,6 +1028,8 @@ void persistent_cache_free(rdpPersistentCache* persistent)
 	persistent_cache_close(persistent);
 
 	free(persistent->filename);
+	free(persistent->tmpname);
+	free(persistent->index);
 
 	winpr_aligned_free(persistent->bmpData);
 
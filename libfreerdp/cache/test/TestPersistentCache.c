@@ -0,0 +1,404 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/path.h>
+#include <winpr/file.h>
+#include <winpr/crypto.h>
+
+#include <freerdp/cache/persistent.h>
+
+#define TEST_ENTRIES 16
+
+static char* test_create_name(void)
+{
+	BYTE tmp[16] = WINPR_C_ARRAY_INIT;
+	char tmp2[64] = WINPR_C_ARRAY_INIT;
+
+	if (winpr_RAND(tmp, sizeof(tmp)) < 0)
+		return nullptr;
+
+	for (size_t x = 0; x < sizeof(tmp); x++)
+		(void)_snprintf(&tmp2[x * 2], sizeof(tmp2) - 2 * x, "%02" PRIx8, tmp[x]);
+	return GetKnownSubPath(KNOWN_PATH_TEMP, tmp2);
+}
+
+static void test_fill_entry(UINT32 version, size_t x, PERSISTENT_CACHE_ENTRY* entry, BYTE* data)
+{
+	entry->key64 = 0x1122334455667788ull + x;
+	entry->width = (UINT16)(1 + (x % 8) * 7);
+	entry->height = (UINT16)((version == 2) ? 64 - x : 1 + x * 5);
+	entry->size = 4u * entry->width * entry->height;
+	entry->flags = 0;
+	entry->data = data;
+
+	for (size_t y = 0; y < entry->size; y++)
+		data[y] = (BYTE)(x + y);
+}
+
+static BOOL test_check_entry(UINT32 version, size_t x, const PERSISTENT_CACHE_ENTRY* entry,
+                             BYTE* data)
+{
+	PERSISTENT_CACHE_ENTRY expect = WINPR_C_ARRAY_INIT;
+	test_fill_entry(version, x, &expect, data);
+
+	if ((entry->key64 != expect.key64) || (entry->width != expect.width) ||
+	    (entry->height != expect.height) || (entry->size != expect.size) || !entry->data)
+		return FALSE;
+	return memcmp(entry->data, expect.data, expect.size) == 0;
+}
+
+static BOOL test_write_cache(const char* name, UINT32 version, size_t count, BYTE* data)
+{
+	BOOL rc = FALSE;
+	rdpPersistentCache* persistent = persistent_cache_new();
+
+	if (!persistent)
+		return FALSE;
+
+	if (persistent_cache_open(persistent, name, TRUE, version) < 1)
+		goto fail;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+		test_fill_entry(version, x, &entry, data);
+		if (persistent_cache_write_entry(persistent, &entry) < 1)
+			goto fail;
+	}
+
+	rc = persistent_cache_close(persistent) > 0;
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+static BOOL test_read_cache(const char* name, UINT32 version, size_t count, BYTE* data)
+{
+	BOOL rc = FALSE;
+	rdpPersistentCache* persistent = persistent_cache_new();
+
+	if (!persistent)
+		return FALSE;
+
+	if (persistent_cache_open(persistent, name, FALSE, 0) < 1)
+		goto fail;
+
+	if ((persistent_cache_get_version(persistent) != (int)version) ||
+	    (persistent_cache_get_count(persistent) != (int)count))
+		goto fail;
+
+	/* Entries can be accessed in any order */
+	for (size_t x = count; x > 0; x--)
+	{
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+		if (persistent_cache_get_entry(persistent, x - 1, &entry) < 1)
+			goto fail;
+		if (!test_check_entry(version, x - 1, &entry, data))
+			goto fail;
+	}
+
+	for (size_t x = 0; x < count; x++)
+	{
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+		if (persistent_cache_read_entry(persistent, &entry) < 1)
+			goto fail;
+		if (!test_check_entry(version, x, &entry, data))
+			goto fail;
+	}
+
+	{
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+		if ((persistent_cache_read_entry(persistent, &entry) > 0) ||
+		    (persistent_cache_get_entry(persistent, count, &entry) > 0))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+/* Entries appended to an open cache are found the next time it is opened */
+static BOOL test_append_cache(const char* name, UINT32 version, size_t first, size_t count,
+                              BYTE* data)
+{
+	BOOL rc = FALSE;
+	rdpPersistentCache* persistent = persistent_cache_new();
+
+	if (!persistent)
+		return FALSE;
+
+	if (persistent_cache_open(persistent, name, FALSE, 0) < 1)
+		goto fail;
+
+	for (size_t x = first; x < first + count; x++)
+	{
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+		test_fill_entry(version, x, &entry, data);
+
+		const int status = persistent_cache_append_entry(persistent, &entry);
+
+		/* The data is copied, the caller may change it right away */
+		memset(data, 0xFF, entry.size);
+
+		/* Version 2 caches assign entries by position, nothing may be appended */
+		if ((version == 2) ? (status > 0) : (status < 1))
+			goto fail;
+	}
+
+	/* Keys in the file or appended before are skipped, the file does not grow */
+	for (size_t x = 0; (version == 3) && (x < first + count); x++)
+	{
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+		test_fill_entry(version, x, &entry, data);
+		if (persistent_cache_append_entry(persistent, &entry) != 0)
+			goto fail;
+	}
+
+	rc = persistent_cache_close(persistent) > 0;
+fail:
+	persistent_cache_free(persistent);
+	return rc;
+}
+
+static char* test_index_name(const char* name)
+{
+	const size_t size = strlen(name) + 5;
+	char* index = calloc(size, sizeof(char));
+	if (index)
+		(void)_snprintf(index, size, "%s.idx", name);
+	return index;
+}
+
+/* The key index is only used if it describes the cache */
+static BOOL test_replace_index(const char* index, const BYTE* data, size_t size)
+{
+	FILE* fp = winpr_fopen(index, "wb");
+
+	if (!fp)
+		return FALSE;
+
+	const BOOL rc = (size == 0) || (fwrite(data, size, 1, fp) == 1);
+	(void)fclose(fp);
+	return rc;
+}
+
+static BYTE* test_load_file(const char* name, size_t* size)
+{
+	BYTE* data = nullptr;
+	FILE* fp = winpr_fopen(name, "rb");
+
+	if (!fp)
+		return nullptr;
+
+	if (_fseeki64(fp, 0, SEEK_END) != 0)
+		goto fail;
+
+	const INT64 length = _ftelli64(fp);
+	if ((length <= 0) || (_fseeki64(fp, 0, SEEK_SET) != 0))
+		goto fail;
+
+	data = malloc((size_t)length);
+	if (data && (fread(data, (size_t)length, 1, fp) != 1))
+	{
+		free(data);
+		data = nullptr;
+	}
+	*size = (size_t)length;
+fail:
+	(void)fclose(fp);
+	return data;
+}
+
+static BOOL test_index(const char* name, UINT32 version, BYTE* data)
+{
+	BOOL rc = FALSE;
+	size_t size = 0;
+	BYTE* index = nullptr;
+	char* indexName = test_index_name(name);
+
+	if (!indexName)
+		return FALSE;
+
+	/* Saved with the cache, a stale one describes more entries than the file has */
+	if (!test_write_cache(name, version, TEST_ENTRIES, data))
+		goto fail;
+	index = test_load_file(indexName, &size);
+	if (!index || !test_write_cache(name, version, TEST_ENTRIES - 3, data))
+		goto fail;
+
+	if (!test_replace_index(indexName, index, size) ||
+	    !test_read_cache(name, version, TEST_ENTRIES - 3, data))
+		goto fail;
+
+	/* A damaged or cut off index is ignored */
+	if (!test_write_cache(name, version, TEST_ENTRIES, data))
+		goto fail;
+
+	index[size / 2] ^= 0x5A;
+	if (!test_replace_index(indexName, index, size) ||
+	    !test_read_cache(name, version, TEST_ENTRIES, data))
+		goto fail;
+
+	if (!test_replace_index(indexName, index, size / 2) ||
+	    !test_read_cache(name, version, TEST_ENTRIES, data))
+		goto fail;
+
+	if (!test_replace_index(indexName, index, 0) ||
+	    !test_read_cache(name, version, TEST_ENTRIES, data))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	{
+		const BOOL deleted = winpr_DeleteFile(indexName);
+		WINPR_UNUSED(deleted);
+	}
+	free(indexName);
+	free(index);
+	return rc;
+}
+
+/* A cache cut off while it was written keeps all complete entries */
+static BOOL test_truncate_cache(const char* name, size_t size)
+{
+	BOOL rc = FALSE;
+	BYTE* buffer = nullptr;
+	FILE* fp = winpr_fopen(name, "rb");
+
+	if (!fp)
+		return FALSE;
+
+	if (_fseeki64(fp, 0, SEEK_END) != 0)
+		goto fail;
+
+	const INT64 length = _ftelli64(fp);
+	if ((length < 0) || ((UINT64)length < size) || (_fseeki64(fp, 0, SEEK_SET) != 0))
+		goto fail;
+
+	buffer = malloc((size_t)length);
+	if (!buffer || (fread(buffer, (size_t)length, 1, fp) != 1))
+		goto fail;
+
+	(void)fclose(fp);
+	fp = winpr_fopen(name, "wb");
+	if (!fp)
+		goto fail;
+
+	rc = fwrite(buffer, (size_t)length - size, 1, fp) == 1;
+fail:
+	if (fp)
+		(void)fclose(fp);
+	free(buffer);
+	return rc;
+}
+
+static BOOL test_persistent_cache(UINT32 version)
+{
+	BOOL rc = FALSE;
+	char* name = test_create_name();
+	BYTE* data = calloc(1, 0x10000);
+
+	if (!name || !data)
+		goto fail;
+
+	if (!test_write_cache(name, version, TEST_ENTRIES, data))
+		goto fail;
+
+	if (!test_read_cache(name, version, TEST_ENTRIES, data))
+		goto fail;
+
+	/* The previous cache stays intact until a new one is completely written */
+	{
+		rdpPersistentCache* persistent = persistent_cache_new();
+		if (!persistent)
+			goto fail;
+
+		PERSISTENT_CACHE_ENTRY entry = WINPR_C_ARRAY_INIT;
+		test_fill_entry(version, 0, &entry, data);
+
+		const BOOL written = (persistent_cache_open(persistent, name, TRUE, version) > 0) &&
+		                     (persistent_cache_write_entry(persistent, &entry) > 0);
+		const BOOL intact = test_read_cache(name, version, TEST_ENTRIES, data);
+		persistent_cache_free(persistent);
+		if (!written || !intact)
+			goto fail;
+	}
+
+	if (!test_read_cache(name, version, 1, data))
+		goto fail;
+
+	if (!test_write_cache(name, version, TEST_ENTRIES, data))
+		goto fail;
+
+	if (!test_truncate_cache(name, 5))
+		goto fail;
+
+	if (!test_read_cache(name, version, TEST_ENTRIES - 1, data))
+		goto fail;
+
+	if (!test_index(name, version, data))
+		goto fail;
+
+	/* Entries added during a session are written behind the saved ones */
+	if (!test_write_cache(name, version, TEST_ENTRIES, data) ||
+	    !test_append_cache(name, version, TEST_ENTRIES, TEST_ENTRIES, data))
+		goto fail;
+
+	if (version == 3)
+	{
+		if (!test_read_cache(name, version, 2 * TEST_ENTRIES, data))
+			goto fail;
+
+		/* A session that ended while appending loses only the entry being written */
+		if (!test_truncate_cache(name, 5) ||
+		    !test_read_cache(name, version, 2 * TEST_ENTRIES - 1, data))
+			goto fail;
+
+		if (!test_append_cache(name, version, 2 * TEST_ENTRIES - 1, 2, data) ||
+		    !test_read_cache(name, version, 2 * TEST_ENTRIES + 1, data))
+			goto fail;
+	}
+	else if (!test_read_cache(name, version, TEST_ENTRIES, data))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	if (name)
+	{
+		char* index = test_index_name(name);
+		if (index)
+		{
+			const BOOL deleted = winpr_DeleteFile(index);
+			WINPR_UNUSED(deleted);
+		}
+		free(index);
+
+		const BOOL deleted = winpr_DeleteFile(name);
+		WINPR_UNUSED(deleted);
+	}
+	free(name);
+	free(data);
+	return rc;
+}
+
+int TestPersistentCache(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_persistent_cache(2))
+	{
+		(void)fprintf(stderr, "persistent cache version 2 failed\n");
+		return -1;
+	}
+
+	if (!test_persistent_cache(3))
+	{
+		(void)fprintf(stderr, "persistent cache version 3 failed\n");
+		return -1;
+	}
+
+	return 0;
+}
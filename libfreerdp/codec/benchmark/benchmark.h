@@ -0,0 +1,33 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Codec benchmarking tools - common helpers
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_CODEC_BENCHMARK_H
+#define FREERDP_LIB_CODEC_BENCHMARK_H
+
+#include <winpr/crt.h>
+#include <winpr/wtypes.h>
+
+/* Formats a duration in nanoseconds as s.ms.us.ns */
+static inline const char* benchmark_print_time(UINT64 t, char* buffer, size_t size)
+{
+	(void)_snprintf(buffer, size, "%u.%03u.%03u.%03u", (unsigned)(t / 1000000000ull),
+	                (unsigned)((t / 1000000ull) % 1000), (unsigned)((t / 1000ull) % 1000),
+	                (unsigned)((t) % 1000));
+	return buffer;
+}
+
+#endif /* FREERDP_LIB_CODEC_BENCHMARK_H */
@@ -0,0 +1,158 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Planar codec benchmarking tool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crypto.h>
+#include <winpr/sysinfo.h>
+#include <freerdp/settings.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/planar.h>
+
+#include "benchmark.h"
+
+#define PLANAR_BENCHMARK_RUNS 10
+
+/* Text like content: flat background with short runs of glyph pixels and some noisy images */
+static void planar_benchmark_fill(BYTE* frame, UINT32 width, UINT32 height)
+{
+	for (UINT32 y = 0; y < height; y++)
+	{
+		BYTE* line = &frame[4ull * width * y];
+		for (UINT32 x = 0; x < width; x++)
+		{
+			BYTE* pixel = &line[4ull * x];
+			const UINT32 tile = (x / 128) + (y / 128) * 17;
+
+			if (tile % 5 == 0)
+				continue; /* keep the random bytes */
+
+			const BOOL glyph = ((y % 16) < 11) && (((x * 7) ^ (y * 3)) % 11 < 3);
+			for (size_t c = 0; c < 3; c++)
+				pixel[c] = glyph ? (BYTE)(0x20 + c * 0x10) : 0xF0;
+			pixel[3] = 0xFF;
+		}
+	}
+}
+
+static BOOL planar_benchmark_run(const BYTE* frame, BYTE* output, UINT32 width, UINT32 height,
+                                 DWORD flags, UINT32 ThreadingFlags)
+{
+	BOOL rc = FALSE;
+	UINT64 bestEncode = UINT64_MAX;
+	UINT64 bestDecode = UINT64_MAX;
+	UINT32 size = 0;
+	BYTE* encoded = nullptr;
+	BITMAP_PLANAR_CONTEXT* encoder =
+	    freerdp_bitmap_planar_context_new_ex(flags, width, height, ThreadingFlags);
+	BITMAP_PLANAR_CONTEXT* decoder =
+	    freerdp_bitmap_planar_context_new_ex(flags, width, height, ThreadingFlags);
+
+	if (!encoder || !decoder)
+		goto fail;
+
+	for (size_t run = 0; run < PLANAR_BENCHMARK_RUNS; run++)
+	{
+		free(encoded);
+		size = 0;
+
+		UINT64 start = winpr_GetTickCount64NS();
+		encoded = freerdp_bitmap_compress_planar(encoder, frame, PIXEL_FORMAT_BGRX32, width,
+		                                         height, 4 * width, nullptr, &size);
+		UINT64 diff = winpr_GetTickCount64NS() - start;
+		if (!encoded)
+		{
+			(void)fprintf(stderr, "freerdp_bitmap_compress_planar failed\n");
+			goto fail;
+		}
+		if (diff < bestEncode)
+			bestEncode = diff;
+
+		start = winpr_GetTickCount64NS();
+		if (!freerdp_bitmap_decompress_planar(decoder, encoded, size, width, height, output,
+		                                      PIXEL_FORMAT_BGRX32, 4 * width, 0, 0, width, height,
+		                                      FALSE))
+		{
+			(void)fprintf(stderr, "freerdp_bitmap_decompress_planar failed\n");
+			goto fail;
+		}
+		diff = winpr_GetTickCount64NS() - start;
+		if (diff < bestDecode)
+			bestDecode = diff;
+	}
+
+	{
+		char buffer[32] = WINPR_C_ARRAY_INIT;
+		const double pixels = 1.0 * width * height;
+		printf("%s, %s: %" PRIu32 " bytes\n",
+		       (flags & PLANAR_FORMAT_HEADER_RLE) ? "RLE" : "raw",
+		       (ThreadingFlags & THREADING_FLAGS_DISABLE_THREADS) ? "single threaded"
+		                                                          : "thread pool",
+		       size);
+		printf("%-20s best %sns, %.1f MPixel/s\n", "frame encode",
+		       benchmark_print_time(bestEncode, buffer, sizeof(buffer)),
+		       pixels * 1000.0 / (double)bestEncode);
+		printf("%-20s best %sns, %.1f MPixel/s\n", "frame decode",
+		       benchmark_print_time(bestDecode, buffer, sizeof(buffer)),
+		       pixels * 1000.0 / (double)bestDecode);
+	}
+
+	rc = TRUE;
+fail:
+	free(encoded);
+	freerdp_bitmap_planar_context_free(encoder);
+	freerdp_bitmap_planar_context_free(decoder);
+	return rc;
+}
+
+int main(int argc, char* argv[])
+{
+	int rc = -1;
+	const UINT32 width = 1920;
+	const UINT32 height = 1080;
+	const DWORD flags[] = { PLANAR_FORMAT_HEADER_NA | PLANAR_FORMAT_HEADER_RLE,
+		                    PLANAR_FORMAT_HEADER_NA };
+	const UINT32 threading[] = { THREADING_FLAGS_DISABLE_THREADS, 0 };
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	BYTE* frame = calloc(4ull * width, height);
+	BYTE* output = calloc(4ull * width, height);
+	if (!frame || !output)
+		goto fail;
+
+	if (winpr_RAND(frame, 4ull * width * height) < 0)
+		goto fail;
+	planar_benchmark_fill(frame, width, height);
+
+	for (size_t x = 0; x < ARRAYSIZE(flags); x++)
+	{
+		for (size_t y = 0; y < ARRAYSIZE(threading); y++)
+		{
+			if (!planar_benchmark_run(frame, output, width, height, flags[x], threading[y]))
+				goto fail;
+			printf("\n");
+		}
+	}
+
+	rc = 0;
+fail:
+	free(frame);
+	free(output);
+	return rc;
+}
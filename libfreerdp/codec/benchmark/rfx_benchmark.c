@@ -0,0 +1,369 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX benchmarking tool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crypto.h>
+#include <winpr/stream.h>
+#include <winpr/sysinfo.h>
+#include <freerdp/codec/color.h>
+#include <freerdp/codec/rfx.h>
+#include <freerdp/codec/region.h>
+
+#include "../rfx_types.h"
+#include "benchmark.h"
+
+#define RFX_BENCHMARK_RUNS 10
+#define RFX_BENCHMARK_RLGR_SIZE 8192
+
+static const UINT32 rfx_benchmark_quant[] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 };
+
+typedef enum
+{
+	RFX_STAGE_DWT_ENCODE,
+	RFX_STAGE_QUANT_ENCODE,
+	RFX_STAGE_RLGR_ENCODE,
+	RFX_STAGE_RLGR_DECODE,
+	RFX_STAGE_QUANT_DECODE,
+	RFX_STAGE_DWT_DECODE,
+	RFX_STAGE_COUNT
+} rfx_benchmark_stage;
+
+static const char* rfx_benchmark_stage_names[] = { "dwt_2d_encode",       "quantization_encode",
+	                                               "rlgr_encode",         "rlgr_decode",
+	                                               "quantization_decode", "dwt_2d_decode" };
+
+typedef struct
+{
+	UINT32 width;
+	UINT32 height;
+	size_t components; /* number of 64x64 tiles times 3 color components */
+	INT16* coefficients;
+	INT16* work;
+	INT16* dwt;
+	BYTE* encoded;
+	UINT32* encodedSize;
+	BYTE* frame;
+	BYTE* output;
+	UINT64 best[RFX_STAGE_COUNT];
+} rfx_benchmark;
+
+static void rfx_benchmark_free(rfx_benchmark* bench)
+{
+	if (!bench)
+		return;
+
+	winpr_aligned_free(bench->coefficients);
+	winpr_aligned_free(bench->work);
+	winpr_aligned_free(bench->dwt);
+	free(bench->encoded);
+	free(bench->encodedSize);
+	free(bench->frame);
+	free(bench->output);
+
+	const rfx_benchmark empty = WINPR_C_ARRAY_INIT;
+	*bench = empty;
+}
+
+/* Mixes flat, gradient and noisy tiles, roughly what a desktop looks like */
+static BYTE rfx_benchmark_sample(UINT32 x, UINT32 y, size_t channel, BYTE noise)
+{
+	const UINT32 tile = (x / 64) + (y / 64) * 7;
+
+	switch (tile % 3)
+	{
+		case 0:
+			return (BYTE)(0xE0 - channel * 0x20);
+		case 1:
+			return (BYTE)((x * 3 + y * 5 + channel * 40) & 0xFF);
+		default:
+			return (BYTE)(((x ^ y) & 0xC0) + (noise & 0x3F));
+	}
+}
+
+static BOOL rfx_benchmark_init(rfx_benchmark* bench, UINT32 width, UINT32 height)
+{
+	bench->width = width;
+	bench->height = height;
+
+	const size_t tilesX = (width + 63) / 64;
+	const size_t tilesY = (height + 63) / 64;
+	bench->components = tilesX * tilesY * 3;
+
+	const size_t coeffSize = bench->components * 4096 * sizeof(INT16);
+	bench->coefficients = winpr_aligned_malloc(coeffSize, 32);
+	bench->work = winpr_aligned_malloc(coeffSize, 32);
+	bench->dwt = winpr_aligned_malloc(4096 * sizeof(INT16), 32);
+	bench->encoded = calloc(bench->components, RFX_BENCHMARK_RLGR_SIZE);
+	bench->encodedSize = calloc(bench->components, sizeof(UINT32));
+	bench->frame = calloc(4ull * width, height);
+	bench->output = calloc(4ull * width, height);
+
+	if (!bench->coefficients || !bench->work || !bench->dwt || !bench->encoded ||
+	    !bench->encodedSize || !bench->frame || !bench->output)
+		return FALSE;
+
+	if (winpr_RAND(bench->frame, 4ull * width * height) < 0)
+		return FALSE;
+
+	for (UINT32 y = 0; y < height; y++)
+	{
+		BYTE* line = &bench->frame[4ull * width * y];
+		for (UINT32 x = 0; x < width; x++)
+		{
+			BYTE* pixel = &line[4ull * x];
+			for (size_t c = 0; c < 3; c++)
+				pixel[c] = rfx_benchmark_sample(x, y, c, pixel[c]);
+			pixel[3] = 0xFF;
+		}
+	}
+
+	/* The coefficients are the components scaled by << 5, as after the RGB->YCbCr phase */
+	for (size_t i = 0; i < bench->components; i++)
+	{
+		const size_t tile = i / 3;
+		const UINT32 tileX = (UINT32)(tile % tilesX) * 64;
+		const UINT32 tileY = (UINT32)(tile / tilesX) * 64;
+		INT16* dst = &bench->coefficients[i * 4096];
+
+		for (UINT32 y = 0; y < 64; y++)
+		{
+			for (UINT32 x = 0; x < 64; x++)
+			{
+				const UINT32 px = MIN(tileX + x, width - 1);
+				const UINT32 py = MIN(tileY + y, height - 1);
+				const BYTE v = bench->frame[4ull * (1ull * py * width + px) + i % 3];
+				dst[y * 64 + x] = (INT16)((v - 128) * 32);
+			}
+		}
+	}
+
+	for (size_t x = 0; x < RFX_STAGE_COUNT; x++)
+		bench->best[x] = UINT64_MAX;
+
+	return TRUE;
+}
+
+static void rfx_benchmark_update(rfx_benchmark* bench, rfx_benchmark_stage stage, UINT64 start)
+{
+	const UINT64 diff = winpr_GetTickCount64NS() - start;
+	if (diff < bench->best[stage])
+		bench->best[stage] = diff;
+}
+
+static BOOL rfx_benchmark_stages_run(rfx_benchmark* bench, RFX_CONTEXT* context)
+{
+	const size_t count = bench->components;
+
+	for (size_t run = 0; run < RFX_BENCHMARK_RUNS; run++)
+	{
+		memcpy(bench->work, bench->coefficients, count * 4096 * sizeof(INT16));
+		memset(bench->encoded, 0, count * RFX_BENCHMARK_RLGR_SIZE);
+
+		UINT64 start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < count; x++)
+			context->dwt_2d_encode(&bench->work[x * 4096], bench->dwt);
+		rfx_benchmark_update(bench, RFX_STAGE_DWT_ENCODE, start);
+
+		start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < count; x++)
+		{
+			if (!context->quantization_encode(&bench->work[x * 4096], rfx_benchmark_quant,
+			                                  ARRAYSIZE(rfx_benchmark_quant)))
+				return FALSE;
+		}
+		rfx_benchmark_update(bench, RFX_STAGE_QUANT_ENCODE, start);
+
+		start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < count; x++)
+		{
+			const int rc =
+			    context->rlgr_encode(context->mode, &bench->work[x * 4096], 4096,
+			                         &bench->encoded[x * RFX_BENCHMARK_RLGR_SIZE],
+			                         RFX_BENCHMARK_RLGR_SIZE);
+			if (rc < 0)
+				return FALSE;
+			bench->encodedSize[x] = (UINT32)rc;
+		}
+		rfx_benchmark_update(bench, RFX_STAGE_RLGR_ENCODE, start);
+
+		start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < count; x++)
+		{
+			if (context->rlgr_decode(context->mode, &bench->encoded[x * RFX_BENCHMARK_RLGR_SIZE],
+			                         bench->encodedSize[x], &bench->work[x * 4096], 4096) < 0)
+				return FALSE;
+		}
+		rfx_benchmark_update(bench, RFX_STAGE_RLGR_DECODE, start);
+
+		start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < count; x++)
+		{
+			if (!context->quantization_decode(&bench->work[x * 4096], rfx_benchmark_quant,
+			                                  ARRAYSIZE(rfx_benchmark_quant)))
+				return FALSE;
+		}
+		rfx_benchmark_update(bench, RFX_STAGE_QUANT_DECODE, start);
+
+		start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < count; x++)
+			context->dwt_2d_decode(&bench->work[x * 4096], bench->dwt);
+		rfx_benchmark_update(bench, RFX_STAGE_DWT_DECODE, start);
+	}
+
+	size_t encoded = 0;
+	for (size_t x = 0; x < count; x++)
+		encoded += bench->encodedSize[x];
+
+	printf("%" PRIuz " tile components, %" PRIuz " bytes RLGR%d encoded\n", count, encoded,
+	       context->mode == RLGR1 ? 1 : 3);
+
+	for (size_t x = 0; x < RFX_STAGE_COUNT; x++)
+	{
+		char buffer[32] = WINPR_C_ARRAY_INIT;
+		const UINT64 best = bench->best[x];
+		const double tiles = (best > 0) ? (1000000000.0 * (double)count / (double)best) : 0.0;
+		printf("%-20s best %sns, %.0f tile components/s\n", rfx_benchmark_stage_names[x],
+		       benchmark_print_time(best, buffer, sizeof(buffer)), tiles);
+	}
+
+	return TRUE;
+}
+
+static BOOL rfx_benchmark_frame_run(rfx_benchmark* bench, RFX_CONTEXT* encoder,
+                                    RFX_CONTEXT* decoder)
+{
+	BOOL rc = FALSE;
+	UINT64 bestEncode = UINT64_MAX;
+	UINT64 bestDecode = UINT64_MAX;
+	size_t size = 0;
+	const UINT32 stride = 4 * bench->width;
+	const RFX_RECT rect = { 0, 0, (UINT16)bench->width, (UINT16)bench->height };
+	REGION16 region = WINPR_C_ARRAY_INIT;
+	wStream* s = Stream_New(nullptr, 1024);
+
+	region16_init(&region);
+	if (!s)
+		goto fail;
+
+	for (size_t run = 0; run < RFX_BENCHMARK_RUNS; run++)
+	{
+		Stream_ResetPosition(s);
+
+		UINT64 start = winpr_GetTickCount64NS();
+		if (!rfx_compose_message(encoder, s, &rect, 1, bench->frame, bench->width, bench->height,
+		                         stride))
+		{
+			(void)fprintf(stderr, "rfx_compose_message failed\n");
+			goto fail;
+		}
+		UINT64 diff = winpr_GetTickCount64NS() - start;
+		if (diff < bestEncode)
+			bestEncode = diff;
+
+		size = Stream_GetPosition(s);
+		region16_clear(&region);
+
+		start = winpr_GetTickCount64NS();
+		if (!rfx_process_message(decoder, Stream_Buffer(s), (UINT32)size, 0, 0, bench->output,
+		                         PIXEL_FORMAT_BGRX32, stride, bench->height, &region))
+		{
+			(void)fprintf(stderr, "rfx_process_message failed\n");
+			goto fail;
+		}
+		diff = winpr_GetTickCount64NS() - start;
+		if (diff < bestDecode)
+			bestDecode = diff;
+	}
+
+	{
+		char buffer[32] = WINPR_C_ARRAY_INIT;
+		const double pixels = 1.0 * bench->width * bench->height;
+		printf("%" PRIu32 "x%" PRIu32 " frame, %" PRIuz " bytes\n", bench->width, bench->height,
+		       size);
+		printf("%-20s best %sns, %.1f MPixel/s\n", "frame encode",
+		       benchmark_print_time(bestEncode, buffer, sizeof(buffer)),
+		       pixels * 1000.0 / (double)bestEncode);
+		printf("%-20s best %sns, %.1f MPixel/s\n", "frame decode",
+		       benchmark_print_time(bestDecode, buffer, sizeof(buffer)),
+		       pixels * 1000.0 / (double)bestDecode);
+	}
+
+	rc = TRUE;
+fail:
+	region16_uninit(&region);
+	Stream_Free(s, TRUE);
+	return rc;
+}
+
+static BOOL rfx_benchmark_run(UINT32 width, UINT32 height, RLGR_MODE mode)
+{
+	BOOL rc = FALSE;
+	rfx_benchmark bench = WINPR_C_ARRAY_INIT;
+	RFX_CONTEXT* encoder = rfx_context_new(TRUE);
+	RFX_CONTEXT* decoder = rfx_context_new(FALSE);
+
+	if (!encoder || !decoder)
+		goto fail;
+
+	if (!rfx_context_reset(encoder, width, height) || !rfx_context_set_mode(encoder, mode))
+		goto fail;
+
+	rfx_context_set_pixel_format(encoder, PIXEL_FORMAT_BGRX32);
+	rfx_context_set_pixel_format(decoder, PIXEL_FORMAT_BGRX32);
+
+	if (!rfx_benchmark_init(&bench, width, height))
+	{
+		(void)fprintf(stderr, "failed to allocate benchmark data\n");
+		goto fail;
+	}
+
+	printf("Running RLGR%d tile stages benchmark:\n", mode == RLGR1 ? 1 : 3);
+	if (!rfx_benchmark_stages_run(&bench, encoder))
+	{
+		(void)fprintf(stderr, "tile stages benchmark failed\n");
+		goto fail;
+	}
+	printf("\n");
+
+	printf("Running RLGR%d frame benchmark:\n", mode == RLGR1 ? 1 : 3);
+	if (!rfx_benchmark_frame_run(&bench, encoder, decoder))
+	{
+		(void)fprintf(stderr, "frame benchmark failed\n");
+		goto fail;
+	}
+	printf("\n");
+
+	rc = TRUE;
+fail:
+	rfx_benchmark_free(&bench);
+	rfx_context_free(encoder);
+	rfx_context_free(decoder);
+	return rc;
+}
+
+int main(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!rfx_benchmark_run(3840, 2160, RLGR1))
+		return -1;
+	if (!rfx_benchmark_run(3840, 2160, RLGR3))
+		return -1;
+	return 0;
+}
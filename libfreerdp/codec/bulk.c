@@ -19,6 +19,7 @@
 
 #include <math.h>
 #include <winpr/assert.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/config.h>
 
@@ -33,6 +34,21 @@
 
 //#define WITH_BULK_DEBUG 1
 
+/* Adaptive compression: PDUs with an estimated entropy above the threshold (bits per byte) are
+ * already compressed (RFX, H.264, JPEG, ...) and sent as they are. */
+#define BULK_ENTROPY_MIN_SIZE 256
+#define BULK_ENTROPY_SAMPLE_SIZE 4096
+#define BULK_ENTROPY_BLOCK_SIZE 64
+#define BULK_ENTROPY_THRESHOLD 7.5
+
+/* Update types the compressor failed to shrink this many times in a row are sent uncompressed
+ * for the next BULK_BACKOFF_PACKETS PDUs before compression is tried again. */
+#define BULK_MISS_LIMIT 8
+#define BULK_BACKOFF_PACKETS 32
+#define BULK_MISS_RATIO 0.97
+
+#define BULK_UPDATE_TYPES 16
+
 struct rdp_bulk
 {
 	ALIGN64 rdpContext* context;
@@ -44,6 +60,8 @@ struct rdp_bulk
 	ALIGN64 NCRUSH_CONTEXT* ncrushSend;
 	ALIGN64 XCRUSH_CONTEXT* xcrushRecv;
 	ALIGN64 XCRUSH_CONTEXT* xcrushSend;
+	ALIGN64 UINT32 Misses[BULK_UPDATE_TYPES];
+	ALIGN64 UINT32 Backoff[BULK_UPDATE_TYPES];
 	ALIGN64 BYTE OutputBuffer[65536];
 };
 
@@ -242,7 +260,108 @@ int bulk_decompress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSr
 	return status;
 }
 
-int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
+/**
+ * Estimate the Shannon entropy in bits per byte. Large PDUs are sampled with evenly spread blocks
+ * to keep the estimate cheap compared to the compressor.
+ */
+WINPR_ATTR_NODISCARD
+static double bulk_estimate_entropy(const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize)
+{
+	UINT32 histogram[256] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	WINPR_ASSERT(pSrcData);
+
+	if (SrcSize <= BULK_ENTROPY_SAMPLE_SIZE)
+	{
+		for (size_t x = 0; x < SrcSize; x++)
+			histogram[pSrcData[x]]++;
+		count = SrcSize;
+	}
+	else
+	{
+		const size_t blocks = BULK_ENTROPY_SAMPLE_SIZE / BULK_ENTROPY_BLOCK_SIZE;
+		const size_t stride = (SrcSize - BULK_ENTROPY_BLOCK_SIZE) / (blocks - 1);
+
+		for (size_t block = 0; block < blocks; block++)
+		{
+			const BYTE* src = &pSrcData[block * stride];
+			for (size_t x = 0; x < BULK_ENTROPY_BLOCK_SIZE; x++)
+				histogram[src[x]]++;
+		}
+		count = blocks * BULK_ENTROPY_BLOCK_SIZE;
+	}
+
+	if (count == 0)
+		return 0.0;
+
+	double entropy = 0.0;
+	size_t symbols = 0;
+	for (size_t x = 0; x < ARRAYSIZE(histogram); x++)
+	{
+		if (histogram[x] == 0)
+			continue;
+
+		const double p = (double)histogram[x] / (double)count;
+		entropy -= p * log2(p);
+		symbols++;
+	}
+
+	/* Miller-Madow correction, small samples underestimate the entropy */
+	entropy += (double)(symbols - 1) / (2.0 * (double)count * log(2.0));
+	return entropy;
+}
+
+/**
+ * Decide if a PDU should bypass the compressor. Compressing data that does not shrink costs CPU
+ * and, for MPPC and NCRUSH, pollutes the history buffer.
+ */
+WINPR_ATTR_NODISCARD
+static BOOL bulk_compress_skip(rdpBulk* WINPR_RESTRICT bulk, UINT32 UpdateType,
+                               const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize)
+{
+	WINPR_ASSERT(bulk);
+
+	if (UpdateType < BULK_UPDATE_TYPES)
+	{
+		if (bulk->Backoff[UpdateType] > 0)
+		{
+			bulk->Backoff[UpdateType]--;
+			return TRUE;
+		}
+	}
+
+	if (SrcSize < BULK_ENTROPY_MIN_SIZE)
+		return FALSE;
+
+	return bulk_estimate_entropy(pSrcData, SrcSize) >= BULK_ENTROPY_THRESHOLD;
+}
+
+static void bulk_compress_feedback(rdpBulk* WINPR_RESTRICT bulk, UINT32 UpdateType,
+                                   UINT32 SrcSize, UINT32 DstSize, UINT32 Flags)
+{
+	WINPR_ASSERT(bulk);
+
+	if (UpdateType >= BULK_UPDATE_TYPES)
+		return;
+
+	const BOOL miss = ((Flags & PACKET_COMPRESSED) == 0) ||
+	                  ((double)DstSize >= (double)SrcSize * BULK_MISS_RATIO);
+	if (!miss)
+	{
+		bulk->Misses[UpdateType] = 0;
+		return;
+	}
+
+	if (++bulk->Misses[UpdateType] >= BULK_MISS_LIMIT)
+	{
+		bulk->Misses[UpdateType] = 0;
+		bulk->Backoff[UpdateType] = BULK_BACKOFF_PACKETS;
+	}
+}
+
+int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, UINT32 UpdateType,
+                  const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
                   const BYTE** WINPR_RESTRICT ppDstData, UINT32* WINPR_RESTRICT pDstSize,
                   UINT32* WINPR_RESTRICT pFlags)
 {
@@ -253,6 +372,7 @@ int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSrcD
 	WINPR_ASSERT(pSrcData);
 	WINPR_ASSERT(ppDstData);
 	WINPR_ASSERT(pDstSize);
+	WINPR_ASSERT(pFlags);
 
 	rdpMetrics* metrics = bulk->context->metrics;
 	WINPR_ASSERT(metrics);
@@ -264,10 +384,24 @@ int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSrcD
 		return 0;
 	}
 
-	*pDstSize = sizeof(bulk->OutputBuffer);
+	const UINT64 start = winpr_GetTickCount64NS();
 	const UINT32 CompressionLevel = bulk_compression_level(bulk);
 	bulk_update_compression_max_size(bulk);
 
+	const BOOL adaptive =
+	    freerdp_settings_get_bool(bulk->context->settings, FreeRDP_CompressionAdaptive);
+	if (adaptive && bulk_compress_skip(bulk, UpdateType, pSrcData, SrcSize))
+	{
+		*ppDstData = pSrcData;
+		*pDstSize = SrcSize;
+		*pFlags = 0;
+		metrics_write_compression(metrics, CompressionLevel, UpdateType, SrcSize, SrcSize,
+		                          winpr_GetTickCount64NS() - start, TRUE);
+		return 0;
+	}
+
+	*pDstSize = sizeof(bulk->OutputBuffer);
+
 	switch (CompressionLevel)
 	{
 		case PACKET_COMPR_TYPE_8K:
@@ -300,6 +434,11 @@ int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSrcD
 		const UINT32 UncompressedBytes = SrcSize;
 		const double CompressionRatio =
 		    metrics_write_bytes(metrics, UncompressedBytes, CompressedBytes);
+		metrics_write_compression(metrics, CompressionLevel, UpdateType, UncompressedBytes,
+		                          CompressedBytes, winpr_GetTickCount64NS() - start, FALSE);
+		if (adaptive)
+			bulk_compress_feedback(bulk, UpdateType, UncompressedBytes, CompressedBytes,
+			                       *pFlags);
 #ifdef WITH_BULK_DEBUG
 		{
 			WLog_DBG(TAG,
@@ -335,6 +474,8 @@ void bulk_reset(rdpBulk* WINPR_RESTRICT bulk)
 	ncrush_context_reset(bulk->ncrushSend, FALSE);
 	xcrush_context_reset(bulk->xcrushRecv, FALSE);
 	xcrush_context_reset(bulk->xcrushSend, FALSE);
+	memset(bulk->Misses, 0, sizeof(bulk->Misses));
+	memset(bulk->Backoff, 0, sizeof(bulk->Backoff));
 }
 
 rdpBulk* bulk_new(rdpContext* context)
@@ -36,9 +36,25 @@ FREERDP_LOCAL int bulk_decompress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINP
                                   UINT32 SrcSize, const BYTE** WINPR_RESTRICT ppDstData,
                                   UINT32* WINPR_RESTRICT pDstSize, UINT32 flags);
 
+/**
+ * @brief bulk_compress Compress a PDU with the negotiated bulk compressor
+ *
+ * With FreeRDP_CompressionAdaptive PDUs that look incompressible are returned as they are with
+ * \b *pFlags set to \b 0.
+ *
+ * @param bulk The bulk compression context
+ * @param UpdateType The fastpath update code of the PDU, used for statistics and adaptation
+ * @param pSrcData The PDU to compress
+ * @param SrcSize The size of the PDU
+ * @param ppDstData Receives a pointer to the data to send
+ * @param pDstSize Receives the size of the data to send
+ * @param pFlags Receives the compression flags
+ * @return A negative value in case of failure
+ */
 WINPR_ATTR_NODISCARD
-FREERDP_LOCAL int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, const BYTE* WINPR_RESTRICT pSrcData,
-                                UINT32 SrcSize, const BYTE** WINPR_RESTRICT ppDstData,
+FREERDP_LOCAL int bulk_compress(rdpBulk* WINPR_RESTRICT bulk, UINT32 UpdateType,
+                                const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
+                                const BYTE** WINPR_RESTRICT ppDstData,
                                 UINT32* WINPR_RESTRICT pDstSize, UINT32* WINPR_RESTRICT pFlags);
 
 FREERDP_LOCAL void bulk_reset(rdpBulk* WINPR_RESTRICT bulk);
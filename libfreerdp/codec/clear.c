@@ -37,6 +37,18 @@
 
 #define CLEARCODEC_VBAR_SIZE 32768
 #define CLEARCODEC_VBAR_SHORT_SIZE 16384
+#define CLEARCODEC_VBAR_MAX_HEIGHT 52
+#define CLEARCODEC_RLEX_MAX_COLORS 127
+
+#define CLEARCODEC_SUBCODEC_UNCOMPRESSED 0
+#define CLEARCODEC_SUBCODEC_NSCODEC 1
+#define CLEARCODEC_SUBCODEC_RLEX 2
+
+/* The encoder classifies the image in blocks of this size */
+#define CLEARCODEC_BLOCK_WIDTH 64
+#define CLEARCODEC_BLOCK_HEIGHT 32
+#define CLEARCODEC_BANDS_MIN_PERCENT 60
+#define CLEARCODEC_VBAR_LOOKUP_SIZE 65536
 
 typedef struct
 {
@@ -52,6 +64,63 @@ typedef struct
 	BYTE* pixels;
 } CLEAR_VBAR_ENTRY;
 
+typedef enum
+{
+	CLEAR_BLOCK_RESIDUAL = 0,
+	CLEAR_BLOCK_BANDS,
+	CLEAR_BLOCK_RLEX,
+	CLEAR_BLOCK_NSCODEC
+} CLEAR_BLOCK_TYPE;
+
+typedef struct
+{
+	CLEAR_BLOCK_TYPE type;
+	UINT32 colorBkg;
+} CLEAR_BLOCK;
+
+typedef struct
+{
+	UINT32 count;
+	BYTE used[256];
+	BYTE index[256];
+	UINT32 keys[256];
+	UINT32 hits[256];
+	UINT32 palette[CLEARCODEC_RLEX_MAX_COLORS];
+} CLEAR_COLOR_SET;
+
+typedef struct
+{
+	UINT32 count;
+	UINT32 pixels[CLEARCODEC_VBAR_MAX_HEIGHT];
+} CLEAR_ENCODER_VBAR;
+
+/**
+ * The encoder keeps a copy of the vBar caches the decoder builds up so that
+ * cache hits can be verified before they are sent.
+ * The lookup tables map a 16 bit hash to (cache index + 1).
+ */
+typedef struct
+{
+	NSC_CONTEXT* nsc;
+	BOOL cacheReset;
+	size_t pixelCount;
+	BYTE* bitmap;
+	BYTE* flipped;
+	UINT32* image;
+	BYTE* covered;
+	BYTE* indices;
+	wStream* residual;
+	wStream* bands;
+	wStream* subcodecs;
+	wStream* payload;
+	UINT32 VBarCursor;
+	UINT16 VBarLookup[CLEARCODEC_VBAR_LOOKUP_SIZE];
+	CLEAR_ENCODER_VBAR VBars[CLEARCODEC_VBAR_SIZE];
+	UINT32 ShortVBarCursor;
+	UINT16 ShortVBarLookup[CLEARCODEC_VBAR_LOOKUP_SIZE];
+	CLEAR_ENCODER_VBAR ShortVBars[CLEARCODEC_VBAR_SHORT_SIZE];
+} CLEAR_ENCODER;
+
 struct S_CLEAR_CONTEXT
 {
 	BOOL Compressor;
@@ -66,6 +135,7 @@ struct S_CLEAR_CONTEXT
 	CLEAR_VBAR_ENTRY VBarStorage[CLEARCODEC_VBAR_SIZE];
 	UINT32 ShortVBarStorageCursor;
 	CLEAR_VBAR_ENTRY ShortVBarStorage[CLEARCODEC_VBAR_SHORT_SIZE];
+	CLEAR_ENCODER* encoder;
 	wLog* log;
 };
 
@@ -1269,6 +1339,685 @@ fail:
 	return rc;
 }
 
+static void clear_color_set_reset(CLEAR_COLOR_SET* WINPR_RESTRICT set)
+{
+	set->count = 0;
+	ZeroMemory(set->used, sizeof(set->used));
+}
+
+static inline size_t clear_color_set_slot(const CLEAR_COLOR_SET* WINPR_RESTRICT set, UINT32 color)
+{
+	size_t slot = ((color * 0x9E3779B1u) >> 24) & 0xFF;
+
+	while (set->used[slot] && (set->keys[slot] != color))
+		slot = (slot + 1) & 0xFF;
+
+	return slot;
+}
+
+/* Returns FALSE if the color does not fit into a RLEX palette anymore */
+static inline BOOL clear_color_set_add(CLEAR_COLOR_SET* WINPR_RESTRICT set, UINT32 color)
+{
+	const size_t slot = clear_color_set_slot(set, color);
+
+	if (set->used[slot])
+	{
+		set->hits[slot]++;
+		return TRUE;
+	}
+
+	if (set->count >= CLEARCODEC_RLEX_MAX_COLORS)
+		return FALSE;
+
+	set->used[slot] = 1;
+	set->keys[slot] = color;
+	set->hits[slot] = 1;
+	set->index[slot] = (BYTE)set->count;
+	set->palette[set->count++] = color;
+	return TRUE;
+}
+
+static BOOL clear_color_set_add_rect(CLEAR_COLOR_SET* WINPR_RESTRICT set,
+                                     const UINT32* WINPR_RESTRICT image, UINT32 nWidth, UINT32 x,
+                                     UINT32 y, UINT32 width, UINT32 height)
+{
+	for (UINT32 j = 0; j < height; j++)
+	{
+		const UINT32* line = &image[1ull * (y + j) * nWidth + x];
+
+		for (UINT32 i = 0; i < width; i++)
+		{
+			if (!clear_color_set_add(set, line[i]))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static inline void clear_write_color(wStream* WINPR_RESTRICT s, UINT32 color)
+{
+	Stream_Write_UINT8(s, color & 0xFF);
+	Stream_Write_UINT8(s, (color >> 8) & 0xFF);
+	Stream_Write_UINT8(s, (color >> 16) & 0xFF);
+}
+
+static inline void clear_write_run_length(wStream* WINPR_RESTRICT s, UINT32 runLength)
+{
+	if (runLength < 0xFF)
+		Stream_Write_UINT8(s, (BYTE)runLength);
+	else
+	{
+		Stream_Write_UINT8(s, 0xFF);
+
+		if (runLength < 0xFFFF)
+			Stream_Write_UINT16(s, (UINT16)runLength);
+		else
+		{
+			Stream_Write_UINT16(s, 0xFFFF);
+			Stream_Write_UINT32(s, runLength);
+		}
+	}
+}
+
+static inline UINT16 clear_vbar_hash(const UINT32* WINPR_RESTRICT pixels, UINT32 count)
+{
+	UINT32 hash = 2166136261u ^ count;
+
+	for (UINT32 i = 0; i < count; i++)
+	{
+		hash ^= pixels[i];
+		hash *= 16777619u;
+	}
+
+	return (UINT16)(hash ^ (hash >> 16));
+}
+
+static inline BOOL clear_vbar_equal(const CLEAR_ENCODER_VBAR* WINPR_RESTRICT vBar,
+                                    const UINT32* WINPR_RESTRICT pixels, UINT32 count)
+{
+	if (vBar->count != count)
+		return FALSE;
+
+	return memcmp(vBar->pixels, pixels, sizeof(UINT32) * count) == 0;
+}
+
+static void clear_encoder_reset_vbar_storage(CLEAR_ENCODER* WINPR_RESTRICT encoder)
+{
+	encoder->VBarCursor = 0;
+	encoder->ShortVBarCursor = 0;
+	ZeroMemory(encoder->VBarLookup, sizeof(encoder->VBarLookup));
+	ZeroMemory(encoder->ShortVBarLookup, sizeof(encoder->ShortVBarLookup));
+}
+
+static BOOL clear_encoder_resize(CLEAR_ENCODER* WINPR_RESTRICT encoder, UINT32 nWidth,
+                                 UINT32 nHeight)
+{
+	const size_t count = 1ull * nWidth * nHeight;
+
+	if (count <= encoder->pixelCount)
+		return TRUE;
+
+	winpr_aligned_free(encoder->bitmap);
+	winpr_aligned_free(encoder->flipped);
+	winpr_aligned_free(encoder->image);
+	winpr_aligned_free(encoder->covered);
+	winpr_aligned_free(encoder->indices);
+	encoder->bitmap = winpr_aligned_malloc(count * 4ull, 32);
+	encoder->flipped = winpr_aligned_malloc(count * 4ull, 32);
+	encoder->image = winpr_aligned_malloc(count * sizeof(UINT32), 32);
+	encoder->covered = winpr_aligned_malloc(count, 32);
+	encoder->indices = winpr_aligned_malloc(count, 32);
+
+	if (!encoder->bitmap || !encoder->flipped || !encoder->image || !encoder->covered ||
+	    !encoder->indices)
+	{
+		encoder->pixelCount = 0;
+		return FALSE;
+	}
+
+	encoder->pixelCount = count;
+	return TRUE;
+}
+
+static void clear_encoder_free(CLEAR_ENCODER* encoder)
+{
+	if (!encoder)
+		return;
+
+	nsc_context_free(encoder->nsc);
+	Stream_Free(encoder->residual, TRUE);
+	Stream_Free(encoder->bands, TRUE);
+	Stream_Free(encoder->subcodecs, TRUE);
+	Stream_Free(encoder->payload, TRUE);
+	winpr_aligned_free(encoder->bitmap);
+	winpr_aligned_free(encoder->flipped);
+	winpr_aligned_free(encoder->image);
+	winpr_aligned_free(encoder->covered);
+	winpr_aligned_free(encoder->indices);
+	winpr_aligned_free(encoder);
+}
+
+static CLEAR_ENCODER* clear_encoder_new(void)
+{
+	CLEAR_ENCODER* encoder = winpr_aligned_calloc(1, sizeof(CLEAR_ENCODER), 32);
+
+	if (!encoder)
+		return nullptr;
+
+	encoder->cacheReset = TRUE;
+	encoder->nsc = nsc_context_new();
+	encoder->residual = Stream_New(nullptr, 1024);
+	encoder->bands = Stream_New(nullptr, 1024);
+	encoder->subcodecs = Stream_New(nullptr, 1024);
+	encoder->payload = Stream_New(nullptr, 1024);
+
+	if (!encoder->nsc || !encoder->residual || !encoder->bands || !encoder->subcodecs ||
+	    !encoder->payload)
+		goto fail;
+
+	if (!nsc_context_set_parameters(encoder->nsc, NSC_COLOR_FORMAT, PIXEL_FORMAT_BGRX32) ||
+	    !nsc_context_set_parameters(encoder->nsc, NSC_COLOR_LOSS_LEVEL, 1) ||
+	    !nsc_context_set_parameters(encoder->nsc, NSC_ALLOW_SUBSAMPLING, FALSE))
+		goto fail;
+
+	return encoder;
+fail:
+	clear_encoder_free(encoder);
+	return nullptr;
+}
+
+static void clear_encoder_set_covered(CLEAR_ENCODER* WINPR_RESTRICT encoder, UINT32 nWidth,
+                                      UINT32 x, UINT32 y, UINT32 width, UINT32 height)
+{
+	for (UINT32 j = 0; j < height; j++)
+		memset(&encoder->covered[1ull * (y + j) * nWidth + x], 1, width);
+}
+
+static CLEAR_BLOCK clear_encoder_classify_block(const UINT32* WINPR_RESTRICT image, UINT32 nWidth,
+                                                UINT32 x, UINT32 y, UINT32 width, UINT32 height)
+{
+	CLEAR_BLOCK block = { CLEAR_BLOCK_NSCODEC, 0 };
+	CLEAR_COLOR_SET set;
+	UINT32 maxHits = 0;
+
+	clear_color_set_reset(&set);
+
+	if (!clear_color_set_add_rect(&set, image, nWidth, x, y, width, height))
+		return block;
+
+	if (set.count == 1)
+	{
+		block.type = CLEAR_BLOCK_RESIDUAL;
+		return block;
+	}
+
+	for (size_t i = 0; i < ARRAYSIZE(set.used); i++)
+	{
+		if (set.used[i] && (set.hits[i] > maxHits))
+		{
+			maxHits = set.hits[i];
+			block.colorBkg = set.keys[i];
+		}
+	}
+
+	if (100ull * maxHits >= 1ull * CLEARCODEC_BANDS_MIN_PERCENT * width * height)
+		block.type = CLEAR_BLOCK_BANDS;
+	else
+		block.type = CLEAR_BLOCK_RLEX;
+
+	return block;
+}
+
+static BOOL clear_encode_residual(CLEAR_ENCODER* WINPR_RESTRICT encoder, UINT32 nWidth,
+                                  UINT32 nHeight)
+{
+	const size_t count = 1ull * nWidth * nHeight;
+	wStream* s = encoder->residual;
+	UINT32 color = 0;
+	UINT32 runLength = 0;
+	size_t i = 0;
+
+	while ((i < count) && encoder->covered[i])
+		i++;
+
+	/* Everything is overwritten by bands and subcodecs, skip the residual layer */
+	if (i == count)
+		return TRUE;
+
+	color = encoder->image[i];
+	runLength = (UINT32)i;
+
+	for (; i < count; i++)
+	{
+		const UINT32 pixel = encoder->image[i];
+
+		if (encoder->covered[i] || (pixel == color))
+		{
+			runLength++;
+			continue;
+		}
+
+		if (!Stream_EnsureRemainingCapacity(s, 10))
+			return FALSE;
+
+		clear_write_color(s, color);
+		clear_write_run_length(s, runLength);
+		color = pixel;
+		runLength = 1;
+	}
+
+	if (!Stream_EnsureRemainingCapacity(s, 10))
+		return FALSE;
+
+	clear_write_color(s, color);
+	clear_write_run_length(s, runLength);
+	return TRUE;
+}
+
+static void clear_encode_vbar(CLEAR_ENCODER* WINPR_RESTRICT encoder, wStream* WINPR_RESTRICT s,
+                              const UINT32* WINPR_RESTRICT column, UINT32 height, UINT32 colorBkg)
+{
+	const UINT16 hash = clear_vbar_hash(column, height);
+	const UINT16 lookup = encoder->VBarLookup[hash];
+	UINT32 yOn = 0;
+	UINT32 yOff = height;
+
+	if (lookup && clear_vbar_equal(&encoder->VBars[lookup - 1], column, height))
+	{
+		Stream_Write_UINT16(s, 0x8000 | (lookup - 1));
+		return;
+	}
+
+	while ((yOn < height) && (column[yOn] == colorBkg))
+		yOn++;
+
+	while ((yOff > yOn) && (column[yOff - 1] == colorBkg))
+		yOff--;
+
+	if (yOn == yOff)
+		yOn = yOff = 0;
+
+	{
+		const UINT32 shortCount = yOff - yOn;
+		const UINT16 shortHash = clear_vbar_hash(&column[yOn], shortCount);
+		const UINT16 shortLookup = encoder->ShortVBarLookup[shortHash];
+
+		if (shortLookup &&
+		    clear_vbar_equal(&encoder->ShortVBars[shortLookup - 1], &column[yOn], shortCount))
+		{
+			Stream_Write_UINT16(s, 0x4000 | (shortLookup - 1));
+			Stream_Write_UINT8(s, (BYTE)yOn);
+		}
+		else
+		{
+			CLEAR_ENCODER_VBAR* vBarShort = &encoder->ShortVBars[encoder->ShortVBarCursor];
+
+			Stream_Write_UINT16(s, (UINT16)((yOff << 8) | yOn));
+
+			for (UINT32 y = yOn; y < yOff; y++)
+				clear_write_color(s, column[y]);
+
+			vBarShort->count = shortCount;
+			memcpy(vBarShort->pixels, &column[yOn], sizeof(UINT32) * shortCount);
+			encoder->ShortVBarLookup[shortHash] = (UINT16)(encoder->ShortVBarCursor + 1);
+			encoder->ShortVBarCursor =
+			    (encoder->ShortVBarCursor + 1) % CLEARCODEC_VBAR_SHORT_SIZE;
+		}
+	}
+
+	/* The decoder stores every short vBar (hit or miss) as a full vBar as well */
+	{
+		CLEAR_ENCODER_VBAR* vBar = &encoder->VBars[encoder->VBarCursor];
+		vBar->count = height;
+		memcpy(vBar->pixels, column, sizeof(UINT32) * height);
+		encoder->VBarLookup[hash] = (UINT16)(encoder->VBarCursor + 1);
+		encoder->VBarCursor = (encoder->VBarCursor + 1) % CLEARCODEC_VBAR_SIZE;
+	}
+}
+
+static BOOL clear_encode_band(CLEAR_ENCODER* WINPR_RESTRICT encoder, UINT32 nWidth, UINT32 x,
+                              UINT32 y, UINT32 width, UINT32 height, UINT32 colorBkg)
+{
+	wStream* s = encoder->bands;
+	UINT32 column[CLEARCODEC_VBAR_MAX_HEIGHT] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(height <= CLEARCODEC_VBAR_MAX_HEIGHT);
+
+	if (!Stream_EnsureRemainingCapacity(s, 11ull + width * (3ull + height * 3ull)))
+		return FALSE;
+
+	Stream_Write_UINT16(s, (UINT16)x);
+	Stream_Write_UINT16(s, (UINT16)(x + width - 1));
+	Stream_Write_UINT16(s, (UINT16)y);
+	Stream_Write_UINT16(s, (UINT16)(y + height - 1));
+	clear_write_color(s, colorBkg);
+
+	for (UINT32 i = 0; i < width; i++)
+	{
+		for (UINT32 j = 0; j < height; j++)
+			column[j] = encoder->image[1ull * (y + j) * nWidth + x + i];
+
+		clear_encode_vbar(encoder, s, column, height, colorBkg);
+	}
+
+	clear_encoder_set_covered(encoder, nWidth, x, y, width, height);
+	return TRUE;
+}
+
+static BOOL clear_encode_subcodec_header(wStream* WINPR_RESTRICT s, UINT32 x, UINT32 y,
+                                         UINT32 width, UINT32 height, size_t byteCount,
+                                         BYTE subcodecId)
+{
+	if (byteCount > UINT32_MAX)
+		return FALSE;
+
+	if (!Stream_EnsureRemainingCapacity(s, 13ull + byteCount))
+		return FALSE;
+
+	Stream_Write_UINT16(s, (UINT16)x);
+	Stream_Write_UINT16(s, (UINT16)y);
+	Stream_Write_UINT16(s, (UINT16)width);
+	Stream_Write_UINT16(s, (UINT16)height);
+	Stream_Write_UINT32(s, (UINT32)byteCount);
+	Stream_Write_UINT8(s, subcodecId);
+	return TRUE;
+}
+
+static BOOL clear_encode_rlex(CLEAR_ENCODER* WINPR_RESTRICT encoder,
+                              const CLEAR_COLOR_SET* WINPR_RESTRICT set, UINT32 nWidth, UINT32 x,
+                              UINT32 y, UINT32 width, UINT32 height)
+{
+	wStream* s = encoder->payload;
+	const size_t count = 1ull * width * height;
+	const UINT32 numBits = CLEAR_LOG2_FLOOR[set->count - 1] + 1;
+	const UINT32 maxDepth = CLEAR_8BIT_MASKS[8 - numBits];
+	BYTE* indices = encoder->indices;
+	size_t i = 0;
+
+	WINPR_ASSERT(set->count > 0);
+	WINPR_ASSERT(set->count <= CLEARCODEC_RLEX_MAX_COLORS);
+
+	for (UINT32 j = 0; j < height; j++)
+	{
+		const UINT32* line = &encoder->image[1ull * (y + j) * nWidth + x];
+
+		for (UINT32 k = 0; k < width; k++)
+			*indices++ = set->index[clear_color_set_slot(set, line[k])];
+	}
+
+	indices = encoder->indices;
+	Stream_ResetPosition(s);
+
+	if (!Stream_EnsureRemainingCapacity(s, 1ull + 3ull * set->count))
+		return FALSE;
+
+	Stream_Write_UINT8(s, (BYTE)set->count);
+
+	for (UINT32 k = 0; k < set->count; k++)
+		clear_write_color(s, set->palette[k]);
+
+	while (i < count)
+	{
+		const BYTE startIndex = indices[i];
+		UINT32 runLength = 0;
+		UINT32 suiteDepth = 0;
+
+		/* A segment is a run of startIndex followed by a suite of ascending indices */
+		while ((i + runLength + 1 < count) && (indices[i + runLength + 1] == startIndex))
+			runLength++;
+
+		i += runLength + 1;
+
+		while ((i < count) && (suiteDepth < maxDepth) &&
+		       (indices[i] == startIndex + suiteDepth + 1))
+		{
+			suiteDepth++;
+			i++;
+		}
+
+		if (!Stream_EnsureRemainingCapacity(s, 8))
+			return FALSE;
+
+		Stream_Write_UINT8(s, (BYTE)((suiteDepth << numBits) | (startIndex + suiteDepth)));
+		clear_write_run_length(s, runLength);
+	}
+
+	if (!clear_encode_subcodec_header(encoder->subcodecs, x, y, width, height,
+	                                  Stream_GetPosition(s), CLEARCODEC_SUBCODEC_RLEX))
+		return FALSE;
+
+	Stream_Write(encoder->subcodecs, Stream_Buffer(s), Stream_GetPosition(s));
+	clear_encoder_set_covered(encoder, nWidth, x, y, width, height);
+	return TRUE;
+}
+
+static BOOL clear_encode_nscodec(CLEAR_ENCODER* WINPR_RESTRICT encoder, UINT32 nWidth, UINT32 x,
+                                 UINT32 y, UINT32 width, UINT32 height)
+{
+	wStream* s = encoder->payload;
+	const size_t rawSize = 3ull * width * height;
+	const BYTE* data = &encoder->bitmap[(1ull * y * nWidth + x) * 4ull];
+
+	/* nsc_compose_message encodes bottom up, ClearCodec decodes NSCodec top down */
+	if (!freerdp_image_copy_no_overlap(encoder->flipped, PIXEL_FORMAT_BGRX32, width * 4, 0, 0,
+	                                   width, height, data, PIXEL_FORMAT_BGRX32, nWidth * 4, 0, 0,
+	                                   nullptr, FREERDP_FLIP_VERTICAL))
+		return FALSE;
+
+	Stream_ResetPosition(s);
+
+	if (nsc_compose_message(encoder->nsc, s, encoder->flipped, width, height, width * 4) &&
+	    (Stream_GetPosition(s) < rawSize))
+	{
+		if (!clear_encode_subcodec_header(encoder->subcodecs, x, y, width, height,
+		                                  Stream_GetPosition(s), CLEARCODEC_SUBCODEC_NSCODEC))
+			return FALSE;
+
+		Stream_Write(encoder->subcodecs, Stream_Buffer(s), Stream_GetPosition(s));
+	}
+	else
+	{
+		if (!clear_encode_subcodec_header(encoder->subcodecs, x, y, width, height, rawSize,
+		                                  CLEARCODEC_SUBCODEC_UNCOMPRESSED))
+			return FALSE;
+
+		for (UINT32 j = 0; j < height; j++)
+		{
+			const UINT32* line = &encoder->image[1ull * (y + j) * nWidth + x];
+
+			for (UINT32 i = 0; i < width; i++)
+				clear_write_color(encoder->subcodecs, line[i]);
+		}
+	}
+
+	clear_encoder_set_covered(encoder, nWidth, x, y, width, height);
+	return TRUE;
+}
+
+static BOOL clear_encode_blocks(CLEAR_ENCODER* WINPR_RESTRICT encoder, UINT32 nWidth, UINT32 y,
+                                UINT32 height)
+{
+	CLEAR_COLOR_SET set;
+	CLEAR_COLOR_SET merged;
+	UINT32 x = 0;
+
+	while (x < nWidth)
+	{
+		UINT32 width = MIN(CLEARCODEC_BLOCK_WIDTH, nWidth - x);
+		const CLEAR_BLOCK block =
+		    clear_encoder_classify_block(encoder->image, nWidth, x, y, width, height);
+
+		/* Merge neighbouring blocks of the same kind into a single band or subcodec */
+		switch (block.type)
+		{
+			case CLEAR_BLOCK_RESIDUAL:
+				break;
+
+			case CLEAR_BLOCK_BANDS:
+				while (x + width < nWidth)
+				{
+					const UINT32 next = MIN(CLEARCODEC_BLOCK_WIDTH, nWidth - x - width);
+					const CLEAR_BLOCK nextBlock = clear_encoder_classify_block(
+					    encoder->image, nWidth, x + width, y, next, height);
+
+					if ((nextBlock.type != CLEAR_BLOCK_BANDS) ||
+					    (nextBlock.colorBkg != block.colorBkg))
+						break;
+
+					width += next;
+				}
+
+				if (!clear_encode_band(encoder, nWidth, x, y, width, height, block.colorBkg))
+					return FALSE;
+				break;
+
+			case CLEAR_BLOCK_RLEX:
+				clear_color_set_reset(&set);
+				if (!clear_color_set_add_rect(&set, encoder->image, nWidth, x, y, width, height))
+					return FALSE;
+
+				while (x + width < nWidth)
+				{
+					const UINT32 next = MIN(CLEARCODEC_BLOCK_WIDTH, nWidth - x - width);
+					const CLEAR_BLOCK nextBlock = clear_encoder_classify_block(
+					    encoder->image, nWidth, x + width, y, next, height);
+
+					if (nextBlock.type != CLEAR_BLOCK_RLEX)
+						break;
+
+					merged = set;
+
+					if (!clear_color_set_add_rect(&merged, encoder->image, nWidth, x + width, y,
+					                              next, height))
+						break;
+
+					set = merged;
+					width += next;
+				}
+
+				if (!clear_encode_rlex(encoder, &set, nWidth, x, y, width, height))
+					return FALSE;
+				break;
+
+			case CLEAR_BLOCK_NSCODEC:
+			default:
+				while (x + width < nWidth)
+				{
+					const UINT32 next = MIN(CLEARCODEC_BLOCK_WIDTH, nWidth - x - width);
+					const CLEAR_BLOCK nextBlock = clear_encoder_classify_block(
+					    encoder->image, nWidth, x + width, y, next, height);
+
+					if (nextBlock.type != CLEAR_BLOCK_NSCODEC)
+						break;
+
+					width += next;
+				}
+
+				if (!clear_encode_nscodec(encoder, nWidth, x, y, width, height))
+					return FALSE;
+				break;
+		}
+
+		x += width;
+	}
+
+	return TRUE;
+}
+
+BOOL clear_compose_message(CLEAR_CONTEXT* WINPR_RESTRICT clear, wStream* WINPR_RESTRICT s,
+                           const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcFormat, UINT32 nSrcStep,
+                           UINT32 nWidth, UINT32 nHeight)
+{
+	BYTE glyphFlags = 0;
+
+	if (!clear || !s || !pSrcData)
+		return FALSE;
+
+	CLEAR_ENCODER* encoder = clear->encoder;
+
+	if (!clear->Compressor || !encoder)
+	{
+		WLog_Print(clear->log, WLOG_ERROR, "context was not created as compressor");
+		return FALSE;
+	}
+
+	if ((nWidth == 0) || (nHeight == 0) || (nWidth > 0xFFFF) || (nHeight > 0xFFFF))
+		return FALSE;
+
+	if (nSrcStep == 0)
+		nSrcStep = nWidth * FreeRDPGetBytesPerPixel(SrcFormat);
+
+	if (!clear_encoder_resize(encoder, nWidth, nHeight))
+		return FALSE;
+
+	if (!freerdp_image_copy_no_overlap(encoder->bitmap, PIXEL_FORMAT_BGRX32, nWidth * 4, 0, 0,
+	                                   nWidth, nHeight, pSrcData, SrcFormat, nSrcStep, 0, 0,
+	                                   nullptr, FREERDP_FLIP_NONE))
+		return FALSE;
+
+	{
+		const size_t count = 1ull * nWidth * nHeight;
+		const BYTE* pixel = encoder->bitmap;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			encoder->image[i] = pixel[0] | ((UINT32)pixel[1] << 8) | ((UINT32)pixel[2] << 16);
+			pixel += 4;
+		}
+
+		memset(encoder->covered, 0, count);
+	}
+
+	if (encoder->cacheReset)
+	{
+		glyphFlags |= CLEARCODEC_FLAG_CACHE_RESET;
+		clear_encoder_reset_vbar_storage(encoder);
+		encoder->cacheReset = FALSE;
+	}
+
+	Stream_ResetPosition(encoder->residual);
+	Stream_ResetPosition(encoder->bands);
+	Stream_ResetPosition(encoder->subcodecs);
+
+	for (UINT32 y = 0; y < nHeight; y += CLEARCODEC_BLOCK_HEIGHT)
+	{
+		const UINT32 height = MIN(CLEARCODEC_BLOCK_HEIGHT, nHeight - y);
+
+		if (!clear_encode_blocks(encoder, nWidth, y, height))
+			return FALSE;
+	}
+
+	if (!clear_encode_residual(encoder, nWidth, nHeight))
+		return FALSE;
+
+	{
+		const size_t residualByteCount = Stream_GetPosition(encoder->residual);
+		const size_t bandsByteCount = Stream_GetPosition(encoder->bands);
+		const size_t subcodecByteCount = Stream_GetPosition(encoder->subcodecs);
+
+		if ((residualByteCount > UINT32_MAX) || (bandsByteCount > UINT32_MAX) ||
+		    (subcodecByteCount > UINT32_MAX))
+			return FALSE;
+
+		if (!Stream_EnsureRemainingCapacity(
+		        s, 14ull + residualByteCount + bandsByteCount + subcodecByteCount))
+			return FALSE;
+
+		Stream_Write_UINT8(s, glyphFlags);
+		Stream_Write_UINT8(s, (BYTE)clear->seqNumber);
+		Stream_Write_UINT32(s, (UINT32)residualByteCount);
+		Stream_Write_UINT32(s, (UINT32)bandsByteCount);
+		Stream_Write_UINT32(s, (UINT32)subcodecByteCount);
+		Stream_Write(s, Stream_Buffer(encoder->residual), residualByteCount);
+		Stream_Write(s, Stream_Buffer(encoder->bands), bandsByteCount);
+		Stream_Write(s, Stream_Buffer(encoder->subcodecs), subcodecByteCount);
+	}
+
+	clear->seqNumber = (clear->seqNumber + 1) % 256;
+	return TRUE;
+}
+
 #if !defined(WITHOUT_FREERDP_3x_DEPRECATED)
 int clear_compress(WINPR_ATTR_UNUSED CLEAR_CONTEXT* WINPR_RESTRICT clear,
                    WINPR_ATTR_UNUSED const BYTE* WINPR_RESTRICT pSrcData,
@@ -1316,6 +2065,14 @@ CLEAR_CONTEXT* clear_context_new(BOOL Compressor)
 	if (!clear->TempBuffer)
 		goto error_nsc;
 
+	if (Compressor)
+	{
+		clear->encoder = clear_encoder_new();
+
+		if (!clear->encoder)
+			goto error_nsc;
+	}
+
 	if (!clear_context_reset(clear))
 		goto error_nsc;
 
@@ -1334,6 +2091,7 @@ void clear_context_free(CLEAR_CONTEXT* WINPR_RESTRICT clear)
 		return;
 
 	nsc_context_free(clear->nsc);
+	clear_encoder_free(clear->encoder);
 	winpr_aligned_free(clear->TempBuffer);
 
 	clear_reset_vbar_storage(clear, TRUE);
@@ -26,14 +26,25 @@
 #include <winpr/assert.h>
 #include <winpr/cast.h>
 #include <winpr/print.h>
+#include <winpr/pool.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/primitives.h>
 #include <freerdp/log.h>
+#include <freerdp/settings.h>
 #include <freerdp/codec/bitmap.h>
 #include <freerdp/codec/planar.h>
 
+#include "planar.h"
+#include "sse/planar_sse2.h"
+
 #define TAG FREERDP_TAG("codec")
 
+/* Images smaller than this are always processed on the calling thread */
+#define PLANAR_THREADING_MIN_PIXELS (128 * 128)
+#define PLANAR_MIN_BAND_ROWS 32
+#define PLANAR_MAX_BANDS 16
+
 #define PLANAR_ALIGN(val, align) \
 	((val) % (align) == 0) ? (val) : ((val) + (align) - (val) % (align))
 
@@ -67,35 +78,6 @@ typedef struct
 	BYTE formatHeader;
 } RDP6_BITMAP_STREAM;
 
-struct S_BITMAP_PLANAR_CONTEXT
-{
-	UINT32 maxWidth;
-	UINT32 maxHeight;
-	UINT32 maxPlaneSize;
-
-	BOOL AllowSkipAlpha;
-	BOOL AllowRunLengthEncoding;
-	BOOL AllowColorSubsampling;
-	BOOL AllowDynamicColorFidelity;
-
-	UINT32 ColorLossLevel;
-
-	BYTE* planes[4];
-	BYTE* planesBuffer;
-
-	BYTE* deltaPlanes[4];
-	BYTE* deltaPlanesBuffer;
-
-	BYTE* rlePlanes[4];
-	BYTE* rlePlanesBuffer;
-
-	BYTE* pTempData;
-	UINT32 nTempStep;
-
-	BOOL bgr;
-	BOOL topdown;
-};
-
 static inline BYTE PLANAR_CONTROL_BYTE(UINT32 nRunLength, UINT32 cRawBytes)
 {
 	return WINPR_ASSERTING_INT_CAST(UINT8, ((nRunLength & 0x0F) | ((cRawBytes & 0x0F) << 4)));
@@ -110,6 +92,69 @@ static inline BYTE PLANAR_CONTROL_BYTE_RAW_BYTES(UINT32 controlByte)
 	return ((controlByte >> 4) & 0x0F);
 }
 
+/* Upper bound of a RLE encoded scanline, raw segments cost one control byte per 15 bytes */
+static inline size_t planar_rle_row_size(UINT32 width)
+{
+	return 1ull * width + width / 8 + 4;
+}
+
+/* Number of horizontal bands an image is split into for the thread pool */
+static inline UINT32 planar_band_count(const BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
+                                       UINT32 width, UINT32 height)
+{
+	WINPR_ASSERT(planar);
+
+	if (!planar->useThreads || (1ull * width * height < PLANAR_THREADING_MIN_PIXELS))
+		return 1;
+
+	return MAX(1, MIN(planar->maxBands, height / PLANAR_MIN_BAND_ROWS));
+}
+
+static inline UINT32 planar_band_start(UINT32 height, UINT32 bands, UINT32 band)
+{
+	return (UINT32)(1ull * height * band / bands);
+}
+
+/**
+ * Runs callback for count parameter blocks of size bytes each. The first block is processed on
+ * the calling thread, the others on the default thread pool if threading is enabled.
+ */
+static void planar_run_work(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
+                            PTP_WORK_CALLBACK callback, void* params, size_t size, size_t count)
+{
+	PTP_WORK work[4 * PLANAR_MAX_BANDS] = WINPR_C_ARRAY_INIT;
+	BYTE* param = params;
+
+	WINPR_ASSERT(planar);
+	WINPR_ASSERT(callback);
+	WINPR_ASSERT(count <= ARRAYSIZE(work));
+
+	for (size_t x = 1; x < count; x++)
+	{
+		void* cur = &param[x * size];
+
+		if (planar->useThreads)
+			work[x] = CreateThreadpoolWork(callback, cur, nullptr);
+
+		if (work[x])
+			SubmitThreadpoolWork(work[x]);
+		else
+			callback(nullptr, cur, nullptr);
+	}
+
+	if (count > 0)
+		callback(nullptr, param, nullptr);
+
+	for (size_t x = 1; x < count; x++)
+	{
+		if (!work[x])
+			continue;
+
+		WaitForThreadpoolWorkCallbacks(work[x], FALSE);
+		CloseThreadpoolWork(work[x]);
+	}
+}
+
 static inline UINT32 planar_invert_format(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar, BOOL alpha,
                                           UINT32 DstFormat)
 {
@@ -177,9 +222,6 @@ static inline BOOL freerdp_bitmap_planar_compress_plane_rle(const BYTE* WINPR_RE
                                                             UINT32 width, UINT32 height,
                                                             BYTE* WINPR_RESTRICT outPlane,
                                                             UINT32* WINPR_RESTRICT dstSize);
-static inline BYTE* freerdp_bitmap_planar_delta_encode_plane(const BYTE* WINPR_RESTRICT inPlane,
-                                                             UINT32 width, UINT32 height,
-                                                             BYTE* WINPR_RESTRICT outPlane);
 
 static inline INT32 planar_skip_plane_rle(const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
                                           UINT32 nWidth, UINT32 nHeight)
@@ -707,6 +749,201 @@ static BOOL planar_subsample_expand(const BYTE* WINPR_RESTRICT plane, size_t pla
 	return TRUE;
 }
 
+typedef struct
+{
+	const BYTE* src;
+	UINT32 srcSize;
+	BYTE* dst;
+	UINT32 width;
+	UINT32 height;
+	INT32 status;
+} PLANAR_RLE_WORK_PARAM;
+
+typedef struct
+{
+	const BYTE* planes[4];
+	BYTE* dst;
+	UINT32 format;
+	UINT32 step;
+	UINT32 x;
+	UINT32 y;
+	UINT32 width;
+	UINT32 height;
+	BOOL vFlip;
+	UINT32 totalHeight;
+	BOOL rc;
+} PLANAR_RAW_WORK_PARAM;
+
+typedef struct
+{
+	const BYTE* src;
+	UINT32 srcStep;
+	BYTE* dst;
+	UINT32 format;
+	UINT32 dstStep;
+	UINT32 width;
+	UINT32 height;
+	BYTE cll;
+	BOOL alpha;
+	BOOL rc;
+} PLANAR_YCOCG_WORK_PARAM;
+
+static void CALLBACK planar_decompress_plane_rle_work_callback(
+    WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance, void* context,
+    WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	PLANAR_RLE_WORK_PARAM* param = context;
+	WINPR_ASSERT(param);
+
+	param->status = planar_decompress_plane_rle_only(param->src, param->srcSize, param->dst,
+	                                                 param->width, param->height);
+}
+
+static void CALLBACK planar_decompress_planes_raw_work_callback(
+    WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance, void* context,
+    WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	PLANAR_RAW_WORK_PARAM* param = context;
+	WINPR_ASSERT(param);
+
+	param->rc = planar_decompress_planes_raw(param->planes, param->dst, param->format, param->step,
+	                                         param->x, param->y, param->width, param->height,
+	                                         param->vFlip, param->totalHeight);
+}
+
+static void CALLBACK planar_ycocg_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance,
+                                                void* context, WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	PLANAR_YCOCG_WORK_PARAM* param = context;
+	const primitives_t* prims = primitives_get();
+	WINPR_ASSERT(param);
+	WINPR_ASSERT(prims);
+	WINPR_ASSERT(prims->YCoCgToRGB_8u_AC4R);
+
+	const int rc = prims->YCoCgToRGB_8u_AC4R(
+	    param->src, WINPR_ASSERTING_INT_CAST(int32_t, param->srcStep), param->dst, param->format,
+	    WINPR_ASSERTING_INT_CAST(int32_t, param->dstStep), param->width, param->height, param->cll,
+	    param->alpha);
+	if (rc != PRIMITIVES_SUCCESS)
+		WLog_ERR(TAG, "YCoCgToRGB_8u_AC4R failed with %d", rc);
+	param->rc = (rc == PRIMITIVES_SUCCESS);
+}
+
+/* Decodes the RLE planes selected by mask into separate buffers, one plane per work item */
+static BOOL planar_decompress_planes_rle_only(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
+                                              const BYTE* planes[4], const INT32 rleSizes[4],
+                                              const UINT32 rawWidths[4],
+                                              const UINT32 rawHeights[4], BYTE* rleBuffer[4],
+                                              UINT32 mask)
+{
+	PLANAR_RLE_WORK_PARAM params[4] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	for (size_t x = 0; x < 4; x++)
+	{
+		if (!(mask & (1u << x)))
+			continue;
+
+		PLANAR_RLE_WORK_PARAM* param = &params[count++];
+		param->src = planes[x];
+		param->srcSize = WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[x]);
+		param->dst = rleBuffer[x];
+		param->width = rawWidths[x];
+		param->height = rawHeights[x];
+	}
+
+	planar_run_work(planar, planar_decompress_plane_rle_work_callback, params, sizeof(params[0]),
+	                count);
+
+	for (size_t x = 0; x < count; x++)
+	{
+		if (params[x].status < 0)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* planar_decompress_planes_raw split in horizontal bands */
+static BOOL planar_decompress_planes_raw_bands(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
+                                               const BYTE* pSrcData[4], BYTE* pDstData,
+                                               UINT32 DstFormat, UINT32 nDstStep, UINT32 nXDst,
+                                               UINT32 nYDst, UINT32 nWidth, UINT32 nHeight,
+                                               BOOL vFlip, UINT32 totalHeight)
+{
+	PLANAR_RAW_WORK_PARAM params[PLANAR_MAX_BANDS] = WINPR_C_ARRAY_INIT;
+	const UINT32 bands = planar_band_count(planar, nWidth, nHeight);
+
+	if (bands <= 1)
+		return planar_decompress_planes_raw(pSrcData, pDstData, DstFormat, nDstStep, nXDst, nYDst,
+		                                    nWidth, nHeight, vFlip, totalHeight);
+
+	for (UINT32 x = 0; x < bands; x++)
+	{
+		PLANAR_RAW_WORK_PARAM* param = &params[x];
+		const UINT32 first = planar_band_start(nHeight, bands, x);
+		const UINT32 last = planar_band_start(nHeight, bands, x + 1);
+
+		for (size_t y = 0; y < 4; y++)
+		{
+			if (pSrcData[y])
+				param->planes[y] = &pSrcData[y][1ull * first * nWidth];
+		}
+
+		param->dst = pDstData;
+		param->format = DstFormat;
+		param->step = nDstStep;
+		param->x = nXDst;
+		param->y = vFlip ? nYDst + nHeight - last : nYDst + first;
+		param->width = nWidth;
+		param->height = last - first;
+		param->vFlip = vFlip;
+		param->totalHeight = totalHeight;
+	}
+
+	planar_run_work(planar, planar_decompress_planes_raw_work_callback, params, sizeof(params[0]),
+	                bands);
+
+	for (UINT32 x = 0; x < bands; x++)
+	{
+		if (!params[x].rc)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static BOOL planar_ycocg_to_rgb(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar, const BYTE* pSrc,
+                                UINT32 srcStep, BYTE* pDst, UINT32 DstFormat, UINT32 dstStep,
+                                UINT32 width, UINT32 height, BYTE cll, BOOL alpha)
+{
+	PLANAR_YCOCG_WORK_PARAM params[PLANAR_MAX_BANDS] = WINPR_C_ARRAY_INIT;
+	const UINT32 bands = planar_band_count(planar, width, height);
+
+	for (UINT32 x = 0; x < bands; x++)
+	{
+		PLANAR_YCOCG_WORK_PARAM* param = &params[x];
+		const UINT32 first = planar_band_start(height, bands, x);
+
+		param->src = &pSrc[1ull * first * srcStep];
+		param->srcStep = srcStep;
+		param->dst = &pDst[1ull * first * dstStep];
+		param->format = DstFormat;
+		param->dstStep = dstStep;
+		param->width = width;
+		param->height = planar_band_start(height, bands, x + 1) - first;
+		param->cll = cll;
+		param->alpha = alpha;
+	}
+
+	planar_run_work(planar, planar_ycocg_work_callback, params, sizeof(params[0]), bands);
+
+	for (UINT32 x = 0; x < bands; x++)
+	{
+		if (!params[x].rc)
+			return FALSE;
+	}
+	return TRUE;
+}
+
 #if !defined(WITHOUT_FREERDP_3x_DEPRECATED)
 BOOL planar_decompress(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
                        const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize, UINT32 nSrcWidth,
@@ -957,8 +1194,9 @@ BOOL freerdp_bitmap_decompress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT plan
 
 		if (!rle) /* RAW */
 		{
-			if (!planar_decompress_planes_raw(planes, pTempData, TempFormat, nTempStep, nXDst,
-			                                  nYDst, nSrcWidth, nSrcHeight, vFlip, nTotalHeight))
+			if (!planar_decompress_planes_raw_bands(planar, planes, pTempData, TempFormat,
+			                                        nTempStep, nXDst, nYDst, nSrcWidth,
+			                                        nSrcHeight, vFlip, nTotalHeight))
 				return FALSE;
 
 			if (alpha)
@@ -989,44 +1227,79 @@ BOOL freerdp_bitmap_decompress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT plan
 				return FALSE;
 			}
 
-			status = planar_decompress_plane_rle(
-			    planes[0], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[0]), pTempData, nTempStep,
-			    nXDst, nYDst, nSrcWidth, nSrcHeight, 2, vFlip); /* RedPlane */
+			if (planar_band_count(planar, nSrcWidth, nSrcHeight) > 1)
+			{
+				/* Decode the planes in parallel to separate buffers, writing them interleaved
+				 * to the same scanlines would make the threads share cache lines */
+				BYTE* rleBuffer[4] = WINPR_C_ARRAY_INIT;
 
-			if (status < 0)
-				return FALSE;
+				if (!planar->rlePlanesBuffer)
+					return FALSE;
 
-			status = planar_decompress_plane_rle(
-			    planes[1], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[1]), pTempData, nTempStep,
-			    nXDst, nYDst, nSrcWidth, nSrcHeight, 1, vFlip); /* GreenPlane */
+				rleBuffer[3] = planar->rlePlanesBuffer;  /* AlphaPlane */
+				rleBuffer[0] = rleBuffer[3] + planeSize; /* LumaOrRedPlane */
+				rleBuffer[1] = rleBuffer[0] + planeSize; /* OrangeChromaOrGreenPlane */
+				rleBuffer[2] = rleBuffer[1] + planeSize; /* GreenChromaOrBluePlane */
 
-			if (status < 0)
-				return FALSE;
+				if (!planar_decompress_planes_rle_only(planar, planes, rleSizes, rawWidths,
+				                                       rawHeights, rleBuffer,
+				                                       useAlpha ? 0x0F : 0x07))
+					return FALSE;
 
-			status = planar_decompress_plane_rle(
-			    planes[2], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[2]), pTempData, nTempStep,
-			    nXDst, nYDst, nSrcWidth, nSrcHeight, 0, vFlip); /* BluePlane */
+				/* The RLE planes are always stored as BGRA, see planar_decompress_plane_rle */
+				const BYTE* rlePlanes[4] = { rleBuffer[0], rleBuffer[1], rleBuffer[2],
+					                         useAlpha ? rleBuffer[3] : nullptr };
+				if (!planar_decompress_planes_raw_bands(
+				        planar, rlePlanes, pTempData,
+				        useAlpha ? PIXEL_FORMAT_BGRA32 : PIXEL_FORMAT_BGRX32, nTempStep, nXDst,
+				        nYDst, nSrcWidth, nSrcHeight, vFlip, nTotalHeight))
+					return FALSE;
 
-			if (status < 0)
-				return FALSE;
+				srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
+				if (alpha)
+					srcp += rleSizes[3];
+			}
+			else
+			{
+				status = planar_decompress_plane_rle(
+				    planes[0], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[0]), pTempData,
+				    nTempStep, nXDst, nYDst, nSrcWidth, nSrcHeight, 2, vFlip); /* RedPlane */
 
-			srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
+				if (status < 0)
+					return FALSE;
 
-			if (useAlpha)
-			{
 				status = planar_decompress_plane_rle(
-				    planes[3], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[3]), pTempData,
-				    nTempStep, nXDst, nYDst, nSrcWidth, nSrcHeight, 3, vFlip); /* AlphaPlane */
-			}
-			else
-				status = planar_set_plane(0xFF, pTempData, nTempStep, nXDst, nYDst, nSrcWidth,
-				                          nSrcHeight, 3, vFlip);
+				    planes[1], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[1]), pTempData,
+				    nTempStep, nXDst, nYDst, nSrcWidth, nSrcHeight, 1, vFlip); /* GreenPlane */
 
-			if (status < 0)
-				return FALSE;
+				if (status < 0)
+					return FALSE;
 
-			if (alpha)
-				srcp += rleSizes[3];
+				status = planar_decompress_plane_rle(
+				    planes[2], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[2]), pTempData,
+				    nTempStep, nXDst, nYDst, nSrcWidth, nSrcHeight, 0, vFlip); /* BluePlane */
+
+				if (status < 0)
+					return FALSE;
+
+				srcp += rleSizes[0] + rleSizes[1] + rleSizes[2];
+
+				if (useAlpha)
+				{
+					status = planar_decompress_plane_rle(
+					    planes[3], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[3]), pTempData,
+					    nTempStep, nXDst, nYDst, nSrcWidth, nSrcHeight, 3, vFlip); /* AlphaPlane */
+				}
+				else
+					status = planar_set_plane(0xFF, pTempData, nTempStep, nXDst, nYDst, nSrcWidth,
+					                          nSrcHeight, 3, vFlip);
+
+				if (status < 0)
+					return FALSE;
+
+				if (alpha)
+					srcp += rleSizes[3];
+			}
 		}
 
 		if (pTempData != pDstData)
@@ -1067,40 +1340,13 @@ BOOL freerdp_bitmap_decompress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT plan
 			rleBuffer[0] = rleBuffer[3] + planeSize; /* LumaOrRedPlane */
 			rleBuffer[1] = rleBuffer[0] + planeSize; /* OrangeChromaOrGreenPlane */
 			rleBuffer[2] = rleBuffer[1] + planeSize; /* GreenChromaOrBluePlane */
-			if (useAlpha)
-			{
-				status = planar_decompress_plane_rle_only(
-				    planes[3], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[3]), rleBuffer[3],
-				    rawWidths[3], rawHeights[3]); /* AlphaPlane */
-
-				if (status < 0)
-					return FALSE;
-			}
+			if (!planar_decompress_planes_rle_only(planar, planes, rleSizes, rawWidths,
+			                                       rawHeights, rleBuffer, useAlpha ? 0x0F : 0x07))
+				return FALSE;
 
 			if (alpha)
 				srcp += rleSizes[3];
 
-			status = planar_decompress_plane_rle_only(
-			    planes[0], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[0]), rleBuffer[0],
-			    rawWidths[0], rawHeights[0]); /* LumaPlane */
-
-			if (status < 0)
-				return FALSE;
-
-			status = planar_decompress_plane_rle_only(
-			    planes[1], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[1]), rleBuffer[1],
-			    rawWidths[1], rawHeights[1]); /* OrangeChromaPlane */
-
-			if (status < 0)
-				return FALSE;
-
-			status = planar_decompress_plane_rle_only(
-			    planes[2], WINPR_ASSERTING_INT_CAST(uint32_t, rleSizes[2]), rleBuffer[2],
-			    rawWidths[2], rawHeights[2]); /* GreenChromaPlane */
-
-			if (status < 0)
-				return FALSE;
-
 			planes[0] = rleBuffer[0];
 			planes[1] = rleBuffer[1];
 			planes[2] = rleBuffer[2];
@@ -1132,8 +1378,9 @@ BOOL freerdp_bitmap_decompress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT plan
 				rawHeights[2] = nSrcHeight;
 			}
 
-			if (!planar_decompress_planes_raw(planes, pTempData, TempFormat, nTempStep, nXDst,
-			                                  nYDst, nSrcWidth, nSrcHeight, vFlip, nTotalHeight))
+			if (!planar_decompress_planes_raw_bands(planar, planes, pTempData, TempFormat,
+			                                        nTempStep, nXDst, nYDst, nSrcWidth,
+			                                        nSrcHeight, vFlip, nTotalHeight))
 				return FALSE;
 
 			if (alpha)
@@ -1145,27 +1392,76 @@ BOOL freerdp_bitmap_decompress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT plan
 				srcp++; /* pad */
 		}
 
-		WINPR_ASSERT(prims->YCoCgToRGB_8u_AC4R);
-		int rc = prims->YCoCgToRGB_8u_AC4R(
-		    pTempData, WINPR_ASSERTING_INT_CAST(int32_t, nTempStep), dst, DstFormat,
-		    WINPR_ASSERTING_INT_CAST(int32_t, nDstStep), w, h, cll, useAlpha);
-		if (rc != PRIMITIVES_SUCCESS)
-		{
-			WLog_ERR(TAG, "YCoCgToRGB_8u_AC4R failed with %d", rc);
+		/* The planes were written at the destination offset of the temporary buffer */
+		const BYTE* src =
+		    &pTempData[nXDst * FreeRDPGetBytesPerPixel(TempFormat) + nYDst * nTempStep];
+		if (!planar_ycocg_to_rgb(planar, src, nTempStep, dst, DstFormat, nDstStep, w, h, cll,
+		                         useAlpha))
 			return FALSE;
-		}
 	}
 
 	WINPR_UNUSED(srcp);
 	return TRUE;
 }
 
+static inline BOOL planar_pixel_layout(UINT32 format, PLANAR_PIXEL_LAYOUT* WINPR_RESTRICT layout)
+{
+	WINPR_ASSERT(layout);
+
+	switch (format)
+	{
+		case PIXEL_FORMAT_ARGB32:
+		case PIXEL_FORMAT_XRGB32:
+			*layout = (PLANAR_PIXEL_LAYOUT){ { 0, 1, 2, 3 }, format == PIXEL_FORMAT_ARGB32 };
+			return TRUE;
+
+		case PIXEL_FORMAT_ABGR32:
+		case PIXEL_FORMAT_XBGR32:
+			*layout = (PLANAR_PIXEL_LAYOUT){ { 0, 3, 2, 1 }, format == PIXEL_FORMAT_ABGR32 };
+			return TRUE;
+
+		case PIXEL_FORMAT_RGBA32:
+		case PIXEL_FORMAT_RGBX32:
+			*layout = (PLANAR_PIXEL_LAYOUT){ { 3, 0, 1, 2 }, format == PIXEL_FORMAT_RGBA32 };
+			return TRUE;
+
+		case PIXEL_FORMAT_BGRA32:
+		case PIXEL_FORMAT_BGRX32:
+			*layout = (PLANAR_PIXEL_LAYOUT){ { 3, 2, 1, 0 }, format == PIXEL_FORMAT_BGRA32 };
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
+}
+
+static void planar_split_row_c(const BYTE* WINPR_RESTRICT src, UINT32 width,
+                               const PLANAR_PIXEL_LAYOUT* WINPR_RESTRICT layout,
+                               BYTE* WINPR_RESTRICT planes[4])
+{
+	WINPR_ASSERT(layout);
+
+	for (UINT32 x = 0; x < width; x++)
+	{
+		const BYTE* pixel = &src[4ULL * x];
+		planes[0][x] = layout->alpha ? pixel[layout->offset[0]] : 0xFF;
+		planes[1][x] = pixel[layout->offset[1]];
+		planes[2][x] = pixel[layout->offset[2]];
+		planes[3][x] = pixel[layout->offset[3]];
+	}
+}
+
+/* Splits the scanlines [first, last) of the plane images */
 static inline BOOL freerdp_split_color_planes(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
                                               const BYTE* WINPR_RESTRICT data, UINT32 format,
                                               UINT32 width, UINT32 height, UINT32 scanline,
+                                              UINT32 first, UINT32 last,
                                               BYTE* WINPR_RESTRICT planes[4])
 {
+	PLANAR_PIXEL_LAYOUT layout = WINPR_C_ARRAY_INIT;
+
 	WINPR_ASSERT(planar);
+	WINPR_ASSERT(planar->splitRow);
 
 	if ((width > INT32_MAX) || (height > INT32_MAX) || (scanline > INT32_MAX))
 		return FALSE;
@@ -1173,39 +1469,28 @@ static inline BOOL freerdp_split_color_planes(BITMAP_PLANAR_CONTEXT* WINPR_RESTR
 	if (scanline == 0)
 		scanline = width * FreeRDPGetBytesPerPixel(format);
 
-	if (planar->topdown)
-	{
-		UINT32 k = 0;
-		for (UINT32 i = 0; i < height; i++)
-		{
-			const BYTE* pixel = &data[1ULL * scanline * i];
+	const BOOL fast = planar_pixel_layout(format, &layout);
 
-			for (UINT32 j = 0; j < width; j++)
-			{
-				const UINT32 color = FreeRDPReadColor(pixel, format);
-				pixel += FreeRDPGetBytesPerPixel(format);
-				FreeRDPSplitColor(color, format, &planes[1][k], &planes[2][k], &planes[3][k],
-				                  &planes[0][k], nullptr);
-				k++;
-			}
-		}
-	}
-	else
+	for (UINT32 y = first; y < last; y++)
 	{
-		UINT32 k = 0;
+		const UINT32 line = planar->topdown ? y : height - 1 - y;
+		const BYTE* pixel = &data[1ULL * scanline * line];
+		size_t k = 1ULL * y * width;
 
-		for (INT64 i = (INT64)height - 1; i >= 0; i--)
+		if (fast)
 		{
-			const BYTE* pixel = &data[1ULL * scanline * (UINT32)i];
+			BYTE* rows[4] = { &planes[0][k], &planes[1][k], &planes[2][k], &planes[3][k] };
+			planar->splitRow(pixel, width, &layout, rows);
+			continue;
+		}
 
-			for (UINT32 j = 0; j < width; j++)
-			{
-				const UINT32 color = FreeRDPReadColor(pixel, format);
-				pixel += FreeRDPGetBytesPerPixel(format);
-				FreeRDPSplitColor(color, format, &planes[1][k], &planes[2][k], &planes[3][k],
-				                  &planes[0][k], nullptr);
-				k++;
-			}
+		for (UINT32 j = 0; j < width; j++)
+		{
+			const UINT32 color = FreeRDPReadColor(pixel, format);
+			pixel += FreeRDPGetBytesPerPixel(format);
+			FreeRDPSplitColor(color, format, &planes[1][k], &planes[2][k], &planes[3][k],
+			                  &planes[0][k], nullptr);
+			k++;
 		}
 	}
 	return TRUE;
@@ -1435,103 +1720,178 @@ BOOL freerdp_bitmap_planar_compress_plane_rle(const BYTE* WINPR_RESTRICT inPlane
 	return TRUE;
 }
 
-static inline BOOL freerdp_bitmap_planar_compress_planes_rle(BYTE* WINPR_RESTRICT inPlanes[4],
-                                                             UINT32 width, UINT32 height,
-                                                             BYTE* WINPR_RESTRICT outPlanes,
-                                                             UINT32* WINPR_RESTRICT dstSizes,
-                                                             BOOL skipAlpha)
+static void planar_delta_row_c(const BYTE* WINPR_RESTRICT row, const BYTE* WINPR_RESTRICT prevRow,
+                               UINT32 width, BYTE* WINPR_RESTRICT dst)
 {
-	UINT32 outPlanesSize = width * height * 4;
-
-	/* AlphaPlane */
-	if (skipAlpha)
+	for (UINT32 x = 0; x < width; x++)
 	{
-		dstSizes[0] = 0;
+		const int delta = (int)row[x] - (int)prevRow[x];
+		const int s2c1i = (delta >= 0) ? delta : (INT_MAX + delta) + 1;
+		const int8_t s2c1 = WINPR_CXX_COMPAT_CAST(int8_t, s2c1i);
+		const uint32_t s2c =
+		    (s2c1 >= 0) ? ((UINT32)s2c1 << 1) : (((UINT32)(~(s2c1) + 1) << 1) - 1);
+		dst[x] = (BYTE)s2c;
 	}
-	else
-	{
-		dstSizes[0] = outPlanesSize;
+}
 
-		if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[0], width, height, outPlanes,
-		                                              &dstSizes[0]))
-			return FALSE;
+typedef struct
+{
+	BITMAP_PLANAR_CONTEXT* planar;
+	const BYTE* data;
+	UINT32 format;
+	UINT32 width;
+	UINT32 height;
+	UINT32 scanline;
+	UINT32 first;
+	UINT32 last;
+	BOOL rc;
+} PLANAR_SPLIT_WORK_PARAM;
 
-		outPlanes += dstSizes[0];
-		outPlanesSize -= dstSizes[0];
-	}
+typedef struct
+{
+	BITMAP_PLANAR_CONTEXT* planar;
+	UINT32 plane;
+	UINT32 width;
+	UINT32 first;
+	UINT32 last;
+	BYTE* dst;
+	UINT32 dstSize;
+	BOOL rc;
+} PLANAR_ENCODE_WORK_PARAM;
+
+static void CALLBACK planar_split_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance,
+                                                void* context, WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	PLANAR_SPLIT_WORK_PARAM* param = context;
+	WINPR_ASSERT(param);
 
-	/* LumaOrRedPlane */
-	dstSizes[1] = outPlanesSize;
+	param->rc = freerdp_split_color_planes(param->planar, param->data, param->format,
+	                                       param->width, param->height, param->scanline,
+	                                       param->first, param->last, param->planar->planes);
+}
 
-	if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[1], width, height, outPlanes,
-	                                              &dstSizes[1]))
-		return FALSE;
+/* Delta and RLE encodes the scanlines [first, last) of a plane */
+static void CALLBACK planar_encode_work_callback(WINPR_ATTR_UNUSED PTP_CALLBACK_INSTANCE instance,
+                                                 void* context, WINPR_ATTR_UNUSED PTP_WORK work)
+{
+	PLANAR_ENCODE_WORK_PARAM* param = context;
+	WINPR_ASSERT(param);
 
-	outPlanes += dstSizes[1];
-	outPlanesSize -= dstSizes[1];
-	/* OrangeChromaOrGreenPlane */
-	dstSizes[2] = outPlanesSize;
+	BITMAP_PLANAR_CONTEXT* planar = param->planar;
+	WINPR_ASSERT(planar);
+	WINPR_ASSERT(planar->deltaRow);
 
-	if (!freerdp_bitmap_planar_compress_plane_rle(inPlanes[2], width, height, outPlanes,
-	                                              &dstSizes[2]))
-		return FALSE;
+	const UINT32 width = param->width;
+	const BYTE* inPlane = planar->planes[param->plane];
+	BYTE* deltaPlane = planar->deltaPlanes[param->plane];
 
-	outPlanes += dstSizes[2];
-	outPlanesSize -= dstSizes[2];
-	/* GreenChromeOrBluePlane */
-	dstSizes[3] = outPlanesSize;
+	for (UINT32 y = param->first; y < param->last; y++)
+	{
+		const size_t off = 1ull * width * y;
 
-	return (freerdp_bitmap_planar_compress_plane_rle(inPlanes[3], width, height, outPlanes,
-	                                                 &dstSizes[3]));
+		// first line is copied as is
+		if (y == 0)
+			CopyMemory(deltaPlane, inPlane, width);
+		else
+			planar->deltaRow(&inPlane[off], &inPlane[off - width], width, &deltaPlane[off]);
+	}
+
+	param->rc = freerdp_bitmap_planar_compress_plane_rle(&deltaPlane[1ull * width * param->first],
+	                                                     width, param->last - param->first,
+	                                                     param->dst, &param->dstSize);
 }
 
-BYTE* freerdp_bitmap_planar_delta_encode_plane(const BYTE* WINPR_RESTRICT inPlane, UINT32 width,
-                                               UINT32 height, BYTE* WINPR_RESTRICT outPlane)
+static inline BOOL freerdp_split_color_planes_bands(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
+                                                    const BYTE* WINPR_RESTRICT data,
+                                                    UINT32 format, UINT32 width, UINT32 height,
+                                                    UINT32 scanline, UINT32 bands)
 {
-	if (!outPlane)
+	PLANAR_SPLIT_WORK_PARAM params[PLANAR_MAX_BANDS] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(bands <= ARRAYSIZE(params));
+
+	for (UINT32 x = 0; x < bands; x++)
 	{
-		if (width * height == 0)
-			return nullptr;
+		PLANAR_SPLIT_WORK_PARAM* param = &params[x];
+		param->planar = planar;
+		param->data = data;
+		param->format = format;
+		param->width = width;
+		param->height = height;
+		param->scanline = scanline;
+		param->first = planar_band_start(height, bands, x);
+		param->last = planar_band_start(height, bands, x + 1);
+	}
 
-		outPlane = (BYTE*)calloc(height, width);
-		if (!outPlane)
-			return nullptr;
+	planar_run_work(planar, planar_split_work_callback, params, sizeof(params[0]), bands);
+
+	for (UINT32 x = 0; x < bands; x++)
+	{
+		if (!params[x].rc)
+			return FALSE;
 	}
+	return TRUE;
+}
+
+/**
+ * Encodes every band of a plane into its own area of the plane slot in rlePlanesBuffer,
+ * the bands are concatenated afterwards. Since scanlines are RLE encoded independently the
+ * result is the same as encoding the plane as a whole.
+ */
+static inline BOOL
+freerdp_bitmap_planar_compress_planes_rle(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT planar,
+                                          UINT32 width, UINT32 height, UINT32 bands,
+                                          UINT32* WINPR_RESTRICT dstSizes)
+{
+	PLANAR_ENCODE_WORK_PARAM params[4 * PLANAR_MAX_BANDS] = WINPR_C_ARRAY_INIT;
+	const size_t rowSize = planar_rle_row_size(width);
+	const UINT32 firstPlane = planar->AllowSkipAlpha ? 1 : 0;
+	size_t count = 0;
 
-	// first line is copied as is
-	CopyMemory(outPlane, inPlane, width);
+	WINPR_ASSERT(bands <= PLANAR_MAX_BANDS);
+	WINPR_ASSERT(rowSize * height <= planar->rlePlaneSize);
 
-	for (UINT32 y = 1; y < height; y++)
+	for (UINT32 x = firstPlane; x < 4; x++)
 	{
-		const size_t off = 1ull * width * y;
-		BYTE* outPtr = &outPlane[off];
-		const BYTE* srcPtr = &inPlane[off];
-		const BYTE* prevLinePtr = &inPlane[off - width];
-		for (UINT32 x = 0; x < width; x++)
+		BYTE* slot = &planar->rlePlanesBuffer[x * planar->rlePlaneSize];
+
+		for (UINT32 y = 0; y < bands; y++)
 		{
-			const int delta = (int)srcPtr[x] - (int)prevLinePtr[x];
-			const int s2c1i = (delta >= 0) ? delta : (INT_MAX + delta) + 1;
-			const int8_t s2c1 = WINPR_CXX_COMPAT_CAST(int8_t, s2c1i);
-			const uint32_t s2c =
-			    (s2c1 >= 0) ? ((UINT32)s2c1 << 1) : (((UINT32)(~(s2c1) + 1) << 1) - 1);
-			outPtr[x] = (BYTE)s2c;
+			PLANAR_ENCODE_WORK_PARAM* param = &params[count++];
+			param->planar = planar;
+			param->plane = x;
+			param->width = width;
+			param->first = planar_band_start(height, bands, y);
+			param->last = planar_band_start(height, bands, y + 1);
+			param->dst = &slot[rowSize * param->first];
+			param->dstSize =
+			    WINPR_ASSERTING_INT_CAST(UINT32, rowSize * (param->last - param->first));
 		}
 	}
 
-	return outPlane;
-}
+	planar_run_work(planar, planar_encode_work_callback, params, sizeof(params[0]), count);
 
-static inline BOOL freerdp_bitmap_planar_delta_encode_planes(BYTE* WINPR_RESTRICT inPlanes[4],
-                                                             UINT32 width, UINT32 height,
-                                                             BYTE* WINPR_RESTRICT outPlanes[4])
-{
-	for (UINT32 i = 0; i < 4; i++)
+	/* AlphaPlane */
+	dstSizes[0] = 0;
+	planar->rlePlanes[0] = planar->rlePlanesBuffer;
+
+	const PLANAR_ENCODE_WORK_PARAM* param = params;
+	for (UINT32 x = firstPlane; x < 4; x++)
 	{
-		outPlanes[i] =
-		    freerdp_bitmap_planar_delta_encode_plane(inPlanes[i], width, height, outPlanes[i]);
+		BYTE* slot = &planar->rlePlanesBuffer[x * planar->rlePlaneSize];
+		size_t offset = 0;
 
-		if (!outPlanes[i])
-			return FALSE;
+		for (UINT32 y = 0; y < bands; y++, param++)
+		{
+			if (!param->rc)
+				return FALSE;
+
+			MoveMemory(&slot[offset], param->dst, param->dstSize);
+			offset += param->dstSize;
+		}
+
+		planar->rlePlanes[x] = slot;
+		dstSizes[x] = WINPR_ASSERTING_INT_CAST(UINT32, offset);
 	}
 
 	return TRUE;
@@ -1558,39 +1918,35 @@ BYTE* freerdp_bitmap_compress_planar(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT conte
 	if (!context->AllowSkipAlpha)
 		format = planar_invert_format(context, TRUE, format);
 
-	if (!freerdp_split_color_planes(context, data, format, width, height, scanline,
-	                                context->planes))
+	if ((width > context->maxWidth) || (height > context->maxHeight))
+	{
+		WLog_ERR(TAG, "planar image %" PRIu32 "x%" PRIu32 " exceeds context size %" PRIu32
+		              "x%" PRIu32,
+		         width, height, context->maxWidth, context->maxHeight);
+		return nullptr;
+	}
+
+	const UINT32 bands = planar_band_count(context, width, height);
+
+	if (!freerdp_split_color_planes_bands(context, data, format, width, height, scanline, bands))
 		return nullptr;
 
 	if (context->AllowRunLengthEncoding)
 	{
-		if (!freerdp_bitmap_planar_delta_encode_planes(context->planes, width, height,
-		                                               context->deltaPlanes))
-			return nullptr;
-
-		if (!freerdp_bitmap_planar_compress_planes_rle(context->deltaPlanes, width, height,
-		                                               context->rlePlanesBuffer, dstSizes,
-		                                               context->AllowSkipAlpha))
+		if (!freerdp_bitmap_planar_compress_planes_rle(context, width, height, bands, dstSizes))
 			return nullptr;
 
-		{
-			uint32_t offset = 0;
+		/* Noise does not compress, send the raw planes if RLE exceeds their size */
+		const UINT64 rleSize = 1ull * dstSizes[0] + dstSizes[1] + dstSizes[2] + dstSizes[3];
+		if (rleSize <= 4ull * planeSize)
 			FormatHeader |= PLANAR_FORMAT_HEADER_RLE;
-			context->rlePlanes[0] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[0];
-			context->rlePlanes[1] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[1];
-			context->rlePlanes[2] = &context->rlePlanesBuffer[offset];
-			offset += dstSizes[2];
-			context->rlePlanes[3] = &context->rlePlanesBuffer[offset];
 
 #if defined(WITH_DEBUG_CODECS)
-			WLog_DBG(TAG,
-			         "R: [%" PRIu32 "/%" PRIu32 "] G: [%" PRIu32 "/%" PRIu32 "] B: [%" PRIu32
-			         " / %" PRIu32 "] ",
-			         dstSizes[1], planeSize, dstSizes[2], planeSize, dstSizes[3], planeSize);
+		WLog_DBG(TAG,
+		         "R: [%" PRIu32 "/%" PRIu32 "] G: [%" PRIu32 "/%" PRIu32 "] B: [%" PRIu32
+		         " / %" PRIu32 "] ",
+		         dstSizes[1], planeSize, dstSizes[2], planeSize, dstSizes[3], planeSize);
 #endif
-		}
 	}
 
 	if (FormatHeader & PLANAR_FORMAT_HEADER_RLE)
@@ -1758,7 +2114,9 @@ BOOL freerdp_bitmap_planar_context_reset(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT c
 			return FALSE;
 		context->deltaPlanesBuffer = tmp;
 
-		tmp = winpr_aligned_recalloc(context->rlePlanesBuffer, context->maxPlaneSize, 4, 32);
+		/* Large enough for the worst case RLE encoding of each plane */
+		context->rlePlaneSize = planar_rle_row_size(context->maxWidth) * context->maxHeight;
+		tmp = winpr_aligned_recalloc(context->rlePlanesBuffer, context->rlePlaneSize, 4, 32);
 		if (!tmp)
 			return FALSE;
 		context->rlePlanesBuffer = tmp;
@@ -1777,6 +2135,12 @@ BOOL freerdp_bitmap_planar_context_reset(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT c
 
 BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, UINT32 maxWidth,
                                                          UINT32 maxHeight)
+{
+	return freerdp_bitmap_planar_context_new_ex(flags, maxWidth, maxHeight, 0);
+}
+
+BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new_ex(DWORD flags, UINT32 maxWidth,
+                                                            UINT32 maxHeight, UINT32 ThreadingFlags)
 {
 	BITMAP_PLANAR_CONTEXT* context =
 	    (BITMAP_PLANAR_CONTEXT*)winpr_aligned_calloc(1, sizeof(BITMAP_PLANAR_CONTEXT), 32);
@@ -1784,6 +2148,25 @@ BITMAP_PLANAR_CONTEXT* freerdp_bitmap_planar_context_new(DWORD flags, UINT32 max
 	if (!context)
 		return nullptr;
 
+	if (!(ThreadingFlags & THREADING_FLAGS_DISABLE_THREADS))
+	{
+		SYSTEM_INFO sysInfos = WINPR_C_ARRAY_INIT;
+		GetNativeSystemInfo(&sysInfos);
+		context->useThreads = (sysInfos.dwNumberOfProcessors > 1);
+		context->maxBands = MIN(sysInfos.dwNumberOfProcessors, PLANAR_MAX_BANDS);
+	}
+
+	/* Initialize the primitives before any work is run on the thread pool */
+	if (context->useThreads && !primitives_get())
+	{
+		winpr_aligned_free(context);
+		return nullptr;
+	}
+
+	context->splitRow = planar_split_row_c;
+	context->deltaRow = planar_delta_row_c;
+	planar_init_sse2(context);
+
 	if (flags & PLANAR_FORMAT_HEADER_NA)
 		context->AllowSkipAlpha = TRUE;
 
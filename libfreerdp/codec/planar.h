@@ -0,0 +1,78 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP6 Planar Codec
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INTERNAL_CODEC_PLANAR_H
+#define INTERNAL_CODEC_PLANAR_H
+
+#include <winpr/wtypes.h>
+
+#include <freerdp/codec/planar.h>
+
+/** @brief Byte offsets of the A, R, G and B components in a 32bpp pixel */
+typedef struct
+{
+	BYTE offset[4];
+	BOOL alpha; /**< FALSE if the alpha plane is filled with 0xFF */
+} PLANAR_PIXEL_LAYOUT;
+
+/** @brief Splits a row of 32bpp pixels into the A, R, G and B planes */
+typedef void (*planar_split_row_fn)(const BYTE* WINPR_RESTRICT src, UINT32 width,
+                                    const PLANAR_PIXEL_LAYOUT* WINPR_RESTRICT layout,
+                                    BYTE* WINPR_RESTRICT planes[4]);
+
+/** @brief Writes the sign magnitude encoded difference of two plane rows */
+typedef void (*planar_delta_row_fn)(const BYTE* WINPR_RESTRICT row,
+                                    const BYTE* WINPR_RESTRICT prevRow, UINT32 width,
+                                    BYTE* WINPR_RESTRICT dst);
+
+struct S_BITMAP_PLANAR_CONTEXT
+{
+	UINT32 maxWidth;
+	UINT32 maxHeight;
+	UINT32 maxPlaneSize;
+
+	BOOL AllowSkipAlpha;
+	BOOL AllowRunLengthEncoding;
+	BOOL AllowColorSubsampling;
+	BOOL AllowDynamicColorFidelity;
+
+	UINT32 ColorLossLevel;
+
+	BYTE* planes[4];
+	BYTE* planesBuffer;
+
+	BYTE* deltaPlanes[4];
+	BYTE* deltaPlanesBuffer;
+
+	BYTE* rlePlanes[4];
+	BYTE* rlePlanesBuffer;
+	size_t rlePlaneSize;
+
+	BYTE* pTempData;
+	UINT32 nTempStep;
+
+	BOOL bgr;
+	BOOL topdown;
+
+	BOOL useThreads;
+	UINT32 maxBands;
+
+	planar_split_row_fn splitRow;
+	planar_delta_row_fn deltaRow;
+};
+
+#endif /* INTERNAL_CODEC_PLANAR_H */
@@ -21,6 +21,8 @@
 
 #include <freerdp/config.h>
 
+#include <stddef.h>
+
 #include <winpr/assert.h>
 #include <winpr/cast.h>
 #include <winpr/crt.h>
@@ -39,6 +41,7 @@
 #include "rfx_rlgr.h"
 #include "rfx_constants.h"
 #include "rfx_types.h"
+#include "rfx_encode.h"
 #include "progressive.h"
 
 #define TAG FREERDP_TAG("codec.progressive")
@@ -806,6 +809,75 @@ void rfx_dwt_2d_extrapolate_decode(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RE
 	progressive_rfx_dwt_2d_decode_block(&buffer[0], dwt_buffer, 1);
 }
 
+/* Exact inverse of progressive_rfx_idwt_x / progressive_rfx_idwt_y for a single line */
+static inline void progressive_rfx_dwt_1d(const INT16* WINPR_RESTRICT pSrc, size_t nSrcStep,
+                                          INT16* WINPR_RESTRICT pLowBand, size_t nLowStep,
+                                          INT16* WINPR_RESTRICT pHighBand, size_t nHighStep,
+                                          size_t nLowCount, size_t nHighCount)
+{
+#define X(i) ((int32_t)pSrc[(i) * nSrcStep])
+#define L(i) pLowBand[(i) * nLowStep]
+#define H(i) pHighBand[(i) * nHighStep]
+	for (size_t k = 0; k < nHighCount; k++)
+	{
+		const int32_t d = X(2 * k + 1) - ((X(2 * k) + X(2 * k + 2)) / 2);
+		H(k) = clampi16(d >> 1);
+	}
+
+	L(0) = clampi16(X(0) + H(0));
+
+	for (size_t k = 1; k < nHighCount; k++)
+		L(k) = clampi16(X(2 * k) + ((H(k - 1) + H(k)) / 2));
+
+	if (nLowCount == nHighCount + 1)
+		L(nHighCount) = clampi16(X(2 * nHighCount) + H(nHighCount - 1));
+	else
+	{
+		L(nHighCount) = clampi16(X(2 * nHighCount) + (H(nHighCount - 1) / 2));
+		L(nHighCount + 1) = clampi16((2 * X(2 * nHighCount + 1)) - X(2 * nHighCount));
+	}
+#undef X
+#undef L
+#undef H
+}
+
+static inline void progressive_rfx_dwt_2d_encode_block(INT16* WINPR_RESTRICT buffer,
+                                                       INT16* WINPR_RESTRICT temp, size_t level)
+{
+	const size_t nBandL = progressive_rfx_get_band_l_count(level);
+	const size_t nBandH = progressive_rfx_get_band_h_count(level);
+	const size_t nStep = nBandL + nBandH;
+	INT16* HL = &buffer[0];
+	INT16* LH = &HL[nBandL * nBandH];
+	INT16* HH = &LH[nBandH * nBandL];
+	INT16* LL = &HH[nBandH * nBandH];
+	INT16* L = &temp[0];
+	INT16* H = &temp[nBandL * nStep];
+
+	/* vertical (LL -> L + H) */
+	for (size_t x = 0; x < nStep; x++)
+		progressive_rfx_dwt_1d(&buffer[x], nStep, &L[x], nStep, &H[x], nStep, nBandL, nBandH);
+
+	/* horizontal (L -> LL + HL) */
+	for (size_t y = 0; y < nBandL; y++)
+		progressive_rfx_dwt_1d(&L[y * nStep], 1, &LL[y * nBandL], 1, &HL[y * nBandH], 1, nBandL,
+		                       nBandH);
+
+	/* horizontal (H -> LH + HH) */
+	for (size_t y = 0; y < nBandH; y++)
+		progressive_rfx_dwt_1d(&H[y * nStep], 1, &LH[y * nBandL], 1, &HH[y * nBandH], 1, nBandL,
+		                       nBandH);
+}
+
+void rfx_dwt_2d_extrapolate_encode(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt_buffer)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(dwt_buffer);
+	progressive_rfx_dwt_2d_encode_block(&buffer[0], dwt_buffer, 1);
+	progressive_rfx_dwt_2d_encode_block(&buffer[3007], dwt_buffer, 2);
+	progressive_rfx_dwt_2d_encode_block(&buffer[3807], dwt_buffer, 3);
+}
+
 static inline int progressive_rfx_dwt_2d_decode(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
                                                 INT16* WINPR_RESTRICT buffer,
                                                 INT16* WINPR_RESTRICT current, BOOL coeffDiff,
@@ -2486,6 +2558,799 @@ fail:
 	return rc;
 }
 
+#define PROGRESSIVE_ENCODER_MAX_PASSES 4
+#define PROGRESSIVE_ENCODER_RLGR_SIZE 8192
+#define PROGRESSIVE_ENCODER_SRL_SIZE 16384
+#define PROGRESSIVE_ENCODER_RAW_SIZE 8192
+
+typedef struct
+{
+	size_t offset;
+	size_t length;
+	size_t quant; /* position of the band in RFX_COMPONENT_CODEC_QUANT */
+} PROGRESSIVE_BAND;
+
+/* Bands of the reduce extrapolate layout in bitstream order, LL3 last */
+static const PROGRESSIVE_BAND progressive_bands[] = {
+	{ 0, 1023, offsetof(RFX_COMPONENT_CODEC_QUANT, HL1) },
+	{ 1023, 1023, offsetof(RFX_COMPONENT_CODEC_QUANT, LH1) },
+	{ 2046, 961, offsetof(RFX_COMPONENT_CODEC_QUANT, HH1) },
+	{ 3007, 272, offsetof(RFX_COMPONENT_CODEC_QUANT, HL2) },
+	{ 3279, 272, offsetof(RFX_COMPONENT_CODEC_QUANT, LH2) },
+	{ 3551, 256, offsetof(RFX_COMPONENT_CODEC_QUANT, HH2) },
+	{ 3807, 72, offsetof(RFX_COMPONENT_CODEC_QUANT, HL3) },
+	{ 3879, 72, offsetof(RFX_COMPONENT_CODEC_QUANT, LH3) },
+	{ 3951, 64, offsetof(RFX_COMPONENT_CODEC_QUANT, HH3) },
+	{ 4015, 81, offsetof(RFX_COMPONENT_CODEC_QUANT, LL3) },
+};
+
+/* Same values as the RemoteFX encoder default quantization */
+static const RFX_COMPONENT_CODEC_QUANT progressive_encoder_quant = {
+	.LL3 = 6, .HL3 = 6, .LH3 = 6, .HH3 = 6, .HL2 = 7,
+	.LH2 = 7, .HH2 = 8, .HL1 = 8, .LH1 = 8, .HH1 = 9,
+};
+
+/**
+ * Additional quantization of the coarse passes, indexed by the number of passes.
+ * The final pass always uses progressive->quantProgValFull. Consecutive entries
+ * differ by at most 4 bits which bounds the size of the upgrade bitstreams.
+ */
+static const BYTE progressive_encoder_prog_quant[PROGRESSIVE_ENCODER_MAX_PASSES]
+                                                [PROGRESSIVE_ENCODER_MAX_PASSES - 1] = {
+	                                                { 0, 0, 0 },
+	                                                { 4, 0, 0 },
+	                                                { 6, 3, 0 },
+	                                                { 6, 4, 2 },
+                                                };
+
+static inline BYTE progressive_band_quant(const RFX_COMPONENT_CODEC_QUANT* WINPR_RESTRICT quant,
+                                          const PROGRESSIVE_BAND* WINPR_RESTRICT band)
+{
+	const BYTE* bytes = (const BYTE*)quant;
+	return bytes[band->quant];
+}
+
+static inline BOOL progressive_band_is_ll(const PROGRESSIVE_BAND* WINPR_RESTRICT band)
+{
+	return band->quant == offsetof(RFX_COMPONENT_CODEC_QUANT, LL3);
+}
+
+static inline BYTE progressive_encoder_quality(const PROGRESSIVE_ENCODER* WINPR_RESTRICT encoder,
+                                               UINT32 pass)
+{
+	WINPR_ASSERT(pass > 0);
+	if (pass >= encoder->numPasses)
+		return 0xFF;
+	return (BYTE)(pass - 1);
+}
+
+static inline void progressive_encoder_prog_quant_get(const PROGRESSIVE_ENCODER* WINPR_RESTRICT
+                                                          encoder,
+                                                      BYTE quality,
+                                                      RFX_COMPONENT_CODEC_QUANT* WINPR_RESTRICT
+                                                          quant)
+{
+	BYTE value = 0;
+
+	if (quality != 0xFF)
+		value = progressive_encoder_prog_quant[encoder->numPasses - 1][quality];
+
+	/* LL3 carries most of the energy, refine it earlier than the high bands */
+	quant->LL3 = value / 2;
+	quant->HL3 = value;
+	quant->LH3 = value;
+	quant->HH3 = value;
+	quant->HL2 = value;
+	quant->LH2 = value;
+	quant->HH2 = value;
+	quant->HL1 = value;
+	quant->LH1 = value;
+	quant->HH1 = value;
+}
+
+static inline void
+progressive_component_codec_quant_write(wStream* WINPR_RESTRICT s,
+                                        const RFX_COMPONENT_CODEC_QUANT* WINPR_RESTRICT quantVal)
+{
+	Stream_Write_UINT8(s, (UINT8)(quantVal->LL3 | (quantVal->HL3 << 4)));
+	Stream_Write_UINT8(s, (UINT8)(quantVal->LH3 | (quantVal->HH3 << 4)));
+	Stream_Write_UINT8(s, (UINT8)(quantVal->HL2 | (quantVal->LH2 << 4)));
+	Stream_Write_UINT8(s, (UINT8)(quantVal->HH2 | (quantVal->HL1 << 4)));
+	Stream_Write_UINT8(s, (UINT8)(quantVal->LH1 | (quantVal->HH1 << 4)));
+}
+
+static void progressive_encoder_free_tiles(PROGRESSIVE_ENCODER* WINPR_RESTRICT encoder)
+{
+	WINPR_ASSERT(encoder);
+
+	if (encoder->tiles)
+	{
+		const size_t count = 1ull * encoder->gridWidth * encoder->gridHeight;
+		for (size_t x = 0; x < count; x++)
+			winpr_aligned_free(encoder->tiles[x].coeffs);
+	}
+
+	free(encoder->tiles);
+	encoder->tiles = nullptr;
+	encoder->width = 0;
+	encoder->height = 0;
+	encoder->gridWidth = 0;
+	encoder->gridHeight = 0;
+}
+
+static void progressive_encoder_uninit(PROGRESSIVE_ENCODER* WINPR_RESTRICT encoder)
+{
+	WINPR_ASSERT(encoder);
+
+	progressive_encoder_free_tiles(encoder);
+	Stream_Free(encoder->tileData, TRUE);
+	encoder->tileData = nullptr;
+	for (size_t x = 0; x < ARRAYSIZE(encoder->srlData); x++)
+	{
+		winpr_aligned_free(encoder->srlData[x]);
+		winpr_aligned_free(encoder->rawData[x]);
+		encoder->srlData[x] = nullptr;
+		encoder->rawData[x] = nullptr;
+	}
+	winpr_aligned_free(encoder->srlValues);
+	winpr_aligned_free(encoder->srlBits);
+	encoder->srlValues = nullptr;
+	encoder->srlBits = nullptr;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL progressive_encoder_init(PROGRESSIVE_ENCODER* WINPR_RESTRICT encoder)
+{
+	WINPR_ASSERT(encoder);
+
+	if (encoder->tileData)
+		return TRUE;
+
+	encoder->tileData = Stream_New(nullptr, 0x10000);
+	if (!encoder->tileData)
+		goto fail;
+
+	for (size_t x = 0; x < ARRAYSIZE(encoder->srlData); x++)
+	{
+		encoder->srlData[x] = winpr_aligned_malloc(PROGRESSIVE_ENCODER_SRL_SIZE, 16);
+		encoder->rawData[x] = winpr_aligned_malloc(PROGRESSIVE_ENCODER_RAW_SIZE, 16);
+		if (!encoder->srlData[x] || !encoder->rawData[x])
+			goto fail;
+	}
+
+	encoder->srlValues = winpr_aligned_calloc(4096, sizeof(INT16), 16);
+	encoder->srlBits = winpr_aligned_calloc(4096, sizeof(BYTE), 16);
+	if (!encoder->srlValues || !encoder->srlBits)
+		goto fail;
+
+	return TRUE;
+fail:
+	progressive_encoder_uninit(encoder);
+	return FALSE;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL progressive_encoder_resize(PROGRESSIVE_ENCODER* WINPR_RESTRICT encoder, UINT32 width,
+                                       UINT32 height)
+{
+	WINPR_ASSERT(encoder);
+
+	if (encoder->tiles && (encoder->width == width) && (encoder->height == height))
+		return TRUE;
+
+	progressive_encoder_free_tiles(encoder);
+
+	const UINT32 gridWidth = (width + 63) / 64;
+	const UINT32 gridHeight = (height + 63) / 64;
+	encoder->tiles = calloc(1ull * gridWidth * gridHeight, sizeof(PROGRESSIVE_ENCODER_TILE));
+	if (!encoder->tiles)
+		return FALSE;
+
+	encoder->width = width;
+	encoder->height = height;
+	encoder->gridWidth = gridWidth;
+	encoder->gridHeight = gridHeight;
+
+	for (UINT32 yIdx = 0; yIdx < gridHeight; yIdx++)
+	{
+		for (UINT32 xIdx = 0; xIdx < gridWidth; xIdx++)
+		{
+			PROGRESSIVE_ENCODER_TILE* tile = &encoder->tiles[yIdx * gridWidth + xIdx];
+			tile->xIdx = WINPR_ASSERTING_INT_CAST(UINT16, xIdx);
+			tile->yIdx = WINPR_ASSERTING_INT_CAST(UINT16, yIdx);
+			tile->rect.x = WINPR_ASSERTING_INT_CAST(UINT16, xIdx * 64);
+			tile->rect.y = WINPR_ASSERTING_INT_CAST(UINT16, yIdx * 64);
+			tile->rect.width = WINPR_ASSERTING_INT_CAST(UINT16, MIN(64, width - xIdx * 64));
+			tile->rect.height = WINPR_ASSERTING_INT_CAST(UINT16, MIN(64, height - yIdx * 64));
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * The decoder reconstructs truncated coefficients, both for the first pass and the
+ * bit plane upgrades. Offset the coefficients by half of the final quantization step
+ * so the full quality pass is rounded to nearest instead.
+ */
+static void progressive_encoder_bias(INT16* WINPR_RESTRICT coeffs)
+{
+	for (size_t i = 0; i < ARRAYSIZE(progressive_bands); i++)
+	{
+		const PROGRESSIVE_BAND* band = &progressive_bands[i];
+		const int half = 1 << (progressive_band_quant(&progressive_encoder_quant, band) - 2);
+		INT16* dst = &coeffs[band->offset];
+
+		if (progressive_band_is_ll(band))
+		{
+			for (size_t x = 0; x < band->length; x++)
+				dst[x] = clampi16(dst[x] + half);
+		}
+		else
+		{
+			for (size_t x = 0; x < band->length; x++)
+			{
+				if (dst[x] > 0)
+					dst[x] = clampi16(dst[x] + half);
+				else if (dst[x] < 0)
+					dst[x] = clampi16(dst[x] - half);
+			}
+		}
+	}
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL progressive_encoder_tile_transform(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                               PROGRESSIVE_ENCODER_TILE* WINPR_RESTRICT tile,
+                                               const BYTE* WINPR_RESTRICT pSrcData,
+                                               UINT32 SrcFormat, UINT32 ScanLine)
+{
+	BOOL rc = FALSE;
+	INT16* pSrcDst[3] = WINPR_C_ARRAY_INIT;
+	RFX_CONTEXT* rfx = progressive->rfx_context;
+	const size_t bpp = FreeRDPGetBytesPerPixel(SrcFormat);
+	const BYTE* src = &pSrcData[1ull * tile->rect.y * ScanLine + 1ull * tile->rect.x * bpp];
+
+	if (!tile->coeffs)
+	{
+		tile->coeffs = winpr_aligned_calloc(3ull * 4096ull, sizeof(INT16), 32);
+		if (!tile->coeffs)
+			return FALSE;
+	}
+
+	BYTE* pBuffer = (BYTE*)BufferPool_Take(progressive->bufferPool, -1);
+	INT16* temp = (INT16*)BufferPool_Take(progressive->bufferPool, -1); /* DWT buffer */
+	if (!pBuffer || !temp)
+		goto fail;
+
+	pSrcDst[0] = (INT16*)((&pBuffer[((8192 + 32) * 0) + 16])); /* Y/R buffer */
+	pSrcDst[1] = (INT16*)((&pBuffer[((8192 + 32) * 1) + 16])); /* Cb/G buffer */
+	pSrcDst[2] = (INT16*)((&pBuffer[((8192 + 32) * 2) + 16])); /* Cr/B buffer */
+
+	if (!rfx_encode_rgb_to_ycbcr(rfx, src, tile->rect.width, tile->rect.height, ScanLine,
+	                             pSrcDst))
+		goto fail;
+
+	for (size_t x = 0; x < 3; x++)
+	{
+		INT16* coeffs = &tile->coeffs[4096ull * x];
+		CopyMemory(coeffs, pSrcDst[x], 4096ull * sizeof(INT16));
+		WINPR_ASSERT(rfx->dwt_2d_extrapolate_encode);
+		rfx->dwt_2d_extrapolate_encode(coeffs, temp);
+		progressive_encoder_bias(coeffs);
+	}
+
+	rc = TRUE;
+fail:
+	BufferPool_Return(progressive->bufferPool, temp);
+	BufferPool_Return(progressive->bufferPool, pBuffer);
+	return rc;
+}
+
+/**
+ * Quantize a component for RFX_PROGRESSIVE_TILE_FIRST.
+ * The high bands are truncated towards zero (sign/magnitude) and LL3 is floored,
+ * which is what the RAW/SRL upgrade passes of the decoder refine.
+ */
+static void progressive_encoder_quantize(const INT16* WINPR_RESTRICT coeffs,
+                                         INT16* WINPR_RESTRICT dst,
+                                         const RFX_COMPONENT_CODEC_QUANT* WINPR_RESTRICT bitPos)
+{
+	for (size_t i = 0; i < ARRAYSIZE(progressive_bands); i++)
+	{
+		const PROGRESSIVE_BAND* band = &progressive_bands[i];
+		const UINT32 shift = progressive_band_quant(bitPos, band) - 1u;
+		const INT16* src = &coeffs[band->offset];
+		INT16* out = &dst[band->offset];
+
+		if (progressive_band_is_ll(band))
+		{
+			for (size_t x = 0; x < band->length; x++)
+				out[x] = (INT16)(src[x] >> shift);
+		}
+		else
+		{
+			for (size_t x = 0; x < band->length; x++)
+			{
+				const INT16 mag = (INT16)(abs(src[x]) >> shift);
+				out[x] = (src[x] < 0) ? (INT16)-mag : mag;
+			}
+		}
+	}
+
+	rfx_differential_encode(&dst[4015], 81);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL progressive_encoder_write_tile_first(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                                 wStream* WINPR_RESTRICT s,
+                                                 PROGRESSIVE_ENCODER_TILE* WINPR_RESTRICT tile)
+{
+	BOOL rc = FALSE;
+	PROGRESSIVE_ENCODER* encoder = &progressive->encoder;
+	RFX_COMPONENT_CODEC_QUANT progQuant = WINPR_C_ARRAY_INIT;
+	RFX_COMPONENT_CODEC_QUANT bitPos = WINPR_C_ARRAY_INIT;
+	UINT16 len[3] = WINPR_C_ARRAY_INIT;
+	const BYTE quality = progressive_encoder_quality(encoder, 1);
+
+	progressive_encoder_prog_quant_get(encoder, quality, &progQuant);
+	progressive_rfx_quant_add(&progressive_encoder_quant, &progQuant, &bitPos);
+
+	INT16* quantized = (INT16*)BufferPool_Take(progressive->bufferPool, -1);
+	if (!quantized)
+		return FALSE;
+
+	const size_t start = Stream_GetPosition(s);
+	const size_t header = 23;
+	if (!Stream_EnsureRemainingCapacity(s, header + 3ull * PROGRESSIVE_ENCODER_RLGR_SIZE))
+		goto fail;
+
+	Stream_Seek(s, header);
+	for (size_t x = 0; x < 3; x++)
+	{
+		BYTE* data = Stream_Pointer(s);
+
+		progressive_encoder_quantize(&tile->coeffs[4096ull * x], quantized, &bitPos);
+
+		/* The RLGR encoder expects a zeroed output buffer */
+		ZeroMemory(data, PROGRESSIVE_ENCODER_RLGR_SIZE);
+		const int size = progressive->rfx_context->rlgr_encode(
+		    RLGR1, quantized, 4096, data, PROGRESSIVE_ENCODER_RLGR_SIZE);
+		/* A full buffer means the RLGR encoder truncated its output */
+		if ((size < 0) || (size >= PROGRESSIVE_ENCODER_RLGR_SIZE))
+			goto fail;
+
+		len[x] = WINPR_ASSERTING_INT_CAST(UINT16, size);
+		Stream_Seek(s, len[x]);
+	}
+
+	{
+		const size_t end = Stream_GetPosition(s);
+		const size_t blockLen = end - start;
+		if (!Stream_SetPosition(s, start))
+			goto fail;
+		Stream_Write_UINT16(s, PROGRESSIVE_WBT_TILE_FIRST); /* blockType (2 bytes) */
+		Stream_Write_UINT32(s, (UINT32)blockLen);          /* blockLen (4 bytes) */
+		Stream_Write_UINT8(s, 0);                          /* quantIdxY (1 byte) */
+		Stream_Write_UINT8(s, 0);                          /* quantIdxCb (1 byte) */
+		Stream_Write_UINT8(s, 0);                          /* quantIdxCr (1 byte) */
+		Stream_Write_UINT16(s, tile->xIdx);                /* xIdx (2 bytes) */
+		Stream_Write_UINT16(s, tile->yIdx);                /* yIdx (2 bytes) */
+		Stream_Write_UINT8(s, 0);                          /* flags (1 byte) */
+		Stream_Write_UINT8(s, quality);                    /* quality (1 byte) */
+		Stream_Write_UINT16(s, len[0]);                    /* yLen (2 bytes) */
+		Stream_Write_UINT16(s, len[1]);                    /* cbLen (2 bytes) */
+		Stream_Write_UINT16(s, len[2]);                    /* crLen (2 bytes) */
+		Stream_Write_UINT16(s, 0);                         /* tailLen (2 bytes) */
+		if (!Stream_SetPosition(s, end))
+			goto fail;
+	}
+
+	tile->pass = 1;
+	rc = TRUE;
+fail:
+	BufferPool_Return(progressive->bufferPool, quantized);
+	return rc;
+}
+
+/**
+ * Encode the SRL stream of a component.
+ * This mirrors progressive_rfx_srl_read: an adaptive run length code for the zero
+ * coefficients followed by sign and unary coded magnitude of the non zero ones.
+ */
+static void progressive_encoder_srl_write(wBitStream* WINPR_RESTRICT bs,
+                                          const INT16* WINPR_RESTRICT values,
+                                          const BYTE* WINPR_RESTRICT numBits, size_t count)
+{
+	UINT32 kp = 8;
+	size_t index = 0;
+
+	while (index < count)
+	{
+		const UINT32 k = kp / 8;
+		size_t run = 0;
+
+		while ((index + run < count) && (values[index + run] == 0))
+			run++;
+
+		if ((run >= (1ull << k)) || (index + run == count))
+		{
+			/* '0' bit, a full run of (1 << k) zeros. Also terminates trailing zeros */
+			BitStream_Write_Bits(bs, 0, 1);
+			index += (1ull << k);
+			kp = MIN(kp + 4, 80);
+			continue;
+		}
+
+		/* '1' bit, followed by the remaining run length in k bits */
+		BitStream_Write_Bits(bs, 1, 1);
+		if (k)
+			BitStream_Write_Bits(bs, (UINT32)run, k);
+		index += run;
+
+		const INT16 value = values[index];
+		const UINT32 mag = (UINT32)abs(value);
+		const UINT32 max = (1u << numBits[index]) - 1u;
+		BitStream_Write_Bits(bs, (value < 0) ? 1 : 0, 1);
+		kp = (kp < 6) ? 0 : kp - 6;
+
+		if (numBits[index] > 1)
+		{
+			WINPR_ASSERT(mag <= max);
+			if (mag > 1)
+				BitStream_Write_Bits(bs, 0, mag - 1);
+			if (mag < max)
+				BitStream_Write_Bits(bs, 1, 1);
+		}
+		index++;
+	}
+}
+
+static inline UINT16 progressive_encoder_bitstream_finish(wBitStream* WINPR_RESTRICT bs)
+{
+	BitStream_Flush(bs);
+	return WINPR_ASSERTING_INT_CAST(UINT16, (bs->position + 7) / 8);
+}
+
+static void progressive_encoder_upgrade_component(
+    PROGRESSIVE_ENCODER* WINPR_RESTRICT encoder, const INT16* WINPR_RESTRICT coeffs,
+    const RFX_COMPONENT_CODEC_QUANT* WINPR_RESTRICT oldBitPos,
+    const RFX_COMPONENT_CODEC_QUANT* WINPR_RESTRICT newBitPos, BYTE* WINPR_RESTRICT srlData,
+    UINT16* WINPR_RESTRICT srlLen, BYTE* WINPR_RESTRICT rawData, UINT16* WINPR_RESTRICT rawLen)
+{
+	wBitStream srl = WINPR_C_ARRAY_INIT;
+	wBitStream raw = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	BitStream_Attach(&raw, rawData, PROGRESSIVE_ENCODER_RAW_SIZE);
+
+	for (size_t i = 0; i < ARRAYSIZE(progressive_bands); i++)
+	{
+		const PROGRESSIVE_BAND* band = &progressive_bands[i];
+		const UINT32 oldPos = progressive_band_quant(oldBitPos, band);
+		const UINT32 newPos = progressive_band_quant(newBitPos, band);
+		const INT16* src = &coeffs[band->offset];
+
+		WINPR_ASSERT(oldPos >= newPos);
+		const UINT32 numBits = oldPos - newPos;
+		if (numBits < 1)
+			continue;
+
+		WINPR_ASSERT(numBits <= 4);
+		const UINT32 mask = (1u << numBits) - 1u;
+		const UINT32 oldShift = oldPos - 1;
+		const UINT32 newShift = newPos - 1;
+
+		if (progressive_band_is_ll(band))
+		{
+			for (size_t x = 0; x < band->length; x++)
+				BitStream_Write_Bits(&raw, (UINT32)(src[x] >> newShift) & mask, numBits);
+			continue;
+		}
+
+		for (size_t x = 0; x < band->length; x++)
+		{
+			const UINT32 mag = (UINT32)abs(src[x]);
+			const UINT32 bits = (mag >> newShift) & mask;
+
+			if ((mag >> oldShift) != 0)
+				BitStream_Write_Bits(&raw, bits, numBits);
+			else
+			{
+				encoder->srlValues[count] = (src[x] < 0) ? (INT16)-(INT16)bits : (INT16)bits;
+				encoder->srlBits[count] = (BYTE)numBits;
+				count++;
+			}
+		}
+	}
+
+	BitStream_Attach(&srl, srlData, PROGRESSIVE_ENCODER_SRL_SIZE);
+	progressive_encoder_srl_write(&srl, encoder->srlValues, encoder->srlBits, count);
+	*srlLen = progressive_encoder_bitstream_finish(&srl);
+	*rawLen = progressive_encoder_bitstream_finish(&raw);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL progressive_encoder_write_tile_upgrade(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                                   wStream* WINPR_RESTRICT s,
+                                                   PROGRESSIVE_ENCODER_TILE* WINPR_RESTRICT tile)
+{
+	PROGRESSIVE_ENCODER* encoder = &progressive->encoder;
+	RFX_COMPONENT_CODEC_QUANT progQuant = WINPR_C_ARRAY_INIT;
+	RFX_COMPONENT_CODEC_QUANT oldBitPos = WINPR_C_ARRAY_INIT;
+	RFX_COMPONENT_CODEC_QUANT newBitPos = WINPR_C_ARRAY_INIT;
+	UINT16 srlLen[3] = WINPR_C_ARRAY_INIT;
+	UINT16 rawLen[3] = WINPR_C_ARRAY_INIT;
+	const BYTE oldQuality = progressive_encoder_quality(encoder, tile->pass);
+	const BYTE quality = progressive_encoder_quality(encoder, tile->pass + 1);
+
+	WINPR_ASSERT(tile->pass > 0);
+	WINPR_ASSERT(tile->pass < encoder->numPasses);
+
+	progressive_encoder_prog_quant_get(encoder, oldQuality, &progQuant);
+	progressive_rfx_quant_add(&progressive_encoder_quant, &progQuant, &oldBitPos);
+	progressive_encoder_prog_quant_get(encoder, quality, &progQuant);
+	progressive_rfx_quant_add(&progressive_encoder_quant, &progQuant, &newBitPos);
+
+	size_t blockLen = 26;
+	for (size_t x = 0; x < 3; x++)
+	{
+		progressive_encoder_upgrade_component(encoder, &tile->coeffs[4096ull * x], &oldBitPos,
+		                                      &newBitPos, encoder->srlData[x], &srlLen[x],
+		                                      encoder->rawData[x], &rawLen[x]);
+		blockLen += srlLen[x] + rawLen[x];
+	}
+
+	if (!Stream_EnsureRemainingCapacity(s, blockLen))
+		return FALSE;
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_TILE_UPGRADE); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)blockLen);            /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0);                            /* quantIdxY (1 byte) */
+	Stream_Write_UINT8(s, 0);                            /* quantIdxCb (1 byte) */
+	Stream_Write_UINT8(s, 0);                            /* quantIdxCr (1 byte) */
+	Stream_Write_UINT16(s, tile->xIdx);                  /* xIdx (2 bytes) */
+	Stream_Write_UINT16(s, tile->yIdx);                  /* yIdx (2 bytes) */
+	Stream_Write_UINT8(s, quality);                      /* quality (1 byte) */
+	for (size_t x = 0; x < 3; x++)
+	{
+		Stream_Write_UINT16(s, srlLen[x]); /* srlLen (2 bytes) */
+		Stream_Write_UINT16(s, rawLen[x]); /* rawLen (2 bytes) */
+	}
+	for (size_t x = 0; x < 3; x++)
+	{
+		Stream_Write(s, encoder->srlData[x], srlLen[x]); /* srlData */
+		Stream_Write(s, encoder->rawData[x], rawLen[x]); /* rawData */
+	}
+
+	tile->pass++;
+	return TRUE;
+}
+
+/* Write a complete progressive message with a single region around the tiles in tileData */
+WINPR_ATTR_NODISCARD
+static BOOL progressive_encoder_write_message(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                              wStream* WINPR_RESTRICT s,
+                                              const RFX_RECT* WINPR_RESTRICT rects,
+                                              UINT16 numRects, UINT16 numTiles)
+{
+	PROGRESSIVE_ENCODER* encoder = &progressive->encoder;
+	const size_t tilesDataSize = Stream_GetPosition(encoder->tileData);
+	const BYTE numProgQuant = (BYTE)(encoder->numPasses - 1);
+	const size_t regionLen =
+	    18ull + numRects * 8ull + 5ull + numProgQuant * 16ull + tilesDataSize;
+
+	if (regionLen > UINT32_MAX)
+		return FALSE;
+
+	if (!Stream_EnsureRemainingCapacity(s, 12ull + 10ull + 12ull + regionLen + 6ull))
+		return FALSE;
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_SYNC); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 12);                   /* blockLen (4 bytes) */
+	Stream_Write_UINT32(s, 0xCACCACCA);           /* magic (4 bytes) */
+	Stream_Write_UINT16(s, 0x0100);               /* version (2 bytes) */
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_CONTEXT); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 10);                      /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 0);                        /* ctxId (1 byte) */
+	Stream_Write_UINT16(s, 64);                      /* tileSize (2 bytes) */
+	Stream_Write_UINT8(s, RFX_SUBBAND_DIFFING);      /* flags (1 byte) */
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_FRAME_BEGIN);      /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 12);                               /* blockLen (4 bytes) */
+	Stream_Write_UINT32(s, progressive->rfx_context->frameIdx++); /* frameIndex (4 bytes) */
+	Stream_Write_UINT16(s, 1);                                /* regionCount (2 bytes) */
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_REGION);    /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)regionLen);         /* blockLen (4 bytes) */
+	Stream_Write_UINT8(s, 64);                         /* tileSize (1 byte) */
+	Stream_Write_UINT16(s, numRects);                  /* numRects (2 bytes) */
+	Stream_Write_UINT8(s, 1);                          /* numQuant (1 byte) */
+	Stream_Write_UINT8(s, numProgQuant);               /* numProgQuant (1 byte) */
+	Stream_Write_UINT8(s, RFX_DWT_REDUCE_EXTRAPOLATE); /* flags (1 byte) */
+	Stream_Write_UINT16(s, numTiles);                  /* numTiles (2 bytes) */
+	Stream_Write_UINT32(s, (UINT32)tilesDataSize);     /* tilesDataSize (4 bytes) */
+
+	for (UINT16 i = 0; i < numRects; i++)
+	{
+		const RFX_RECT* r = &rects[i];
+		Stream_Write_UINT16(s, r->x);      /* x (2 bytes) */
+		Stream_Write_UINT16(s, r->y);      /* y (2 bytes) */
+		Stream_Write_UINT16(s, r->width);  /* width (2 bytes) */
+		Stream_Write_UINT16(s, r->height); /* height (2 bytes) */
+	}
+
+	progressive_component_codec_quant_write(s, &progressive_encoder_quant);
+
+	for (BYTE i = 0; i < numProgQuant; i++)
+	{
+		RFX_COMPONENT_CODEC_QUANT progQuant = WINPR_C_ARRAY_INIT;
+		progressive_encoder_prog_quant_get(encoder, i, &progQuant);
+
+		Stream_Write_UINT8(s, (BYTE)((100u * (i + 1u)) / encoder->numPasses)); /* quality */
+		progressive_component_codec_quant_write(s, &progQuant); /* yQuantValues */
+		progressive_component_codec_quant_write(s, &progQuant); /* cbQuantValues */
+		progressive_component_codec_quant_write(s, &progQuant); /* crQuantValues */
+	}
+
+	Stream_Write(s, Stream_Buffer(encoder->tileData), tilesDataSize);
+
+	Stream_Write_UINT16(s, PROGRESSIVE_WBT_FRAME_END); /* blockType (2 bytes) */
+	Stream_Write_UINT32(s, 6);                         /* blockLen (4 bytes) */
+	return TRUE;
+}
+
+static inline BOOL progressive_encoder_tile_intersects(const PROGRESSIVE_ENCODER_TILE* tile,
+                                                       const RFX_RECT* WINPR_RESTRICT rect)
+{
+	return (rect->x < tile->rect.x + tile->rect.width) &&
+	       (tile->rect.x < rect->x + rect->width) &&
+	       (rect->y < tile->rect.y + tile->rect.height) &&
+	       (tile->rect.y < rect->y + rect->height);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL progressive_encoder_compress(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                         wStream* WINPR_RESTRICT s,
+                                         const RFX_RECT* WINPR_RESTRICT rects, UINT32 numRects,
+                                         const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcFormat,
+                                         UINT32 Width, UINT32 Height, UINT32 ScanLine)
+{
+	PROGRESSIVE_ENCODER* encoder = &progressive->encoder;
+	UINT32 numTiles = 0;
+
+	if (numRects > UINT16_MAX)
+		return FALSE;
+
+	if (!progressive_encoder_init(encoder))
+		return FALSE;
+
+	if (!progressive_encoder_resize(encoder, Width, Height))
+		return FALSE;
+
+	Stream_ResetPosition(encoder->tileData);
+
+	for (UINT32 index = 0; index < encoder->gridWidth * encoder->gridHeight; index++)
+	{
+		PROGRESSIVE_ENCODER_TILE* tile = &encoder->tiles[index];
+		BOOL dirty = FALSE;
+
+		for (UINT32 i = 0; i < numRects; i++)
+		{
+			if (progressive_encoder_tile_intersects(tile, &rects[i]))
+			{
+				dirty = TRUE;
+				break;
+			}
+		}
+
+		if (!dirty)
+			continue;
+
+		if (numTiles >= UINT16_MAX)
+			return FALSE;
+
+		if (!progressive_encoder_tile_transform(progressive, tile, pSrcData, SrcFormat, ScanLine))
+			return FALSE;
+
+		if (!progressive_encoder_write_tile_first(progressive, encoder->tileData, tile))
+			return FALSE;
+
+		numTiles++;
+	}
+
+	return progressive_encoder_write_message(progressive, s, rects, (UINT16)numRects,
+	                                         (UINT16)numTiles);
+}
+
+BOOL progressive_compress_set_passes(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
+                                     UINT32 passes)
+{
+	if (!progressive || !progressive->Compressor)
+		return FALSE;
+
+	if ((passes < 1) || (passes > PROGRESSIVE_ENCODER_MAX_PASSES))
+		return FALSE;
+
+	/* Tiles that were sent with a different quantization can not be upgraded anymore */
+	if (progressive->encoder.numPasses != passes)
+		progressive_encoder_free_tiles(&progressive->encoder);
+
+	progressive->encoder.numPasses = passes;
+	return TRUE;
+}
+
+int progressive_compress_upgrade(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive, UINT32 maxSize,
+                                 BYTE** WINPR_RESTRICT ppDstData, UINT32* WINPR_RESTRICT pDstSize)
+{
+	UINT32 numTiles = 0;
+
+	if (!progressive || !ppDstData || !pDstSize)
+		return -1;
+
+	PROGRESSIVE_ENCODER* encoder = &progressive->encoder;
+	if (!encoder->tiles || (encoder->numPasses < 2))
+		return 0;
+
+	const size_t count = 1ull * encoder->gridWidth * encoder->gridHeight;
+	if (!Stream_EnsureCapacity(progressive->rects, count * sizeof(RFX_RECT)))
+		return -5;
+
+	RFX_RECT* rects = Stream_BufferAs(progressive->rects, RFX_RECT);
+	wStream* tileData = encoder->tileData;
+	Stream_ResetPosition(tileData);
+
+	/**
+	 * Only refine the coarsest tiles so the quality of the surface improves evenly.
+	 * This also guarantees a tile is upgraded at most once per message.
+	 */
+	UINT32 pass = encoder->numPasses;
+	for (size_t index = 0; index < count; index++)
+	{
+		const PROGRESSIVE_ENCODER_TILE* tile = &encoder->tiles[index];
+		if (tile->pass > 0)
+			pass = MIN(pass, tile->pass);
+	}
+
+	for (size_t index = 0; (index < count) && (numTiles < UINT16_MAX); index++)
+	{
+		PROGRESSIVE_ENCODER_TILE* tile = &encoder->tiles[index];
+		if ((pass >= encoder->numPasses) || (tile->pass != pass))
+			continue;
+
+		const size_t start = Stream_GetPosition(tileData);
+		if (!progressive_encoder_write_tile_upgrade(progressive, tileData, tile))
+			return -6;
+
+		if ((maxSize > 0) && (numTiles > 0) && (Stream_GetPosition(tileData) > maxSize))
+		{
+			/* over budget, this tile goes with the next call */
+			tile->pass--;
+			if (!Stream_SetPosition(tileData, start))
+				return -6;
+			break;
+		}
+
+		rects[numTiles++] = tile->rect;
+	}
+
+	if (numTiles == 0)
+		return 0;
+
+	wStream* s = progressive->buffer;
+	Stream_ResetPosition(s);
+	if (!progressive_encoder_write_message(progressive, s, rects, (UINT16)numTiles,
+	                                       (UINT16)numTiles))
+		return -6;
+
+	const size_t pos = Stream_GetPosition(s);
+	WINPR_ASSERT(pos <= UINT32_MAX);
+	*pDstSize = (UINT32)pos;
+	*ppDstData = Stream_Buffer(s);
+	return 1;
+}
+
 BOOL progressive_rfx_write_message_progressive_simple(
     PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive, wStream* WINPR_RESTRICT s,
     const RFX_MESSAGE* WINPR_RESTRICT msg)
@@ -2608,6 +3473,18 @@ int progressive_compress(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
 	progressive->rfx_context->width = WINPR_ASSERTING_INT_CAST(UINT16, Width);
 	progressive->rfx_context->height = WINPR_ASSERTING_INT_CAST(UINT16, Height);
 	rfx_context_set_pixel_format(progressive->rfx_context, SrcFormat);
+
+	if (progressive->encoder.numPasses > 1)
+	{
+		if (!progressive_encoder_compress(progressive, s, rects, numRects, pSrcData, SrcFormat,
+		                                  Width, Height, ScanLine))
+		{
+			WLog_ERR(TAG, "failed to encode progressive message");
+			goto fail;
+		}
+		goto out;
+	}
+
 	message = rfx_encode_message(progressive->rfx_context, rects, numRects, pSrcData, Width, Height,
 	                             ScanLine);
 	if (!message)
@@ -2621,6 +3498,7 @@ int progressive_compress(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive,
 	if (!rc)
 		goto fail;
 
+out:
 	{
 		const size_t pos = Stream_GetPosition(s);
 		WINPR_ASSERT(pos <= UINT32_MAX);
@@ -2634,7 +3512,11 @@ fail:
 
 BOOL progressive_context_reset(PROGRESSIVE_CONTEXT* WINPR_RESTRICT progressive)
 {
-	return (progressive != nullptr);
+	if (!progressive)
+		return FALSE;
+
+	progressive_encoder_free_tiles(&progressive->encoder);
+	return TRUE;
 }
 
 PROGRESSIVE_CONTEXT* progressive_context_new(BOOL Compressor)
@@ -2652,6 +3534,7 @@ PROGRESSIVE_CONTEXT* progressive_context_new_ex(BOOL Compressor, UINT32 Threadin
 
 	progressive->Compressor = Compressor;
 	progressive->quantProgValFull.quality = 100;
+	progressive->encoder.numPasses = 1;
 	progressive->log = WLog_Get(TAG);
 	if (!progressive->log)
 		goto fail;
@@ -2693,6 +3576,7 @@ void progressive_context_free(PROGRESSIVE_CONTEXT* progressive)
 	Stream_Free(progressive->buffer, TRUE);
 	Stream_Free(progressive->rects, TRUE);
 	rfx_context_free(progressive->rfx_context);
+	progressive_encoder_uninit(&progressive->encoder);
 
 	BufferPool_Free(progressive->bufferPool);
 	HashTable_Free(progressive->SurfaceContexts);
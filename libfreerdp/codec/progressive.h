@@ -201,6 +201,30 @@ typedef struct
 	UINT32* updatedTileIndices;
 } PROGRESSIVE_SURFACE_CONTEXT;
 
+typedef struct
+{
+	UINT16 xIdx;
+	UINT16 yIdx;
+	UINT32 pass; /* quality passes sent, 0 if the tile was never encoded */
+	RFX_RECT rect;
+	INT16* coeffs; /* Y, Cb and Cr DWT coefficients, 4096 each */
+} PROGRESSIVE_ENCODER_TILE;
+
+typedef struct
+{
+	UINT32 numPasses;
+	UINT32 width;
+	UINT32 height;
+	UINT32 gridWidth;
+	UINT32 gridHeight;
+	PROGRESSIVE_ENCODER_TILE* tiles;
+	wStream* tileData;
+	BYTE* srlData[3];
+	BYTE* rawData[3];
+	INT16* srlValues;
+	BYTE* srlBits;
+} PROGRESSIVE_ENCODER;
+
 typedef enum
 {
 	FLAG_WBT_SYNC = 0x01,
@@ -228,6 +252,7 @@ struct S_PROGRESSIVE_CONTEXT
 	wStream* buffer;
 	wStream* rects;
 	RFX_CONTEXT* rfx_context;
+	PROGRESSIVE_ENCODER encoder;
 	PROGRESSIVE_TILE_PROCESS_WORK_PARAM params[0x10000];
 	PTP_WORK work_objects[0x10000];
 };
@@ -50,6 +50,7 @@
 #include "../core/utils.h"
 
 #include "sse/rfx_sse2.h"
+#include "sse/rfx_avx2.h"
 #include "neon/rfx_neon.h"
 
 #define TAG FREERDP_TAG("codec")
@@ -308,9 +309,11 @@ RFX_CONTEXT* rfx_context_new_ex(BOOL encoder, UINT32 ThreadingFlags)
 	context->dwt_2d_decode = rfx_dwt_2d_decode;
 	context->dwt_2d_extrapolate_decode = rfx_dwt_2d_extrapolate_decode;
 	context->dwt_2d_encode = rfx_dwt_2d_encode;
+	context->dwt_2d_extrapolate_encode = rfx_dwt_2d_extrapolate_encode;
 	context->rlgr_decode = rfx_rlgr_decode;
 	context->rlgr_encode = rfx_rlgr_encode;
 	rfx_init_sse2(context);
+	rfx_init_avx2(context);
 	rfx_init_neon(context);
 	context->state = RFX_STATE_SEND_HEADERS;
 	context->expectedDataBlockType = WBT_FRAME_BEGIN;
@@ -2126,20 +2129,19 @@ static inline BOOL rfx_write_message_tileset(RFX_CONTEXT* WINPR_RESTRICT context
 
 static inline BOOL
 rfx_write_message_frame_begin(WINPR_ATTR_UNUSED RFX_CONTEXT* WINPR_RESTRICT context,
-                              wStream* WINPR_RESTRICT s, const RFX_MESSAGE* WINPR_RESTRICT message)
+                              wStream* WINPR_RESTRICT s, UINT32 frameIdx)
 {
 	WINPR_ASSERT(context);
-	WINPR_ASSERT(message);
 
 	if (!Stream_EnsureRemainingCapacity(s, 14))
 		return FALSE;
 
-	Stream_Write_UINT16(s, WBT_FRAME_BEGIN);   /* CodecChannelT.blockType */
-	Stream_Write_UINT32(s, 14);                /* CodecChannelT.blockLen */
-	Stream_Write_UINT8(s, 1);                  /* CodecChannelT.codecId */
-	Stream_Write_UINT8(s, 0);                  /* CodecChannelT.channelId */
-	Stream_Write_UINT32(s, message->frameIdx); /* frameIdx */
-	Stream_Write_UINT16(s, 1);                 /* numRegions */
+	Stream_Write_UINT16(s, WBT_FRAME_BEGIN); /* CodecChannelT.blockType */
+	Stream_Write_UINT32(s, 14);              /* CodecChannelT.blockLen */
+	Stream_Write_UINT8(s, 1);                /* CodecChannelT.codecId */
+	Stream_Write_UINT8(s, 0);                /* CodecChannelT.channelId */
+	Stream_Write_UINT32(s, frameIdx);        /* frameIdx */
+	Stream_Write_UINT16(s, 1);               /* numRegions */
 	return TRUE;
 }
 
@@ -2199,8 +2201,8 @@ rfx_write_message_frame_end(WINPR_ATTR_UNUSED RFX_CONTEXT* WINPR_RESTRICT contex
 	return TRUE;
 }
 
-BOOL rfx_write_message(RFX_CONTEXT* WINPR_RESTRICT context, wStream* WINPR_RESTRICT s,
-                       const RFX_MESSAGE* WINPR_RESTRICT message)
+static BOOL rfx_write_message_frame(RFX_CONTEXT* WINPR_RESTRICT context, wStream* WINPR_RESTRICT s,
+                                    const RFX_MESSAGE* WINPR_RESTRICT message, UINT32 frameIdx)
 {
 	WINPR_ASSERT(context);
 	WINPR_ASSERT(message);
@@ -2213,7 +2215,7 @@ BOOL rfx_write_message(RFX_CONTEXT* WINPR_RESTRICT context, wStream* WINPR_RESTR
 		context->state = RFX_STATE_SEND_FRAME_DATA;
 	}
 
-	if (!rfx_write_message_frame_begin(context, s, message) ||
+	if (!rfx_write_message_frame_begin(context, s, frameIdx) ||
 	    !rfx_write_message_region(context, s, message) ||
 	    !rfx_write_message_tileset(context, s, message) ||
 	    !rfx_write_message_frame_end(context, s, message))
@@ -2224,6 +2226,25 @@ BOOL rfx_write_message(RFX_CONTEXT* WINPR_RESTRICT context, wStream* WINPR_RESTR
 	return TRUE;
 }
 
+BOOL rfx_write_message(RFX_CONTEXT* WINPR_RESTRICT context, wStream* WINPR_RESTRICT s,
+                       const RFX_MESSAGE* WINPR_RESTRICT message)
+{
+	WINPR_ASSERT(message);
+	return rfx_write_message_frame(context, s, message, message->frameIdx);
+}
+
+BOOL rfx_write_shared_message(RFX_CONTEXT* WINPR_RESTRICT context, wStream* WINPR_RESTRICT s,
+                              const RFX_MESSAGE* WINPR_RESTRICT message)
+{
+	WINPR_ASSERT(context);
+
+	if (!rfx_write_message_frame(context, s, message, context->frameIdx))
+		return FALSE;
+
+	context->frameIdx++;
+	return TRUE;
+}
+
 BOOL rfx_compose_message(RFX_CONTEXT* WINPR_RESTRICT context, wStream* WINPR_RESTRICT s,
                          const RFX_RECT* WINPR_RESTRICT rects, size_t numRects,
                          const BYTE* WINPR_RESTRICT data, UINT32 width, UINT32 height,
@@ -2253,6 +2274,55 @@ RLGR_MODE rfx_context_get_mode(RFX_CONTEXT* WINPR_RESTRICT context)
 	return context->mode;
 }
 
+BOOL rfx_context_set_quantization(RFX_CONTEXT* WINPR_RESTRICT context,
+                                  const UINT32* WINPR_RESTRICT quantVals, size_t count)
+{
+	WINPR_ASSERT(context);
+
+	if (!context->encoder || !quantVals || (count != NR_QUANT_VALUES))
+		return FALSE;
+
+	/* [MS-RDPRFX] 2.2.2.1.5 TS_RFX_CODEC_QUANT */
+	for (size_t i = 0; i < count; i++)
+	{
+		if ((quantVals[i] < 6) || (quantVals[i] > 15))
+			return FALSE;
+	}
+
+	if (context->numQuant != 1)
+	{
+		UINT32* quants = (UINT32*)winpr_aligned_recalloc(context->quants, 1,
+		                                                 NR_QUANT_VALUES * sizeof(UINT32), 32);
+		if (!quants)
+			return FALSE;
+
+		context->quants = quants;
+		context->numQuant = 1;
+	}
+
+	CopyMemory(context->quants, quantVals, NR_QUANT_VALUES * sizeof(UINT32));
+	context->quantIdxY = 0;
+	context->quantIdxCb = 0;
+	context->quantIdxCr = 0;
+	return TRUE;
+}
+
+BOOL rfx_context_get_quantization(RFX_CONTEXT* WINPR_RESTRICT context,
+                                  UINT32* WINPR_RESTRICT quantVals, size_t count)
+{
+	WINPR_ASSERT(context);
+
+	if (!context->encoder || !quantVals || (count != NR_QUANT_VALUES))
+		return FALSE;
+
+	if (context->numQuant == 0)
+		CopyMemory(quantVals, rfx_default_quantization_values, NR_QUANT_VALUES * sizeof(UINT32));
+	else
+		CopyMemory(quantVals, &context->quants[NR_QUANT_VALUES * context->quantIdxY],
+		           NR_QUANT_VALUES * sizeof(UINT32));
+	return TRUE;
+}
+
 UINT32 rfx_context_get_frame_idx(const RFX_CONTEXT* WINPR_RESTRICT context)
 {
 	WINPR_ASSERT(context);
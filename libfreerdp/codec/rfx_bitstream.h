@@ -22,6 +22,7 @@
 
 #include <winpr/assert.h>
 #include <winpr/cast.h>
+#include <winpr/endian.h>
 
 #include <freerdp/codec/rfx.h>
 
@@ -30,106 +31,176 @@ extern "C"
 {
 #endif
 
+	/* Writes MSB first, the bits are collected in a 64 bit accumulator and stored 32 bits at a
+	 * time. Bits that do not fit the buffer are counted but dropped. */
 	typedef struct
 	{
 		BYTE* buffer;
-		uint32_t nbytes;
-		uint32_t byte_pos;
-		uint32_t bits_left;
+		size_t nbytes;
+		size_t byte_pos;
+		UINT64 accumulator;
+		uint32_t count; /* bits pending in the low end of accumulator, always < 32 */
 	} RFX_BITSTREAM;
 
+	/* Reads MSB first, the next bits are kept left aligned in a 64 bit accumulator */
+	typedef struct
+	{
+		const BYTE* data;
+		const BYTE* end;
+		UINT64 accumulator;
+		uint32_t count; /* valid bits in the high end of accumulator */
+	} RFX_BITREADER;
+
 	static inline void rfx_bitstream_attach(RFX_BITSTREAM* bs, BYTE* WINPR_RESTRICT buffer,
 	                                        size_t nbytes)
 	{
 		WINPR_ASSERT(bs);
-		bs->buffer = (buffer);
-
-		WINPR_ASSERT(nbytes <= UINT32_MAX);
-		bs->nbytes = WINPR_ASSERTING_INT_CAST(uint32_t, nbytes);
+		bs->buffer = buffer;
+		bs->nbytes = nbytes;
 		bs->byte_pos = 0;
-		bs->bits_left = 8;
+		bs->accumulator = 0;
+		bs->count = 0;
 	}
 
-	WINPR_ATTR_NODISCARD
-	static inline uint32_t rfx_bitstream_get_bits(RFX_BITSTREAM* bs, uint32_t nbits)
+	static inline void rfx_bitstream_write_byte(RFX_BITSTREAM* bs, BYTE value)
 	{
-		UINT16 n = 0;
-		while (bs->byte_pos < bs->nbytes && nbits > 0)
-		{
-			uint32_t b = nbits;
-			if (b > bs->bits_left)
-				b = bs->bits_left;
-			if (n)
-				n <<= b;
-			n |= (bs->buffer[bs->byte_pos] >> (bs->bits_left - b)) & ((1u << b) - 1);
-			bs->bits_left -= b;
-			nbits -= b;
-			if (bs->bits_left == 0)
-			{
-				bs->bits_left = 8;
-				bs->byte_pos++;
-			}
-		}
-		return n;
+		if (bs->byte_pos < bs->nbytes)
+			bs->buffer[bs->byte_pos] = value;
+		bs->byte_pos++;
 	}
 
-	static inline void rfx_bitstream_put_bits(RFX_BITSTREAM* bs, uint32_t _bits, uint32_t _nbits)
+	/* Appends the low _nbits (up to 32) of _bits */
+	static inline void rfx_bitstream_put_bits(RFX_BITSTREAM* bs, UINT64 _bits, uint32_t _nbits)
 	{
-		UINT16 bits = WINPR_ASSERTING_INT_CAST(UINT16, _bits);
+		WINPR_ASSERT(bs);
+		WINPR_ASSERT(_nbits <= 32);
+
+		const UINT64 mask = (1ull << _nbits) - 1ull;
+		bs->accumulator = (bs->accumulator << _nbits) | (_bits & mask);
+		bs->count += _nbits;
+
+		if (bs->count < 32)
+			return;
 
-		uint32_t nbits = (_nbits);
-		while (bs->byte_pos < bs->nbytes && nbits > 0)
+		bs->count -= 32;
+		const UINT32 value = (UINT32)(bs->accumulator >> bs->count);
+
+		if (bs->byte_pos + 4 <= bs->nbytes)
 		{
-			uint32_t b = nbits;
-			if (b > bs->bits_left)
-				b = bs->bits_left;
-			bs->buffer[bs->byte_pos] |= ((bits >> (nbits - b)) & ((1u << b) - 1))
-			                            << (bs->bits_left - b);
-			bs->bits_left -= b;
-			nbits -= b;
-			if (bs->bits_left == 0)
-			{
-				bs->bits_left = 8;
-				bs->byte_pos++;
-			}
+			winpr_Data_Write_UINT32_BE(&bs->buffer[bs->byte_pos], value);
+			bs->byte_pos += 4;
 		}
+		else
+		{
+			for (size_t x = 0; x < 4; x++)
+				rfx_bitstream_write_byte(bs, (value >> (24 - 8 * x)) & 0xFF);
+		}
+	}
+
+	/* Appends count copies of bit */
+	static inline void rfx_bitstream_put_bit(RFX_BITSTREAM* bs, uint32_t count, BOOL bit)
+	{
+		const UINT64 bits = bit ? UINT32_MAX : 0;
+
+		for (; count > 32; count -= 32)
+			rfx_bitstream_put_bits(bs, bits, 32);
+
+		rfx_bitstream_put_bits(bs, bits, count);
 	}
 
+	/* Pads the last byte with 0 bits. As many 0 bits as the last byte uses are appended, which
+	 * adds a trailing 0 byte if more than half of it is used. Encoders always did that. */
 	static inline void rfx_bitstream_flush(RFX_BITSTREAM* bs)
 	{
 		WINPR_ASSERT(bs);
-		if (bs->bits_left != 8)
+
+		rfx_bitstream_put_bits(bs, 0, bs->count % 8);
+
+		while (bs->count > 0)
 		{
-			uint32_t _nbits = 8 - bs->bits_left;
-			rfx_bitstream_put_bits(bs, 0, _nbits);
+			const uint32_t n = (bs->count >= 8) ? 8 : bs->count;
+			bs->count -= n;
+			const UINT64 value = (bs->accumulator >> bs->count) << (8 - n);
+			rfx_bitstream_write_byte(bs, value & 0xFF);
 		}
 	}
 
 	WINPR_ATTR_NODISCARD
-	static inline BOOL rfx_bitstream_eos(RFX_BITSTREAM* bs)
+	static inline uint32_t rfx_bitstream_get_processed_bytes(RFX_BITSTREAM* bs)
 	{
 		WINPR_ASSERT(bs);
-		return ((bs)->byte_pos >= (bs)->nbytes);
+		WINPR_ASSERT(bs->count == 0);
+
+		if (bs->byte_pos > bs->nbytes)
+			return WINPR_ASSERTING_INT_CAST(uint32_t, bs->nbytes);
+		return WINPR_ASSERTING_INT_CAST(uint32_t, bs->byte_pos);
+	}
+
+	static inline void rfx_bitreader_attach(RFX_BITREADER* br, const BYTE* WINPR_RESTRICT data,
+	                                        size_t nbytes)
+	{
+		WINPR_ASSERT(br);
+		br->data = data;
+		br->end = data + nbytes;
+		br->accumulator = 0;
+		br->count = 0;
+	}
+
+	/* Loads at least 57 bits into the accumulator, less only at the end of the data */
+	static inline void rfx_bitreader_fill(RFX_BITREADER* br)
+	{
+		WINPR_ASSERT(br);
+
+		if (br->count > 56)
+			return;
+
+		if (br->end - br->data >= 8)
+		{
+			/* The bits of a partially loaded byte are loaded again with the next fill */
+			br->accumulator |= winpr_Data_Get_UINT64_BE(br->data) >> br->count;
+			br->data += (63 - br->count) >> 3;
+			br->count |= 56;
+		}
+		else
+		{
+			while ((br->count <= 56) && (br->data < br->end))
+			{
+				br->accumulator |= ((UINT64)*br->data++) << (56 - br->count);
+				br->count += 8;
+			}
+		}
 	}
 
+	/* Returns TRUE if at least nbits are left */
 	WINPR_ATTR_NODISCARD
-	static inline uint32_t rfx_bitstream_left(RFX_BITSTREAM* bs)
+	static inline BOOL rfx_bitreader_check(RFX_BITREADER* br, uint32_t nbits)
 	{
-		WINPR_ASSERT(bs);
+		rfx_bitreader_fill(br);
+		return br->count >= nbits;
+	}
 
-		if ((bs)->byte_pos >= (bs)->nbytes)
-			return 0;
+	static inline void rfx_bitreader_skip(RFX_BITREADER* br, uint32_t nbits)
+	{
+		WINPR_ASSERT(br);
+		WINPR_ASSERT(nbits <= br->count);
 
-		return ((bs)->nbytes - (bs)->byte_pos - 1) * 8 + (bs)->bits_left;
+		br->accumulator = (nbits < 64) ? (br->accumulator << nbits) : 0;
+		br->count -= nbits;
 	}
 
+	/* Reads nbits (up to 32), rfx_bitreader_check must have been successful */
 	WINPR_ATTR_NODISCARD
-	static inline uint32_t rfx_bitstream_get_processed_bytes(RFX_BITSTREAM* bs)
+	static inline uint32_t rfx_bitreader_get_bits(RFX_BITREADER* br, uint32_t nbits)
 	{
-		WINPR_ASSERT(bs);
-		if ((bs)->bits_left < 8)
-			return (bs)->byte_pos + 1;
-		return (bs)->byte_pos;
+		WINPR_ASSERT(br);
+		WINPR_ASSERT(nbits <= 32);
+
+		WINPR_ASSERT(nbits <= br->count);
+
+		const uint32_t value = (uint32_t)((br->accumulator >> 1) >> (63 - nbits));
+		br->accumulator <<= nbits;
+		br->count -= nbits;
+		return value;
 	}
 
 #ifdef __cplusplus
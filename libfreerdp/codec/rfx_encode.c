@@ -269,19 +269,43 @@ fail:
 	return res;
 }
 
-BOOL rfx_encode_rgb(RFX_CONTEXT* WINPR_RESTRICT context, RFX_TILE* WINPR_RESTRICT tile)
+BOOL rfx_encode_rgb_to_ycbcr(RFX_CONTEXT* WINPR_RESTRICT context, const BYTE* WINPR_RESTRICT data,
+                             UINT32 width, UINT32 height, UINT32 scanline,
+                             INT16* pSrcDst[3])
 {
-	BOOL rc = FALSE;
 	union
 	{
 		const INT16** cpv;
 		INT16** pv;
 	} cnv;
+	primitives_t* prims = primitives_get();
+	static const prim_size_t roi_64x64 = { 64, 64 };
+
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(data);
+	WINPR_ASSERT(width <= 64);
+	WINPR_ASSERT(height <= 64);
+
+	PROFILER_ENTER(context->priv->prof_rfx_encode_format_rgb)
+	rfx_encode_format_rgb(data, width, height, scanline, context->pixel_format, context->palette,
+	                      pSrcDst[0], pSrcDst[1], pSrcDst[2]);
+	PROFILER_EXIT(context->priv->prof_rfx_encode_format_rgb)
+	PROFILER_ENTER(context->priv->prof_rfx_rgb_to_ycbcr)
+
+	cnv.pv = pSrcDst;
+	const pstatus_t rc = prims->RGBToYCbCr_16s16s_P3P3(cnv.cpv, 64 * sizeof(INT16), pSrcDst,
+	                                                   64 * sizeof(INT16), &roi_64x64);
+
+	PROFILER_EXIT(context->priv->prof_rfx_rgb_to_ycbcr)
+	return (rc == PRIMITIVES_SUCCESS);
+}
+
+BOOL rfx_encode_rgb(RFX_CONTEXT* WINPR_RESTRICT context, RFX_TILE* WINPR_RESTRICT tile)
+{
+	BOOL rc = FALSE;
 	INT16* pSrcDst[3] = WINPR_C_ARRAY_INIT;
 	uint32_t CbLen = 0;
 	uint32_t CrLen = 0;
-	primitives_t* prims = primitives_get();
-	static const prim_size_t roi_64x64 = { 64, 64 };
 
 	BYTE* pBuffer = (BYTE*)BufferPool_Take(context->priv->BufferPool, -1);
 	if (!pBuffer)
@@ -295,19 +319,10 @@ BOOL rfx_encode_rgb(RFX_CONTEXT* WINPR_RESTRICT context, RFX_TILE* WINPR_RESTRIC
 	pSrcDst[1] = (INT16*)((&pBuffer[((8192ULL + 32ULL) * 1ULL) + 16ULL])); /* cb_g_buffer */
 	pSrcDst[2] = (INT16*)((&pBuffer[((8192ULL + 32ULL) * 2ULL) + 16ULL])); /* cr_b_buffer */
 	PROFILER_ENTER(context->priv->prof_rfx_encode_rgb)
-	PROFILER_ENTER(context->priv->prof_rfx_encode_format_rgb)
-	rfx_encode_format_rgb(tile->data, tile->width, tile->height, tile->scanline,
-	                      context->pixel_format, context->palette, pSrcDst[0], pSrcDst[1],
-	                      pSrcDst[2]);
-	PROFILER_EXIT(context->priv->prof_rfx_encode_format_rgb)
-	PROFILER_ENTER(context->priv->prof_rfx_rgb_to_ycbcr)
-
-	cnv.pv = pSrcDst;
-	if (prims->RGBToYCbCr_16s16s_P3P3(cnv.cpv, 64 * sizeof(INT16), pSrcDst, 64 * sizeof(INT16),
-	                                  &roi_64x64) != PRIMITIVES_SUCCESS)
+	if (!rfx_encode_rgb_to_ycbcr(context, tile->data, tile->width, tile->height, tile->scanline,
+	                             pSrcDst))
 		goto fail;
 
-	PROFILER_EXIT(context->priv->prof_rfx_rgb_to_ycbcr)
 	/**
 	 * We need to clear the buffers as the RLGR encoder expects it to be initialized to zero.
 	 * This allows simplifying and improving the performance of the encoding process.
@@ -27,4 +27,12 @@ WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL rfx_encode_rgb(RFX_CONTEXT* WINPR_RESTRICT context,
                                   RFX_TILE* WINPR_RESTRICT tile);
 
+/* Convert a tile of up to 64x64 pixels to the planar, scaled YCbCr representation used by the
+ * DWT. Tiles smaller than 64x64 are padded by replicating the last column and row. */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL rfx_encode_rgb_to_ycbcr(RFX_CONTEXT* WINPR_RESTRICT context,
+                                           const BYTE* WINPR_RESTRICT data, UINT32 width,
+                                           UINT32 height, UINT32 scanline,
+                                           INT16* pSrcDst[3]);
+
 #endif /* FREERDP_LIB_CODEC_RFX_ENCODE_H */
@@ -33,7 +33,6 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/sysinfo.h>
-#include <winpr/bitstream.h>
 #include <winpr/intrin.h>
 
 #include "rfx_bitstream.h"
@@ -48,19 +47,6 @@
 #define UQ_GR (3)  /* increase in kp after nonzero symbol in GR mode */
 #define DQ_GR (3)  /* decrease in kp after zero symbol in GR mode */
 
-/* Returns the least number of bits required to represent a given value */
-#define GetMinBits(_val, _nbits) \
-	do                           \
-	{                            \
-		UINT32 _v = (_val);      \
-		(_nbits) = 0;            \
-		while (_v)               \
-		{                        \
-			_v >>= 1;            \
-			(_nbits)++;          \
-		}                        \
-	} while (0)
-
 /*
  * Update the passed parameter and clamp it to the range [0, KPMAX]
  * Return the value of parameter right-shifted by LSGR
@@ -149,437 +135,236 @@ static inline UINT32 lzcnt_s(UINT32 x)
 	return __lzcnt(x);
 }
 
-int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
-                    INT16* WINPR_RESTRICT pDstData, UINT32 rDstSize)
+static inline UINT32 lzcnt64_s(UINT64 x)
 {
-	uint32_t vk = 0;
-	size_t run = 0;
-	size_t cnt = 0;
-	size_t size = 0;
-	size_t offset = 0;
-	INT16 mag = 0;
-	UINT32 k = 0;
-	UINT32 kp = 0;
-	UINT32 kr = 0;
-	UINT32 krp = 0;
-	UINT16 code = 0;
-	UINT32 sign = 0;
-	UINT32 nIdx = 0;
-	UINT32 val1 = 0;
-	UINT32 val2 = 0;
-	INT16* pOutput = nullptr;
-	wBitStream* bs = nullptr;
-	wBitStream s_bs = WINPR_C_ARRAY_INIT;
-	const SSIZE_T DstSize = rDstSize;
-
-	if (!InitOnceExecuteOnce(&rfx_rlgr_init_once, rfx_rlgr_init, nullptr, nullptr))
-		return -1;
-
-	k = 1;
-	kp = k << LSGR;
-
-	kr = 1;
-	krp = kr << LSGR;
-
-	if ((mode != RLGR1) && (mode != RLGR3))
-		mode = RLGR1;
-
-	if (!pSrcData || !SrcSize)
-		return -1;
-
-	if (!pDstData || !DstSize)
-		return -1;
-
-	pOutput = pDstData;
+	const UINT32 hi = (UINT32)(x >> 32);
+	if (hi)
+		return lzcnt_s(hi);
+	return 32 + lzcnt_s((UINT32)x);
+}
 
-	bs = &s_bs;
+/* Returns the least number of bits required to represent a given value */
+static inline UINT32 GetMinBits(UINT32 val)
+{
+	return 32 - lzcnt_s(val);
+}
 
-	BitStream_Attach(bs, pSrcData, SrcSize);
-	BitStream_Fetch(bs);
+/* Consumes the leading 0 (or 1) bits up to the end of the data and returns their count */
+static inline size_t rfx_rlgr_count_bits(RFX_BITREADER* WINPR_RESTRICT br, BOOL ones)
+{
+	const UINT64 invert = ones ? UINT64_MAX : 0;
+	size_t total = 0;
 
-	while ((BitStream_GetRemainingLength(bs) > 0) && ((pOutput - pDstData) < DstSize))
+	for (;;)
 	{
-		if (k)
+		rfx_bitreader_fill(br);
+		if (br->count == 0)
+			break;
+
+		const UINT32 cnt = lzcnt64_s(br->accumulator ^ invert);
+		if (cnt < br->count)
 		{
-			/* Run-Length (RL) Mode */
+			rfx_bitreader_skip(br, cnt);
+			return total + cnt;
+		}
 
-			run = 0;
+		total += br->count;
+		rfx_bitreader_skip(br, br->count);
+	}
 
-			/* count number of leading 0s */
+	return total;
+}
 
-			cnt = lzcnt_s(bs->accumulator);
+/* Reads the Golomb/Rice encoding of a non-negative integer */
+WINPR_ATTR_NODISCARD
+static inline BOOL rfx_rlgr_decode_gr(RFX_BITREADER* WINPR_RESTRICT br, uint32_t* krp,
+                                      UINT16* code)
+{
+	const uint32_t kr = *krp >> LSGR;
+	uint32_t vk = 0;
+	uint32_t remainder = 0;
 
-			size_t nbits = BitStream_GetRemainingLength(bs);
+	/* count number of leading 1s, usually the whole code is already in the accumulator */
+	rfx_bitreader_fill(br);
+	const UINT32 ones = lzcnt64_s(~br->accumulator);
 
-			if (cnt > nbits)
-				cnt = WINPR_ASSERTING_INT_CAST(uint32_t, nbits);
+	if (ones + 1 + kr <= br->count)
+	{
+		vk = ones;
+		rfx_bitreader_skip(br, vk + 1);
+		remainder = rfx_bitreader_get_bits(br, kr);
+	}
+	else
+	{
+		vk = WINPR_ASSERTING_INT_CAST(uint32_t, rfx_rlgr_count_bits(br, TRUE));
 
-			vk = WINPR_ASSERTING_INT_CAST(uint32_t, cnt);
+		if (!rfx_bitreader_check(br, 1))
+			return FALSE;
 
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
+		rfx_bitreader_skip(br, 1);
 
-				cnt = lzcnt_s(bs->accumulator);
+		/* next kr bits contain code remainder */
+		if (!rfx_bitreader_check(br, kr))
+			return FALSE;
 
-				nbits = BitStream_GetRemainingLength(bs);
+		remainder = rfx_bitreader_get_bits(br, kr);
+	}
 
-				if (cnt > nbits)
-					cnt = nbits;
+	/* add (vk << kr) to code */
+	*code = (UINT16)(remainder | (vk << kr));
 
-				WINPR_ASSERT(cnt + vk <= UINT32_MAX);
-				vk += WINPR_ASSERTING_INT_CAST(uint32_t, cnt);
-			}
+	/* update krp, only if vk is not equal to 1 */
+	if (vk == 0)
+		(void)UpdateParam(krp, -2);
+	else if (vk >= KPMAX)
+		*krp = KPMAX;
+	else if (vk > 1)
+		(void)UpdateParam(krp, WINPR_ASSERTING_INT_CAST(int32_t, vk));
 
-			BitStream_Shift(bs, (vk % 32));
+	return TRUE;
+}
 
-			if (BitStream_GetRemainingLength(bs) < 1)
-				break;
+/* Converts (2 * magnitude - sign) back to the signed value */
+static inline INT16 GetMagSign(UINT32 twoMs)
+{
+	if (twoMs & 1)
+		return WINPR_ASSERTING_INT_CAST(INT16, (twoMs + 1) >> 1) * -1;
+	return WINPR_ASSERTING_INT_CAST(INT16, twoMs >> 1);
+}
 
-			BitStream_Shift(bs, 1);
+int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
+                    INT16* WINPR_RESTRICT pDstData, UINT32 rDstSize)
+{
+	RFX_BITREADER s_br = WINPR_C_ARRAY_INIT;
+	RFX_BITREADER* br = &s_br;
 
-			while (vk--)
-			{
-				const UINT32 add = (1u << k); /* add (1u << k) to run length */
-				run += add;
+	if (!InitOnceExecuteOnce(&rfx_rlgr_init_once, rfx_rlgr_init, nullptr, nullptr))
+		return -1;
 
-				/* update k, kp params */
+	uint32_t k = 1;
+	uint32_t kp = k << LSGR;
+	uint32_t krp = 1u << LSGR;
 
-				kp += UP_GR;
+	if ((mode != RLGR1) && (mode != RLGR3))
+		mode = RLGR1;
 
-				if (kp > KPMAX)
-					kp = KPMAX;
+	if (!pSrcData || !SrcSize)
+		return -1;
 
-				k = kp >> LSGR;
-			}
+	if (!pDstData || !rDstSize)
+		return -1;
 
-			/* next k bits contain run length remainder */
+	INT16* pOutput = pDstData;
+	const INT16* pEnd = &pDstData[rDstSize];
 
-			if (BitStream_GetRemainingLength(bs) < k)
-				break;
+	rfx_bitreader_attach(br, pSrcData, SrcSize);
 
-			bs->mask = ((1u << k) - 1);
-			run += ((bs->accumulator >> (32 - k)) & bs->mask);
-			BitStream_Shift(bs, k);
+	while (rfx_bitreader_check(br, 1) && (pOutput < pEnd))
+	{
+		if (k)
+		{
+			/* Run-Length (RL) Mode */
 
-			/* read sign bit */
+			/* count number of leading 0s */
+			size_t vk = rfx_rlgr_count_bits(br, FALSE);
 
-			if (BitStream_GetRemainingLength(bs) < 1)
+			if (!rfx_bitreader_check(br, 1))
 				break;
 
-			sign = (bs->accumulator & 0x80000000) ? 1 : 0;
-			BitStream_Shift(bs, 1);
+			rfx_bitreader_skip(br, 1);
 
-			/* count number of leading 1s */
-
-			cnt = lzcnt_s(~(bs->accumulator));
-
-			nbits = BitStream_GetRemainingLength(bs);
-
-			if (cnt > nbits)
-				cnt = nbits;
-
-			vk = WINPR_ASSERTING_INT_CAST(uint32_t, cnt);
-
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
+			/* add (1 << k) to run length for each 0, k is constant once kp reached KPMAX */
+			size_t run = 0;
+			for (; (vk > 0) && (kp < KPMAX); vk--)
 			{
-				BitStream_Shift32(bs);
-
-				cnt = lzcnt_s(~(bs->accumulator));
-
-				nbits = BitStream_GetRemainingLength(bs);
-
-				if (cnt > nbits)
-					cnt = nbits;
-
-				WINPR_ASSERT(cnt + vk <= UINT32_MAX);
-				vk += WINPR_ASSERTING_INT_CAST(uint32_t, cnt);
+				run += (1ull << k);
+				k = UpdateParam(&kp, UP_GR);
 			}
 
-			BitStream_Shift(bs, (vk % 32));
+			run += vk << k;
 
-			if (BitStream_GetRemainingLength(bs) < 1)
+			/* next k bits contain run length remainder */
+			if (!rfx_bitreader_check(br, k))
 				break;
 
-			BitStream_Shift(bs, 1);
+			run += rfx_bitreader_get_bits(br, k);
 
-			/* next kr bits contain code remainder */
-
-			if (BitStream_GetRemainingLength(bs) < kr)
+			/* read sign bit */
+			if (!rfx_bitreader_check(br, 1))
 				break;
 
-			bs->mask = ((1u << kr) - 1);
-			if (kr > 0)
-				code = (UINT16)((bs->accumulator >> (32 - kr)) & bs->mask);
-			else
-				code = 0;
-			BitStream_Shift(bs, kr);
-
-			/* add (vk << kr) to code */
-
-			code |= (vk << kr);
-
-			if (!vk)
-			{
-				/* update kr, krp params */
-
-				if (krp > 2)
-					krp -= 2;
-				else
-					krp = 0;
-
-				kr = krp >> LSGR;
-			}
-			else if (vk != 1)
-			{
-				/* update kr, krp params */
-
-				krp += vk;
-
-				if (krp > KPMAX)
-					krp = KPMAX;
+			const uint32_t sign = rfx_bitreader_get_bits(br, 1);
 
-				kr = krp >> LSGR;
-			}
+			UINT16 code = 0;
+			if (!rfx_rlgr_decode_gr(br, &krp, &code))
+				break;
 
 			/* update k, kp params */
-
-			if (kp > DN_GR)
-				kp -= DN_GR;
-			else
-				kp = 0;
-
-			k = kp >> LSGR;
+			k = UpdateParam(&kp, -DN_GR);
 
 			/* compute magnitude from code */
-
+			INT16 mag = WINPR_ASSERTING_INT_CAST(int16_t, code + 1);
 			if (sign)
-				mag = WINPR_ASSERTING_INT_CAST(int16_t, (code + 1)) * -1;
-			else
-				mag = WINPR_ASSERTING_INT_CAST(int16_t, code + 1);
+				mag *= -1;
 
 			/* write to output stream */
+			const size_t left = WINPR_ASSERTING_INT_CAST(size_t, pEnd - pOutput);
+			if (run > left)
+				run = left;
 
-			offset = WINPR_ASSERTING_INT_CAST(size_t, (pOutput)-pDstData);
-			size = run;
+			ZeroMemory(pOutput, run * sizeof(INT16));
+			pOutput += run;
 
-			if ((offset + size) > rDstSize)
-				size = WINPR_ASSERTING_INT_CAST(size_t, DstSize) - offset;
-
-			if (size)
-			{
-				ZeroMemory(pOutput, size * sizeof(INT16));
-				pOutput += size;
-			}
-
-			if ((pOutput - pDstData) < DstSize)
-			{
-				*pOutput = mag;
-				pOutput++;
-			}
+			if (pOutput < pEnd)
+				*pOutput++ = mag;
 		}
 		else
 		{
 			/* Golomb-Rice (GR) Mode */
-
-			/* count number of leading 1s */
-
-			cnt = lzcnt_s(~(bs->accumulator));
-
-			size_t nbits = BitStream_GetRemainingLength(bs);
-
-			if (cnt > nbits)
-				cnt = nbits;
-
-			vk = WINPR_ASSERTING_INT_CAST(uint32_t, cnt);
-
-			while ((cnt == 32) && (BitStream_GetRemainingLength(bs) > 0))
-			{
-				BitStream_Shift32(bs);
-
-				cnt = lzcnt_s(~(bs->accumulator));
-
-				nbits = BitStream_GetRemainingLength(bs);
-
-				if (cnt > nbits)
-					cnt = nbits;
-
-				WINPR_ASSERT(cnt + vk <= UINT32_MAX);
-				vk += WINPR_ASSERTING_INT_CAST(uint32_t, cnt);
-			}
-
-			BitStream_Shift(bs, (vk % 32));
-
-			if (BitStream_GetRemainingLength(bs) < 1)
+			UINT16 code = 0;
+			if (!rfx_rlgr_decode_gr(br, &krp, &code))
 				break;
 
-			BitStream_Shift(bs, 1);
-
-			/* next kr bits contain code remainder */
-
-			if (BitStream_GetRemainingLength(bs) < kr)
-				break;
-
-			bs->mask = ((1u << kr) - 1);
-			if (kr > 0)
-				code = (UINT16)((bs->accumulator >> (32 - kr)) & bs->mask);
-			else
-				code = 0;
-			BitStream_Shift(bs, kr);
-
-			/* add (vk << kr) to code */
-
-			code |= (vk << kr);
-
-			if (!vk)
-			{
-				/* update kr, krp params */
-
-				if (krp > 2)
-					krp -= 2;
-				else
-					krp = 0;
-
-				kr = (krp >> LSGR) & UINT32_MAX;
-			}
-			else if (vk != 1)
-			{
-				/* update kr, krp params */
-
-				krp += vk;
-
-				if (krp > KPMAX)
-					krp = KPMAX;
-
-				kr = krp >> LSGR;
-			}
-
 			if (mode == RLGR1) /* RLGR1 */
 			{
+				/* update k, kp params */
 				if (!code)
-				{
-					/* update k, kp params */
-
-					kp += UQ_GR;
-
-					if (kp > KPMAX)
-						kp = KPMAX;
-
-					k = kp >> LSGR;
-
-					mag = 0;
-				}
+					k = UpdateParam(&kp, UQ_GR);
 				else
-				{
-					/* update k, kp params */
-
-					if (kp > DQ_GR)
-						kp -= DQ_GR;
-					else
-						kp = 0;
-
-					k = kp >> LSGR;
-
-					/*
-					 * code = 2 * mag - sign
-					 * sign + code = 2 * mag
-					 */
-
-					if (code & 1)
-						mag = WINPR_ASSERTING_INT_CAST(INT16, (code + 1) >> 1) * -1;
-					else
-						mag = WINPR_ASSERTING_INT_CAST(INT16, code >> 1);
-				}
+					k = UpdateParam(&kp, -DQ_GR);
 
-				if ((pOutput - pDstData) < DstSize)
-				{
-					*pOutput = mag;
-					pOutput++;
-				}
+				/*
+				 * code = 2 * mag - sign
+				 * sign + code = 2 * mag
+				 */
+				*pOutput++ = GetMagSign(code);
 			}
 			else if (mode == RLGR3) /* RLGR3 */
 			{
-				nIdx = 0;
+				const UINT32 nIdx = GetMinBits(code);
 
-				if (code)
-				{
-					mag = WINPR_ASSERTING_INT_CAST(int16_t, code);
-					nIdx = 32 - lzcnt_s(WINPR_ASSERTING_INT_CAST(uint32_t, mag));
-				}
-
-				if (BitStream_GetRemainingLength(bs) < nIdx)
+				if (!rfx_bitreader_check(br, nIdx))
 					break;
 
-				bs->mask = ((1u << nIdx) - 1);
-				if (nIdx > 0)
-					val1 = ((bs->accumulator >> (32 - nIdx)) & bs->mask);
-				else
-					val1 = 0;
-				BitStream_Shift(bs, nIdx);
-
-				val2 = code - val1;
+				const UINT32 val1 = rfx_bitreader_get_bits(br, nIdx);
+				const UINT32 val2 = code - val1;
 
+				/* update k, kp params */
 				if (val1 && val2)
-				{
-					/* update k, kp params */
-
-					if (kp > 2 * DQ_GR)
-						kp -= (2 * DQ_GR);
-					else
-						kp = 0;
-
-					k = kp >> LSGR;
-				}
+					k = UpdateParam(&kp, -2 * DQ_GR);
 				else if (!val1 && !val2)
-				{
-					/* update k, kp params */
-
-					kp += (2 * UQ_GR);
-
-					if (kp > KPMAX)
-						kp = KPMAX;
-
-					k = kp >> LSGR;
-				}
-
-				if (val1 & 1)
-					mag = WINPR_ASSERTING_INT_CAST(int16_t, (val1 + 1) >> 1) * -1;
-				else
-					mag = WINPR_ASSERTING_INT_CAST(int16_t, val1 >> 1);
-
-				if ((pOutput - pDstData) < DstSize)
-				{
-					*pOutput = mag;
-					pOutput++;
-				}
+					k = UpdateParam(&kp, 2 * UQ_GR);
 
-				if (val2 & 1)
-					mag = WINPR_ASSERTING_INT_CAST(int16_t, (val2 + 1) >> 1) * -1;
-				else
-					mag = WINPR_ASSERTING_INT_CAST(int16_t, val2 >> 1);
+				*pOutput++ = GetMagSign(val1);
 
-				if ((pOutput - pDstData) < DstSize)
-				{
-					*pOutput = WINPR_ASSERTING_INT_CAST(int16_t, mag);
-					pOutput++;
-				}
+				if (pOutput < pEnd)
+					*pOutput++ = GetMagSign(val2);
 			}
 		}
 	}
 
-	offset = WINPR_ASSERTING_INT_CAST(size_t, (pOutput - pDstData));
-
-	if (offset < rDstSize)
-	{
-		size = WINPR_ASSERTING_INT_CAST(size_t, DstSize) - offset;
-		ZeroMemory(pOutput, size * 2);
-		pOutput += size;
-	}
-
-	offset = WINPR_ASSERTING_INT_CAST(size_t, (pOutput - pDstData));
-
-	if ((DstSize < 0) || (offset != (size_t)DstSize))
-		return -1;
+	if (pOutput < pEnd)
+		ZeroMemory(pOutput, WINPR_ASSERTING_INT_CAST(size_t, pEnd - pOutput) * sizeof(INT16));
 
 	return 1;
 }
@@ -603,16 +388,7 @@ int rfx_rlgr_decode(RLGR_MODE mode, const BYTE* WINPR_RESTRICT pSrcData, UINT32
 #define OutputBits(numBits, bitPattern) rfx_bitstream_put_bits(bs, bitPattern, numBits)
 
 /* Emit a bit (0 or 1), count number of times, to the output bitstream */
-static inline void OutputBit(RFX_BITSTREAM* bs, uint32_t count, UINT8 bit)
-{
-	UINT16 _b = ((bit) ? 0xFFFF : 0);
-	const uint32_t rem = count % 16;
-	for (uint32_t x = 0; x < count - rem; x += 16)
-		rfx_bitstream_put_bits(bs, _b, 16);
-
-	if (rem > 0)
-		rfx_bitstream_put_bits(bs, _b, rem);
-}
+#define OutputBit(count, bit) rfx_bitstream_put_bit(bs, count, bit)
 
 /* Converts the input value to (2 * abs(input) - sign(input)), where sign(input) = (input < 0 ? 1 :
  * 0) and returns it */
@@ -626,20 +402,26 @@ static inline UINT32 Get2MagSign(INT32 input)
 /* Outputs the Golomb/Rice encoding of a non-negative integer */
 #define CodeGR(krp, val) rfx_rlgr_code_gr(bs, krp, val)
 
-static void rfx_rlgr_code_gr(RFX_BITSTREAM* bs, uint32_t* krp, UINT32 val)
+static void rfx_rlgr_code_gr(RFX_BITSTREAM* WINPR_RESTRICT bs, uint32_t* krp, UINT32 val)
 {
-	uint32_t kr = *krp >> LSGR;
+	const uint32_t kr = *krp >> LSGR;
 
 	/* unary part of GR code */
-
 	const uint32_t vk = val >> kr;
-	OutputBit(bs, vk, 1);
-	OutputBit(bs, 1, 0);
 
 	/* remainder part of GR code, if needed */
-	if (kr)
+	const UINT64 remainder = val & ((1ull << kr) - 1ull);
+
+	if (vk + kr < 32)
+	{
+		/* vk 1s, the terminating 0 and the remainder fit a single write */
+		OutputBits(vk + 1 + kr, (((1ull << vk) - 1ull) << (kr + 1)) | remainder);
+	}
+	else
 	{
-		OutputBits(kr, val & ((1u << kr) - 1));
+		OutputBit(vk, 1);
+		OutputBit(1, 0);
+		OutputBits(kr, remainder);
 	}
 
 	/* update krp, only if it is not equal to 1 */
@@ -656,10 +438,11 @@ static void rfx_rlgr_code_gr(RFX_BITSTREAM* bs, uint32_t* krp, UINT32 val)
 int rfx_rlgr_encode(RLGR_MODE mode, const INT16* WINPR_RESTRICT data, UINT32 data_size,
                     BYTE* WINPR_RESTRICT buffer, UINT32 buffer_size)
 {
-	RFX_BITSTREAM* bs = (RFX_BITSTREAM*)winpr_aligned_calloc(1, sizeof(RFX_BITSTREAM), 32);
+	RFX_BITSTREAM s_bs = WINPR_C_ARRAY_INIT;
+	RFX_BITSTREAM* bs = &s_bs;
 
-	if (!bs)
-		return 0;
+	if (!InitOnceExecuteOnce(&rfx_rlgr_init_once, rfx_rlgr_init, nullptr, nullptr))
+		return -1;
 
 	rfx_bitstream_attach(bs, buffer, buffer_size);
 
@@ -676,13 +459,11 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* WINPR_RESTRICT data, UINT32 dat
 		if (k)
 		{
 			uint32_t numZeros = 0;
-			uint32_t runmax = 0;
-			BYTE sign = 0;
+			uint32_t zeroBits = 0;
 
 			/* RUN-LENGTH MODE */
 
 			/* collect the run of zeros in the input stream */
-			numZeros = 0;
 			GetNextInput(input);
 			while (input == 0 && data_size > 0)
 			{
@@ -690,31 +471,38 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* WINPR_RESTRICT data, UINT32 dat
 				GetNextInput(input);
 			}
 
+			/* A run at the end of the data has no nonzero value, the terminating value written
+			 * below lies past the end and is dropped by the decoder */
+			if (input == 0)
+				numZeros++;
+
 			// emit output zeros
-			runmax = 1u << k;
-			while (numZeros >= runmax)
+			uint32_t runmax = 1u << k;
+			while ((numZeros >= runmax) && (kp < KPMAX))
 			{
-				OutputBit(bs, 1, 0); /* output a zero bit */
+				zeroBits++; /* output a zero bit */
 				numZeros -= runmax;
 				k = UpdateParam(&kp, UP_GR); /* update kp, k */
 				runmax = 1u << k;
 			}
 
-			/* output a 1 to terminate runs */
-			OutputBit(bs, 1, 1);
-
-			/* output the remaining run length using k bits */
-			OutputBits(k, numZeros);
-
-			/* note: when we reach here and the last byte being encoded is 0, we still
-			   need to output the last two bits, otherwise mstsc will crash */
+			/* k does not change any more, output the remaining full runs at once */
+			zeroBits += numZeros >> k;
+			numZeros &= runmax - 1;
+			OutputBit(zeroBits, 0);
 
 			/* encode the nonzero value using GR coding */
 			const UINT32 mag =
 			    (UINT32)(input < 0 ? -input : input); /* absolute value of input coefficient */
-			sign = (input < 0 ? 1 : 0);         /* sign of input coefficient */
+			const UINT32 sign = (input < 0 ? 1 : 0);  /* sign of input coefficient */
+
+			/* output a 1 to terminate runs, the remaining run length using k bits and the sign
+			 * bit */
+			OutputBits(k + 2, (1ull << (k + 1)) | (numZeros << 1) | sign);
+
+			/* note: when we reach here and the last byte being encoded is 0, we still
+			   need to output the last two bits, otherwise mstsc will crash */
 
-			OutputBit(bs, 1, sign);          /* output the sign bit */
 			CodeGR(&krp, mag ? mag - 1 : 0); /* output GR code for (mag - 1) */
 
 			k = UpdateParam(&kp, -DN_GR);
@@ -751,7 +539,6 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* WINPR_RESTRICT data, UINT32 dat
 				UINT32 twoMs1 = 0;
 				UINT32 twoMs2 = 0;
 				UINT32 sum2Ms = 0;
-				UINT32 nIdx = 0;
 
 				/* RLGR3 variant */
 
@@ -767,8 +554,7 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* WINPR_RESTRICT data, UINT32 dat
 				CodeGR(&krp, sum2Ms);
 
 				/* encode binary representation of the first input (twoMs1). */
-				GetMinBits(sum2Ms, nIdx);
-				OutputBits(nIdx, twoMs1);
+				OutputBits(GetMinBits(sum2Ms), twoMs1);
 
 				/* update k,kp for the two input values */
 
@@ -785,8 +571,7 @@ int rfx_rlgr_encode(RLGR_MODE mode, const INT16* WINPR_RESTRICT data, UINT32 dat
 	}
 
 	rfx_bitstream_flush(bs);
-	uint32_t processed_size = rfx_bitstream_get_processed_bytes(bs);
-	winpr_aligned_free(bs);
+	const uint32_t processed_size = rfx_bitstream_get_processed_bytes(bs);
 
 	return WINPR_ASSERTING_INT_CAST(int, processed_size);
 }
@@ -0,0 +1,113 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RDP6 Planar Codec - SSE2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+
+#include "../planar.h"
+#include "planar_sse2.h"
+
+#include "../../core/simd.h"
+#include "../../primitives/sse/prim_avxsse.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+
+#include <freerdp/log.h>
+
+static void planar_split_row_sse2(const BYTE* WINPR_RESTRICT src, UINT32 width,
+                                  const PLANAR_PIXEL_LAYOUT* WINPR_RESTRICT layout,
+                                  BYTE* WINPR_RESTRICT planes[4])
+{
+	WINPR_ASSERT(layout);
+
+	const __m128i opaque = _mm_set1_epi8((char)0xFF);
+	UINT32 x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		/* Byte transpose of 16 pixels, c[i] holds byte i of every pixel */
+		const __m128i p0 = LOAD_SI128(&src[4ULL * x]);
+		const __m128i p1 = LOAD_SI128(&src[4ULL * x + 16]);
+		const __m128i p2 = LOAD_SI128(&src[4ULL * x + 32]);
+		const __m128i p3 = LOAD_SI128(&src[4ULL * x + 48]);
+		const __m128i t0 = _mm_unpacklo_epi8(p0, p1);
+		const __m128i t1 = _mm_unpackhi_epi8(p0, p1);
+		const __m128i t2 = _mm_unpacklo_epi8(p2, p3);
+		const __m128i t3 = _mm_unpackhi_epi8(p2, p3);
+		const __m128i u0 = _mm_unpacklo_epi8(t0, t1);
+		const __m128i u1 = _mm_unpackhi_epi8(t0, t1);
+		const __m128i u2 = _mm_unpacklo_epi8(t2, t3);
+		const __m128i u3 = _mm_unpackhi_epi8(t2, t3);
+		const __m128i v0 = _mm_unpacklo_epi8(u0, u1);
+		const __m128i v1 = _mm_unpackhi_epi8(u0, u1);
+		const __m128i v2 = _mm_unpacklo_epi8(u2, u3);
+		const __m128i v3 = _mm_unpackhi_epi8(u2, u3);
+		const __m128i c[4] = { _mm_unpacklo_epi64(v0, v2), _mm_unpackhi_epi64(v0, v2),
+			                   _mm_unpacklo_epi64(v1, v3), _mm_unpackhi_epi64(v1, v3) };
+
+		STORE_SI128(&planes[0][x], layout->alpha ? c[layout->offset[0]] : opaque);
+		STORE_SI128(&planes[1][x], c[layout->offset[1]]);
+		STORE_SI128(&planes[2][x], c[layout->offset[2]]);
+		STORE_SI128(&planes[3][x], c[layout->offset[3]]);
+	}
+
+	for (; x < width; x++)
+	{
+		const BYTE* pixel = &src[4ULL * x];
+		planes[0][x] = layout->alpha ? pixel[layout->offset[0]] : 0xFF;
+		planes[1][x] = pixel[layout->offset[1]];
+		planes[2][x] = pixel[layout->offset[2]];
+		planes[3][x] = pixel[layout->offset[3]];
+	}
+}
+
+static void planar_delta_row_sse2(const BYTE* WINPR_RESTRICT row,
+                                  const BYTE* WINPR_RESTRICT prevRow, UINT32 width,
+                                  BYTE* WINPR_RESTRICT dst)
+{
+	const __m128i zero = _mm_setzero_si128();
+	UINT32 x = 0;
+
+	for (; x + 16 <= width; x += 16)
+	{
+		/* (d << 1) ^ (d >> 7) is the sign magnitude encoding of the wrapped difference */
+		const __m128i delta = _mm_sub_epi8(LOAD_SI128(&row[x]), LOAD_SI128(&prevRow[x]));
+		const __m128i sign = _mm_cmpgt_epi8(zero, delta);
+		STORE_SI128(&dst[x], _mm_xor_si128(_mm_add_epi8(delta, delta), sign));
+	}
+
+	for (; x < width; x++)
+	{
+		const BYTE delta = (BYTE)(row[x] - prevRow[x]);
+		dst[x] = (BYTE)((delta << 1) ^ ((delta & 0x80) ? 0xFF : 0x00));
+	}
+}
+#endif
+
+void planar_init_sse2_int(BITMAP_PLANAR_CONTEXT* WINPR_RESTRICT context)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "SSE2/SSE3 optimizations");
+	context->splitRow = planar_split_row_sse2;
+	context->deltaRow = planar_delta_row_sse2;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or SSE2 intrinsics not available");
+	WINPR_UNUSED(context);
+#endif
+}
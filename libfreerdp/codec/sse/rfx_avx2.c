@@ -0,0 +1,515 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX Codec Library - AVX2 Optimizations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/assert.h>
+#include <winpr/cast.h>
+#include <winpr/platform.h>
+#include <freerdp/config.h>
+
+#include "../rfx_types.h"
+#include "rfx_avx2.h"
+#include "../rfx_quantization.h"
+
+#include "../../core/simd.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED) && defined(WITH_AVX2)
+#include <immintrin.h>
+
+#ifdef _MSC_VER
+#define __attribute__(...)
+#endif
+
+#ifndef __clang__
+#define ATTRIBUTES __gnu_inline__, __always_inline__, __artificial__
+#else
+#define ATTRIBUTES __gnu_inline__, __always_inline__
+#endif
+
+static inline __m256i __attribute__((ATTRIBUTES)) LOAD_SI256(const INT16* WINPR_RESTRICT ptr)
+{
+	return _mm256_loadu_si256((const __m256i*)ptr);
+}
+
+static inline void __attribute__((ATTRIBUTES)) STORE_SI256(INT16* WINPR_RESTRICT ptr, __m256i val)
+{
+	_mm256_storeu_si256((__m256i*)ptr, val);
+}
+
+/* Returns v[1..15], next[0] */
+static inline __m256i __attribute__((ATTRIBUTES)) mm256_shift_next_epi16(__m256i v, __m256i next)
+{
+	const __m256i t = _mm256_permute2x128_si256(v, next, 0x21);
+	return _mm256_alignr_epi8(t, v, 2);
+}
+
+/* Returns v[1..15], v[15] */
+static inline __m256i __attribute__((ATTRIBUTES)) mm256_shift_next_mirror_epi16(__m256i v)
+{
+	const __m256i t = _mm256_permute2x128_si256(v, v, 0x11);
+	return mm256_shift_next_epi16(v, _mm256_srli_si256(t, 14));
+}
+
+/* Returns prev[15], v[0..14] */
+static inline __m256i __attribute__((ATTRIBUTES)) mm256_shift_prev_epi16(__m256i v, __m256i prev)
+{
+	const __m256i t = _mm256_permute2x128_si256(prev, v, 0x21);
+	return _mm256_alignr_epi8(v, t, 14);
+}
+
+/* Returns v[0], v[0..14] */
+static inline __m256i __attribute__((ATTRIBUTES)) mm256_shift_prev_mirror_epi16(__m256i v)
+{
+	const __m256i t = _mm256_permute2x128_si256(v, v, 0x00);
+	return mm256_shift_prev_epi16(v, _mm256_slli_si256(t, 14));
+}
+
+/* Splits 16 elements into the even ones in the low and the odd ones in the high lane */
+static inline __m256i __attribute__((ATTRIBUTES)) mm256_deinterleave_epi16(__m256i v)
+{
+	const __m256i mask = _mm256_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15, 0,
+	                                      1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+	return _mm256_permute4x64_epi64(_mm256_shuffle_epi8(v, mask), 0xD8);
+}
+
+/* Loads 32 elements and splits them into the even and the odd ones */
+static inline void __attribute__((ATTRIBUTES))
+mm256_load_deinterleave_epi16(const INT16* WINPR_RESTRICT src, __m256i* even, __m256i* odd)
+{
+	const __m256i a = mm256_deinterleave_epi16(LOAD_SI256(src));
+	const __m256i b = mm256_deinterleave_epi16(LOAD_SI256(src + 16));
+	*even = _mm256_permute2x128_si256(a, b, 0x20);
+	*odd = _mm256_permute2x128_si256(a, b, 0x31);
+}
+
+/* Stores 16 even and 16 odd elements interleaved */
+static inline void __attribute__((ATTRIBUTES))
+mm256_store_interleave_epi16(INT16* WINPR_RESTRICT dst, __m256i even, __m256i odd)
+{
+	const __m256i lo = _mm256_unpacklo_epi16(even, odd);
+	const __m256i hi = _mm256_unpackhi_epi16(even, odd);
+	STORE_SI256(dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+	STORE_SI256(dst + 16, _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+static inline void __attribute__((ATTRIBUTES))
+rfx_quantization_decode_block_avx2(INT16* WINPR_RESTRICT buffer, const size_t buffer_size,
+                                   const UINT32 factor)
+{
+	if (factor == 0)
+		return;
+
+	const __m128i shift = _mm_cvtsi32_si128(WINPR_ASSERTING_INT_CAST(int, factor));
+
+	for (size_t x = 0; x < buffer_size; x += 16)
+	{
+		const __m256i a = LOAD_SI256(&buffer[x]);
+		STORE_SI256(&buffer[x], _mm256_sll_epi16(a, shift));
+	}
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL rfx_quantization_decode_avx2(INT16* WINPR_RESTRICT buffer,
+                                         const UINT32* WINPR_RESTRICT quantVals,
+                                         size_t nrQuantValues)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(quantVals);
+	WINPR_ASSERT(nrQuantValues == NR_QUANT_VALUES);
+
+	for (size_t x = 0; x < nrQuantValues; x++)
+	{
+		const UINT32 val = quantVals[x];
+		if (val < 1)
+			return FALSE;
+	}
+
+	rfx_quantization_decode_block_avx2(&buffer[0], 1024, quantVals[8] - 1);    /* HL1 */
+	rfx_quantization_decode_block_avx2(&buffer[1024], 1024, quantVals[7] - 1); /* LH1 */
+	rfx_quantization_decode_block_avx2(&buffer[2048], 1024, quantVals[9] - 1); /* HH1 */
+	rfx_quantization_decode_block_avx2(&buffer[3072], 256, quantVals[5] - 1);  /* HL2 */
+	rfx_quantization_decode_block_avx2(&buffer[3328], 256, quantVals[4] - 1);  /* LH2 */
+	rfx_quantization_decode_block_avx2(&buffer[3584], 256, quantVals[6] - 1);  /* HH2 */
+	rfx_quantization_decode_block_avx2(&buffer[3840], 64, quantVals[2] - 1);   /* HL3 */
+	rfx_quantization_decode_block_avx2(&buffer[3904], 64, quantVals[1] - 1);   /* LH3 */
+	rfx_quantization_decode_block_avx2(&buffer[3968], 64, quantVals[3] - 1);   /* HH3 */
+	rfx_quantization_decode_block_avx2(&buffer[4032], 64, quantVals[0] - 1);   /* LL3 */
+	return TRUE;
+}
+
+/* Quantizes a sub-band and removes the << 5 scaling of the RGB->YCbCr phase in the same pass */
+static inline void __attribute__((ATTRIBUTES))
+rfx_quantization_encode_block_avx2(INT16* WINPR_RESTRICT buffer, const size_t buffer_size,
+                                   const UINT32 factor)
+{
+	const __m128i shift = _mm_cvtsi32_si128(WINPR_ASSERTING_INT_CAST(int, factor));
+	const __m256i round = _mm256_set1_epi16(1 << 4);
+	__m256i half = _mm256_setzero_si256();
+
+	if (factor > 0)
+		half = _mm256_set1_epi16(WINPR_ASSERTING_INT_CAST(INT16, 1 << (factor - 1)));
+
+	for (size_t x = 0; x < buffer_size; x += 16)
+	{
+		__m256i a = LOAD_SI256(&buffer[x]);
+		a = _mm256_sra_epi16(_mm256_add_epi16(a, half), shift);
+		a = _mm256_srai_epi16(_mm256_add_epi16(a, round), 5);
+		STORE_SI256(&buffer[x], a);
+	}
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL rfx_quantization_encode_avx2(INT16* WINPR_RESTRICT buffer,
+                                         const UINT32* WINPR_RESTRICT quantization_values,
+                                         size_t quantVals)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(quantization_values);
+	WINPR_ASSERT(quantVals == NR_QUANT_VALUES);
+
+	for (size_t x = 0; x < quantVals; x++)
+	{
+		const UINT32 val = quantization_values[x];
+		if (val < 6)
+			return FALSE;
+		if (val > INT16_MAX)
+			return FALSE;
+	}
+
+	rfx_quantization_encode_block_avx2(buffer, 1024, quantization_values[8] - 6);        /* HL1 */
+	rfx_quantization_encode_block_avx2(buffer + 1024, 1024, quantization_values[7] - 6); /* LH1 */
+	rfx_quantization_encode_block_avx2(buffer + 2048, 1024, quantization_values[9] - 6); /* HH1 */
+	rfx_quantization_encode_block_avx2(buffer + 3072, 256, quantization_values[5] - 6);  /* HL2 */
+	rfx_quantization_encode_block_avx2(buffer + 3328, 256, quantization_values[4] - 6);  /* LH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3584, 256, quantization_values[6] - 6);  /* HH2 */
+	rfx_quantization_encode_block_avx2(buffer + 3840, 64, quantization_values[2] - 6);   /* HL3 */
+	rfx_quantization_encode_block_avx2(buffer + 3904, 64, quantization_values[1] - 6);   /* LH3 */
+	rfx_quantization_encode_block_avx2(buffer + 3968, 64, quantization_values[3] - 6);   /* HH3 */
+	rfx_quantization_encode_block_avx2(buffer + 4032, 64, quantization_values[0] - 6);   /* LL3 */
+	return TRUE;
+}
+
+static inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_horiz_8_avx2(const INT16* WINPR_RESTRICT l, const INT16* WINPR_RESTRICT h,
+                                     INT16* WINPR_RESTRICT dst)
+{
+	const __m128i one = _mm_set1_epi16(1);
+
+	for (size_t y = 0; y < 8; y++)
+	{
+		/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+		const __m128i l_n = _mm_loadu_si128((const __m128i*)l);
+		const __m128i h_n = _mm_loadu_si128((const __m128i*)h);
+		const __m128i h_n_m = _mm_alignr_epi8(h_n, _mm_slli_si128(h_n, 14), 14);
+		__m128i tmp_n = _mm_add_epi16(_mm_add_epi16(h_n, h_n_m), one);
+		const __m128i even = _mm_sub_epi16(l_n, _mm_srai_epi16(tmp_n, 1));
+
+		/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+		const __m128i even_p = _mm_alignr_epi8(_mm_srli_si128(even, 14), even, 2);
+		tmp_n = _mm_srai_epi16(_mm_add_epi16(even, even_p), 1);
+		const __m128i odd = _mm_add_epi16(tmp_n, _mm_slli_epi16(h_n, 1));
+		_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(even, odd));
+		_mm_storeu_si128((__m128i*)(dst + 8), _mm_unpackhi_epi16(even, odd));
+		l += 8;
+		h += 8;
+		dst += 16;
+	}
+}
+
+static inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_horiz_avx2(const INT16* WINPR_RESTRICT l, const INT16* WINPR_RESTRICT h,
+                                   INT16* WINPR_RESTRICT dst, size_t subband_width)
+{
+	const __m256i one = _mm256_set1_epi16(1);
+	const size_t count = subband_width / 16;
+	__m256i even[2];
+	__m256i h_n[2];
+
+	WINPR_ASSERT(count <= ARRAYSIZE(even));
+
+	for (size_t y = 0; y < subband_width; y++)
+	{
+		/* Even coefficients */
+		for (size_t x = 0; x < count; x++)
+		{
+			/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+			const __m256i l_n = LOAD_SI256(&l[16 * x]);
+			h_n[x] = LOAD_SI256(&h[16 * x]);
+			const __m256i h_n_m = (x == 0) ? mm256_shift_prev_mirror_epi16(h_n[x])
+			                               : mm256_shift_prev_epi16(h_n[x], h_n[x - 1]);
+			const __m256i tmp_n = _mm256_add_epi16(_mm256_add_epi16(h_n[x], h_n_m), one);
+			even[x] = _mm256_sub_epi16(l_n, _mm256_srai_epi16(tmp_n, 1));
+		}
+
+		/* Odd coefficients */
+		for (size_t x = 0; x < count; x++)
+		{
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+			const __m256i even_p = (x + 1 == count)
+			                           ? mm256_shift_next_mirror_epi16(even[x])
+			                           : mm256_shift_next_epi16(even[x], even[x + 1]);
+			const __m256i tmp_n = _mm256_srai_epi16(_mm256_add_epi16(even[x], even_p), 1);
+			const __m256i odd = _mm256_add_epi16(tmp_n, _mm256_slli_epi16(h_n[x], 1));
+			mm256_store_interleave_epi16(&dst[32 * x], even[x], odd);
+		}
+
+		l += subband_width;
+		h += subband_width;
+		dst += 2 * subband_width;
+	}
+}
+
+static inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_vert_avx2(const INT16* WINPR_RESTRICT l, const INT16* WINPR_RESTRICT h,
+                                  INT16* WINPR_RESTRICT dst, size_t subband_width)
+{
+	const __m256i one = _mm256_set1_epi16(1);
+	const size_t total_width = subband_width + subband_width;
+
+	for (size_t x = 0; x < total_width; x += 16)
+	{
+		/* dst[2n] = l[n] - ((h[n-1] + h[n] + 1) >> 1); */
+		__m256i h_n = LOAD_SI256(&h[x]);
+		__m256i tmp_n = _mm256_add_epi16(_mm256_add_epi16(h_n, h_n), one);
+		__m256i even = _mm256_sub_epi16(LOAD_SI256(&l[x]), _mm256_srai_epi16(tmp_n, 1));
+		STORE_SI256(&dst[x], even);
+
+		for (size_t n = 0; n < subband_width; n++)
+		{
+			__m256i even_p = even;
+			__m256i h_n_p = h_n;
+
+			if (n + 1 < subband_width)
+			{
+				const size_t offset = (n + 1) * total_width + x;
+				h_n_p = LOAD_SI256(&h[offset]);
+				tmp_n = _mm256_add_epi16(_mm256_add_epi16(h_n, h_n_p), one);
+				even_p = _mm256_sub_epi16(LOAD_SI256(&l[offset]), _mm256_srai_epi16(tmp_n, 1));
+				STORE_SI256(&dst[(2 * n + 2) * total_width + x], even_p);
+			}
+
+			/* dst[2n + 1] = (h[n] << 1) + ((dst[2n] + dst[2n + 2]) >> 1); */
+			tmp_n = _mm256_srai_epi16(_mm256_add_epi16(even, even_p), 1);
+			const __m256i odd = _mm256_add_epi16(tmp_n, _mm256_slli_epi16(h_n, 1));
+			STORE_SI256(&dst[(2 * n + 1) * total_width + x], odd);
+			even = even_p;
+			h_n = h_n_p;
+		}
+	}
+}
+
+static inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_decode_block_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT idwt,
+                             size_t subband_width)
+{
+	/* Inverse DWT in horizontal direction, results in 2 sub-bands in L, H order in tmp buffer idwt.
+	 */
+	/* The 4 sub-bands are stored in HL(0), LH(1), HH(2), LL(3) order. */
+	/* The lower part L uses LL(3) and HL(0). */
+	/* The higher part H uses LH(1) and HH(2). */
+	const INT16* ll = buffer + 3ULL * subband_width * subband_width;
+	const INT16* hl = buffer;
+	INT16* l_dst = idwt;
+	const INT16* lh = buffer + 1ULL * subband_width * subband_width;
+	const INT16* hh = buffer + 2ULL * subband_width * subband_width;
+	INT16* h_dst = idwt + 2ULL * subband_width * subband_width;
+
+	if (subband_width == 8)
+	{
+		rfx_dwt_2d_decode_block_horiz_8_avx2(ll, hl, l_dst);
+		rfx_dwt_2d_decode_block_horiz_8_avx2(lh, hh, h_dst);
+	}
+	else
+	{
+		rfx_dwt_2d_decode_block_horiz_avx2(ll, hl, l_dst, subband_width);
+		rfx_dwt_2d_decode_block_horiz_avx2(lh, hh, h_dst, subband_width);
+	}
+
+	/* Inverse DWT in vertical direction, results are stored in original buffer. */
+	rfx_dwt_2d_decode_block_vert_avx2(l_dst, h_dst, buffer, subband_width);
+}
+
+static void rfx_dwt_2d_decode_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt_buffer)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(dwt_buffer);
+
+	rfx_dwt_2d_decode_block_avx2(&buffer[3840], dwt_buffer, 8);
+	rfx_dwt_2d_decode_block_avx2(&buffer[3072], dwt_buffer, 16);
+	rfx_dwt_2d_decode_block_avx2(&buffer[0], dwt_buffer, 32);
+}
+
+static inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_vert_avx2(const INT16* WINPR_RESTRICT src, INT16* WINPR_RESTRICT l,
+                                  INT16* WINPR_RESTRICT h, size_t subband_width)
+{
+	const size_t total_width = subband_width << 1;
+
+	for (size_t n = 0; n < subband_width; n++)
+	{
+		for (size_t x = 0; x < total_width; x += 16)
+		{
+			const __m256i src_2n = LOAD_SI256(&src[x]);
+			const __m256i src_2n_1 = LOAD_SI256(&src[total_width + x]);
+			__m256i src_2n_2 = src_2n;
+
+			if (n < subband_width - 1)
+				src_2n_2 = LOAD_SI256(&src[2 * total_width + x]);
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+			__m256i h_n = _mm256_srai_epi16(_mm256_add_epi16(src_2n, src_2n_2), 1);
+			h_n = _mm256_srai_epi16(_mm256_sub_epi16(src_2n_1, h_n), 1);
+			STORE_SI256(&h[x], h_n);
+
+			__m256i h_n_m = h_n;
+			if (n != 0)
+				h_n_m = LOAD_SI256(&h[x] - total_width);
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+			const __m256i l_n = _mm256_srai_epi16(_mm256_add_epi16(h_n_m, h_n), 1);
+			STORE_SI256(&l[x], _mm256_add_epi16(l_n, src_2n));
+		}
+
+		src += 2 * total_width;
+		l += total_width;
+		h += total_width;
+	}
+}
+
+static inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_horiz_8_avx2(const INT16* WINPR_RESTRICT src, INT16* WINPR_RESTRICT l,
+                                     INT16* WINPR_RESTRICT h)
+{
+	for (size_t y = 0; y < 8; y++)
+	{
+		const __m256i v = mm256_deinterleave_epi16(LOAD_SI256(src));
+		const __m128i src_2n = _mm256_castsi256_si128(v);
+		const __m128i src_2n_1 = _mm256_extracti128_si256(v, 1);
+		const __m128i src_2n_2 = _mm_alignr_epi8(_mm_srli_si128(src_2n, 14), src_2n, 2);
+
+		/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+		__m128i h_n = _mm_srai_epi16(_mm_add_epi16(src_2n, src_2n_2), 1);
+		h_n = _mm_srai_epi16(_mm_sub_epi16(src_2n_1, h_n), 1);
+		_mm_storeu_si128((__m128i*)h, h_n);
+
+		/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+		const __m128i h_n_m = _mm_alignr_epi8(h_n, _mm_slli_si128(h_n, 14), 14);
+		const __m128i l_n = _mm_srai_epi16(_mm_add_epi16(h_n_m, h_n), 1);
+		_mm_storeu_si128((__m128i*)l, _mm_add_epi16(l_n, src_2n));
+		src += 16;
+		l += 8;
+		h += 8;
+	}
+}
+
+static inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_horiz_avx2(const INT16* WINPR_RESTRICT src, INT16* WINPR_RESTRICT l,
+                                   INT16* WINPR_RESTRICT h, size_t subband_width)
+{
+	const size_t count = subband_width / 16;
+	__m256i src_2n[2];
+	__m256i src_2n_1[2];
+
+	WINPR_ASSERT(count <= ARRAYSIZE(src_2n));
+
+	for (size_t y = 0; y < subband_width; y++)
+	{
+		for (size_t x = 0; x < count; x++)
+			mm256_load_deinterleave_epi16(&src[32 * x], &src_2n[x], &src_2n_1[x]);
+
+		__m256i h_n_p = _mm256_setzero_si256();
+		for (size_t x = 0; x < count; x++)
+		{
+			const __m256i src_2n_2 = (x + 1 == count)
+			                             ? mm256_shift_next_mirror_epi16(src_2n[x])
+			                             : mm256_shift_next_epi16(src_2n[x], src_2n[x + 1]);
+
+			/* h[n] = (src[2n + 1] - ((src[2n] + src[2n + 2]) >> 1)) >> 1 */
+			__m256i h_n = _mm256_srai_epi16(_mm256_add_epi16(src_2n[x], src_2n_2), 1);
+			h_n = _mm256_srai_epi16(_mm256_sub_epi16(src_2n_1[x], h_n), 1);
+			STORE_SI256(&h[16 * x], h_n);
+
+			/* l[n] = src[2n] + ((h[n - 1] + h[n]) >> 1) */
+			const __m256i h_n_m = (x == 0) ? mm256_shift_prev_mirror_epi16(h_n)
+			                               : mm256_shift_prev_epi16(h_n, h_n_p);
+			const __m256i l_n = _mm256_srai_epi16(_mm256_add_epi16(h_n_m, h_n), 1);
+			STORE_SI256(&l[16 * x], _mm256_add_epi16(l_n, src_2n[x]));
+			h_n_p = h_n;
+		}
+
+		src += 2 * subband_width;
+		l += subband_width;
+		h += subband_width;
+	}
+}
+
+static inline void __attribute__((ATTRIBUTES))
+rfx_dwt_2d_encode_block_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt,
+                             size_t subband_width)
+{
+	/* DWT in vertical direction, results in 2 sub-bands in L, H order in tmp buffer dwt. */
+	INT16* l_src = dwt;
+	INT16* h_src = dwt + 2ULL * subband_width * subband_width;
+	rfx_dwt_2d_encode_block_vert_avx2(buffer, l_src, h_src, subband_width);
+	/* DWT in horizontal direction, results in 4 sub-bands in HL(0), LH(1), HH(2), LL(3) order,
+	 * stored in original buffer. */
+	/* The lower part L generates LL(3) and HL(0). */
+	/* The higher part H generates LH(1) and HH(2). */
+	INT16* ll = buffer + 3ULL * subband_width * subband_width;
+	INT16* hl = buffer;
+	INT16* lh = buffer + 1ULL * subband_width * subband_width;
+	INT16* hh = buffer + 2ULL * subband_width * subband_width;
+
+	if (subband_width == 8)
+	{
+		rfx_dwt_2d_encode_block_horiz_8_avx2(l_src, ll, hl);
+		rfx_dwt_2d_encode_block_horiz_8_avx2(h_src, lh, hh);
+	}
+	else
+	{
+		rfx_dwt_2d_encode_block_horiz_avx2(l_src, ll, hl, subband_width);
+		rfx_dwt_2d_encode_block_horiz_avx2(h_src, lh, hh, subband_width);
+	}
+}
+
+static void rfx_dwt_2d_encode_avx2(INT16* WINPR_RESTRICT buffer, INT16* WINPR_RESTRICT dwt_buffer)
+{
+	WINPR_ASSERT(buffer);
+	WINPR_ASSERT(dwt_buffer);
+
+	rfx_dwt_2d_encode_block_avx2(buffer, dwt_buffer, 32);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3072, dwt_buffer, 16);
+	rfx_dwt_2d_encode_block_avx2(buffer + 3840, dwt_buffer, 8);
+}
+#endif
+
+void rfx_init_avx2_int(RFX_CONTEXT* WINPR_RESTRICT context)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED) && defined(WITH_AVX2)
+	WLog_VRB(PRIM_TAG, "AVX2 optimizations");
+	PROFILER_RENAME(context->priv->prof_rfx_quantization_decode, "rfx_quantization_decode_avx2")
+	PROFILER_RENAME(context->priv->prof_rfx_quantization_encode, "rfx_quantization_encode_avx2")
+	PROFILER_RENAME(context->priv->prof_rfx_dwt_2d_decode, "rfx_dwt_2d_decode_avx2")
+	PROFILER_RENAME(context->priv->prof_rfx_dwt_2d_encode, "rfx_dwt_2d_encode_avx2")
+	context->quantization_decode = rfx_quantization_decode_avx2;
+	context->quantization_encode = rfx_quantization_encode_avx2;
+	context->dwt_2d_decode = rfx_dwt_2d_decode_avx2;
+	context->dwt_2d_encode = rfx_dwt_2d_encode_avx2;
+#else
+	WINPR_UNUSED(context);
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or WITH_AVX2 or AVX2 intrinsics not available");
+#endif
+}
@@ -0,0 +1,145 @@
+#include <winpr/crt.h>
+#include <winpr/crypto.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/codec/bulk.h>
+#include <freerdp/metrics.h>
+
+#include "../bulk.h"
+
+#define TEST_UPDATE_TYPE 4 /* FASTPATH_UPDATETYPE_SURFCMDS */
+
+static BOOL fill_text(BYTE* data, size_t size)
+{
+	static const char text[] = "No man is an island entire of itself; every man is a piece of the "
+	                           "continent, a part of the main; ";
+
+	for (size_t x = 0; x < size; x++)
+		data[x] = (BYTE)text[x % (sizeof(text) - 1)];
+	return TRUE;
+}
+
+static BOOL fill_random(BYTE* data, size_t size)
+{
+	return winpr_RAND(data, size) >= 0;
+}
+
+static BOOL test_roundtrip(rdpBulk* send, rdpBulk* recv, UINT32 level, const BYTE* data,
+                           UINT32 size, BOOL expectCompressed)
+{
+	const BYTE* pDstData = nullptr;
+	UINT32 DstSize = 0;
+	UINT32 Flags = 0;
+
+	if (bulk_compress(send, TEST_UPDATE_TYPE, data, size, &pDstData, &DstSize, &Flags) < 0)
+		return FALSE;
+
+	const BOOL compressed = (Flags & PACKET_COMPRESSED) != 0;
+	if (compressed != expectCompressed)
+	{
+		printf("size %" PRIu32 ": compressed=%d, expected %d\n", size, compressed,
+		       expectCompressed);
+		return FALSE;
+	}
+
+	const BYTE* pData = nullptr;
+	UINT32 DataSize = 0;
+	if (bulk_decompress(recv, pDstData, DstSize, &pData, &DataSize, Flags | level) < 0)
+		return FALSE;
+
+	return (DataSize == size) && (memcmp(pData, data, size) == 0);
+}
+
+static BOOL test_bulk_level(UINT32 level)
+{
+	BOOL rc = FALSE;
+	BYTE text[4000] = WINPR_C_ARRAY_INIT;
+	BYTE random[4000] = WINPR_C_ARRAY_INIT;
+	rdpContext context = WINPR_C_ARRAY_INIT;
+	rdpBulk* send = nullptr;
+	rdpBulk* recv = nullptr;
+
+	context.settings = freerdp_settings_new(0);
+	context.metrics = metrics_new(&context);
+	if (!context.settings || !context.metrics)
+		goto fail;
+
+	if (!freerdp_settings_set_uint32(context.settings, FreeRDP_CompressionLevel, level) ||
+	    !freerdp_settings_set_bool(context.settings, FreeRDP_CompressionAdaptive, TRUE))
+		goto fail;
+
+	send = bulk_new(&context);
+	recv = bulk_new(&context);
+	if (!send || !recv)
+		goto fail;
+
+	if (!fill_text(text, sizeof(text)) || !fill_random(random, sizeof(random)))
+		goto fail;
+
+	/* Incompressible payloads bypass the compressor, but must not break the history */
+	if (!test_roundtrip(send, recv, level, text, sizeof(text), TRUE) ||
+	    !test_roundtrip(send, recv, level, random, sizeof(random), FALSE) ||
+	    !test_roundtrip(send, recv, level, text, sizeof(text), TRUE))
+		goto fail;
+
+	{
+		const rdpCompressionMetrics* compressor = &context.metrics->Compressors[level];
+		const rdpCompressionMetrics* update = &context.metrics->UpdateTypes[TEST_UPDATE_TYPE];
+		if ((compressor->Packets != 3) || (compressor->SkippedPackets != 1) ||
+		    (update->Packets != 3) || (update->UncompressedBytes != 3 * sizeof(text)))
+		{
+			printf("level %" PRIu32 ": unexpected metrics %" PRIu64 "/%" PRIu64 "\n", level,
+			       compressor->Packets, compressor->SkippedPackets);
+			goto fail;
+		}
+
+		const double ratio = metrics_compression_ratio(compressor);
+		if ((ratio <= 0.0) || (ratio >= 1.0))
+		{
+			printf("level %" PRIu32 ": unexpected ratio %f\n", level, ratio);
+			goto fail;
+		}
+	}
+
+	/* Without the adaptive mode everything is handed to the compressor */
+	if (!freerdp_settings_set_bool(context.settings, FreeRDP_CompressionAdaptive, FALSE))
+		goto fail;
+	{
+		const BYTE* pDstData = nullptr;
+		UINT32 DstSize = 0;
+		UINT32 Flags = 0;
+		if (bulk_compress(send, TEST_UPDATE_TYPE, random, sizeof(random), &pDstData, &DstSize,
+		                  &Flags) < 0)
+			goto fail;
+		if (context.metrics->Compressors[level].SkippedPackets != 1)
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	bulk_free(send);
+	bulk_free(recv);
+	metrics_free(context.metrics);
+	freerdp_settings_free(context.settings);
+	return rc;
+}
+
+int TestFreeRDPCodecBulk(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	const UINT32 levels[] = { PACKET_COMPR_TYPE_8K, PACKET_COMPR_TYPE_64K, PACKET_COMPR_TYPE_RDP6,
+		                      PACKET_COMPR_TYPE_RDP61 };
+
+	for (size_t x = 0; x < ARRAYSIZE(levels); x++)
+	{
+		if (!test_bulk_level(levels[x]))
+		{
+			printf("bulk compression level %" PRIu32 " failed\n", levels[x]);
+			return -1;
+		}
+	}
+
+	return 0;
+}
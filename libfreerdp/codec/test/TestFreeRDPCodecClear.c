@@ -1,6 +1,7 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/platform.h>
+#include <winpr/crypto.h>
 
 #include <freerdp/codec/clear.h>
 
@@ -68,6 +69,252 @@ fail:
 	return rc;
 }
 
+typedef enum
+{
+	TEST_CLEAR_FLAT,
+	TEST_CLEAR_TEXT,
+	TEST_CLEAR_PALETTE,
+	TEST_CLEAR_NOISE,
+	TEST_CLEAR_MIXED
+} TEST_CLEAR_IMAGE;
+
+static void test_ClearFillText(BYTE* data, UINT32 width, UINT32 height, UINT32 x0, UINT32 y0,
+                               UINT32 w, UINT32 h)
+{
+	const UINT32 colors[] = { 0xFFFFFFFF, 0xFF000000, 0xFF404040, 0xFFA0A0A0, 0xFF0000C0 };
+
+	for (UINT32 y = y0; (y < y0 + h) && (y < height); y++)
+	{
+		for (UINT32 x = x0; (x < x0 + w) && (x < width); x++)
+		{
+			const UINT32 line = (y - y0) % 16;
+			const UINT32 glyph = ((x - x0) / 7) * 31 + ((y - y0) / 16) * 17;
+			UINT32 color = colors[0];
+
+			/* glyph like strokes on a white background, repeated every few characters */
+			if ((line > 2) && (line < 13) && ((x - x0) % 7 < 5))
+			{
+				const UINT32 bits = (glyph % 23) * 2654435761u;
+				if ((bits >> (((x - x0) % 7) * 5 + (line % 5))) & 1)
+					color = colors[1 + ((glyph + line) % 4)];
+			}
+
+			winpr_Data_Write_UINT32(&data[4ull * (1ull * y * width + x)], color);
+		}
+	}
+}
+
+static BOOL test_ClearCreateImage(BYTE* data, UINT32 width, UINT32 height, TEST_CLEAR_IMAGE type)
+{
+	switch (type)
+	{
+		case TEST_CLEAR_FLAT:
+			for (size_t i = 0; i < 1ull * width * height; i++)
+				winpr_Data_Write_UINT32(&data[4ull * i], 0xFF336699);
+			break;
+
+		case TEST_CLEAR_TEXT:
+			test_ClearFillText(data, width, height, 0, 0, width, height);
+			break;
+
+		case TEST_CLEAR_PALETTE:
+			for (UINT32 y = 0; y < height; y++)
+			{
+				for (UINT32 x = 0; x < width; x++)
+				{
+					const UINT32 index = ((x / 3) + (y / 5) * 7) % 40;
+					const UINT32 color = 0xFF000000 | (index * 0x060402);
+					winpr_Data_Write_UINT32(&data[4ull * (1ull * y * width + x)], color);
+				}
+			}
+			break;
+
+		case TEST_CLEAR_NOISE:
+			if (winpr_RAND(data, 4ull * width * height) < 0)
+				return FALSE;
+			break;
+
+		case TEST_CLEAR_MIXED:
+			if (!test_ClearCreateImage(data, width, height, TEST_CLEAR_FLAT))
+				return FALSE;
+			test_ClearFillText(data, width, height, 10, 5, width / 2, height / 2);
+			if (winpr_RAND(&data[4ull * (1ull * (height / 2) * width)],
+			               4ull * (height / 4) * width) < 0)
+				return FALSE;
+			break;
+
+		default:
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL test_ClearCompare(const BYTE* src, const BYTE* dst, UINT32 width, UINT32 height,
+                              UINT32 tolerance)
+{
+	for (size_t i = 0; i < 4ull * width * height; i++)
+	{
+		/* alpha is not transported */
+		if ((i % 4) == 3)
+			continue;
+
+		const UINT32 diff = (src[i] > dst[i]) ? src[i] - dst[i] : dst[i] - src[i];
+
+		if (diff > tolerance)
+		{
+			(void)printf("clear round trip mismatch at pixel %" PRIuz ": %02" PRIx8
+			             " != %02" PRIx8 "\n",
+			             i / 4, src[i], dst[i]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL test_ClearRoundTrip(CLEAR_CONTEXT* encoder, CLEAR_CONTEXT* decoder, const BYTE* src,
+                                UINT32 width, UINT32 height, UINT32 tolerance, size_t* pSize)
+{
+	BOOL rc = FALSE;
+	BYTE* dst = calloc(4ull * width, height);
+	wStream* s = Stream_New(nullptr, 1024);
+
+	if (!dst || !s)
+		goto fail;
+
+	if (!clear_compose_message(encoder, s, src, PIXEL_FORMAT_BGRX32, 0, width, height))
+	{
+		(void)printf("clear_compose_message %" PRIu32 "x%" PRIu32 " failed\n", width, height);
+		goto fail;
+	}
+
+	const INT32 status =
+	    clear_decompress(decoder, Stream_Buffer(s), (UINT32)Stream_GetPosition(s), width, height,
+	                     dst, PIXEL_FORMAT_BGRX32, 4 * width, 0, 0, width, height, nullptr);
+
+	if (status != 0)
+	{
+		(void)printf("clear_decompress %" PRIu32 "x%" PRIu32 " failed with %" PRId32 "\n",
+		             width, height, status);
+		goto fail;
+	}
+
+	if (!test_ClearCompare(src, dst, width, height, tolerance))
+	{
+
+		goto fail;
+	}
+
+	if (pSize)
+		*pSize = Stream_GetPosition(s);
+	rc = TRUE;
+fail:
+	Stream_Free(s, TRUE);
+	free(dst);
+	return rc;
+}
+
+static BOOL test_ClearCompressRoundTrip(void)
+{
+	BOOL rc = FALSE;
+	const UINT32 sizes[][2] = { { 1, 1 }, { 7, 15 }, { 64, 32 }, { 203, 77 }, { 320, 240 } };
+	const TEST_CLEAR_IMAGE types[] = { TEST_CLEAR_FLAT, TEST_CLEAR_TEXT, TEST_CLEAR_PALETTE,
+		                               TEST_CLEAR_NOISE, TEST_CLEAR_MIXED };
+	CLEAR_CONTEXT* encoder = clear_context_new(TRUE);
+	CLEAR_CONTEXT* decoder = clear_context_new(FALSE);
+	BYTE* src = nullptr;
+
+	if (!encoder || !decoder)
+		goto fail;
+
+	for (size_t i = 0; i < ARRAYSIZE(sizes); i++)
+	{
+		const UINT32 width = sizes[i][0];
+		const UINT32 height = sizes[i][1];
+
+		free(src);
+		src = calloc(4ull * width, height);
+		if (!src)
+			goto fail;
+
+		for (size_t j = 0; j < ARRAYSIZE(types); j++)
+		{
+			/* NSCodec is used for photo like content and is not lossless */
+			const BOOL lossy = (types[j] == TEST_CLEAR_NOISE) || (types[j] == TEST_CLEAR_MIXED);
+			size_t size = 0;
+
+			if (!test_ClearCreateImage(src, width, height, types[j]))
+				goto fail;
+
+			if (!test_ClearRoundTrip(encoder, decoder, src, width, height, lossy ? 2 : 0, &size))
+			{
+				(void)printf("clear round trip type %" PRIuz " failed\n", j);
+				goto fail;
+			}
+
+			(void)printf("clear round trip type %" PRIuz " %" PRIu32 "x%" PRIu32
+			             " compressed to %" PRIuz " bytes\n",
+			             j, width, height, size);
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(src);
+	clear_context_free(encoder);
+	clear_context_free(decoder);
+	return rc;
+}
+
+static BOOL test_ClearCompressCache(void)
+{
+	BOOL rc = FALSE;
+	const UINT32 width = 256;
+	const UINT32 height = 64;
+	size_t first = 0;
+	size_t second = 0;
+	CLEAR_CONTEXT* encoder = clear_context_new(TRUE);
+	CLEAR_CONTEXT* decoder = clear_context_new(FALSE);
+	BYTE* src = calloc(4ull * width, height);
+
+	if (!encoder || !decoder || !src)
+		goto fail;
+
+	if (!test_ClearCreateImage(src, width, height, TEST_CLEAR_TEXT))
+		goto fail;
+
+	if (!test_ClearRoundTrip(encoder, decoder, src, width, height, 0, &first))
+		goto fail;
+
+	/* The second frame must be served from the vBar cache */
+	if (!test_ClearRoundTrip(encoder, decoder, src, width, height, 0, &second))
+		goto fail;
+
+	if (second >= first / 4)
+	{
+		(void)printf("clear vBar cache not used: %" PRIuz " >= %" PRIuz " / 4\n", second, first);
+		goto fail;
+	}
+
+	/* A decompressor context must not be usable for compression */
+	{
+		wStream* s = Stream_New(nullptr, 64);
+		const BOOL res = clear_compose_message(decoder, s, src, PIXEL_FORMAT_BGRX32, 0, width,
+		                                       height);
+		Stream_Free(s, TRUE);
+		if (res)
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	free(src);
+	clear_context_free(encoder);
+	clear_context_free(decoder);
+	return rc;
+}
+
 int TestFreeRDPCodecClear(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -87,5 +334,11 @@ int TestFreeRDPCodecClear(int argc, char* argv[])
 	if (!test_ClearDecompressExample(4, 7, 15, TEST_CLEAR_EXAMPLE_4, sizeof(TEST_CLEAR_EXAMPLE_4)))
 		return -1;
 
+	if (!test_ClearCompressRoundTrip())
+		return -1;
+
+	if (!test_ClearCompressCache())
+		return -1;
+
 	return 0;
 }
@@ -13,6 +13,7 @@
 #include <freerdp/codec/planar.h>
 
 #include "TestFreeRDPHelpers.h"
+#include "../planar.h"
 
 static const UINT32 colorFormatList[] = {
 	PIXEL_FORMAT_RGB15,  PIXEL_FORMAT_BGR15,  PIXEL_FORMAT_RGB16,  PIXEL_FORMAT_BGR16,
@@ -282,6 +283,125 @@ fail:
 	return rc;
 }
 
+static BOOL DecompressPlanarThreaded(BITMAP_PLANAR_CONTEXT* single, BITMAP_PLANAR_CONTEXT* threaded,
+                                     const BYTE* data, UINT32 size, UINT32 width, UINT32 height,
+                                     UINT32 format, BOOL vFlip)
+{
+	BOOL rc = FALSE;
+	const size_t stride = 1ull * width * FreeRDPGetBytesPerPixel(format);
+	BYTE* a = calloc(height, stride);
+	BYTE* b = calloc(height, stride);
+
+	if (!a || !b)
+		goto fail;
+
+	if (!freerdp_bitmap_decompress_planar(single, data, size, width, height, a, format,
+	                                      (UINT32)stride, 0, 0, width, height, vFlip))
+		goto fail;
+
+	if (!freerdp_bitmap_decompress_planar(threaded, data, size, width, height, b, format,
+	                                      (UINT32)stride, 0, 0, width, height, vFlip))
+		goto fail;
+
+	rc = memcmp(a, b, stride * height) == 0;
+fail:
+	free(a);
+	free(b);
+	return rc;
+}
+
+/* The banded encoder and decoder must produce the same output as the single threaded code */
+static BOOL TestPlanarThreaded(DWORD planarFlags)
+{
+	BOOL rc = FALSE;
+	const UINT32 width = 333;
+	const UINT32 height = 517;
+	const UINT32 format = PIXEL_FORMAT_BGRA32;
+	const size_t stride = 4ull * width;
+	UINT32 singleSize = 0;
+	UINT32 threadedSize = 0;
+	BYTE* singleData = nullptr;
+	BYTE* threadedData = nullptr;
+	BYTE* decoded = calloc(height, stride);
+	BYTE* bmp = calloc(height, stride);
+	BITMAP_PLANAR_CONTEXT* single = freerdp_bitmap_planar_context_new_ex(
+	    planarFlags, width, height, THREADING_FLAGS_DISABLE_THREADS);
+	BITMAP_PLANAR_CONTEXT* threaded =
+	    freerdp_bitmap_planar_context_new_ex(planarFlags, width, height, 0);
+
+	(void)printf("%s [0x%08" PRIx32 "]: ", __func__, planarFlags);
+	if (!bmp || !decoded || !single || !threaded)
+		goto fail;
+
+	/* Run the banded code paths even on single core machines */
+	threaded->useThreads = TRUE;
+	threaded->maxBands = 7;
+
+	if (winpr_RAND(bmp, stride * height) < 0)
+		goto fail;
+
+	/* Flat areas with glyph like runs, the upper left corner stays noise */
+	for (size_t y = 0; y < height; y++)
+	{
+		for (size_t x = 0; x < width; x++)
+		{
+			BYTE* pixel = &bmp[y * stride + 4 * x];
+			if (planarFlags & PLANAR_FORMAT_HEADER_NA)
+				pixel[3] = 0xFF;
+			if ((x < 64) && (y < 64))
+				continue;
+
+			const BOOL glyph = ((x * 7) ^ (y * 3)) % 11 < 3;
+			pixel[0] = glyph ? 0x20 : 0xF0;
+			pixel[1] = glyph ? 0x30 : 0xF0;
+			pixel[2] = glyph ? 0x40 : 0xF0;
+			if (!(planarFlags & PLANAR_FORMAT_HEADER_NA))
+				pixel[3] = (BYTE)(0xFF - (y % 3));
+		}
+	}
+
+	singleData = freerdp_bitmap_compress_planar(single, bmp, format, width, height,
+	                                            (UINT32)stride, nullptr, &singleSize);
+	threadedData = freerdp_bitmap_compress_planar(threaded, bmp, format, width, height,
+	                                              (UINT32)stride, nullptr, &threadedSize);
+	if (!singleData || !threadedData)
+		goto fail;
+
+	if ((singleSize != threadedSize) || (memcmp(singleData, threadedData, singleSize) != 0))
+		goto fail;
+
+	for (UINT32 x = 0; x < colorFormatCount; x++)
+	{
+		if (!DecompressPlanarThreaded(single, threaded, singleData, singleSize, width, height,
+		                              colorFormatList[x], FALSE))
+			goto fail;
+		if (!DecompressPlanarThreaded(single, threaded, singleData, singleSize, width, height,
+		                              colorFormatList[x], TRUE))
+			goto fail;
+	}
+
+	/* The encoder stores the image bottom up */
+	if (!freerdp_bitmap_decompress_planar(threaded, threadedData, threadedSize, width, height,
+	                                      decoded, format, (UINT32)stride, 0, 0, width, height,
+	                                      TRUE))
+		goto fail;
+
+	if (!CompareBitmap(decoded, format, bmp, format, width, height))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	free(bmp);
+	free(decoded);
+	free(singleData);
+	free(threadedData);
+	freerdp_bitmap_planar_context_free(single);
+	freerdp_bitmap_planar_context_free(threaded);
+	(void)printf("%s\n", rc ? "SUCCESS" : "FAILED");
+	(void)fflush(stdout);
+	return rc;
+}
+
 static UINT32 prand(UINT32 max)
 {
 	UINT32 tmp = 0;
@@ -415,6 +535,15 @@ int TestFreeRDPCodecPlanar(int argc, char* argv[])
 	if (!FuzzPlanar())
 		goto fail;
 
+	if (!TestPlanarThreaded(PLANAR_FORMAT_HEADER_NA | PLANAR_FORMAT_HEADER_RLE))
+		goto fail;
+
+	if (!TestPlanarThreaded(PLANAR_FORMAT_HEADER_RLE))
+		goto fail;
+
+	if (!TestPlanarThreaded(PLANAR_FORMAT_HEADER_NA))
+		goto fail;
+
 	for (UINT32 x = 0; x < colorFormatCount; x++)
 	{
 		if (!TestPlanar(colorFormatList[x]))
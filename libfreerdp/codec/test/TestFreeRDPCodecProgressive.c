@@ -1116,6 +1116,129 @@ fail:
 	return res;
 }
 
+static UINT64 test_image_error(const wImage* image, const BYTE* data, UINT32 format)
+{
+	UINT64 error = 0;
+
+	for (size_t y = 0; y < image->height; y++)
+	{
+		const BYTE* orig = &image->data[y * image->scanline];
+		const BYTE* dec = &data[y * image->scanline];
+		for (size_t x = 0; x < image->width; x++)
+		{
+			BYTE ar = 0;
+			BYTE ag = 0;
+			BYTE ab = 0;
+			BYTE br = 0;
+			BYTE bg = 0;
+			BYTE bb = 0;
+			FreeRDPSplitColor(FreeRDPReadColor(&orig[x * 4], format), format, &ar, &ag, &ab,
+			                  nullptr, nullptr);
+			FreeRDPSplitColor(FreeRDPReadColor(&dec[x * 4], format), format, &br, &bg, &bb,
+			                  nullptr, nullptr);
+			error += (UINT64)abs(ar - br) + (UINT64)abs(ag - bg) + (UINT64)abs(ab - bb);
+		}
+	}
+	return error;
+}
+
+static BOOL test_encode_decode_upgrade(const char* path, UINT32 passes)
+{
+	BOOL res = FALSE;
+	int rc = 0;
+	BYTE* resultData = nullptr;
+	BYTE* dstData = nullptr;
+	UINT32 dstSize = 0;
+	UINT32 upgrades = 0;
+	UINT64 lastError = UINT64_MAX;
+	const UINT32 ColorFormat = PIXEL_FORMAT_BGRX32;
+	REGION16 invalidRegion = WINPR_C_ARRAY_INIT;
+	wImage* image = winpr_image_new();
+	char* name = GetCombinedPath(path, "progressive.bmp");
+	PROGRESSIVE_CONTEXT* progressiveEnc = progressive_context_new(TRUE);
+	PROGRESSIVE_CONTEXT* progressiveDec = progressive_context_new(FALSE);
+
+	region16_init(&invalidRegion);
+	if (!image || !name || !progressiveEnc || !progressiveDec)
+		goto fail;
+
+	if (!progressive_compress_set_passes(progressiveEnc, passes))
+		goto fail;
+
+	rc = winpr_image_read(image, name);
+	if (rc <= 0)
+		goto fail;
+
+	resultData = calloc(image->scanline, image->height);
+	if (!resultData)
+		goto fail;
+
+	rc = progressive_create_surface_context(progressiveDec, 0, image->width, image->height);
+	if (rc <= 0)
+		goto fail;
+
+	rc = progressive_compress(progressiveEnc, image->data, image->scanline * image->height,
+	                          ColorFormat, image->width, image->height, image->scanline, nullptr,
+	                          &dstData, &dstSize);
+	if (rc < 0)
+		goto fail;
+
+	/* Every upgrade pass has to improve the decoded image until full quality is reached */
+	do
+	{
+		rc = progressive_decompress(progressiveDec, dstData, dstSize, resultData, ColorFormat,
+		                            image->scanline, 0, 0, &invalidRegion, 0, 0);
+		if (rc < 0)
+			goto fail;
+
+		const UINT64 error = test_image_error(image, resultData, ColorFormat);
+		if (error > lastError)
+		{
+			printf("upgrade %" PRIu32 " increased error %" PRIu64 " -> %" PRIu64 "\n", upgrades,
+			       lastError, error);
+			goto fail;
+		}
+		lastError = error;
+
+		/* a small budget to exercise partial upgrades */
+		rc = progressive_compress_upgrade(progressiveEnc, 0x4000, &dstData, &dstSize);
+		if (rc < 0)
+			goto fail;
+		if (rc > 0)
+			upgrades++;
+	} while (rc > 0);
+
+	if ((passes > 1) && (upgrades < passes - 1))
+		goto fail;
+
+	for (size_t y = 0; y < image->height; y++)
+	{
+		const BYTE* orig = &image->data[y * image->scanline];
+		const BYTE* dec = &resultData[y * image->scanline];
+		for (size_t x = 0; x < image->width; x++)
+		{
+			const DWORD a = FreeRDPReadColor(&orig[x * 4], ColorFormat);
+			const DWORD b = FreeRDPReadColor(&dec[x * 4], ColorFormat);
+			if (!colordiff(ColorFormat, a, b))
+			{
+				printf("passes %" PRIu32 " [%" PRIuz ":%" PRIuz "] %08X != %08X\n", passes, x, y,
+				       a, b);
+				goto fail;
+			}
+		}
+	}
+
+	res = TRUE;
+fail:
+	region16_uninit(&invalidRegion);
+	progressive_context_free(progressiveEnc);
+	progressive_context_free(progressiveDec);
+	winpr_image_free(image, TRUE);
+	free(resultData);
+	free(name);
+	return res;
+}
+
 static BOOL readUInt(FILE* fp, const char* prefix, const char* postfix, UINT32* pval)
 {
 	WINPR_ASSERT(fp);
@@ -1495,6 +1618,11 @@ int TestFreeRDPCodecProgressive(int argc, char* argv[])
 		    */
 		if (!test_encode_decode(ms_sample_path))
 			goto fail;
+		for (UINT32 passes = 1; passes <= 4; passes++)
+		{
+			if (!test_encode_decode_upgrade(ms_sample_path, passes))
+				goto fail;
+		}
 		rc = 0;
 	}
 
@@ -842,6 +842,75 @@ static BOOL fuzzyCompareImage(const UINT32* crefImage, const BYTE* img, size_t n
 	return TRUE;
 }
 
+/* The quantization values set on an encoder are returned and used for encoding */
+static BOOL test_quantization(void)
+{
+	BOOL rc = FALSE;
+	UINT32 quant[10] = WINPR_C_ARRAY_INIT;
+	const UINT32 defaults[10] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 };
+	const UINT32 coarse[10] = { 15, 14, 13, 12, 11, 10, 9, 8, 7, 6 };
+	UINT32 invalid[10] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 16 };
+	BYTE* data = calloc(IMG_WIDTH * IMG_HEIGHT, FORMAT_SIZE);
+	RFX_CONTEXT* decoder = rfx_context_new(FALSE);
+	RFX_CONTEXT* encoder = rfx_context_new(TRUE);
+	RFX_MESSAGE* message = nullptr;
+
+	if (!data || !decoder || !encoder)
+		goto fail;
+
+	/* Only encoders have quantization values to set */
+	if (rfx_context_get_quantization(decoder, quant, ARRAYSIZE(quant)) ||
+	    rfx_context_set_quantization(decoder, coarse, ARRAYSIZE(coarse)))
+		goto fail;
+
+	if (!rfx_context_get_quantization(encoder, quant, ARRAYSIZE(quant)) ||
+	    (memcmp(quant, defaults, sizeof(quant)) != 0))
+		goto fail;
+
+	if (!rfx_context_set_quantization(encoder, coarse, ARRAYSIZE(coarse)) ||
+	    !rfx_context_get_quantization(encoder, quant, ARRAYSIZE(quant)) ||
+	    (memcmp(quant, coarse, sizeof(quant)) != 0))
+		goto fail;
+
+	/* Values out of range and short arrays are rejected and keep the previous values */
+	if (rfx_context_set_quantization(encoder, invalid, ARRAYSIZE(invalid)))
+		goto fail;
+	invalid[9] = 5;
+	if (rfx_context_set_quantization(encoder, invalid, ARRAYSIZE(invalid)) ||
+	    rfx_context_set_quantization(encoder, defaults, ARRAYSIZE(defaults) - 1) ||
+	    rfx_context_get_quantization(encoder, quant, ARRAYSIZE(quant) - 1))
+		goto fail;
+	if (!rfx_context_get_quantization(encoder, quant, ARRAYSIZE(quant)) ||
+	    (memcmp(quant, coarse, sizeof(quant)) != 0))
+		goto fail;
+
+	rfx_context_set_pixel_format(encoder, FORMAT);
+	if (!rfx_context_reset(encoder, IMG_WIDTH, IMG_HEIGHT))
+		goto fail;
+
+	{
+		const RFX_RECT rect = { 0, 0, IMG_WIDTH, IMG_HEIGHT };
+		message = rfx_encode_message(encoder, &rect, 1, data, IMG_WIDTH, IMG_HEIGHT,
+		                             IMG_WIDTH * FORMAT_SIZE);
+		if (!message)
+			goto fail;
+
+		UINT16 numQuant = 0;
+		const UINT32* quantVals = rfx_message_get_quants(message, &numQuant);
+		if ((numQuant != 1) || !quantVals || (memcmp(quantVals, coarse, sizeof(coarse)) != 0))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	if (message)
+		rfx_message_free(encoder, message);
+	rfx_context_free(encoder);
+	rfx_context_free(decoder);
+	free(data);
+	return rc;
+}
+
 int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 {
 	int rc = -1;
@@ -877,6 +946,12 @@ int TestFreeRDPCodecRemoteFX(int argc, char* argv[])
 	if (!fuzzyCompareImage(srefImage, dest, IMG_WIDTH * IMG_HEIGHT))
 		goto fail;
 
+	if (!test_quantization())
+	{
+		(void)fprintf(stderr, "RemoteFX quantization failed\n");
+		goto fail;
+	}
+
 	rc = 0;
 fail:
 	region16_uninit(&region);
@@ -0,0 +1,207 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX SIMD DWT and quantization test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/codec/rfx.h>
+
+#include "../rfx_types.h"
+#include "../rfx_dwt.h"
+#include "../rfx_quantization.h"
+#include "../sse/rfx_sse2.h"
+#include "../sse/rfx_avx2.h"
+#include "../neon/rfx_neon.h"
+
+#define TEST_COEFFICIENTS 4096
+#define TEST_DWT_SIZE (3 * TEST_COEFFICIENTS)
+#define TEST_RUNS 16
+
+static const UINT32 test_quant[][10] = { { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 },
+	                                     { 15, 15, 15, 15, 15, 15, 15, 15, 15, 15 },
+	                                     { 6, 6, 6, 6, 6, 6, 6, 6, 6, 6 },
+	                                     { 9, 8, 10, 11, 7, 12, 13, 6, 14, 15 } };
+
+typedef struct
+{
+	const char* name;
+	RFX_CONTEXT* context;
+} test_impl;
+
+static UINT32 test_random(UINT32* state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+/* Coefficients of color converted pixels use 11.5 fixed point, every run mixes flat areas,
+ * edges and noise */
+static void test_fill(INT16* data, UINT32 run, INT32 range)
+{
+	UINT32 state = 0xC0FFEEu + run;
+
+	for (size_t x = 0; x < TEST_COEFFICIENTS; x++)
+	{
+		const size_t row = x / 64;
+		const size_t column = x % 64;
+		INT32 value = 0;
+
+		switch ((run + row / 16) % 4)
+		{
+			case 0:
+				value = (INT32)(test_random(&state) % (2u * (UINT32)range + 1)) - range;
+				break;
+			case 1:
+				value = ((column / 8 + row / 8) % 2) ? range - 1 : -range;
+				break;
+			case 2:
+				value = (INT32)((column * 37 + row * 11) % (2u * (UINT32)range)) - range;
+				break;
+			default:
+				value = (INT32)(run * 13) - range / 2;
+				break;
+		}
+
+		data[x] = (INT16)value;
+	}
+}
+
+static RFX_CONTEXT* test_context_new(void (*init)(RFX_CONTEXT* WINPR_RESTRICT context))
+{
+	RFX_CONTEXT* context = rfx_context_new(TRUE);
+	if (!context)
+		return nullptr;
+
+	context->quantization_decode = rfx_quantization_decode;
+	context->quantization_encode = rfx_quantization_encode;
+	context->dwt_2d_decode = rfx_dwt_2d_decode;
+	context->dwt_2d_encode = rfx_dwt_2d_encode;
+	if (init)
+		init(context);
+	return context;
+}
+
+static BOOL test_compare(const char* stage, const test_impl* impl, const test_impl* reference,
+                         UINT32 run, const INT16* data, const INT16* expect)
+{
+	for (size_t x = 0; x < TEST_COEFFICIENTS; x++)
+	{
+		if (data[x] != expect[x])
+		{
+			(void)fprintf(stderr,
+			              "%s run %" PRIu32 ": %s differs from %s at %" PRIuz ": %" PRId16
+			              " != %" PRId16 "\n",
+			              stage, run, impl->name, reference->name, x, data[x], expect[x]);
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/* Runs every stage with \b impl and \b reference on the same input, the results must match */
+static BOOL test_impl_compare(const test_impl* impl, const test_impl* reference)
+{
+	BOOL rc = FALSE;
+	INT16* a = winpr_aligned_calloc(TEST_COEFFICIENTS, sizeof(INT16), 32);
+	INT16* b = winpr_aligned_calloc(TEST_COEFFICIENTS, sizeof(INT16), 32);
+	INT16* dwt = winpr_aligned_calloc(TEST_DWT_SIZE, sizeof(INT16), 32);
+
+	if (!a || !b || !dwt)
+		goto fail;
+
+	for (UINT32 run = 0; run < TEST_RUNS; run++)
+	{
+		const UINT32* quant = test_quant[run % ARRAYSIZE(test_quant)];
+
+		/* Encoder: DWT, then quantization */
+		test_fill(a, run, 4096);
+		memcpy(b, a, TEST_COEFFICIENTS * sizeof(INT16));
+		impl->context->dwt_2d_encode(a, dwt);
+		reference->context->dwt_2d_encode(b, dwt);
+		if (!test_compare("dwt_2d_encode", impl, reference, run, a, b))
+			goto fail;
+
+		if (!impl->context->quantization_encode(a, quant, ARRAYSIZE(test_quant[0])) ||
+		    !reference->context->quantization_encode(b, quant, ARRAYSIZE(test_quant[0])))
+			goto fail;
+		if (!test_compare("quantization_encode", impl, reference, run, a, b))
+			goto fail;
+
+		/* Decoder: quantization, then DWT */
+		if (!impl->context->quantization_decode(a, quant, ARRAYSIZE(test_quant[0])) ||
+		    !reference->context->quantization_decode(b, quant, ARRAYSIZE(test_quant[0])))
+			goto fail;
+		if (!test_compare("quantization_decode", impl, reference, run, a, b))
+			goto fail;
+
+		impl->context->dwt_2d_decode(a, dwt);
+		reference->context->dwt_2d_decode(b, dwt);
+		if (!test_compare("dwt_2d_decode", impl, reference, run, a, b))
+			goto fail;
+
+		/* Quantized coefficients as received from the wire */
+		test_fill(a, run, 255);
+		memcpy(b, a, TEST_COEFFICIENTS * sizeof(INT16));
+		if (!impl->context->quantization_decode(a, quant, ARRAYSIZE(test_quant[0])) ||
+		    !reference->context->quantization_decode(b, quant, ARRAYSIZE(test_quant[0])))
+			goto fail;
+		if (!test_compare("quantization_decode", impl, reference, run, a, b))
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	winpr_aligned_free(a);
+	winpr_aligned_free(b);
+	winpr_aligned_free(dwt);
+	return rc;
+}
+
+int TestFreeRDPCodecRemoteFXSimd(int argc, char* argv[])
+{
+	int rc = -1;
+	test_impl generic = { "generic", test_context_new(nullptr) };
+	test_impl sse2 = { "SSE2", test_context_new(rfx_init_sse2) };
+	test_impl avx2 = { "AVX2", test_context_new(rfx_init_avx2) };
+	test_impl neon = { "NEON", test_context_new(rfx_init_neon) };
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!generic.context || !sse2.context || !avx2.context || !neon.context)
+		goto fail;
+
+	/* Implementations the build or the CPU does not support fall back to the generic code */
+	if (!test_impl_compare(&sse2, &generic) || !test_impl_compare(&neon, &generic))
+		goto fail;
+
+	if (avx2.context->dwt_2d_encode == rfx_dwt_2d_encode)
+		(void)printf("AVX2 not available, comparing the fallback\n");
+
+	if (!test_impl_compare(&avx2, &sse2) || !test_impl_compare(&avx2, &generic))
+		goto fail;
+
+	rc = 0;
+fail:
+	rfx_context_free(generic.context);
+	rfx_context_free(sse2.context);
+	rfx_context_free(avx2.context);
+	rfx_context_free(neon.context);
+	return rc;
+}
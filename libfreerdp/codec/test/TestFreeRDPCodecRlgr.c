@@ -0,0 +1,239 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * RemoteFX RLGR entropy coder test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/print.h>
+
+#include <freerdp/codec/rfx.h>
+
+#include "../rfx_rlgr.h"
+
+#define TEST_COEFFICIENTS 4096
+#define TEST_BUFFER_SIZE (TEST_COEFFICIENTS * 4)
+
+typedef enum
+{
+	TEST_RLGR_ZERO,   /**< A tile without detail, a single zero run */
+	TEST_RLGR_SPARSE, /**< Long zero runs between single values, run length mode */
+	TEST_RLGR_SMALL,  /**< Small values without runs, Golomb-Rice mode */
+	TEST_RLGR_LARGE,  /**< Magnitudes up to 16000, long codes */
+	TEST_RLGR_MIXED   /**< Blocks switching between runs and dense values */
+} TEST_RLGR_PATTERN;
+
+static const char* test_pattern_names[] = { "zero", "sparse", "small", "large", "mixed" };
+
+/* Encoded by the coder before the 64 bit rework, the output must stay bit identical */
+static const INT16 test_reference_input[64] = {
+	0,  0, 0, 0, 0,   0,    0, 0, 0, 0, 0, 0, 1, -1, 2, -2, /* dense */
+	0,  0, 0, 5, 0,   0,    0, 0, 0, 0, 0, 0, 0, 0,  0, 0,  /* run */
+	-7, 3, 0, 0, 120, -300, 0, 1, 0, 0, 0, 0, 0, 0,  0, 0,  /* large */
+	0,  0, 0, 0, 0,   0,    0, 0, 0, 0, 0, 0, 0, 0,  4, -1  /* terminated run */
+};
+
+static const BYTE test_reference_rlgr1[] = { 0x08, 0x12, 0x97, 0x1b, 0xc0, 0xdf, 0xd2,
+	                                         0x27, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	                                         0xff, 0x72, 0xb8, 0x00, 0x04, 0x00, 0x00,
+	                                         0x02, 0x00, 0x71, 0x00 };
+
+static const BYTE test_reference_rlgr3[] = { 0x08, 0x12, 0x97, 0x69, 0xe0, 0x47, 0xf4, 0x44,
+	                                         0x7f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf6,
+	                                         0xa5, 0x60, 0x20, 0x00, 0x08, 0x00, 0xe2, 0x00 };
+
+static UINT32 test_random(UINT32* state)
+{
+	*state = *state * 1664525u + 1013904223u;
+	return *state >> 8;
+}
+
+static INT16 test_value(UINT32* state, UINT32 magnitude)
+{
+	const INT32 value = (INT32)(test_random(state) % (2 * magnitude + 1)) - (INT32)magnitude;
+	return (INT16)value;
+}
+
+static void test_generate(TEST_RLGR_PATTERN pattern, INT16* data, size_t count)
+{
+	UINT32 state = 0x12345678u + (UINT32)pattern;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		switch (pattern)
+		{
+			case TEST_RLGR_SPARSE:
+				data[x] = ((test_random(&state) % 97) == 0) ? test_value(&state, 50) : 0;
+				break;
+			case TEST_RLGR_SMALL:
+				data[x] = test_value(&state, 3);
+				break;
+			case TEST_RLGR_LARGE:
+				data[x] = test_value(&state, 16000);
+				break;
+			case TEST_RLGR_MIXED:
+				data[x] = ((x / 256) % 2) ? test_value(&state, 200) : 0;
+				break;
+			case TEST_RLGR_ZERO:
+			default:
+				data[x] = 0;
+				break;
+		}
+	}
+}
+
+static BOOL test_round_trip(RLGR_MODE mode, TEST_RLGR_PATTERN pattern, UINT32 count)
+{
+	BOOL rc = FALSE;
+	INT16* data = calloc(TEST_COEFFICIENTS, sizeof(INT16));
+	INT16* decoded = calloc(TEST_COEFFICIENTS, sizeof(INT16));
+	BYTE* encoded = calloc(TEST_BUFFER_SIZE, sizeof(BYTE));
+
+	if (!data || !decoded || !encoded)
+		goto fail;
+
+	test_generate(pattern, data, count);
+
+	const int size = rfx_rlgr_encode(mode, data, count, encoded, TEST_BUFFER_SIZE);
+	if ((size <= 0) || (size >= TEST_BUFFER_SIZE))
+		goto fail;
+
+	/* Garbage in the output must be overwritten, nothing past it is touched */
+	memset(decoded, 0x55, TEST_COEFFICIENTS * sizeof(INT16));
+	if (rfx_rlgr_decode(mode, encoded, (UINT32)size, decoded, count) < 0)
+		goto fail;
+
+	for (size_t x = 0; x < TEST_COEFFICIENTS; x++)
+	{
+		const INT16 expect = (x < count) ? data[x] : 0x5555;
+		if (decoded[x] != expect)
+		{
+			(void)fprintf(stderr, "coefficient %" PRIuz ": expected %" PRId16 ", got %" PRId16 "\n",
+			              x, expect, decoded[x]);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(data);
+	free(decoded);
+	free(encoded);
+	return rc;
+}
+
+static BOOL test_reference(RLGR_MODE mode, const BYTE* expect, size_t size)
+{
+	BYTE encoded[256] = WINPR_C_ARRAY_INIT;
+	INT16 decoded[ARRAYSIZE(test_reference_input)] = WINPR_C_ARRAY_INIT;
+
+	/* The encoder must not depend on a zeroed buffer */
+	memset(encoded, 0xFF, sizeof(encoded));
+
+	const int rc = rfx_rlgr_encode(mode, test_reference_input, ARRAYSIZE(test_reference_input),
+	                               encoded, sizeof(encoded));
+	if ((rc < 0) || ((size_t)rc != size) || (memcmp(encoded, expect, size) != 0))
+	{
+		(void)fprintf(stderr, "expected %" PRIuz " bytes, got %d\n", size, rc);
+		winpr_HexDump("rlgr", WLOG_ERROR, encoded, (rc > 0) ? (size_t)rc : 0);
+		return FALSE;
+	}
+
+	if (rfx_rlgr_decode(mode, expect, (UINT32)size, decoded, ARRAYSIZE(decoded)) < 0)
+		return FALSE;
+	if (memcmp(decoded, test_reference_input, sizeof(decoded)) != 0)
+		return FALSE;
+
+	/* Coefficients missing in the data are zero */
+	INT16 padded[2 * ARRAYSIZE(test_reference_input)] = WINPR_C_ARRAY_INIT;
+	memset(padded, 0x55, sizeof(padded));
+	if (rfx_rlgr_decode(mode, expect, (UINT32)size, padded, ARRAYSIZE(padded)) < 0)
+		return FALSE;
+	for (size_t x = ARRAYSIZE(test_reference_input); x < ARRAYSIZE(padded); x++)
+	{
+		if (padded[x] != 0)
+			return FALSE;
+	}
+	return memcmp(padded, test_reference_input, sizeof(decoded)) == 0;
+}
+
+/* Output that does not fit is dropped, nothing is written past the buffer */
+static BOOL test_short_buffer(RLGR_MODE mode)
+{
+	BYTE encoded[64 + 16] = WINPR_C_ARRAY_INIT;
+	INT16 data[TEST_COEFFICIENTS] = WINPR_C_ARRAY_INIT;
+
+	test_generate(TEST_RLGR_LARGE, data, ARRAYSIZE(data));
+	memset(encoded, 0xA5, sizeof(encoded));
+
+	const int rc = rfx_rlgr_encode(mode, data, ARRAYSIZE(data), encoded, 64);
+	if (rc != 64)
+		return FALSE;
+
+	for (size_t x = 64; x < sizeof(encoded); x++)
+	{
+		if (encoded[x] != 0xA5)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+int TestFreeRDPCodecRlgr(int argc, char* argv[])
+{
+	const RLGR_MODE modes[] = { RLGR1, RLGR3 };
+	const UINT32 counts[] = { TEST_COEFFICIENTS, TEST_COEFFICIENTS - 1, 1, 3 };
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (size_t m = 0; m < ARRAYSIZE(modes); m++)
+	{
+		const char* name = (modes[m] == RLGR1) ? "RLGR1" : "RLGR3";
+
+		for (size_t p = 0; p < ARRAYSIZE(test_pattern_names); p++)
+		{
+			for (size_t c = 0; c < ARRAYSIZE(counts); c++)
+			{
+				if (!test_round_trip(modes[m], (TEST_RLGR_PATTERN)p, counts[c]))
+				{
+					(void)fprintf(stderr, "%s %s round trip of %" PRIu32 " coefficients failed\n",
+					              name, test_pattern_names[p], counts[c]);
+					return -1;
+				}
+			}
+		}
+
+		if (!test_short_buffer(modes[m]))
+		{
+			(void)fprintf(stderr, "%s short buffer failed\n", name);
+			return -1;
+		}
+	}
+
+	if (!test_reference(RLGR1, test_reference_rlgr1, sizeof(test_reference_rlgr1)))
+	{
+		(void)fprintf(stderr, "RLGR1 reference encoding failed\n");
+		return -1;
+	}
+
+	if (!test_reference(RLGR3, test_reference_rlgr3, sizeof(test_reference_rlgr3)))
+	{
+		(void)fprintf(stderr, "RLGR3 reference encoding failed\n");
+		return -1;
+	}
+
+	return 0;
+}
@@ -1,6 +1,7 @@
 #include <winpr/crt.h>
 #include <winpr/print.h>
 #include <winpr/bitstream.h>
+#include <winpr/crypto.h>
 
 #include <freerdp/freerdp.h>
 #include <freerdp/codec/zgfx.h>
@@ -253,6 +254,201 @@ fail:
 	return rc;
 }
 
+static BOOL test_ZGfxRoundTripData(ZGFX_CONTEXT* compressor, ZGFX_CONTEXT* decompressor,
+                                   const BYTE* pSrcData, UINT32 SrcSize, UINT32* pCompressedSize)
+{
+	BOOL rc = FALSE;
+	UINT32 Flags = 0;
+	UINT32 DstSize = 0;
+	BYTE* pDstData = nullptr;
+	UINT32 CompressedSize = 0;
+	BYTE* pCompressedData = nullptr;
+
+	if (zgfx_compress(compressor, pSrcData, SrcSize, &pCompressedData, &CompressedSize, &Flags) <
+	    0)
+		goto fail;
+
+	if (zgfx_decompress(decompressor, pCompressedData, CompressedSize, &pDstData, &DstSize, 0) <
+	    0)
+	{
+		printf("zgfx_decompress failed for %" PRIu32 " bytes\n", SrcSize);
+		goto fail;
+	}
+
+	if ((DstSize != SrcSize) || ((SrcSize > 0) && (memcmp(pDstData, pSrcData, SrcSize) != 0)))
+	{
+		printf("round trip mismatch: Actual: %" PRIu32 ", Expected: %" PRIu32 "\n", DstSize,
+		       SrcSize);
+		goto fail;
+	}
+
+	if (pCompressedSize)
+		*pCompressedSize = CompressedSize;
+	rc = TRUE;
+fail:
+	free(pCompressedData);
+	free(pDstData);
+	return rc;
+}
+
+static BYTE* test_ZGfxCreateSample(UINT32 size)
+{
+	BYTE* data = calloc(size, sizeof(BYTE));
+	if (!data)
+		return nullptr;
+
+	/* pseudo surface command stream: repeated rows, text and some noise */
+	for (UINT32 x = 0; x < size; x++)
+	{
+		const UINT32 row = x / 256;
+
+		if (row % 7 == 3)
+			data[x] = (BYTE)(x * 31 + row);
+		else if (row % 5 == 1)
+			data[x] = TEST_FOX_DATA[x % (sizeof(TEST_FOX_DATA) - 1)];
+		else
+			data[x] = (BYTE)((x % 256) / 16);
+	}
+
+	if (winpr_RAND(&data[size / 2], MIN(4096, size / 4)) < 0)
+	{
+		free(data);
+		return nullptr;
+	}
+
+	return data;
+}
+
+static int test_ZGfxCompressRoundTrip(void)
+{
+	int rc = -1;
+	const UINT32 sizes[] = { 1, 3, 4, 17, 4096, 65535, 65536, 200000 };
+	const ZGFX_COMPRESSION_LEVEL levels[] = { ZGFX_COMPRESSION_LEVEL_NONE,
+		                                      ZGFX_COMPRESSION_LEVEL_FAST,
+		                                      ZGFX_COMPRESSION_LEVEL_DEFAULT,
+		                                      ZGFX_COMPRESSION_LEVEL_BEST };
+
+	for (size_t l = 0; l < ARRAYSIZE(levels); l++)
+	{
+		ZGFX_CONTEXT* compressor = zgfx_context_new(TRUE);
+		ZGFX_CONTEXT* decompressor = zgfx_context_new(FALSE);
+		BYTE* random = nullptr;
+
+		if (!compressor || !decompressor)
+			goto fail_level;
+
+		if (!zgfx_context_set_compression_level(compressor, levels[l]))
+			goto fail_level;
+
+		for (size_t x = 0; x < ARRAYSIZE(sizes); x++)
+		{
+			UINT32 CompressedSize = 0;
+			BYTE* sample = test_ZGfxCreateSample(sizes[x]);
+			if (!sample)
+				goto fail_level;
+
+			const BOOL res = test_ZGfxRoundTripData(compressor, decompressor, sample, sizes[x],
+			                                        &CompressedSize);
+			free(sample);
+
+			if (!res)
+			{
+				printf("test_ZGfxCompressRoundTrip: level %d size %" PRIu32 " failed\n",
+				       levels[l], sizes[x]);
+				goto fail_level;
+			}
+
+			printf("level %d: %" PRIu32 " -> %" PRIu32 " bytes\n", levels[l], sizes[x],
+			       CompressedSize);
+
+			if ((levels[l] != ZGFX_COMPRESSION_LEVEL_NONE) && (sizes[x] >= 4096) &&
+			    (CompressedSize >= sizes[x] / 2))
+			{
+				printf("test_ZGfxCompressRoundTrip: level %d did not compress\n", levels[l]);
+				goto fail_level;
+			}
+		}
+
+		/* incompressible data must not expand beyond the segment headers */
+		random = malloc(100000);
+		if (!random || (winpr_RAND(random, 100000) < 0))
+			goto fail_level;
+
+		{
+			UINT32 CompressedSize = 0;
+			if (!test_ZGfxRoundTripData(compressor, decompressor, random, 100000,
+			                            &CompressedSize))
+				goto fail_level;
+			if (CompressedSize > 100000 + 7 + 2 * 5)
+			{
+				printf("test_ZGfxCompressRoundTrip: random data expanded to %" PRIu32 "\n",
+				       CompressedSize);
+				goto fail_level;
+			}
+		}
+
+		free(random);
+		zgfx_context_free(compressor);
+		zgfx_context_free(decompressor);
+		continue;
+
+	fail_level:
+		free(random);
+		zgfx_context_free(compressor);
+		zgfx_context_free(decompressor);
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+	return rc;
+}
+
+static int test_ZGfxCompressHistory(void)
+{
+	int rc = -1;
+	UINT32 first = 0;
+	UINT32 second = 0;
+	BYTE* sample = test_ZGfxCreateSample(30000);
+	ZGFX_CONTEXT* compressor = zgfx_context_new(TRUE);
+	ZGFX_CONTEXT* decompressor = zgfx_context_new(FALSE);
+
+	if (!sample || !compressor || !decompressor)
+		goto fail;
+
+	/* The second PDU repeats the first one and must be encoded against the history */
+	if (!test_ZGfxRoundTripData(compressor, decompressor, sample, 30000, &first))
+		goto fail;
+
+	if (!test_ZGfxRoundTripData(compressor, decompressor, sample, 30000, &second))
+		goto fail;
+
+	printf("history: first %" PRIu32 " bytes, repeated %" PRIu32 " bytes\n", first, second);
+
+	if (second > 64)
+		goto fail;
+
+	/* After a reset both sides must start over with an empty history */
+	zgfx_context_reset(compressor, FALSE);
+	zgfx_context_reset(decompressor, FALSE);
+
+	if (!test_ZGfxRoundTripData(compressor, decompressor, sample, 30000, &second))
+		goto fail;
+
+	if (second != first)
+		goto fail;
+
+	if (zgfx_context_set_compression_level(decompressor, ZGFX_COMPRESSION_LEVEL_BEST))
+		goto fail;
+
+	rc = 0;
+fail:
+	free(sample);
+	zgfx_context_free(compressor);
+	zgfx_context_free(decompressor);
+	return rc;
+}
+
 int TestFreeRDPCodecZGfx(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -270,5 +466,11 @@ int TestFreeRDPCodecZGfx(int argc, char* argv[])
 	if (test_ZGfxCompressConsistent() < 0)
 		return -1;
 
+	if (test_ZGfxCompressRoundTrip() < 0)
+		return -1;
+
+	if (test_ZGfxCompressHistory() < 0)
+		return -1;
+
 	return 0;
 }
@@ -42,6 +42,12 @@
  * Minimum match length: 3 bytes
  */
 
+#define ZGFX_MIN_MATCH 3
+#define ZGFX_MAX_UNENCODED 0x7FFF
+#define ZGFX_HASH_BITS 16
+#define ZGFX_HASH_SIZE (1u << ZGFX_HASH_BITS)
+#define ZGFX_HASH_NONE UINT32_MAX
+
 typedef struct
 {
 	UINT32 prefixLength;
@@ -69,8 +75,40 @@ struct S_ZGFX_CONTEXT
 	BYTE HistoryBuffer[2500000];
 	UINT32 HistoryIndex;
 	UINT32 HistoryBufferSize;
+
+	/* compressor state, only allocated if Compressor == TRUE */
+	ZGFX_COMPRESSION_LEVEL CompressionLevel;
+	UINT32 CompressorPosition;
+	UINT32* HashHead;
+	UINT32* HashPrev;
+	UINT16 LiteralCode[256];
+	BYTE LiteralBits[256];
 };
 
+typedef struct
+{
+	UINT32 maxChain;
+	UINT32 niceLength;
+	BOOL lazy;
+} ZGFX_LEVEL_PARAMS;
+
+typedef struct
+{
+	BYTE* data;
+	size_t capacity;
+	size_t length;
+	UINT32 accumulator;
+	UINT32 nbits;
+	BOOL overflow;
+} ZGFX_BIT_WRITER;
+
+typedef struct
+{
+	UINT32 length;
+	UINT32 distance;
+	INT32 score;
+} ZGFX_MATCH;
+
 static const ZGFX_TOKEN ZGFX_TOKEN_TABLE[] = {
 	// len code vbits type  vbase
 	{ 1, 0, 8, 0, 0 },           // 0
@@ -116,6 +154,15 @@ static const ZGFX_TOKEN ZGFX_TOKEN_TABLE[] = {
 	WINPR_C_ARRAY_INIT
 };
 
+/* indexed by ZGFX_COMPRESSION_LEVEL */
+static const ZGFX_LEVEL_PARAMS ZGFX_LEVEL_TABLE[] = {
+	// maxChain niceLength lazy
+	{ 0, 0, FALSE },     // ZGFX_COMPRESSION_LEVEL_NONE
+	{ 4, 32, FALSE },    // ZGFX_COMPRESSION_LEVEL_FAST
+	{ 32, 258, TRUE },   // ZGFX_COMPRESSION_LEVEL_DEFAULT
+	{ 512, 4096, TRUE }, // ZGFX_COMPRESSION_LEVEL_BEST
+};
+
 static inline BOOL zgfx_GetBits(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 nbits)
 {
 	if (!zgfx)
@@ -488,11 +535,349 @@ fail:
 	return status;
 }
 
-static BOOL zgfx_compress_segment(WINPR_ATTR_UNUSED ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
-                                  wStream* WINPR_RESTRICT s, const BYTE* WINPR_RESTRICT pSrcData,
-                                  UINT32 SrcSize, UINT32* WINPR_RESTRICT pFlags)
+static inline void zgfx_bits_write(ZGFX_BIT_WRITER* WINPR_RESTRICT bw, UINT32 bits, UINT32 nbits)
+{
+	WINPR_ASSERT(nbits <= 24);
+
+	bw->accumulator = (bw->accumulator << nbits) | (bits & ((1u << nbits) - 1u));
+	bw->nbits += nbits;
+
+	while (bw->nbits >= 8)
+	{
+		bw->nbits -= 8;
+
+		if (bw->length >= bw->capacity)
+		{
+			bw->overflow = TRUE;
+			return;
+		}
+
+		bw->data[bw->length++] = (BYTE)(bw->accumulator >> bw->nbits);
+	}
+
+	bw->accumulator &= ((1u << bw->nbits) - 1u);
+}
+
+static inline UINT32 zgfx_bits_position(const ZGFX_BIT_WRITER* WINPR_RESTRICT bw)
+{
+	return (UINT32)(bw->length * 8) + bw->nbits;
+}
+
+static inline const ZGFX_TOKEN* zgfx_distance_token(UINT32 distance)
+{
+	for (size_t x = 0; ZGFX_TOKEN_TABLE[x].prefixLength != 0; x++)
+	{
+		const ZGFX_TOKEN* token = &ZGFX_TOKEN_TABLE[x];
+
+		if (token->tokenType != 1)
+			continue;
+
+		if ((distance >= token->valueBase) &&
+		    (distance - token->valueBase < (1u << token->valueBits)))
+			return token;
+	}
+
+	return nullptr;
+}
+
+static inline UINT32 zgfx_length_bits(UINT32 length)
+{
+	UINT32 extra = 0;
+
+	if (length == ZGFX_MIN_MATCH)
+		return 1;
+
+	for (UINT32 base = 8; base <= length; base *= 2)
+		extra++;
+
+	return 2 * extra + 4;
+}
+
+static inline UINT32 zgfx_match_bits(UINT32 length, UINT32 distance)
+{
+	const ZGFX_TOKEN* token = zgfx_distance_token(distance);
+	WINPR_ASSERT(token);
+	return token->prefixLength + token->valueBits + zgfx_length_bits(length);
+}
+
+static inline UINT32 zgfx_literal_cost(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+                                       const BYTE* WINPR_RESTRICT data, size_t count)
+{
+	UINT32 bits = 0;
+
+	for (size_t x = 0; x < count; x++)
+		bits += zgfx->LiteralBits[data[x]];
+
+	return bits;
+}
+
+static inline UINT32 zgfx_hash(const BYTE* WINPR_RESTRICT data)
+{
+	const UINT32 value = ((UINT32)data[0] << 16) | ((UINT32)data[1] << 8) | data[2];
+	return (value * 2654435761u) >> (32 - ZGFX_HASH_BITS);
+}
+
+static inline UINT32 zgfx_ring_index(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 ringBase,
+                                     UINT32 offset)
+{
+	return (UINT32)(((UINT64)ringBase + offset) % zgfx->HistoryBufferSize);
+}
+
+static inline void zgfx_hash_insert(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, UINT32 ringBase,
+                                    const BYTE* WINPR_RESTRICT pSrcData, UINT32 index)
+{
+	const UINT32 hash = zgfx_hash(&pSrcData[index]);
+	zgfx->HashPrev[zgfx_ring_index(zgfx, ringBase, index)] = zgfx->HashHead[hash];
+	zgfx->HashHead[hash] = zgfx->CompressorPosition + index;
+}
+
+static inline UINT32 zgfx_history_match_length(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+                                               UINT32 ringIndex, const BYTE* WINPR_RESTRICT cur,
+                                               UINT32 maxLength)
+{
+	UINT32 length = 0;
+
+	while (length < maxLength)
+	{
+		const UINT32 chunk = MIN(maxLength - length, zgfx->HistoryBufferSize - ringIndex);
+		const BYTE* hist = &zgfx->HistoryBuffer[ringIndex];
+
+		for (UINT32 x = 0; x < chunk; x++)
+		{
+			if (hist[x] != cur[length + x])
+				return length + x;
+		}
+
+		length += chunk;
+		ringIndex = 0;
+	}
+
+	return length;
+}
+
+/**
+ * Search the hash chain for the best match at pSrcData[index]. The history buffer already
+ * contains the whole segment, so matches may overlap the current position.
+ */
+static inline ZGFX_MATCH zgfx_find_match(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+                                         const ZGFX_LEVEL_PARAMS* WINPR_RESTRICT params,
+                                         UINT32 ringBase, const BYTE* WINPR_RESTRICT pSrcData,
+                                         UINT32 SrcSize, UINT32 index)
+{
+	ZGFX_MATCH best = WINPR_C_ARRAY_INIT;
+	const UINT32 position = zgfx->CompressorPosition + index;
+	const UINT32 ringPosition = zgfx_ring_index(zgfx, ringBase, index);
+	const UINT32 maxDistance = zgfx->HistoryBufferSize - ZGFX_SEGMENTED_MAXSIZE;
+	const UINT32 maxLength = SrcSize - index;
+	UINT32 candidate = zgfx->HashHead[zgfx_hash(&pSrcData[index])];
+
+	for (UINT32 chain = 0; (chain < params->maxChain) && (candidate < position); chain++)
+	{
+		const UINT32 distance = position - candidate;
+
+		if (distance > maxDistance)
+			break;
+
+		const UINT32 ringCandidate =
+		    zgfx_ring_index(zgfx, ringPosition, zgfx->HistoryBufferSize - distance);
+		const UINT32 length =
+		    zgfx_history_match_length(zgfx, ringCandidate, &pSrcData[index], maxLength);
+
+		if (length >= ZGFX_MIN_MATCH)
+		{
+			const INT32 score = (INT32)(length * 8) - (INT32)zgfx_match_bits(length, distance);
+
+			if ((best.length == 0) || (score > best.score))
+			{
+				best.length = length;
+				best.distance = distance;
+				best.score = score;
+
+				if (length >= params->niceLength)
+					break;
+			}
+		}
+
+		const UINT32 next = zgfx->HashPrev[ringCandidate];
+
+		if (next >= candidate)
+			break;
+
+		candidate = next;
+	}
+
+	return best;
+}
+
+static inline void zgfx_write_match(ZGFX_BIT_WRITER* WINPR_RESTRICT bw, UINT32 length,
+                                    UINT32 distance)
+{
+	const ZGFX_TOKEN* token = zgfx_distance_token(distance);
+	WINPR_ASSERT(token);
+
+	zgfx_bits_write(bw, token->prefixCode, token->prefixLength);
+	zgfx_bits_write(bw, distance - token->valueBase, token->valueBits);
+
+	if (length == ZGFX_MIN_MATCH)
+	{
+		zgfx_bits_write(bw, 0, 1);
+		return;
+	}
+
+	UINT32 base = 4;
+	UINT32 extra = 2;
+	zgfx_bits_write(bw, 1, 1);
+
+	while (length >= base * 2)
+	{
+		zgfx_bits_write(bw, 1, 1);
+		base *= 2;
+		extra++;
+	}
+
+	zgfx_bits_write(bw, 0, 1);
+	zgfx_bits_write(bw, length - base, extra);
+}
+
+/**
+ * Emit a run of bytes that did not match. Runs that are cheaper as raw bytes than as
+ * literal tokens are sent as unencoded blocks (distance 0 token, byte aligned payload).
+ */
+static inline void zgfx_write_literals(const ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+                                       ZGFX_BIT_WRITER* WINPR_RESTRICT bw,
+                                       const BYTE* WINPR_RESTRICT data, UINT32 count)
 {
-	/* FIXME: Currently compression not implemented. Just copy the raw source */
+	const ZGFX_TOKEN* unencoded = zgfx_distance_token(0);
+	WINPR_ASSERT(unencoded);
+
+	while ((count > 0) && !bw->overflow)
+	{
+		const UINT32 chunk = MIN(count, ZGFX_MAX_UNENCODED);
+		const UINT32 headerBits = unencoded->prefixLength + unencoded->valueBits + 15;
+		const UINT32 padding = (8 - ((zgfx_bits_position(bw) + headerBits) % 8)) % 8;
+		const UINT32 literalBits = zgfx_literal_cost(zgfx, data, chunk);
+
+		if (headerBits + padding + 8 * chunk < literalBits)
+		{
+			zgfx_bits_write(bw, unencoded->prefixCode, unencoded->prefixLength);
+			zgfx_bits_write(bw, 0, unencoded->valueBits);
+			zgfx_bits_write(bw, chunk, 15);
+			zgfx_bits_write(bw, 0, padding);
+			WINPR_ASSERT(bw->nbits == 0);
+
+			if (bw->capacity - bw->length < chunk)
+			{
+				bw->overflow = TRUE;
+				return;
+			}
+
+			CopyMemory(&bw->data[bw->length], data, chunk);
+			bw->length += chunk;
+		}
+		else
+		{
+			for (UINT32 x = 0; x < chunk; x++)
+				zgfx_bits_write(bw, zgfx->LiteralCode[data[x]], zgfx->LiteralBits[data[x]]);
+		}
+
+		data += chunk;
+		count -= chunk;
+	}
+}
+
+static BOOL zgfx_encode_segment(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+                                ZGFX_BIT_WRITER* WINPR_RESTRICT bw, UINT32 ringBase,
+                                const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize)
+{
+	UINT32 index = 0;
+	UINT32 literalStart = 0;
+	const ZGFX_LEVEL_PARAMS* params = &ZGFX_LEVEL_TABLE[zgfx->CompressionLevel];
+
+	while ((index < SrcSize) && !bw->overflow)
+	{
+		if (SrcSize - index < ZGFX_MIN_MATCH)
+		{
+			index++;
+			continue;
+		}
+
+		ZGFX_MATCH match = zgfx_find_match(zgfx, params, ringBase, pSrcData, SrcSize, index);
+		zgfx_hash_insert(zgfx, ringBase, pSrcData, index);
+
+		/* lazy evaluation: prefer a better match starting at the next byte */
+		while (params->lazy && (match.length > 0) && (match.length < params->niceLength) &&
+		       (SrcSize - index - 1 >= ZGFX_MIN_MATCH))
+		{
+			const ZGFX_MATCH next =
+			    zgfx_find_match(zgfx, params, ringBase, pSrcData, SrcSize, index + 1);
+
+			if ((next.length == 0) || (next.score <= match.score))
+				break;
+
+			index++;
+			zgfx_hash_insert(zgfx, ringBase, pSrcData, index);
+			match = next;
+		}
+
+		if ((match.length == 0) ||
+		    (zgfx_match_bits(match.length, match.distance) >=
+		     zgfx_literal_cost(zgfx, &pSrcData[index], match.length)))
+		{
+			index++;
+			continue;
+		}
+
+		zgfx_write_literals(zgfx, bw, &pSrcData[literalStart], index - literalStart);
+		zgfx_write_match(bw, match.length, match.distance);
+
+		for (UINT32 x = index + 1; x < index + match.length; x++)
+		{
+			if (SrcSize - x >= ZGFX_MIN_MATCH)
+				zgfx_hash_insert(zgfx, ringBase, pSrcData, x);
+		}
+
+		index += match.length;
+		literalStart = index;
+	}
+
+	/* keep the hash chains complete if the encoder bailed out early */
+	for (; index + ZGFX_MIN_MATCH <= SrcSize; index++)
+		zgfx_hash_insert(zgfx, ringBase, pSrcData, index);
+
+	zgfx_write_literals(zgfx, bw, &pSrcData[literalStart], SrcSize - literalStart);
+
+	if (bw->overflow)
+		return FALSE;
+
+	/* the last byte holds the number of unused bits in the preceding byte */
+	const UINT32 unused = (8 - bw->nbits) % 8;
+	zgfx_bits_write(bw, 0, unused);
+	zgfx_bits_write(bw, unused, 8);
+	return !bw->overflow;
+}
+
+static void zgfx_compressor_reset(ZGFX_CONTEXT* WINPR_RESTRICT zgfx)
+{
+	WINPR_ASSERT(zgfx);
+
+	zgfx->CompressorPosition = 0;
+
+	if (zgfx->HashHead)
+		memset(zgfx->HashHead, 0xFF, ZGFX_HASH_SIZE * sizeof(UINT32));
+
+	if (zgfx->HashPrev)
+		memset(zgfx->HashPrev, 0xFF, zgfx->HistoryBufferSize * sizeof(UINT32));
+}
+
+static BOOL zgfx_compress_segment(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, wStream* WINPR_RESTRICT s,
+                                  const BYTE* WINPR_RESTRICT pSrcData, UINT32 SrcSize,
+                                  UINT32* WINPR_RESTRICT pFlags)
+{
+	BOOL compressed = FALSE;
+
+	WINPR_ASSERT(zgfx);
+	WINPR_ASSERT(pFlags);
+
 	if (!Stream_EnsureRemainingCapacity(s, SrcSize + 1))
 	{
 		WLog_ERR(TAG, "Stream_EnsureRemainingCapacity failed!");
@@ -500,8 +885,43 @@ static BOOL zgfx_compress_segment(WINPR_ATTR_UNUSED ZGFX_CONTEXT* WINPR_RESTRICT
 	}
 
 	(*pFlags) |= ZGFX_PACKET_COMPR_TYPE_RDP8; /* RDP 8.0 compression format */
-	Stream_Write_UINT8(s, WINPR_ASSERTING_INT_CAST(uint8_t, *pFlags)); /* header (1 byte) */
-	Stream_Write(s, pSrcData, SrcSize);
+
+	/* Positions are tracked in 32 bit, start over well before they wrap around */
+	if (zgfx->CompressorPosition > UINT32_MAX - zgfx->HistoryBufferSize - ZGFX_SEGMENTED_MAXSIZE)
+		zgfx_compressor_reset(zgfx);
+
+	/* The decoder adds every segment to its history, compressed or not. */
+	const UINT32 ringBase = zgfx->HistoryIndex;
+	zgfx_history_buffer_ring_write(zgfx, pSrcData, SrcSize);
+
+	if (zgfx->HashHead && zgfx->HashPrev &&
+	    (zgfx->CompressionLevel != ZGFX_COMPRESSION_LEVEL_NONE) && (SrcSize > ZGFX_MIN_MATCH))
+	{
+		/* Only use the compressed form if it is smaller than the raw segment */
+		ZGFX_BIT_WRITER bw = { .data = Stream_PointerAs(s, BYTE) + 1, .capacity = SrcSize - 2 };
+
+		compressed = zgfx_encode_segment(zgfx, &bw, ringBase, pSrcData, SrcSize);
+
+		if (compressed)
+		{
+			const UINT32 header = *pFlags | PACKET_COMPRESSED;
+			Stream_Write_UINT8(s, WINPR_ASSERTING_INT_CAST(uint8_t, header)); /* header (1 byte) */
+			Stream_Seek(s, bw.length);
+		}
+	}
+	else if (zgfx->HashHead && zgfx->HashPrev)
+	{
+		for (UINT32 index = 0; index + ZGFX_MIN_MATCH <= SrcSize; index++)
+			zgfx_hash_insert(zgfx, ringBase, pSrcData, index);
+	}
+
+	if (!compressed)
+	{
+		Stream_Write_UINT8(s, WINPR_ASSERTING_INT_CAST(uint8_t, *pFlags)); /* header (1 byte) */
+		Stream_Write(s, pSrcData, SrcSize);
+	}
+
+	zgfx->CompressorPosition += SrcSize;
 	return TRUE;
 }
 
@@ -615,6 +1035,50 @@ int zgfx_compress(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, const BYTE* WINPR_RESTRICT
 void zgfx_context_reset(ZGFX_CONTEXT* WINPR_RESTRICT zgfx, WINPR_ATTR_UNUSED BOOL flush)
 {
 	zgfx->HistoryIndex = 0;
+	zgfx_compressor_reset(zgfx);
+}
+
+BOOL zgfx_context_set_compression_level(ZGFX_CONTEXT* WINPR_RESTRICT zgfx,
+                                        ZGFX_COMPRESSION_LEVEL level)
+{
+	WINPR_ASSERT(zgfx);
+
+	if (!zgfx->Compressor)
+		return FALSE;
+
+	if ((size_t)level >= ARRAYSIZE(ZGFX_LEVEL_TABLE))
+	{
+		WLog_WARN(TAG, "Invalid compression level %d", level);
+		return FALSE;
+	}
+
+	zgfx->CompressionLevel = level;
+	return TRUE;
+}
+
+static void zgfx_init_literal_table(ZGFX_CONTEXT* WINPR_RESTRICT zgfx)
+{
+	/* Default: prefix '0' followed by the 8 bit literal value */
+	for (size_t x = 0; x < ARRAYSIZE(zgfx->LiteralCode); x++)
+	{
+		zgfx->LiteralCode[x] = (UINT16)((ZGFX_TOKEN_TABLE[0].prefixCode << 8) | x);
+		zgfx->LiteralBits[x] = (BYTE)(ZGFX_TOKEN_TABLE[0].prefixLength + 8);
+	}
+
+	/* Frequent bytes have dedicated, shorter tokens */
+	for (size_t x = 0; ZGFX_TOKEN_TABLE[x].prefixLength != 0; x++)
+	{
+		const ZGFX_TOKEN* token = &ZGFX_TOKEN_TABLE[x];
+
+		if ((token->tokenType != 0) || (token->valueBits != 0))
+			continue;
+
+		if (token->prefixLength < zgfx->LiteralBits[token->valueBase])
+		{
+			zgfx->LiteralCode[token->valueBase] = (UINT16)token->prefixCode;
+			zgfx->LiteralBits[token->valueBase] = (BYTE)token->prefixLength;
+		}
+	}
 }
 
 ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
@@ -626,6 +1090,22 @@ ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
 	{
 		zgfx->Compressor = Compressor;
 		zgfx->HistoryBufferSize = sizeof(zgfx->HistoryBuffer);
+
+		if (Compressor)
+		{
+			zgfx->CompressionLevel = ZGFX_COMPRESSION_LEVEL_DEFAULT;
+			zgfx->HashHead = (UINT32*)calloc(ZGFX_HASH_SIZE, sizeof(UINT32));
+			zgfx->HashPrev = (UINT32*)calloc(zgfx->HistoryBufferSize, sizeof(UINT32));
+
+			if (!zgfx->HashHead || !zgfx->HashPrev)
+			{
+				zgfx_context_free(zgfx);
+				return nullptr;
+			}
+
+			zgfx_init_literal_table(zgfx);
+		}
+
 		zgfx_context_reset(zgfx, FALSE);
 	}
 
@@ -634,5 +1114,10 @@ ZGFX_CONTEXT* zgfx_context_new(BOOL Compressor)
 
 void zgfx_context_free(ZGFX_CONTEXT* zgfx)
 {
+	if (!zgfx)
+		return;
+
+	free(zgfx->HashHead);
+	free(zgfx->HashPrev);
 	free(zgfx);
 }
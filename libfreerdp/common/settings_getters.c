@@ -128,6 +128,9 @@ BOOL freerdp_settings_get_bool(WINPR_ATTR_UNUSED const rdpSettings* settings,
 		case FreeRDP_CertificateCallbackPreferPEM:
 			return settings->CertificateCallbackPreferPEM;
 
+		case FreeRDP_CompressionAdaptive:
+			return settings->CompressionAdaptive;
+
 		case FreeRDP_CompressionEnabled:
 			return settings->CompressionEnabled;
 
@@ -608,6 +611,9 @@ BOOL freerdp_settings_get_bool(WINPR_ATTR_UNUSED const rdpSettings* settings,
 		case FreeRDP_TcpKeepAlive:
 			return settings->TcpKeepAlive;
 
+		case FreeRDP_TlsKernelOffload:
+			return settings->TlsKernelOffload;
+
 		case FreeRDP_TlsSecurity:
 			return settings->TlsSecurity;
 
@@ -765,6 +771,10 @@ BOOL freerdp_settings_set_bool(WINPR_ATTR_UNUSED rdpSettings* settings,
 			settings->CertificateCallbackPreferPEM = cnv.c;
 			break;
 
+		case FreeRDP_CompressionAdaptive:
+			settings->CompressionAdaptive = cnv.c;
+			break;
+
 		case FreeRDP_CompressionEnabled:
 			settings->CompressionEnabled = cnv.c;
 			break;
@@ -1405,6 +1415,10 @@ BOOL freerdp_settings_set_bool(WINPR_ATTR_UNUSED rdpSettings* settings,
 			settings->TcpKeepAlive = cnv.c;
 			break;
 
+		case FreeRDP_TlsKernelOffload:
+			settings->TlsKernelOffload = cnv.c;
+			break;
+
 		case FreeRDP_TlsSecurity:
 			settings->TlsSecurity = cnv.c;
 			break;
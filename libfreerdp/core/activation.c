@@ -317,11 +317,12 @@ static UINT16 rdp_load_persistent_key_list(rdpRdp* rdp, UINT64** pKeyList)
 		if (!keyList)
 			goto error;
 
+		/* Only the keys are needed, the bitmap data of the entries is never touched */
 		for (int index = 0; index < count; index++)
 		{
 			PERSISTENT_CACHE_ENTRY cacheEntry = WINPR_C_ARRAY_INIT;
 
-			if (persistent_cache_read_entry(persistent, &cacheEntry) < 1)
+			if (persistent_cache_get_entry(persistent, (size_t)index, &cacheEntry) < 1)
 				continue;
 
 			keyList[index] = cacheEntry.key64;
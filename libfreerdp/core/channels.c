@@ -307,7 +307,7 @@ BOOL freerdp_channel_send_packet(rdpRdp* rdp, UINT16 channelId, size_t totalSize
 	if (!s)
 		return FALSE;
 
-	if (!Stream_EnsureRemainingCapacity(s, chunkSize + 8))
+	if (!Stream_EnsureRemainingCapacity(s, 8))
 	{
 		Stream_Release(s);
 		return FALSE;
@@ -316,8 +316,6 @@ BOOL freerdp_channel_send_packet(rdpRdp* rdp, UINT16 channelId, size_t totalSize
 	Stream_Write_UINT32(s, (UINT32)totalSize);
 	Stream_Write_UINT32(s, flags);
 
-	Stream_Write(s, data, chunkSize);
-
 	/* WLog_DBG(TAG, "sending data (flags=0x%x size=%d)",  flags, size); */
-	return rdp_send(rdp, s, channelId, sec_flags);
+	return rdp_send_data(rdp, s, data, chunkSize, channelId, sec_flags);
 }
@@ -1272,7 +1272,7 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 
 		if (freerdp_settings_get_bool(settings, FreeRDP_CompressionEnabled) && !skipCompression)
 		{
-			if (bulk_compress(rdp->bulk, pSrcData, SrcSize, &pDstData, &DstSize,
+			if (bulk_compress(rdp->bulk, updateCode, pSrcData, SrcSize, &pDstData, &DstSize,
 			                  &compressionFlags) >= 0)
 			{
 				if (compressionFlags)
@@ -1336,6 +1336,19 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 		if (!fastpath_write_update_header(fs, &fpUpdateHeader))
 			return FALSE;
 
+		/* Unencrypted fragments are sent from where the encoder or the compressor left them */
+		if (!(sec_flags & SEC_ENCRYPT))
+		{
+			const DataChunk chunks[] = { { .size = Stream_GetPosition(fs),
+				                           .data = Stream_Buffer(fs) },
+				                         { .size = DstSize, .data = pDstData } };
+			if (transport_write_chunks(rdp->transport, chunks, ARRAYSIZE(chunks)) < 0)
+				return FALSE;
+
+			Stream_Seek(s, SrcSize);
+			continue;
+		}
+
 		if (!Stream_CheckAndLogRequiredCapacity(TAG, (fs), (size_t)DstSize + pad))
 			return FALSE;
 		Stream_Write(fs, pDstData, DstSize);
@@ -1344,36 +1357,32 @@ BOOL fastpath_send_update_pdu(rdpFastPath* fastpath, BYTE updateCode, wStream* s
 			Stream_Zero(fs, pad);
 
 		BOOL res = FALSE;
-		if (sec_flags & SEC_ENCRYPT)
-		{
-			security_lock(rdp);
+		security_lock(rdp);
 
-			should_unlock = TRUE;
-			UINT32 dataSize = fpUpdateHeaderSize + DstSize + pad;
-			BYTE* data = Stream_PointerAs(fs, BYTE) - dataSize;
+		should_unlock = TRUE;
+		UINT32 dataSize = fpUpdateHeaderSize + DstSize + pad;
+		BYTE* data = Stream_PointerAs(fs, BYTE) - dataSize;
 
-			if (freerdp_settings_get_uint32(rdp->settings, FreeRDP_EncryptionMethods) ==
-			    ENCRYPTION_METHOD_FIPS)
-			{
-				// TODO: Ensure stream capacity
-				if (!security_hmac_signature(data, dataSize - pad, pSignature, 8, rdp))
-					goto unlock;
+		if (freerdp_settings_get_uint32(rdp->settings, FreeRDP_EncryptionMethods) ==
+		    ENCRYPTION_METHOD_FIPS)
+		{
+			// TODO: Ensure stream capacity
+			if (!security_hmac_signature(data, dataSize - pad, pSignature, 8, rdp))
+				goto unlock;
 
-				if (!security_fips_encrypt(data, dataSize, rdp))
-					goto unlock;
-			}
+			if (!security_fips_encrypt(data, dataSize, rdp))
+				goto unlock;
+		}
+		else
+		{
+			// TODO: Ensure stream capacity
+			if (sec_flags & SEC_SECURE_CHECKSUM)
+				status = security_salted_mac_signature(rdp, data, dataSize, TRUE, pSignature, 8);
 			else
-			{
-				// TODO: Ensure stream capacity
-				if (sec_flags & SEC_SECURE_CHECKSUM)
-					status =
-					    security_salted_mac_signature(rdp, data, dataSize, TRUE, pSignature, 8);
-				else
-					status = security_mac_signature(rdp, data, dataSize, pSignature, 8);
+				status = security_mac_signature(rdp, data, dataSize, pSignature, 8);
 
-				if (!status || !security_encrypt(data, dataSize, rdp))
-					goto unlock;
-			}
+			if (!status || !security_encrypt(data, dataSize, rdp))
+				goto unlock;
 		}
 		res = TRUE;
 
@@ -19,6 +19,8 @@
 
 #include <freerdp/config.h>
 
+#include <winpr/assert.h>
+
 #include "rdp.h"
 
 double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32 CompressedBytes)
@@ -37,6 +39,41 @@ double metrics_write_bytes(rdpMetrics* metrics, UINT32 UncompressedBytes, UINT32
 	return CompressionRatio;
 }
 
+static void metrics_write_compression_entry(rdpCompressionMetrics* entry, UINT32 UncompressedBytes,
+                                            UINT32 CompressedBytes, UINT64 TimeNS, BOOL Skipped)
+{
+	WINPR_ASSERT(entry);
+
+	entry->Packets++;
+	if (Skipped)
+		entry->SkippedPackets++;
+	entry->UncompressedBytes += UncompressedBytes;
+	entry->CompressedBytes += CompressedBytes;
+	entry->CompressionTimeNS += TimeNS;
+}
+
+void metrics_write_compression(rdpMetrics* metrics, UINT32 CompressionType, UINT32 UpdateType,
+                               UINT32 UncompressedBytes, UINT32 CompressedBytes, UINT64 TimeNS,
+                               BOOL Skipped)
+{
+	WINPR_ASSERT(metrics);
+
+	if (CompressionType < ARRAYSIZE(metrics->Compressors))
+		metrics_write_compression_entry(&metrics->Compressors[CompressionType], UncompressedBytes,
+		                                CompressedBytes, TimeNS, Skipped);
+	if (UpdateType < ARRAYSIZE(metrics->UpdateTypes))
+		metrics_write_compression_entry(&metrics->UpdateTypes[UpdateType], UncompressedBytes,
+		                                CompressedBytes, TimeNS, Skipped);
+}
+
+double metrics_compression_ratio(const rdpCompressionMetrics* entry)
+{
+	if (!entry || (entry->UncompressedBytes == 0))
+		return 0.0;
+
+	return ((double)entry->CompressedBytes) / ((double)entry->UncompressedBytes);
+}
+
 rdpMetrics* metrics_new(rdpContext* context)
 {
 	rdpMetrics* metrics = nullptr;
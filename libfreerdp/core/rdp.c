@@ -865,6 +865,50 @@ fail:
 	return rc;
 }
 
+BOOL rdp_send_data(rdpRdp* rdp, wStream* s, const BYTE* data, size_t size, UINT16 channelId,
+                   UINT16 sec_flags)
+{
+	BOOL rc = FALSE;
+	UINT32 pad = 0;
+
+	if (!s)
+		return FALSE;
+
+	if (!rdp || (!data && (size > 0)))
+		goto fail;
+
+	/* Encryption works in place, the data has to be part of the stream */
+	if (sec_flags & SEC_ENCRYPT)
+	{
+		if (!Stream_EnsureRemainingCapacity(s, size))
+			goto fail;
+		Stream_Write(s, data, size);
+		return rdp_send(rdp, s, channelId, sec_flags);
+	}
+
+	{
+		const size_t headerLength = Stream_GetPosition(s);
+		const size_t length = headerLength + size;
+		Stream_ResetPosition(s);
+		if (!rdp_write_header(rdp, s, length, channelId, sec_flags))
+			goto fail;
+
+		if (!rdp_security_stream_out(rdp, s, length, sec_flags, &pad))
+			goto fail;
+		WINPR_ASSERT(pad == 0);
+
+		const DataChunk chunks[] = { { .size = headerLength, .data = Stream_Buffer(s) },
+			                         { .size = size, .data = data } };
+		if (transport_write_chunks(rdp->transport, chunks, ARRAYSIZE(chunks)) < 0)
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	Stream_Release(s);
+	return rc;
+}
+
 BOOL rdp_send_pdu(rdpRdp* rdp, wStream* s, UINT16 type, UINT16 channel_id, UINT16 sec_flags)
 {
 	BOOL rc = FALSE;
@@ -231,6 +231,14 @@ FREERDP_LOCAL BOOL rdp_read_share_data_header(rdpRdp* rdp, wStream* s, UINT16* l
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL rdp_send(rdpRdp* rdp, wStream* s, UINT16 channelId, UINT16 sec_flags);
 
+/**
+ * @brief Like rdp_send, with \b data appended to the PDU in \b s. Unless the PDU is encrypted
+ * \b data is written to the transport without copying it into \b s.
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL rdp_send_data(rdpRdp* rdp, wStream* s, const BYTE* data, size_t size,
+                                 UINT16 channelId, UINT16 sec_flags);
+
 WINPR_ATTR_MALLOC(rdp_send, 2)
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL wStream* rdp_send_stream_init(rdpRdp* rdp, UINT16* sec_flags);
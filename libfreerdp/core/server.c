@@ -38,6 +38,16 @@
 #include <freerdp/constants.h>
 #include <freerdp/server/channels.h>
 #include <freerdp/channels/drdynvc.h>
+#include <freerdp/channels/rdpgfx.h>
+#include <freerdp/channels/geometry.h>
+#include <freerdp/channels/video.h>
+#include <freerdp/channels/rdpei.h>
+#include <freerdp/channels/ainput.h>
+#include <freerdp/channels/disp.h>
+#include <freerdp/channels/rdpemsc.h>
+#include <freerdp/channels/rdpsnd.h>
+#include <freerdp/channels/audin.h>
+#include <freerdp/rail.h>
 #include <freerdp/utils/drdynvc.h>
 
 #include "rdp.h"
@@ -55,6 +65,9 @@
 #endif
 
 #define DVC_MAX_DATA_PDU_SIZE 1600
+/* command byte, channel id and length of a DATA_FIRST PDU */
+#define DVC_MAX_DATA_HEADER_SIZE 9
+#define WTS_SEND_QUEUE_MIN_ITEMS 16
 
 typedef struct
 {
@@ -64,6 +77,58 @@ typedef struct
 	UINT32 offset;
 } wtsChannelMessage;
 
+typedef enum
+{
+	WTS_SEND_ITEM_SVC,     /* static channel message, sent in VCChunkSize packets */
+	WTS_SEND_ITEM_DVC_PDU, /* DVC PDUs of DVC_MAX_DATA_PDU_SIZE bytes, the last may be shorter */
+	WTS_SEND_ITEM_DVC_DATA /* DVC payload, the DATA PDU headers are added when sending */
+} wtsSendItemType;
+
+typedef struct
+{
+	wtsSendItemType type;
+	UINT16 channelId; /* static channel the data is sent on */
+	UINT32 dvcChannelId;
+	wStream* s; /* reference on the stream holding the data */
+	const BYTE* data;
+	size_t length;
+	size_t offset; /* bytes already sent */
+} wtsSendItem;
+
+struct wts_send_queue
+{
+	rdpPeerChannel* channel; /* nullptr after the channel was closed */
+	wtsSendItem* items;
+	size_t head;
+	size_t count;
+	size_t capacity;
+	WTS_CHANNEL_QUEUE_STATS stats;
+};
+
+/* Bytes a channel may send per WTSVirtualChannelManagerCheckFileDescriptor call, by priority */
+static const size_t wts_priority_budget[] = { 1024 * 1024, 256 * 1024, 128 * 1024, 64 * 1024 };
+
+static const struct
+{
+	const char* name;
+	WTS_CHANNEL_PRIORITY priority;
+} wts_channel_priorities[] = {
+	{ DRDYNVC_SVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_GRAPHICS },
+	{ RDPGFX_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_GRAPHICS },
+	{ GEOMETRY_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_GRAPHICS },
+	{ VIDEO_CONTROL_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_GRAPHICS },
+	{ VIDEO_DATA_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_GRAPHICS },
+	{ RDPEI_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_INPUT },
+	{ AINPUT_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_INPUT },
+	{ DISP_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_INPUT },
+	{ RDPEMSC_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_INPUT },
+	{ RAIL_SVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_INPUT },
+	{ RDPSND_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_AUDIO },
+	{ RDPSND_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_AUDIO },
+	{ RDPSND_LOSSY_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_AUDIO },
+	{ AUDIN_DVC_CHANNEL_NAME, WTS_CHANNEL_PRIORITY_AUDIO },
+};
+
 static const DWORD g_err_oom = WINPR_CXX_COMPAT_CAST(DWORD, E_OUTOFMEMORY);
 
 static DWORD g_SessionId = 1;
@@ -106,22 +171,6 @@ static BOOL wts_queue_receive_data(rdpPeerChannel* channel, const BYTE* Buffer1,
 	return MessageQueue_Post(channel->queue, messageCtx, 0, nullptr, nullptr);
 }
 
-static BOOL wts_queue_send_item(rdpPeerChannel* channel, BYTE* Buffer, UINT32 Length)
-{
-	BYTE* buffer = nullptr;
-	UINT32 length = 0;
-
-	WINPR_ASSERT(channel);
-	WINPR_ASSERT(channel->vcm);
-	buffer = Buffer;
-	length = Length;
-
-	WINPR_ASSERT(channel->channelId <= UINT16_MAX);
-	const UINT16 channelId = (UINT16)channel->channelId;
-	return MessageQueue_Post(channel->vcm->queue, (void*)(UINT_PTR)channelId, 0, (void*)buffer,
-	                         (void*)(UINT_PTR)length);
-}
-
 static unsigned wts_read_variable_uint(wStream* s, int cbLen, UINT32* val)
 {
 	WINPR_ASSERT(s);
@@ -181,7 +230,7 @@ static BOOL wts_read_drdynvc_capabilities_response(rdpPeerChannel* channel, wStr
 	/* we only support version 1 for now (no compression yet) */
 	vcm->dvc_spoken_version = MAX(Version, 1);
 
-	return SetEvent(MessageQueue_Event(vcm->queue));
+	return SetEvent(vcm->sendEvent);
 }
 
 static BOOL wts_read_drdynvc_create_response(rdpPeerChannel* channel, wStream* s)
@@ -456,6 +505,400 @@ static BOOL wts_write_drdynvc_create_request(wStream* s, UINT32 ChannelId, const
 	return TRUE;
 }
 
+/* Writes the header of the next DATA or DATA_FIRST PDU for length bytes left to send and returns
+ * the number of bytes fitting the PDU */
+static size_t wts_write_drdynvc_data_header(wStream* s, UINT32 ChannelId, BOOL first,
+                                            size_t length)
+{
+	WINPR_ASSERT(s);
+	WINPR_ASSERT(Stream_GetRemainingCapacity(s) >= DVC_MAX_DATA_HEADER_SIZE);
+
+	const size_t start = Stream_GetPosition(s);
+	BYTE* bm = Stream_PointerAs(s, BYTE);
+	Stream_Seek_UINT8(s);
+	const int cbChId = wts_write_variable_uint(s, ChannelId);
+	size_t available = DVC_MAX_DATA_PDU_SIZE - (Stream_GetPosition(s) - start);
+
+	if (first && (length > available))
+	{
+		const int cbLen = wts_write_variable_uint(s, WINPR_ASSERTING_INT_CAST(uint32_t, length));
+		*bm = ((DATA_FIRST_PDU << 4) | (cbLen << 2) | cbChId) & 0xFF;
+		available = DVC_MAX_DATA_PDU_SIZE - (Stream_GetPosition(s) - start);
+	}
+	else
+	{
+		*bm = ((DATA_PDU << 4) | cbChId) & 0xFF;
+	}
+
+	return MIN(available, length);
+}
+
+static wStream* wts_write_drdynvc_data(UINT32 ChannelId, const BYTE* data, size_t length)
+{
+	const size_t pdus = length / (DVC_MAX_DATA_PDU_SIZE - DVC_MAX_DATA_HEADER_SIZE) + 1;
+	wStream* s = Stream_New(nullptr, length + pdus * DVC_MAX_DATA_HEADER_SIZE);
+
+	if (!s)
+		return nullptr;
+
+	for (size_t offset = 0; offset < length;)
+	{
+		if (!Stream_EnsureRemainingCapacity(s, DVC_MAX_DATA_PDU_SIZE))
+		{
+			Stream_Free(s, TRUE);
+			return nullptr;
+		}
+
+		const size_t size =
+		    wts_write_drdynvc_data_header(s, ChannelId, offset == 0, length - offset);
+		Stream_Write(s, &data[offset], size);
+		offset += size;
+	}
+
+	return s;
+}
+
+static WTS_CHANNEL_PRIORITY wts_channel_default_priority(const rdpPeerChannel* channel)
+{
+	WINPR_ASSERT(channel);
+
+	if (channel->channelType == RDP_PEER_CHANNEL_TYPE_DVC)
+	{
+		switch (channel->channelFlags & WTS_CHANNEL_OPTION_DYNAMIC_PRI_REAL)
+		{
+			case WTS_CHANNEL_OPTION_DYNAMIC_PRI_REAL:
+				return WTS_CHANNEL_PRIORITY_GRAPHICS;
+			case WTS_CHANNEL_OPTION_DYNAMIC_PRI_HIGH:
+				return WTS_CHANNEL_PRIORITY_INPUT;
+			case WTS_CHANNEL_OPTION_DYNAMIC_PRI_MED:
+				return WTS_CHANNEL_PRIORITY_AUDIO;
+			default:
+				break;
+		}
+	}
+
+	for (size_t x = 0; x < ARRAYSIZE(wts_channel_priorities); x++)
+	{
+		if (_stricmp(channel->channelName, wts_channel_priorities[x].name) == 0)
+			return wts_channel_priorities[x].priority;
+	}
+
+	return WTS_CHANNEL_PRIORITY_BULK;
+}
+
+static void wts_send_queue_pop(wtsSendQueue* queue, BOOL sent)
+{
+	WINPR_ASSERT(queue);
+	WINPR_ASSERT(queue->count > 0);
+
+	wtsSendItem* item = &queue->items[queue->head];
+	queue->stats.queuedBytes -= item->length - item->offset;
+	if (sent)
+		queue->stats.sentMessages++;
+
+	Stream_Release(item->s);
+	const wtsSendItem empty = WINPR_C_ARRAY_INIT;
+	*item = empty;
+
+	queue->head = (queue->head + 1) % queue->capacity;
+	queue->count--;
+	queue->stats.queuedMessages = queue->count;
+}
+
+static BOOL wts_send_queue_push(wtsSendQueue* queue, const wtsSendItem* item)
+{
+	WINPR_ASSERT(queue);
+	WINPR_ASSERT(item);
+
+	if (queue->count == queue->capacity)
+	{
+		const size_t capacity = MAX(WTS_SEND_QUEUE_MIN_ITEMS, queue->capacity * 2);
+		wtsSendItem* items = calloc(capacity, sizeof(wtsSendItem));
+		if (!items)
+			return FALSE;
+
+		for (size_t x = 0; x < queue->count; x++)
+			items[x] = queue->items[(queue->head + x) % queue->capacity];
+
+		free(queue->items);
+		queue->items = items;
+		queue->head = 0;
+		queue->capacity = capacity;
+	}
+
+	queue->items[(queue->head + queue->count) % queue->capacity] = *item;
+	queue->count++;
+	queue->stats.queuedMessages = queue->count;
+	queue->stats.queuedBytes += item->length;
+	queue->stats.maxQueuedBytes = MAX(queue->stats.maxQueuedBytes, queue->stats.queuedBytes);
+	return TRUE;
+}
+
+static void wts_send_queue_free(void* obj)
+{
+	wtsSendQueue* queue = obj;
+
+	if (!queue)
+		return;
+
+	while (queue->count > 0)
+		wts_send_queue_pop(queue, FALSE);
+
+	if (queue->channel)
+		queue->channel->sendQueue = nullptr;
+
+	free(queue->items);
+	free(queue);
+}
+
+static BOOL wts_send_queue_attach(WTSVirtualChannelManager* vcm, rdpPeerChannel* channel)
+{
+	WINPR_ASSERT(vcm);
+	WINPR_ASSERT(channel);
+
+	wtsSendQueue* queue = calloc(1, sizeof(wtsSendQueue));
+	if (!queue)
+		return FALSE;
+
+	queue->channel = channel;
+	queue->stats.priority = wts_channel_default_priority(channel);
+
+	EnterCriticalSection(&vcm->sendLock);
+	const BOOL rc = ArrayList_Append(vcm->sendQueues, queue);
+	if (rc)
+		channel->sendQueue = queue;
+	LeaveCriticalSection(&vcm->sendLock);
+
+	if (!rc)
+		free(queue);
+	return rc;
+}
+
+static void wts_send_queue_detach(rdpPeerChannel* channel)
+{
+	WINPR_ASSERT(channel);
+
+	/* The queue is gone if the channel manager was closed first */
+	if (!channel->sendQueue)
+		return;
+
+	WTSVirtualChannelManager* vcm = channel->vcm;
+	WINPR_ASSERT(vcm);
+
+	EnterCriticalSection(&vcm->sendLock);
+	wtsSendQueue* queue = channel->sendQueue;
+	channel->sendQueue = nullptr;
+	queue->channel = nullptr;
+
+	/* Data written before the channel was closed is still sent */
+	if (queue->count == 0)
+		ArrayList_Remove(vcm->sendQueues, queue);
+	LeaveCriticalSection(&vcm->sendLock);
+}
+
+/* Queues length bytes of data held by s, the reference on s is released in any case */
+static BOOL wts_queue_send_item(rdpPeerChannel* channel, wtsSendItemType type, UINT16 channelId,
+                                wStream* s, const BYTE* data, size_t length)
+{
+	BOOL rc = FALSE;
+
+	WINPR_ASSERT(channel);
+	WINPR_ASSERT(channel->vcm);
+	WINPR_ASSERT(s);
+
+	if (length == 0)
+	{
+		Stream_Release(s);
+		return TRUE;
+	}
+
+	const wtsSendItem item = { .type = type,
+		                       .channelId = channelId,
+		                       .dvcChannelId = channel->channelId,
+		                       .s = s,
+		                       .data = data,
+		                       .length = length,
+		                       .offset = 0 };
+
+	WTSVirtualChannelManager* vcm = channel->vcm;
+	EnterCriticalSection(&vcm->sendLock);
+	if (channel->sendQueue)
+		rc = wts_send_queue_push(channel->sendQueue, &item);
+	if (rc)
+		(void)SetEvent(vcm->sendEvent);
+	LeaveCriticalSection(&vcm->sendLock);
+
+	if (!rc)
+	{
+		SetLastError(g_err_oom);
+		Stream_Release(s);
+	}
+	return rc;
+}
+
+/* Sends the next packet of an item, returns the number of item bytes sent or -1 */
+static SSIZE_T wts_send_item_packet(WTSVirtualChannelManager* vcm, const wtsSendItem* item,
+                                    size_t chunkSize)
+{
+	WINPR_ASSERT(vcm);
+	WINPR_ASSERT(item);
+
+	freerdp_peer* client = vcm->client;
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->SendChannelData);
+	WINPR_ASSERT(client->SendChannelPacket);
+
+	const BYTE* data = &item->data[item->offset];
+	const size_t left = item->length - item->offset;
+	size_t size = 0;
+
+	switch (item->type)
+	{
+		case WTS_SEND_ITEM_SVC:
+		{
+			UINT32 flags = 0;
+			size = MIN(left, chunkSize);
+			if (item->offset == 0)
+				flags |= CHANNEL_FLAG_FIRST;
+			if (size == left)
+				flags |= CHANNEL_FLAG_LAST;
+
+			if (!client->SendChannelPacket(client, item->channelId, item->length, flags, data,
+			                               size))
+				return -1;
+		}
+		break;
+
+		case WTS_SEND_ITEM_DVC_PDU:
+			size = MIN(left, DVC_MAX_DATA_PDU_SIZE);
+			if (!client->SendChannelData(client, item->channelId, data, size))
+				return -1;
+			break;
+
+		case WTS_SEND_ITEM_DVC_DATA:
+		{
+			wStream* s = vcm->sendBuffer;
+			Stream_ResetPosition(s);
+			size = wts_write_drdynvc_data_header(s, item->dvcChannelId, item->offset == 0, left);
+			Stream_Write(s, data, size);
+			if (!client->SendChannelData(client, item->channelId, Stream_Buffer(s),
+			                             Stream_GetPosition(s)))
+				return -1;
+		}
+		break;
+
+		default:
+			return -1;
+	}
+
+	return WINPR_ASSERTING_INT_CAST(SSIZE_T, size);
+}
+
+/* Called with sendLock held. The lock is released while a packet is sent, so writers are not
+ * blocked by a slow connection. The item stays at the head of the queue meanwhile, which also
+ * keeps the queue in the list. */
+static BOOL wts_send_queue_flush(WTSVirtualChannelManager* vcm, wtsSendQueue* queue,
+                                 size_t budget, size_t chunkSize, UINT16 drdynvcId)
+{
+	size_t sent = 0;
+
+	WINPR_ASSERT(queue);
+
+	while (queue->count > 0)
+	{
+		const wtsSendItem item = queue->items[queue->head];
+
+		/* All DVCs share the drdynvc channel, a message on it must not be interrupted */
+		const BOOL partial =
+		    (item.type == WTS_SEND_ITEM_SVC) && (item.channelId == drdynvcId) && (item.offset > 0);
+		if ((sent >= budget) && !partial)
+			break;
+
+		LeaveCriticalSection(&vcm->sendLock);
+		const SSIZE_T rc = wts_send_item_packet(vcm, &item, chunkSize);
+		EnterCriticalSection(&vcm->sendLock);
+
+		if (rc < 0)
+		{
+			wts_send_queue_pop(queue, FALSE);
+			return FALSE;
+		}
+
+		/* Writers may have grown the queue meanwhile, the head item is still the same */
+		wtsSendItem* cur = &queue->items[queue->head];
+		const size_t size = (size_t)rc;
+		cur->offset += size;
+		sent += size;
+		queue->stats.queuedBytes -= size;
+		queue->stats.sentBytes += size;
+
+		if (cur->offset >= cur->length)
+			wts_send_queue_pop(queue, TRUE);
+	}
+
+	return TRUE;
+}
+
+/* Every channel sends up to the budget of its priority class, higher classes first. Channels of
+ * the same class take turns to go first. */
+static BOOL wts_send_queues_flush(WTSVirtualChannelManager* vcm)
+{
+	BOOL rc = TRUE;
+	BOOL pending = FALSE;
+
+	WINPR_ASSERT(vcm);
+	WINPR_ASSERT(vcm->client);
+	WINPR_ASSERT(vcm->client->context);
+
+	const size_t chunkSize =
+	    freerdp_settings_get_uint32(vcm->client->context->settings, FreeRDP_VCChunkSize);
+	if (chunkSize == 0)
+		return FALSE;
+
+	/* A single flush at a time, the head items are sent without holding sendLock */
+	EnterCriticalSection(&vcm->flushLock);
+	EnterCriticalSection(&vcm->sendLock);
+	UINT16 drdynvcId = 0;
+	if (vcm->drdynvc_channel)
+		drdynvcId = WINPR_ASSERTING_INT_CAST(UINT16, vcm->drdynvc_channel->channelId);
+
+	for (size_t priority = 0; rc && (priority < ARRAYSIZE(wts_priority_budget)); priority++)
+	{
+		/* Queues of closed channels might be removed while sendLock is not held */
+		const size_t count = ArrayList_Count(vcm->sendQueues);
+		for (size_t x = 0; rc && (x < count); x++)
+		{
+			wtsSendQueue* queue =
+			    ArrayList_GetItem(vcm->sendQueues, (vcm->sendRotation + x) % count);
+			if (!queue || (queue->stats.priority != priority))
+				continue;
+
+			rc = wts_send_queue_flush(vcm, queue, wts_priority_budget[priority], chunkSize,
+			                          drdynvcId);
+		}
+	}
+	vcm->sendRotation++;
+
+	for (size_t x = ArrayList_Count(vcm->sendQueues); x > 0; x--)
+	{
+		wtsSendQueue* queue = ArrayList_GetItem(vcm->sendQueues, x - 1);
+		if (queue->count > 0)
+			pending = TRUE;
+		else if (!queue->channel)
+			ArrayList_RemoveAt(vcm->sendQueues, x - 1);
+	}
+
+	/* Keep the event set while data exceeding the budgets is left */
+	if (pending)
+		(void)SetEvent(vcm->sendEvent);
+	else
+		(void)ResetEvent(vcm->sendEvent);
+	LeaveCriticalSection(&vcm->sendLock);
+	LeaveCriticalSection(&vcm->flushLock);
+
+	return rc;
+}
+
 static BOOL WTSProcessChannelData(rdpPeerChannel* channel, UINT16 channelId, const BYTE* data,
                                   size_t s, UINT32 flags, size_t t)
 {
@@ -581,7 +1024,7 @@ void WTSVirtualChannelManagerGetFileDescriptor(HANDLE hServer, void** fds, int*
 	WINPR_ASSERT(fds);
 	WINPR_ASSERT(fds_count);
 
-	fd = GetEventWaitObject(MessageQueue_Event(vcm->queue));
+	fd = GetEventWaitObject(vcm->sendEvent);
 
 	if (fd)
 	{
@@ -649,8 +1092,6 @@ BOOL WTSVirtualChannelManagerOpen(HANDLE hServer)
 
 BOOL WTSVirtualChannelManagerCheckFileDescriptorEx(HANDLE hServer, BOOL autoOpen)
 {
-	wMessage message = WINPR_C_ARRAY_INIT;
-	BOOL status = TRUE;
 	WTSVirtualChannelManager* vcm = nullptr;
 
 	if (!hServer || hServer == INVALID_HANDLE_VALUE)
@@ -664,29 +1105,7 @@ BOOL WTSVirtualChannelManagerCheckFileDescriptorEx(HANDLE hServer, BOOL autoOpen
 			return FALSE;
 	}
 
-	while (MessageQueue_Peek(vcm->queue, &message, TRUE))
-	{
-		BYTE* buffer = nullptr;
-		UINT32 length = 0;
-		UINT16 channelId = 0;
-		channelId = (UINT16)(UINT_PTR)message.context;
-		buffer = (BYTE*)message.wParam;
-		length = (UINT32)(UINT_PTR)message.lParam;
-
-		WINPR_ASSERT(vcm->client);
-		WINPR_ASSERT(vcm->client->SendChannelData);
-		if (!vcm->client->SendChannelData(vcm->client, channelId, buffer, length))
-		{
-			status = FALSE;
-		}
-
-		free(buffer);
-
-		if (!status)
-			break;
-	}
-
-	return status;
+	return wts_send_queues_flush(vcm);
 }
 
 BOOL WTSVirtualChannelManagerCheckFileDescriptor(HANDLE hServer)
@@ -698,7 +1117,7 @@ HANDLE WTSVirtualChannelManagerGetEventHandle(HANDLE hServer)
 {
 	WTSVirtualChannelManager* vcm = (WTSVirtualChannelManager*)hServer;
 	WINPR_ASSERT(vcm);
-	return MessageQueue_Event(vcm->queue);
+	return vcm->sendEvent;
 }
 
 static rdpMcsChannel* wts_get_joined_channel_by_name(rdpMcs* mcs, const char* channel_name)
@@ -1015,21 +1434,10 @@ HANDLE WINAPI FreeRDP_WTSOpenServerW(WINPR_ATTR_UNUSED LPWSTR pServerName)
 	return INVALID_HANDLE_VALUE;
 }
 
-static void wts_virtual_channel_manager_free_message(void* obj)
-{
-	wMessage* msg = (wMessage*)obj;
-
-	if (msg)
-	{
-		BYTE* buffer = (BYTE*)msg->wParam;
-
-		if (buffer)
-			free(buffer);
-	}
-}
-
 static void channel_free(rdpPeerChannel* channel)
 {
+	if (channel)
+		wts_send_queue_detach(channel);
 	server_channel_common_free(channel);
 }
 
@@ -1099,7 +1507,12 @@ static void wtsCloseVCM(WTSVirtualChannelManager* vcm, bool closeDrdynvc)
 			vcm->drdynvc_channel = nullptr;
 		}
 
-		MessageQueue_Free(vcm->queue);
+		ArrayList_Free(vcm->sendQueues);
+		Stream_Free(vcm->sendBuffer, TRUE);
+		if (vcm->sendEvent)
+			(void)CloseHandle(vcm->sendEvent);
+		DeleteCriticalSection(&vcm->sendLock);
+		DeleteCriticalSection(&vcm->flushLock);
 		free(vcm);
 	}
 	HashTable_Unlock(g_ServerHandles);
@@ -1107,8 +1520,6 @@ static void wtsCloseVCM(WTSVirtualChannelManager* vcm, bool closeDrdynvc)
 
 HANDLE WINAPI FreeRDP_WTSOpenServerA(LPSTR pServerName)
 {
-	wObject queueCallbacks = WINPR_C_ARRAY_INIT;
-
 	rdpContext* context = (rdpContext*)pServerName;
 
 	if (!setup() || !context)
@@ -1127,15 +1538,29 @@ HANDLE WINAPI FreeRDP_WTSOpenServerA(LPSTR pServerName)
 	if (!vcm)
 		goto fail;
 
+	InitializeCriticalSection(&vcm->sendLock);
+	InitializeCriticalSection(&vcm->flushLock);
 	vcm->client = client;
 	vcm->rdp = context->rdp;
 
-	queueCallbacks.fnObjectFree = wts_virtual_channel_manager_free_message;
-	vcm->queue = MessageQueue_New(&queueCallbacks);
+	vcm->sendEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!vcm->sendEvent)
+		goto fail;
+
+	vcm->sendBuffer = Stream_New(nullptr, DVC_MAX_DATA_PDU_SIZE);
+	if (!vcm->sendBuffer)
+		goto fail;
 
-	if (!vcm->queue)
+	vcm->sendQueues = ArrayList_New(FALSE);
+	if (!vcm->sendQueues)
 		goto fail;
 
+	{
+		wObject* obj = ArrayList_Object(vcm->sendQueues);
+		WINPR_ASSERT(obj);
+		obj->fnObjectFree = wts_send_queue_free;
+	}
+
 	vcm->dvc_channel_id_seq = 0;
 	vcm->dynamicVirtualChannels = HashTable_New(TRUE);
 
@@ -1425,6 +1850,9 @@ static rdpPeerChannel* channel_new(WTSVirtualChannelManager* vcm, freerdp_peer*
 	    (type == RDP_PEER_CHANNEL_TYPE_SVC) ? ERROR_SUCCESS : ERROR_OPERATION_IN_PROGRESS;
 	channel->channelFlags = flags;
 
+	if (!wts_send_queue_attach(vcm, channel))
+		goto fail;
+
 	return channel;
 fail:
 	channel_free(channel);
@@ -1512,7 +1940,6 @@ HANDLE WINAPI FreeRDP_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualNam
 	wStream* s = nullptr;
 	rdpPeerChannel* channel = nullptr;
 	BOOL joined = FALSE;
-	ULONG written = 0;
 
 	if (!setup())
 		return nullptr;
@@ -1597,10 +2024,12 @@ HANDLE WINAPI FreeRDP_WTSVirtualChannelOpenEx(DWORD SessionId, LPSTR pVirtualNam
 		goto fail;
 
 	{
-		const size_t pos = Stream_GetPosition(s);
-		WINPR_ASSERT(pos <= UINT32_MAX);
-		if (!WTSVirtualChannelWrite(vcm->drdynvc_channel, Stream_BufferAs(s, char), (UINT32)pos,
-		                            &written))
+		/* Queued with the channel data to keep the order */
+		const UINT16 drdynvcId = WINPR_ASSERTING_INT_CAST(UINT16, vcm->drdynvc_channel->channelId);
+		wStream* pdu = s;
+		s = nullptr;
+		if (!wts_queue_send_item(channel, WTS_SEND_ITEM_DVC_PDU, drdynvcId, pdu,
+		                         Stream_Buffer(pdu), Stream_GetPosition(pdu)))
 			goto fail;
 	}
 
@@ -1651,7 +2080,6 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelClose(HANDLE hChannelHandle)
 		{
 			if (channel->dvc_open_state == DVC_OPEN_STATE_SUCCEEDED)
 			{
-				ULONG written = 0;
 				s = Stream_New(nullptr, 8);
 
 				if (!s)
@@ -1659,15 +2087,20 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelClose(HANDLE hChannelHandle)
 					WLog_ERR(TAG, "Stream_New failed!");
 					ret = FALSE;
 				}
+				else if (!vcm->drdynvc_channel)
+				{
+					Stream_Free(s, TRUE);
+					ret = FALSE;
+				}
 				else
 				{
 					wts_write_drdynvc_header(s, CLOSE_REQUEST_PDU, channel->channelId);
 
-					const size_t pos = Stream_GetPosition(s);
-					WINPR_ASSERT(pos <= UINT32_MAX);
-					ret = WTSVirtualChannelWrite(vcm->drdynvc_channel, Stream_BufferAs(s, char),
-					                             (UINT32)pos, &written);
-					Stream_Free(s, TRUE);
+					/* Queued behind the data written before, the queue outlives the channel */
+					const UINT16 drdynvcId =
+					    WINPR_ASSERTING_INT_CAST(UINT16, vcm->drdynvc_channel->channelId);
+					ret = wts_queue_send_item(channel, WTS_SEND_ITEM_DVC_PDU, drdynvcId, s,
+					                          Stream_Buffer(s), Stream_GetPosition(s));
 				}
 			}
 			HashTable_Remove(vcm->dynamicVirtualChannels, &channel->channelId);
@@ -1728,11 +2161,6 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
                                            PULONG pBytesWritten)
 {
 	wStream* s = nullptr;
-	int cbLen = 0;
-	int cbChId = 0;
-	int first = 0;
-	BYTE* buffer = nullptr;
-	size_t totalWritten = 0;
 	rdpPeerChannel* channel = (rdpPeerChannel*)hChannelHandle;
 	BOOL ret = FALSE;
 
@@ -1743,18 +2171,18 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
 	WINPR_ASSERT(channel->vcm);
 	if (channel->channelType == RDP_PEER_CHANNEL_TYPE_SVC)
 	{
-		buffer = (BYTE*)malloc(uLength);
+		s = Stream_New(nullptr, MAX(uLength, 1));
 
-		if (!buffer)
+		if (!s)
 		{
 			SetLastError(g_err_oom);
 			goto fail;
 		}
 
-		CopyMemory(buffer, Buffer, uLength);
-		totalWritten = uLength;
-		if (!wts_queue_send_item(channel, buffer, uLength))
-			goto fail;
+		Stream_Write(s, Buffer, uLength);
+		ret = wts_queue_send_item(channel, WTS_SEND_ITEM_SVC,
+		                          WINPR_ASSERTING_INT_CAST(UINT16, channel->channelId), s,
+		                          Stream_Buffer(s), uLength);
 	}
 	else if (!channel->vcm->drdynvc_channel || (channel->vcm->drdynvc_state != DRDYNVC_STATE_READY))
 	{
@@ -1763,62 +2191,107 @@ BOOL WINAPI FreeRDP_WTSVirtualChannelWrite(HANDLE hChannelHandle, PCHAR Buffer,
 	}
 	else
 	{
-		first = TRUE;
+		/* Build all PDUs in one buffer that is sent without further copies */
+		s = wts_write_drdynvc_data(channel->channelId, (const BYTE*)Buffer, uLength);
 
-		size_t Length = uLength;
-		while (Length > 0)
+		if (!s)
 		{
-			s = Stream_New(nullptr, DVC_MAX_DATA_PDU_SIZE);
+			WLog_ERR(TAG, "wts_write_drdynvc_data failed!");
+			SetLastError(g_err_oom);
+			goto fail;
+		}
 
-			if (!s)
-			{
-				WLog_ERR(TAG, "Stream_New failed!");
-				SetLastError(g_err_oom);
-				goto fail;
-			}
+		const UINT16 drdynvcId =
+		    WINPR_ASSERTING_INT_CAST(UINT16, channel->vcm->drdynvc_channel->channelId);
+		ret = wts_queue_send_item(channel, WTS_SEND_ITEM_DVC_PDU, drdynvcId, s, Stream_Buffer(s),
+		                          Stream_GetPosition(s));
+	}
 
-			buffer = Stream_Buffer(s);
-			Stream_Seek_UINT8(s);
-			cbChId = wts_write_variable_uint(s, channel->channelId);
+	if (ret && pBytesWritten)
+		*pBytesWritten = uLength;
 
-			if (first && (Length > Stream_GetRemainingLength(s)))
-			{
-				cbLen = wts_write_variable_uint(s, WINPR_ASSERTING_INT_CAST(uint32_t, Length));
-				buffer[0] = ((DATA_FIRST_PDU << 4) | (cbLen << 2) | cbChId) & 0xFF;
-			}
-			else
-			{
-				buffer[0] = ((DATA_PDU << 4) | cbChId) & 0xFF;
-			}
+fail:
+	LeaveCriticalSection(&channel->writeLock);
+	return ret;
+}
 
-			first = FALSE;
-			size_t written = Stream_GetRemainingLength(s);
-
-			if (written > Length)
-				written = Length;
-
-			Stream_Write(s, Buffer, written);
-			const size_t length = Stream_GetPosition(s);
-			Stream_Free(s, FALSE);
-			if (length > UINT32_MAX)
-				goto fail;
-			Length -= written;
-			Buffer += written;
-			totalWritten += written;
-			if (!wts_queue_send_item(channel->vcm->drdynvc_channel, buffer, (UINT32)length))
-				goto fail;
-		}
-	}
+BOOL WTSVirtualChannelWriteStream(HANDLE hChannelHandle, wStream* s, PULONG pBytesWritten)
+{
+	rdpPeerChannel* channel = (rdpPeerChannel*)hChannelHandle;
+	BOOL ret = FALSE;
 
-	if (pBytesWritten)
-		*pBytesWritten = WINPR_ASSERTING_INT_CAST(uint32_t, totalWritten);
+	if (!s)
+		return FALSE;
 
-	ret = TRUE;
-fail:
+	const size_t length = Stream_GetPosition(s);
+	if (!channel || !channel->vcm || (length > UINT32_MAX))
+	{
+		Stream_Release(s);
+		return FALSE;
+	}
+
+	EnterCriticalSection(&channel->writeLock);
+	if (channel->channelType == RDP_PEER_CHANNEL_TYPE_SVC)
+	{
+		ret = wts_queue_send_item(channel, WTS_SEND_ITEM_SVC,
+		                          WINPR_ASSERTING_INT_CAST(UINT16, channel->channelId), s,
+		                          Stream_Buffer(s), length);
+	}
+	else if (!channel->vcm->drdynvc_channel || (channel->vcm->drdynvc_state != DRDYNVC_STATE_READY))
+	{
+		DEBUG_DVC("drdynvc not ready");
+		Stream_Release(s);
+	}
+	else
+	{
+		const UINT16 drdynvcId =
+		    WINPR_ASSERTING_INT_CAST(UINT16, channel->vcm->drdynvc_channel->channelId);
+		ret = wts_queue_send_item(channel, WTS_SEND_ITEM_DVC_DATA, drdynvcId, s, Stream_Buffer(s),
+		                          length);
+	}
 	LeaveCriticalSection(&channel->writeLock);
+
+	if (ret && pBytesWritten)
+		*pBytesWritten = (ULONG)length;
 	return ret;
 }
 
+BOOL WTSVirtualChannelSetPriority(HANDLE hChannelHandle, WTS_CHANNEL_PRIORITY priority)
+{
+	rdpPeerChannel* channel = (rdpPeerChannel*)hChannelHandle;
+	BOOL rc = FALSE;
+
+	if (!channel || !channel->vcm || ((size_t)priority >= ARRAYSIZE(wts_priority_budget)))
+		return FALSE;
+
+	EnterCriticalSection(&channel->vcm->sendLock);
+	if (channel->sendQueue)
+	{
+		channel->sendQueue->stats.priority = priority;
+		rc = TRUE;
+	}
+	LeaveCriticalSection(&channel->vcm->sendLock);
+	return rc;
+}
+
+BOOL WTSVirtualChannelGetQueueStats(HANDLE hChannelHandle, WTS_CHANNEL_QUEUE_STATS* stats)
+{
+	rdpPeerChannel* channel = (rdpPeerChannel*)hChannelHandle;
+	BOOL rc = FALSE;
+
+	if (!channel || !channel->vcm || !stats)
+		return FALSE;
+
+	EnterCriticalSection(&channel->vcm->sendLock);
+	if (channel->sendQueue)
+	{
+		*stats = channel->sendQueue->stats;
+		rc = TRUE;
+	}
+	LeaveCriticalSection(&channel->vcm->sendLock);
+	return rc;
+}
+
 BOOL WINAPI FreeRDP_WTSVirtualChannelPurgeInput(WINPR_ATTR_UNUSED HANDLE hChannelHandle)
 {
 	WLog_ERR("TODO", "TODO: implement");
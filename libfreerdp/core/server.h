@@ -31,6 +31,7 @@
 
 typedef struct rdp_peer_channel rdpPeerChannel;
 typedef struct WTSVirtualChannelManager WTSVirtualChannelManager;
+typedef struct wts_send_queue wtsSendQueue;
 
 #include "rdp.h"
 #include "mcs.h"
@@ -62,6 +63,7 @@ struct rdp_peer_channel
 
 	wStream* receiveData;
 	wMessageQueue* queue;
+	wtsSendQueue* sendQueue;
 
 	BYTE dvc_open_state;
 	INT32 creationStatus;
@@ -78,7 +80,14 @@ struct WTSVirtualChannelManager
 	freerdp_peer* client;
 
 	DWORD SessionId;
-	wMessageQueue* queue;
+
+	/* Outgoing data, one wtsSendQueue per channel */
+	HANDLE sendEvent;
+	CRITICAL_SECTION sendLock;
+	CRITICAL_SECTION flushLock;
+	wArrayList* sendQueues;
+	size_t sendRotation;
+	wStream* sendBuffer;
 
 	rdpPeerChannel* drdynvc_channel;
 	BYTE drdynvc_state;
@@ -39,6 +39,7 @@
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <net/if.h>
@@ -133,6 +134,67 @@ static int transport_bio_simple_write(BIO* bio, const char* buf, int size)
 	return status;
 }
 
+static long transport_bio_simple_writev(BIO* bio, const DataChunk* chunks, size_t count)
+{
+	long status = 0;
+	WINPR_BIO_SIMPLE_SOCKET* ptr = (WINPR_BIO_SIMPLE_SOCKET*)BIO_get_data(bio);
+
+	if (!chunks || (count == 0) || (count > BIO_WRITEV_MAX_CHUNKS))
+		return 0;
+
+	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
+
+#if defined(_WIN32)
+	WSABUF buffers[BIO_WRITEV_MAX_CHUNKS] = WINPR_C_ARRAY_INIT;
+	for (size_t i = 0; i < count; i++)
+	{
+		buffers[i].buf = (CHAR*)chunks[i].data;
+		buffers[i].len = (ULONG)MIN(chunks[i].size, INT32_MAX);
+	}
+
+	DWORD sent = 0;
+	if (WSASend(ptr->socket, buffers, (DWORD)count, &sent, 0, nullptr, nullptr) == 0)
+		status = (long)MIN(sent, INT32_MAX);
+	else
+		status = -1;
+#else
+	struct iovec iov[BIO_WRITEV_MAX_CHUNKS] = WINPR_C_ARRAY_INIT;
+	for (size_t i = 0; i < count; i++)
+	{
+		iov[i].iov_base = (void*)chunks[i].data;
+		iov[i].iov_len = MIN(chunks[i].size, INT32_MAX);
+	}
+
+	struct msghdr msg = WINPR_C_ARRAY_INIT;
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+
+	int flags = 0;
+#if defined(MSG_NOSIGNAL)
+	flags |= MSG_NOSIGNAL;
+#endif
+	const ssize_t rc = sendmsg((int)ptr->socket, &msg, flags);
+	status = (long)MIN(rc, INT32_MAX);
+#endif
+
+	if (status <= 0)
+	{
+		const int error = WSAGetLastError();
+
+		if ((error == WSAEWOULDBLOCK) || (error == WSAEINTR) || (error == WSAEINPROGRESS) ||
+		    (error == WSAEALREADY))
+		{
+			BIO_set_flags(bio, (BIO_FLAGS_WRITE | BIO_FLAGS_SHOULD_RETRY));
+		}
+		else
+		{
+			BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+		}
+	}
+
+	return status;
+}
+
 static int transport_bio_simple_read(BIO* bio, char* buf, int size)
 {
 	int error = 0;
@@ -190,6 +252,8 @@ static long transport_bio_simple_ctrl(BIO* bio, int cmd, long arg1, void* arg2)
 
 	switch (cmd)
 	{
+		case BIO_C_WRITEV:
+			return transport_bio_simple_writev(bio, (const DataChunk*)arg2, (size_t)arg1);
 		case BIO_C_SET_SOCKET:
 			transport_bio_simple_uninit(bio);
 			transport_bio_simple_init(bio, (SOCKET)arg2, (int)arg1);
@@ -457,14 +521,73 @@ typedef struct
 	RingBuffer xmitBuffer;
 } WINPR_BIO_BUFFERED_SOCKET;
 
-static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
+/* Writes as much of \b data as the next BIO takes, FALSE on a fatal error */
+static BOOL transport_bio_buffered_send(BIO* bio, const BYTE* data, size_t size, size_t* written)
+{
+	WINPR_BIO_BUFFERED_SOCKET* ptr = (WINPR_BIO_BUFFERED_SOCKET*)BIO_get_data(bio);
+	BIO* next_bio = BIO_next(bio);
+
+	WINPR_ASSERT(ptr);
+	WINPR_ASSERT(written);
+
+	*written = 0;
+	while (*written < size)
+	{
+		ERR_clear_error();
+
+		const size_t wr = MIN(INT32_MAX, size - *written);
+		const int status = BIO_write(next_bio, &data[*written], (int)wr);
+
+		if (status <= 0)
+		{
+			if (!BIO_should_retry(next_bio))
+			{
+				BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+				return FALSE;
+			}
+
+			if (BIO_should_write(next_bio))
+			{
+				BIO_set_flags(bio, BIO_FLAGS_WRITE);
+				ptr->writeBlocked = TRUE;
+				return TRUE; /* EWOULDBLOCK */
+			}
+		}
+		else
+			*written += (size_t)status;
+	}
+
+	return TRUE;
+}
+
+/* Sends the queued data, FALSE on a fatal error */
+static BOOL transport_bio_buffered_flush_queue(BIO* bio)
 {
-	int ret = num;
-	int nchunks = 0;
+	BOOL rc = TRUE;
 	size_t committedBytes = 0;
 	DataChunk chunks[2] = WINPR_C_ARRAY_INIT;
 	WINPR_BIO_BUFFERED_SOCKET* ptr = (WINPR_BIO_BUFFERED_SOCKET*)BIO_get_data(bio);
-	BIO* next_bio = nullptr;
+
+	WINPR_ASSERT(ptr);
+
+	const int nchunks =
+	    ringbuffer_peek(&ptr->xmitBuffer, chunks, ringbuffer_used(&ptr->xmitBuffer));
+	for (int i = 0; i < nchunks; i++)
+	{
+		size_t written = 0;
+		rc = transport_bio_buffered_send(bio, chunks[i].data, chunks[i].size, &written);
+		committedBytes += written;
+		if (!rc || (written < chunks[i].size))
+			break;
+	}
+
+	ringbuffer_commit_read_bytes(&ptr->xmitBuffer, committedBytes);
+	return rc;
+}
+
+static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
+{
+	WINPR_BIO_BUFFERED_SOCKET* ptr = (WINPR_BIO_BUFFERED_SOCKET*)BIO_get_data(bio);
 
 	WINPR_ASSERT(bio);
 	WINPR_ASSERT(ptr);
@@ -474,55 +597,121 @@ static int transport_bio_buffered_write(BIO* bio, const char* buf, int num)
 	ptr->writeBlocked = FALSE;
 	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
 
-	/* we directly append extra bytes in the xmit buffer, this could be prevented
-	 * but for now it makes the code more simple.
-	 */
-	if (buf && (num > 0) && !ringbuffer_write(&ptr->xmitBuffer, (const BYTE*)buf, (size_t)num))
+	/* The queued data goes first */
+	if (!transport_bio_buffered_flush_queue(bio))
+		return -1; /* fatal error */
+
+	const BYTE* data = (const BYTE*)buf;
+	size_t size = buf ? (size_t)num : 0;
+
+	/* Write through while nothing is queued, only what the socket does not take is copied */
+	if ((size > 0) && (ringbuffer_used(&ptr->xmitBuffer) == 0))
+	{
+		size_t written = 0;
+		if (!transport_bio_buffered_send(bio, data, size, &written))
+			return -1; /* fatal error */
+
+		data += written;
+		size -= written;
+	}
+
+	if ((size > 0) && !ringbuffer_write(&ptr->xmitBuffer, data, size))
 	{
 		WLog_ERR(TAG, "an error occurred when writing (num: %d)", num);
 		return -1;
 	}
 
-	nchunks = ringbuffer_peek(&ptr->xmitBuffer, chunks, ringbuffer_used(&ptr->xmitBuffer));
-	next_bio = BIO_next(bio);
+	return num;
+}
 
-	for (int i = 0; i < nchunks; i++)
+static long transport_bio_buffered_writev(BIO* bio, const DataChunk* chunks, size_t count)
+{
+	size_t total = 0;
+	DataChunk pending[BIO_WRITEV_MAX_CHUNKS] = WINPR_C_ARRAY_INIT;
+	WINPR_BIO_BUFFERED_SOCKET* ptr = (WINPR_BIO_BUFFERED_SOCKET*)BIO_get_data(bio);
+	BIO* next_bio = BIO_next(bio);
+
+	WINPR_ASSERT(ptr);
+
+	if (!chunks || (count > BIO_WRITEV_MAX_CHUNKS))
+		return -1;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		pending[i] = chunks[i];
+		total += chunks[i].size;
+	}
+
+	if (total > INT32_MAX)
+		return -1;
+
+	/* Only the simple socket BIO gathers, write the chunks one by one to anything else */
+	if (BIO_method_type(next_bio) != BIO_TYPE_SIMPLE)
 	{
-		while (chunks[i].size)
+		for (size_t i = 0; i < count; i++)
 		{
-			ERR_clear_error();
+			if (transport_bio_buffered_write(bio, (const char*)chunks[i].data,
+			                                 (int)chunks[i].size) < 0)
+				return -1;
+		}
+		return (long)total;
+	}
 
-			const size_t wr = MIN(INT32_MAX, chunks[i].size);
-			const int status = BIO_write(next_bio, chunks[i].data, (int)wr);
+	ptr->writeBlocked = FALSE;
+	BIO_clear_flags(bio, BIO_FLAGS_WRITE);
 
-			if (status <= 0)
-			{
-				if (!BIO_should_retry(next_bio))
-				{
-					BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
-					ret = -1; /* fatal error */
-					goto out;
-				}
+	if (!transport_bio_buffered_flush_queue(bio))
+		return -1; /* fatal error */
 
-				if (BIO_should_write(next_bio))
-				{
-					BIO_set_flags(bio, BIO_FLAGS_WRITE);
-					ptr->writeBlocked = TRUE;
-					goto out; /* EWOULDBLOCK */
-				}
+	size_t first = 0;
+	while (!ptr->writeBlocked && (ringbuffer_used(&ptr->xmitBuffer) == 0))
+	{
+		while ((first < count) && (pending[first].size == 0))
+			first++;
+		if (first == count)
+			break;
+
+		ERR_clear_error();
+		const long status = BIO_writev(next_bio, &pending[first], count - first);
+		if (status <= 0)
+		{
+			if (!BIO_should_retry(next_bio))
+			{
+				BIO_clear_flags(bio, BIO_FLAGS_SHOULD_RETRY);
+				return -1; /* fatal error */
 			}
-			else
+
+			if (BIO_should_write(next_bio))
 			{
-				committedBytes += (size_t)status;
-				chunks[i].size -= (size_t)status;
-				chunks[i].data += status;
+				BIO_set_flags(bio, BIO_FLAGS_WRITE);
+				ptr->writeBlocked = TRUE;
 			}
+			continue;
+		}
+
+		for (size_t done = (size_t)status; done > 0;)
+		{
+			const size_t step = MIN(done, pending[first].size);
+			pending[first].data += step;
+			pending[first].size -= step;
+			done -= step;
+			if (pending[first].size == 0)
+				first++;
 		}
 	}
 
-out:
-	ringbuffer_commit_read_bytes(&ptr->xmitBuffer, committedBytes);
-	return ret;
+	/* Queue what the socket did not take */
+	for (size_t i = first; i < count; i++)
+	{
+		if ((pending[i].size > 0) &&
+		    !ringbuffer_write(&ptr->xmitBuffer, pending[i].data, pending[i].size))
+		{
+			WLog_ERR(TAG, "an error occurred when writing (size: %" PRIuz ")", total);
+			return -1;
+		}
+	}
+
+	return (long)total;
 }
 
 static int transport_bio_buffered_read(BIO* bio, char* buf, int size)
@@ -600,6 +789,10 @@ static long transport_bio_buffered_ctrl(BIO* bio, int cmd, long arg1, void* arg2
 			status = (int)ptr->writeBlocked;
 			break;
 
+		case BIO_C_WRITEV:
+			status = transport_bio_buffered_writev(bio, (const DataChunk*)arg2, (size_t)arg1);
+			break;
+
 		default:
 			status = BIO_ctrl(BIO_next(bio), cmd, arg1, arg2);
 			break;
@@ -29,6 +29,7 @@
 #include <freerdp/api.h>
 #include <freerdp/transport_io.h>
 
+#include <winpr/assert.h>
 #include <winpr/crt.h>
 #include <winpr/synch.h>
 #include <winpr/stream.h>
@@ -53,6 +54,10 @@
 #define BIO_C_WAIT_READ 1107
 #define BIO_C_WAIT_WRITE 1108
 #define BIO_C_SET_HANDLE 1109
+#define BIO_C_WRITEV 1110
+
+/* Chunks a single BIO_writev hands to the socket */
+#define BIO_WRITEV_MAX_CHUNKS 16
 
 WINPR_ATTR_NODISCARD
 static inline long BIO_set_socket(BIO* b, SOCKET s, long c)
@@ -103,6 +108,19 @@ static inline long BIO_wait_write(BIO* b, long c)
 	return BIO_ctrl(b, BIO_C_WAIT_WRITE, c, nullptr);
 }
 
+/**
+ * @brief Writes \b count chunks with a single call, supported by the simple and the buffered
+ * socket BIO.
+ *
+ * @return The number of bytes written, <= 0 on failure with the retry flags set like BIO_write
+ */
+WINPR_ATTR_NODISCARD
+static inline long BIO_writev(BIO* b, const DataChunk* chunks, size_t count)
+{
+	WINPR_ASSERT(count <= BIO_WRITEV_MAX_CHUNKS);
+	return BIO_ctrl(b, BIO_C_WRITEV, (long)count, (void*)chunks);
+}
+
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BIO_METHOD* BIO_s_simple_socket(void);
 
@@ -0,0 +1,258 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Socket BIO vectored write test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/crypto.h>
+#include <winpr/winsock.h>
+
+#include "../tcp.h"
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_QUEUED_SIZE (4 * 1024 * 1024)
+
+typedef struct
+{
+	int peer;
+	BIO* simple;
+	BIO* buffered;
+} test_bio;
+
+static void test_bio_free(test_bio* bio)
+{
+	WINPR_ASSERT(bio);
+
+	if (bio->buffered)
+		BIO_free_all(bio->buffered);
+	else
+		BIO_free(bio->simple);
+	if (bio->peer >= 0)
+		close(bio->peer);
+}
+
+static BOOL test_bio_new(test_bio* bio, BOOL buffered)
+{
+	int fds[2] = { -1, -1 };
+
+	WINPR_ASSERT(bio);
+	bio->peer = -1;
+	bio->simple = nullptr;
+	bio->buffered = nullptr;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return FALSE;
+
+	bio->peer = fds[1];
+	bio->simple = BIO_new(BIO_s_simple_socket());
+	if (!bio->simple)
+	{
+		close(fds[0]);
+		return FALSE;
+	}
+
+	BIO_set_fd(bio->simple, fds[0], BIO_CLOSE);
+	if (!BIO_set_nonblock(bio->simple, TRUE) || (fcntl(bio->peer, F_SETFL, O_NONBLOCK) != 0))
+		return FALSE;
+
+	if (buffered)
+	{
+		bio->buffered = BIO_new(BIO_s_buffered_socket());
+		if (!bio->buffered)
+			return FALSE;
+		bio->buffered = BIO_push(bio->buffered, bio->simple);
+	}
+	return TRUE;
+}
+
+/* Reads what the peer received so far, appends it at \b offset */
+static BOOL test_bio_receive(test_bio* bio, BYTE* data, size_t size, size_t* offset)
+{
+	while (*offset < size)
+	{
+		const ssize_t rc = recv(bio->peer, &data[*offset], size - *offset, 0);
+		if (rc > 0)
+			*offset += (size_t)rc;
+		else if ((rc < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+			return TRUE;
+		else
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* The simple socket BIO gathers all chunks into one sendmsg */
+static BOOL test_simple_writev(void)
+{
+	BOOL rc = FALSE;
+	BYTE header[7] = WINPR_C_ARRAY_INIT;
+	BYTE payload[3000] = WINPR_C_ARRAY_INIT;
+	BYTE trailer[1] = { 0xAB };
+	BYTE received[sizeof(header) + sizeof(payload) + sizeof(trailer)] = WINPR_C_ARRAY_INIT;
+	test_bio bio = WINPR_C_ARRAY_INIT;
+
+	if (!test_bio_new(&bio, FALSE))
+		goto fail;
+
+	if ((winpr_RAND(header, sizeof(header)) < 0) || (winpr_RAND(payload, sizeof(payload)) < 0))
+		goto fail;
+
+	{
+		const DataChunk chunks[] = { { sizeof(header), header },
+			                         { 0, nullptr },
+			                         { sizeof(payload), payload },
+			                         { sizeof(trailer), trailer } };
+		if (BIO_writev(bio.simple, chunks, ARRAYSIZE(chunks)) != (long)sizeof(received))
+			goto fail;
+	}
+
+	size_t offset = 0;
+	if (!test_bio_receive(&bio, received, sizeof(received), &offset) ||
+	    (offset != sizeof(received)))
+		goto fail;
+
+	rc = (memcmp(received, header, sizeof(header)) == 0) &&
+	     (memcmp(&received[sizeof(header)], payload, sizeof(payload)) == 0) &&
+	     (received[sizeof(received) - 1] == trailer[0]);
+fail:
+	test_bio_free(&bio);
+	return rc;
+}
+
+/* The buffered BIO writes through while nothing is queued */
+static BOOL test_buffered_write_through(void)
+{
+	BOOL rc = FALSE;
+	BYTE data[1000] = WINPR_C_ARRAY_INIT;
+	BYTE received[2 * sizeof(data)] = WINPR_C_ARRAY_INIT;
+	test_bio bio = WINPR_C_ARRAY_INIT;
+
+	if (!test_bio_new(&bio, TRUE))
+		goto fail;
+
+	if (winpr_RAND(data, sizeof(data)) < 0)
+		goto fail;
+
+	if (BIO_write(bio.buffered, data, sizeof(data)) != (int)sizeof(data))
+		goto fail;
+	if (BIO_wpending(bio.buffered) != 0)
+		goto fail;
+
+	{
+		const DataChunk chunks[] = { { 10, data }, { sizeof(data) - 10, &data[10] } };
+		if (BIO_writev(bio.buffered, chunks, ARRAYSIZE(chunks)) != (long)sizeof(data))
+			goto fail;
+	}
+	if (BIO_wpending(bio.buffered) != 0)
+		goto fail;
+
+	/* Nothing was flushed, the data must already be on the socket */
+	size_t offset = 0;
+	if (!test_bio_receive(&bio, received, sizeof(received), &offset) ||
+	    (offset != sizeof(received)))
+		goto fail;
+
+	rc = (memcmp(received, data, sizeof(data)) == 0) &&
+	     (memcmp(&received[sizeof(data)], data, sizeof(data)) == 0);
+fail:
+	test_bio_free(&bio);
+	return rc;
+}
+
+/* What the socket does not take is queued, later writes go behind it and flush keeps the order */
+static BOOL test_buffered_queue(void)
+{
+	BOOL rc = FALSE;
+	test_bio bio = WINPR_C_ARRAY_INIT;
+	BYTE* data = malloc(TEST_QUEUED_SIZE);
+	BYTE* received = calloc(1, TEST_QUEUED_SIZE);
+
+	if (!data || !received || !test_bio_new(&bio, TRUE))
+		goto fail;
+
+	for (size_t x = 0; x < TEST_QUEUED_SIZE; x++)
+		data[x] = (BYTE)((x * 7) ^ (x >> 12));
+
+	/* The first half with plain writes fills the socket buffer and starts queueing */
+	const size_t half = TEST_QUEUED_SIZE / 2;
+	if (BIO_write(bio.buffered, data, (int)half) != (int)half)
+		goto fail;
+	if (BIO_wpending(bio.buffered) <= 0)
+	{
+		(void)fprintf(stderr, "socket took %d bytes without blocking\n", (int)half);
+		goto fail;
+	}
+
+	/* The second half in chunks must be queued behind it, not written through */
+	{
+		const size_t quarter = half / 2;
+		const DataChunk chunks[] = { { 13, &data[half] },
+			                         { quarter - 13, &data[half + 13] },
+			                         { TEST_QUEUED_SIZE - half - quarter, &data[half + quarter] } };
+		if (BIO_writev(bio.buffered, chunks, ARRAYSIZE(chunks)) != (long)half)
+			goto fail;
+	}
+
+	size_t offset = 0;
+	for (size_t loops = 0; offset < TEST_QUEUED_SIZE; loops++)
+	{
+		if ((loops > 100000) || (BIO_flush(bio.buffered) < 0))
+			goto fail;
+		if (!test_bio_receive(&bio, received, TEST_QUEUED_SIZE, &offset))
+			goto fail;
+	}
+
+	rc = (BIO_wpending(bio.buffered) == 0) && (memcmp(data, received, TEST_QUEUED_SIZE) == 0);
+fail:
+	test_bio_free(&bio);
+	free(data);
+	free(received);
+	return rc;
+}
+#endif
+
+int TestBioWritev(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+#if !defined(_WIN32)
+	if (!test_simple_writev())
+	{
+		(void)fprintf(stderr, "simple socket BIO_writev failed\n");
+		return -1;
+	}
+
+	if (!test_buffered_write_through())
+	{
+		(void)fprintf(stderr, "buffered socket write through failed\n");
+		return -1;
+	}
+
+	if (!test_buffered_queue())
+	{
+		(void)fprintf(stderr, "buffered socket queueing failed\n");
+		return -1;
+	}
+#endif
+	return 0;
+}
@@ -18,6 +18,8 @@
  */
 
 #include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
 #include <winpr/wtsapi.h>
 
 #include <freerdp/peer.h>
@@ -29,6 +31,10 @@
 #include "../rdp.h"
 
 #define TEST_SVC_CHANNEL_ID 1004
+#define TEST_BULK_CHANNEL_ID 1005
+#define TEST_INPUT_CHANNEL_ID 1006
+#define TEST_BULK_SIZE (1024 * 1024)
+#define TEST_INPUT_SIZE 10000
 
 static BOOL recv_pdu(freerdp_peer* client, const BYTE* data, size_t size)
 {
@@ -96,6 +102,193 @@ fail:
 	return rc;
 }
 
+typedef struct
+{
+	HANDLE input;
+	wStream* bulkData;
+	wStream* inputData;
+	UINT16 firstChannel;
+	BOOL writerBlocked;
+} test_send_state;
+
+static test_send_state g_send = WINPR_C_ARRAY_INIT;
+
+static DWORD WINAPI test_write_thread(LPVOID arg)
+{
+	BYTE data[16] = WINPR_C_ARRAY_INIT;
+	ULONG written = 0;
+
+	WINPR_UNUSED(arg);
+	return WTSVirtualChannelWrite(g_send.input, (PCHAR)data, sizeof(data), &written) ? 0 : 1;
+}
+
+static BOOL test_send_packet(WINPR_ATTR_UNUSED freerdp_peer* client, UINT16 channelId,
+                             WINPR_ATTR_UNUSED size_t totalSize, WINPR_ATTR_UNUSED UINT32 flags,
+                             const BYTE* data, size_t chunkSize)
+{
+	if (g_send.firstChannel == 0)
+	{
+		g_send.firstChannel = channelId;
+
+		/* Other threads can queue data while a packet is sent */
+		HANDLE thread = CreateThread(nullptr, 0, test_write_thread, nullptr, 0, nullptr);
+		if (!thread)
+			return FALSE;
+		g_send.writerBlocked = WaitForSingleObject(thread, 1000) != WAIT_OBJECT_0;
+		if (g_send.writerBlocked)
+			(void)WaitForSingleObject(thread, INFINITE);
+		(void)CloseHandle(thread);
+	}
+
+	wStream* s = (channelId == TEST_BULK_CHANNEL_ID) ? g_send.bulkData : g_send.inputData;
+	if (!Stream_EnsureRemainingCapacity(s, chunkSize))
+		return FALSE;
+	Stream_Write(s, data, chunkSize);
+	return TRUE;
+}
+
+static BOOL test_send_data(freerdp_peer* client, UINT16 channelId, const BYTE* data, size_t size)
+{
+	return test_send_packet(client, channelId, size, CHANNEL_FLAG_FIRST | CHANNEL_FLAG_LAST, data,
+	                        size);
+}
+
+static BOOL test_check_stats(HANDLE channel, WTS_CHANNEL_PRIORITY priority, size_t queuedMessages,
+                             size_t queuedBytes, UINT64 sentMessages, UINT64 sentBytes)
+{
+	WTS_CHANNEL_QUEUE_STATS stats = WINPR_C_ARRAY_INIT;
+	if (!WTSVirtualChannelGetQueueStats(channel, &stats))
+		return FALSE;
+
+	if ((stats.priority != priority) || (stats.queuedMessages != queuedMessages) ||
+	    (stats.queuedBytes != queuedBytes) || (stats.sentMessages != sentMessages) ||
+	    (stats.sentBytes != sentBytes))
+	{
+		(void)fprintf(stderr,
+		              "stats: priority %d, queued %" PRIuz " messages %" PRIuz
+		              " bytes, sent %" PRIu64 " messages %" PRIu64 " bytes\n",
+		              stats.priority, stats.queuedMessages, stats.queuedBytes,
+		              stats.sentMessages, stats.sentBytes);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* A large bulk transfer must not hold back data of a higher priority channel */
+static BOOL test_send_priorities(void)
+{
+	BOOL rc = FALSE;
+	HANDLE vcm = INVALID_HANDLE_VALUE;
+	HANDLE bulk = nullptr;
+	BYTE* data = malloc(TEST_BULK_SIZE);
+	ULONG written = 0;
+
+	freerdp_peer* client = calloc(1, sizeof(freerdp_peer));
+	g_send.bulkData = Stream_New(nullptr, TEST_BULK_SIZE);
+	g_send.inputData = Stream_New(nullptr, TEST_INPUT_SIZE);
+	if (!client || !data || !g_send.bulkData || !g_send.inputData)
+		goto fail;
+
+	for (size_t x = 0; x < TEST_BULK_SIZE; x++)
+		data[x] = (BYTE)(x ^ (x >> 8));
+
+	client->ContextSize = sizeof(rdpContext);
+	if (!freerdp_peer_context_new(client))
+		goto fail;
+	client->SendChannelData = test_send_data;
+	client->SendChannelPacket = test_send_packet;
+
+	rdpMcs* mcs = client->context->rdp->mcs;
+	mcs->channelCount = 2;
+	(void)strncpy(mcs->channels[0].Name, "cliprdr", CHANNEL_NAME_LEN);
+	mcs->channels[0].ChannelId = TEST_BULK_CHANNEL_ID;
+	mcs->channels[0].joined = TRUE;
+	(void)strncpy(mcs->channels[1].Name, "rail", CHANNEL_NAME_LEN);
+	mcs->channels[1].ChannelId = TEST_INPUT_CHANNEL_ID;
+	mcs->channels[1].joined = TRUE;
+
+	vcm = WTSOpenServerA((LPSTR)client->context);
+	if (!vcm || (vcm == INVALID_HANDLE_VALUE))
+		goto fail;
+
+	bulk = WTSVirtualChannelOpen(vcm, WTS_CURRENT_SESSION, "cliprdr");
+	g_send.input = WTSVirtualChannelOpen(vcm, WTS_CURRENT_SESSION, "rail");
+	if (!bulk || !g_send.input)
+		goto fail;
+
+	/* The bulk data is queued first */
+	if (!WTSVirtualChannelWrite(bulk, (PCHAR)data, TEST_BULK_SIZE, &written) ||
+	    !WTSVirtualChannelWrite(g_send.input, (PCHAR)data, TEST_INPUT_SIZE, &written))
+		goto fail;
+
+	if (!test_check_stats(bulk, WTS_CHANNEL_PRIORITY_BULK, 1, TEST_BULK_SIZE, 0, 0) ||
+	    !test_check_stats(g_send.input, WTS_CHANNEL_PRIORITY_INPUT, 1, TEST_INPUT_SIZE, 0, 0))
+		goto fail;
+
+	if (!WTSVirtualChannelManagerCheckFileDescriptorEx(vcm, FALSE))
+		goto fail;
+
+	if ((g_send.firstChannel != TEST_INPUT_CHANNEL_ID) || g_send.writerBlocked)
+	{
+		(void)fprintf(stderr, "first packet on channel %" PRIu16 ", writer %s\n",
+		              g_send.firstChannel, g_send.writerBlocked ? "blocked" : "not blocked");
+		goto fail;
+	}
+
+	/* The input message and the one written from the send callback went out completely, the
+	 * bulk channel sent no more than its budget */
+	const size_t bulkSent = Stream_GetPosition(g_send.bulkData);
+	if ((bulkSent == 0) || (bulkSent >= TEST_BULK_SIZE / 2))
+		goto fail;
+	if (!test_check_stats(g_send.input, WTS_CHANNEL_PRIORITY_INPUT, 0, 0, 2,
+	                      TEST_INPUT_SIZE + 16) ||
+	    !test_check_stats(bulk, WTS_CHANNEL_PRIORITY_BULK, 1, TEST_BULK_SIZE - bulkSent, 0,
+	                      bulkSent))
+		goto fail;
+
+	/* Data left over keeps the event set */
+	HANDLE event = WTSVirtualChannelManagerGetEventHandle(vcm);
+	if (WaitForSingleObject(event, 0) != WAIT_OBJECT_0)
+		goto fail;
+
+	/* New input data overtakes the queued bulk data */
+	if (!WTSVirtualChannelWrite(g_send.input, (PCHAR)data, TEST_INPUT_SIZE, &written) ||
+	    !WTSVirtualChannelManagerCheckFileDescriptorEx(vcm, FALSE))
+		goto fail;
+	if (!test_check_stats(g_send.input, WTS_CHANNEL_PRIORITY_INPUT, 0, 0, 3,
+	                      2ull * TEST_INPUT_SIZE + 16))
+		goto fail;
+
+	for (size_t x = 0; WaitForSingleObject(event, 0) == WAIT_OBJECT_0; x++)
+	{
+		if ((x > TEST_BULK_SIZE / 1024) ||
+		    !WTSVirtualChannelManagerCheckFileDescriptorEx(vcm, FALSE))
+			goto fail;
+	}
+
+	WTS_CHANNEL_QUEUE_STATS stats = WINPR_C_ARRAY_INIT;
+	if (!test_check_stats(bulk, WTS_CHANNEL_PRIORITY_BULK, 0, 0, 1, TEST_BULK_SIZE) ||
+	    !WTSVirtualChannelGetQueueStats(bulk, &stats) || (stats.maxQueuedBytes != TEST_BULK_SIZE))
+		goto fail;
+
+	rc = (Stream_GetPosition(g_send.bulkData) == TEST_BULK_SIZE) &&
+	     (memcmp(Stream_Buffer(g_send.bulkData), data, TEST_BULK_SIZE) == 0);
+fail:
+	if (bulk)
+		(void)WTSVirtualChannelClose(bulk);
+	if (g_send.input)
+		(void)WTSVirtualChannelClose(g_send.input);
+	if (vcm != INVALID_HANDLE_VALUE)
+		WTSCloseServer(vcm);
+	if (client)
+		freerdp_peer_context_free(client);
+	free(client);
+	free(data);
+	Stream_Free(g_send.bulkData, TRUE);
+	Stream_Free(g_send.inputData, TRUE);
+	return rc;
+}
+
 int TestServerChannels(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
 {
 	WTSRegisterWtsApiFunctionTable(FreeRDP_InitWtsApi());
@@ -103,5 +296,11 @@ int TestServerChannels(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[
 	if (!test_truncated_dynvc_pdu())
 		return -1;
 
+	if (!test_send_priorities())
+	{
+		(void)fprintf(stderr, "virtual channel send priorities failed\n");
+		return -1;
+	}
+
 	return 0;
 }
@@ -0,0 +1,328 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * TLS kernel offload fallback test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#include <freerdp/freerdp.h>
+#include <freerdp/crypto/privatekey.h>
+
+#include <openssl/x509.h>
+
+#include "../tcp.h"
+#include "../../crypto/tls.h"
+#include "../../crypto/certificate.h"
+#include "../../crypto/privatekey.h"
+
+#if !defined(_WIN32)
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_REQUEST_SIZE (1024 * 1024)
+#define TEST_REPLY_SIZE 4096
+
+typedef struct
+{
+	freerdp* instance;
+	rdpTls* tls;
+	BIO* bio;
+	BYTE* data;
+	size_t size;
+	BOOL rc;
+} test_peer;
+
+static rdpCertificate* test_certificate_new(const rdpPrivateKey* key)
+{
+	rdpCertificate* cert = nullptr;
+	EVP_PKEY* pkey = freerdp_key_get_evp_pkey(key);
+	X509* x509 = X509_new();
+
+	if (!pkey || !x509)
+		goto fail;
+
+	if ((X509_set_version(x509, 2) != 1) ||
+	    (ASN1_INTEGER_set(X509_get_serialNumber(x509), 1) != 1) ||
+	    !X509_gmtime_adj(X509_getm_notBefore(x509), 0) ||
+	    !X509_gmtime_adj(X509_getm_notAfter(x509), 3600) || (X509_set_pubkey(x509, pkey) != 1))
+		goto fail;
+
+	X509_NAME* name = X509_get_subject_name(x509);
+	if ((X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const BYTE*)"localhost", -1, -1,
+	                                0) != 1) ||
+	    (X509_set_issuer_name(x509, name) != 1) || (X509_sign(x509, pkey, EVP_sha256()) <= 0))
+		goto fail;
+
+	cert = freerdp_certificate_new_from_x509(x509, nullptr);
+fail:
+	X509_free(x509);
+	EVP_PKEY_free(pkey);
+	return cert;
+}
+
+static void test_peer_free(test_peer* peer)
+{
+	WINPR_ASSERT(peer);
+
+	/* The TLS connection owns the socket BIOs once prepared */
+	if (peer->tls && peer->tls->underlying)
+		peer->bio = nullptr;
+	freerdp_tls_free(peer->tls);
+	BIO_free_all(peer->bio);
+	if (peer->instance)
+	{
+		freerdp_context_free(peer->instance);
+		freerdp_free(peer->instance);
+	}
+	free(peer->data);
+}
+
+static BOOL test_peer_new(test_peer* peer, int socket, BOOL server, BOOL offload, BOOL buffered)
+{
+	WINPR_ASSERT(peer);
+
+	BIO* simple = BIO_new(BIO_s_simple_socket());
+	if (!simple)
+	{
+		close(socket);
+		return FALSE;
+	}
+
+	BIO_set_fd(simple, socket, BIO_CLOSE);
+	peer->bio = simple;
+	if (!BIO_set_nonblock(simple, TRUE))
+		return FALSE;
+
+	if (buffered)
+	{
+		BIO* bio = BIO_new(BIO_s_buffered_socket());
+		if (!bio)
+			return FALSE;
+		peer->bio = BIO_push(bio, simple);
+	}
+
+	peer->instance = freerdp_new();
+	if (!peer->instance || !freerdp_context_new(peer->instance))
+		return FALSE;
+
+	rdpSettings* settings = peer->instance->context->settings;
+	if (!freerdp_settings_set_bool(settings, FreeRDP_ServerMode, server) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_TlsKernelOffload, offload) ||
+	    !freerdp_settings_set_bool(settings, FreeRDP_IgnoreCertificate, TRUE) ||
+	    !freerdp_settings_set_string(settings, FreeRDP_ServerHostname, "localhost"))
+		return FALSE;
+
+	if (server)
+	{
+		if (!freerdp_settings_set_pointer_len(settings, FreeRDP_RdpServerRsaKey, nullptr, 1))
+			return FALSE;
+
+		rdpPrivateKey* key =
+		    freerdp_settings_get_pointer_array_writable(settings, FreeRDP_RdpServerRsaKey, 0);
+		if (!key || !freerdp_key_generate(key, "RSA", 1, 2048))
+			return FALSE;
+
+		rdpCertificate* cert = test_certificate_new(key);
+		if (!cert || !freerdp_settings_set_pointer_len(settings, FreeRDP_RdpServerCertificate,
+		                                               cert, 1))
+		{
+			freerdp_certificate_free(cert);
+			return FALSE;
+		}
+	}
+
+	peer->tls = freerdp_tls_new(peer->instance->context);
+	return peer->tls != nullptr;
+}
+
+static BOOL test_tls_read(rdpTls* tls, BYTE* data, size_t size)
+{
+	size_t offset = 0;
+
+	while (offset < size)
+	{
+		ERR_clear_error();
+		const int rc = BIO_read(tls->bio, &data[offset], (int)MIN(size - offset, INT32_MAX));
+		if (rc > 0)
+			offset += (size_t)rc;
+		else if (!BIO_should_retry(tls->bio) || (BIO_wait_read(tls->bio, 100) < 0))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* The buffered socket BIO queues what the socket did not take */
+static BOOL test_tls_flush(rdpTls* tls)
+{
+	while (BIO_wpending(tls->bio) > 0)
+	{
+		if ((BIO_flush(tls->bio) < 0) || (BIO_wait_write(tls->bio, 100) < 0))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/* Accepts the connection, receives the request and answers with its start */
+static DWORD WINAPI test_server_thread(LPVOID arg)
+{
+	test_peer* peer = arg;
+	WINPR_ASSERT(peer);
+
+	BIO* bio = peer->bio;
+	if (!freerdp_tls_accept(peer->tls, bio, peer->instance->context->settings))
+		return 0;
+
+	if (!test_tls_read(peer->tls, peer->data, peer->size))
+		return 0;
+
+	peer->rc = (freerdp_tls_write_all(peer->tls, peer->data, TEST_REPLY_SIZE) == TEST_REPLY_SIZE) &&
+	           test_tls_flush(peer->tls);
+	return 0;
+}
+
+/* OpenSSL took its own socket BIO for writing if offload was requested, records are read
+ * through the FreeRDP BIO */
+static BOOL test_check_bios(const test_peer* peer, BOOL offload)
+{
+	BIO* rbio = SSL_get_rbio(peer->tls->ssl);
+	BIO* wbio = SSL_get_wbio(peer->tls->ssl);
+
+	if (!offload)
+		return wbio == rbio;
+#if defined(FREERDP_HAVE_KTLS)
+	return (wbio != rbio) && (BIO_method_type(wbio) == BIO_TYPE_SOCKET) &&
+	       ((SSL_get_options(peer->tls->ssl) & SSL_OP_ENABLE_KTLS) != 0);
+#else
+	return wbio == rbio;
+#endif
+}
+
+/* A unix socket never gets the TLS upper layer protocol, kernel offload must fall back to
+ * OpenSSL encrypting in user space */
+static BOOL test_fallback(BOOL offload)
+{
+	BOOL rc = FALSE;
+	HANDLE thread = nullptr;
+	int fds[2] = { -1, -1 };
+	test_peer client = WINPR_C_ARRAY_INIT;
+	test_peer server = WINPR_C_ARRAY_INIT;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0)
+		return FALSE;
+
+	if (!test_peer_new(&server, fds[1], TRUE, offload, FALSE) ||
+	    !test_peer_new(&client, fds[0], FALSE, offload, TRUE))
+		goto fail;
+
+	client.size = TEST_REQUEST_SIZE;
+	client.data = malloc(client.size);
+	server.size = TEST_REQUEST_SIZE;
+	server.data = calloc(1, server.size);
+	if (!client.data || !server.data)
+		goto fail;
+
+	for (size_t x = 0; x < client.size; x++)
+		client.data[x] = (BYTE)((x * 13) ^ (x >> 11));
+
+	thread = CreateThread(nullptr, 0, test_server_thread, &server, 0, nullptr);
+	if (!thread)
+		goto fail;
+
+	BIO* bio = client.bio;
+	if (freerdp_tls_connect(client.tls, bio) <= 0)
+	{
+		(void)fprintf(stderr, "TLS handshake failed\n");
+		goto fail;
+	}
+
+	if (freerdp_tls_get_kernel_offload(client.tls) != TLS_KERNEL_OFFLOAD_NONE)
+	{
+		(void)fprintf(stderr, "kernel offload reported on a unix socket\n");
+		goto fail;
+	}
+
+	if (!test_check_bios(&client, offload))
+	{
+		(void)fprintf(stderr, "unexpected write BIO\n");
+		goto fail;
+	}
+
+	/* Without send offload the chunks must not bypass SSL_write */
+	{
+		const DataChunk chunks[] = { { 16, client.data } };
+		if (BIO_writev(client.tls->bio, chunks, ARRAYSIZE(chunks)) != 0)
+			goto fail;
+	}
+
+	if ((freerdp_tls_write_all(client.tls, client.data, client.size) != (int)client.size) ||
+	    !test_tls_flush(client.tls))
+	{
+		(void)fprintf(stderr, "TLS write failed\n");
+		goto fail;
+	}
+
+	BYTE reply[TEST_REPLY_SIZE] = WINPR_C_ARRAY_INIT;
+	if (!test_tls_read(client.tls, reply, sizeof(reply)))
+		goto fail;
+
+	if (WaitForSingleObject(thread, INFINITE) != WAIT_OBJECT_0)
+		goto fail;
+
+	rc = server.rc && (freerdp_tls_get_kernel_offload(server.tls) == TLS_KERNEL_OFFLOAD_NONE) &&
+	     test_check_bios(&server, offload) &&
+	     (memcmp(server.data, client.data, client.size) == 0) &&
+	     (memcmp(reply, client.data, sizeof(reply)) == 0);
+fail:
+	if (thread)
+	{
+		if (!rc)
+			(void)shutdown(fds[0], SHUT_RDWR);
+		(void)WaitForSingleObject(thread, INFINITE);
+		(void)CloseHandle(thread);
+	}
+	test_peer_free(&client);
+	test_peer_free(&server);
+	return rc;
+}
+#endif
+
+int TestTlsKernelOffload(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+#if !defined(_WIN32)
+	/* OpenSSL's socket BIO does not suppress SIGPIPE when the peer closed first */
+	(void)signal(SIGPIPE, SIG_IGN);
+
+	if (!test_fallback(FALSE))
+	{
+		(void)fprintf(stderr, "TLS without kernel offload failed\n");
+		return -1;
+	}
+
+	if (!test_fallback(TRUE))
+	{
+		(void)fprintf(stderr, "TLS kernel offload fallback failed\n");
+		return -1;
+	}
+#endif
+	return 0;
+}
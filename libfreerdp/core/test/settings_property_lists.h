@@ -25,6 +25,7 @@ static const size_t bool_list_indices[] = {
 	FreeRDP_BitmapCacheV3Enabled,
 	FreeRDP_BitmapCompressionDisabled,
 	FreeRDP_CertificateCallbackPreferPEM,
+	FreeRDP_CompressionAdaptive,
 	FreeRDP_CompressionEnabled,
 	FreeRDP_ConnectChildSession,
 	FreeRDP_ConsoleSession,
@@ -185,6 +186,7 @@ static const size_t bool_list_indices[] = {
 	FreeRDP_SynchronousDynamicChannels,
 	FreeRDP_SynchronousStaticChannels,
 	FreeRDP_TcpKeepAlive,
+	FreeRDP_TlsKernelOffload,
 	FreeRDP_TlsSecurity,
 	FreeRDP_ToggleFullscreen,
 	FreeRDP_TransportDump,
@@ -54,6 +54,24 @@ struct ALIGN64 freerdp_timer_s
 	bool running;
 };
 
+#if defined(FREERDP_TIMER_SUPPORTED)
+static DWORD WINAPI timer_thread(LPVOID arg);
+
+/* The thread is started with the first timer, most connections never add one */
+WINPR_ATTR_NODISCARD
+static bool timer_start_thread(FreeRDPTimer* timer)
+{
+	WINPR_ASSERT(timer);
+
+	ArrayList_Lock(timer->entries);
+	if (!timer->thread && timer->running)
+		timer->thread = CreateThread(nullptr, 0, timer_thread, timer, 0, nullptr);
+	const bool started = timer->thread != nullptr;
+	ArrayList_Unlock(timer->entries);
+	return started;
+}
+#endif
+
 FreeRDP_TimerID freerdp_timer_add(rdpContext* context, uint64_t intervalNS,
                                   FreeRDP_TimerCallback callback, void* userdata, bool mainloop)
 {
@@ -75,6 +93,9 @@ FreeRDP_TimerID freerdp_timer_add(rdpContext* context, uint64_t intervalNS,
 	if ((intervalNS == 0) || !callback)
 		return false;
 
+	if (!timer_start_thread(timer))
+		return 0;
+
 	const uint64_t cur = winpr_GetTickCount64NS();
 	const timer_entry_t entry = { .id = ++timer->maxIdx,
 		                          .intervallNS = intervalNS,
@@ -291,12 +312,7 @@ FreeRDPTimer* freerdp_timer_new(rdpRdp* rdp)
 	if (!timer->mainevent)
 		goto fail;
 
-#if defined(FREERDP_TIMER_SUPPORTED)
 	timer->running = true;
-	timer->thread = CreateThread(nullptr, 0, timer_thread, timer, 0, nullptr);
-	if (!timer->thread)
-		goto fail;
-#endif
 	return timer;
 
 fail:
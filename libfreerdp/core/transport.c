@@ -65,6 +65,9 @@
 
 #define BUFFER_SIZE 16384
 
+/* Largest TLS record payload, a PDU written to a TLS BIO is split into records of this size */
+#define TRANSPORT_TLS_RECORD_SIZE 16384
+
 struct rdp_transport
 {
 	TRANSPORT_LAYER layer;
@@ -1203,6 +1206,103 @@ int transport_write(rdpTransport* transport, wStream* s)
 	return IFCALLRESULT(-1, transport->io.WritePdu, transport, s);
 }
 
+/* Waits until the buffered BIO sent everything for blocking transports, the lock is held */
+static int transport_default_wait_flush(rdpTransport* transport)
+{
+	rdpContext* context = transport_get_context(transport);
+
+	WINPR_ASSERT(transport);
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(context->settings);
+
+	if (!transport->blocking && !context->settings->WaitForOutputBufferFlush)
+		return 1;
+
+	while (BIO_write_blocked(transport->frontBio))
+	{
+		if (BIO_wait_write(transport->frontBio, 100) < 0)
+		{
+			WLog_Print(transport->log, WLOG_ERROR, "error when selecting for write");
+			return -1;
+		}
+
+		if (BIO_flush(transport->frontBio) < 1)
+		{
+			WLog_Print(transport->log, WLOG_ERROR, "error when flushing outputBuffer");
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+/* Writes \b length bytes of \b data to the front BIO, the lock is held */
+static int transport_default_write_bytes(rdpTransport* transport, const BYTE* data, size_t length)
+{
+	int status = -1;
+
+	WINPR_ASSERT(transport);
+	WINPR_ASSERT(data || (length == 0));
+
+	while (length > 0)
+	{
+		ERR_clear_error();
+		const int towrite = (length > INT32_MAX) ? INT32_MAX : (int)length;
+		status = BIO_write(transport->frontBio, data, towrite);
+
+		if (status <= 0)
+		{
+			/* the buffered BIO that is at the end of the chain always says OK for writing,
+			 * so a retry means that for any reason we need to read. The most probable
+			 * is a SSL or TSG BIO in the chain.
+			 */
+			if (!BIO_should_retry(transport->frontBio))
+			{
+				WLog_ERR_BIO(transport, "BIO_should_retry", transport->frontBio);
+				return -1;
+			}
+
+			/* non-blocking can live with blocked IOs */
+			if (!transport->blocking)
+			{
+				WLog_ERR_BIO(transport, "BIO_write", transport->frontBio);
+				return -1;
+			}
+
+			if (BIO_wait_write(transport->frontBio, 100) < 0)
+			{
+				WLog_ERR_BIO(transport, "BIO_wait_write", transport->frontBio);
+				return -1;
+			}
+
+			continue;
+		}
+
+		if (transport_default_wait_flush(transport) < 0)
+			return -1;
+
+		const size_t ustatus = (size_t)status;
+		if (ustatus > length)
+			return -1;
+
+		length -= ustatus;
+		data += ustatus;
+	}
+
+	return status;
+}
+
+static void transport_default_write_failed(rdpTransport* transport)
+{
+	rdpContext* context = transport_get_context(transport);
+
+	WINPR_ASSERT(transport);
+
+	/* A write error indicates that the peer has dropped the connection */
+	transport->layer = TRANSPORT_LAYER_CLOSED;
+	freerdp_set_last_error_if_not(context, FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
+}
+
 static int transport_default_write(rdpTransport* transport, wStream* s)
 {
 	int status = -1;
@@ -1225,8 +1325,7 @@ static int transport_default_write(rdpTransport* transport, wStream* s)
 		goto out_cleanup;
 
 	{
-		size_t length = Stream_GetPosition(s);
-		size_t writtenlength = length;
+		const size_t length = Stream_GetPosition(s);
 		Stream_ResetPosition(s);
 
 		if (length > 0)
@@ -1235,87 +1334,155 @@ static int transport_default_write(rdpTransport* transport, wStream* s)
 			WLog_Packet(transport->log, WLOG_TRACE, Stream_Buffer(s), length, WLOG_PACKET_OUTBOUND);
 		}
 
-		while (length > 0)
-		{
-			ERR_clear_error();
-			const int towrite = (length > INT32_MAX) ? INT32_MAX : (int)length;
-			status = BIO_write(transport->frontBio, Stream_ConstPointer(s), towrite);
+		status = transport_default_write_bytes(transport, Stream_ConstPointer(s), length);
+		if (status < 0)
+			goto out_cleanup;
 
-			if (status <= 0)
-			{
-				/* the buffered BIO that is at the end of the chain always says OK for writing,
-				 * so a retry means that for any reason we need to read. The most probable
-				 * is a SSL or TSG BIO in the chain.
-				 */
-				if (!BIO_should_retry(transport->frontBio))
-				{
-					WLog_ERR_BIO(transport, "BIO_should_retry", transport->frontBio);
-					goto out_cleanup;
-				}
+		Stream_Seek(s, length);
+		transport->written += length;
+	}
+out_cleanup:
 
-				/* non-blocking can live with blocked IOs */
-				if (!transport->blocking)
-				{
-					WLog_ERR_BIO(transport, "BIO_write", transport->frontBio);
-					goto out_cleanup;
-				}
+	if (status < 0)
+		transport_default_write_failed(transport);
 
-				if (BIO_wait_write(transport->frontBio, 100) < 0)
-				{
-					WLog_ERR_BIO(transport, "BIO_wait_write", transport->frontBio);
-					status = -1;
-					goto out_cleanup;
-				}
+	LeaveCriticalSection(&(transport->WriteLock));
+fail:
+	Stream_Release(s);
+	return status;
+}
 
-				continue;
-			}
+static BOOL transport_kernel_tls_send(rdpTransport* transport)
+{
+	WINPR_ASSERT(transport);
+
+	if (!transport->tls || (transport->frontBio != transport->tls->bio))
+		return FALSE;
+	return (freerdp_tls_get_kernel_offload(transport->tls) & TLS_KERNEL_OFFLOAD_TX) != 0;
+}
+
+static int transport_default_write_chunks(rdpTransport* transport, const DataChunk* chunks,
+                                          size_t count, size_t total)
+{
+	int status = -1;
+	rdpContext* context = transport_get_context(transport);
+
+	WINPR_ASSERT(transport);
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(chunks);
+
+	rdpRdp* rdp = context->rdp;
+	if (!rdp)
+		return -1;
+
+	EnterCriticalSection(&(transport->WriteLock));
+	if (!transport->frontBio)
+		goto out_cleanup;
+
+	rdp->outBytes += total;
+	for (size_t i = 0; i < count; i++)
+		WLog_Packet(transport->log, WLOG_TRACE, chunks[i].data, chunks[i].size,
+		            WLOG_PACKET_OUTBOUND);
+
+	long written = 0;
+	if ((BIO_method_type(transport->frontBio) == BIO_TYPE_BUFFERED) ||
+	    transport_kernel_tls_send(transport))
+	{
+		/* A plain socket or one the kernel encrypts for, the kernel gathers the chunks.
+		 * The TLS BIO returns 0 if OpenSSL has a record of its own pending. */
+		ERR_clear_error();
+		written = BIO_writev(transport->frontBio, chunks, count);
+		if (written < 0)
+		{
+			WLog_ERR_BIO(transport, "BIO_writev", transport->frontBio);
+			goto out_cleanup;
+		}
+	}
+
+	if (written > 0)
+		status = transport_default_wait_flush(transport);
+	else
+	{
+		/* Every write to a TLS BIO is a record of its own. Fill the records up to the maximum
+		 * size so a PDU takes as many records (and sends) as a single write of it did, parts
+		 * of large chunks that fill a whole record are written without copying them. */
+		BYTE buffer[TRANSPORT_TLS_RECORD_SIZE];
+		size_t used = 0;
+
+		status = 1;
+		for (size_t i = 0; (i < count) && (status >= 0); i++)
+		{
+			const BYTE* data = chunks[i].data;
+			size_t size = chunks[i].size;
 
-			WINPR_ASSERT(context->settings);
-			if (transport->blocking || context->settings->WaitForOutputBufferFlush)
+			while ((size > 0) && (status >= 0))
 			{
-				while (BIO_write_blocked(transport->frontBio))
+				if ((used == 0) && (size >= sizeof(buffer)))
 				{
-					if (BIO_wait_write(transport->frontBio, 100) < 0)
-					{
-						WLog_Print(transport->log, WLOG_ERROR, "error when selecting for write");
-						status = -1;
-						goto out_cleanup;
-					}
-
-					if (BIO_flush(transport->frontBio) < 1)
-					{
-						WLog_Print(transport->log, WLOG_ERROR, "error when flushing outputBuffer");
-						status = -1;
-						goto out_cleanup;
-					}
+					status = transport_default_write_bytes(transport, data, sizeof(buffer));
+					data += sizeof(buffer);
+					size -= sizeof(buffer);
+					continue;
 				}
-			}
 
-			const size_t ustatus = (size_t)status;
-			if (ustatus > length)
-			{
-				status = -1;
-				goto out_cleanup;
-			}
+				const size_t length = MIN(size, sizeof(buffer) - used);
+				memcpy(&buffer[used], data, length);
+				used += length;
+				data += length;
+				size -= length;
 
-			length -= ustatus;
-			Stream_Seek(s, ustatus);
+				if (used == sizeof(buffer))
+				{
+					status = transport_default_write_bytes(transport, buffer, used);
+					used = 0;
+				}
+			}
 		}
 
-		transport->written += writtenlength;
+		if ((status >= 0) && (used > 0))
+			status = transport_default_write_bytes(transport, buffer, used);
 	}
-out_cleanup:
 
-	if (status < 0)
+	if (status >= 0)
 	{
-		/* A write error indicates that the peer has dropped the connection */
-		transport->layer = TRANSPORT_LAYER_CLOSED;
-		freerdp_set_last_error_if_not(context, FREERDP_ERROR_CONNECT_TRANSPORT_FAILED);
+		transport->written += total;
+		status = (int)total;
 	}
 
+out_cleanup:
+	if (status < 0)
+		transport_default_write_failed(transport);
+
 	LeaveCriticalSection(&(transport->WriteLock));
-fail:
-	Stream_Release(s);
+	return status;
+}
+
+int transport_write_chunks(rdpTransport* transport, const DataChunk* chunks, size_t count)
+{
+	size_t total = 0;
+
+	if (!transport || !chunks || (count > BIO_WRITEV_MAX_CHUNKS))
+		return -1;
+
+	for (size_t i = 0; i < count; i++)
+		total += chunks[i].size;
+
+	if (total > INT32_MAX)
+		return -1;
+
+	if (transport->io.WritePdu == transport_default_write)
+		return transport_default_write_chunks(transport, chunks, count, total);
+
+	/* Custom I/O callbacks take whole PDUs */
+	wStream* s = Stream_New(nullptr, MAX(total, 1));
+	if (!s)
+		return -1;
+
+	for (size_t i = 0; i < count; i++)
+		Stream_Write(s, chunks[i].data, chunks[i].size);
+
+	const int status = transport_write(transport, s);
+	Stream_Free(s, TRUE);
 	return status;
 }
 
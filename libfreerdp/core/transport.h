@@ -134,6 +134,16 @@ FREERDP_LOCAL int transport_read_pdu(rdpTransport* transport, wStream* s);
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL int transport_write(rdpTransport* transport, wStream* s);
 
+/**
+ * @brief Writes a PDU made of \b count chunks (at most \b BIO_WRITEV_MAX_CHUNKS), for example
+ * a header and the encoder output, without assembling it in a stream first.
+ *
+ * @return The number of bytes written or a negative value on failure
+ */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL int transport_write_chunks(rdpTransport* transport, const DataChunk* chunks,
+                                         size_t count);
+
 WINPR_ATTR_NODISCARD
 FREERDP_LOCAL BOOL transport_get_public_key(rdpTransport* transport, const BYTE** data,
                                             DWORD* length);
@@ -179,6 +179,20 @@ static void bio_rdp_tls_write_account(BIO_RDP_TLS* tls, int count)
 }
 #endif
 
+#if defined(FREERDP_HAVE_KTLS)
+/* OpenSSL writes to its own socket BIO, data the next BIO still queues goes out before */
+static BOOL bio_rdp_tls_next_drained(BIO* bio, BIO_RDP_TLS* tls)
+{
+	BIO* next_bio = BIO_next(bio);
+
+	if (!next_bio || (next_bio == SSL_get_wbio(tls->ssl)) || (BIO_wpending(next_bio) == 0))
+		return TRUE;
+
+	(void)BIO_flush(next_bio);
+	return BIO_wpending(next_bio) == 0;
+}
+#endif
+
 static int bio_rdp_tls_write(BIO* bio, const char* buf, int size)
 {
 	int error = 0;
@@ -198,6 +212,14 @@ static int bio_rdp_tls_write(BIO* bio, const char* buf, int size)
 
 	BIO_clear_flags(bio, BIO_FLAGS_WRITE | BIO_FLAGS_READ | BIO_FLAGS_IO_SPECIAL);
 	EnterCriticalSection(&tls->lock);
+#if defined(FREERDP_HAVE_KTLS)
+	if (!bio_rdp_tls_next_drained(bio, tls))
+	{
+		LeaveCriticalSection(&tls->lock);
+		BIO_set_flags(bio, BIO_FLAGS_WRITE | BIO_FLAGS_SHOULD_RETRY);
+		return -1;
+	}
+#endif
 	status = SSL_write(tls->ssl, buf, size);
 	error = SSL_get_error(tls->ssl, status);
 #ifdef WITH_TLS_DATA_LIMIT
@@ -247,6 +269,40 @@ static int bio_rdp_tls_write(BIO* bio, const char* buf, int size)
 	return status;
 }
 
+#if defined(FREERDP_HAVE_KTLS)
+/* With kernel TLS send offload the socket encrypts, the plaintext chunks are handed to the
+ * next BIO, which writes them to the same socket without a copy. Returns 0 whenever OpenSSL
+ * has to write a record itself. */
+static long bio_rdp_tls_writev(BIO* bio, const DataChunk* chunks, size_t count)
+{
+	long status = 0;
+	BIO_RDP_TLS* tls = (BIO_RDP_TLS*)BIO_get_data(bio);
+
+	if (!chunks || !tls)
+		return 0;
+
+	BIO_clear_flags(bio, BIO_FLAGS_WRITE | BIO_FLAGS_READ | BIO_FLAGS_IO_SPECIAL);
+	EnterCriticalSection(&tls->lock);
+	BIO* wbio = SSL_get_wbio(tls->ssl);
+	BIO* next_bio = BIO_next(bio);
+	if (wbio && next_bio && BIO_get_ktls_send(wbio) && !SSL_in_init(tls->ssl) &&
+	    (SSL_want(tls->ssl) != SSL_WRITING) &&
+	    (SSL_get_key_update_type(tls->ssl) == SSL_KEY_UPDATE_NONE))
+	{
+		status = BIO_writev(next_bio, chunks, count);
+#ifdef WITH_TLS_DATA_LIMIT
+		if (status > 0)
+			bio_rdp_tls_write_account(tls, (int)MIN(status, INT32_MAX));
+#endif
+		if (status <= 0)
+			BIO_set_flags(bio, BIO_test_flags(next_bio, BIO_FLAGS_RWS | BIO_FLAGS_SHOULD_RETRY));
+	}
+	LeaveCriticalSection(&tls->lock);
+
+	return status;
+}
+#endif
+
 static int bio_rdp_tls_read(BIO* bio, char* buf, int size)
 {
 	int error = 0;
@@ -395,6 +451,14 @@ static long bio_rdp_tls_ctrl(BIO* bio, int cmd, long num, void* ptr)
 			status = BIO_ctrl(ssl_rbio, cmd, num, ptr);
 			break;
 
+		case BIO_C_WRITEV:
+#if defined(FREERDP_HAVE_KTLS)
+			status = bio_rdp_tls_writev(bio, (const DataChunk*)ptr, (size_t)num);
+#else
+			status = 0;
+#endif
+			break;
+
 		case BIO_CTRL_INFO:
 			status = 0;
 			break;
@@ -436,6 +500,8 @@ static long bio_rdp_tls_ctrl(BIO* bio, int cmd, long num, void* ptr)
 
 		case BIO_CTRL_WPENDING:
 			status = BIO_ctrl(ssl_wbio, cmd, num, ptr);
+			if (next_bio && (next_bio != ssl_wbio))
+				status += BIO_ctrl(next_bio, cmd, num, ptr);
 			break;
 
 		case BIO_CTRL_PENDING:
@@ -448,6 +514,8 @@ static long bio_rdp_tls_ctrl(BIO* bio, int cmd, long num, void* ptr)
 
 		case BIO_CTRL_FLUSH:
 			BIO_clear_retry_flags(bio);
+			if (next_bio && (next_bio != ssl_wbio))
+				(void)BIO_ctrl(next_bio, cmd, num, ptr);
 			status = BIO_ctrl(ssl_wbio, cmd, num, ptr);
 			if (status != 1)
 				WLog_DBG(TAG, "BIO_ctrl returned %ld", status);
@@ -480,18 +548,18 @@ static long bio_rdp_tls_ctrl(BIO* bio, int cmd, long num, void* ptr)
 			/* Only detach if we are the BIO explicitly being popped */
 			if (bio == ptr)
 			{
-				if (ssl_rbio != ssl_wbio)
-					BIO_free_all(ssl_wbio);
-
 #if OPENSSL_VERSION_NUMBER < 0x10100000L || \
     (defined(LIBRESSL_VERSION_NUMBER) && LIBRESSL_VERSION_NUMBER < 0x2070000fL)
+				if (ssl_rbio != ssl_wbio)
+					BIO_free_all(ssl_wbio);
 
 				if (next_bio)
 					CRYPTO_add(&(bio->next_bio->references), -1, CRYPTO_LOCK_BIO);
 
 				tls->ssl->wbio = tls->ssl->rbio = nullptr;
 #else
-				/* OpenSSL 1.1: This will also clear the reference we obtained during push */
+				/* OpenSSL 1.1: This will also clear the reference we obtained during push and
+				 * free a separate write BIO */
 				SSL_set_bio(tls->ssl, nullptr, nullptr);
 #endif
 			}
@@ -535,6 +603,13 @@ static long bio_rdp_tls_ctrl(BIO* bio, int cmd, long num, void* ptr)
 			status = 1;
 			break;
 
+		case BIO_C_WRITE_BLOCKED:
+			status = BIO_ctrl(ssl_rbio, cmd, num, ptr);
+			/* A separate kernel TLS write BIO does not know the FreeRDP controls */
+			if ((status == 0) && ssl_wbio && (ssl_wbio != ssl_rbio))
+				status = BIO_should_write(ssl_wbio) ? 1 : 0;
+			break;
+
 		case BIO_C_DO_STATE_MACHINE:
 			BIO_clear_flags(bio, BIO_FLAGS_READ | BIO_FLAGS_WRITE | BIO_FLAGS_IO_SPECIAL);
 			BIO_set_retry_reason(bio, 0);
@@ -860,8 +935,30 @@ static void tls_reset(rdpTls* tls)
 
 	free_tls_public_key(tls);
 	free_tls_bindings(tls);
+	tls->kernelOffload = TLS_KERNEL_OFFLOAD_NONE;
 }
 
+#if defined(FREERDP_HAVE_KTLS)
+/* OpenSSL enables kernel TLS only on its own socket BIO. One on the same socket becomes the
+ * write BIO of the connection, the records received still pass \b underlying. Unlike our
+ * socket BIOs it does not send with MSG_NOSIGNAL, the application has to ignore SIGPIPE. */
+static BOOL tls_set_kernel_wbio(rdpTls* tls, BIO* underlying)
+{
+	SOCKET socket = INVALID_SOCKET;
+
+	if ((BIO_get_socket(underlying, &socket) <= 0) || (socket == INVALID_SOCKET))
+		return FALSE;
+
+	BIO* wbio = BIO_new_socket((int)socket, BIO_NOCLOSE);
+	if (!wbio)
+		return FALSE;
+
+	/* Releases the reference the SSL object held on \b underlying for writing */
+	SSL_set0_wbio(tls->ssl, wbio);
+	return TRUE;
+}
+#endif
+
 #if OPENSSL_VERSION_NUMBER >= 0x010000000L
 static BOOL tls_prepare(rdpTls* tls, BIO* underlying, const SSL_METHOD* method, int options,
                         BOOL clientMode)
@@ -889,6 +986,7 @@ static BOOL tls_prepare(rdpTls* tls, BIO* underlying, SSL_METHOD* method, int op
 	SSL_CTX_set_mode(tls->ctx, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_ENABLE_PARTIAL_WRITE);
 	SSL_CTX_set_options(tls->ctx, WINPR_ASSERTING_INT_CAST(uint64_t, options));
 	SSL_CTX_set_read_ahead(tls->ctx, 1);
+
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L || defined(LIBRESSL_VERSION_NUMBER)
 	UINT16 version = freerdp_settings_get_uint16(settings, FreeRDP_TLSMinVersion);
 	if (!SSL_CTX_set_min_proto_version(tls->ctx, version))
@@ -947,6 +1045,24 @@ static BOOL tls_prepare(rdpTls* tls, BIO* underlying, SSL_METHOD* method, int op
 	}
 
 	BIO_push(tls->bio, underlying);
+
+	if (freerdp_settings_get_bool(settings, FreeRDP_TlsKernelOffload))
+	{
+#if defined(FREERDP_HAVE_KTLS)
+		/* The kernel can only take over a plain socket, not a gateway tunnel */
+		const int type = underlying ? BIO_method_type(underlying) : BIO_TYPE_NONE;
+		if ((type == BIO_TYPE_BUFFERED) || (type == BIO_TYPE_SIMPLE))
+		{
+			if (tls_set_kernel_wbio(tls, underlying))
+				SSL_set_options(tls->ssl, SSL_OP_ENABLE_KTLS);
+			else
+				WLog_WARN(TAG, "kernel TLS offload is not available for this connection");
+		}
+#else
+		WLog_WARN(TAG, "kernel TLS offload is not supported by this OpenSSL build");
+#endif
+	}
+
 	return TRUE;
 }
 
@@ -1037,6 +1153,44 @@ static int bio_err_print(const char* str, size_t len, void* u)
 	return 0;
 }
 
+#if defined(FREERDP_HAVE_KTLS)
+static const char* tls_kernel_offload_str(UINT32 offload)
+{
+	switch (offload)
+	{
+		case TLS_KERNEL_OFFLOAD_TX:
+			return "send";
+		case TLS_KERNEL_OFFLOAD_RX:
+			return "receive";
+		case TLS_KERNEL_OFFLOAD_TX | TLS_KERNEL_OFFLOAD_RX:
+			return "send and receive";
+		default:
+			return "none";
+	}
+}
+#endif
+
+/* OpenSSL hands the keys to the kernel while changing the cipher state, check what it took */
+static void tls_update_kernel_offload(rdpTls* tls)
+{
+	WINPR_ASSERT(tls);
+
+	tls->kernelOffload = TLS_KERNEL_OFFLOAD_NONE;
+
+#if defined(FREERDP_HAVE_KTLS)
+	if ((SSL_get_options(tls->ssl) & SSL_OP_ENABLE_KTLS) == 0)
+		return;
+
+	if (BIO_get_ktls_send(SSL_get_wbio(tls->ssl)))
+		tls->kernelOffload |= TLS_KERNEL_OFFLOAD_TX;
+	if (BIO_get_ktls_recv(SSL_get_rbio(tls->ssl)))
+		tls->kernelOffload |= TLS_KERNEL_OFFLOAD_RX;
+
+	WLog_INFO(TAG, "kernel TLS offload: %s [%s, %s]", tls_kernel_offload_str(tls->kernelOffload),
+	          SSL_get_version(tls->ssl), SSL_get_cipher_name(tls->ssl));
+#endif
+}
+
 TlsHandshakeResult freerdp_tls_handshake(rdpTls* tls)
 {
 	TlsHandshakeResult ret = TLS_HANDSHAKE_ERROR;
@@ -1056,6 +1210,8 @@ TlsHandshakeResult freerdp_tls_handshake(rdpTls* tls)
 		return TLS_HANDSHAKE_CONTINUE;
 	}
 
+	tls_update_kernel_offload(tls);
+
 	int verify_status = 0;
 	rdpCertificate* cert = tls_get_certificate(tls, tls->isClientMode);
 
@@ -1415,6 +1571,12 @@ int freerdp_tls_write_all(rdpTls* tls, const BYTE* data, size_t length)
 	return (int)length;
 }
 
+UINT32 freerdp_tls_get_kernel_offload(const rdpTls* tls)
+{
+	WINPR_ASSERT(tls);
+	return tls->kernelOffload;
+}
+
 int freerdp_tls_set_alert_code(rdpTls* tls, int level, int description)
 {
 	WINPR_ASSERT(tls);
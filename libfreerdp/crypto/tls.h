@@ -63,6 +63,20 @@
 
 typedef struct rdp_tls rdpTls;
 
+/* Kernel TLS is only enabled through the public OpenSSL API */
+#if !defined(OPENSSL_NO_KTLS) && defined(BIO_get_ktls_send) && defined(SSL_OP_ENABLE_KTLS) && \
+    !defined(_WIN32)
+#define FREERDP_HAVE_KTLS
+#endif
+
+/** @brief directions the kernel encrypts (kTLS), see freerdp_tls_get_kernel_offload */
+typedef enum
+{
+	TLS_KERNEL_OFFLOAD_NONE = 0x00, /*!< OpenSSL encrypts and decrypts in user space */
+	TLS_KERNEL_OFFLOAD_TX = 0x01,   /*!< the kernel encrypts the records sent */
+	TLS_KERNEL_OFFLOAD_RX = 0x02    /*!< the kernel decrypts the records received */
+} TlsKernelOffload;
+
 struct rdp_tls
 {
 	SSL* ssl;
@@ -82,6 +96,7 @@ struct rdp_tls
 	int alertDescription;
 	BOOL isGatewayTransport;
 	BOOL isClientMode;
+	UINT32 kernelOffload;
 };
 
 /** @brief result of a handshake operation */
@@ -126,6 +141,14 @@ extern "C"
 
 	FREERDP_LOCAL int freerdp_tls_set_alert_code(rdpTls* tls, int level, int description);
 
+	/**
+	 * @brief Returns the directions the kernel encrypts since the handshake completed.
+	 *
+	 * @return A combination of \b TlsKernelOffload flags
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL UINT32 freerdp_tls_get_kernel_offload(const rdpTls* tls);
+
 	FREERDP_LOCAL void freerdp_tls_free(rdpTls* tls);
 
 	WINPR_ATTR_MALLOC(freerdp_tls_free, 1)
@@ -37,6 +37,7 @@
 
 #include "brush.h"
 #include "clipping.h"
+#include "rop.h"
 #include "../gdi/gdi.h"
 
 #define TAG FREERDP_TAG("gdi.bitmap")
@@ -177,179 +178,83 @@ HGDI_BITMAP gdi_CreateCompatibleBitmap(HGDI_DC hdc, UINT32 nWidth, UINT32 nHeigh
 	return hBitmap;
 }
 
-static BOOL op_not(UINT32* stack, const UINT32* stackp)
+/* Expand a raw pixel across a row, the pattern period must be at the start of the row */
+static void BitBlt_repeat_row(BYTE* row, size_t period, size_t rowSize)
 {
-	if (!stack || !stackp)
-		return FALSE;
-
-	if (*stackp < 1)
-		return FALSE;
-
-	stack[(*stackp) - 1] = ~stack[(*stackp) - 1];
-	return TRUE;
-}
-
-static BOOL op_and(UINT32* stack, UINT32* stackp)
-{
-	if (!stack || !stackp)
-		return FALSE;
-
-	if (*stackp < 2)
-		return FALSE;
-
-	(*stackp)--;
-	stack[(*stackp) - 1] &= stack[(*stackp)];
-	return TRUE;
-}
-
-static BOOL op_or(UINT32* stack, UINT32* stackp)
-{
-	if (!stack || !stackp)
-		return FALSE;
-
-	if (*stackp < 2)
-		return FALSE;
-
-	(*stackp)--;
-	stack[(*stackp) - 1] |= stack[(*stackp)];
-	return TRUE;
-}
-
-static BOOL op_xor(UINT32* stack, UINT32* stackp)
-{
-	if (!stack || !stackp)
-		return FALSE;
-
-	if (*stackp < 2)
-		return FALSE;
+	size_t filled = period;
 
-	(*stackp)--;
-	stack[(*stackp) - 1] ^= stack[(*stackp)];
-	return TRUE;
+	while (filled < rowSize)
+	{
+		const size_t chunk = MIN(filled, rowSize - filled);
+		memcpy(&row[filled], row, chunk);
+		filled += chunk;
+	}
 }
 
-static UINT32 process_rop(UINT32 src, UINT32 dst, UINT32 pat, const char* rop, UINT32 format)
+static BOOL BitBlt_fill_pattern_row(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, BYTE* row,
+                                    size_t width)
 {
-	UINT32 stack[10] = WINPR_C_ARRAY_INIT;
-	UINT32 stackp = 0;
+	const HGDI_BITMAP hBmpBrush = hdcDest->brush->pattern;
+	const UINT32 bpp = FreeRDPGetBytesPerPixel(hdcDest->format);
+	const size_t period = MIN(width, WINPR_ASSERTING_INT_CAST(size_t, hBmpBrush->width));
 
-	while (*rop != '\0')
+	for (size_t x = 0; x < period; x++)
 	{
-		char op = *rop++;
+		const BYTE* patp =
+		    gdi_get_brush_pointer(hdcDest, WINPR_ASSERTING_INT_CAST(uint32_t, nXDest) + (UINT32)x,
+		                          WINPR_ASSERTING_INT_CAST(uint32_t, nYDest));
 
-		switch (op)
+		if (!patp)
 		{
-			case '0':
-				stack[stackp++] = FreeRDPGetColor(format, 0, 0, 0, 0xFF);
-				break;
-
-			case '1':
-				stack[stackp++] = FreeRDPGetColor(format, 0xFF, 0xFF, 0xFF, 0xFF);
-				break;
-
-			case 'D':
-				stack[stackp++] = dst;
-				break;
-
-			case 'S':
-				stack[stackp++] = src;
-				break;
-
-			case 'P':
-				stack[stackp++] = pat;
-				break;
-
-			case 'x':
-				op_xor(stack, &stackp);
-				break;
-
-			case 'a':
-				op_and(stack, &stackp);
-				break;
-
-			case 'o':
-				op_or(stack, &stackp);
-				break;
-
-			case 'n':
-				op_not(stack, &stackp);
-				break;
-
-			default:
-				break;
+			WLog_ERR(TAG, "patp=%p", (const void*)patp);
+			return FALSE;
 		}
+
+		const UINT32 color = FreeRDPReadColor(patp, hdcDest->format);
+		if (!FreeRDPWriteColor(&row[x * bpp], hdcDest->format, color))
+			return FALSE;
 	}
 
-	return stack[0];
+	BitBlt_repeat_row(row, period * bpp, width * bpp);
+	return TRUE;
 }
 
-static inline BOOL BitBlt_write(HGDI_DC hdcDest, HGDI_DC hdcSrc, INT32 nXDest, INT32 nYDest,
-                                INT32 nXSrc, INT32 nYSrc, INT32 x, INT32 y, BOOL useSrc,
-                                BOOL usePat, UINT32 style, const char* rop,
-                                const gdiPalette* palette)
+static const BYTE* BitBlt_src_row(HGDI_DC hdcDest, HGDI_DC hdcSrc, INT32 nXSrc, INT32 nYSrc,
+                                  BYTE* row, size_t width, const gdiPalette* palette)
 {
-	UINT32 dstColor = 0;
-	UINT32 colorA = 0;
-	UINT32 colorB = 0;
-	UINT32 colorC = 0;
-	const INT32 dstX = nXDest + x;
-	const INT32 dstY = nYDest + y;
-	BYTE* dstp = gdi_get_bitmap_pointer(hdcDest, dstX, dstY);
-
-	if (!dstp)
+	const HGDI_BITMAP hSrcBmp = (HGDI_BITMAP)hdcSrc->selectedObject;
+	const HGDI_BITMAP hDstBmp = (HGDI_BITMAP)hdcDest->selectedObject;
+	const UINT32 srcBpp = FreeRDPGetBytesPerPixel(hdcSrc->format);
+	const UINT32 dstBpp = FreeRDPGetBytesPerPixel(hdcDest->format);
+	const BYTE* srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc, nYSrc);
+
+	if (!srcp || !gdi_get_bitmap_pointer(hdcSrc, nXSrc + WINPR_ASSERTING_INT_CAST(INT32, width) - 1,
+	                                     nYSrc))
 	{
-		WLog_ERR(TAG, "dstp=%p", (const void*)dstp);
-		return FALSE;
+		WLog_ERR(TAG, "srcp=%p", (const void*)srcp);
+		return nullptr;
 	}
 
-	colorA = FreeRDPReadColor(dstp, hdcDest->format);
-
-	if (useSrc)
+	if (hdcSrc->format == hdcDest->format)
 	{
-		const BYTE* srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc + x, nYSrc + y);
+		/* Blits within the same surface may overlap, the row must be read before it is
+		 * written. */
+		if (hSrcBmp->data != hDstBmp->data)
+			return srcp;
 
-		if (!srcp)
-		{
-			WLog_ERR(TAG, "srcp=%p", (const void*)srcp);
-			return FALSE;
-		}
-
-		colorC = FreeRDPReadColor(srcp, hdcSrc->format);
-		colorC = FreeRDPConvertColor(colorC, hdcSrc->format, hdcDest->format, palette);
+		memcpy(row, srcp, width * dstBpp);
+		return row;
 	}
 
-	if (usePat)
+	for (size_t x = 0; x < width; x++)
 	{
-		switch (style)
-		{
-			case GDI_BS_SOLID:
-				colorB = hdcDest->brush->color;
-				break;
-
-			case GDI_BS_HATCHED:
-			case GDI_BS_PATTERN:
-			{
-				const BYTE* patp =
-				    gdi_get_brush_pointer(hdcDest, WINPR_ASSERTING_INT_CAST(uint32_t, nXDest + x),
-				                          WINPR_ASSERTING_INT_CAST(uint32_t, nYDest + y));
-
-				if (!patp)
-				{
-					WLog_ERR(TAG, "patp=%p", (const void*)patp);
-					return FALSE;
-				}
-
-				colorB = FreeRDPReadColor(patp, hdcDest->format);
-			}
-			break;
-
-			default:
-				break;
-		}
+		UINT32 color = FreeRDPReadColor(&srcp[x * srcBpp], hdcSrc->format);
+		color = FreeRDPConvertColor(color, hdcSrc->format, hdcDest->format, palette);
+		if (!FreeRDPWriteColor(&row[x * dstBpp], hdcDest->format, color))
+			return nullptr;
 	}
 
-	dstColor = process_rop(colorC, colorA, colorB, rop, hdcDest->format);
-	return FreeRDPWriteColor(dstp, hdcDest->format, dstColor);
+	return row;
 }
 
 static BOOL adjust_src_coordinates(HGDI_DC hdcSrc, INT32 nWidth, INT32 nHeight, INT32* px,
@@ -463,31 +368,22 @@ static BOOL adjust_src_dst_coordinates(HGDI_DC hdcDest, INT32* pnXSrc, INT32* pn
 	return TRUE;
 }
 
+/**
+ * Generic raster operation, the operation is evaluated row by row with a kernel compiled for
+ * the ROP3 index. Source and pattern rows are provided in the raw destination format, as all
+ * raster operations are bitwise this is equivalent to evaluating the operation per color.
+ */
 static BOOL BitBlt_process(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nWidth, INT32 nHeight,
-                           HGDI_DC hdcSrc, INT32 nXSrc, INT32 nYSrc, const char* rop,
+                           HGDI_DC hdcSrc, INT32 nXSrc, INT32 nYSrc, DWORD rop,
                            const gdiPalette* palette)
 {
-	UINT32 style = 0;
-	BOOL useSrc = FALSE;
-	BOOL usePat = FALSE;
-	const char* iter = rop;
-
-	while (*iter != '\0')
-	{
-		switch (*iter++)
-		{
-			case 'P':
-				usePat = TRUE;
-				break;
-
-			case 'S':
-				useSrc = TRUE;
-				break;
-
-			default:
-				break;
-		}
-	}
+	BOOL rc = FALSE;
+	BYTE* buffer = nullptr;
+	UINT32 style = GDI_BS_NULL;
+	UINT32 solidColor = 0;
+	BYTE index = gdi_rop3_index(rop);
+	BOOL useSrc = gdi_rop3_uses_src(index);
+	BOOL usePat = gdi_rop3_uses_pat(index);
 
 	if (!hdcDest)
 		return FALSE;
@@ -504,13 +400,25 @@ static BOOL BitBlt_process(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nW
 			return FALSE;
 	}
 
-	if (usePat)
+	if ((index == 0x00) || (index == 0xFF))
+	{
+		/* BLACKNESS and WHITENESS write opaque colors, not all bits cleared or set */
+		const BYTE c = (index == 0x00) ? 0x00 : 0xFF;
+		solidColor = FreeRDPGetColor(hdcDest->format, c, c, c, 0xFF);
+		index = (GDI_PATCOPY >> 16) & 0xFF;
+		usePat = TRUE;
+		style = GDI_BS_SOLID;
+	}
+	else if (usePat)
 	{
 		style = gdi_GetBrushStyle(hdcDest);
 
 		switch (style)
 		{
 			case GDI_BS_SOLID:
+				solidColor = hdcDest->brush->color;
+				break;
+
 			case GDI_BS_HATCHED:
 			case GDI_BS_PATTERN:
 				break;
@@ -521,56 +429,89 @@ static BOOL BitBlt_process(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nW
 		}
 	}
 
-	if ((nXDest > nXSrc) && (nYDest > nYSrc))
+	if ((nWidth <= 0) || (nHeight <= 0))
+		return TRUE;
+
+	const UINT32 bpp = FreeRDPGetBytesPerPixel(hdcDest->format);
+	const size_t width = WINPR_ASSERTING_INT_CAST(size_t, nWidth);
+	const size_t rowSize = width * bpp;
+	const BOOL mask15 =
+	    (FreeRDPGetBitsPerPixel(hdcDest->format) == 15) && !FreeRDPColorHasAlpha(hdcDest->format);
+	const gdi_rop3_kernel kernel = gdi_rop3_get_kernel(index);
+	const gdi_rop3_solid_kernel solidKernel =
+	    ((bpp == 4) && (style == GDI_BS_SOLID)) ? gdi_rop3_get_solid_kernel(index) : nullptr;
+	UINT32 solidPixel = 0;
+	INT64 patternRow = -1;
+
+	if ((bpp == 0) || (bpp > 4))
+		return FALSE;
+
+	/* source row and pattern row scratch buffers */
+	buffer = winpr_aligned_calloc(2, rowSize, 32);
+	if (!buffer)
+		return FALSE;
+
+	BYTE* srcRow = buffer;
+	BYTE* patRow = &buffer[rowSize];
+
+	if (style == GDI_BS_SOLID)
 	{
-		for (INT32 y = nHeight - 1; y >= 0; y--)
-		{
-			for (INT32 x = nWidth - 1; x >= 0; x--)
-			{
-				if (!BitBlt_write(hdcDest, hdcSrc, nXDest, nYDest, nXSrc, nYSrc, x, y, useSrc,
-				                  usePat, style, rop, palette))
-					return FALSE;
-			}
-		}
+		if (!FreeRDPWriteColor(patRow, hdcDest->format, solidColor))
+			goto fail;
+
+		memcpy(&solidPixel, patRow, bpp);
+		BitBlt_repeat_row(patRow, bpp, rowSize);
 	}
-	else if (nXDest > nXSrc)
+
+	/* Rows are processed in the direction that does not overwrite source rows not yet read */
+	for (INT32 i = 0; i < nHeight; i++)
 	{
-		for (INT32 y = 0; y < nHeight; y++)
+		const INT32 y = (nYDest > nYSrc) ? nHeight - 1 - i : i;
+		const BYTE* srcp = nullptr;
+		BYTE* dstp = gdi_get_bitmap_pointer(hdcDest, nXDest, nYDest + y);
+
+		if (!dstp || !gdi_get_bitmap_pointer(hdcDest, nXDest + nWidth - 1, nYDest + y))
 		{
-			for (INT32 x = nWidth - 1; x >= 0; x--)
-			{
-				if (!BitBlt_write(hdcDest, hdcSrc, nXDest, nYDest, nXSrc, nYSrc, x, y, useSrc,
-				                  usePat, style, rop, palette))
-					return FALSE;
-			}
+			WLog_ERR(TAG, "dstp=%p", (const void*)dstp);
+			goto fail;
 		}
-	}
-	else if (nYDest > nYSrc)
-	{
-		for (INT32 y = nHeight - 1; y >= 0; y--)
+
+		if (useSrc)
 		{
-			for (INT32 x = 0; x < nWidth; x++)
-			{
-				if (!BitBlt_write(hdcDest, hdcSrc, nXDest, nYDest, nXSrc, nYSrc, x, y, useSrc,
-				                  usePat, style, rop, palette))
-					return FALSE;
-			}
+			srcp = BitBlt_src_row(hdcDest, hdcSrc, nXSrc, nYSrc + y, srcRow, width, palette);
+			if (!srcp)
+				goto fail;
 		}
-	}
-	else
-	{
-		for (INT32 y = 0; y < nHeight; y++)
+
+		if (usePat && (style != GDI_BS_SOLID))
 		{
-			for (INT32 x = 0; x < nWidth; x++)
+			const HGDI_BITMAP hBmpBrush = hdcDest->brush->pattern;
+			const INT64 row = (nYDest + y) % hBmpBrush->height;
+
+			if (row != patternRow)
 			{
-				if (!BitBlt_write(hdcDest, hdcSrc, nXDest, nYDest, nXSrc, nYSrc, x, y, useSrc,
-				                  usePat, style, rop, palette))
-					return FALSE;
+				if (!BitBlt_fill_pattern_row(hdcDest, nXDest, nYDest + y, patRow, width))
+					goto fail;
+				patternRow = row;
 			}
 		}
+
+		if (solidKernel && ((((uintptr_t)dstp) | ((uintptr_t)srcp)) % sizeof(UINT32)) == 0)
+			solidKernel((UINT32*)dstp, (const UINT32*)srcp, solidPixel, width);
+		else
+			kernel(dstp, srcp, patRow, rowSize);
+
+		if (mask15)
+		{
+			for (size_t x = 1; x < rowSize; x += 2)
+				dstp[x] &= 0x7F;
+		}
 	}
 
-	return TRUE;
+	rc = TRUE;
+fail:
+	winpr_aligned_free(buffer);
+	return rc;
 }
 
 /**
@@ -664,8 +605,8 @@ BOOL gdi_BitBlt(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nWidth, INT32
 			break;
 
 		default:
-			if (!BitBlt_process(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc,
-			                    gdi_rop_to_string(rop), palette))
+			if (!BitBlt_process(hdcDest, nXDest, nYDest, nWidth, nHeight, hdcSrc, nXSrc, nYSrc, rop,
+			                    palette))
 				return FALSE;
 
 			break;
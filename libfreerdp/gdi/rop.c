@@ -0,0 +1,353 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Ternary Raster Operations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+
+#include <freerdp/gdi/gdi.h>
+
+#include "rop.h"
+
+/**
+ * All 256 ternary raster operations, indexed by their truth table.
+ *
+ * The index of a raster operation is the result of the operation applied to
+ * P = 0xF0, S = 0xCC and D = 0xAA, so every operation is a pure bitwise function of
+ * destination, source and pattern and can be evaluated on whole pixels (or bytes) at once.
+ * The expressions are the infix form of the reverse polish notation given in the comments
+ * (see gdi_rop_to_string)
+ */
+#define GDI_ROP3_LIST(X)                                   \
+	X(0x00, 0) /* 0 */                                     \
+	X(0x01, ~(D | (P | S))) /* DPSoon */                   \
+	X(0x02, D & ~(P | S)) /* DPSona */                     \
+	X(0x03, ~(P | S)) /* PSon */                           \
+	X(0x04, S & ~(D | P)) /* SDPona */                     \
+	X(0x05, ~(D | P)) /* DPon */                           \
+	X(0x06, ~(P | ~(D ^ S))) /* PDSxnon */                 \
+	X(0x07, ~(P | (D & S))) /* PDSaon */                   \
+	X(0x08, S & (D & ~P)) /* SDPnaa */                     \
+	X(0x09, ~(P | (D ^ S))) /* PDSxon */                   \
+	X(0x0A, D & ~P) /* DPna */                             \
+	X(0x0B, ~(P | (S & ~D))) /* PSDnaon */                 \
+	X(0x0C, S & ~P) /* SPna */                             \
+	X(0x0D, ~(P | (D & ~S))) /* PDSnaon */                 \
+	X(0x0E, ~(P | ~(D | S))) /* PDSonon */                 \
+	X(0x0F, ~P) /* Pn */                                   \
+	X(0x10, P & ~(D | S)) /* PDSona */                     \
+	X(0x11, ~(D | S)) /* DSon */                           \
+	X(0x12, ~(S | ~(D ^ P))) /* SDPxnon */                 \
+	X(0x13, ~(S | (D & P))) /* SDPaon */                   \
+	X(0x14, ~(D | ~(P ^ S))) /* DPSxnon */                 \
+	X(0x15, ~(D | (P & S))) /* DPSaon */                   \
+	X(0x16, P ^ (S ^ (D & ~(P & S)))) /* PSDPSanaxx */     \
+	X(0x17, ~(S ^ ((S ^ P) & (D ^ S)))) /* SSPxDSxaxn */   \
+	X(0x18, (S ^ P) & (P ^ D)) /* SPxPDxa */               \
+	X(0x19, ~(S ^ (D & ~(P & S)))) /* SDPSanaxn */         \
+	X(0x1A, P ^ (D | (S & P))) /* PDSPaox */               \
+	X(0x1B, ~(S ^ (D & (P ^ S)))) /* SDPSxaxn */           \
+	X(0x1C, P ^ (S | (D & P))) /* PSDPaox */               \
+	X(0x1D, ~(D ^ (S & (P ^ D)))) /* DSPDxaxn */           \
+	X(0x1E, P ^ (D | S)) /* PDSox */                       \
+	X(0x1F, ~(P & (D | S))) /* PDSoan */                   \
+	X(0x20, D & (P & ~S)) /* DPSnaa */                     \
+	X(0x21, ~(S | (D ^ P))) /* SDPxon */                   \
+	X(0x22, D & ~S) /* DSna */                             \
+	X(0x23, ~(S | (P & ~D))) /* SPDnaon */                 \
+	X(0x24, (S ^ P) & (D ^ S)) /* SPxDSxa */               \
+	X(0x25, ~(P ^ (D & ~(S & P)))) /* PDSPanaxn */         \
+	X(0x26, S ^ (D | (P & S))) /* SDPSaox */               \
+	X(0x27, S ^ (D | ~(P ^ S))) /* SDPSxnox */             \
+	X(0x28, D & (P ^ S)) /* DPSxa */                       \
+	X(0x29, ~(P ^ (S ^ (D | (P & S))))) /* PSDPSaoxxn */   \
+	X(0x2A, D & ~(P & S)) /* DPSana */                     \
+	X(0x2B, ~(S ^ ((S ^ P) & (P ^ D)))) /* SSPxPDxaxn */   \
+	X(0x2C, S ^ (P & (D | S))) /* SPDSoax */               \
+	X(0x2D, P ^ (S | ~D)) /* PSDnox */                     \
+	X(0x2E, P ^ (S | (D ^ P))) /* PSDPxox */               \
+	X(0x2F, ~(P & (S | ~D))) /* PSDnoan */                 \
+	X(0x30, P & ~S) /* PSna */                             \
+	X(0x31, ~(S | (D & ~P))) /* SDPnaon */                 \
+	X(0x32, S ^ (D | (P | S))) /* SDPSoox */               \
+	X(0x33, ~S) /* Sn */                                   \
+	X(0x34, S ^ (P | (D & S))) /* SPDSaox */               \
+	X(0x35, S ^ (P | ~(D ^ S))) /* SPDSxnox */             \
+	X(0x36, S ^ (D | P)) /* SDPox */                       \
+	X(0x37, ~(S & (D | P))) /* SDPoan */                   \
+	X(0x38, P ^ (S & (D | P))) /* PSDPoax */               \
+	X(0x39, S ^ (P | ~D)) /* SPDnox */                     \
+	X(0x3A, S ^ (P | (D ^ S))) /* SPDSxox */               \
+	X(0x3B, ~(S & (P | ~D))) /* SPDnoan */                 \
+	X(0x3C, P ^ S) /* PSx */                               \
+	X(0x3D, S ^ (P | ~(D | S))) /* SPDSonox */             \
+	X(0x3E, S ^ (P | (D & ~S))) /* SPDSnaox */             \
+	X(0x3F, ~(P & S)) /* PSan */                           \
+	X(0x40, P & (S & ~D)) /* PSDnaa */                     \
+	X(0x41, ~(D | (P ^ S))) /* DPSxon */                   \
+	X(0x42, (S ^ D) & (P ^ D)) /* SDxPDxa */               \
+	X(0x43, ~(S ^ (P & ~(D & S)))) /* SPDSanaxn */         \
+	X(0x44, S & ~D) /* SDna */                             \
+	X(0x45, ~(D | (P & ~S))) /* DPSnaon */                 \
+	X(0x46, D ^ (S | (P & D))) /* DSPDaox */               \
+	X(0x47, ~(P ^ (S & (D ^ P)))) /* PSDPxaxn */           \
+	X(0x48, S & (D ^ P)) /* SDPxa */                       \
+	X(0x49, ~(P ^ (D ^ (S | (P & D))))) /* PDSPDaoxxn */   \
+	X(0x4A, D ^ (P & (S | D))) /* DPSDoax */               \
+	X(0x4B, P ^ (D | ~S)) /* PDSnox */                     \
+	X(0x4C, S & ~(D & P)) /* SDPana */                     \
+	X(0x4D, ~(S ^ ((S ^ P) | (D ^ S)))) /* SSPxDSxoxn */   \
+	X(0x4E, P ^ (D | (S ^ P))) /* PDSPxox */               \
+	X(0x4F, ~(P & (D | ~S))) /* PDSnoan */                 \
+	X(0x50, P & ~D) /* PDna */                             \
+	X(0x51, ~(D | (S & ~P))) /* DSPnaon */                 \
+	X(0x52, D ^ (P | (S & D))) /* DPSDaox */               \
+	X(0x53, ~(S ^ (P & (D ^ S)))) /* SPDSxaxn */           \
+	X(0x54, ~(D | ~(P | S))) /* DPSonon */                 \
+	X(0x55, ~D) /* Dn */                                   \
+	X(0x56, D ^ (P | S)) /* DPSox */                       \
+	X(0x57, ~(D & (P | S))) /* DPSoan */                   \
+	X(0x58, P ^ (D & (S | P))) /* PDSPoax */               \
+	X(0x59, D ^ (P | ~S)) /* DPSnox */                     \
+	X(0x5A, D ^ P) /* DPx */                               \
+	X(0x5B, D ^ (P | ~(S | D))) /* DPSDonox */             \
+	X(0x5C, D ^ (P | (S ^ D))) /* DPSDxox */               \
+	X(0x5D, ~(D & (P | ~S))) /* DPSnoan */                 \
+	X(0x5E, D ^ (P | (S & ~D))) /* DPSDnaox */             \
+	X(0x5F, ~(D & P)) /* DPan */                           \
+	X(0x60, P & (D ^ S)) /* PDSxa */                       \
+	X(0x61, ~(D ^ (S ^ (P | (D & S))))) /* DSPDSaoxxn */   \
+	X(0x62, D ^ (S & (P | D))) /* DSPDoax */               \
+	X(0x63, S ^ (D | ~P)) /* SDPnox */                     \
+	X(0x64, S ^ (D & (P | S))) /* SDPSoax */               \
+	X(0x65, D ^ (S | ~P)) /* DSPnox */                     \
+	X(0x66, D ^ S) /* DSx */                               \
+	X(0x67, S ^ (D | ~(P | S))) /* SDPSonox */             \
+	X(0x68, ~(D ^ (S ^ (P | ~(D | S))))) /* DSPDSonoxxn */ \
+	X(0x69, ~(P ^ (D ^ S))) /* PDSxxn */                   \
+	X(0x6A, D ^ (P & S)) /* DPSax */                       \
+	X(0x6B, ~(P ^ (S ^ (D & (P | S))))) /* PSDPSoaxxn */   \
+	X(0x6C, S ^ (D & P)) /* SDPax */                       \
+	X(0x6D, ~(P ^ (D ^ (S & (P | D))))) /* PDSPDoaxxn */   \
+	X(0x6E, S ^ (D & (P | ~S))) /* SDPSnoax */             \
+	X(0x6F, ~(P & ~(D ^ S))) /* PDSxnan */                 \
+	X(0x70, P & ~(D & S)) /* PDSana */                     \
+	X(0x71, ~(S ^ ((S ^ D) & (P ^ D)))) /* SSDxPDxaxn */   \
+	X(0x72, S ^ (D | (P ^ S))) /* SDPSxox */               \
+	X(0x73, ~(S & (D | ~P))) /* SDPnoan */                 \
+	X(0x74, D ^ (S | (P ^ D))) /* DSPDxox */               \
+	X(0x75, ~(D & (S | ~P))) /* DSPnoan */                 \
+	X(0x76, S ^ (D | (P & ~S))) /* SDPSnaox */             \
+	X(0x77, ~(D & S)) /* DSan */                           \
+	X(0x78, P ^ (D & S)) /* PDSax */                       \
+	X(0x79, ~(D ^ (S ^ (P & (D | S))))) /* DSPDSoaxxn */   \
+	X(0x7A, D ^ (P & (S | ~D))) /* DPSDnoax */             \
+	X(0x7B, ~(S & ~(D ^ P))) /* SDPxnan */                 \
+	X(0x7C, S ^ (P & (D | ~S))) /* SPDSnoax */             \
+	X(0x7D, ~(D & ~(P ^ S))) /* DPSxnan */                 \
+	X(0x7E, (S ^ P) | (D ^ S)) /* SPxDSxo */               \
+	X(0x7F, ~(D & (P & S))) /* DPSaan */                   \
+	X(0x80, D & (P & S)) /* DPSaa */                       \
+	X(0x81, ~((S ^ P) | (D ^ S))) /* SPxDSxon */           \
+	X(0x82, D & ~(P ^ S)) /* DPSxna */                     \
+	X(0x83, ~(S ^ (P & (D | ~S)))) /* SPDSnoaxn */         \
+	X(0x84, S & ~(D ^ P)) /* SDPxna */                     \
+	X(0x85, ~(P ^ (D & (S | ~P)))) /* PDSPnoaxn */         \
+	X(0x86, D ^ (S ^ (P & (D | S)))) /* DSPDSoaxx */       \
+	X(0x87, ~(P ^ (D & S))) /* PDSaxn */                   \
+	X(0x88, D & S) /* DSa */                               \
+	X(0x89, ~(S ^ (D | (P & ~S)))) /* SDPSnaoxn */         \
+	X(0x8A, D & (S | ~P)) /* DSPnoa */                     \
+	X(0x8B, ~(D ^ (S | (P ^ D)))) /* DSPDxoxn */           \
+	X(0x8C, S & (D | ~P)) /* SDPnoa */                     \
+	X(0x8D, ~(S ^ (D | (P ^ S)))) /* SDPSxoxn */           \
+	X(0x8E, S ^ ((S ^ D) & (P ^ D))) /* SSDxPDxax */       \
+	X(0x8F, ~(P & ~(D & S))) /* PDSanan */                 \
+	X(0x90, P & ~(D ^ S)) /* PDSxna */                     \
+	X(0x91, ~(S ^ (D & (P | ~S)))) /* SDPSnoaxn */         \
+	X(0x92, D ^ (P ^ (S & (D | P)))) /* DPSDPoaxx */       \
+	X(0x93, ~(S ^ (P & D))) /* SPDaxn */                   \
+	X(0x94, P ^ (S ^ (D & (P | S)))) /* PSDPSoaxx */       \
+	X(0x95, ~(D ^ (P & S))) /* DPSaxn */                   \
+	X(0x96, D ^ (P ^ S)) /* DPSxx */                       \
+	X(0x97, P ^ (S ^ (D | ~(P | S)))) /* PSDPSonoxx */     \
+	X(0x98, ~(S ^ (D | ~(P | S)))) /* SDPSonoxn */         \
+	X(0x99, ~(D ^ S)) /* DSxn */                           \
+	X(0x9A, D ^ (P & ~S)) /* DPSnax */                     \
+	X(0x9B, ~(S ^ (D & (P | S)))) /* SDPSoaxn */           \
+	X(0x9C, S ^ (P & ~D)) /* SPDnax */                     \
+	X(0x9D, ~(D ^ (S & (P | D)))) /* DSPDoaxn */           \
+	X(0x9E, D ^ (S ^ (P | (D & S)))) /* DSPDSaoxx */       \
+	X(0x9F, ~(P & (D ^ S))) /* PDSxan */                   \
+	X(0xA0, D & P) /* DPa */                               \
+	X(0xA1, ~(P ^ (D | (S & ~P)))) /* PDSPnaoxn */         \
+	X(0xA2, D & (P | ~S)) /* DPSnoa */                     \
+	X(0xA3, ~(D ^ (P | (S ^ D)))) /* DPSDxoxn */           \
+	X(0xA4, ~(P ^ (D | ~(S | P)))) /* PDSPonoxn */         \
+	X(0xA5, ~(P ^ D)) /* PDxn */                           \
+	X(0xA6, D ^ (S & ~P)) /* DSPnax */                     \
+	X(0xA7, ~(P ^ (D & (S | P)))) /* PDSPoaxn */           \
+	X(0xA8, D & (P | S)) /* DPSoa */                       \
+	X(0xA9, ~(D ^ (P | S))) /* DPSoxn */                   \
+	X(0xAA, D) /* D */                                     \
+	X(0xAB, D | ~(P | S)) /* DPSono */                     \
+	X(0xAC, S ^ (P & (D ^ S))) /* SPDSxax */               \
+	X(0xAD, ~(D ^ (P | (S & D)))) /* DPSDaoxn */           \
+	X(0xAE, D | (S & ~P)) /* DSPnao */                     \
+	X(0xAF, D | ~P) /* DPno */                             \
+	X(0xB0, P & (D | ~S)) /* PDSnoa */                     \
+	X(0xB1, ~(P ^ (D | (S ^ P)))) /* PDSPxoxn */           \
+	X(0xB2, S ^ ((S ^ P) | (D ^ S))) /* SSPxDSxox */       \
+	X(0xB3, ~(S & ~(D & P))) /* SDPanan */                 \
+	X(0xB4, P ^ (S & ~D)) /* PSDnax */                     \
+	X(0xB5, ~(D ^ (P & (S | D)))) /* DPSDoaxn */           \
+	X(0xB6, D ^ (P ^ (S | (D & P)))) /* DPSDPaoxx */       \
+	X(0xB7, ~(S & (D ^ P))) /* SDPxan */                   \
+	X(0xB8, P ^ (S & (D ^ P))) /* PSDPxax */               \
+	X(0xB9, ~(D ^ (S | (P & D)))) /* DSPDaoxn */           \
+	X(0xBA, D | (P & ~S)) /* DPSnao */                     \
+	X(0xBB, D | ~S) /* DSno */                             \
+	X(0xBC, S ^ (P & ~(D & S))) /* SPDSanax */             \
+	X(0xBD, ~((S ^ D) & (P ^ D))) /* SDxPDxan */           \
+	X(0xBE, D | (P ^ S)) /* DPSxo */                       \
+	X(0xBF, D | ~(P & S)) /* DPSano */                     \
+	X(0xC0, P & S) /* PSa */                               \
+	X(0xC1, ~(S ^ (P | (D & ~S)))) /* SPDSnaoxn */         \
+	X(0xC2, ~(S ^ (P | ~(D | S)))) /* SPDSonoxn */         \
+	X(0xC3, ~(P ^ S)) /* PSxn */                           \
+	X(0xC4, S & (P | ~D)) /* SPDnoa */                     \
+	X(0xC5, ~(S ^ (P | (D ^ S)))) /* SPDSxoxn */           \
+	X(0xC6, S ^ (D & ~P)) /* SDPnax */                     \
+	X(0xC7, ~(P ^ (S & (D | P)))) /* PSDPoaxn */           \
+	X(0xC8, S & (D | P)) /* SDPoa */                       \
+	X(0xC9, ~(S ^ (P | D))) /* SPDoxn */                   \
+	X(0xCA, D ^ (P & (S ^ D))) /* DPSDxax */               \
+	X(0xCB, ~(S ^ (P | (D & S)))) /* SPDSaoxn */           \
+	X(0xCC, S) /* S */                                     \
+	X(0xCD, S | ~(D | P)) /* SDPono */                     \
+	X(0xCE, S | (D & ~P)) /* SDPnao */                     \
+	X(0xCF, S | ~P) /* SPno */                             \
+	X(0xD0, P & (S | ~D)) /* PSDnoa */                     \
+	X(0xD1, ~(P ^ (S | (D ^ P)))) /* PSDPxoxn */           \
+	X(0xD2, P ^ (D & ~S)) /* PDSnax */                     \
+	X(0xD3, ~(S ^ (P & (D | S)))) /* SPDSoaxn */           \
+	X(0xD4, S ^ ((S ^ P) & (P ^ D))) /* SSPxPDxax */       \
+	X(0xD5, ~(D & ~(P & S))) /* DPSanan */                 \
+	X(0xD6, P ^ (S ^ (D | (P & S)))) /* PSDPSaoxx */       \
+	X(0xD7, ~(D & (P ^ S))) /* DPSxan */                   \
+	X(0xD8, P ^ (D & (S ^ P))) /* PDSPxax */               \
+	X(0xD9, ~(S ^ (D | (P & S)))) /* SDPSaoxn */           \
+	X(0xDA, D ^ (P & ~(S & D))) /* DPSDanax */             \
+	X(0xDB, ~((S ^ P) & (D ^ S))) /* SPxDSxan */           \
+	X(0xDC, S | (P & ~D)) /* SPDnao */                     \
+	X(0xDD, S | ~D) /* SDno */                             \
+	X(0xDE, S | (D ^ P)) /* SDPxo */                       \
+	X(0xDF, S | ~(D & P)) /* SDPano */                     \
+	X(0xE0, P & (D | S)) /* PDSoa */                       \
+	X(0xE1, ~(P ^ (D | S))) /* PDSoxn */                   \
+	X(0xE2, D ^ (S & (P ^ D))) /* DSPDxax */               \
+	X(0xE3, ~(P ^ (S | (D & P)))) /* PSDPaoxn */           \
+	X(0xE4, S ^ (D & (P ^ S))) /* SDPSxax */               \
+	X(0xE5, ~(P ^ (D | (S & P)))) /* PDSPaoxn */           \
+	X(0xE6, S ^ (D & ~(P & S))) /* SDPSanax */             \
+	X(0xE7, ~((S ^ P) & (P ^ D))) /* SPxPDxan */           \
+	X(0xE8, S ^ ((S ^ P) & (D ^ S))) /* SSPxDSxax */       \
+	X(0xE9, ~(D ^ (S ^ (P & ~(D & S))))) /* DSPDSanaxxn */ \
+	X(0xEA, D | (P & S)) /* DPSao */                       \
+	X(0xEB, D | ~(P ^ S)) /* DPSxno */                     \
+	X(0xEC, S | (D & P)) /* SDPao */                       \
+	X(0xED, S | ~(D ^ P)) /* SDPxno */                     \
+	X(0xEE, D | S) /* DSo */                               \
+	X(0xEF, S | (D | ~P)) /* SDPnoo */                     \
+	X(0xF0, P) /* P */                                     \
+	X(0xF1, P | ~(D | S)) /* PDSono */                     \
+	X(0xF2, P | (D & ~S)) /* PDSnao */                     \
+	X(0xF3, P | ~S) /* PSno */                             \
+	X(0xF4, P | (S & ~D)) /* PSDnao */                     \
+	X(0xF5, P | ~D) /* PDno */                             \
+	X(0xF6, P | (D ^ S)) /* PDSxo */                       \
+	X(0xF7, P | ~(D & S)) /* PDSano */                     \
+	X(0xF8, P | (D & S)) /* PDSao */                       \
+	X(0xF9, P | ~(D ^ S)) /* PDSxno */                     \
+	X(0xFA, D | P) /* DPo */                               \
+	X(0xFB, D | (P | ~S)) /* DPSnoo */                     \
+	X(0xFC, P | S) /* PSo */                               \
+	X(0xFD, P | (S | ~D)) /* PSDnoo */                     \
+	X(0xFE, D | (P | S)) /* DPSoo */                       \
+	X(0xFF, ~0) /* 1 */
+
+/* Each kernel only references the operands it uses, so unused ones may be nullptr */
+#define GDI_ROP3_KERNEL(code, expr)                                                         \
+	static void gdi_rop3_##code(BYTE* WINPR_RESTRICT dst, const BYTE* WINPR_RESTRICT src,   \
+	                            const BYTE* WINPR_RESTRICT pat, size_t length)             \
+	{                                                                                       \
+		WINPR_UNUSED(src);                                                                  \
+		WINPR_UNUSED(pat);                                                                  \
+		for (size_t x = 0; x < length; x++)                                                 \
+			dst[x] = (BYTE)(expr);                                                          \
+	}
+
+#define GDI_ROP3_SOLID_KERNEL(code, expr)                                                   \
+	static void gdi_rop3_solid_##code(UINT32* WINPR_RESTRICT dst,                           \
+	                                  const UINT32* WINPR_RESTRICT src, UINT32 pat,         \
+	                                  size_t count)                                         \
+	{                                                                                       \
+		WINPR_UNUSED(src);                                                                  \
+		WINPR_UNUSED(pat);                                                                  \
+		for (size_t x = 0; x < count; x++)                                                  \
+			dst[x] = (UINT32)(expr);                                                        \
+	}
+
+#define GDI_ROP3_ENTRY(code, expr) gdi_rop3_##code,
+#define GDI_ROP3_SOLID_ENTRY(code, expr) gdi_rop3_solid_##code,
+
+/* The operand names are expanded when the list is instantiated, once per kernel flavour */
+#define D dst[x]
+#define S src[x]
+#define P pat[x]
+GDI_ROP3_LIST(GDI_ROP3_KERNEL)
+#undef P
+
+#define P pat
+GDI_ROP3_LIST(GDI_ROP3_SOLID_KERNEL)
+#undef P
+#undef S
+#undef D
+
+static const gdi_rop3_kernel rop3_kernels[256] = { GDI_ROP3_LIST(GDI_ROP3_ENTRY) };
+
+static const gdi_rop3_solid_kernel rop3_solid_kernels[256] = { GDI_ROP3_LIST(
+	GDI_ROP3_SOLID_ENTRY) };
+
+BYTE gdi_rop3_index(UINT32 rop)
+{
+	/* The glyph order is SPaDSnao, which has the same truth table as DSPDxax */
+	if (rop == GDI_GLYPH_ORDER)
+		return (GDI_DSPDxax >> 16) & 0xFF;
+
+	return (BYTE)((rop >> 16) & 0xFF);
+}
+
+gdi_rop3_kernel gdi_rop3_get_kernel(BYTE index)
+{
+	return rop3_kernels[index];
+}
+
+gdi_rop3_solid_kernel gdi_rop3_get_solid_kernel(BYTE index)
+{
+	return rop3_solid_kernels[index];
+}
@@ -0,0 +1,77 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * GDI Ternary Raster Operations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_GDI_ROP_H
+#define FREERDP_LIB_GDI_ROP_H
+
+#include <winpr/wtypes.h>
+#include <winpr/platform.h>
+
+#include <freerdp/api.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	/**
+	 * A ROP3 row kernel, combines \b length bytes of destination, source and pattern.
+	 * Source and pattern are only accessed if the raster operation uses them.
+	 */
+	typedef void (*gdi_rop3_kernel)(BYTE* WINPR_RESTRICT dst, const BYTE* WINPR_RESTRICT src,
+	                                const BYTE* WINPR_RESTRICT pat, size_t length);
+
+	/**
+	 * A ROP3 row kernel for 32bpp pixels and a solid brush, combines \b count pixels.
+	 */
+	typedef void (*gdi_rop3_solid_kernel)(UINT32* WINPR_RESTRICT dst,
+	                                      const UINT32* WINPR_RESTRICT src, UINT32 pat,
+	                                      size_t count);
+
+	/**
+	 * @brief gdi_rop3_index Get the ternary raster operation index (the truth table of the
+	 * operation) for a raster operation code.
+	 *
+	 * @param rop A GDI_ raster operation code
+	 * @return The operation index
+	 */
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL BYTE gdi_rop3_index(UINT32 rop);
+
+	WINPR_ATTR_NODISCARD
+	static inline BOOL gdi_rop3_uses_src(BYTE index)
+	{
+		return (((index >> 2) ^ index) & 0x33) != 0;
+	}
+
+	WINPR_ATTR_NODISCARD
+	static inline BOOL gdi_rop3_uses_pat(BYTE index)
+	{
+		return (((index >> 4) ^ index) & 0x0F) != 0;
+	}
+
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL gdi_rop3_kernel gdi_rop3_get_kernel(BYTE index);
+
+	WINPR_ATTR_NODISCARD
+	FREERDP_LOCAL gdi_rop3_solid_kernel gdi_rop3_get_solid_kernel(BYTE index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_LIB_GDI_ROP_H */
@@ -1,8 +1,17 @@
 
 #include <winpr/crt.h>
 #include <winpr/winpr.h>
+#include <winpr/crypto.h>
+#include <winpr/sysinfo.h>
 #include <winpr/collections.h>
 
+#include <freerdp/gdi/gdi.h>
+#include <freerdp/gdi/dc.h>
+#include <freerdp/gdi/bitmap.h>
+
+#include "../gdi.h"
+#include "brush.h"
+
 /**
  * Ternary Raster Operations:
  * See "Windows Graphics Programming: Win32 GDI and DirectDraw", chapter 11. Advanced Bitmap
@@ -198,6 +207,351 @@ static const char* test_ROP3[] = { "DSPDxax",  "PSDPxax", "SPna",   "DSna",   "D
 	                               "PDna",     "DPan",    "DSan",   "DSxn",   "DPa",
 	                               "D",        "DPno",    "SDno",   "PDno",   "DPo" };
 
+/* Per pixel evaluation of the reverse polish notation, the reference for the ROP3 kernels */
+static UINT32 ref_process_rop(UINT32 src, UINT32 dst, UINT32 pat, const char* rop, UINT32 format)
+{
+	UINT32 stack[10] = WINPR_C_ARRAY_INIT;
+	size_t stackp = 0;
+
+	for (; *rop != '\0'; rop++)
+	{
+		switch (*rop)
+		{
+			case '0':
+				stack[stackp++] = FreeRDPGetColor(format, 0, 0, 0, 0xFF);
+				break;
+			case '1':
+				stack[stackp++] = FreeRDPGetColor(format, 0xFF, 0xFF, 0xFF, 0xFF);
+				break;
+			case 'D':
+				stack[stackp++] = dst;
+				break;
+			case 'S':
+				stack[stackp++] = src;
+				break;
+			case 'P':
+				stack[stackp++] = pat;
+				break;
+			case 'n':
+				stack[stackp - 1] = ~stack[stackp - 1];
+				break;
+			case 'a':
+				stackp--;
+				stack[stackp - 1] &= stack[stackp];
+				break;
+			case 'o':
+				stackp--;
+				stack[stackp - 1] |= stack[stackp];
+				break;
+			case 'x':
+				stackp--;
+				stack[stackp - 1] ^= stack[stackp];
+				break;
+			default:
+				break;
+		}
+	}
+
+	return stack[0];
+}
+
+static BOOL ref_BitBlt(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nWidth, INT32 nHeight,
+                       HGDI_DC hdcSrc, INT32 nXSrc, INT32 nYSrc, DWORD rop,
+                       const gdiPalette* palette)
+{
+	const char* str = gdi_rop_to_string(rop);
+	const BOOL useSrc = strchr(str, 'S') != nullptr;
+	const BOOL usePat = strchr(str, 'P') != nullptr;
+	const size_t count = 1ull * WINPR_ASSERTING_INT_CAST(size_t, nWidth) *
+	                     WINPR_ASSERTING_INT_CAST(size_t, nHeight);
+	UINT32* src = calloc(count + 1, sizeof(UINT32));
+
+	if (!src)
+		return FALSE;
+
+	/* Read the source first, blits within the same surface may overlap.
+	 * Like SRCCOPY, the source is taken as is if the formats match. */
+	for (INT32 y = 0; useSrc && (y < nHeight); y++)
+	{
+		for (INT32 x = 0; x < nWidth; x++)
+		{
+			const BYTE* srcp = gdi_get_bitmap_pointer(hdcSrc, nXSrc + x, nYSrc + y);
+			UINT32 color = FreeRDPReadColor(srcp, hdcSrc->format);
+			if (hdcSrc->format != hdcDest->format)
+				color = FreeRDPConvertColor(color, hdcSrc->format, hdcDest->format, palette);
+			src[1ull * y * WINPR_ASSERTING_INT_CAST(size_t, nWidth) +
+			    WINPR_ASSERTING_INT_CAST(size_t, x)] = color;
+		}
+	}
+
+	for (INT32 y = 0; y < nHeight; y++)
+	{
+		for (INT32 x = 0; x < nWidth; x++)
+		{
+			UINT32 pat = 0;
+			BYTE* dstp = gdi_get_bitmap_pointer(hdcDest, nXDest + x, nYDest + y);
+			const UINT32 dst = FreeRDPReadColor(dstp, hdcDest->format);
+
+			if (usePat && (gdi_GetBrushStyle(hdcDest) == GDI_BS_SOLID))
+				pat = hdcDest->brush->color;
+			else if (usePat)
+			{
+				const BYTE* patp =
+				    gdi_get_brush_pointer(hdcDest, WINPR_ASSERTING_INT_CAST(UINT32, nXDest + x),
+				                          WINPR_ASSERTING_INT_CAST(UINT32, nYDest + y));
+				pat = FreeRDPReadColor(patp, hdcDest->format);
+			}
+
+			const UINT32 color =
+			    ref_process_rop(src[1ull * y * WINPR_ASSERTING_INT_CAST(size_t, nWidth) +
+			                        WINPR_ASSERTING_INT_CAST(size_t, x)],
+			                    dst, pat, str, hdcDest->format);
+			if (!FreeRDPWriteColor(dstp, hdcDest->format, color))
+			{
+				free(src);
+				return FALSE;
+			}
+		}
+	}
+
+	free(src);
+	return TRUE;
+}
+
+static HGDI_BITMAP create_random_bitmap(UINT32 width, UINT32 height, UINT32 format)
+{
+	const size_t size = 1ull * width * height * FreeRDPGetBytesPerPixel(format);
+	BYTE* data = winpr_aligned_malloc(size, 16);
+
+	if (!data)
+		return nullptr;
+
+	if (winpr_RAND(data, size) < 0)
+	{
+		winpr_aligned_free(data);
+		return nullptr;
+	}
+
+	HGDI_BITMAP bmp = gdi_CreateBitmap(width, height, format, data);
+	if (!bmp)
+		winpr_aligned_free(data);
+	return bmp;
+}
+
+static BOOL compare_bitmaps(HGDI_BITMAP a, HGDI_BITMAP b)
+{
+	const size_t size = 1ull * a->scanline * WINPR_ASSERTING_INT_CAST(size_t, a->height);
+	return (a->scanline == b->scanline) && (memcmp(a->data, b->data, size) == 0);
+}
+
+static BOOL reset_bitmap(HGDI_BITMAP dst, HGDI_BITMAP src)
+{
+	const size_t size = 1ull * src->scanline * WINPR_ASSERTING_INT_CAST(size_t, src->height);
+	memcpy(dst->data, src->data, size);
+	return TRUE;
+}
+
+/* Run every ROP3 through gdi_BitBlt and compare against the per pixel reference */
+static BOOL test_rop3_kernels(UINT32 SrcFormat, UINT32 DstFormat, BOOL pattern)
+{
+	BOOL rc = FALSE;
+	HGDI_DC hdcSrc = gdi_GetDC();
+	HGDI_DC hdcDst = gdi_GetDC();
+	HGDI_DC hdcRef = gdi_GetDC();
+	HGDI_BITMAP hBmpSrc = create_random_bitmap(64, 40, SrcFormat);
+	HGDI_BITMAP hBmpOrig = create_random_bitmap(64, 40, DstFormat);
+	HGDI_BITMAP hBmpDst = create_random_bitmap(64, 40, DstFormat);
+	HGDI_BITMAP hBmpRef = create_random_bitmap(64, 40, DstFormat);
+	HGDI_BITMAP hBmpPattern = create_random_bitmap(8, 8, DstFormat);
+	HGDI_BRUSH brushDst = nullptr;
+	HGDI_BRUSH brushRef = nullptr;
+	gdiPalette palette = WINPR_C_ARRAY_INIT;
+
+	if (!hdcSrc || !hdcDst || !hdcRef || !hBmpSrc || !hBmpOrig || !hBmpDst || !hBmpRef ||
+	    !hBmpPattern)
+		goto fail;
+
+	palette.format = DstFormat;
+	for (UINT32 x = 0; x < 256; x++)
+		palette.palette[x] = FreeRDPGetColor(DstFormat, (BYTE)x, (BYTE)x, (BYTE)x, 0xFF);
+
+	if (pattern)
+	{
+		brushDst = gdi_CreatePatternBrush(hBmpPattern);
+		brushRef = gdi_CreatePatternBrush(hBmpPattern);
+	}
+	else
+	{
+		const UINT32 color = FreeRDPGetColor(DstFormat, 0x12, 0x34, 0x56, 0x78);
+		brushDst = gdi_CreateSolidBrush(color);
+		brushRef = gdi_CreateSolidBrush(color);
+	}
+
+	if (!brushDst || !brushRef)
+		goto fail;
+
+	brushDst->nXOrg = brushRef->nXOrg = 3;
+	brushDst->nYOrg = brushRef->nYOrg = 5;
+
+	hdcSrc->format = SrcFormat;
+	hdcDst->format = DstFormat;
+	hdcRef->format = DstFormat;
+	gdi_SelectObject(hdcSrc, (HGDIOBJECT)hBmpSrc);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT)hBmpDst);
+	gdi_SelectObject(hdcRef, (HGDIOBJECT)hBmpRef);
+	gdi_SelectObject(hdcDst, (HGDIOBJECT)brushDst);
+	gdi_SelectObject(hdcRef, (HGDIOBJECT)brushRef);
+
+	for (UINT32 index = 0; index < 256; index++)
+	{
+		const DWORD rop = gdi_rop3_code((BYTE)index);
+
+		/* SRCCOPY and DSTCOPY are plain image copies */
+		if ((rop == GDI_SRCCOPY) || (rop == GDI_DSTCOPY))
+			continue;
+
+		if (!reset_bitmap(hBmpDst, hBmpOrig) || !reset_bitmap(hBmpRef, hBmpOrig))
+			goto fail;
+
+		if (!gdi_BitBlt(hdcDst, 3, 2, 50, 33, hdcSrc, 5, 4, rop, &palette) ||
+		    !ref_BitBlt(hdcRef, 3, 2, 50, 33, hdcSrc, 5, 4, rop, &palette))
+			goto fail;
+
+		if (!compare_bitmaps(hBmpDst, hBmpRef))
+		{
+			printf("ROP %s [%s -> %s, %s brush] mismatch\n", gdi_rop3_string(rop),
+			       FreeRDPGetColorFormatName(SrcFormat), FreeRDPGetColorFormatName(DstFormat),
+			       pattern ? "pattern" : "solid");
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	gdi_DeleteObject((HGDIOBJECT)brushDst);
+	gdi_DeleteObject((HGDIOBJECT)brushRef);
+	gdi_DeleteObject((HGDIOBJECT)hBmpSrc);
+	gdi_DeleteObject((HGDIOBJECT)hBmpOrig);
+	gdi_DeleteObject((HGDIOBJECT)hBmpDst);
+	gdi_DeleteObject((HGDIOBJECT)hBmpRef);
+	gdi_DeleteObject((HGDIOBJECT)hBmpPattern);
+	gdi_DeleteDC(hdcSrc);
+	gdi_DeleteDC(hdcDst);
+	gdi_DeleteDC(hdcRef);
+	return rc;
+}
+
+typedef BOOL (*pBitBlt)(HGDI_DC hdcDest, INT32 nXDest, INT32 nYDest, INT32 nWidth, INT32 nHeight,
+                        HGDI_DC hdcSrc, INT32 nXSrc, INT32 nYSrc, DWORD rop,
+                        const gdiPalette* palette);
+
+typedef struct
+{
+	DWORD rop;
+	BOOL pattern;
+	BOOL screen;
+} test_order;
+
+/* The raster operations legacy sessions use most: PatBlt, ScrBlt, MemBlt, Mem3Blt and glyphs */
+static const test_order test_orders[] = {
+	{ GDI_PATCOPY, FALSE, FALSE },   { GDI_PATCOPY, TRUE, FALSE },
+	{ GDI_PATINVERT, FALSE, FALSE }, { GDI_PATINVERT, TRUE, FALSE },
+	{ GDI_DSTINVERT, FALSE, FALSE }, { GDI_BLACKNESS, FALSE, FALSE },
+	{ GDI_SRCINVERT, FALSE, TRUE },  { GDI_SRCAND, FALSE, FALSE },
+	{ GDI_SRCPAINT, FALSE, FALSE },  { GDI_MERGECOPY, TRUE, FALSE },
+	{ GDI_DSPDxax, FALSE, FALSE },   { GDI_GLYPH_ORDER, FALSE, FALSE },
+	{ GDI_PSDPxax, TRUE, FALSE },    { GDI_SRCERASE, FALSE, TRUE },
+};
+
+static UINT32 test_next(UINT32* seed, UINT32 max)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return (*seed >> 8) % max;
+}
+
+static BOOL run_order_stream(pBitBlt fkt, HGDI_DC hdcScreen, HGDI_DC hdcMem, HGDI_BRUSH solid,
+                             HGDI_BRUSH pattern, size_t count, UINT64* duration)
+{
+	UINT32 seed = 42;
+	const UINT64 start = winpr_GetTickCount64NS();
+
+	for (size_t x = 0; x < count; x++)
+	{
+		const test_order* order = &test_orders[test_next(&seed, ARRAYSIZE(test_orders))];
+		const INT32 w = (INT32)test_next(&seed, 255) + 1;
+		const INT32 h = (INT32)test_next(&seed, 127) + 1;
+		const INT32 dx = (INT32)test_next(&seed, (UINT32)(1024 - w));
+		const INT32 dy = (INT32)test_next(&seed, (UINT32)(768 - h));
+		const INT32 sx = (INT32)test_next(&seed, (UINT32)(order->screen ? 1024 - w : 256 - w + 1));
+		const INT32 sy = (INT32)test_next(&seed, (UINT32)(order->screen ? 768 - h : 256 - h + 1));
+		HGDI_DC hdcSrc = order->screen ? hdcScreen : hdcMem;
+
+		gdi_SelectObject(hdcScreen, (HGDIOBJECT)(order->pattern ? pattern : solid));
+		if (!fkt(hdcScreen, dx, dy, w, h, hdcSrc, sx, sy, order->rop, nullptr))
+			return FALSE;
+	}
+
+	*duration = winpr_GetTickCount64NS() - start;
+	return TRUE;
+}
+
+/* Replay a synthetic legacy drawing order stream with the kernels and the reference */
+static BOOL test_rop3_order_stream(void)
+{
+	BOOL rc = FALSE;
+	const UINT32 format = PIXEL_FORMAT_BGRA32;
+	const size_t count = 400;
+	UINT64 kernelTime = 0;
+	UINT64 refTime = 0;
+	HGDI_DC hdcScreen = gdi_GetDC();
+	HGDI_DC hdcRefScreen = gdi_GetDC();
+	HGDI_DC hdcMem = gdi_GetDC();
+	HGDI_BITMAP hBmpScreen = create_random_bitmap(1024, 768, format);
+	HGDI_BITMAP hBmpRefScreen = create_random_bitmap(1024, 768, format);
+	HGDI_BITMAP hBmpMem = create_random_bitmap(256, 256, format);
+	HGDI_BITMAP hBmpPattern = create_random_bitmap(8, 8, format);
+	HGDI_BRUSH solid = gdi_CreateSolidBrush(FreeRDPGetColor(format, 0x20, 0x40, 0x80, 0xFF));
+	HGDI_BRUSH pattern = hBmpPattern ? gdi_CreatePatternBrush(hBmpPattern) : nullptr;
+
+	if (!hdcScreen || !hdcRefScreen || !hdcMem || !hBmpScreen || !hBmpRefScreen || !hBmpMem ||
+	    !solid || !pattern)
+		goto fail;
+
+	hdcScreen->format = hdcRefScreen->format = hdcMem->format = format;
+	gdi_SelectObject(hdcScreen, (HGDIOBJECT)hBmpScreen);
+	gdi_SelectObject(hdcRefScreen, (HGDIOBJECT)hBmpRefScreen);
+	gdi_SelectObject(hdcMem, (HGDIOBJECT)hBmpMem);
+
+	if (!reset_bitmap(hBmpRefScreen, hBmpScreen))
+		goto fail;
+
+	if (!run_order_stream(gdi_BitBlt, hdcScreen, hdcMem, solid, pattern, count, &kernelTime) ||
+	    !run_order_stream(ref_BitBlt, hdcRefScreen, hdcMem, solid, pattern, count, &refTime))
+		goto fail;
+
+	printf("%" PRIuz " orders: kernels %" PRIu64 " us, per pixel reference %" PRIu64 " us\n",
+	       count, kernelTime / 1000, refTime / 1000);
+
+	if (!compare_bitmaps(hBmpScreen, hBmpRefScreen))
+	{
+		printf("order stream result mismatch\n");
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	gdi_DeleteObject((HGDIOBJECT)solid);
+	gdi_DeleteObject((HGDIOBJECT)pattern);
+	gdi_DeleteObject((HGDIOBJECT)hBmpScreen);
+	gdi_DeleteObject((HGDIOBJECT)hBmpRefScreen);
+	gdi_DeleteObject((HGDIOBJECT)hBmpMem);
+	gdi_DeleteObject((HGDIOBJECT)hBmpPattern);
+	gdi_DeleteDC(hdcScreen);
+	gdi_DeleteDC(hdcRefScreen);
+	gdi_DeleteDC(hdcMem);
+	return rc;
+}
+
 int TestGdiRop3(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -215,5 +569,29 @@ int TestGdiRop3(int argc, char* argv[])
 		free(infix);
 	}
 
+	const struct
+	{
+		UINT32 src;
+		UINT32 dst;
+	} formats[] = { { PIXEL_FORMAT_BGRA32, PIXEL_FORMAT_BGRA32 },
+		            { PIXEL_FORMAT_RGBA32, PIXEL_FORMAT_RGBA32 },
+		            { PIXEL_FORMAT_BGR24, PIXEL_FORMAT_BGR24 },
+		            { PIXEL_FORMAT_RGB16, PIXEL_FORMAT_RGB16 },
+		            { PIXEL_FORMAT_RGB15, PIXEL_FORMAT_RGB15 },
+		            { PIXEL_FORMAT_ARGB15, PIXEL_FORMAT_ARGB15 },
+		            { PIXEL_FORMAT_RGB16, PIXEL_FORMAT_BGRA32 },
+		            { PIXEL_FORMAT_BGR24, PIXEL_FORMAT_ABGR32 },
+		            { PIXEL_FORMAT_ARGB32, PIXEL_FORMAT_RGB16 } };
+
+	for (size_t x = 0; x < ARRAYSIZE(formats); x++)
+	{
+		if (!test_rop3_kernels(formats[x].src, formats[x].dst, FALSE) ||
+		    !test_rop3_kernels(formats[x].src, formats[x].dst, TRUE))
+			return -1;
+	}
+
+	if (!test_rop3_order_stream())
+		return -1;
+
 	return 0;
 }
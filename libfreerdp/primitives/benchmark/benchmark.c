@@ -24,6 +24,10 @@
 #include <winpr/sysinfo.h>
 #include <freerdp/primitives.h>
 
+#if defined(BUILD_TESTING_INTERNAL)
+#include "../prim_internal.h"
+#endif
+
 typedef struct
 {
 	BYTE* channels[3];
@@ -31,6 +35,7 @@ typedef struct
 	prim_size_t roi;
 	BYTE* outputBuffer;
 	BYTE* outputChannels[3];
+	BYTE* auxChannels[3];
 	BYTE* rgbBuffer;
 	UINT32 outputStride;
 	UINT32 testedFormat;
@@ -47,6 +52,7 @@ static void primitives_YUV_benchmark_free(primitives_YUV_benchmark* bench)
 	for (size_t i = 0; i < 3; i++)
 	{
 		free(bench->outputChannels[i]);
+		free(bench->auxChannels[i]);
 		free(bench->channels[i]);
 	}
 
@@ -75,7 +81,8 @@ static primitives_YUV_benchmark primitives_YUV_benchmark_init(void)
 	{
 		ret.channels[i] = calloc(ret.roi.width, ret.roi.height);
 		ret.outputChannels[i] = calloc(ret.roi.width, ret.roi.height);
-		if (!ret.channels[i] || !ret.outputChannels[i])
+		ret.auxChannels[i] = calloc(ret.roi.width, ret.roi.height);
+		if (!ret.channels[i] || !ret.outputChannels[i] || !ret.auxChannels[i])
 			goto fail;
 
 		if (winpr_RAND(ret.channels[i], 1ull * ret.roi.width * ret.roi.height) < 0)
@@ -98,6 +105,15 @@ static const char* print_time(UINT64 t, char* buffer, size_t size)
 	return buffer;
 }
 
+static void print_throughput(const char* name, const prim_size_t* roi, UINT64 best)
+{
+	char buffer[32] = WINPR_C_ARRAY_INIT;
+	const double pixels = 1.0 * roi->width * roi->height;
+	const double mps = (best > 0) ? (pixels * 1000.0 / (double)best) : 0.0;
+	printf("%s %" PRIu32 "x%" PRIu32 " best %sns, %.1f MPixel/s\n", name, roi->width, roi->height,
+	       print_time(best, buffer, sizeof(buffer)), mps);
+}
+
 static BOOL primitives_YUV420_benchmark_run(primitives_YUV_benchmark* bench, primitives_t* prims)
 {
 	const BYTE* channels[3] = WINPR_C_ARRAY_INIT;
@@ -105,6 +121,7 @@ static BOOL primitives_YUV420_benchmark_run(primitives_YUV_benchmark* bench, pri
 	for (size_t i = 0; i < 3; i++)
 		channels[i] = bench->channels[i];
 
+	UINT64 best = UINT64_MAX;
 	for (size_t x = 0; x < 10; x++)
 	{
 		const UINT64 start = winpr_GetTickCount64NS();
@@ -121,8 +138,11 @@ static BOOL primitives_YUV420_benchmark_run(primitives_YUV_benchmark* bench, pri
 		char buffer[32] = WINPR_C_ARRAY_INIT;
 		printf("[%" PRIuz "] YUV420ToRGB_8u_P3AC4R %" PRIu32 "x%" PRIu32 " took %sns\n", x,
 		       bench->roi.width, bench->roi.height, print_time(diff, buffer, sizeof(buffer)));
+		if (diff < best)
+			best = diff;
 	}
 
+	print_throughput("YUV420ToRGB_8u_P3AC4R", &bench->roi, best);
 	return TRUE;
 }
 
@@ -133,6 +153,7 @@ static BOOL primitives_YUV444_benchmark_run(primitives_YUV_benchmark* bench, pri
 	for (size_t i = 0; i < 3; i++)
 		channels[i] = bench->channels[i];
 
+	UINT64 best = UINT64_MAX;
 	for (size_t x = 0; x < 10; x++)
 	{
 		const UINT64 start = winpr_GetTickCount64NS();
@@ -149,13 +170,17 @@ static BOOL primitives_YUV444_benchmark_run(primitives_YUV_benchmark* bench, pri
 		char buffer[32] = WINPR_C_ARRAY_INIT;
 		printf("[%" PRIuz "] YUV444ToRGB_8u_P3AC4R %" PRIu32 "x%" PRIu32 " took %sns\n", x,
 		       bench->roi.width, bench->roi.height, print_time(diff, buffer, sizeof(buffer)));
+		if (diff < best)
+			best = diff;
 	}
 
+	print_throughput("YUV444ToRGB_8u_P3AC4R", &bench->roi, best);
 	return TRUE;
 }
 
 static BOOL primitives_RGB2420_benchmark_run(primitives_YUV_benchmark* bench, primitives_t* prims)
 {
+	UINT64 best = UINT64_MAX;
 	for (size_t x = 0; x < 10; x++)
 	{
 		const UINT64 start = winpr_GetTickCount64NS();
@@ -172,13 +197,17 @@ static BOOL primitives_RGB2420_benchmark_run(primitives_YUV_benchmark* bench, pr
 		char buffer[32] = WINPR_C_ARRAY_INIT;
 		printf("[%" PRIuz "] RGBToYUV420_8u_P3AC4R %" PRIu32 "x%" PRIu32 " took %sns\n", x,
 		       bench->roi.width, bench->roi.height, print_time(diff, buffer, sizeof(buffer)));
+		if (diff < best)
+			best = diff;
 	}
 
+	print_throughput("RGBToYUV420_8u_P3AC4R", &bench->roi, best);
 	return TRUE;
 }
 
 static BOOL primitives_RGB2444_benchmark_run(primitives_YUV_benchmark* bench, primitives_t* prims)
 {
+	UINT64 best = UINT64_MAX;
 	for (size_t x = 0; x < 10; x++)
 	{
 		const UINT64 start = winpr_GetTickCount64NS();
@@ -195,8 +224,142 @@ static BOOL primitives_RGB2444_benchmark_run(primitives_YUV_benchmark* bench, pr
 		char buffer[32] = WINPR_C_ARRAY_INIT;
 		printf("[%" PRIuz "] RGBToYUV444_8u_P3AC4R %" PRIu32 "x%" PRIu32 " took %sns\n", x,
 		       bench->roi.width, bench->roi.height, print_time(diff, buffer, sizeof(buffer)));
+		if (diff < best)
+			best = diff;
+	}
+
+	print_throughput("RGBToYUV444_8u_P3AC4R", &bench->roi, best);
+	return TRUE;
+}
+
+static BOOL primitives_RGB2AVC444_benchmark_run(primitives_YUV_benchmark* bench,
+                                                primitives_t* prims)
+{
+	UINT64 best = UINT64_MAX;
+	for (size_t x = 0; x < 10; x++)
+	{
+		const UINT64 start = winpr_GetTickCount64NS();
+		pstatus_t status = prims->RGBToAVC444YUV(
+		    bench->rgbBuffer, bench->testedFormat, bench->outputStride, bench->outputChannels,
+		    bench->steps, bench->auxChannels, bench->steps, &bench->roi);
+		const UINT64 end = winpr_GetTickCount64NS();
+		if (status != PRIMITIVES_SUCCESS)
+		{
+			(void)fprintf(stderr, "Running RGBToAVC444YUV failed\n");
+			return FALSE;
+		}
+		const UINT64 diff = end - start;
+		char buffer[32] = WINPR_C_ARRAY_INIT;
+		printf("[%" PRIuz "] RGBToAVC444YUV %" PRIu32 "x%" PRIu32 " took %sns\n", x,
+		       bench->roi.width, bench->roi.height, print_time(diff, buffer, sizeof(buffer)));
+		if (diff < best)
+			best = diff;
+	}
+
+	print_throughput("RGBToAVC444YUV", &bench->roi, best);
+	return TRUE;
+}
+
+static BOOL primitives_compare_benchmark_run(primitives_t* prims, UINT32 width, UINT32 height)
+{
+	BOOL rc = FALSE;
+	const prim_size_t roi = { width, height };
+	const UINT32 step = width * 4;
+	const UINT32 tilesStep = (width + 15) / 16;
+	BYTE* frame1 = calloc(step, height);
+	BYTE* frame2 = calloc(step, height);
+	BYTE* tiles = calloc(tilesStep, (height + 15) / 16);
+
+	if (!frame1 || !frame2 || !tiles)
+		goto fail;
+
+	/* Identical frames are the common case for a mostly static desktop and require reading
+	 * every pixel */
+	if (winpr_RAND(frame1, 1ull * step * height) < 0)
+		goto fail;
+	memcpy(frame2, frame1, 1ull * step * height);
+
+	UINT64 best = UINT64_MAX;
+	for (size_t x = 0; x < 10; x++)
+	{
+		const UINT64 start = winpr_GetTickCount64NS();
+		pstatus_t status =
+		    prims->compare_tiles_32u(frame1, step, frame2, step, width, height, tiles, tilesStep);
+		const UINT64 end = winpr_GetTickCount64NS();
+		if (status != PRIMITIVES_SUCCESS)
+		{
+			(void)fprintf(stderr, "Running compare_tiles_32u failed\n");
+			goto fail;
+		}
+		const UINT64 diff = end - start;
+		if (diff < best)
+			best = diff;
 	}
 
+	print_throughput("compare_tiles_32u", &roi, best);
+	rc = TRUE;
+
+fail:
+	free(frame1);
+	free(frame2);
+	free(tiles);
+	return rc;
+}
+
+static BOOL primitives_benchmark_run_all(primitives_YUV_benchmark* bench, primitives_t* prim,
+                                         const char* name)
+{
+	if (prim->compare_tiles_32u)
+	{
+		printf("Running tile compare benchmark on %s implementation:\n", name);
+		if (!primitives_compare_benchmark_run(prim, 1920, 1080) ||
+		    !primitives_compare_benchmark_run(prim, 3840, 2160))
+		{
+			(void)fprintf(stderr, "tile compare benchmark failed\n");
+			return FALSE;
+		}
+		printf("\n");
+	}
+
+	printf("Running YUV420 -> RGB benchmark on %s implementation:\n", name);
+	if (!primitives_YUV420_benchmark_run(bench, prim))
+	{
+		(void)fprintf(stderr, "YUV420 -> RGB benchmark failed\n");
+		return FALSE;
+	}
+	printf("\n");
+
+	printf("Running RGB -> YUV420 benchmark on %s implementation:\n", name);
+	if (!primitives_RGB2420_benchmark_run(bench, prim))
+	{
+		(void)fprintf(stderr, "RGB -> YUV420 benchmark failed\n");
+		return FALSE;
+	}
+	printf("\n");
+
+	printf("Running YUV444 -> RGB benchmark on %s implementation:\n", name);
+	if (!primitives_YUV444_benchmark_run(bench, prim))
+	{
+		(void)fprintf(stderr, "YUV444 -> RGB benchmark failed\n");
+		return FALSE;
+	}
+	printf("\n");
+
+	printf("Running RGB -> YUV444 benchmark on %s implementation:\n", name);
+	if (!primitives_RGB2444_benchmark_run(bench, prim))
+	{
+		(void)fprintf(stderr, "RGB -> YUV444 benchmark failed\n");
+		return FALSE;
+	}
+	printf("\n");
+
+	printf("Running RGB -> AVC444 benchmark on %s implementation:\n", name);
+	if (!primitives_RGB2AVC444_benchmark_run(bench, prim))
+	{
+		(void)fprintf(stderr, "RGB -> AVC444 benchmark failed\n");
+		return FALSE;
+	}
+	printf("\n");
 	return TRUE;
 }
 
@@ -216,38 +379,33 @@ int main(int argc, char* argv[])
 			goto fail;
 		}
 
-		printf("Running YUV420 -> RGB benchmark on %s implementation:\n", hintstr);
-		if (!primitives_YUV420_benchmark_run(&bench, prim))
-		{
-			(void)fprintf(stderr, "YUV420 -> RGB benchmark failed\n");
-			goto fail;
-		}
-		printf("\n");
-
-		printf("Running RGB -> YUV420 benchmark on %s implementation:\n", hintstr);
-		if (!primitives_RGB2420_benchmark_run(&bench, prim))
-		{
-			(void)fprintf(stderr, "RGB -> YUV420 benchmark failed\n");
+		if (!primitives_benchmark_run_all(&bench, prim, hintstr))
 			goto fail;
-		}
-		printf("\n");
+	}
 
-		printf("Running YUV444 -> RGB benchmark on %s implementation:\n", hintstr);
-		if (!primitives_YUV444_benchmark_run(&bench, prim))
+#if defined(BUILD_TESTING_INTERNAL)
+	/* The instruction set specific routines are internal, only exported for testing */
+	{
+		const struct
 		{
-			(void)fprintf(stderr, "YUV444 -> RGB benchmark failed\n");
-			goto fail;
-		}
-		printf("\n");
+			DWORD feature;
+			const char* name;
+		} isas[] = { { 0, "generic" }, { PF_EX_SSE41, "SSE4.1" }, { PF_EX_AVX2, "AVX2" } };
 
-		printf("Running RGB -> YUV444 benchmark on %s implementation:\n", hintstr);
-		if (!primitives_RGB2444_benchmark_run(&bench, prim))
+		for (size_t x = 0; x < ARRAYSIZE(isas); x++)
 		{
-			(void)fprintf(stderr, "RGB -> YUV444 benchmark failed\n");
-			goto fail;
+			primitives_t prim = WINPR_C_ARRAY_INIT;
+			if (!primitives_init_YUV_by_feature(&prim, isas[x].feature))
+			{
+				printf("Skipping %s YUV implementation, not supported\n\n", isas[x].name);
+				continue;
+			}
+
+			if (!primitives_benchmark_run_all(&bench, &prim, isas[x].name))
+				goto fail;
 		}
-		printf("\n");
 	}
+#endif
 fail:
 	primitives_YUV_benchmark_free(&bench);
 	return 0;
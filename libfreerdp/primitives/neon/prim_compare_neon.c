@@ -0,0 +1,80 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Optimized tile compare
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <winpr/sysinfo.h>
+
+#include "prim_internal.h"
+#include "prim_compare.h"
+
+#if defined(NEON_INTRINSICS_ENABLED)
+#include <arm_neon.h>
+
+static inline uint8x16_t neon_xor_row(const BYTE* WINPR_RESTRICT p1, const BYTE* WINPR_RESTRICT p2)
+{
+	const uint8x16_t d0 = veorq_u8(vld1q_u8(&p1[0]), vld1q_u8(&p2[0]));
+	const uint8x16_t d1 = veorq_u8(vld1q_u8(&p1[16]), vld1q_u8(&p2[16]));
+	const uint8x16_t d2 = veorq_u8(vld1q_u8(&p1[32]), vld1q_u8(&p2[32]));
+	const uint8x16_t d3 = veorq_u8(vld1q_u8(&p1[48]), vld1q_u8(&p2[48]));
+	return vorrq_u8(vorrq_u8(d0, d1), vorrq_u8(d2, d3));
+}
+
+static BYTE neon_tile_differs(const BYTE* WINPR_RESTRICT pSrc1, size_t src1Step,
+                              const BYTE* WINPR_RESTRICT pSrc2, size_t src2Step)
+{
+	/* Check every 4 lines so a changed tile is not read completely */
+	for (size_t y = 0; y < PRIM_COMPARE_TILE_SIZE; y += 4)
+	{
+		uint8x16_t acc = vdupq_n_u8(0);
+		for (size_t k = y; k < y + 4; k++)
+			acc = vorrq_u8(acc, neon_xor_row(&pSrc1[k * src1Step], &pSrc2[k * src2Step]));
+
+		const uint64x2_t acc64 = vreinterpretq_u64_u8(acc);
+		if ((vgetq_lane_u64(acc64, 0) | vgetq_lane_u64(acc64, 1)) != 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static pstatus_t neon_compare_tiles_32u(const BYTE* WINPR_RESTRICT pSrc1, UINT32 src1Step,
+                                        const BYTE* WINPR_RESTRICT pSrc2, UINT32 src2Step,
+                                        UINT32 width, UINT32 height, BYTE* WINPR_RESTRICT pTiles,
+                                        UINT32 tilesStep)
+{
+	if (!pSrc1 || !pSrc2 || !pTiles)
+		return -1;
+
+	return prim_compare_tiles_32u(neon_tile_differs, pSrc1, src1Step, pSrc2, src2Step, width,
+	                              height, pTiles, tilesStep);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_compare_neon_int(primitives_t* WINPR_RESTRICT prims)
+{
+#if defined(NEON_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "NEON optimizations");
+	prims->compare_tiles_32u = neon_compare_tiles_32u;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or neon intrinsics not available");
+	WINPR_UNUSED(prims);
+#endif
+}
@@ -2388,5 +2388,41 @@ void primitives_init_YUV_opt(primitives_t* WINPR_RESTRICT prims)
 {
 	primitives_init_YUV(prims);
 	primitives_init_YUV_sse41(prims);
+#if defined(WITH_AVX2)
+	primitives_init_YUV_avx2(prims);
+#endif
 	primitives_init_YUV_neon(prims);
 }
+
+BOOL primitives_init_YUV_by_feature(primitives_t* prims, DWORD ProcessorFeature)
+{
+	const primitives_t* gen = primitives_get_generic();
+	if (!prims || !gen)
+		return FALSE;
+
+	*prims = *gen;
+	switch (ProcessorFeature)
+	{
+		case 0:
+			return TRUE;
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+		case PF_EX_SSE41:
+			if (!IsProcessorFeaturePresentEx(PF_EX_SSE41) ||
+			    !IsProcessorFeaturePresent(PF_SSE4_1_INSTRUCTIONS_AVAILABLE))
+				return FALSE;
+			primitives_init_YUV_sse41_int(prims);
+			return TRUE;
+#if defined(WITH_AVX2)
+		case PF_EX_AVX2:
+			if (!IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+				return FALSE;
+			/* routines without an AVX2 version use sse41 */
+			primitives_init_YUV_sse41_int(prims);
+			primitives_init_YUV_avx2_int(prims);
+			return TRUE;
+#endif
+#endif
+		default:
+			return FALSE;
+	}
+}
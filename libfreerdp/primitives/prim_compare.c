@@ -0,0 +1,86 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Primitives tile compare
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <string.h>
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+#include "prim_compare.h"
+
+/* ------------------------------------------------------------------------- */
+static pstatus_t general_compare_tiles_32u(const BYTE* WINPR_RESTRICT pSrc1, UINT32 src1Step,
+                                           const BYTE* WINPR_RESTRICT pSrc2, UINT32 src2Step,
+                                           UINT32 width, UINT32 height,
+                                           BYTE* WINPR_RESTRICT pTiles, UINT32 tilesStep)
+{
+	const size_t nrow = (height + PRIM_COMPARE_TILE_SIZE - 1) / PRIM_COMPARE_TILE_SIZE;
+	const size_t ncol = (width + PRIM_COMPARE_TILE_SIZE - 1) / PRIM_COMPARE_TILE_SIZE;
+
+	if (!pSrc1 || !pSrc2 || !pTiles)
+		return -1;
+
+	for (size_t ty = 0; ty < nrow; ty++)
+	{
+		const size_t th = MIN(PRIM_COMPARE_TILE_SIZE, height - ty * PRIM_COMPARE_TILE_SIZE);
+
+		for (size_t tx = 0; tx < ncol; tx++)
+		{
+			const size_t tw = MIN(PRIM_COMPARE_TILE_SIZE, width - tx * PRIM_COMPARE_TILE_SIZE);
+			const BYTE* p1 = &pSrc1[(ty * PRIM_COMPARE_TILE_SIZE * src1Step) +
+			                        (tx * PRIM_COMPARE_TILE_SIZE * 4ull)];
+			const BYTE* p2 = &pSrc2[(ty * PRIM_COMPARE_TILE_SIZE * src2Step) +
+			                        (tx * PRIM_COMPARE_TILE_SIZE * 4ull)];
+			BYTE differs = 0;
+
+			for (size_t k = 0; k < th; k++)
+			{
+				if (memcmp(p1, p2, tw * 4) != 0)
+				{
+					differs = 1;
+					break;
+				}
+
+				p1 += src1Step;
+				p2 += src2Step;
+			}
+
+			pTiles[ty * tilesStep + tx] = differs;
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_compare(primitives_t* WINPR_RESTRICT prims)
+{
+	prims->compare_tiles_32u = general_compare_tiles_32u;
+}
+
+void primitives_init_compare_opt(primitives_t* WINPR_RESTRICT prims)
+{
+	primitives_init_compare(prims);
+	primitives_init_compare_sse2(prims);
+#if defined(WITH_AVX2)
+	primitives_init_compare_avx2(prims);
+#endif
+	primitives_init_compare_neon(prims);
+}
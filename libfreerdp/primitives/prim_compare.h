@@ -0,0 +1,114 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Primitives tile compare
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_LIB_PRIM_COMPARE_H
+#define FREERDP_LIB_PRIM_COMPARE_H
+
+#include <winpr/wtypes.h>
+#include <winpr/sysinfo.h>
+
+#include <freerdp/config.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+
+/* Edge length of a compared tile in pixels */
+#define PRIM_COMPARE_TILE_SIZE 16
+
+/**
+ * Compares the tiles covering only complete 16x16 pixels blocks with \b fkt and the partial
+ * tiles at the right and bottom edges with the generic implementation.
+ */
+typedef BYTE (*prim_compare_tile_fkt)(const BYTE* WINPR_RESTRICT pSrc1, size_t src1Step,
+                                      const BYTE* WINPR_RESTRICT pSrc2, size_t src2Step);
+
+static inline pstatus_t prim_compare_tiles_32u(prim_compare_tile_fkt fkt,
+                                               const BYTE* WINPR_RESTRICT pSrc1, UINT32 src1Step,
+                                               const BYTE* WINPR_RESTRICT pSrc2, UINT32 src2Step,
+                                               UINT32 width, UINT32 height,
+                                               BYTE* WINPR_RESTRICT pTiles, UINT32 tilesStep)
+{
+	const primitives_t* gen = primitives_get_generic();
+	const size_t fullCols = width / PRIM_COMPARE_TILE_SIZE;
+	const size_t fullRows = height / PRIM_COMPARE_TILE_SIZE;
+	const size_t tileStep1 = 1ull * PRIM_COMPARE_TILE_SIZE * src1Step;
+	const size_t tileStep2 = 1ull * PRIM_COMPARE_TILE_SIZE * src2Step;
+	const size_t tileWidth = 4ull * PRIM_COMPARE_TILE_SIZE;
+
+	WINPR_ASSERT(fkt);
+	WINPR_ASSERT(gen);
+
+	for (size_t ty = 0; ty < fullRows; ty++)
+	{
+		const BYTE* p1 = &pSrc1[ty * tileStep1];
+		const BYTE* p2 = &pSrc2[ty * tileStep2];
+		BYTE* tiles = &pTiles[ty * tilesStep];
+
+		for (size_t tx = 0; tx < fullCols; tx++)
+			tiles[tx] = fkt(&p1[tx * tileWidth], src1Step, &p2[tx * tileWidth], src2Step);
+	}
+
+	if ((fullCols * PRIM_COMPARE_TILE_SIZE < width) && (fullRows > 0))
+	{
+		const pstatus_t status = gen->compare_tiles_32u(
+		    &pSrc1[fullCols * tileWidth], src1Step, &pSrc2[fullCols * tileWidth], src2Step,
+		    width % PRIM_COMPARE_TILE_SIZE, (UINT32)(fullRows * PRIM_COMPARE_TILE_SIZE),
+		    &pTiles[fullCols], tilesStep);
+		if (status != PRIMITIVES_SUCCESS)
+			return status;
+	}
+
+	if (fullRows * PRIM_COMPARE_TILE_SIZE < height)
+		return gen->compare_tiles_32u(&pSrc1[fullRows * tileStep1], src1Step,
+		                              &pSrc2[fullRows * tileStep2], src2Step, width,
+		                              height % PRIM_COMPARE_TILE_SIZE,
+		                              &pTiles[fullRows * tilesStep], tilesStep);
+
+	return PRIMITIVES_SUCCESS;
+}
+
+FREERDP_LOCAL void primitives_init_compare_sse2_int(primitives_t* WINPR_RESTRICT prims);
+static inline void primitives_init_compare_sse2(primitives_t* WINPR_RESTRICT prims)
+{
+	if (!IsProcessorFeaturePresent(PF_SSE2_INSTRUCTIONS_AVAILABLE) ||
+	    !IsProcessorFeaturePresent(PF_SSE3_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	primitives_init_compare_sse2_int(prims);
+}
+
+#if defined(WITH_AVX2)
+FREERDP_LOCAL void primitives_init_compare_avx2_int(primitives_t* WINPR_RESTRICT prims);
+static inline void primitives_init_compare_avx2(primitives_t* WINPR_RESTRICT prims)
+{
+	if (!IsProcessorFeaturePresent(PF_AVX2_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	primitives_init_compare_avx2_int(prims);
+}
+#endif
+
+FREERDP_LOCAL void primitives_init_compare_neon_int(primitives_t* WINPR_RESTRICT prims);
+static inline void primitives_init_compare_neon(primitives_t* WINPR_RESTRICT prims)
+{
+	if (!IsProcessorFeaturePresent(PF_ARM_NEON_INSTRUCTIONS_AVAILABLE))
+		return;
+
+	primitives_init_compare_neon_int(prims);
+}
+
+#endif
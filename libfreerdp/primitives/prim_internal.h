@@ -332,6 +332,7 @@ FREERDP_LOCAL void primitives_init_alphaComp(primitives_t* WINPR_RESTRICT prims)
 FREERDP_LOCAL void primitives_init_colors(primitives_t* WINPR_RESTRICT prims);
 FREERDP_LOCAL void primitives_init_YCoCg(primitives_t* WINPR_RESTRICT prims);
 FREERDP_LOCAL void primitives_init_YUV(primitives_t* WINPR_RESTRICT prims);
+FREERDP_LOCAL void primitives_init_compare(primitives_t* WINPR_RESTRICT prims);
 
 FREERDP_LOCAL void primitives_init_copy_opt(primitives_t* WINPR_RESTRICT prims);
 FREERDP_LOCAL void primitives_init_set_opt(primitives_t* WINPR_RESTRICT prims);
@@ -343,6 +344,12 @@ FREERDP_LOCAL void primitives_init_alphaComp_opt(primitives_t* WINPR_RESTRICT pr
 FREERDP_LOCAL void primitives_init_colors_opt(primitives_t* WINPR_RESTRICT prims);
 FREERDP_LOCAL void primitives_init_YCoCg_opt(primitives_t* WINPR_RESTRICT prims);
 FREERDP_LOCAL void primitives_init_YUV_opt(primitives_t* WINPR_RESTRICT prims);
+FREERDP_LOCAL void primitives_init_compare_opt(primitives_t* WINPR_RESTRICT prims);
+
+/* Generic primitives with the YUV routines of ProcessorFeature (0, PF_EX_SSE41 or PF_EX_AVX2),
+ * FALSE if the build or the CPU does not support it. Used to compare the implementations. */
+WINPR_ATTR_NODISCARD
+FREERDP_LOCAL BOOL primitives_init_YUV_by_feature(primitives_t* prims, DWORD ProcessorFeature);
 
 #if defined(WITH_OPENCL)
 WINPR_ATTR_NODISCARD
@@ -0,0 +1,1124 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Optimized YUV/RGB conversion operations
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/wtypes.h>
+#include <freerdp/config.h>
+
+#include <winpr/sysinfo.h>
+#include <winpr/crt.h>
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+
+#include "prim_internal.h"
+#include "prim_avxsse.h"
+#include "prim_YUV.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+#include <immintrin.h>
+
+/* The kernels in this file are 256 bit versions of the sse41 ones.
+ * Most AVX2 integer instructions operate on two independent 128 bit lanes,
+ * so the sse41 data flow is kept per lane and the results are put back into
+ * pixel order with a single cross lane permutation where required. */
+
+static primitives_t* generic = nullptr;
+
+WINPR_ATTR_NODISCARD
+static inline __m256i LOAD_SI256(const void* ptr)
+{
+	const __m256i* mptr = WINPR_CXX_COMPAT_CAST(const __m256i*, ptr);
+	return _mm256_loadu_si256(mptr);
+}
+
+static inline void STORE_SI256(void* ptr, __m256i val)
+{
+	__m256i* mptr = WINPR_CXX_COMPAT_CAST(__m256i*, ptr);
+	_mm256_storeu_si256(mptr, val);
+}
+
+/* Same 128 bit pattern in both lanes */
+WINPR_ATTR_NODISCARD
+static inline __m256i mm256_set_lanes_epu32(uint32_t val1, uint32_t val2, uint32_t val3,
+                                            uint32_t val4)
+{
+	return _mm256_broadcastsi128_si256(mm_set_epu32(val1, val2, val3, val4));
+}
+
+WINPR_ATTR_NODISCARD
+static inline __m256i mm256_set1_epu32(uint32_t val)
+{
+	return _mm256_set1_epi32(WINPR_CXX_COMPAT_CAST(int32_t, val));
+}
+
+/* Reorder the 32bit groups of a lane wise packed vector
+ * [0 2 4 6 | 1 3 5 7] -> [0 1 2 3 | 4 5 6 7] */
+WINPR_ATTR_NODISCARD
+static inline __m256i avx2_unpack_lanes_epi32(__m256i val)
+{
+	return _mm256_permutevar8x32_epi32(val, _mm256_set_epi32(7, 3, 6, 2, 5, 1, 4, 0));
+}
+
+/* Move the lower 64bit of each lane to the lower 128bit of the vector */
+WINPR_ATTR_NODISCARD
+static inline __m128i avx2_lower_epi64(__m256i val)
+{
+	return _mm256_castsi256_si128(_mm256_permute4x64_epi64(val, 0xD8));
+}
+
+/* Keep the alpha values already present in the destination buffer */
+static inline void avx2_store_BGRX(BYTE* WINPR_RESTRICT dst, __m256i BGR)
+{
+	const __m256i amask = mm256_set1_epu32(0xFF000000);
+	const __m256i old = _mm256_and_si256(LOAD_SI256(dst), amask);
+	STORE_SI256(dst, _mm256_or_si256(old, _mm256_andnot_si256(amask, BGR)));
+}
+
+/****************************************************************************/
+/* avx2 YUV420 -> RGB conversion                                            */
+/****************************************************************************/
+static inline __m256i avx2_YUV444Pixel(__m256i Yraw, __m256i Uraw, __m256i Vraw, UINT8 pos)
+{
+	const __m256i mapY[] = { mm256_set_lanes_epu32(0x80800380, 0x80800280, 0x80800180, 0x80800080),
+		                     mm256_set_lanes_epu32(0x80800780, 0x80800680, 0x80800580, 0x80800480),
+		                     mm256_set_lanes_epu32(0x80800B80, 0x80800A80, 0x80800980, 0x80800880),
+		                     mm256_set_lanes_epu32(0x80800F80, 0x80800E80, 0x80800D80,
+		                                           0x80800C80) };
+	const __m256i mapUV[] = {
+		mm256_set_lanes_epu32(0x80038002, 0x80018000, 0x80808080, 0x80808080),
+		mm256_set_lanes_epu32(0x80078006, 0x80058004, 0x80808080, 0x80808080),
+		mm256_set_lanes_epu32(0x800B800A, 0x80098008, 0x80808080, 0x80808080),
+		mm256_set_lanes_epu32(0x800F800E, 0x800D800C, 0x80808080, 0x80808080)
+	};
+	const __m256i mask[] = { mm256_set_lanes_epu32(0x80038080, 0x80028080, 0x80018080, 0x80008080),
+		                     mm256_set_lanes_epu32(0x80800380, 0x80800280, 0x80800180, 0x80800080),
+		                     mm256_set_lanes_epu32(0x80808003, 0x80808002, 0x80808001,
+		                                           0x80808000) };
+	const __m256i c128 = _mm256_set1_epi16(128);
+	const __m256i zero = _mm256_setzero_si256();
+
+	/* Load Y values and expand to 32 bit, multiplied by 256 */
+	const __m256i C = _mm256_shuffle_epi8(Yraw, mapY[pos]);
+	/* D = U - 128 */
+	const __m256i D = _mm256_sub_epi16(_mm256_shuffle_epi8(Uraw, mapUV[pos]), c128);
+	/* E = V - 128 */
+	const __m256i E = _mm256_sub_epi16(_mm256_shuffle_epi8(Vraw, mapUV[pos]), c128);
+	__m256i BGRX = zero;
+
+	/* Get the R value */
+	{
+		const __m256i c403 = _mm256_set1_epi16(403);
+		const __m256i e403 =
+		    _mm256_unpackhi_epi16(_mm256_mullo_epi16(E, c403), _mm256_mulhi_epi16(E, c403));
+		const __m256i R32 = _mm256_srai_epi32(_mm256_add_epi32(C, e403), 8);
+		const __m256i R16 = _mm256_packs_epi32(R32, zero);
+		const __m256i R = _mm256_packus_epi16(R16, zero);
+		BGRX = _mm256_or_si256(BGRX, _mm256_shuffle_epi8(R, mask[0]));
+	}
+	/* Get the G value */
+	{
+		const __m256i c48 = _mm256_set1_epi16(48);
+		const __m256i d48 =
+		    _mm256_unpackhi_epi16(_mm256_mullo_epi16(D, c48), _mm256_mulhi_epi16(D, c48));
+		const __m256i c120 = _mm256_set1_epi16(120);
+		const __m256i e120 =
+		    _mm256_unpackhi_epi16(_mm256_mullo_epi16(E, c120), _mm256_mulhi_epi16(E, c120));
+		const __m256i de = _mm256_add_epi32(d48, e120);
+		const __m256i G32 = _mm256_srai_epi32(_mm256_sub_epi32(C, de), 8);
+		const __m256i G16 = _mm256_packs_epi32(G32, zero);
+		const __m256i G = _mm256_packus_epi16(G16, zero);
+		BGRX = _mm256_or_si256(BGRX, _mm256_shuffle_epi8(G, mask[1]));
+	}
+	/* Get the B value */
+	{
+		const __m256i c475 = _mm256_set1_epi16(475);
+		const __m256i d475 =
+		    _mm256_unpackhi_epi16(_mm256_mullo_epi16(D, c475), _mm256_mulhi_epi16(D, c475));
+		const __m256i B32 = _mm256_srai_epi32(_mm256_add_epi32(C, d475), 8);
+		const __m256i B16 = _mm256_packs_epi32(B32, zero);
+		const __m256i B = _mm256_packus_epi16(B16, zero);
+		BGRX = _mm256_or_si256(BGRX, _mm256_shuffle_epi8(B, mask[2]));
+	}
+
+	return BGRX;
+}
+
+static inline pstatus_t avx2_YUV420ToRGB_BGRX(const BYTE* WINPR_RESTRICT pSrc[],
+                                              const UINT32* WINPR_RESTRICT srcStep,
+                                              BYTE* WINPR_RESTRICT pDst, UINT32 dstStep,
+                                              const prim_size_t* WINPR_RESTRICT roi)
+{
+	const UINT32 nWidth = roi->width;
+	const UINT32 nHeight = roi->height;
+	const UINT32 pad = roi->width % 32;
+	/* lane 0 duplicates chroma 0 to 7, lane 1 chroma 8 to 15 */
+	const __m256i duplicate =
+	    _mm256_set_epi8(15, 15, 14, 14, 13, 13, 12, 12, 11, 11, 10, 10, 9, 9, 8, 8, 7, 7, 6, 6, 5,
+	                    5, 4, 4, 3, 3, 2, 2, 1, 1, 0, 0);
+
+	for (size_t y = 0; y < nHeight; y++)
+	{
+		BYTE* dst = pDst + dstStep * y;
+		const BYTE* YData = pSrc[0] + y * srcStep[0];
+		const BYTE* UData = pSrc[1] + (y / 2) * srcStep[1];
+		const BYTE* VData = pSrc[2] + (y / 2) * srcStep[2];
+
+		for (UINT32 x = 0; x < nWidth - pad; x += 32)
+		{
+			const __m256i Y = LOAD_SI256(YData);
+			const __m256i U = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(LOAD_SI128(UData)),
+			                                      duplicate);
+			const __m256i V = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(LOAD_SI128(VData)),
+			                                      duplicate);
+			YData += 32;
+			UData += 16;
+			VData += 16;
+
+			/* lane 0 holds pixels 0 to 15, lane 1 pixels 16 to 31 */
+			const __m256i p0 = avx2_YUV444Pixel(Y, U, V, 0);
+			const __m256i p1 = avx2_YUV444Pixel(Y, U, V, 1);
+			const __m256i p2 = avx2_YUV444Pixel(Y, U, V, 2);
+			const __m256i p3 = avx2_YUV444Pixel(Y, U, V, 3);
+			avx2_store_BGRX(&dst[0], _mm256_permute2x128_si256(p0, p1, 0x20));
+			avx2_store_BGRX(&dst[32], _mm256_permute2x128_si256(p2, p3, 0x20));
+			avx2_store_BGRX(&dst[64], _mm256_permute2x128_si256(p0, p1, 0x31));
+			avx2_store_BGRX(&dst[96], _mm256_permute2x128_si256(p2, p3, 0x31));
+			dst += 128;
+		}
+
+		for (UINT32 x = 0; x < pad; x++)
+		{
+			const BYTE Y = *YData++;
+			const BYTE U = *UData;
+			const BYTE V = *VData;
+			dst = writeYUVPixel(dst, PIXEL_FORMAT_BGRX32, Y, U, V, writePixelBGRX);
+
+			if (x % 2)
+			{
+				UData++;
+				VData++;
+			}
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static pstatus_t avx2_YUV420ToRGB(const BYTE* WINPR_RESTRICT pSrc[3], const UINT32 srcStep[3],
+                                  BYTE* WINPR_RESTRICT pDst, UINT32 dstStep, UINT32 DstFormat,
+                                  const prim_size_t* WINPR_RESTRICT roi)
+{
+	switch (DstFormat)
+	{
+		case PIXEL_FORMAT_BGRX32:
+		case PIXEL_FORMAT_BGRA32:
+			return avx2_YUV420ToRGB_BGRX(pSrc, srcStep, pDst, dstStep, roi);
+
+		default:
+			return generic->YUV420ToRGB_8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
+	}
+}
+
+/****************************************************************************/
+/* avx2 YUV444 -> RGB conversion                                            */
+/****************************************************************************/
+static inline void BGRX_fillRGB(size_t offset, BYTE* WINPR_RESTRICT pRGB[2],
+                                const BYTE* WINPR_RESTRICT pY[2], const BYTE* WINPR_RESTRICT pU[2],
+                                const BYTE* WINPR_RESTRICT pV[2], BOOL filter)
+{
+	WINPR_ASSERT(pRGB);
+	WINPR_ASSERT(pY);
+	WINPR_ASSERT(pU);
+	WINPR_ASSERT(pV);
+
+	const UINT32 DstFormat = PIXEL_FORMAT_BGRX32;
+	const UINT32 bpp = 4;
+
+	for (size_t i = 0; i < 2; i++)
+	{
+		for (size_t j = 0; j < 2; j++)
+		{
+			const BYTE Y = pY[i][offset + j];
+			BYTE U = pU[i][offset + j];
+			BYTE V = pV[i][offset + j];
+			if ((i == 0) && (j == 0) && filter)
+			{
+				const INT32 avgU =
+				    4 * pU[0][offset] - pU[0][offset + 1] - pU[1][offset] - pU[1][offset + 1];
+				const INT32 avgV =
+				    4 * pV[0][offset] - pV[0][offset + 1] - pV[1][offset] - pV[1][offset + 1];
+
+				U = CONDITIONAL_CLIP(avgU, pU[0][offset]);
+				V = CONDITIONAL_CLIP(avgV, pV[0][offset]);
+			}
+
+			writeYUVPixel(&pRGB[i][(j + offset) * bpp], DstFormat, Y, U, V, writePixelBGRX);
+		}
+	}
+}
+
+/* input are uint16_t vectors */
+static inline __m256i avx2_yuv2x_single(const __m256i Y, __m256i U, __m256i V, const short iMulU,
+                                        const short iMulV)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	__m256i Ylo = _mm256_unpacklo_epi16(Y, zero);
+	__m256i Yhi = _mm256_unpackhi_epi16(Y, zero);
+	if (iMulU != 0)
+	{
+		const __m256i D = _mm256_sub_epi16(U, _mm256_set1_epi16(128));
+		const __m256i mul = _mm256_set1_epi16(iMulU);
+		const __m256i mulDlo = _mm256_mullo_epi16(D, mul);
+		const __m256i mulDhi = _mm256_mulhi_epi16(D, mul);
+		Ylo = _mm256_add_epi32(Ylo, _mm256_unpacklo_epi16(mulDlo, mulDhi));
+		Yhi = _mm256_add_epi32(Yhi, _mm256_unpackhi_epi16(mulDlo, mulDhi));
+	}
+	if (iMulV != 0)
+	{
+		const __m256i E = _mm256_sub_epi16(V, _mm256_set1_epi16(128));
+		const __m256i mul = _mm256_set1_epi16(iMulV);
+		const __m256i mulElo = _mm256_mullo_epi16(E, mul);
+		const __m256i mulEhi = _mm256_mulhi_epi16(E, mul);
+		Ylo = _mm256_add_epi32(Ylo, _mm256_unpacklo_epi16(mulElo, mulEhi));
+		Yhi = _mm256_add_epi32(Yhi, _mm256_unpackhi_epi16(mulElo, mulEhi));
+	}
+
+	return _mm256_packs_epi32(_mm256_srai_epi32(Ylo, 8), _mm256_srai_epi32(Yhi, 8));
+}
+
+/* Input are uint8_t vectors */
+static inline __m256i avx2_yuv2x(const __m256i Y, __m256i U, __m256i V, const short iMulU,
+                                 const short iMulV)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	/* Y * 256, U and V extended to uint16_t */
+	const __m256i preslo =
+	    avx2_yuv2x_single(_mm256_unpacklo_epi8(zero, Y), _mm256_unpacklo_epi8(U, zero),
+	                      _mm256_unpacklo_epi8(V, zero), iMulU, iMulV);
+	const __m256i preshi =
+	    avx2_yuv2x_single(_mm256_unpackhi_epi8(zero, Y), _mm256_unpackhi_epi8(U, zero),
+	                      _mm256_unpackhi_epi8(V, zero), iMulU, iMulV);
+	return _mm256_packus_epi16(preslo, preshi);
+}
+
+static inline void avx2_BGRX_fillRGB_pixel(BYTE* WINPR_RESTRICT pRGB, __m256i Y, __m256i U,
+                                           __m256i V)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	/* const INT32 r = ((256L * C(Y) + 0L * D(U) + 403L * E(V))) >> 8; */
+	const __m256i r = avx2_yuv2x(Y, U, V, 0, 403);
+	/* const INT32 g = ((256L * C(Y) - 48L * D(U) - 120L * E(V))) >> 8; */
+	const __m256i g = avx2_yuv2x(Y, U, V, -48, -120);
+	/* const INT32 b = ((256L * C(Y) + 475L * D(U) + 0L * E(V))) >> 8; */
+	const __m256i b = avx2_yuv2x(Y, U, V, 475, 0);
+
+	const __m256i rxlo = _mm256_unpacklo_epi8(r, zero);
+	const __m256i rxhi = _mm256_unpackhi_epi8(r, zero);
+	const __m256i bglo = _mm256_unpacklo_epi8(b, g);
+	const __m256i bghi = _mm256_unpackhi_epi8(b, g);
+
+	/* lane 0 holds pixels 0 to 15, lane 1 pixels 16 to 31 */
+	const __m256i bgrx0 = _mm256_unpacklo_epi16(bglo, rxlo);
+	const __m256i bgrx1 = _mm256_unpackhi_epi16(bglo, rxlo);
+	const __m256i bgrx2 = _mm256_unpacklo_epi16(bghi, rxhi);
+	const __m256i bgrx3 = _mm256_unpackhi_epi16(bghi, rxhi);
+	avx2_store_BGRX(&pRGB[0], _mm256_permute2x128_si256(bgrx0, bgrx1, 0x20));
+	avx2_store_BGRX(&pRGB[32], _mm256_permute2x128_si256(bgrx2, bgrx3, 0x20));
+	avx2_store_BGRX(&pRGB[64], _mm256_permute2x128_si256(bgrx0, bgrx1, 0x31));
+	avx2_store_BGRX(&pRGB[96], _mm256_permute2x128_si256(bgrx2, bgrx3, 0x31));
+}
+
+static inline void avx2_filter(__m256i pU[2])
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	/* sum of the odd values of the first and both values of the second line */
+	const __m256i u1sum = _mm256_hadds_epi16(_mm256_unpacklo_epi8(pU[1], zero),
+	                                         _mm256_unpackhi_epi8(pU[1], zero));
+	const __m256i u0odd = _mm256_srli_epi16(pU[0], 8);
+	const __m256i sum = _mm256_adds_epi16(u1sum, u0odd);
+
+	/* Mask out the odd bytes. We don´t need to do anything to make the uint8_t to uint16_t */
+	const __m256i u0even = _mm256_and_si256(pU[0], _mm256_set1_epi16(0x00FF));
+
+	/* avg = 4 * u0even - sum, clamped to [0, 255] */
+	const __m256i uavg = _mm256_sub_epi16(_mm256_slli_epi16(u0even, 2), sum);
+	const __m256i avg = _mm256_min_epi16(_mm256_max_epi16(uavg, zero), _mm256_set1_epi16(0xFF));
+
+	/* Only apply the avg value if the difference is < 30 */
+	const __m256i absdiff = _mm256_abs_epi16(_mm256_subs_epi16(u0even, avg));
+	const __m256i umask = _mm256_cmpgt_epi16(_mm256_set1_epi16(30), absdiff);
+
+	const __m256i evenresult = _mm256_blendv_epi8(avg, u0even, umask);
+	const __m256i u0oddbytes = _mm256_andnot_si256(_mm256_set1_epi16(0x00FF), pU[0]);
+	pU[0] = _mm256_or_si256(evenresult, u0oddbytes);
+}
+
+static inline pstatus_t avx2_YUV444ToRGB_8u_P3AC4R_BGRX_DOUBLE_ROW(
+    BYTE* WINPR_RESTRICT pDst[2], const BYTE* WINPR_RESTRICT YData[2],
+    const BYTE* WINPR_RESTRICT UData[2], const BYTE* WINPR_RESTRICT VData[2], UINT32 nWidth)
+{
+	WINPR_ASSERT((nWidth % 2) == 0);
+	const UINT32 pad = nWidth % 32;
+
+	size_t x = 0;
+	for (; x < nWidth - pad; x += 32)
+	{
+		__m256i U[] = { LOAD_SI256(&UData[0][x]), LOAD_SI256(&UData[1][x]) };
+		__m256i V[] = { LOAD_SI256(&VData[0][x]), LOAD_SI256(&VData[1][x]) };
+
+		avx2_filter(U);
+		avx2_filter(V);
+
+		for (size_t i = 0; i < 2; i++)
+			avx2_BGRX_fillRGB_pixel(&pDst[i][x * 4], LOAD_SI256(&YData[i][x]), U[i], V[i]);
+	}
+
+	for (; x < nWidth; x += 2)
+	{
+		BGRX_fillRGB(x, pDst, YData, UData, VData, TRUE);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static inline pstatus_t avx2_YUV444ToRGB_8u_P3AC4R_BGRX_SINGLE_ROW(
+    BYTE* WINPR_RESTRICT pDst, const BYTE* WINPR_RESTRICT YData, const BYTE* WINPR_RESTRICT UData,
+    const BYTE* WINPR_RESTRICT VData, UINT32 nWidth)
+{
+	for (size_t x = 0; x < nWidth; x++)
+	{
+		pDst = writeYUVPixel(pDst, PIXEL_FORMAT_BGRX32, YData[x], UData[x], VData[x],
+		                     writePixelBGRX);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static inline pstatus_t avx2_YUV444ToRGB_8u_P3AC4R_BGRX(const BYTE* WINPR_RESTRICT pSrc[],
+                                                        const UINT32 srcStep[],
+                                                        BYTE* WINPR_RESTRICT pDst, UINT32 dstStep,
+                                                        const prim_size_t* WINPR_RESTRICT roi)
+{
+	const UINT32 nWidth = roi->width;
+	const UINT32 nHeight = roi->height;
+
+	size_t y = 0;
+	for (; y < nHeight - nHeight % 2; y += 2)
+	{
+		BYTE* dst[] = { (pDst + dstStep * y), (pDst + dstStep * (y + 1)) };
+		const BYTE* YData[] = { pSrc[0] + y * srcStep[0], pSrc[0] + (y + 1) * srcStep[0] };
+		const BYTE* UData[] = { pSrc[1] + y * srcStep[1], pSrc[1] + (y + 1) * srcStep[1] };
+		const BYTE* VData[] = { pSrc[2] + y * srcStep[2], pSrc[2] + (y + 1) * srcStep[2] };
+
+		const pstatus_t rc =
+		    avx2_YUV444ToRGB_8u_P3AC4R_BGRX_DOUBLE_ROW(dst, YData, UData, VData, nWidth);
+		if (rc != PRIMITIVES_SUCCESS)
+			return rc;
+	}
+	for (; y < nHeight; y++)
+	{
+		BYTE* dst = (pDst + dstStep * y);
+		const BYTE* YData = pSrc[0] + y * srcStep[0];
+		const BYTE* UData = pSrc[1] + y * srcStep[1];
+		const BYTE* VData = pSrc[2] + y * srcStep[2];
+		const pstatus_t rc =
+		    avx2_YUV444ToRGB_8u_P3AC4R_BGRX_SINGLE_ROW(dst, YData, UData, VData, nWidth);
+		if (rc != PRIMITIVES_SUCCESS)
+			return rc;
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static pstatus_t avx2_YUV444ToRGB_8u_P3AC4R(const BYTE* WINPR_RESTRICT pSrc[],
+                                            const UINT32 srcStep[], BYTE* WINPR_RESTRICT pDst,
+                                            UINT32 dstStep, UINT32 DstFormat,
+                                            const prim_size_t* WINPR_RESTRICT roi)
+{
+	if ((roi->width % 2) != 0)
+		return generic->YUV444ToRGB_8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
+
+	switch (DstFormat)
+	{
+		case PIXEL_FORMAT_BGRX32:
+		case PIXEL_FORMAT_BGRA32:
+			return avx2_YUV444ToRGB_8u_P3AC4R_BGRX(pSrc, srcStep, pDst, dstStep, roi);
+
+		default:
+			return generic->YUV444ToRGB_8u_P3AC4R(pSrc, srcStep, pDst, dstStep, DstFormat, roi);
+	}
+}
+
+/****************************************************************************/
+/* avx2 RGB -> YUV420 conversion                                           **/
+/****************************************************************************/
+
+/* See prim_YUV_sse4.1.c for the derivation of the factors */
+#define BGRX_Y_FACTORS mm256_set_lanes_epu32(0x001B5C09, 0x001B5C09, 0x001B5C09, 0x001B5C09)
+#define BGRX_U_FACTORS mm256_set_lanes_epu32(0x00E39D7F, 0x00E39D7F, 0x00E39D7F, 0x00E39D7F)
+#define BGRX_V_FACTORS mm256_set_lanes_epu32(0x007F8CF4, 0x007F8CF4, 0x007F8CF4, 0x007F8CF4)
+#define CONST128_FACTORS _mm256_set1_epi8(-128)
+
+#define Y_SHIFT 7
+#define U_SHIFT 8
+#define V_SHIFT 8
+
+static inline void avx2_BGRX_TO_YUV(const BYTE* WINPR_RESTRICT pLine1, BYTE* WINPR_RESTRICT pYLine,
+                                    BYTE* WINPR_RESTRICT pULine, BYTE* WINPR_RESTRICT pVLine)
+{
+	const BYTE r1 = pLine1[2];
+	const BYTE g1 = pLine1[1];
+	const BYTE b1 = pLine1[0];
+
+	if (pYLine)
+		pYLine[0] = RGB2Y(r1, g1, b1);
+	if (pULine)
+		pULine[0] = RGB2U(r1, g1, b1);
+	if (pVLine)
+		pVLine[0] = RGB2V(r1, g1, b1);
+}
+
+/* luma (Y) of 32 BGRX pixels in pixel order */
+WINPR_ATTR_NODISCARD
+static inline __m256i avx2_BGRX_TO_Y(const BYTE* WINPR_RESTRICT src)
+{
+	const __m256i y_factors = BGRX_Y_FACTORS;
+	const __m256i x0 = _mm256_maddubs_epi16(LOAD_SI256(&src[0]), y_factors);
+	const __m256i x1 = _mm256_maddubs_epi16(LOAD_SI256(&src[32]), y_factors);
+	const __m256i x2 = _mm256_maddubs_epi16(LOAD_SI256(&src[64]), y_factors);
+	const __m256i x3 = _mm256_maddubs_epi16(LOAD_SI256(&src[96]), y_factors);
+	const __m256i y0 = _mm256_srli_epi16(_mm256_hadds_epi16(x0, x1), Y_SHIFT);
+	const __m256i y1 = _mm256_srli_epi16(_mm256_hadds_epi16(x2, x3), Y_SHIFT);
+	return avx2_unpack_lanes_epi32(_mm256_packus_epi16(y0, y1));
+}
+
+/* chroma (U or V, depending on factors) of 32 BGRX pixels in pixel order */
+WINPR_ATTR_NODISCARD
+static inline __m256i avx2_BGRX_TO_UV(const BYTE* WINPR_RESTRICT src, __m256i factors)
+{
+	const __m256i x0 = _mm256_maddubs_epi16(LOAD_SI256(&src[0]), factors);
+	const __m256i x1 = _mm256_maddubs_epi16(LOAD_SI256(&src[32]), factors);
+	const __m256i x2 = _mm256_maddubs_epi16(LOAD_SI256(&src[64]), factors);
+	const __m256i x3 = _mm256_maddubs_epi16(LOAD_SI256(&src[96]), factors);
+	const __m256i u0 = _mm256_srai_epi16(_mm256_hadd_epi16(x0, x1), U_SHIFT);
+	const __m256i u1 = _mm256_srai_epi16(_mm256_hadd_epi16(x2, x3), U_SHIFT);
+	const __m256i u = _mm256_sub_epi8(_mm256_packs_epi16(u0, u1), CONST128_FACTORS);
+	return avx2_unpack_lanes_epi32(u);
+}
+
+/* compute the luma (Y) component from a single rgb source line */
+
+static inline void avx2_RGBToYUV420_BGRX_Y(const BYTE* WINPR_RESTRICT src, BYTE* dst, UINT32 width)
+{
+	UINT32 x = 0;
+
+	for (; x < width - width % 32; x += 32)
+		STORE_SI256(&dst[x], avx2_BGRX_TO_Y(&src[4ULL * x]));
+
+	for (; x < width; x++)
+	{
+		avx2_BGRX_TO_YUV(&src[4ULL * x], &dst[x], nullptr, nullptr);
+	}
+}
+
+/* compute the chrominance (UV) components from two rgb source lines */
+
+/* shufps on integer vectors, selects 32 bit elements of a and b per lane */
+#define avx2_shuffle_epi32x2(a, b, imm) \
+	_mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), (imm)))
+
+static inline void avx2_RGBToYUV420_BGRX_UV(const BYTE* WINPR_RESTRICT src1,
+                                            const BYTE* WINPR_RESTRICT src2,
+                                            BYTE* WINPR_RESTRICT dst1, BYTE* WINPR_RESTRICT dst2,
+                                            UINT32 width)
+{
+	const __m256i u_factors = BGRX_U_FACTORS;
+	const __m256i v_factors = BGRX_V_FACTORS;
+	const __m256i vector128 = CONST128_FACTORS;
+
+	size_t x = 0;
+
+	for (; x < width - width % 32; x += 32)
+	{
+		const BYTE* rgb1 = &src1[4ULL * x];
+		const BYTE* rgb2 = &src2[4ULL * x];
+
+		/* subsample 32x2 pixels into 32x1 pixels */
+		const __m256i x0 = _mm256_avg_epu8(LOAD_SI256(&rgb1[0]), LOAD_SI256(&rgb2[0]));
+		const __m256i x1 = _mm256_avg_epu8(LOAD_SI256(&rgb1[32]), LOAD_SI256(&rgb2[32]));
+		const __m256i x2 = _mm256_avg_epu8(LOAD_SI256(&rgb1[64]), LOAD_SI256(&rgb2[64]));
+		const __m256i x3 = _mm256_avg_epu8(LOAD_SI256(&rgb1[96]), LOAD_SI256(&rgb2[96]));
+
+		/* subsample these 32x1 pixels into 16x1 pixels
+		 * lane 0 then holds the pixel pairs 0 1 4 5 8 9 12 13,
+		 * lane 1 the pairs 2 3 6 7 10 11 14 15 */
+		const __m256i e0 = avx2_shuffle_epi32x2(x0, x1, 0x88);
+		const __m256i o0 = avx2_shuffle_epi32x2(x0, x1, 0xdd);
+		const __m256i a0 = _mm256_avg_epu8(o0, e0);
+		const __m256i e1 = avx2_shuffle_epi32x2(x2, x3, 0x88);
+		const __m256i o1 = avx2_shuffle_epi32x2(x2, x3, 0xdd);
+		const __m256i a1 = _mm256_avg_epu8(o1, e1);
+
+		/* multiplications, subtotals and the total sums */
+		const __m256i u = _mm256_hadd_epi16(_mm256_maddubs_epi16(a0, u_factors),
+		                                    _mm256_maddubs_epi16(a1, u_factors));
+		const __m256i v = _mm256_hadd_epi16(_mm256_maddubs_epi16(a0, v_factors),
+		                                    _mm256_maddubs_epi16(a1, v_factors));
+
+		/* shift, pack the words into bytes and add 128 */
+		const __m256i uv = _mm256_sub_epi8(
+		    _mm256_packs_epi16(_mm256_srai_epi16(u, U_SHIFT), _mm256_srai_epi16(v, V_SHIFT)),
+		    vector128);
+
+		/* interleave the pixel pairs of both lanes */
+		const __m128i lo = _mm256_castsi256_si128(uv);
+		const __m128i hi = _mm256_extracti128_si256(uv, 1);
+		STORE_SI128(&dst1[x / 2], _mm_unpacklo_epi16(lo, hi));
+		STORE_SI128(&dst2[x / 2], _mm_unpackhi_epi16(lo, hi));
+	}
+
+	for (; x < width - width % 2; x += 2)
+	{
+		BYTE u[4] = WINPR_C_ARRAY_INIT;
+		BYTE v[4] = WINPR_C_ARRAY_INIT;
+		avx2_BGRX_TO_YUV(&src1[4ULL * x], nullptr, &u[0], &v[0]);
+		avx2_BGRX_TO_YUV(&src1[4ULL * (1ULL + x)], nullptr, &u[1], &v[1]);
+		avx2_BGRX_TO_YUV(&src2[4ULL * x], nullptr, &u[2], &v[2]);
+		avx2_BGRX_TO_YUV(&src2[4ULL * (1ULL + x)], nullptr, &u[3], &v[3]);
+		const INT16 u4 = WINPR_ASSERTING_INT_CAST(INT16, (INT16)u[0] + u[1] + u[2] + u[3]);
+		const INT16 uu = WINPR_ASSERTING_INT_CAST(INT16, u4 / 4);
+		const BYTE u8 = CLIP(uu);
+		dst1[x / 2] = u8;
+
+		const INT16 v4 = WINPR_ASSERTING_INT_CAST(INT16, (INT16)v[0] + v[1] + v[2] + v[3]);
+		const INT16 vu = WINPR_ASSERTING_INT_CAST(INT16, v4 / 4);
+		const BYTE v8 = CLIP(vu);
+		dst2[x / 2] = v8;
+	}
+}
+
+static pstatus_t avx2_RGBToYUV420_BGRX(const BYTE* WINPR_RESTRICT pSrc, UINT32 srcStep,
+                                       BYTE* WINPR_RESTRICT pDst[], const UINT32 dstStep[],
+                                       const prim_size_t* WINPR_RESTRICT roi)
+{
+	if (roi->height < 1 || roi->width < 1)
+	{
+		return !PRIMITIVES_SUCCESS;
+	}
+
+	size_t y = 0;
+	for (; y < roi->height - roi->height % 2; y += 2)
+	{
+		const BYTE* line1 = &pSrc[y * srcStep];
+		const BYTE* line2 = &pSrc[(1ULL + y) * srcStep];
+		BYTE* ydst1 = &pDst[0][y * dstStep[0]];
+		BYTE* ydst2 = &pDst[0][(1ULL + y) * dstStep[0]];
+		BYTE* udst = &pDst[1][y / 2 * dstStep[1]];
+		BYTE* vdst = &pDst[2][y / 2 * dstStep[2]];
+
+		avx2_RGBToYUV420_BGRX_UV(line1, line2, udst, vdst, roi->width);
+		avx2_RGBToYUV420_BGRX_Y(line1, ydst1, roi->width);
+		avx2_RGBToYUV420_BGRX_Y(line2, ydst2, roi->width);
+	}
+
+	for (; y < roi->height; y++)
+	{
+		const BYTE* line = &pSrc[y * srcStep];
+		BYTE* ydst = &pDst[0][1ULL * y * dstStep[0]];
+		avx2_RGBToYUV420_BGRX_Y(line, ydst, roi->width);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static pstatus_t avx2_RGBToYUV420(const BYTE* WINPR_RESTRICT pSrc, UINT32 srcFormat,
+                                  UINT32 srcStep, BYTE* WINPR_RESTRICT pDst[],
+                                  const UINT32 dstStep[], const prim_size_t* WINPR_RESTRICT roi)
+{
+	switch (srcFormat)
+	{
+		case PIXEL_FORMAT_BGRX32:
+		case PIXEL_FORMAT_BGRA32:
+			return avx2_RGBToYUV420_BGRX(pSrc, srcStep, pDst, dstStep, roi);
+
+		default:
+			return generic->RGBToYUV420_8u_P3AC4R(pSrc, srcFormat, srcStep, pDst, dstStep, roi);
+	}
+}
+
+/****************************************************************************/
+/* avx2 RGB -> AVC444-YUV conversion                                       **/
+/****************************************************************************/
+
+/* Average 2x2 blocks of two lines of 32 chroma values */
+WINPR_ATTR_NODISCARD
+static inline __m128i avx2_avg2x2(__m256i even, __m256i odd)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lo =
+	    _mm256_add_epi16(_mm256_unpacklo_epi8(even, zero), _mm256_unpacklo_epi8(odd, zero));
+	const __m256i hi =
+	    _mm256_add_epi16(_mm256_unpackhi_epi8(even, zero), _mm256_unpackhi_epi8(odd, zero));
+	const __m256i avg16 = _mm256_srai_epi16(_mm256_hadd_epi16(lo, hi), 2);
+	return avx2_lower_epi64(_mm256_packus_epi16(avg16, avg16));
+}
+
+/* Extract the even (shift 0) or odd (shift 1) values of 32 chroma values */
+WINPR_ATTR_NODISCARD
+static inline __m128i avx2_subsample(__m256i val, BOOL odd)
+{
+	const __m256i even = _mm256_set_epi8(
+	    (char)0x80, (char)0x80, (char)0x80, (char)0x80, (char)0x80, (char)0x80, (char)0x80,
+	    (char)0x80, 14, 12, 10, 8, 6, 4, 2, 0, (char)0x80, (char)0x80, (char)0x80, (char)0x80,
+	    (char)0x80, (char)0x80, (char)0x80, (char)0x80, 14, 12, 10, 8, 6, 4, 2, 0);
+	const __m256i src = odd ? _mm256_srli_epi16(val, 8) : val;
+	return avx2_lower_epi64(_mm256_shuffle_epi8(src, even));
+}
+
+static inline void avx2_RGBToAVC444YUV_BGRX_DOUBLE_ROW(
+    const BYTE* WINPR_RESTRICT srcEven, const BYTE* WINPR_RESTRICT srcOdd,
+    BYTE* WINPR_RESTRICT b1Even, BYTE* WINPR_RESTRICT b1Odd, BYTE* WINPR_RESTRICT b2,
+    BYTE* WINPR_RESTRICT b3, BYTE* WINPR_RESTRICT b4, BYTE* WINPR_RESTRICT b5,
+    BYTE* WINPR_RESTRICT b6, BYTE* WINPR_RESTRICT b7, UINT32 width)
+{
+	const __m256i u_factors = BGRX_U_FACTORS;
+	const __m256i v_factors = BGRX_V_FACTORS;
+
+	UINT32 x = 0;
+	for (; x < width - width % 32; x += 32)
+	{
+		const BYTE* argbEven = &srcEven[4ULL * x];
+		const BYTE* argbOdd = b1Odd ? &srcOdd[4ULL * x] : nullptr;
+
+		/* store y [b1] */
+		STORE_SI256(b1Even, avx2_BGRX_TO_Y(argbEven));
+		b1Even += 32;
+
+		if (b1Odd)
+		{
+			STORE_SI256(b1Odd, avx2_BGRX_TO_Y(argbOdd));
+			b1Odd += 32;
+		}
+
+		/* We need to split U and V according to
+		 * 3.3.8.3.2 YUV420p Stream Combination for YUV444 mode
+		 *
+		 * 2x   2y    -> b2 / b3
+		 * x    2y+1  -> b4 / b5
+		 * 2x+1 2y    -> b6 / b7 */
+		{
+			const __m256i ue = avx2_BGRX_TO_UV(argbEven, u_factors);
+			if (b1Odd)
+			{
+				const __m256i uo = avx2_BGRX_TO_UV(argbOdd, u_factors);
+				STORE_SI128(b2, avx2_avg2x2(ue, uo));
+				STORE_SI256(b4, uo);
+				b4 += 32;
+			}
+			else
+				STORE_SI128(b2, avx2_subsample(ue, FALSE));
+			b2 += 16;
+
+			STORE_SI128(b6, avx2_subsample(ue, TRUE));
+			b6 += 16;
+		}
+		{
+			const __m256i ve = avx2_BGRX_TO_UV(argbEven, v_factors);
+			if (b1Odd)
+			{
+				const __m256i vo = avx2_BGRX_TO_UV(argbOdd, v_factors);
+				STORE_SI128(b3, avx2_avg2x2(ve, vo));
+				STORE_SI256(b5, vo);
+				b5 += 32;
+			}
+			else
+				STORE_SI128(b3, avx2_subsample(ve, FALSE));
+			b3 += 16;
+
+			STORE_SI128(b7, avx2_subsample(ve, TRUE));
+			b7 += 16;
+		}
+	}
+
+	general_RGBToAVC444YUV_BGRX_DOUBLE_ROW(x, srcEven, srcOdd, b1Even, b1Odd, b2, b3, b4, b5, b6,
+	                                       b7, width);
+}
+
+static pstatus_t avx2_RGBToAVC444YUV_BGRX(const BYTE* WINPR_RESTRICT pSrc, UINT32 srcStep,
+                                          BYTE* WINPR_RESTRICT pDst1[], const UINT32 dst1Step[],
+                                          BYTE* WINPR_RESTRICT pDst2[], const UINT32 dst2Step[],
+                                          const prim_size_t* WINPR_RESTRICT roi)
+{
+	if (roi->height < 1 || roi->width < 1)
+		return !PRIMITIVES_SUCCESS;
+
+	size_t y = 0;
+	for (; y < roi->height - roi->height % 2; y += 2)
+	{
+		const BYTE* srcEven = pSrc + y * srcStep;
+		const BYTE* srcOdd = pSrc + (y + 1) * srcStep;
+		const size_t i = y >> 1;
+		const size_t n = (i & (size_t)~7) + i;
+		BYTE* b1Even = pDst1[0] + y * dst1Step[0];
+		BYTE* b1Odd = (b1Even + dst1Step[0]);
+		BYTE* b2 = pDst1[1] + (y / 2) * dst1Step[1];
+		BYTE* b3 = pDst1[2] + (y / 2) * dst1Step[2];
+		BYTE* b4 = pDst2[0] + 1ULL * dst2Step[0] * n;
+		BYTE* b5 = b4 + 8ULL * dst2Step[0];
+		BYTE* b6 = pDst2[1] + (y / 2) * dst2Step[1];
+		BYTE* b7 = pDst2[2] + (y / 2) * dst2Step[2];
+		avx2_RGBToAVC444YUV_BGRX_DOUBLE_ROW(srcEven, srcOdd, b1Even, b1Odd, b2, b3, b4, b5, b6, b7,
+		                                    roi->width);
+	}
+
+	for (; y < roi->height; y++)
+	{
+		const BYTE* srcEven = pSrc + y * srcStep;
+		BYTE* b1Even = pDst1[0] + y * dst1Step[0];
+		BYTE* b2 = pDst1[1] + (y / 2) * dst1Step[1];
+		BYTE* b3 = pDst1[2] + (y / 2) * dst1Step[2];
+		BYTE* b6 = pDst2[1] + (y / 2) * dst2Step[1];
+		BYTE* b7 = pDst2[2] + (y / 2) * dst2Step[2];
+		general_RGBToAVC444YUV_BGRX_DOUBLE_ROW(0, srcEven, nullptr, b1Even, nullptr, b2, b3,
+		                                       nullptr, nullptr, b6, b7, roi->width);
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static pstatus_t avx2_RGBToAVC444YUV(const BYTE* WINPR_RESTRICT pSrc, UINT32 srcFormat,
+                                     UINT32 srcStep, BYTE* WINPR_RESTRICT pDst1[],
+                                     const UINT32 dst1Step[], BYTE* WINPR_RESTRICT pDst2[],
+                                     const UINT32 dst2Step[],
+                                     const prim_size_t* WINPR_RESTRICT roi)
+{
+	switch (srcFormat)
+	{
+		case PIXEL_FORMAT_BGRX32:
+		case PIXEL_FORMAT_BGRA32:
+			return avx2_RGBToAVC444YUV_BGRX(pSrc, srcStep, pDst1, dst1Step, pDst2, dst2Step, roi);
+
+		default:
+			return generic->RGBToAVC444YUV(pSrc, srcFormat, srcStep, pDst1, dst1Step, pDst2,
+			                               dst2Step, roi);
+	}
+}
+
+/****************************************************************************/
+/* avx2 YUV420 -> YUV444 combination                                       **/
+/****************************************************************************/
+
+/* Write 32 values to every second byte of 64 bytes, starting at dst[1] */
+static inline void avx2_store_odd(BYTE* WINPR_RESTRICT dst, __m256i val)
+{
+	const __m256i mask = _mm256_set1_epi16((short)0xFF00);
+	const __m256i lo = _mm256_unpacklo_epi8(val, val);
+	const __m256i hi = _mm256_unpackhi_epi8(val, val);
+	const __m256i d0 = _mm256_permute2x128_si256(lo, hi, 0x20);
+	const __m256i d1 = _mm256_permute2x128_si256(lo, hi, 0x31);
+	STORE_SI256(&dst[0], _mm256_blendv_epi8(LOAD_SI256(&dst[0]), d0, mask));
+	STORE_SI256(&dst[32], _mm256_blendv_epi8(LOAD_SI256(&dst[32]), d1, mask));
+}
+
+static pstatus_t avx2_LumaToYUV444(const BYTE* WINPR_RESTRICT pSrcRaw[], const UINT32 srcStep[],
+                                   BYTE* WINPR_RESTRICT pDstRaw[], const UINT32 dstStep[],
+                                   const RECTANGLE_16* WINPR_RESTRICT roi)
+{
+	const UINT32 nWidth = roi->right - roi->left;
+	const UINT32 nHeight = roi->bottom - roi->top;
+	const UINT32 halfWidth = (nWidth + 1) / 2;
+	const UINT32 halfPad = halfWidth % 32;
+	const UINT32 halfHeight = (nHeight + 1) / 2;
+	const BYTE* pSrc[3] = { pSrcRaw[0] + 1ULL * roi->top * srcStep[0] + roi->left,
+		                    pSrcRaw[1] + 1ULL * roi->top / 2 * srcStep[1] + roi->left / 2,
+		                    pSrcRaw[2] + 1ULL * roi->top / 2 * srcStep[2] + roi->left / 2 };
+	BYTE* pDst[3] = { pDstRaw[0] + 1ULL * roi->top * dstStep[0] + roi->left,
+		              pDstRaw[1] + 1ULL * roi->top * dstStep[1] + roi->left,
+		              pDstRaw[2] + 1ULL * roi->top * dstStep[2] + roi->left };
+
+	/* Y data is already here... */
+	/* B1 */
+	for (size_t y = 0; y < nHeight; y++)
+	{
+		const BYTE* Ym = pSrc[0] + y * srcStep[0];
+		BYTE* pY = pDst[0] + y * dstStep[0];
+		memcpy(pY, Ym, nWidth);
+	}
+
+	/* The first half of U, V are already here part of this frame. */
+	/* B2 and B3 */
+	for (size_t y = 0; y < halfHeight; y++)
+	{
+		const size_t val2y = 2 * y;
+		const BYTE* Sm[2] = { pSrc[1] + 1ULL * srcStep[1] * y, pSrc[2] + 1ULL * srcStep[2] * y };
+		BYTE* pX[2] = { pDst[1] + 1ULL * dstStep[1] * val2y, pDst[2] + 1ULL * dstStep[2] * val2y };
+		BYTE* pX1[2] = { pDst[1] + 1ULL * dstStep[1] * (val2y + 1),
+			             pDst[2] + 1ULL * dstStep[2] * (val2y + 1) };
+
+		for (size_t i = 0; i < 2; i++)
+		{
+			size_t x = 0;
+			for (; x < halfWidth - halfPad; x += 32)
+			{
+				const __m256i u = LOAD_SI256(&Sm[i][x]);
+				const __m256i lo = _mm256_unpacklo_epi8(u, u);
+				const __m256i hi = _mm256_unpackhi_epi8(u, u);
+				const __m256i d0 = _mm256_permute2x128_si256(lo, hi, 0x20);
+				const __m256i d1 = _mm256_permute2x128_si256(lo, hi, 0x31);
+				STORE_SI256(&pX[i][2ULL * x], d0);
+				STORE_SI256(&pX[i][2ULL * x + 32], d1);
+				STORE_SI256(&pX1[i][2ULL * x], d0);
+				STORE_SI256(&pX1[i][2ULL * x + 32], d1);
+			}
+
+			for (; x < halfWidth; x++)
+			{
+				const size_t val2x = 2 * x;
+				pX[i][val2x] = Sm[i][x];
+				pX[i][val2x + 1] = Sm[i][x];
+				pX1[i][val2x] = Sm[i][x];
+				pX1[i][val2x + 1] = Sm[i][x];
+			}
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static pstatus_t avx2_ChromaV1ToYUV444(const BYTE* WINPR_RESTRICT pSrcRaw[3],
+                                       const UINT32 srcStep[3], BYTE* WINPR_RESTRICT pDstRaw[3],
+                                       const UINT32 dstStep[3],
+                                       const RECTANGLE_16* WINPR_RESTRICT roi)
+{
+	const UINT32 mod = 16;
+	UINT32 uY = 0;
+	UINT32 vY = 0;
+	const UINT32 nWidth = roi->right - roi->left;
+	const UINT32 nHeight = roi->bottom - roi->top;
+	const UINT32 halfWidth = nWidth / 2;
+	const UINT32 halfEnd = halfWidth - halfWidth % 32;
+	const UINT32 halfHeight = nHeight / 2;
+	const UINT32 oddY = 1;
+	const UINT32 oddX = 1;
+	/* The auxiliary frame is aligned to multiples of 16x16.
+	 * We need the padded height for B4 and B5 conversion. */
+	const UINT32 padHeight = nHeight + 16 - nHeight % 16;
+	const BYTE* pSrc[3] = { pSrcRaw[0] + 1ULL * roi->top * srcStep[0] + roi->left,
+		                    pSrcRaw[1] + 1ULL * roi->top / 2 * srcStep[1] + roi->left / 2,
+		                    pSrcRaw[2] + 1ULL * roi->top / 2 * srcStep[2] + roi->left / 2 };
+	BYTE* pDst[3] = { pDstRaw[0] + 1ULL * roi->top * dstStep[0] + roi->left,
+		              pDstRaw[1] + 1ULL * roi->top * dstStep[1] + roi->left,
+		              pDstRaw[2] + 1ULL * roi->top * dstStep[2] + roi->left };
+
+	/* The second half of U and V is a bit more tricky... */
+	/* B4 and B5 */
+	for (size_t y = 0; y < padHeight; y++)
+	{
+		const BYTE* Ya = pSrc[0] + 1ULL * srcStep[0] * y;
+		BYTE* pX = nullptr;
+
+		if ((y) % mod < (mod + 1) / 2)
+		{
+			const UINT32 pos = (2 * uY++ + oddY);
+
+			if (pos >= nHeight)
+				continue;
+
+			pX = pDst[1] + 1ULL * dstStep[1] * pos;
+		}
+		else
+		{
+			const UINT32 pos = (2 * vY++ + oddY);
+
+			if (pos >= nHeight)
+				continue;
+
+			pX = pDst[2] + 1ULL * dstStep[2] * pos;
+		}
+
+		if (y < nHeight)
+			memcpy(pX, Ya, nWidth);
+	}
+
+	/* B6 and B7 */
+	for (size_t y = 0; y < halfHeight; y++)
+	{
+		const size_t val2y = y * 2;
+		const BYTE* Ua = pSrc[1] + srcStep[1] * y;
+		const BYTE* Va = pSrc[2] + srcStep[2] * y;
+		BYTE* pU = pDst[1] + dstStep[1] * val2y;
+		BYTE* pV = pDst[2] + dstStep[2] * val2y;
+
+		size_t x = 0;
+		for (; x < halfEnd; x += 32)
+		{
+			avx2_store_odd(&pU[2 * x], LOAD_SI256(&Ua[x]));
+			avx2_store_odd(&pV[2 * x], LOAD_SI256(&Va[x]));
+		}
+
+		for (; x < halfWidth; x++)
+		{
+			const size_t val2x1 = (x * 2ULL + oddX);
+			pU[val2x1] = Ua[x];
+			pV[val2x1] = Va[x];
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static pstatus_t avx2_ChromaV2ToYUV444(const BYTE* WINPR_RESTRICT pSrc[3], const UINT32 srcStep[3],
+                                       UINT32 nTotalWidth, WINPR_ATTR_UNUSED UINT32 nTotalHeight,
+                                       BYTE* WINPR_RESTRICT pDst[3], const UINT32 dstStep[3],
+                                       const RECTANGLE_16* WINPR_RESTRICT roi)
+{
+	const UINT32 nWidth = roi->right - roi->left;
+	const UINT32 nHeight = roi->bottom - roi->top;
+	const UINT32 halfWidth = (nWidth + 1) / 2;
+	const UINT32 halfHeight = (nHeight + 1) / 2;
+	const UINT32 quaterWidth = (nWidth + 3) / 4;
+	/* The masked stores must not touch bytes outside of the rectangle */
+	const UINT32 halfEnd = nWidth / 2 - (nWidth / 2) % 32;
+	const UINT32 quaterEnd = nWidth / 4 - (nWidth / 4) % 32;
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i mask = _mm256_set1_epi16(0x00FF);
+
+	/* B4 and B5: odd UV values for width/2, height */
+	for (size_t y = 0; y < nHeight; y++)
+	{
+		const size_t yTop = y + roi->top;
+		const BYTE* pYaU = pSrc[0] + srcStep[0] * yTop + roi->left / 2;
+		const BYTE* pYaV = pYaU + nTotalWidth / 2;
+		BYTE* pU = pDst[1] + 1ULL * dstStep[1] * yTop + roi->left;
+		BYTE* pV = pDst[2] + 1ULL * dstStep[2] * yTop + roi->left;
+
+		size_t x = 0;
+		for (; x < halfEnd; x += 32)
+		{
+			avx2_store_odd(&pU[2 * x], LOAD_SI256(&pYaU[x]));
+			avx2_store_odd(&pV[2 * x], LOAD_SI256(&pYaV[x]));
+		}
+
+		for (; x < halfWidth; x++)
+		{
+			const size_t odd = 2ULL * x + 1;
+			pU[odd] = pYaU[x];
+			pV[odd] = pYaV[x];
+		}
+	}
+
+	/* B6 - B9 */
+	for (size_t y = 0; y < halfHeight; y++)
+	{
+		const BYTE* pUaU = pSrc[1] + srcStep[1] * (y + roi->top / 2) + roi->left / 4;
+		const BYTE* pUaV = pUaU + nTotalWidth / 4;
+		const BYTE* pVaU = pSrc[2] + srcStep[2] * (y + roi->top / 2) + roi->left / 4;
+		const BYTE* pVaV = pVaU + nTotalWidth / 4;
+		BYTE* pU = pDst[1] + dstStep[1] * (2 * y + 1 + roi->top) + roi->left;
+		BYTE* pV = pDst[2] + dstStep[2] * (2 * y + 1 + roi->top) + roi->left;
+		const BYTE* pA[2][2] = { { pUaU, pVaU }, { pUaV, pVaV } };
+		BYTE* pX[2] = { pU, pV };
+
+		for (size_t i = 0; i < 2; i++)
+		{
+			UINT32 x = 0;
+			for (; x < quaterEnd; x += 32)
+			{
+				/* every pixel group of 4 gets [U, keep, V, keep] */
+				const __m256i u = LOAD_SI256(&pA[i][0][x]);
+				const __m256i v = LOAD_SI256(&pA[i][1][x]);
+				const __m256i lo = _mm256_unpacklo_epi8(u, v);
+				const __m256i hi = _mm256_unpackhi_epi8(u, v);
+				const __m256i p0 = _mm256_unpacklo_epi8(lo, zero);
+				const __m256i p1 = _mm256_unpackhi_epi8(lo, zero);
+				const __m256i p2 = _mm256_unpacklo_epi8(hi, zero);
+				const __m256i p3 = _mm256_unpackhi_epi8(hi, zero);
+				const __m256i d[] = { _mm256_permute2x128_si256(p0, p1, 0x20),
+					                  _mm256_permute2x128_si256(p2, p3, 0x20),
+					                  _mm256_permute2x128_si256(p0, p1, 0x31),
+					                  _mm256_permute2x128_si256(p2, p3, 0x31) };
+				BYTE* dst = &pX[i][4ULL * x];
+
+				for (size_t j = 0; j < ARRAYSIZE(d); j++)
+				{
+					BYTE* cur = &dst[32 * j];
+					STORE_SI256(cur, _mm256_blendv_epi8(LOAD_SI256(cur), d[j], mask));
+				}
+			}
+
+			for (; x < quaterWidth; x++)
+			{
+				pX[i][4 * x + 0] = pA[i][0][x];
+				pX[i][4 * x + 2] = pA[i][1][x];
+			}
+		}
+	}
+
+	return PRIMITIVES_SUCCESS;
+}
+
+static pstatus_t avx2_YUV420CombineToYUV444(avc444_frame_type type,
+                                            const BYTE* WINPR_RESTRICT pSrc[3],
+                                            const UINT32 srcStep[3], UINT32 nWidth, UINT32 nHeight,
+                                            BYTE* WINPR_RESTRICT pDst[3], const UINT32 dstStep[3],
+                                            const RECTANGLE_16* WINPR_RESTRICT roi)
+{
+	if (!pSrc || !pSrc[0] || !pSrc[1] || !pSrc[2])
+		return -1;
+
+	if (!pDst || !pDst[0] || !pDst[1] || !pDst[2])
+		return -1;
+
+	if (!roi)
+		return -1;
+
+	switch (type)
+	{
+		case AVC444_LUMA:
+			return avx2_LumaToYUV444(pSrc, srcStep, pDst, dstStep, roi);
+
+		case AVC444_CHROMAv1:
+			return avx2_ChromaV1ToYUV444(pSrc, srcStep, pDst, dstStep, roi);
+
+		case AVC444_CHROMAv2:
+			return avx2_ChromaV2ToYUV444(pSrc, srcStep, nWidth, nHeight, pDst, dstStep, roi);
+
+		default:
+			return -1;
+	}
+}
+#endif
+
+void primitives_init_YUV_avx2_int(primitives_t* WINPR_RESTRICT prims)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	generic = primitives_get_generic();
+
+	WLog_VRB(PRIM_TAG, "AVX2 optimizations");
+	prims->RGBToYUV420_8u_P3AC4R = avx2_RGBToYUV420;
+	prims->RGBToAVC444YUV = avx2_RGBToAVC444YUV;
+	prims->YUV420ToRGB_8u_P3AC4R = avx2_YUV420ToRGB;
+	prims->YUV444ToRGB_8u_P3AC4R = avx2_YUV444ToRGB_8u_P3AC4R;
+	prims->YUV420CombineToYUV444 = avx2_YUV420CombineToYUV444;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or WITH_AVX2 or AVX2 intrinsics not available");
+	WINPR_UNUSED(prims);
+#endif
+}
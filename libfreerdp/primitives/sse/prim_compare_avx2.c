@@ -0,0 +1,79 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Optimized tile compare
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <winpr/sysinfo.h>
+
+#include "prim_internal.h"
+#include "prim_compare.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <immintrin.h>
+
+static inline __m256i avx2_xor_row(const BYTE* WINPR_RESTRICT p1, const BYTE* WINPR_RESTRICT p2)
+{
+	const __m256i* a = (const __m256i*)p1;
+	const __m256i* b = (const __m256i*)p2;
+	const __m256i d0 = _mm256_xor_si256(_mm256_loadu_si256(&a[0]), _mm256_loadu_si256(&b[0]));
+	const __m256i d1 = _mm256_xor_si256(_mm256_loadu_si256(&a[1]), _mm256_loadu_si256(&b[1]));
+	return _mm256_or_si256(d0, d1);
+}
+
+static BYTE avx2_tile_differs(const BYTE* WINPR_RESTRICT pSrc1, size_t src1Step,
+                              const BYTE* WINPR_RESTRICT pSrc2, size_t src2Step)
+{
+	/* Check every 4 lines so a changed tile is not read completely */
+	for (size_t y = 0; y < PRIM_COMPARE_TILE_SIZE; y += 4)
+	{
+		__m256i acc = _mm256_setzero_si256();
+		for (size_t k = y; k < y + 4; k++)
+			acc = _mm256_or_si256(acc, avx2_xor_row(&pSrc1[k * src1Step], &pSrc2[k * src2Step]));
+
+		if (!_mm256_testz_si256(acc, acc))
+			return 1;
+	}
+
+	return 0;
+}
+
+static pstatus_t avx2_compare_tiles_32u(const BYTE* WINPR_RESTRICT pSrc1, UINT32 src1Step,
+                                        const BYTE* WINPR_RESTRICT pSrc2, UINT32 src2Step,
+                                        UINT32 width, UINT32 height, BYTE* WINPR_RESTRICT pTiles,
+                                        UINT32 tilesStep)
+{
+	if (!pSrc1 || !pSrc2 || !pTiles)
+		return -1;
+
+	return prim_compare_tiles_32u(avx2_tile_differs, pSrc1, src1Step, pSrc2, src2Step, width,
+	                              height, pTiles, tilesStep);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_compare_avx2_int(primitives_t* WINPR_RESTRICT prims)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "AVX2 optimizations");
+	prims->compare_tiles_32u = avx2_compare_tiles_32u;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or AVX2 intrinsics not available");
+	WINPR_UNUSED(prims);
+#endif
+}
@@ -0,0 +1,83 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Optimized tile compare
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <freerdp/types.h>
+#include <freerdp/primitives.h>
+#include <winpr/sysinfo.h>
+
+#include "prim_internal.h"
+#include "prim_compare.h"
+
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+#include <emmintrin.h>
+
+static inline __m128i sse2_xor_row(const BYTE* WINPR_RESTRICT p1, const BYTE* WINPR_RESTRICT p2)
+{
+	const __m128i* a = (const __m128i*)p1;
+	const __m128i* b = (const __m128i*)p2;
+	const __m128i d0 = _mm_xor_si128(_mm_loadu_si128(&a[0]), _mm_loadu_si128(&b[0]));
+	const __m128i d1 = _mm_xor_si128(_mm_loadu_si128(&a[1]), _mm_loadu_si128(&b[1]));
+	const __m128i d2 = _mm_xor_si128(_mm_loadu_si128(&a[2]), _mm_loadu_si128(&b[2]));
+	const __m128i d3 = _mm_xor_si128(_mm_loadu_si128(&a[3]), _mm_loadu_si128(&b[3]));
+	return _mm_or_si128(_mm_or_si128(d0, d1), _mm_or_si128(d2, d3));
+}
+
+static BYTE sse2_tile_differs(const BYTE* WINPR_RESTRICT pSrc1, size_t src1Step,
+                              const BYTE* WINPR_RESTRICT pSrc2, size_t src2Step)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	/* Check every 4 lines so a changed tile is not read completely */
+	for (size_t y = 0; y < PRIM_COMPARE_TILE_SIZE; y += 4)
+	{
+		__m128i acc = _mm_setzero_si128();
+		for (size_t k = y; k < y + 4; k++)
+			acc = _mm_or_si128(acc, sse2_xor_row(&pSrc1[k * src1Step], &pSrc2[k * src2Step]));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, zero)) != 0xFFFF)
+			return 1;
+	}
+
+	return 0;
+}
+
+static pstatus_t sse2_compare_tiles_32u(const BYTE* WINPR_RESTRICT pSrc1, UINT32 src1Step,
+                                        const BYTE* WINPR_RESTRICT pSrc2, UINT32 src2Step,
+                                        UINT32 width, UINT32 height, BYTE* WINPR_RESTRICT pTiles,
+                                        UINT32 tilesStep)
+{
+	if (!pSrc1 || !pSrc2 || !pTiles)
+		return -1;
+
+	return prim_compare_tiles_32u(sse2_tile_differs, pSrc1, src1Step, pSrc2, src2Step, width,
+	                              height, pTiles, tilesStep);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+void primitives_init_compare_sse2_int(primitives_t* WINPR_RESTRICT prims)
+{
+#if defined(SSE_AVX_INTRINSICS_ENABLED)
+	WLog_VRB(PRIM_TAG, "SSE2 optimizations");
+	prims->compare_tiles_32u = sse2_compare_tiles_32u;
+#else
+	WLog_VRB(PRIM_TAG, "undefined WITH_SIMD or SSE2 intrinsics not available");
+	WINPR_UNUSED(prims);
+#endif
+}
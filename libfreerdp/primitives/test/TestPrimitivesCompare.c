@@ -0,0 +1,146 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Primitives tile compare tests
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/crypto.h>
+#include <winpr/sysinfo.h>
+
+#include "prim_test.h"
+
+#define TILE_SIZE 16
+
+/* ------------------------------------------------------------------------- */
+static BOOL check_tiles(const char* name, fn_compare_tiles_32u_t fkt, const BYTE* src1,
+                        UINT32 src1Step, const BYTE* src2, UINT32 src2Step, UINT32 width,
+                        UINT32 height, const BYTE* expected, UINT32 ncol, UINT32 nrow)
+{
+	BOOL rc = FALSE;
+	BYTE* tiles = malloc(1ull * ncol * nrow);
+	if (!tiles)
+		return FALSE;
+
+	memset(tiles, 0xAA, 1ull * ncol * nrow);
+	if (fkt(src1, src1Step, src2, src2Step, width, height, tiles, ncol) != PRIMITIVES_SUCCESS)
+	{
+		printf("%s [%" PRIu32 "x%" PRIu32 "] failed\n", name, width, height);
+		goto fail;
+	}
+
+	for (size_t x = 0; x < 1ull * ncol * nrow; x++)
+	{
+		if (tiles[x] != expected[x])
+		{
+			printf("%s [%" PRIu32 "x%" PRIu32 "] tile %" PRIuz "x%" PRIuz ": got %" PRIu8
+			       ", expected %" PRIu8 "\n",
+			       name, width, height, x % ncol, x / ncol, tiles[x], expected[x]);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	free(tiles);
+	return rc;
+}
+
+static BOOL test_compare_tiles_size(UINT32 width, UINT32 height, size_t changes)
+{
+	BOOL rc = FALSE;
+	const UINT32 ncol = (width + TILE_SIZE - 1) / TILE_SIZE;
+	const UINT32 nrow = (height + TILE_SIZE - 1) / TILE_SIZE;
+	/* Different padding for both frames to catch stride mixups */
+	const UINT32 src1Step = width * 4 + 16;
+	const UINT32 src2Step = width * 4 + 36;
+	BYTE* src1 = calloc(height, src1Step);
+	BYTE* src2 = calloc(height, src2Step);
+	BYTE* expected = calloc(nrow, ncol);
+
+	if (!src1 || !src2 || !expected)
+		goto fail;
+
+	if ((winpr_RAND(src1, 1ull * height * src1Step) < 0) ||
+	    (winpr_RAND(src2, 1ull * height * src2Step) < 0))
+		goto fail;
+
+	for (size_t y = 0; y < height; y++)
+		memcpy(&src2[y * src2Step], &src1[y * src1Step], 4ull * width);
+
+	for (size_t x = 0; x < changes; x++)
+	{
+		UINT32 pos[3] = WINPR_C_ARRAY_INIT;
+		if (winpr_RAND(pos, sizeof(pos)) < 0)
+			goto fail;
+
+		const size_t px = pos[0] % width;
+		const size_t py = pos[1] % height;
+		/* Flip a single bit of one channel */
+		BYTE* pixel = &src2[py * src2Step + px * 4 + (pos[2] % 4)];
+		*pixel ^= (BYTE)(1u << ((pos[2] >> 2) % 8));
+		expected[(py / TILE_SIZE) * ncol + px / TILE_SIZE] = 1;
+	}
+
+	if (!check_tiles("generic->compare_tiles_32u", generic->compare_tiles_32u, src1, src1Step,
+	                 src2, src2Step, width, height, expected, ncol, nrow))
+		goto fail;
+
+	if (!check_tiles("optimized->compare_tiles_32u", optimized->compare_tiles_32u, src1,
+	                 src1Step, src2, src2Step, width, height, expected, ncol, nrow))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	free(src1);
+	free(src2);
+	free(expected);
+	return rc;
+}
+
+static BOOL test_compare_tiles_func(void)
+{
+	const struct
+	{
+		UINT32 width;
+		UINT32 height;
+	} sizes[] = { { 1, 1 },     { 15, 17 },   { 16, 16 },   { 64, 64 },
+		          { 67, 45 },   { 100, 333 }, { 257, 130 }, { 1920, 1080 } };
+	const size_t changes[] = { 0, 1, 5, 100 };
+
+	for (size_t x = 0; x < ARRAYSIZE(sizes); x++)
+	{
+		for (size_t y = 0; y < ARRAYSIZE(changes); y++)
+		{
+			if (!test_compare_tiles_size(sizes[x].width, sizes[x].height, changes[y]))
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+int TestPrimitivesCompare(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	prim_test_setup(FALSE);
+
+	if (!test_compare_tiles_func())
+		return -1;
+
+	return 0;
+}
@@ -68,6 +68,8 @@ static void pf_server_register_signal_handlers(void)
 #ifndef _WIN32
 	(void)signal(SIGQUIT, cleanup_handler);
 	(void)signal(SIGKILL, cleanup_handler);
+	/* OpenSSL writes to kernel TLS sockets without MSG_NOSIGNAL */
+	(void)signal(SIGPIPE, SIG_IGN);
 #endif
 }
 
@@ -661,6 +661,8 @@ static BOOL pf_client_set_security_settings(pClientContext* pc)
 		return FALSE;
 	if (!freerdp_settings_set_bool(settings, FreeRDP_NlaSecurity, config->ClientNlaSecurity))
 		return FALSE;
+	if (!freerdp_settings_set_bool(settings, FreeRDP_TlsKernelOffload, config->TlsKernelOffload))
+		return FALSE;
 
 	if (pf_client_use_proxy_smartcard_auth(settings))
 	{
@@ -757,27 +759,17 @@ out:
 	return rc;
 }
 
-/**
- * RDP main loop.
- * Connects RDP, loops while running and handles event and dispatch, cleans up
- * after the connection ends.
- */
-WINPR_ATTR_NODISCARD
-static DWORD WINAPI pf_client_thread_proc(pClientContext* pc)
+DWORD pf_client_get_event_handles(pClientContext* pc, HANDLE* handles, DWORD count)
 {
-	freerdp* instance = nullptr;
-	proxyData* pdata = nullptr;
 	DWORD nCount = 0;
-	DWORD status = 0;
-	HANDLE handles[MAXIMUM_WAIT_OBJECTS] = WINPR_C_ARRAY_INIT;
 
 	WINPR_ASSERT(pc);
+	WINPR_ASSERT(pc->pdata);
+	WINPR_ASSERT(handles);
 
-	instance = pc->cctx.context.instance;
-	WINPR_ASSERT(instance);
+	if (count < 2)
+		return 0;
 
-	pdata = pc->pdata;
-	WINPR_ASSERT(pdata);
 	/*
 	 * during redirection, freerdp's abort event might be overridden (reset) by the library, after
 	 * the server set it in order to shutdown the connection. it means that the server might signal
@@ -785,66 +777,119 @@ static DWORD WINAPI pf_client_thread_proc(pClientContext* pc)
 	 * continue its work instead of exiting. That's why the client must wait on `pdata->abort_event`
 	 * too, which will never be modified by the library.
 	 */
-	handles[nCount++] = pdata->abort_event;
+	handles[nCount++] = pc->pdata->abort_event;
+	handles[nCount++] = Queue_Event(pc->cached_server_channel_data);
 
-	if (!pf_modules_run_hook(pdata->module, HOOK_TYPE_CLIENT_INIT_CONNECT, pdata, pc))
+	const DWORD tmp =
+	    freerdp_get_event_handles(&pc->cctx.context, &handles[nCount], count - nCount);
+	if (tmp == 0)
 	{
-		proxy_data_abort_connect(pdata);
-		goto end;
+		PROXY_LOG_ERR(TAG, pc, "freerdp_get_event_handles failed!");
+		return 0;
 	}
 
-	if (!pf_client_connect(instance))
+	return nCount + tmp;
+}
+
+BOOL pf_client_check_event_handles(pClientContext* pc)
+{
+	WINPR_ASSERT(pc);
+
+	rdpContext* context = &pc->cctx.context;
+	proxyData* pdata = pc->pdata;
+	WINPR_ASSERT(pdata);
+
+	if (WaitForSingleObject(pdata->abort_event, 0) == WAIT_OBJECT_0)
+		return FALSE;
+
+	if (freerdp_shall_disconnect_context(context))
+		return FALSE;
+
+	if (proxy_data_shall_disconnect(pdata))
+		return FALSE;
+
+	if (!freerdp_check_event_handles(context))
 	{
-		proxy_data_abort_connect(pdata);
-		goto end;
+		if (freerdp_get_last_error(context) == FREERDP_ERROR_SUCCESS)
+			WLog_ERR(TAG, "Failed to check FreeRDP event handles");
+
+		return FALSE;
 	}
-	handles[nCount++] = Queue_Event(pc->cached_server_channel_data);
 
-	while (!freerdp_shall_disconnect_context(instance->context))
+	if (!sendQueuedChannelData(pc))
+		return FALSE;
+
+	return !freerdp_shall_disconnect_context(context);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL pf_client_connect_session(pClientContext* pc)
+{
+	WINPR_ASSERT(pc);
+
+	proxyData* pdata = pc->pdata;
+	WINPR_ASSERT(pdata);
+
+	if (!pf_modules_run_hook(pdata->module, HOOK_TYPE_CLIENT_INIT_CONNECT, pdata, pc) ||
+	    !pf_client_connect(pc->cctx.context.instance))
 	{
-		UINT32 tmp = freerdp_get_event_handles(instance->context, &handles[nCount],
-		                                       ARRAYSIZE(handles) - nCount);
+		proxy_data_abort_connect(pdata);
+		return FALSE;
+	}
 
-		if (tmp == 0)
-		{
-			PROXY_LOG_ERR(TAG, pc, "freerdp_get_event_handles failed!");
-			break;
-		}
+	return TRUE;
+}
 
-		status = WaitForMultipleObjects(nCount + tmp, handles, FALSE, INFINITE);
+static void pf_client_end_session(pClientContext* pc, BOOL connected)
+{
+	WINPR_ASSERT(pc);
 
-		if (status == WAIT_FAILED)
-		{
-			WLog_ERR(TAG, "WaitForMultipleObjects failed with %" PRIu32 "", status);
-			break;
-		}
+	proxyData* pdata = pc->pdata;
+	WINPR_ASSERT(pdata);
 
-		/* abort_event triggered */
-		if (status == WAIT_OBJECT_0)
-			break;
+	if (connected)
+		freerdp_disconnect(pc->cctx.context.instance);
 
-		if (freerdp_shall_disconnect_context(instance->context))
-			break;
+	(void)pf_modules_run_hook(pdata->module, HOOK_TYPE_CLIENT_UNINIT_CONNECT, pdata, pc);
+}
+
+/**
+ * RDP main loop.
+ * Connects RDP, loops while running and handles event and dispatch, cleans up
+ * after the connection ends.
+ */
+WINPR_ATTR_NODISCARD
+static DWORD WINAPI pf_client_thread_proc(pClientContext* pc)
+{
+	HANDLE handles[MAXIMUM_WAIT_OBJECTS] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(pc);
+
+	if (!pf_client_connect_session(pc))
+	{
+		pf_client_end_session(pc, FALSE);
+		return 0;
+	}
 
-		if (proxy_data_shall_disconnect(pdata))
+	while (!freerdp_shall_disconnect_context(&pc->cctx.context))
+	{
+		const DWORD nCount = pf_client_get_event_handles(pc, handles, ARRAYSIZE(handles));
+		if (nCount == 0)
 			break;
 
-		if (!freerdp_check_event_handles(instance->context))
-		{
-			if (freerdp_get_last_error(instance->context) == FREERDP_ERROR_SUCCESS)
-				WLog_ERR(TAG, "Failed to check FreeRDP event handles");
+		const DWORD status = WaitForMultipleObjects(nCount, handles, FALSE, INFINITE);
 
+		if (status == WAIT_FAILED)
+		{
+			WLog_ERR(TAG, "WaitForMultipleObjects failed with %" PRIu32 "", status);
 			break;
 		}
-		if (!sendQueuedChannelData(pc))
+
+		if (!pf_client_check_event_handles(pc))
 			break;
 	}
 
-	freerdp_disconnect(instance);
-
-end:
-	(void)pf_modules_run_hook(pdata->module, HOOK_TYPE_CLIENT_UNINIT_CONNECT, pdata, pc);
-
+	pf_client_end_session(pc, TRUE);
 	return 0;
 }
 
@@ -1119,3 +1164,24 @@ DWORD WINAPI pf_client_start(LPVOID arg)
 	freerdp_client_stop(&pc->cctx.context);
 	return rc;
 }
+
+DWORD WINAPI pf_client_connect_start(LPVOID arg)
+{
+	pClientContext* pc = (pClientContext*)arg;
+
+	WINPR_ASSERT(pc);
+	if ((freerdp_client_start(&pc->cctx.context) == 0) && pf_client_connect_session(pc))
+		return 0;
+
+	pf_client_end_session(pc, FALSE);
+	freerdp_client_stop(&pc->cctx.context);
+	return 1;
+}
+
+void pf_client_stop(pClientContext* pc)
+{
+	WINPR_ASSERT(pc);
+
+	pf_client_end_session(pc, TRUE);
+	freerdp_client_stop(&pc->cctx.context);
+}
@@ -77,4 +77,21 @@ struct p_client_context
 int RdpClientEntry(RDP_CLIENT_ENTRY_POINTS* pEntryPoints);
 WINPR_ATTR_NODISCARD DWORD WINAPI pf_client_start(LPVOID arg);
 
+/**
+ * Connects the proxy's client to the target server and returns once the connection is
+ * established. The exit code is \b 0 if the client is connected and must be driven with
+ * \link pf_client_check_event_handles and stopped with \link pf_client_stop
+ */
+WINPR_ATTR_NODISCARD DWORD WINAPI pf_client_connect_start(LPVOID arg);
+
+/** Disconnects a client connected by \link pf_client_connect_start */
+void pf_client_stop(pClientContext* pc);
+
+/** Returns the number of handles to wait for or \b 0 in case of failure */
+WINPR_ATTR_NODISCARD DWORD pf_client_get_event_handles(pClientContext* pc, HANDLE* handles,
+                                                       DWORD count);
+
+/** Processes pending events, returns \b FALSE if the connection should be closed */
+WINPR_ATTR_NODISCARD BOOL pf_client_check_event_handles(pClientContext* pc);
+
 #endif /* FREERDP_SERVER_PROXY_PFCLIENT_H */
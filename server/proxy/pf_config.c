@@ -70,6 +70,9 @@ static const char* section_server = "Server";
 static const char* key_host = "Host";
 static const char* key_port = "Port";
 static const char* key_sam_file = "SamFile";
+static const char* key_io_workers = "IoWorkers";
+static const char* key_handshake_timeout = "HandshakeTimeout";
+static const char* key_tls_kernel_offload = "TlsKernelOffload";
 
 static const char* section_target = "Target";
 static const char* key_target_fixed = "FixedTarget";
@@ -296,6 +299,16 @@ static BOOL pf_config_load_server(wIniFile* ini, proxyConfig* config)
 			return FALSE;
 	}
 
+	if (!pf_config_get_uint32(ini, section_server, key_io_workers, &config->IoWorkers, FALSE))
+		return FALSE;
+
+	if (!pf_config_get_uint32(ini, section_server, key_handshake_timeout,
+	                          &config->HandshakeTimeout, FALSE))
+		return FALSE;
+
+	config->TlsKernelOffload =
+	    pf_config_get_bool(ini, section_server, key_tls_kernel_offload, FALSE);
+
 	return TRUE;
 }
 
@@ -743,6 +756,13 @@ BOOL pf_server_config_dump(const char* file)
 	if (IniFile_SetKeyValueString(ini, section_server, key_sam_file,
 	                              "optional/path/some/file.sam") < 0)
 		goto fail;
+	if (IniFile_SetKeyValueInt(ini, section_server, key_io_workers, 0) < 0)
+		goto fail;
+	if (IniFile_SetKeyValueInt(ini, section_server, key_handshake_timeout, 30) < 0)
+		goto fail;
+	if (IniFile_SetKeyValueString(ini, section_server, key_tls_kernel_offload, bool_str_false) <
+	    0)
+		goto fail;
 
 	/* Target configuration */
 	if (IniFile_SetKeyValueString(ini, section_target, key_host, "somehost.example.com") < 0)
@@ -953,6 +973,9 @@ void pf_server_config_print(const proxyConfig* config)
 	CONFIG_PRINT_STR(config, Host);
 	CONFIG_PRINT_STR(config, SamFile);
 	CONFIG_PRINT_UINT16(config, Port);
+	CONFIG_PRINT_UINT32(config, IoWorkers);
+	CONFIG_PRINT_UINT32(config, HandshakeTimeout);
+	CONFIG_PRINT_BOOL(config, TlsKernelOffload);
 
 	if (config->FixedTarget)
 	{
@@ -0,0 +1,715 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * FreeRDP Proxy Server
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/collections.h>
+#include <winpr/interlocked.h>
+#include <winpr/synch.h>
+#include <winpr/sysinfo.h>
+#include <winpr/thread.h>
+
+#include <freerdp/server/proxy/proxy_context.h>
+#include <freerdp/server/proxy/proxy_log.h>
+
+#include "pf_event_loop.h"
+#include "pf_client.h"
+
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define TAG PROXY_TAG("event-loop")
+
+#if defined(__linux__)
+
+#define SESSION_MAX_FDS MAXIMUM_WAIT_OBJECTS
+#define WORKER_MAX_EVENTS 128
+#define HANDSHAKE_MIN_THREADS 4
+#define HANDSHAKE_DEFAULT_TIMEOUT 30 /* seconds */
+
+typedef enum
+{
+	PROXY_BACK_NONE,
+	PROXY_BACK_CONNECTING, /* pdata->client_thread connects to the target */
+	PROXY_BACK_CONNECTED,  /* the back connection is driven by the worker */
+	PROXY_BACK_CLOSED
+} proxy_back_state;
+
+typedef struct proxy_io_worker proxyIoWorker;
+
+typedef struct
+{
+	proxyIoWorker* worker;
+	freerdp_peer* client;
+	proxyData* pdata;
+	proxy_back_state back;
+	size_t round; /* last dispatch round, a session is checked once per round */
+	int fds[SESSION_MAX_FDS];
+	size_t fdCount;
+} proxySession;
+
+struct proxy_io_worker
+{
+	proxyEventLoop* loop;
+	HANDLE thread;
+	int epfd;
+	wQueue* incoming;     /* proxySession* of activated peers handed over to the worker */
+	wArrayList* sessions; /* proxySession* handled by this worker */
+	LONG load;
+};
+
+typedef struct
+{
+	proxyEventLoop* loop;
+	HANDLE thread;
+	freerdp_peer* client; /* peer in the connection sequence, guarded by the loop lock */
+	proxyData* pdata;
+	int sockfd;
+	UINT64 deadline;
+	BOOL expired;
+} proxyHandshake;
+
+struct proxy_event_loop
+{
+	proxyServer* server;
+	proxyIoWorker* workers;
+	size_t count;
+	wQueue* pending; /* freerdp_peer* accepted and waiting for a handshake thread */
+	proxyHandshake* handshakes;
+	size_t handshakeCount;
+	CRITICAL_SECTION lock;
+	UINT64 timeout; /* of the connection sequence in ms */
+};
+
+static BOOL fd_list_contains(const int* fds, size_t count, int fd)
+{
+	for (size_t x = 0; x < count; x++)
+	{
+		if (fds[x] == fd)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static BOOL epoll_register(int epfd, int fd, void* ptr, BOOL force)
+{
+	struct epoll_event ev = WINPR_C_ARRAY_INIT;
+	ev.events = EPOLLIN;
+	ev.data.ptr = ptr;
+
+	/* A handle might have been closed and its descriptor reused without us noticing, so
+	 * a forced update re-arms descriptors we think are registered already. */
+	if (force && (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0))
+		return TRUE;
+
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == 0)
+		return TRUE;
+
+	if (errno == EEXIST)
+		return epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+
+	return FALSE;
+}
+
+/* Collect the descriptors of all handles the session waits for and sync them with epoll */
+WINPR_ATTR_NODISCARD
+static BOOL session_update_fds(proxySession* session, BOOL force)
+{
+	HANDLE handles[SESSION_MAX_FDS] = WINPR_C_ARRAY_INIT;
+	int fds[SESSION_MAX_FDS] = WINPR_C_ARRAY_INIT;
+	size_t fdCount = 0;
+
+	WINPR_ASSERT(session);
+	WINPR_ASSERT(session->worker);
+
+	DWORD count =
+	    pf_server_peer_get_event_handles(session->client, handles, ARRAYSIZE(handles) - 1);
+	if (count == 0)
+		return FALSE;
+
+	if (session->back == PROXY_BACK_CONNECTING)
+		handles[count++] = session->pdata->client_thread;
+	else if (session->back == PROXY_BACK_CONNECTED)
+	{
+		pClientContext* pc = proxy_data_get_client_context(session->pdata);
+		const DWORD tmp =
+		    pf_client_get_event_handles(pc, &handles[count], ARRAYSIZE(handles) - count);
+		if (tmp == 0)
+			return FALSE;
+		count += tmp;
+	}
+
+	for (DWORD x = 0; x < count; x++)
+	{
+		const int fd = GetEventFileDescriptor(handles[x]);
+		if ((fd < 0) || fd_list_contains(fds, fdCount, fd))
+			continue;
+		fds[fdCount++] = fd;
+	}
+
+	for (size_t x = 0; x < session->fdCount; x++)
+	{
+		const int fd = session->fds[x];
+		if (!fd_list_contains(fds, fdCount, fd))
+			(void)epoll_ctl(session->worker->epfd, EPOLL_CTL_DEL, fd, nullptr);
+	}
+
+	for (size_t x = 0; x < fdCount; x++)
+	{
+		const int fd = fds[x];
+		const BOOL known = fd_list_contains(session->fds, session->fdCount, fd);
+		if (known && !force)
+			continue;
+
+		if (!epoll_register(session->worker->epfd, fd, session, known))
+		{
+			WLog_ERR(TAG, "failed to register descriptor %d: %s", fd, strerror(errno));
+			return FALSE;
+		}
+	}
+
+	memcpy(session->fds, fds, fdCount * sizeof(int));
+	session->fdCount = fdCount;
+	return TRUE;
+}
+
+static void session_free(proxySession* session)
+{
+	WINPR_ASSERT(session);
+
+	proxyIoWorker* worker = session->worker;
+	WINPR_ASSERT(worker);
+
+	proxyData* pdata = session->pdata;
+	WINPR_ASSERT(pdata);
+
+	proxy_data_abort_connect(pdata);
+
+	if (session->back == PROXY_BACK_CONNECTING)
+	{
+		DWORD code = 1;
+		(void)WaitForSingleObject(pdata->client_thread, INFINITE);
+		if (GetExitCodeThread(pdata->client_thread, &code) && (code == 0))
+			session->back = PROXY_BACK_CONNECTED;
+	}
+
+	if (session->back == PROXY_BACK_CONNECTED)
+		pf_client_stop(proxy_data_get_client_context(pdata));
+
+	for (size_t x = 0; x < session->fdCount; x++)
+		(void)epoll_ctl(worker->epfd, EPOLL_CTL_DEL, session->fds[x], nullptr);
+
+	ArrayList_Remove(worker->sessions, session);
+	(void)InterlockedDecrement(&worker->load);
+
+	pf_server_peer_session_free(session->client, pdata, TRUE);
+	free(session);
+}
+
+/* Same steps as a session thread runs after each wakeup, returns FALSE if the session ended */
+static BOOL session_check(proxySession* session, BOOL force)
+{
+	WINPR_ASSERT(session);
+
+	proxyData* pdata = session->pdata;
+	WINPR_ASSERT(pdata);
+
+	if ((session->back == PROXY_BACK_CONNECTING) &&
+	    (WaitForSingleObject(pdata->client_thread, 0) == WAIT_OBJECT_0))
+	{
+		DWORD code = 1;
+		if (GetExitCodeThread(pdata->client_thread, &code) && (code == 0))
+			session->back = PROXY_BACK_CONNECTED;
+		else
+			session->back = PROXY_BACK_CLOSED;
+		force = TRUE;
+	}
+
+	if (!pf_server_peer_check_event_handles(session->client))
+		goto fail;
+
+	/* the back connection is started by the front's post connect */
+	if ((session->back == PROXY_BACK_NONE) && pdata->client_thread)
+	{
+		session->back = PROXY_BACK_CONNECTING;
+		force = TRUE;
+	}
+
+	if (session->back == PROXY_BACK_CONNECTED)
+	{
+		pClientContext* pc = proxy_data_get_client_context(pdata);
+		if (!pf_client_check_event_handles(pc))
+		{
+			pf_client_stop(pc);
+			session->back = PROXY_BACK_CLOSED;
+			force = TRUE;
+		}
+	}
+
+	if (!session_update_fds(session, force))
+		goto fail;
+
+	return TRUE;
+
+fail:
+	session_free(session);
+	return FALSE;
+}
+
+static void worker_add_incoming(proxyIoWorker* worker)
+{
+	proxySession* session = nullptr;
+
+	WINPR_ASSERT(worker);
+
+	while ((session = Queue_Dequeue(worker->incoming)))
+	{
+		if (!ArrayList_Append(worker->sessions, session))
+		{
+			session_free(session);
+			continue;
+		}
+
+		/* Process anything the peer already sent */
+		(void)session_check(session, TRUE);
+	}
+}
+
+/* Called with the loop lock held */
+static void handshake_abort(proxyHandshake* handshake)
+{
+	WINPR_ASSERT(handshake);
+	WINPR_ASSERT(handshake->client);
+
+	proxy_data_abort_connect(handshake->pdata);
+	const BOOL aborted = freerdp_abort_connect_context(handshake->client->context);
+	WINPR_UNUSED(aborted);
+
+	/* TLS accept and NLA read from the blocking socket, which only returns once it is shut down.
+	 * The transport still owns the descriptor and closes it with the peer. */
+	(void)shutdown(handshake->sockfd, SHUT_RDWR);
+	handshake->expired = TRUE;
+}
+
+/* Aborts connection sequences running longer than the timeout, which frees their thread */
+static void handshakes_check_timeout(proxyEventLoop* loop)
+{
+	WINPR_ASSERT(loop);
+
+	const UINT64 now = GetTickCount64();
+
+	EnterCriticalSection(&loop->lock);
+	for (size_t x = 0; x < loop->handshakeCount; x++)
+	{
+		proxyHandshake* handshake = &loop->handshakes[x];
+		if (!handshake->client || handshake->expired || (now < handshake->deadline))
+			continue;
+
+		WLog_WARN(TAG, "connection sequence of %s timed out", handshake->client->hostname);
+		handshake_abort(handshake);
+	}
+	LeaveCriticalSection(&loop->lock);
+}
+
+static DWORD WINAPI pf_event_loop_worker(LPVOID arg)
+{
+	struct epoll_event events[WORKER_MAX_EVENTS] = WINPR_C_ARRAY_INIT;
+	proxySession* ready[WORKER_MAX_EVENTS] = WINPR_C_ARRAY_INIT;
+	proxyIoWorker* worker = arg;
+	size_t round = 0;
+
+	WINPR_ASSERT(worker);
+	WINPR_ASSERT(worker->loop);
+
+	proxyServer* server = worker->loop->server;
+	WINPR_ASSERT(server);
+
+	while (WaitForSingleObject(server->stopEvent, 0) != WAIT_OBJECT_0)
+	{
+		/* Do periodic polling to avoid client hang, like the session threads do */
+		const int status = epoll_wait(worker->epfd, events, ARRAYSIZE(events), 1000);
+		if (status < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			WLog_ERR(TAG, "epoll_wait failed: %s", strerror(errno));
+			break;
+		}
+
+		/* The first worker wakes up at least once per polling interval */
+		if (worker == &worker->loop->workers[0])
+			handshakes_check_timeout(worker->loop);
+
+		round++;
+		if (status == 0)
+		{
+			for (size_t x = ArrayList_Count(worker->sessions); x > 0; x--)
+				(void)session_check(ArrayList_GetItem(worker->sessions, x - 1), TRUE);
+			continue;
+		}
+
+		/* A session might be signaled by several descriptors, check each one once and only
+		 * after all events were collected as checking might free the session. */
+		size_t readyCount = 0;
+		BOOL incoming = FALSE;
+		for (int x = 0; x < status; x++)
+		{
+			void* ptr = events[x].data.ptr;
+			if (ptr == worker)
+				incoming = TRUE;
+			else if (ptr)
+			{
+				proxySession* session = ptr;
+				if (session->round == round)
+					continue;
+				session->round = round;
+				ready[readyCount++] = session;
+			}
+		}
+
+		for (size_t x = 0; x < readyCount; x++)
+			(void)session_check(ready[x], FALSE);
+
+		if (incoming)
+			worker_add_incoming(worker);
+	}
+
+	for (size_t x = ArrayList_Count(worker->sessions); x > 0; x--)
+		session_free(ArrayList_GetItem(worker->sessions, x - 1));
+
+	ExitThread(0);
+	return 0;
+}
+
+static void worker_uninit(proxyIoWorker* worker)
+{
+	WINPR_ASSERT(worker);
+
+	if (worker->thread)
+	{
+		(void)WaitForSingleObject(worker->thread, INFINITE);
+		(void)CloseHandle(worker->thread);
+	}
+
+	/* sessions handed over while the worker was shutting down */
+	proxySession* session = nullptr;
+	while (worker->incoming && (session = Queue_Dequeue(worker->incoming)))
+		session_free(session);
+
+	if (worker->epfd >= 0)
+		close(worker->epfd);
+
+	Queue_Free(worker->incoming);
+	ArrayList_Free(worker->sessions);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL worker_init(proxyIoWorker* worker, proxyEventLoop* loop)
+{
+	WINPR_ASSERT(worker);
+	WINPR_ASSERT(loop);
+
+	worker->loop = loop;
+	worker->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (worker->epfd < 0)
+		return FALSE;
+
+	worker->incoming = Queue_New(TRUE, -1, -1);
+	if (!worker->incoming)
+		return FALSE;
+
+	worker->sessions = ArrayList_New(FALSE);
+	if (!worker->sessions)
+		return FALSE;
+
+	if (!epoll_register(worker->epfd, GetEventFileDescriptor(Queue_Event(worker->incoming)),
+	                    worker, FALSE))
+		return FALSE;
+
+	if (!epoll_register(worker->epfd, GetEventFileDescriptor(loop->server->stopEvent), nullptr,
+	                    FALSE))
+		return FALSE;
+
+	worker->thread = CreateThread(nullptr, 0, pf_event_loop_worker, worker, 0, nullptr);
+	return worker->thread != nullptr;
+}
+
+BOOL pf_event_loop_supported(void)
+{
+	return TRUE;
+}
+
+static void handshakes_uninit(proxyEventLoop* loop)
+{
+	WINPR_ASSERT(loop);
+
+	/* Connection sequences blocked in the TLS accept do not see the server stopEvent */
+	EnterCriticalSection(&loop->lock);
+	for (size_t x = 0; x < loop->handshakeCount; x++)
+	{
+		if (loop->handshakes[x].client)
+			handshake_abort(&loop->handshakes[x]);
+	}
+	LeaveCriticalSection(&loop->lock);
+
+	for (size_t x = 0; x < loop->handshakeCount; x++)
+	{
+		HANDLE thread = loop->handshakes[x].thread;
+		if (thread)
+		{
+			(void)WaitForSingleObject(thread, INFINITE);
+			(void)CloseHandle(thread);
+		}
+	}
+
+	/* peers accepted while all handshake threads were busy */
+	freerdp_peer* client = nullptr;
+	while (loop->pending && (client = Queue_Dequeue(loop->pending)))
+		pf_server_peer_session_free(client, nullptr, FALSE);
+
+	free(loop->handshakes);
+	Queue_Free(loop->pending);
+}
+
+void pf_event_loop_free(proxyEventLoop* loop)
+{
+	if (!loop)
+		return;
+
+	/* The workers and handshake threads exit once the server stopEvent is set */
+	(void)SetEvent(loop->server->stopEvent);
+	handshakes_uninit(loop);
+
+	for (size_t x = 0; x < loop->count; x++)
+		worker_uninit(&loop->workers[x]);
+
+	DeleteCriticalSection(&loop->lock);
+	free(loop->workers);
+	free(loop);
+}
+
+static DWORD WINAPI pf_event_loop_handshake(LPVOID arg);
+
+WINPR_ATTR_NODISCARD
+static BOOL handshakes_init(proxyEventLoop* loop, size_t threads)
+{
+	WINPR_ASSERT(loop);
+
+	loop->pending = Queue_New(TRUE, -1, -1);
+	if (!loop->pending)
+		return FALSE;
+
+	loop->handshakes = calloc(threads, sizeof(proxyHandshake));
+	if (!loop->handshakes)
+		return FALSE;
+
+	for (size_t x = 0; x < threads; x++)
+	{
+		proxyHandshake* handshake = &loop->handshakes[x];
+		handshake->loop = loop;
+		loop->handshakeCount++;
+		handshake->thread =
+		    CreateThread(nullptr, 0, pf_event_loop_handshake, handshake, 0, nullptr);
+		if (!handshake->thread)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+proxyEventLoop* pf_event_loop_new(proxyServer* server, size_t workers, UINT32 timeout)
+{
+	WINPR_ASSERT(server);
+	WINPR_ASSERT(server->stopEvent);
+	WINPR_ASSERT(workers > 0);
+
+	proxyEventLoop* loop = calloc(1, sizeof(proxyEventLoop));
+	if (!loop)
+		return nullptr;
+
+	loop->server = server;
+	loop->timeout = 1000ull * ((timeout > 0) ? timeout : HANDSHAKE_DEFAULT_TIMEOUT);
+	if (!InitializeCriticalSectionAndSpinCount(&loop->lock, 4000))
+	{
+		free(loop);
+		return nullptr;
+	}
+
+	loop->workers = calloc(workers, sizeof(proxyIoWorker));
+	if (!loop->workers)
+		goto fail;
+
+	for (size_t x = 0; x < workers; x++)
+	{
+		loop->workers[x].epfd = -1;
+		loop->count++;
+		if (!worker_init(&loop->workers[x], loop))
+			goto fail;
+	}
+
+	const size_t handshakes = MAX(workers, HANDSHAKE_MIN_THREADS);
+	if (!handshakes_init(loop, handshakes))
+		goto fail;
+
+	WLog_INFO(TAG,
+	          "handling sessions with %" PRIuz " I/O workers and %" PRIuz
+	          " handshake threads, connection sequence timeout %" PRIu64 " ms",
+	          workers, handshakes, loop->timeout);
+	return loop;
+
+fail:
+	WLog_ERR(TAG, "failed to start I/O workers");
+	pf_event_loop_free(loop);
+	return nullptr;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL pf_event_loop_handover(proxyEventLoop* loop, freerdp_peer* client, proxyData* pdata)
+{
+	WINPR_ASSERT(loop);
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(pdata);
+
+	proxySession* session = calloc(1, sizeof(proxySession));
+	if (!session)
+		return FALSE;
+
+	proxyIoWorker* worker = &loop->workers[0];
+	for (size_t x = 1; x < loop->count; x++)
+	{
+		proxyIoWorker* cur = &loop->workers[x];
+		if (InterlockedCompareExchange(&cur->load, 0, 0) <
+		    InterlockedCompareExchange(&worker->load, 0, 0))
+			worker = cur;
+	}
+
+	session->worker = worker;
+	session->client = client;
+	session->pdata = pdata;
+	session->back = PROXY_BACK_NONE;
+
+	(void)InterlockedIncrement(&worker->load);
+	if (!Queue_Enqueue(worker->incoming, session))
+	{
+		(void)InterlockedDecrement(&worker->load);
+		free(session);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Runs the connection sequence of a peer and hands it to a worker once it is active */
+static void handshake_run(proxyHandshake* handshake, freerdp_peer* client)
+{
+	WINPR_ASSERT(handshake);
+	WINPR_ASSERT(client);
+
+	proxyEventLoop* loop = handshake->loop;
+	WINPR_ASSERT(loop);
+
+	/* The peer hands the socket to its transport on initialization */
+	const int sockfd = client->sockfd;
+	proxyData* pdata = pf_server_peer_session_new(client);
+	if (!pdata)
+		return;
+
+	EnterCriticalSection(&loop->lock);
+	handshake->client = client;
+	handshake->pdata = pdata;
+	handshake->sockfd = sockfd;
+	handshake->deadline = GetTickCount64() + loop->timeout;
+	handshake->expired = FALSE;
+	LeaveCriticalSection(&loop->lock);
+
+	const BOOL active = pf_server_peer_run(client, TRUE);
+
+	/* The timeout check must not touch the peer once it is freed or handed over */
+	EnterCriticalSection(&loop->lock);
+	const BOOL expired = handshake->expired;
+	handshake->client = nullptr;
+	handshake->pdata = nullptr;
+	LeaveCriticalSection(&loop->lock);
+
+	if (!active || expired || !pf_event_loop_handover(loop, client, pdata))
+		pf_server_peer_session_free(client, pdata, TRUE);
+}
+
+/* TLS accept, NLA and the activation block on the peer, so they must not run on a worker.
+ * A fixed number of these threads take the accepted peers one after the other. */
+static DWORD WINAPI pf_event_loop_handshake(LPVOID arg)
+{
+	proxyHandshake* handshake = arg;
+	WINPR_ASSERT(handshake);
+
+	proxyEventLoop* loop = handshake->loop;
+	WINPR_ASSERT(loop);
+
+	HANDLE events[] = { loop->server->stopEvent, Queue_Event(loop->pending) };
+	while (WaitForMultipleObjects(ARRAYSIZE(events), events, FALSE, INFINITE) ==
+	       WAIT_OBJECT_0 + 1)
+	{
+		/* Several threads wake up for a single peer */
+		freerdp_peer* client = Queue_Dequeue(loop->pending);
+		if (client)
+			handshake_run(handshake, client);
+	}
+
+	ExitThread(0);
+	return 0;
+}
+
+BOOL pf_event_loop_add_peer(proxyEventLoop* loop, freerdp_peer* client)
+{
+	WINPR_ASSERT(loop);
+	WINPR_ASSERT(client);
+
+	return Queue_Enqueue(loop->pending, client);
+}
+
+#else
+
+BOOL pf_event_loop_supported(void)
+{
+	return FALSE;
+}
+
+void pf_event_loop_free(proxyEventLoop* loop)
+{
+	WINPR_ASSERT(!loop);
+}
+
+proxyEventLoop* pf_event_loop_new(WINPR_ATTR_UNUSED proxyServer* server,
+                                  WINPR_ATTR_UNUSED size_t workers,
+                                  WINPR_ATTR_UNUSED UINT32 timeout)
+{
+	WLog_ERR(TAG, "I/O workers are not supported on this platform");
+	return nullptr;
+}
+
+BOOL pf_event_loop_add_peer(WINPR_ATTR_UNUSED proxyEventLoop* loop,
+                            WINPR_ATTR_UNUSED freerdp_peer* client)
+{
+	return FALSE;
+}
+
+#endif
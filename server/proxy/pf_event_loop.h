@@ -0,0 +1,62 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * FreeRDP Proxy Server
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_PROXY_PFEVENTLOOP_H
+#define FREERDP_SERVER_PROXY_PFEVENTLOOP_H
+
+#include <freerdp/peer.h>
+
+#include "pf_server.h"
+
+/**
+ * @brief pf_event_loop_supported Checks if the platform supports I/O workers
+ *
+ * @return \b TRUE if \link pf_event_loop_new can be used
+ */
+WINPR_ATTR_NODISCARD BOOL pf_event_loop_supported(void);
+
+void pf_event_loop_free(proxyEventLoop* loop);
+
+/**
+ * @brief pf_event_loop_new Starts a fixed number of I/O worker threads, each one handling
+ *        the front and back connections of many sessions, and a small pool of threads for
+ *        the connection sequences.
+ *
+ * The threads stop and tear down their sessions when the server stopEvent is set.
+ *
+ * @param server The proxy server the sessions belong to. Must NOT be nullptr.
+ * @param workers The number of worker threads, must be > 0
+ * @param timeout The time in seconds a peer may take to become active, 0 for the default
+ * @return A new event loop or \b nullptr in case of failure
+ */
+WINPR_ATTR_MALLOC(pf_event_loop_free, 1)
+WINPR_ATTR_NODISCARD proxyEventLoop* pf_event_loop_new(proxyServer* server, size_t workers,
+                                                       UINT32 timeout);
+
+/**
+ * @brief pf_event_loop_add_peer Starts the session of an accepted peer.
+ *
+ * The connection sequence runs on the handshake pool, as TLS accept and NLA block. Peers wait
+ * while all of its threads are busy and are dropped if they do not become active within the
+ * timeout. Once the peer is active the session is handed to the least loaded worker. The peer
+ * is freed when the session ends.
+ *
+ * @return \b TRUE in case of success, \b FALSE if the peer was not taken over
+ */
+WINPR_ATTR_NODISCARD BOOL pf_event_loop_add_peer(proxyEventLoop* loop, freerdp_peer* client);
+
+#endif /* FREERDP_SERVER_PROXY_PFEVENTLOOP_H */
@@ -45,6 +45,7 @@
 #include <freerdp/server/proxy/proxy_log.h>
 
 #include "pf_server.h"
+#include "pf_event_loop.h"
 #include "pf_input.h"
 #include "pf_channel.h"
 #include <freerdp/server/proxy/proxy_config.h>
@@ -58,12 +59,6 @@
 
 #define TAG PROXY_TAG("server")
 
-typedef struct
-{
-	HANDLE thread;
-	freerdp_peer* client;
-} peer_thread_args;
-
 WINPR_ATTR_NODISCARD
 static BOOL pf_server_parse_target_from_routing_token(rdpContext* context, rdpSettings* settings,
                                                       FreeRDP_Settings_Keys_String targetID,
@@ -365,8 +360,15 @@ static BOOL pf_server_post_connect(freerdp_peer* peer)
 	if (!pf_modules_run_hook(pdata->module, HOOK_TYPE_SERVER_POST_CONNECT, pdata, peer))
 		return FALSE;
 
-	/* Start a proxy's client in it's own thread */
-	pdata->client_thread = CreateThread(nullptr, 0, pf_client_start, pc, 0, nullptr);
+	/* Start a proxy's client in it's own thread. With I/O workers the thread only connects,
+	 * the established connection is then handled by the worker of the peer. */
+	proxyServer* server = (proxyServer*)peer->ContextExtra;
+	WINPR_ASSERT(server);
+	LPTHREAD_START_ROUTINE start = pf_client_start;
+	if (server->event_loop)
+		start = pf_client_connect_start;
+
+	pdata->client_thread = CreateThread(nullptr, 0, start, pc, 0, nullptr);
 	if (!pdata->client_thread)
 	{
 		PROXY_LOG_ERR(TAG, ps, "failed to create client thread");
@@ -395,6 +397,8 @@ static BOOL pf_server_activate(freerdp_peer* peer)
 
 	if (!freerdp_settings_set_uint32(settings, FreeRDP_CompressionLevel, PACKET_COMPR_TYPE_RDP8))
 		return FALSE;
+	if (!freerdp_settings_set_bool(settings, FreeRDP_CompressionAdaptive, TRUE))
+		return FALSE;
 	if (!pf_modules_run_hook(pdata->module, HOOK_TYPE_SERVER_ACTIVATE, pdata, peer))
 		return FALSE;
 
@@ -574,6 +578,8 @@ static BOOL pf_server_initialize_peer_connection(freerdp_peer* peer, proxyData*
 		return FALSE;
 	if (!freerdp_settings_set_bool(settings, FreeRDP_NlaSecurity, config->ServerNlaSecurity))
 		return FALSE;
+	if (!freerdp_settings_set_bool(settings, FreeRDP_TlsKernelOffload, config->TlsKernelOffload))
+		return FALSE;
 
 	if (!freerdp_settings_set_uint32(settings, FreeRDP_EncryptionLevel,
 	                                 ENCRYPTION_LEVEL_CLIENT_COMPATIBLE))
@@ -613,165 +619,171 @@ static BOOL pf_server_initialize_peer_connection(freerdp_peer* peer, proxyData*
 	return (stream_dump_register_handlers(peer->context, CONNECTION_STATE_NEGO, TRUE));
 }
 
-/**
- * Handles an incoming client connection, to be run in it's own thread.
- *
- * arg is a pointer to a freerdp_peer representing the client.
- */
-WINPR_ATTR_NODISCARD
-static DWORD WINAPI pf_server_handle_peer(LPVOID arg)
+proxyData* pf_server_peer_session_new(freerdp_peer* client)
 {
-	HANDLE eventHandles[MAXIMUM_WAIT_OBJECTS] = WINPR_C_ARRAY_INIT;
-	pServerContext* ps = nullptr;
-	peer_thread_args* args = arg;
-
-	WINPR_ASSERT(args);
-
-	freerdp_peer* client = args->client;
 	WINPR_ASSERT(client);
 
 	proxyServer* server = (proxyServer*)client->ContextExtra;
 	WINPR_ASSERT(server);
 
 	ArrayList_Lock(server->peer_list);
-	size_t count = ArrayList_Count(server->peer_list);
+	const size_t count = ArrayList_Count(server->peer_list);
 	ArrayList_Unlock(server->peer_list);
 
 	proxyData* pdata = proxy_data_new();
 	if (!pdata)
-		goto out_free_peer;
+		goto fail;
 
 	if (!pf_context_init_server_context(client))
-		goto out_free_peer;
+		goto fail;
 
 	if (!pf_server_initialize_peer_connection(client, pdata))
-		goto out_free_peer;
+		goto fail;
 
-	ps = (pServerContext*)client->context;
+	pServerContext* ps = (pServerContext*)client->context;
 	WINPR_ASSERT(ps);
 	PROXY_LOG_DBG(TAG, ps, "Added peer, %" PRIuz " connected", count);
 
 	if (!pf_modules_run_hook(pdata->module, HOOK_TYPE_SERVER_SESSION_INITIALIZE, pdata, client))
-		goto out_free_peer;
+		goto fail;
 
 	WINPR_ASSERT(client->Initialize);
 	if (!client->Initialize(client))
-		goto out_free_peer;
+		goto fail;
 
 	PROXY_LOG_INFO(TAG, ps, "new connection: proxy address: %s, client address: %s",
 	               pdata->config->Host, client->hostname);
 
 	if (!pf_modules_run_hook(pdata->module, HOOK_TYPE_SERVER_SESSION_STARTED, pdata, client))
-		goto out_free_peer;
+		goto fail;
 
-	while (1)
+	return pdata;
+
+fail:
+	pf_server_peer_session_free(client, pdata, FALSE);
+	return nullptr;
+}
+
+DWORD pf_server_peer_get_event_handles(freerdp_peer* client, HANDLE* handles, DWORD count)
+{
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(handles);
+
+	pServerContext* ps = (pServerContext*)client->context;
+	WINPR_ASSERT(ps);
+
+	proxyData* pdata = ps->pdata;
+	WINPR_ASSERT(pdata);
+
+	if (count < 3)
+		return 0;
+
+	WINPR_ASSERT(client->GetEventHandles);
+	const DWORD eventCount = client->GetEventHandles(client, handles, count - 2);
+	if (eventCount == 0)
 	{
-		HANDLE ChannelEvent = INVALID_HANDLE_VALUE;
-		DWORD eventCount = 0;
-		{
-			WINPR_ASSERT(client->GetEventHandles);
-			const DWORD tmp = client->GetEventHandles(client, &eventHandles[eventCount],
-			                                          ARRAYSIZE(eventHandles) - eventCount);
+		PROXY_LOG_ERR(TAG, ps, "Failed to get FreeRDP transport event handles");
+		return 0;
+	}
 
-			if (tmp == 0)
-			{
-				PROXY_LOG_ERR(TAG, ps, "Failed to get FreeRDP transport event handles");
-				break;
-			}
+	HANDLE ChannelEvent = WTSVirtualChannelManagerGetEventHandle(ps->vcm);
+	WINPR_ASSERT(ChannelEvent && (ChannelEvent != INVALID_HANDLE_VALUE));
+	WINPR_ASSERT(pdata->abort_event && (pdata->abort_event != INVALID_HANDLE_VALUE));
 
-			eventCount += tmp;
-		}
-		/* Main client event handling loop */
-		ChannelEvent = WTSVirtualChannelManagerGetEventHandle(ps->vcm);
+	handles[eventCount] = ChannelEvent;
+	handles[eventCount + 1] = pdata->abort_event;
+	return eventCount + 2;
+}
 
-		WINPR_ASSERT(ChannelEvent && (ChannelEvent != INVALID_HANDLE_VALUE));
-		WINPR_ASSERT(pdata->abort_event && (pdata->abort_event != INVALID_HANDLE_VALUE));
-		eventHandles[eventCount++] = ChannelEvent;
-		eventHandles[eventCount++] = pdata->abort_event;
-		eventHandles[eventCount++] = server->stopEvent;
+BOOL pf_server_peer_check_event_handles(freerdp_peer* client)
+{
+	WINPR_ASSERT(client);
 
-		const DWORD status = WaitForMultipleObjects(
-		    eventCount, eventHandles, FALSE, 1000); /* Do periodic polling to avoid client hang */
+	pServerContext* ps = (pServerContext*)client->context;
+	WINPR_ASSERT(ps);
 
-		if (status == WAIT_FAILED)
+	proxyData* pdata = ps->pdata;
+	WINPR_ASSERT(pdata);
+
+	WINPR_ASSERT(client->CheckFileDescriptor);
+	if (client->CheckFileDescriptor(client) != TRUE)
+		return FALSE;
+
+	HANDLE ChannelEvent = WTSVirtualChannelManagerGetEventHandle(ps->vcm);
+	if (WaitForSingleObject(ChannelEvent, 0) == WAIT_OBJECT_0)
+	{
+		if (!WTSVirtualChannelManagerCheckFileDescriptor(ps->vcm))
 		{
-			PROXY_LOG_ERR(TAG, ps, "WaitForMultipleObjects failed (status: %" PRIu32 ")", status);
-			break;
+			PROXY_LOG_ERR(TAG, ps, "WTSVirtualChannelManagerCheckFileDescriptor failure");
+			return FALSE;
 		}
+	}
 
-		WINPR_ASSERT(client->CheckFileDescriptor);
-		if (client->CheckFileDescriptor(client) != TRUE)
-			break;
+	/* only disconnect after checking client's and vcm's file descriptors  */
+	if (proxy_data_shall_disconnect(pdata))
+	{
+		PROXY_LOG_INFO(TAG, ps, "abort event is set, closing connection with peer %s",
+		               client->hostname);
+		return FALSE;
+	}
 
-		if (WaitForSingleObject(ChannelEvent, 0) == WAIT_OBJECT_0)
-		{
+	switch (WTSVirtualChannelManagerGetDrdynvcState(ps->vcm))
+	{
+		/* Dynamic channel status may have been changed after processing */
+		case DRDYNVC_STATE_NONE:
+
+			/* Initialize drdynvc channel */
 			if (!WTSVirtualChannelManagerCheckFileDescriptor(ps->vcm))
 			{
-				PROXY_LOG_ERR(TAG, ps, "WTSVirtualChannelManagerCheckFileDescriptor failure");
-				goto fail;
+				PROXY_LOG_ERR(TAG, ps, "Failed to initialize drdynvc channel");
+				return FALSE;
 			}
-		}
 
-		/* only disconnect after checking client's and vcm's file descriptors  */
-		if (proxy_data_shall_disconnect(pdata))
-		{
-			PROXY_LOG_INFO(TAG, ps, "abort event is set, closing connection with peer %s",
-			               client->hostname);
-			break;
-		}
-
-		if (WaitForSingleObject(server->stopEvent, 0) == WAIT_OBJECT_0)
-		{
-			PROXY_LOG_INFO(TAG, ps, "Server shutting down, terminating peer");
 			break;
-		}
 
-		switch (WTSVirtualChannelManagerGetDrdynvcState(ps->vcm))
-		{
-			/* Dynamic channel status may have been changed after processing */
-			case DRDYNVC_STATE_NONE:
+		case DRDYNVC_STATE_READY:
+			if (WaitForSingleObject(ps->dynvcReady, 0) == WAIT_TIMEOUT)
+			{
+				(void)SetEvent(ps->dynvcReady);
+			}
 
-				/* Initialize drdynvc channel */
-				if (!WTSVirtualChannelManagerCheckFileDescriptor(ps->vcm))
-				{
-					PROXY_LOG_ERR(TAG, ps, "Failed to initialize drdynvc channel");
-					goto fail;
-				}
+			break;
 
-				break;
+		default:
+			break;
+	}
 
-			case DRDYNVC_STATE_READY:
-				if (WaitForSingleObject(ps->dynvcReady, 0) == WAIT_TIMEOUT)
-				{
-					(void)SetEvent(ps->dynvcReady);
-				}
+	return TRUE;
+}
 
-				break;
+void pf_server_peer_session_free(freerdp_peer* client, proxyData* pdata, BOOL started)
+{
+	WINPR_ASSERT(client);
 
-			default:
-				break;
-		}
-	}
+	proxyServer* server = (proxyServer*)client->ContextExtra;
+	WINPR_ASSERT(server);
 
-fail:
+	pServerContext* ps = (pServerContext*)client->context;
 
-	PROXY_LOG_INFO(TAG, ps, "starting shutdown of connection");
-	PROXY_LOG_INFO(TAG, ps, "stopping proxy's client");
+	if (started)
+	{
+		PROXY_LOG_INFO(TAG, ps, "starting shutdown of connection");
+		PROXY_LOG_INFO(TAG, ps, "stopping proxy's client");
 
-	/* Abort the client. */
-	proxy_data_abort_connect(pdata);
+		/* Abort the client. */
+		proxy_data_abort_connect(pdata);
 
-	(void)pf_modules_run_hook(pdata->module, HOOK_TYPE_SERVER_SESSION_END, pdata, client);
+		(void)pf_modules_run_hook(pdata->module, HOOK_TYPE_SERVER_SESSION_END, pdata, client);
 
-	PROXY_LOG_INFO(TAG, ps, "freeing server's channels");
+		PROXY_LOG_INFO(TAG, ps, "freeing server's channels");
 
-	WINPR_ASSERT(client->Close);
-	client->Close(client);
+		WINPR_ASSERT(client->Close);
+		client->Close(client);
 
-	WINPR_ASSERT(client->Disconnect);
-	client->Disconnect(client);
+		WINPR_ASSERT(client->Disconnect);
+		client->Disconnect(client);
+	}
 
-out_free_peer:
 	PROXY_LOG_INFO(TAG, ps, "freeing proxy data");
 
 	if (pdata && pdata->client_thread)
@@ -789,21 +801,86 @@ out_free_peer:
 		PROXY_LOG_INFO(TAG, ps, "ignore proxy RDP client thread, not proxyData not created");
 	}
 
-	{
-		ArrayList_Lock(server->peer_list);
-		ArrayList_Remove(server->peer_list, args->thread);
-		count = ArrayList_Count(server->peer_list);
-		PROXY_LOG_DBG(TAG, ps, "Removed peer, %" PRIuz " connected", count);
-		freerdp_peer_context_free(client);
-		freerdp_peer_free(client);
-		proxy_data_free(pdata);
-		ArrayList_Unlock(server->peer_list);
-	}
+	ArrayList_Lock(server->peer_list);
+	ArrayList_Remove(server->peer_list, client);
+	const size_t count = ArrayList_Count(server->peer_list);
+	PROXY_LOG_DBG(TAG, ps, "Removed peer, %" PRIuz " connected", count);
+	freerdp_peer_context_free(client);
+	freerdp_peer_free(client);
+	proxy_data_free(pdata);
+	ArrayList_Unlock(server->peer_list);
 
 #if defined(WITH_DEBUG_EVENTS)
 	DumpEventHandles();
 #endif
-	free(args);
+}
+
+BOOL pf_server_peer_run(freerdp_peer* client, BOOL handover)
+{
+	HANDLE eventHandles[MAXIMUM_WAIT_OBJECTS] = WINPR_C_ARRAY_INIT;
+	WINPR_ASSERT(client);
+
+	proxyServer* server = (proxyServer*)client->ContextExtra;
+	WINPR_ASSERT(server);
+
+	pServerContext* ps = (pServerContext*)client->context;
+	while (1)
+	{
+		DWORD eventCount =
+		    pf_server_peer_get_event_handles(client, eventHandles, ARRAYSIZE(eventHandles) - 1);
+		if (eventCount == 0)
+			break;
+
+		eventHandles[eventCount++] = server->stopEvent;
+
+		const DWORD status = WaitForMultipleObjects(
+		    eventCount, eventHandles, FALSE, 1000); /* Do periodic polling to avoid client hang */
+
+		if (status == WAIT_FAILED)
+		{
+			PROXY_LOG_ERR(TAG, ps, "WaitForMultipleObjects failed (status: %" PRIu32 ")", status);
+			break;
+		}
+
+		if (!pf_server_peer_check_event_handles(client))
+			break;
+
+		if (WaitForSingleObject(server->stopEvent, 0) == WAIT_OBJECT_0)
+		{
+			PROXY_LOG_INFO(TAG, ps, "Server shutting down, terminating peer");
+			break;
+		}
+
+		if (handover && (freerdp_get_state(client->context) == CONNECTION_STATE_ACTIVE))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/**
+ * Handles an incoming client connection, to be run in it's own thread.
+ *
+ * arg is a pointer to a freerdp_peer representing the client.
+ */
+WINPR_ATTR_NODISCARD
+static DWORD WINAPI pf_server_handle_peer(LPVOID arg)
+{
+	freerdp_peer* client = arg;
+	WINPR_ASSERT(client);
+
+	proxyData* pdata = pf_server_peer_session_new(client);
+	if (!pdata)
+		goto out;
+
+	{
+		const BOOL active = pf_server_peer_run(client, FALSE);
+		WINPR_UNUSED(active);
+	}
+
+	pf_server_peer_session_free(client, pdata, TRUE);
+
+out:
 	ExitThread(0);
 	return 0;
 }
@@ -811,37 +888,36 @@ out_free_peer:
 WINPR_ATTR_NODISCARD
 static BOOL pf_server_start_peer(freerdp_peer* client)
 {
-	HANDLE hThread = nullptr;
-	proxyServer* server = nullptr;
-	peer_thread_args* args = calloc(1, sizeof(peer_thread_args));
-	if (!args)
-		return FALSE;
-
 	WINPR_ASSERT(client);
-	args->client = client;
 
-	server = (proxyServer*)client->ContextExtra;
+	proxyServer* server = (proxyServer*)client->ContextExtra;
 	WINPR_ASSERT(server);
 
-	hThread = CreateThread(nullptr, 0, pf_server_handle_peer, args, CREATE_SUSPENDED, nullptr);
-	if (!hThread)
-	{
-		free(args);
-		return FALSE;
-	}
-
-	args->thread = hThread;
 	ArrayList_Lock(server->peer_list);
-	const BOOL appended = ArrayList_Append(server->peer_list, hThread);
+	const BOOL appended = ArrayList_Append(server->peer_list, client);
 	ArrayList_Unlock(server->peer_list);
 	if (!appended)
-	{
-		(void)CloseHandle(hThread);
-		free(args);
 		return FALSE;
+
+	if (server->event_loop)
+	{
+		if (pf_event_loop_add_peer(server->event_loop, client))
+			return TRUE;
+	}
+	else
+	{
+		HANDLE hThread = CreateThread(nullptr, 0, pf_server_handle_peer, client, 0, nullptr);
+		if (hThread)
+		{
+			(void)CloseHandle(hThread);
+			return TRUE;
+		}
 	}
 
-	return ResumeThread(hThread) != (DWORD)-1;
+	ArrayList_Lock(server->peer_list);
+	ArrayList_Remove(server->peer_list, client);
+	ArrayList_Unlock(server->peer_list);
+	return FALSE;
 }
 
 WINPR_ATTR_NODISCARD
@@ -991,15 +1067,8 @@ static BOOL are_all_required_modules_loaded(proxyModule* module, const proxyConf
 	return TRUE;
 }
 
-static void peer_free(void* obj)
-{
-	HANDLE hdl = (HANDLE)obj;
-	(void)CloseHandle(hdl);
-}
-
 proxyServer* pf_server_new(const proxyConfig* config)
 {
-	wObject* obj = nullptr;
 	proxyServer* server = nullptr;
 
 	WINPR_ASSERT(config);
@@ -1037,10 +1106,15 @@ proxyServer* pf_server_new(const proxyConfig* config)
 	if (!server->peer_list)
 		goto out;
 
-	obj = ArrayList_Object(server->peer_list);
-	WINPR_ASSERT(obj);
-
-	obj->fnObjectFree = peer_free;
+	if ((server->config->IoWorkers > 0) && !pf_event_loop_supported())
+		WLog_WARN(TAG, "IoWorkers not supported on this platform, using a thread per session");
+	else if (server->config->IoWorkers > 0)
+	{
+		server->event_loop = pf_event_loop_new(server, server->config->IoWorkers,
+		                                       server->config->HandshakeTimeout);
+		if (!server->event_loop)
+			goto out;
+	}
 
 	server->listener->info = server;
 	server->listener->PeerAccepted = pf_server_peer_accepted;
@@ -1130,6 +1204,9 @@ void pf_server_free(proxyServer* server)
 
 	pf_server_stop(server);
 
+	/* tears down all sessions handled by the I/O workers */
+	pf_event_loop_free(server->event_loop);
+
 	if (server->peer_list)
 	{
 		while (ArrayList_Count(server->peer_list) > 0)
@@ -29,8 +29,11 @@
 
 #include <freerdp/server/proxy/proxy_config.h>
 #include <freerdp/server/proxy/proxy_context.h>
+#include <freerdp/server/proxy/proxy_server.h>
 #include "proxy_modules.h"
 
+typedef struct proxy_event_loop proxyEventLoop;
+
 struct proxy_server
 {
 	proxyModule* module;
@@ -38,7 +41,8 @@ struct proxy_server
 
 	freerdp_listener* listener;
 	HANDLE stopEvent; /* an event used to signal the main thread to stop */
-	wArrayList* peer_list;
+	wArrayList* peer_list; /* freerdp_peer* of all active sessions */
+	proxyEventLoop* event_loop; /* I/O workers, nullptr for a thread per session */
 };
 
 struct p_server_context
@@ -55,4 +59,21 @@ struct p_server_context
 	wHashTable* channelsByBackId;
 };
 
+/** Sets up a new session for an accepted peer, returns \b nullptr and frees the peer on failure */
+WINPR_ATTR_NODISCARD proxyData* pf_server_peer_session_new(freerdp_peer* client);
+
+/** Tears down a session created by \link pf_server_peer_session_new and frees the peer */
+void pf_server_peer_session_free(freerdp_peer* client, proxyData* pdata, BOOL started);
+
+/** Returns the number of handles to wait for or \b 0 in case of failure */
+WINPR_ATTR_NODISCARD DWORD pf_server_peer_get_event_handles(freerdp_peer* client,
+                                                            HANDLE* handles, DWORD count);
+
+/** Processes pending events, returns \b FALSE if the session should be closed */
+WINPR_ATTR_NODISCARD BOOL pf_server_peer_check_event_handles(freerdp_peer* client);
+
+/** Drives a session in the calling thread until it ends, returns \b FALSE then.
+ *  With \b handover set it returns \b TRUE as soon as the peer is active instead. */
+WINPR_ATTR_NODISCARD BOOL pf_server_peer_run(freerdp_peer* client, BOOL handover);
+
 #endif /* INT_FREERDP_SERVER_PROXY_SERVER_H */
@@ -0,0 +1,330 @@
+#include <stdio.h>
+
+#include <winpr/wtypes.h>
+#include <winpr/ini.h>
+#include <winpr/path.h>
+#include <winpr/sysinfo.h>
+#include <winpr/thread.h>
+
+#include <freerdp/server/proxy/proxy_config.h>
+#include <freerdp/server/proxy/proxy_server.h>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SESSION_COUNT 256
+
+static UINT16 test_port(void)
+{
+	return (UINT16)(40000 + (GetCurrentProcessId() % 10000));
+}
+
+static proxyConfig* load_config(UINT32 ioWorkers, UINT32 handshakeTimeout)
+{
+	proxyConfig* config = nullptr;
+	char* path = GetCombinedPath(CMAKE_CURRENT_SOURCE_DIR, "conf/test1.conf");
+	wIniFile* ini = IniFile_New();
+	if (!path || !ini)
+		goto fail;
+
+	if (IniFile_ReadFile(ini, path) < 0)
+		goto fail;
+
+	if ((IniFile_SetKeyValueString(ini, "Server", "Host", "127.0.0.1") < 0) ||
+	    (IniFile_SetKeyValueInt(ini, "Server", "Port", test_port()) < 0) ||
+	    (IniFile_SetKeyValueInt(ini, "Server", "IoWorkers", (int)ioWorkers) < 0) ||
+	    (IniFile_SetKeyValueInt(ini, "Server", "HandshakeTimeout", (int)handshakeTimeout) < 0) ||
+	    (IniFile_SetKeyValueString(ini, "Plugins", "Modules", "") < 0) ||
+	    (IniFile_SetKeyValueString(ini, "Plugins", "Required", "") < 0))
+		goto fail;
+
+	config = server_config_load_ini(ini);
+
+fail:
+	IniFile_Free(ini);
+	free(path);
+	return config;
+}
+
+static size_t process_rss_kb(void)
+{
+	unsigned long size = 0;
+	unsigned long resident = 0;
+	FILE* fp = fopen("/proc/self/statm", "r");
+	if (!fp)
+		return 0;
+
+	if (fscanf(fp, "%lu %lu", &size, &resident) != 2)
+		resident = 0;
+	(void)fclose(fp);
+	return resident * (size_t)sysconf(_SC_PAGESIZE) / 1024;
+}
+
+static size_t process_threads(void)
+{
+	char line[256] = WINPR_C_ARRAY_INIT;
+	size_t threads = 0;
+	FILE* fp = fopen("/proc/self/status", "r");
+	if (!fp)
+		return 0;
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		if (sscanf(line, "Threads: %zu", &threads) == 1)
+			break;
+	}
+	(void)fclose(fp);
+	return threads;
+}
+
+static double process_cpu_ms(void)
+{
+	struct rusage usage = WINPR_C_ARRAY_INIT;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+
+	return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0 +
+	       (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+}
+
+static int connect_session(void)
+{
+	struct sockaddr_in addr = WINPR_C_ARRAY_INIT;
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(test_port());
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	const int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+
+	if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* X.224 connection request asking for TLS */
+static BOOL send_connection_request(int fd)
+{
+	const BYTE request[] = { 0x03, 0x00, 0x00, 0x13, 0x0e, 0xe0, 0x00, 0x00, 0x00, 0x00,
+		                     0x00, 0x01, 0x00, 0x08, 0x00, 0x01, 0x00, 0x00, 0x00 };
+	return send(fd, request, sizeof(request), 0) == (ssize_t)sizeof(request);
+}
+
+/* Waits for the X.224 connection confirm of the proxy */
+static BOOL wait_connection_confirm(int fd, int timeout)
+{
+	BYTE buffer[64] = WINPR_C_ARRAY_INIT;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+
+	if (poll(&pfd, 1, timeout) != 1)
+		return FALSE;
+	if (recv(fd, buffer, sizeof(buffer), 0) < 4)
+		return FALSE;
+	return buffer[0] == 0x03;
+}
+
+static DWORD WINAPI server_thread(LPVOID arg)
+{
+	proxyServer* server = arg;
+	return pf_server_run(server) ? 0 : 1;
+}
+
+static BOOL run_load(UINT32 ioWorkers)
+{
+	BOOL rc = FALSE;
+	HANDLE thread = nullptr;
+	int fds[SESSION_COUNT] = WINPR_C_ARRAY_INIT;
+	size_t count = 0;
+
+	proxyConfig* config = load_config(ioWorkers, 0);
+	if (!config)
+		return FALSE;
+
+	proxyServer* server = pf_server_new(config);
+	pf_server_config_free(config);
+	if (!server)
+		return FALSE;
+
+	if (!pf_server_start(server))
+		goto fail;
+
+	const size_t rss = process_rss_kb();
+	const size_t threads = process_threads();
+	const double cpu = process_cpu_ms();
+
+	thread = CreateThread(nullptr, 0, server_thread, server, 0, nullptr);
+	if (!thread)
+		goto fail;
+
+	for (; count < ARRAYSIZE(fds); count++)
+	{
+		fds[count] = connect_session();
+		if (fds[count] < 0)
+			goto fail;
+	}
+
+	/* give the proxy some time to pick up all sessions and idle for a polling interval */
+	Sleep(2000);
+
+	const size_t srss = process_rss_kb();
+	const size_t sthreads = process_threads();
+	printf("IoWorkers=%-2" PRIu32 " sessions=%" PRIuz ": threads=%" PRIuz ", %" PRIuz
+	       " KiB RSS per session, %.1f ms CPU\n",
+	       ioWorkers, count, sthreads - threads, (srss > rss) ? (srss - rss) / count : 0,
+	       process_cpu_ms() - cpu);
+
+	/* The workers and the handshake pool are started with the server, idle peers queue up */
+	rc = (ioWorkers == 0) || (sthreads <= threads + 1);
+
+fail:
+	if (!rc)
+		(void)fprintf(stderr, "IoWorkers=%" PRIu32 ": failed after %" PRIuz " sessions\n",
+		              ioWorkers, count);
+
+	for (size_t x = 0; x < count; x++)
+		close(fds[x]);
+
+	pf_server_stop(server);
+	if (thread)
+	{
+		(void)WaitForSingleObject(thread, INFINITE);
+		(void)CloseHandle(thread);
+	}
+	pf_server_free(server);
+	return rc;
+}
+
+/* A client that stops in the middle of the TLS handshake must not hold up other sessions */
+static BOOL run_stalled(UINT32 ioWorkers)
+{
+	BOOL rc = FALSE;
+	HANDLE thread = nullptr;
+	int stalled = -1;
+	int fd = -1;
+
+	proxyConfig* config = load_config(ioWorkers, 0);
+	if (!config)
+		return FALSE;
+
+	proxyServer* server = pf_server_new(config);
+	pf_server_config_free(config);
+	if (!server)
+		return FALSE;
+
+	if (!pf_server_start(server))
+		goto fail;
+
+	thread = CreateThread(nullptr, 0, server_thread, server, 0, nullptr);
+	if (!thread)
+		goto fail;
+
+	/* The proxy waits for a TLS client hello that never comes */
+	stalled = connect_session();
+	if ((stalled < 0) || !send_connection_request(stalled) ||
+	    !wait_connection_confirm(stalled, 5000))
+		goto fail;
+
+	fd = connect_session();
+	if ((fd < 0) || !send_connection_request(fd))
+		goto fail;
+
+	rc = wait_connection_confirm(fd, 5000);
+	printf("IoWorkers=%-2" PRIu32 " stalled handshake: other session %s\n", ioWorkers,
+	       rc ? "served" : "blocked");
+
+fail:
+	if (fd >= 0)
+		close(fd);
+	if (stalled >= 0)
+		close(stalled);
+
+	pf_server_stop(server);
+	if (thread)
+	{
+		(void)WaitForSingleObject(thread, INFINITE);
+		(void)CloseHandle(thread);
+	}
+	pf_server_free(server);
+	return rc;
+}
+
+/* A stalled connection sequence is dropped after the handshake timeout */
+static BOOL run_timeout(UINT32 ioWorkers)
+{
+	BOOL rc = FALSE;
+	HANDLE thread = nullptr;
+	int stalled = -1;
+
+	proxyConfig* config = load_config(ioWorkers, 1);
+	if (!config)
+		return FALSE;
+
+	proxyServer* server = pf_server_new(config);
+	pf_server_config_free(config);
+	if (!server)
+		return FALSE;
+
+	if (!pf_server_start(server))
+		goto fail;
+
+	thread = CreateThread(nullptr, 0, server_thread, server, 0, nullptr);
+	if (!thread)
+		goto fail;
+
+	stalled = connect_session();
+	if ((stalled < 0) || !send_connection_request(stalled) ||
+	    !wait_connection_confirm(stalled, 5000))
+		goto fail;
+
+	/* The proxy closes the connection, the timeout is checked once per second */
+	{
+		BYTE buffer[64] = WINPR_C_ARRAY_INIT;
+		struct pollfd pfd = { .fd = stalled, .events = POLLIN, .revents = 0 };
+
+		rc = (poll(&pfd, 1, 5000) == 1) && (recv(stalled, buffer, sizeof(buffer), 0) <= 0);
+	}
+	printf("IoWorkers=%-2" PRIu32 " stalled handshake: %s\n", ioWorkers,
+	       rc ? "dropped" : "kept");
+
+fail:
+	if (stalled >= 0)
+		close(stalled);
+
+	pf_server_stop(server);
+	if (thread)
+	{
+		(void)WaitForSingleObject(thread, INFINITE);
+		(void)CloseHandle(thread);
+	}
+	pf_server_free(server);
+	return rc;
+}
+#endif
+
+int TestFreeRDPProxyLoad(WINPR_ATTR_UNUSED int argc, WINPR_ATTR_UNUSED char* argv[])
+{
+#if defined(__linux__)
+	if (!run_load(0))
+		return -1;
+	if (!run_load(1))
+		return -1;
+	if (!run_load(4))
+		return -1;
+	if (!run_stalled(0))
+		return -1;
+	if (!run_stalled(1))
+		return -1;
+	if (!run_timeout(1))
+		return -1;
+#endif
+	return 0;
+}
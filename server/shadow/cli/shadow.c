@@ -101,10 +101,18 @@ int main(int argc, char** argv)
 #endif
 		{ "gfx-progressive", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueTrue, nullptr, -1, nullptr,
 		  "Allow GFX progressive codec" },
+		{ "gfx-progressive-passes", COMMAND_LINE_VALUE_REQUIRED, "<1-4>", "1", nullptr, -1, nullptr,
+		  "Send GFX progressive tiles coarse first and refine them while the screen is idle" },
 		{ "gfx-rfx", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueTrue, nullptr, -1, nullptr,
 		  "Allow GFX RFX codec" },
 		{ "gfx-planar", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueTrue, nullptr, -1, nullptr,
 		  "Allow GFX planar codec" },
+		{ "gfx-clear", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueFalse, nullptr, -1, nullptr,
+		  "Prefer GFX ClearCodec codec over planar (for text heavy desktops)" },
+		{ "gfx-cache", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueTrue, nullptr, -1, nullptr,
+		  "Reuse identical GFX tiles from the client cache (RFX, ClearCodec, planar)" },
+		{ "rate-control", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueFalse, nullptr, -1, nullptr,
+		  "Adapt frame rate and quality to the measured latency and bandwidth" },
 		{ "gfx-avc420", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueTrue, nullptr, -1, nullptr,
 		  "Allow GFX AVC420 codec" },
 		{ "gfx-avc444", COMMAND_LINE_VALUE_BOOL, nullptr, BoolValueTrue, nullptr, -1, nullptr,
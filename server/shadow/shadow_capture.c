@@ -19,9 +19,12 @@
 #include <freerdp/config.h>
 
 #include <winpr/crt.h>
+#include <winpr/pool.h>
 #include <winpr/print.h>
+#include <winpr/sysinfo.h>
 
 #include <freerdp/log.h>
+#include <freerdp/primitives.h>
 
 #include "shadow_surface.h"
 
@@ -218,13 +221,208 @@ static pixel_equal_fn_t get_comparison_fn(DWORD format1, DWORD format2)
 		return pixel_equal_no_alpha;
 }
 
+WINPR_ATTR_NODISCARD
+static int shadow_capture_tiles_to_rect(UINT32 l, UINT32 t, UINT32 r, UINT32 b, UINT32 nWidth,
+                                        UINT32 nHeight, RECTANGLE_16* WINPR_RESTRICT rect)
+{
+	WINPR_ASSERT(rect);
+
+	if ((r < l) || (b < t))
+		return 0;
+
+	WINPR_ASSERT(l * 16 <= UINT16_MAX);
+	WINPR_ASSERT(t * 16 <= UINT16_MAX);
+	WINPR_ASSERT((r + 1) * 16 <= UINT16_MAX);
+	WINPR_ASSERT((b + 1) * 16 <= UINT16_MAX);
+	rect->left = (UINT16)l * 16;
+	rect->top = (UINT16)t * 16;
+	rect->right = (UINT16)(r + 1) * 16;
+	rect->bottom = (UINT16)(b + 1) * 16;
+
+	WINPR_ASSERT(nWidth <= UINT16_MAX);
+	if (rect->right > nWidth)
+		rect->right = (UINT16)nWidth;
+
+	WINPR_ASSERT(nHeight <= UINT16_MAX);
+	if (rect->bottom > nHeight)
+		rect->bottom = (UINT16)nHeight;
+
+	return 1;
+}
+
+/* Frames with fewer tile rows are compared on the calling thread */
+#define SHADOW_CAPTURE_COMPARE_MIN_PARALLEL_ROWS 64
+#define SHADOW_CAPTURE_COMPARE_MAX_JOBS 16
+
+typedef struct
+{
+	const BYTE* pData1;
+	UINT32 nStep1;
+	const BYTE* pData2;
+	UINT32 nStep2;
+	UINT32 nWidth;
+	UINT32 nHeight;
+	BYTE* tiles;
+	UINT32 tilesStep;
+	pstatus_t status;
+} SHADOW_CAPTURE_COMPARE_JOB;
+
+static void shadow_capture_compare_job_run(SHADOW_CAPTURE_COMPARE_JOB* job)
+{
+	const primitives_t* prims = primitives_get();
+
+	WINPR_ASSERT(job);
+	WINPR_ASSERT(prims);
+
+	job->status = prims->compare_tiles_32u(job->pData1, job->nStep1, job->pData2, job->nStep2,
+	                                       job->nWidth, job->nHeight, job->tiles, job->tilesStep);
+}
+
+static void CALLBACK shadow_capture_compare_work_callback(PTP_CALLBACK_INSTANCE instance,
+                                                          void* context, PTP_WORK work)
+{
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+	shadow_capture_compare_job_run((SHADOW_CAPTURE_COMPARE_JOB*)context);
+}
+
+WINPR_ATTR_NODISCARD
+static size_t shadow_capture_compare_job_count(UINT32 nrow)
+{
+	SYSTEM_INFO sysInfos = WINPR_C_ARRAY_INIT;
+
+	if (nrow < SHADOW_CAPTURE_COMPARE_MIN_PARALLEL_ROWS)
+		return 1;
+
+	GetNativeSystemInfo(&sysInfos);
+
+	/* Keep at least 16 tile rows per job to amortize the dispatch */
+	size_t jobs = MIN(sysInfos.dwNumberOfProcessors, SHADOW_CAPTURE_COMPARE_MAX_JOBS);
+	jobs = MIN(jobs, nrow / 16);
+	return (jobs > 0) ? jobs : 1;
+}
+
+/**
+ * Fills \b tiles with the dirty state of every 16x16 tile of two 32bpp frames in the same
+ * format. Large frames are split in bands of tile rows processed on the thread pool.
+ */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_capture_compare_tiles(const BYTE* WINPR_RESTRICT pData1, UINT32 nStep1,
+                                         UINT32 nWidth, UINT32 nHeight,
+                                         const BYTE* WINPR_RESTRICT pData2, UINT32 nStep2,
+                                         BYTE* WINPR_RESTRICT tiles, UINT32 ncol, UINT32 nrow)
+{
+	SHADOW_CAPTURE_COMPARE_JOB jobs[SHADOW_CAPTURE_COMPARE_MAX_JOBS] = WINPR_C_ARRAY_INIT;
+	PTP_WORK work[SHADOW_CAPTURE_COMPARE_MAX_JOBS] = WINPR_C_ARRAY_INIT;
+	const size_t count = shadow_capture_compare_job_count(nrow);
+	const size_t rowsPerJob = (nrow + count - 1) / count;
+	BOOL rc = TRUE;
+
+	for (size_t x = 0; x < count; x++)
+	{
+		SHADOW_CAPTURE_COMPARE_JOB* job = &jobs[x];
+		const size_t first = x * rowsPerJob;
+		const size_t y = first * 16;
+
+		if (first >= nrow)
+			break;
+
+		job->pData1 = &pData1[y * nStep1];
+		job->nStep1 = nStep1;
+		job->pData2 = &pData2[y * nStep2];
+		job->nStep2 = nStep2;
+		job->nWidth = nWidth;
+		job->nHeight = (UINT32)MIN(rowsPerJob * 16, nHeight - y);
+		job->tiles = &tiles[first * ncol];
+		job->tilesStep = ncol;
+
+		/* The last band is done on this thread while the others run on the pool */
+		if (x + 1 < count)
+			work[x] = CreateThreadpoolWork(shadow_capture_compare_work_callback, job, nullptr);
+
+		if (work[x])
+			SubmitThreadpoolWork(work[x]);
+		else
+			shadow_capture_compare_job_run(job);
+	}
+
+	for (size_t x = 0; x < count; x++)
+	{
+		if (work[x])
+		{
+			WaitForThreadpoolWorkCallbacks(work[x], FALSE);
+			CloseThreadpoolWork(work[x]);
+		}
+
+		if (jobs[x].tiles && (jobs[x].status != PRIMITIVES_SUCCESS))
+			rc = FALSE;
+	}
+
+	return rc;
+}
+
+WINPR_ATTR_NODISCARD
+static int shadow_capture_compare_32bpp(const BYTE* WINPR_RESTRICT pData1, UINT32 nStep1,
+                                        UINT32 nWidth, UINT32 nHeight,
+                                        const BYTE* WINPR_RESTRICT pData2, UINT32 nStep2,
+                                        RECTANGLE_16* WINPR_RESTRICT rect)
+{
+	int rc = -1;
+	const UINT32 nrow = (nHeight + 15) / 16;
+	const UINT32 ncol = (nWidth + 15) / 16;
+	UINT32 l = ncol + 1;
+	UINT32 t = nrow + 1;
+	UINT32 r = 0;
+	UINT32 b = 0;
+
+	WINPR_ASSERT(rect);
+
+	if ((nrow == 0) || (ncol == 0))
+		return 0;
+
+	BYTE* tiles = calloc(nrow, ncol);
+	if (!tiles)
+		return -1;
+
+	if (!shadow_capture_compare_tiles(pData1, nStep1, nWidth, nHeight, pData2, nStep2, tiles,
+	                                  ncol, nrow))
+		goto fail;
+
+	for (UINT32 ty = 0; ty < nrow; ty++)
+	{
+		const BYTE* row = &tiles[1ull * ty * ncol];
+		BOOL rowEqual = TRUE;
+
+		for (UINT32 tx = 0; tx < ncol; tx++)
+		{
+			if (!row[tx])
+				continue;
+
+			rowEqual = FALSE;
+			l = MIN(l, tx);
+			r = MAX(r, tx);
+		}
+
+		if (!rowEqual)
+		{
+			t = MIN(t, ty);
+			b = MAX(b, ty);
+		}
+	}
+
+	rc = shadow_capture_tiles_to_rect(l, t, r, b, nWidth, nHeight, rect);
+
+fail:
+	free(tiles);
+	return rc;
+}
+
 int shadow_capture_compare_with_format(const BYTE* WINPR_RESTRICT pData1, UINT32 format1,
                                        UINT32 nStep1, UINT32 nWidth, UINT32 nHeight,
                                        const BYTE* WINPR_RESTRICT pData2, UINT32 format2,
                                        UINT32 nStep2, RECTANGLE_16* WINPR_RESTRICT rect)
 {
 	pixel_equal_fn_t pixel_equal_fn = get_comparison_fn(format1, format2);
-	BOOL allEqual = TRUE;
 	UINT32 tw = 0;
 	const UINT32 nrow = (nHeight + 15) / 16;
 	const UINT32 ncol = (nWidth + 15) / 16;
@@ -239,6 +437,14 @@ int shadow_capture_compare_with_format(const BYTE* WINPR_RESTRICT pData1, UINT32
 
 	*rect = empty;
 
+	if ((format1 == format2) && (bppA == 4))
+	{
+		const int rc =
+		    shadow_capture_compare_32bpp(pData1, nStep1, nWidth, nHeight, pData2, nStep2, rect);
+		if (rc >= 0)
+			return rc;
+	}
+
 	for (size_t ty = 0; ty < nrow; ty++)
 	{
 		BOOL rowEqual = TRUE;
@@ -283,8 +489,6 @@ int shadow_capture_compare_with_format(const BYTE* WINPR_RESTRICT pData1, UINT32
 
 		if (!rowEqual)
 		{
-			allEqual = FALSE;
-
 			if (t > ty)
 				t = (UINT32)ty;
 
@@ -293,27 +497,7 @@ int shadow_capture_compare_with_format(const BYTE* WINPR_RESTRICT pData1, UINT32
 		}
 	}
 
-	if (allEqual)
-		return 0;
-
-	WINPR_ASSERT(l * 16 <= UINT16_MAX);
-	WINPR_ASSERT(t * 16 <= UINT16_MAX);
-	WINPR_ASSERT((r + 1) * 16 <= UINT16_MAX);
-	WINPR_ASSERT((b + 1) * 16 <= UINT16_MAX);
-	rect->left = (UINT16)l * 16;
-	rect->top = (UINT16)t * 16;
-	rect->right = (UINT16)(r + 1) * 16;
-	rect->bottom = (UINT16)(b + 1) * 16;
-
-	WINPR_ASSERT(nWidth <= UINT16_MAX);
-	if (rect->right > nWidth)
-		rect->right = (UINT16)nWidth;
-
-	WINPR_ASSERT(nHeight <= UINT16_MAX);
-	if (rect->bottom > nHeight)
-		rect->bottom = (UINT16)nHeight;
-
-	return 1;
+	return shadow_capture_tiles_to_rect(l, t, r, b, nWidth, nHeight, rect);
 }
 
 rdpShadowCapture* shadow_capture_new(rdpShadowServer* server)
@@ -38,6 +38,9 @@
 
 #define TAG CLIENT_TAG("shadow")
 
+/* Tile data of one progressive refinement message */
+#define SHADOW_PROGRESSIVE_UPGRADE_SIZE (64 * 1024)
+
 typedef struct
 {
 	BOOL gfxOpened;
@@ -242,6 +245,7 @@ static void shadow_client_context_free(freerdp_peer* peer, rdpContext* context)
 		ArrayList_Remove(server->clients, (void*)client);
 
 	shadow_encoder_free(client->encoder);
+	shadow_tile_cache_free(client->tileCache);
 
 	/* Clear queued messages and free resource */
 	MessageQueue_Free(client->MsgQueue);
@@ -251,6 +255,7 @@ static void shadow_client_context_free(freerdp_peer* peer, rdpContext* context)
 
 	client->MsgQueue = nullptr;
 	client->encoder = nullptr;
+	client->tileCache = nullptr;
 	client->vcm = nullptr;
 }
 
@@ -317,6 +322,8 @@ static BOOL shadow_client_context_new(freerdp_peer* peer, rdpContext* context)
 		return FALSE;
 	if (!freerdp_settings_set_uint32(settings, FreeRDP_CompressionLevel, PACKET_COMPR_TYPE_RDP8))
 		return FALSE;
+	if (!freerdp_settings_set_bool(settings, FreeRDP_CompressionAdaptive, TRUE))
+		return FALSE;
 
 	if (server->ipcSocket && (strncmp(bind_address, server->ipcSocket,
 	                                  strnlen(bind_address, sizeof(bind_address))) != 0))
@@ -346,6 +353,9 @@ static BOOL shadow_client_context_new(freerdp_peer* peer, rdpContext* context)
 	if (!(client->encoder = shadow_encoder_new(client)))
 		goto fail;
 
+	if (!(client->tileCache = shadow_tile_cache_new()))
+		goto fail;
+
 	if (!ArrayList_Append(server->clients, (void*)client))
 		goto fail;
 
@@ -825,12 +835,19 @@ static inline void shadow_client_common_frame_acknowledge(rdpShadowClient* clien
 	WINPR_ASSERT(client);
 	WINPR_ASSERT(client->encoder);
 	client->encoder->lastAckframeId = frameId;
+
+	if (client->encoder->rate)
+		shadow_rate_control_frame_acked(client->encoder->rate, frameId, GetTickCount64());
 }
 
 WINPR_ATTR_NODISCARD
 static BOOL shadow_client_surface_frame_acknowledge(rdpContext* context, UINT32 frameId)
 {
 	rdpShadowClient* client = (rdpShadowClient*)context;
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->encoder);
+	if (client->encoder->rate)
+		shadow_rate_control_set_acknowledge(client->encoder->rate, TRUE);
 	shadow_client_common_frame_acknowledge(client, frameId);
 	/*
 	 * Reset queueDepth for legacy none RDPGFX acknowledge
@@ -852,14 +869,61 @@ shadow_client_rdpgfx_frame_acknowledge(RdpgfxServerContext* context,
 	WINPR_ASSERT(frameAcknowledge);
 
 	client = (rdpShadowClient*)context->custom;
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->encoder);
+	if (client->encoder->rate)
+		shadow_rate_control_set_acknowledge(
+		    client->encoder->rate,
+		    frameAcknowledge->queueDepth != SUSPEND_FRAME_ACKNOWLEDGEMENT);
 	shadow_client_common_frame_acknowledge(client, frameAcknowledge->frameId);
 
+	client->encoder->queueDepth = frameAcknowledge->queueDepth;
+	return CHANNEL_RC_OK;
+}
+
+WINPR_ATTR_NODISCARD
+static UINT shadow_client_rdpgfx_qoe_frame_acknowledge(
+    RdpgfxServerContext* context, const RDPGFX_QOE_FRAME_ACKNOWLEDGE_PDU* qoeFrameAcknowledge)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(qoeFrameAcknowledge);
+
+	rdpShadowClient* client = (rdpShadowClient*)context->custom;
 	WINPR_ASSERT(client);
 	WINPR_ASSERT(client->encoder);
-	client->encoder->queueDepth = frameAcknowledge->queueDepth;
+
+	/* Decode and render time of the frame on the client */
+	if (client->encoder->rate)
+		shadow_rate_control_client_time(client->encoder->rate,
+		                                1u * qoeFrameAcknowledge->timeDiffSE +
+		                                    qoeFrameAcknowledge->timeDiffEDR,
+		                                GetTickCount64());
 	return CHANNEL_RC_OK;
 }
 
+WINPR_ATTR_NODISCARD
+static UINT
+shadow_client_rdpgfx_cache_import_offer(RdpgfxServerContext* context,
+                                        const RDPGFX_CACHE_IMPORT_OFFER_PDU* cacheImportOffer)
+{
+	WINPR_ASSERT(context);
+	WINPR_ASSERT(cacheImportOffer);
+
+	rdpShadowClient* client = (rdpShadowClient*)context->custom;
+	WINPR_ASSERT(client);
+
+	RDPGFX_CACHE_IMPORT_REPLY_PDU* reply = calloc(1, sizeof(RDPGFX_CACHE_IMPORT_REPLY_PDU));
+	if (!reply)
+		return CHANNEL_RC_NO_MEMORY;
+
+	UINT rc = ERROR_INVALID_DATA;
+	if (shadow_tile_cache_import(client->tileCache, cacheImportOffer, reply))
+		rc = IFCALLRESULT(CHANNEL_RC_OK, context->CacheImportReply, context, reply);
+
+	free(reply);
+	return rc;
+}
+
 WINPR_ATTR_NODISCARD
 static BOOL shadow_are_caps_filtered(const rdpSettings* settings, UINT32 caps)
 {
@@ -911,6 +975,11 @@ static UINT shadow_client_send_caps_confirm(RdpgfxServerContext* context, rdpSha
 	client->areGfxCapsReady = (rc == CHANNEL_RC_OK);
 	client->confirmedCaps = *pdu->capsSet;
 
+	/* The client cache is empty after the capabilities exchange, except for imported entries */
+	if (!shadow_tile_cache_reset(client->tileCache,
+	                             (pdu->capsSet->flags & RDPGFX_CAPS_FLAG_SMALL_CACHE) != 0))
+		return CHANNEL_RC_NO_MEMORY;
+
 	rdpSettings* clientSettings = client->context.settings;
 	WINPR_ASSERT(clientSettings);
 
@@ -1235,6 +1304,47 @@ static inline UINT32 rdpgfx_estimate_h264_avc420(RDPGFX_AVC420_BITMAP_STREAM* ha
 	       havc420->length;
 }
 
+WINPR_ATTR_NODISCARD
+static UINT shadow_client_surface_frame_command(rdpShadowClient* client,
+                                                const RDPGFX_SURFACE_COMMAND* cmd,
+                                                const RDPGFX_START_FRAME_PDU* cmdstart,
+                                                const RDPGFX_END_FRAME_PDU* cmdend)
+{
+	UINT error = CHANNEL_RC_OK;
+
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->encoder);
+	WINPR_ASSERT(cmd);
+
+	if (client->encoder->rate)
+	{
+		size_t length = cmd->length;
+		switch (cmd->codecId)
+		{
+			case RDPGFX_CODECID_AVC420:
+#if defined(WITH_GFX_AV1)
+			case RDPGFX_CODECID_AV1:
+#endif
+				length = rdpgfx_estimate_h264_avc420((RDPGFX_AVC420_BITMAP_STREAM*)cmd->extra);
+				break;
+			case RDPGFX_CODECID_AVC444:
+			case RDPGFX_CODECID_AVC444v2:
+			{
+				RDPGFX_AVC444_BITMAP_STREAM* avc444 = (RDPGFX_AVC444_BITMAP_STREAM*)cmd->extra;
+				length = 4ull + avc444->cbAvc420EncodedBitstream1 +
+				         rdpgfx_estimate_h264_avc420(&avc444->bitstream[1]);
+			}
+			break;
+			default:
+				break;
+		}
+		shadow_rate_control_add_bytes(client->encoder->rate, length);
+	}
+
+	IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart, cmdend);
+	return error;
+}
+
 #if defined(WITH_GFX_AV1)
 WINPR_ATTR_NODISCARD
 static BOOL shadow_client_send_av1(rdpShadowClient* client, const BYTE* pSrcData, UINT32 nSrcStep,
@@ -1285,8 +1395,7 @@ static BOOL shadow_client_send_av1(rdpShadowClient* client, const BYTE* pSrcData
 		cmd->codecId = RDPGFX_CODECID_AV1;
 		cmd->extra = (void*)&avc420;
 
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_surface_frame_command(client, cmd, cmdstart, cmdend);
 		cmd->extra = nullptr;
 	}
 	free_h264_metablock(&avc420.meta);
@@ -1349,8 +1458,7 @@ static BOOL shadow_client_send_avc444(rdpShadowClient* client, const BYTE* pSrcD
 	{
 		avc444.cbAvc420EncodedBitstream1 = rdpgfx_estimate_h264_avc420(&avc444.bitstream[0]);
 		cmd->extra = (void*)&avc444;
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_surface_frame_command(client, cmd, cmdstart, cmdend);
 		cmd->extra = nullptr;
 	}
 
@@ -1408,8 +1516,7 @@ static BOOL shadow_client_send_avc420(rdpShadowClient* client, const BYTE* pSrcD
 	{
 		cmd->codecId = RDPGFX_CODECID_AVC420;
 		cmd->extra = (void*)&avc420;
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_surface_frame_command(client, cmd, cmdstart, cmdend);
 		cmd->extra = nullptr;
 	}
 	free_h264_metablock(&avc420.meta);
@@ -1464,7 +1571,13 @@ static BOOL shadow_client_send_rfx(rdpShadowClient* client, const BYTE* pSrcData
 	rect.width = WINPR_ASSERTING_INT_CAST(UINT16, cmd->right - cmd->left);
 	rect.height = WINPR_ASSERTING_INT_CAST(UINT16, cmd->bottom - cmd->top);
 
-	rc = rfx_compose_message(encoder->rfx, s, &rect, 1, pSrcData, nWidth, nHeight, nSrcStep);
+	/* Viewers with identical settings share the encoded tiles of a frame */
+	rdpShadowEncodeCache* cache = client->server->encodeCache;
+	if (cache)
+		rc = shadow_encode_cache_write_rfx(cache, encoder->rfx, s, &rect, pSrcData, nWidth, nHeight,
+		                                   nSrcStep);
+	else
+		rc = rfx_compose_message(encoder->rfx, s, &rect, 1, pSrcData, nWidth, nHeight, nSrcStep);
 
 	if (!rc)
 	{
@@ -1483,8 +1596,7 @@ static BOOL shadow_client_send_rfx(rdpShadowClient* client, const BYTE* pSrcData
 		cmd->data = Stream_Buffer(s);
 		cmd->length = (UINT32)pos;
 
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_surface_frame_command(client, cmd, cmdstart, cmdend);
 		cmd->data = nullptr;
 	}
 
@@ -1497,6 +1609,13 @@ static BOOL shadow_client_send_rfx(rdpShadowClient* client, const BYTE* pSrcData
 	return TRUE;
 }
 
+/* Refinements wait for a frame interval without screen updates */
+static UINT32 shadow_client_progressive_interval(const rdpShadowEncoder* encoder)
+{
+	WINPR_ASSERT(encoder);
+	return 1000 / MAX(encoder->fps, 1);
+}
+
 WINPR_ATTR_NODISCARD
 static BOOL shadow_client_send_progressive(rdpShadowClient* client, const BYTE* pSrcData,
                                            UINT32 nSrcStep, UINT32 SrcFormat, UINT16 nWidth,
@@ -1548,8 +1667,14 @@ static BOOL shadow_client_send_progressive(rdpShadowClient* client, const BYTE*
 	{
 		cmd->codecId = RDPGFX_CODECID_CAPROGRESSIVE;
 
-		IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart,
-		          cmdend);
+		error = shadow_client_surface_frame_command(client, cmd, cmdstart, cmdend);
+
+		if (client->server->GfxProgressivePasses > 1)
+		{
+			encoder->progressiveUpgrade = TRUE;
+			encoder->progressiveUpgradeTime =
+			    GetTickCount64() + shadow_client_progressive_interval(encoder);
+		}
 	}
 	cmd->data = nullptr;
 
@@ -1584,19 +1709,31 @@ static BOOL shadow_client_send_planar(rdpShadowClient* client, const BYTE* pSrcD
 		return FALSE;
 	}
 
-	const BOOL rc = freerdp_bitmap_planar_context_reset(encoder->planar, w, h);
-	if (!rc)
-		return FALSE;
+	rdpShadowEncodeCache* cache = client->server->encodeCache;
+	if (cache)
+	{
+		cmd->data =
+		    shadow_encode_cache_compress_planar(cache, encoder->planar, encoder->planarFlags, src,
+		                                        SrcFormat, w, h, nSrcStep, &cmd->length);
+		if (!cmd->data)
+			return FALSE;
+	}
+	else
+	{
+		const BOOL rc = freerdp_bitmap_planar_context_reset(encoder->planar, w, h);
+		if (!rc)
+			return FALSE;
 
-	freerdp_planar_topdown_image(encoder->planar, TRUE);
+		freerdp_planar_topdown_image(encoder->planar, TRUE);
 
-	cmd->data = freerdp_bitmap_compress_planar(encoder->planar, src, SrcFormat, w, h, nSrcStep,
-	                                           nullptr, &cmd->length);
+		cmd->data = freerdp_bitmap_compress_planar(encoder->planar, src, SrcFormat, w, h,
+		                                           nSrcStep, nullptr, &cmd->length);
+	}
 	WINPR_ASSERT(cmd->data || (cmd->length == 0));
 
 	cmd->codecId = RDPGFX_CODECID_PLANAR;
 
-	IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart, cmdend);
+	error = shadow_client_surface_frame_command(client, cmd, cmdstart, cmdend);
 	free(cmd->data);
 	cmd->data = nullptr;
 
@@ -1608,6 +1745,59 @@ static BOOL shadow_client_send_planar(rdpShadowClient* client, const BYTE* pSrcD
 	return TRUE;
 }
 
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_send_clear(rdpShadowClient* client, const BYTE* pSrcData,
+                                     UINT32 nSrcStep, UINT32 SrcFormat,
+                                     RDPGFX_SURFACE_COMMAND* cmd,
+                                     const RDPGFX_START_FRAME_PDU* cmdstart,
+                                     const RDPGFX_END_FRAME_PDU* cmdend)
+{
+	WINPR_ASSERT(client);
+
+	rdpShadowEncoder* encoder = client->encoder;
+	WINPR_ASSERT(encoder);
+
+	UINT error = CHANNEL_RC_OK;
+	const UINT32 w = cmd->right - cmd->left;
+	const UINT32 h = cmd->bottom - cmd->top;
+	const BYTE* src =
+	    &pSrcData[cmd->top * nSrcStep + cmd->left * FreeRDPGetBytesPerPixel(SrcFormat)];
+	if (shadow_encoder_prepare(encoder, FREERDP_CODEC_CLEARCODEC) < 0)
+	{
+		WLog_ERR(TAG, "Failed to prepare encoder FREERDP_CODEC_CLEARCODEC");
+		return FALSE;
+	}
+
+	wStream* s = Stream_New(nullptr, 1024);
+	if (!s)
+		return FALSE;
+
+	if (!clear_compose_message(encoder->clear, s, src, SrcFormat, nSrcStep, w, h))
+	{
+		WLog_ERR(TAG, "clear_compose_message failed");
+		Stream_Free(s, TRUE);
+		return FALSE;
+	}
+
+	const size_t pos = Stream_GetPosition(s);
+	WINPR_ASSERT(pos <= UINT32_MAX);
+
+	cmd->codecId = RDPGFX_CODECID_CLEARCODEC;
+	cmd->data = Stream_Buffer(s);
+	cmd->length = (UINT32)pos;
+
+	error = shadow_client_surface_frame_command(client, cmd, cmdstart, cmdend);
+	cmd->data = nullptr;
+	Stream_Free(s, TRUE);
+
+	if (error)
+	{
+		WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
+		return FALSE;
+	}
+	return TRUE;
+}
+
 WINPR_ATTR_NODISCARD
 static BOOL shadow_client_send_uncompressed(rdpShadowClient* client, const BYTE* pSrcData,
                                             UINT32 nSrcStep, UINT32 SrcFormat,
@@ -1638,7 +1828,7 @@ static BOOL shadow_client_send_uncompressed(rdpShadowClient* client, const BYTE*
 	cmd->length = length;
 	cmd->codecId = RDPGFX_CODECID_UNCOMPRESSED;
 
-	IFCALLRET(client->rdpgfx->SurfaceFrameCommand, error, client->rdpgfx, cmd, cmdstart, cmdend);
+	error = shadow_client_surface_frame_command(client, cmd, cmdstart, cmdend);
 	free(data);
 	cmd->data = nullptr;
 	if (error)
@@ -1685,6 +1875,286 @@ static BOOL shadow_avc420_enabled(const rdpShadowClient* client)
 	return (client->confirmedCaps.flags & RDPGFX_CAPS_FLAG_AVC420_ENABLED) != 0;
 }
 
+/**
+ * Function description
+ * Sends the area \b cmd of the surface with the codec \b cmd->codecId
+ *
+ * @return TRUE on success
+ */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_send_surface_command(rdpShadowClient* client, const BYTE* pSrcData,
+                                               UINT32 nSrcStep, UINT32 SrcFormat, UINT16 nWidth,
+                                               UINT16 nHeight, RDPGFX_SURFACE_COMMAND* cmd,
+                                               const RDPGFX_START_FRAME_PDU* cmdstart,
+                                               const RDPGFX_END_FRAME_PDU* cmdend)
+{
+	WINPR_ASSERT(cmd);
+
+	switch (cmd->codecId)
+	{
+		case RDPGFX_CODECID_CAVIDEO:
+			return shadow_client_send_rfx(client, pSrcData, nSrcStep, SrcFormat, nWidth, nHeight,
+			                              cmd, cmdstart, cmdend);
+		case RDPGFX_CODECID_CLEARCODEC:
+			return shadow_client_send_clear(client, pSrcData, nSrcStep, SrcFormat, cmd, cmdstart,
+			                                cmdend);
+		case RDPGFX_CODECID_PLANAR:
+			return shadow_client_send_planar(client, pSrcData, nSrcStep, SrcFormat, cmd, cmdstart,
+			                                 cmdend);
+		case RDPGFX_CODECID_UNCOMPRESSED:
+			return shadow_client_send_uncompressed(client, pSrcData, nSrcStep, SrcFormat, cmd,
+			                                       cmdstart, cmdend);
+		default:
+			WLog_ERR(TAG, "unsupported codec %s", rdpgfx_get_codec_id_string(cmd->codecId));
+			return FALSE;
+	}
+}
+
+static inline BOOL shadow_tile_needs_encode(const SHADOW_TILE* tile)
+{
+	WINPR_ASSERT(tile);
+	return (tile->state == SHADOW_TILE_STORE) || (tile->state == SHADOW_TILE_ENCODE);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_cache_to_surface(rdpShadowClient* client, const SHADOW_TILE* tile)
+{
+	UINT error = CHANNEL_RC_OK;
+	RDPGFX_POINT16 point = WINPR_C_ARRAY_INIT;
+	RDPGFX_CACHE_TO_SURFACE_PDU pdu = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(tile);
+
+	point.x = tile->rect.left;
+	point.y = tile->rect.top;
+	pdu.cacheSlot = tile->slot;
+	pdu.surfaceId = client->surfaceId;
+	pdu.destPtsCount = 1;
+	pdu.destPts = &point;
+	IFCALLRET(client->rdpgfx->CacheToSurface, error, client->rdpgfx, &pdu);
+
+	if (error)
+	{
+		WLog_ERR(TAG, "CacheToSurface failed with error %" PRIu32 "", error);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_surface_to_surface(rdpShadowClient* client, const SHADOW_MOTION* motion)
+{
+	UINT error = CHANNEL_RC_OK;
+	RDPGFX_POINT16 point = WINPR_C_ARRAY_INIT;
+	RDPGFX_SURFACE_TO_SURFACE_PDU pdu = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(motion);
+
+	point.x = motion->x;
+	point.y = motion->y;
+	pdu.surfaceIdSrc = client->surfaceId;
+	pdu.surfaceIdDest = client->surfaceId;
+	pdu.rectSrc = motion->rectSrc;
+	pdu.destPtsCount = 1;
+	pdu.destPts = &point;
+	IFCALLRET(client->rdpgfx->SurfaceToSurface, error, client->rdpgfx, &pdu);
+
+	if (error)
+	{
+		WLog_ERR(TAG, "SurfaceToSurface failed with error %" PRIu32 "", error);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_surface_to_cache(rdpShadowClient* client, const SHADOW_TILE* tile)
+{
+	UINT error = CHANNEL_RC_OK;
+	RDPGFX_SURFACE_TO_CACHE_PDU pdu = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(tile);
+
+	pdu.surfaceId = client->surfaceId;
+	pdu.cacheKey = tile->key;
+	pdu.cacheSlot = tile->slot;
+	pdu.rectSrc = tile->rect;
+	IFCALLRET(client->rdpgfx->SurfaceToCache, error, client->rdpgfx, &pdu);
+
+	if (error)
+	{
+		WLog_ERR(TAG, "SurfaceToCache failed with error %" PRIu32 "", error);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Function description
+ * Sends a frame tile by tile. Moved areas are copied with SurfaceToSurface, unchanged tiles are
+ * skipped, tiles already in the client cache are drawn with CacheToSurface and new tiles are
+ * encoded and stored in the cache afterwards.
+ *
+ * The hash of a tile is used as cache key, persistent cache entries offered by the client match
+ * tiles of earlier sessions.
+ *
+ * @return TRUE on success
+ */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_send_surface_tiles(rdpShadowClient* client, const BYTE* pSrcData,
+                                             UINT32 nSrcStep, UINT32 SrcFormat, UINT16 nWidth,
+                                             UINT16 nHeight, RDPGFX_SURFACE_COMMAND* cmd,
+                                             const RDPGFX_START_FRAME_PDU* cmdstart,
+                                             const RDPGFX_END_FRAME_PDU* cmdend)
+{
+	BOOL rc = FALSE;
+	UINT error = CHANNEL_RC_OK;
+
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(cmd);
+
+	RdpgfxServerContext* context = client->rdpgfx;
+	WINPR_ASSERT(context);
+
+	const UINT32 columns = (nWidth + SHADOW_TILE_SIZE - 1) / SHADOW_TILE_SIZE;
+	const UINT32 rows = (nHeight + SHADOW_TILE_SIZE - 1) / SHADOW_TILE_SIZE;
+	SHADOW_TILE* tiles = calloc(1ull * columns * rows, sizeof(SHADOW_TILE));
+	if (!tiles)
+		return FALSE;
+
+	/* Tiles encoded at reduced quality are sent again on recovery, do not cache them */
+	const UINT32 maxStores =
+	    (client->encoder->target.quality > 0) ? 0 : SHADOW_TILE_CACHE_MAX_STORES;
+	shadow_tile_cache_begin_frame(client->tileCache, maxStores);
+
+	IFCALLRET(context->StartFrame, error, context, cmdstart);
+	if (error)
+	{
+		WLog_ERR(TAG, "StartFrame failed with error %" PRIu32 "", error);
+		goto fail;
+	}
+
+	/* The tiles are hashed once per frame for all clients */
+	rdpShadowTileFrame* frame = client->server->tileFrame;
+	if (!shadow_tile_frame_begin(frame, pSrcData, nSrcStep, SrcFormat, nWidth, nHeight))
+		goto fail;
+
+	/* Scrolled or moved areas are copied on the client, only the exposed parts are encoded */
+	BOOL moved = FALSE;
+	SHADOW_MOTION motion = WINPR_C_ARRAY_INIT;
+	if (shadow_tile_cache_get_previous(client->tileCache, frame))
+	{
+		moved = shadow_tile_frame_get_motion(frame, &motion) &&
+		        shadow_tile_cache_move(client->tileCache, frame, &motion.rectSrc, motion.x,
+		                               motion.y);
+	}
+
+	for (UINT32 y = 0; y < rows; y++)
+	{
+		for (UINT32 x = 0; x < columns; x++)
+		{
+			SHADOW_TILE* tile = &tiles[y * columns + x];
+			tile->rect.left = WINPR_ASSERTING_INT_CAST(UINT16, x * SHADOW_TILE_SIZE);
+			tile->rect.top = WINPR_ASSERTING_INT_CAST(UINT16, y * SHADOW_TILE_SIZE);
+			tile->rect.right = WINPR_ASSERTING_INT_CAST(
+			    UINT16, MIN(nWidth, tile->rect.left + SHADOW_TILE_SIZE));
+			tile->rect.bottom = WINPR_ASSERTING_INT_CAST(
+			    UINT16, MIN(nHeight, tile->rect.top + SHADOW_TILE_SIZE));
+
+			shadow_tile_cache_check(client->tileCache, frame, tile);
+		}
+	}
+
+	shadow_tile_frame_end(frame);
+
+	if (moved && !shadow_client_surface_to_surface(client, &motion))
+		goto fail;
+
+	/* Tiles cached in earlier frames are drawn first, their slots may be reused below */
+	for (size_t x = 0; x < 1ull * columns * rows; x++)
+	{
+		if (tiles[x].state == SHADOW_TILE_CACHED)
+		{
+			if (!shadow_client_cache_to_surface(client, &tiles[x]))
+				goto fail;
+		}
+	}
+
+	/* Horizontal runs of changed tiles are encoded as one surface command */
+	for (UINT32 y = 0; y < rows; y++)
+	{
+		const SHADOW_TILE* row = &tiles[y * columns];
+
+		for (UINT32 x = 0; x < columns;)
+		{
+			if (!shadow_tile_needs_encode(&row[x]))
+			{
+				x++;
+				continue;
+			}
+
+			const UINT32 first = x;
+			while ((x < columns) && shadow_tile_needs_encode(&row[x]))
+				x++;
+
+			cmd->left = row[first].rect.left;
+			cmd->top = row[first].rect.top;
+			cmd->right = row[x - 1].rect.right;
+			cmd->bottom = row[x - 1].rect.bottom;
+			cmd->width = cmd->right - cmd->left;
+			cmd->height = cmd->bottom - cmd->top;
+
+			if (!shadow_client_send_surface_command(client, pSrcData, nSrcStep, SrcFormat, nWidth,
+			                                        nHeight, cmd, nullptr, nullptr))
+				goto fail;
+		}
+	}
+
+	/* New tiles are on the client surface now, store them and draw the duplicates */
+	for (size_t x = 0; x < 1ull * columns * rows; x++)
+	{
+		if (tiles[x].state == SHADOW_TILE_STORE)
+		{
+			if (!shadow_client_surface_to_cache(client, &tiles[x]))
+				goto fail;
+		}
+	}
+
+	for (size_t x = 0; x < 1ull * columns * rows; x++)
+	{
+		if (tiles[x].state == SHADOW_TILE_PENDING)
+		{
+			if (!shadow_client_cache_to_surface(client, &tiles[x]))
+				goto fail;
+		}
+	}
+
+	IFCALLRET(context->EndFrame, error, context, cmdend);
+	if (error)
+	{
+		WLog_ERR(TAG, "EndFrame failed with error %" PRIu32 "", error);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	free(tiles);
+	return rc;
+}
+
+/* The StartFrame timestamp, the UTC time of day in the RDPGFX bit layout */
+static UINT32 shadow_client_frame_timestamp(void)
+{
+	SYSTEMTIME sTime = WINPR_C_ARRAY_INIT;
+
+	GetSystemTime(&sTime);
+	return (UINT32)(sTime.wHour << 22U | sTime.wMinute << 16U | sTime.wSecond << 10U |
+	                sTime.wMilliseconds);
+}
+
 /**
  * Function description
  *
@@ -1699,7 +2169,6 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE*
 	RDPGFX_SURFACE_COMMAND cmd = WINPR_C_ARRAY_INIT;
 	RDPGFX_START_FRAME_PDU cmdstart = WINPR_C_ARRAY_INIT;
 	RDPGFX_END_FRAME_PDU cmdend = WINPR_C_ARRAY_INIT;
-	SYSTEMTIME sTime = WINPR_C_ARRAY_INIT;
 
 	if (!context || !pSrcData)
 		return FALSE;
@@ -1721,9 +2190,7 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE*
 	}
 
 	cmdstart.frameId = shadow_encoder_create_frame_id(encoder);
-	GetSystemTime(&sTime);
-	cmdstart.timestamp = (UINT32)(sTime.wHour << 22U | sTime.wMinute << 16U | sTime.wSecond << 10U |
-	                              sTime.wMilliseconds);
+	cmdstart.timestamp = shadow_client_frame_timestamp();
 	cmdend.frameId = cmdstart.frameId;
 	cmd.surfaceId = client->surfaceId;
 	cmd.format = PIXEL_FORMAT_BGRX32;
@@ -1769,24 +2236,34 @@ static BOOL shadow_client_send_surface_gfx(rdpShadowClient* client, const BYTE*
 #endif
 	    if (freerdp_settings_get_bool(settings, FreeRDP_RemoteFxCodec) && (id != 0))
 	{
-		return shadow_client_send_rfx(client, pSrcData, nSrcStep, SrcFormat, nWidth, nHeight, &cmd,
-		                              &cmdstart, &cmdend);
+		cmd.codecId = RDPGFX_CODECID_CAVIDEO;
 	}
-
-	if (freerdp_settings_get_bool(settings, FreeRDP_GfxProgressive))
+	else if (freerdp_settings_get_bool(settings, FreeRDP_GfxProgressive))
 	{
 		return shadow_client_send_progressive(client, pSrcData, nSrcStep, SrcFormat, nWidth,
 		                                      nHeight, &cmd, &cmdstart, &cmdend);
 	}
+	else if (client->server->GfxClearCodec)
+	{
+		cmd.codecId = RDPGFX_CODECID_CLEARCODEC;
+	}
+	else if (freerdp_settings_get_bool(settings, FreeRDP_GfxPlanar))
+	{
+		cmd.codecId = RDPGFX_CODECID_PLANAR;
+	}
+	else
+	{
+		cmd.codecId = RDPGFX_CODECID_UNCOMPRESSED;
+	}
 
-	if (freerdp_settings_get_bool(settings, FreeRDP_GfxPlanar))
+	if (client->server->GfxTileCache)
 	{
-		return shadow_client_send_planar(client, pSrcData, nSrcStep, SrcFormat, &cmd, &cmdstart,
-		                                 &cmdend);
+		return shadow_client_send_surface_tiles(client, pSrcData, nSrcStep, SrcFormat, nWidth,
+		                                        nHeight, &cmd, &cmdstart, &cmdend);
 	}
 
-	return shadow_client_send_uncompressed(client, pSrcData, nSrcStep, SrcFormat, &cmd, &cmdstart,
-	                                       &cmdend);
+	return shadow_client_send_surface_command(client, pSrcData, nSrcStep, SrcFormat, nWidth,
+	                                          nHeight, &cmd, &cmdstart, &cmdend);
 }
 
 WINPR_ATTR_NODISCARD
@@ -1925,6 +2402,9 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 			first = (i == 0);
 			last = ((i + 1) == numMessages);
 
+			if (encoder->rate)
+				shadow_rate_control_add_bytes(encoder->rate, cmd.bmp.bitmapDataLength);
+
 			if (!encoder->frameAck)
 				IFCALLRET(update->SurfaceBits, ret, update->context, &cmd);
 			else
@@ -1971,6 +2451,9 @@ static BOOL shadow_client_send_surface_bits(rdpShadowClient* client, BYTE* pSrcD
 		first = TRUE;
 		last = TRUE;
 
+		if (encoder->rate)
+			shadow_rate_control_add_bytes(encoder->rate, cmd.bmp.bitmapDataLength);
+
 		if (!encoder->frameAck)
 			IFCALLRET(update->SurfaceBits, ret, update->context, &cmd);
 		else
@@ -2205,6 +2688,105 @@ out:
  *
  * @return TRUE on success (or nothing need to be updated)
  */
+static void shadow_client_frame_sent(rdpShadowClient* client, UINT32 frameId)
+{
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->encoder);
+
+	rdpShadowRateControl* rate = client->encoder->rate;
+	if (!rate)
+		return;
+
+	const UINT64 now = GetTickCount64();
+	shadow_rate_control_frame_sent(rate, frameId, now);
+
+	/* The round trip of a measurement sent right behind a frame includes its queueing delay */
+	rdpContext* context = &client->context;
+	const rdpSettings* settings = context->settings;
+	rdpAutoDetect* autodetect = context->autodetect;
+	if (!autodetect || !freerdp_settings_get_bool(settings, FreeRDP_NetworkAutoDetect))
+		return;
+
+	if (shadow_rate_control_probe(rate, now))
+	{
+		const UINT16 sequenceNumber = (UINT16)(client->encoder->frameId & 0xFFFF);
+		if (!IFCALLRESULT(FALSE, autodetect->RTTMeasureRequest, autodetect, RDP_TRANSPORT_TCP,
+		                  sequenceNumber))
+			WLog_WARN(TAG, "RTTMeasureRequest failed");
+	}
+}
+
+/**
+ * Function description
+ * Refine progressive tiles sent with coarse quality once the screen is idle for a frame
+ *
+ * @return TRUE on success (or nothing need to be refined)
+ */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_send_progressive_upgrade(rdpShadowClient* client,
+                                                   const SHADOW_GFX_STATUS* pStatus)
+{
+	RDPGFX_SURFACE_COMMAND cmd = WINPR_C_ARRAY_INIT;
+	RDPGFX_START_FRAME_PDU cmdstart = WINPR_C_ARRAY_INIT;
+	RDPGFX_END_FRAME_PDU cmdend = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(pStatus);
+
+	rdpShadowEncoder* encoder = client->encoder;
+	WINPR_ASSERT(encoder);
+
+	const UINT64 now = GetTickCount64();
+	if (!encoder->progressiveUpgrade || !encoder->progressive ||
+	    (now < encoder->progressiveUpgradeTime))
+		return TRUE;
+
+	if (!client->activated || client->suppressOutput || !pStatus->gfxSurfaceCreated)
+		return TRUE;
+
+	if (encoder->rate && !shadow_rate_control_can_send(encoder->rate, now))
+		return TRUE;
+
+	const int rc = progressive_compress_upgrade(encoder->progressive,
+	                                            SHADOW_PROGRESSIVE_UPGRADE_SIZE, &cmd.data,
+	                                            &cmd.length);
+	if (rc < 0)
+	{
+		WLog_ERR(TAG, "progressive_compress_upgrade failed");
+		return FALSE;
+	}
+
+	encoder->progressiveUpgradeTime = now + shadow_client_progressive_interval(encoder);
+	if (rc == 0)
+	{
+		/* All tiles are at full quality */
+		encoder->progressiveUpgrade = FALSE;
+		return TRUE;
+	}
+
+	const rdpSettings* settings = client->context.settings;
+	cmdstart.frameId = shadow_encoder_create_frame_id(encoder);
+	cmdstart.timestamp = shadow_client_frame_timestamp();
+	cmdend.frameId = cmdstart.frameId;
+	cmd.surfaceId = client->surfaceId;
+	cmd.codecId = RDPGFX_CODECID_CAPROGRESSIVE;
+	cmd.format = PIXEL_FORMAT_BGRX32;
+	cmd.right = freerdp_settings_get_uint32(settings, FreeRDP_DesktopWidth);
+	cmd.bottom = freerdp_settings_get_uint32(settings, FreeRDP_DesktopHeight);
+	cmd.width = cmd.right;
+	cmd.height = cmd.bottom;
+
+	const UINT error = shadow_client_surface_frame_command(client, &cmd, &cmdstart, &cmdend);
+	if (error)
+	{
+		WLog_ERR(TAG, "SurfaceFrameCommand failed with error %" PRIu32 "", error);
+		return FALSE;
+	}
+
+	shadow_client_frame_sent(client, encoder->frameId);
+	return TRUE;
+}
+
 WINPR_ATTR_NODISCARD
 static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GFX_STATUS* pStatus)
 {
@@ -2328,6 +2910,10 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 				if (!(ret = shadow_client_rdpgfx_new_surface(client)))
 					goto out;
 
+				if (!(ret = shadow_tile_cache_set_surface(client->tileCache, (UINT32)nWidth,
+				                                          (UINT32)nHeight)))
+					goto out;
+
 				pStatus->gfxSurfaceCreated = TRUE;
 			}
 
@@ -2337,6 +2923,8 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 			WINPR_ASSERT(nHeight <= UINT16_MAX);
 			ret = shadow_client_send_surface_gfx(client, pSrcData, nSrcStep, SrcFormat, 0, 0,
 			                                     (UINT16)nWidth, (UINT16)nHeight);
+			if (ret)
+				shadow_client_frame_sent(client, client->encoder->frameId);
 		}
 		else
 		{
@@ -2355,6 +2943,9 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 		WINPR_ASSERT(nHeight <= UINT16_MAX);
 		ret = shadow_client_send_surface_bits(client, pSrcData, nSrcStep, (UINT16)nXSrc,
 		                                      (UINT16)nYSrc, (UINT16)nWidth, (UINT16)nHeight);
+		if (ret)
+			shadow_client_frame_sent(client,
+			                         client->encoder->frameAck ? client->encoder->frameId : 0);
 	}
 	else
 	{
@@ -2368,6 +2959,8 @@ static BOOL shadow_client_send_surface_update(rdpShadowClient* client, SHADOW_GF
 		WINPR_ASSERT(nHeight <= UINT16_MAX);
 		ret = shadow_client_send_bitmap_update(client, pSrcData, nSrcStep, (UINT16)nXSrc,
 		                                       (UINT16)nYSrc, (UINT16)nWidth, (UINT16)nHeight);
+		if (ret)
+			shadow_client_frame_sent(client, 0);
 	}
 
 out:
@@ -2415,6 +3008,9 @@ static BOOL shadow_client_send_resize(rdpShadowClient* client, SHADOW_GFX_STATUS
 		pStatus->gfxSurfaceCreated = FALSE;
 	}
 
+	/* Pending refinements belong to the released surface */
+	client->encoder->progressiveUpgrade = FALSE;
+
 	/* Send Resize */
 	if (!shadow_send_desktop_resize(client))
 		return FALSE;
@@ -2604,6 +3200,81 @@ static int shadow_client_subsystem_process_message(rdpShadowClient* client, wMes
 }
 
 WINPR_ATTR_NODISCARD
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_rtt_measure_response(rdpAutoDetect* autodetect,
+                                               WINPR_ATTR_UNUSED RDP_TRANSPORT_TYPE transport,
+                                               WINPR_ATTR_UNUSED UINT16 sequenceNumber)
+{
+	WINPR_ASSERT(autodetect);
+
+	rdpShadowClient* client = (rdpShadowClient*)autodetect->context;
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->encoder);
+
+	if (client->encoder->rate)
+		shadow_rate_control_network(client->encoder->rate, autodetect->netCharAverageRTT,
+		                            autodetect->netCharBaseRTT, 0, GetTickCount64());
+	return TRUE;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_bandwidth_measure_results(
+    rdpAutoDetect* autodetect, WINPR_ATTR_UNUSED RDP_TRANSPORT_TYPE transport,
+    WINPR_ATTR_UNUSED UINT16 sequenceNumber, WINPR_ATTR_UNUSED UINT16 responseType,
+    UINT32 timeDelta, UINT32 byteCount)
+{
+	WINPR_ASSERT(autodetect);
+
+	rdpShadowClient* client = (rdpShadowClient*)autodetect->context;
+	WINPR_ASSERT(client);
+	WINPR_ASSERT(client->encoder);
+
+	if (client->encoder->rate && (timeDelta > 0))
+	{
+		/* bytes per millisecond * 8 is kilobits per second */
+		const UINT64 bandwidth = 8ull * byteCount / timeDelta;
+		shadow_rate_control_network(client->encoder->rate, 0, 0,
+		                            (UINT32)MIN(bandwidth, UINT32_MAX), GetTickCount64());
+	}
+	return TRUE;
+}
+
+/**
+ * Applies the rate control decisions, resumes dropped frames and sends the screen again at
+ * full quality once the link recovered.
+ */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_client_update_rate(rdpShadowClient* client)
+{
+	WINPR_ASSERT(client);
+
+	rdpShadowEncoder* encoder = client->encoder;
+	WINPR_ASSERT(encoder);
+
+	if (!encoder->rate)
+		return TRUE;
+
+	BOOL refresh = shadow_rate_control_resume(encoder->rate, GetTickCount64());
+
+	BOOL refine = FALSE;
+	if (!shadow_encoder_update_rate(encoder, &refine))
+	{
+		WLog_ERR(TAG, "Failed to apply the rate control targets");
+		return FALSE;
+	}
+
+	if (refine)
+	{
+		shadow_tile_cache_invalidate(client->tileCache);
+		shadow_client_mark_invalid(client, 0, nullptr);
+		refresh = TRUE;
+	}
+
+	if (refresh && client->activated && !client->suppressOutput)
+		return shadow_client_refresh_request(client);
+	return TRUE;
+}
+
 static DWORD WINAPI shadow_client_thread(LPVOID arg)
 {
 	rdpShadowClient* client = (rdpShadowClient*)arg;
@@ -2659,6 +3330,13 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 	update->SuppressOutput = shadow_client_suppress_output;
 	update->SurfaceFrameAcknowledge = shadow_client_surface_frame_acknowledge;
 
+	rdpAutoDetect* autodetect = peer->context->autodetect;
+	if (autodetect && client->encoder->rate)
+	{
+		autodetect->RTTMeasureResponse = shadow_client_rtt_measure_response;
+		autodetect->BandwidthMeasureResults = shadow_client_bandwidth_measure_results;
+	}
+
 	if ((!client->vcm) || (!subsystem->updateEvent))
 		goto out;
 
@@ -2707,7 +3385,17 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 			events[nCount++] = gfxevent;
 #endif
 
-		status = WaitForMultipleObjects(nCount, events, FALSE, INFINITE);
+		DWORD timeout = INFINITE;
+		if (client->encoder->rate)
+			timeout = shadow_rate_control_timeout(client->encoder->rate, GetTickCount64());
+		if (client->encoder->progressiveUpgrade)
+		{
+			const UINT64 now = GetTickCount64();
+			const UINT64 due = client->encoder->progressiveUpgradeTime;
+			timeout = MIN(timeout, (due > now) ? (DWORD)MIN(due - now, UINT32_MAX - 1) : 0);
+		}
+
+		status = WaitForMultipleObjects(nCount, events, FALSE, timeout);
 
 		if (status == WAIT_FAILED)
 			goto fail;
@@ -2735,6 +3423,16 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 						break;
 					}
 				}
+				else if (client->encoder->rate &&
+				         !shadow_rate_control_can_send(client->encoder->rate, GetTickCount64()))
+				{
+					/* The link is congested, keep the damage for a later frame */
+					if (!shadow_client_no_surface_update(client, &gfxstatus))
+					{
+						WLog_ERR(TAG, "Failed to handle surface update");
+						break;
+					}
+				}
 				else
 				{
 					/* Send frame */
@@ -2762,6 +3460,12 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 			(void)shadow_multiclient_consume(UpdateSubscriber);
 		}
 
+		if (!shadow_client_send_progressive_upgrade(client, &gfxstatus))
+		{
+			WLog_ERR(TAG, "Failed to send progressive refinement");
+			break;
+		}
+
 		WINPR_ASSERT(peer->CheckFileDescriptor);
 		if (!peer->CheckFileDescriptor(peer))
 		{
@@ -2769,6 +3473,9 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 			goto fail;
 		}
 
+		if (!shadow_client_update_rate(client))
+			goto fail;
+
 		if (client->activated &&
 		    WTSVirtualChannelManagerIsChannelJoined(client->vcm, DRDYNVC_SVC_CHANNEL_NAME))
 		{
@@ -2803,7 +3510,12 @@ static DWORD WINAPI shadow_client_thread(LPVOID arg)
 					    client->rdpgfx && !gfxstatus.gfxOpened)
 					{
 						client->rdpgfx->FrameAcknowledge = shadow_client_rdpgfx_frame_acknowledge;
+						client->rdpgfx->QoeFrameAcknowledge =
+						    shadow_client_rdpgfx_qoe_frame_acknowledge;
 						client->rdpgfx->CapsAdvertise = shadow_client_rdpgfx_caps_advertise;
+						if (client->server->GfxTileCache)
+							client->rdpgfx->CacheImportOffer =
+							    shadow_client_rdpgfx_cache_import_offer;
 
 						if (!client->rdpgfx->Open(client->rdpgfx))
 						{
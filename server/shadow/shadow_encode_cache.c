@@ -0,0 +1,494 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/codec/planar.h>
+#include <freerdp/codec/region.h>
+#include <freerdp/log.h>
+
+#include "shadow_encode_cache.h"
+
+#define TAG SERVER_TAG("shadow.cache")
+
+/* The number of RemoteFX quantization values, see rfx_context_set_quantization */
+#define SHADOW_ENCODE_CACHE_QUANT_VALUES 10
+
+/* The number of encodings kept per codec, one per distinct set of client settings */
+#define SHADOW_ENCODE_CACHE_SLOTS 4
+
+/* Everything an encoded bitstream depends on. Clients with an identical key get identical
+ * output, so the encoding is done once and shared. */
+typedef struct
+{
+	UINT64 frame;
+	const BYTE* data;
+	UINT32 format;
+	UINT32 step;
+	UINT32 width;
+	UINT32 height;
+	RECTANGLE_16 rect;
+	UINT32 settings;
+	UINT32 quant[SHADOW_ENCODE_CACHE_QUANT_VALUES];
+} SHADOW_ENCODE_CACHE_KEY;
+
+/* A slot is owned by the thread encoding into it while pending, read by any number of threads
+ * while users is not 0 and only reused when neither is the case. The fields are protected by
+ * the cache lock, the codec context and the result are accessed outside of it. */
+typedef struct
+{
+	SHADOW_ENCODE_CACHE_KEY key;
+	BOOL valid;
+	BOOL pending;
+	UINT32 users;
+	UINT64 used;
+	HANDLE done;
+
+	RFX_CONTEXT* rfx;
+	UINT32 rfxWidth;
+	UINT32 rfxHeight;
+	RFX_MESSAGE* message;
+
+	BITMAP_PLANAR_CONTEXT* planar;
+	DWORD planarFlags;
+	BYTE* data;
+	UINT32 length;
+} SHADOW_ENCODE_CACHE_SLOT;
+
+typedef enum
+{
+	SHADOW_ENCODE_CACHE_MISS,
+	SHADOW_ENCODE_CACHE_HIT,
+	SHADOW_ENCODE_CACHE_FULL
+} SHADOW_ENCODE_CACHE_LOOKUP;
+
+struct rdp_shadow_encode_cache
+{
+	rdpShadowServer* server;
+
+	CRITICAL_SECTION lock;
+	UINT64 frame;
+	UINT64 tick;
+	UINT64 encoded;
+	UINT64 reused;
+
+	SHADOW_ENCODE_CACHE_SLOT rfx[SHADOW_ENCODE_CACHE_SLOTS];
+	SHADOW_ENCODE_CACHE_SLOT planar[SHADOW_ENCODE_CACHE_SLOTS];
+};
+
+WINPR_ATTR_NODISCARD
+static SHADOW_ENCODE_CACHE_KEY shadow_encode_cache_key(rdpShadowEncodeCache* cache,
+                                                       const BYTE* pSrcData, UINT32 format,
+                                                       UINT32 nSrcStep, UINT32 nWidth,
+                                                       UINT32 nHeight, UINT32 settings)
+{
+	SHADOW_ENCODE_CACHE_KEY key = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(cache);
+
+	EnterCriticalSection(&cache->lock);
+	key.frame = cache->frame;
+	LeaveCriticalSection(&cache->lock);
+
+	key.data = pSrcData;
+	key.format = format;
+	key.step = nSrcStep;
+	key.width = nWidth;
+	key.height = nHeight;
+	key.settings = settings;
+	return key;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_encode_cache_key_equal(const SHADOW_ENCODE_CACHE_KEY* a,
+                                          const SHADOW_ENCODE_CACHE_KEY* b)
+{
+	WINPR_ASSERT(a);
+	WINPR_ASSERT(b);
+
+	return (a->frame == b->frame) && (a->data == b->data) && (a->format == b->format) &&
+	       (a->step == b->step) && (a->width == b->width) && (a->height == b->height) &&
+	       rectangles_equal(&a->rect, &b->rect) && (a->settings == b->settings) &&
+	       (memcmp(a->quant, b->quant, sizeof(a->quant)) == 0);
+}
+
+static void shadow_encode_cache_slot_clear(SHADOW_ENCODE_CACHE_SLOT* slot)
+{
+	WINPR_ASSERT(slot);
+
+	if (slot->message)
+		rfx_message_free(slot->rfx, slot->message);
+	slot->message = nullptr;
+
+	free(slot->data);
+	slot->data = nullptr;
+	slot->length = 0;
+	slot->valid = FALSE;
+}
+
+/**
+ * Looks up \b key in \b slots. On a hit the slot holds a valid encoding, on a miss the slot is
+ * reserved for the caller to encode into. In both cases the slot must be returned with
+ * \b shadow_encode_cache_release. A lookup of an encoding in progress waits for it to finish.
+ */
+WINPR_ATTR_NODISCARD
+static SHADOW_ENCODE_CACHE_LOOKUP shadow_encode_cache_acquire(rdpShadowEncodeCache* cache,
+                                                              SHADOW_ENCODE_CACHE_SLOT* slots,
+                                                              const SHADOW_ENCODE_CACHE_KEY* key,
+                                                              SHADOW_ENCODE_CACHE_SLOT** pslot)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(slots);
+	WINPR_ASSERT(key);
+	WINPR_ASSERT(pslot);
+
+	*pslot = nullptr;
+
+	for (;;)
+	{
+		HANDLE pending = nullptr;
+		SHADOW_ENCODE_CACHE_SLOT* victim = nullptr;
+
+		EnterCriticalSection(&cache->lock);
+		for (size_t x = 0; x < SHADOW_ENCODE_CACHE_SLOTS; x++)
+		{
+			SHADOW_ENCODE_CACHE_SLOT* slot = &slots[x];
+
+			if ((slot->valid || slot->pending) && shadow_encode_cache_key_equal(&slot->key, key))
+			{
+				if (slot->pending)
+				{
+					pending = slot->done;
+					break;
+				}
+
+				slot->users++;
+				slot->used = ++cache->tick;
+				cache->reused++;
+				LeaveCriticalSection(&cache->lock);
+
+				*pslot = slot;
+				return SHADOW_ENCODE_CACHE_HIT;
+			}
+
+			if (slot->pending || (slot->users > 0))
+				continue;
+
+			if (!victim || (slot->used < victim->used))
+				victim = slot;
+		}
+
+		if (!pending)
+		{
+			if (victim)
+			{
+				shadow_encode_cache_slot_clear(victim);
+				victim->key = *key;
+				victim->pending = TRUE;
+				victim->users = 1;
+				victim->used = ++cache->tick;
+				(void)ResetEvent(victim->done);
+				*pslot = victim;
+			}
+			cache->encoded++;
+			LeaveCriticalSection(&cache->lock);
+			return victim ? SHADOW_ENCODE_CACHE_MISS : SHADOW_ENCODE_CACHE_FULL;
+		}
+
+		LeaveCriticalSection(&cache->lock);
+		(void)WaitForSingleObject(pending, INFINITE);
+	}
+}
+
+/**
+ * Returns a slot obtained with \b shadow_encode_cache_acquire. After a miss \b valid tells if
+ * the encoding succeeded and can be shared.
+ */
+static void shadow_encode_cache_release(rdpShadowEncodeCache* cache,
+                                        SHADOW_ENCODE_CACHE_SLOT* slot, BOOL valid)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(slot);
+
+	EnterCriticalSection(&cache->lock);
+	WINPR_ASSERT(slot->users > 0);
+	slot->users--;
+	if (slot->pending)
+	{
+		slot->pending = FALSE;
+		slot->valid = valid;
+		(void)SetEvent(slot->done);
+	}
+	LeaveCriticalSection(&cache->lock);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_encode_cache_prepare_rfx(rdpShadowEncodeCache* cache,
+                                            SHADOW_ENCODE_CACHE_SLOT* slot)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(slot);
+
+	const SHADOW_ENCODE_CACHE_KEY* key = &slot->key;
+
+	if (!slot->rfx)
+	{
+		const rdpSettings* settings = cache->server->settings;
+		slot->rfx = rfx_context_new_ex(
+		    TRUE, freerdp_settings_get_uint32(settings, FreeRDP_ThreadingFlags));
+		if (!slot->rfx)
+			return FALSE;
+		slot->rfxWidth = 0;
+		slot->rfxHeight = 0;
+	}
+
+	if ((slot->rfxWidth != key->width) || (slot->rfxHeight != key->height))
+	{
+		if (!rfx_context_reset(slot->rfx, key->width, key->height))
+			return FALSE;
+		slot->rfxWidth = key->width;
+		slot->rfxHeight = key->height;
+	}
+
+	rfx_context_set_pixel_format(slot->rfx, key->format);
+	if (!rfx_context_set_quantization(slot->rfx, key->quant, ARRAYSIZE(key->quant)))
+		return FALSE;
+	return rfx_context_set_mode(slot->rfx, WINPR_ASSERTING_INT_CAST(RLGR_MODE, key->settings));
+}
+
+BOOL shadow_encode_cache_write_rfx(rdpShadowEncodeCache* cache, RFX_CONTEXT* rfx, wStream* s,
+                                   const RFX_RECT* rect, const BYTE* pSrcData, UINT32 nWidth,
+                                   UINT32 nHeight, UINT32 nSrcStep)
+{
+	SHADOW_ENCODE_CACHE_SLOT* slot = nullptr;
+
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(rfx);
+	WINPR_ASSERT(s);
+	WINPR_ASSERT(rect);
+
+	SHADOW_ENCODE_CACHE_KEY key =
+	    shadow_encode_cache_key(cache, pSrcData, rfx_context_get_pixel_format(rfx), nSrcStep,
+	                            nWidth, nHeight, (UINT32)rfx_context_get_mode(rfx));
+	key.rect.left = rect->x;
+	key.rect.top = rect->y;
+	key.rect.right = WINPR_ASSERTING_INT_CAST(UINT16, rect->x + rect->width);
+	key.rect.bottom = WINPR_ASSERTING_INT_CAST(UINT16, rect->y + rect->height);
+	if (!rfx_context_get_quantization(rfx, key.quant, ARRAYSIZE(key.quant)))
+		return FALSE;
+
+	switch (shadow_encode_cache_acquire(cache, cache->rfx, &key, &slot))
+	{
+		case SHADOW_ENCODE_CACHE_FULL:
+			return rfx_compose_message(rfx, s, rect, 1, pSrcData, nWidth, nHeight, nSrcStep);
+
+		case SHADOW_ENCODE_CACHE_MISS:
+			if (shadow_encode_cache_prepare_rfx(cache, slot))
+				slot->message =
+				    rfx_encode_message(slot->rfx, rect, 1, pSrcData, nWidth, nHeight, nSrcStep);
+			if (!slot->message)
+			{
+				shadow_encode_cache_release(cache, slot, FALSE);
+				return FALSE;
+			}
+			break;
+
+		case SHADOW_ENCODE_CACHE_HIT:
+		default:
+			break;
+	}
+
+	/* The tiles are shared, the headers and the frame index come from the client context */
+	const BOOL rc = rfx_write_shared_message(rfx, s, slot->message);
+	shadow_encode_cache_release(cache, slot, TRUE);
+	return rc;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_encode_cache_prepare_planar(rdpShadowEncodeCache* cache,
+                                               SHADOW_ENCODE_CACHE_SLOT* slot)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(slot);
+
+	const SHADOW_ENCODE_CACHE_KEY* key = &slot->key;
+
+	if (slot->planar && (slot->planarFlags != key->settings))
+	{
+		freerdp_bitmap_planar_context_free(slot->planar);
+		slot->planar = nullptr;
+	}
+
+	if (!slot->planar)
+	{
+		const rdpSettings* settings = cache->server->settings;
+		slot->planar = freerdp_bitmap_planar_context_new_ex(
+		    key->settings, key->width, key->height,
+		    freerdp_settings_get_uint32(settings, FreeRDP_ThreadingFlags));
+		if (!slot->planar)
+			return FALSE;
+		slot->planarFlags = key->settings;
+	}
+
+	if (!freerdp_bitmap_planar_context_reset(slot->planar, key->width, key->height))
+		return FALSE;
+
+	freerdp_planar_topdown_image(slot->planar, TRUE);
+	return TRUE;
+}
+
+BYTE* shadow_encode_cache_compress_planar(rdpShadowEncodeCache* cache,
+                                          BITMAP_PLANAR_CONTEXT* planar, DWORD planarFlags,
+                                          const BYTE* pSrcData, UINT32 SrcFormat, UINT32 nWidth,
+                                          UINT32 nHeight, UINT32 nSrcStep, UINT32* pDstSize)
+{
+	SHADOW_ENCODE_CACHE_SLOT* slot = nullptr;
+
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(planar);
+	WINPR_ASSERT(pDstSize);
+
+	SHADOW_ENCODE_CACHE_KEY key =
+	    shadow_encode_cache_key(cache, pSrcData, SrcFormat, nSrcStep, nWidth, nHeight, planarFlags);
+	WINPR_ASSERT(nWidth <= UINT16_MAX);
+	WINPR_ASSERT(nHeight <= UINT16_MAX);
+	key.rect.right = (UINT16)nWidth;
+	key.rect.bottom = (UINT16)nHeight;
+
+	*pDstSize = 0;
+
+	switch (shadow_encode_cache_acquire(cache, cache->planar, &key, &slot))
+	{
+		case SHADOW_ENCODE_CACHE_FULL:
+			if (!freerdp_bitmap_planar_context_reset(planar, nWidth, nHeight))
+				return nullptr;
+			freerdp_planar_topdown_image(planar, TRUE);
+			return freerdp_bitmap_compress_planar(planar, pSrcData, SrcFormat, nWidth, nHeight,
+			                                      nSrcStep, nullptr, pDstSize);
+
+		case SHADOW_ENCODE_CACHE_MISS:
+			if (shadow_encode_cache_prepare_planar(cache, slot))
+				slot->data = freerdp_bitmap_compress_planar(slot->planar, pSrcData, SrcFormat,
+				                                            nWidth, nHeight, nSrcStep, nullptr,
+				                                            &slot->length);
+			if (!slot->data)
+			{
+				shadow_encode_cache_release(cache, slot, FALSE);
+				return nullptr;
+			}
+			break;
+
+		case SHADOW_ENCODE_CACHE_HIT:
+		default:
+			break;
+	}
+
+	BYTE* dst = malloc(slot->length);
+	if (dst)
+	{
+		memcpy(dst, slot->data, slot->length);
+		*pDstSize = slot->length;
+	}
+
+	shadow_encode_cache_release(cache, slot, TRUE);
+	return dst;
+}
+
+void shadow_encode_cache_get_stats(rdpShadowEncodeCache* cache, UINT64* encoded, UINT64* reused)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(encoded);
+	WINPR_ASSERT(reused);
+
+	EnterCriticalSection(&cache->lock);
+	*encoded = cache->encoded;
+	*reused = cache->reused;
+	LeaveCriticalSection(&cache->lock);
+}
+
+void shadow_encode_cache_next_frame(rdpShadowEncodeCache* cache)
+{
+	if (!cache)
+		return;
+
+	EnterCriticalSection(&cache->lock);
+	cache->frame++;
+	LeaveCriticalSection(&cache->lock);
+}
+
+rdpShadowEncodeCache* shadow_encode_cache_new(rdpShadowServer* server)
+{
+	WINPR_ASSERT(server);
+
+	rdpShadowEncodeCache* cache = (rdpShadowEncodeCache*)calloc(1, sizeof(rdpShadowEncodeCache));
+	if (!cache)
+		return nullptr;
+
+	cache->server = server;
+
+	if (!InitializeCriticalSectionAndSpinCount(&cache->lock, 4000))
+	{
+		free(cache);
+		return nullptr;
+	}
+
+	for (size_t x = 0; x < SHADOW_ENCODE_CACHE_SLOTS; x++)
+	{
+		cache->rfx[x].done = CreateEvent(nullptr, TRUE, TRUE, nullptr);
+		cache->planar[x].done = CreateEvent(nullptr, TRUE, TRUE, nullptr);
+		if (!cache->rfx[x].done || !cache->planar[x].done)
+		{
+			shadow_encode_cache_free(cache);
+			return nullptr;
+		}
+	}
+
+	return cache;
+}
+
+static void shadow_encode_cache_slot_free(SHADOW_ENCODE_CACHE_SLOT* slot)
+{
+	WINPR_ASSERT(slot);
+	WINPR_ASSERT(!slot->pending && (slot->users == 0));
+
+	shadow_encode_cache_slot_clear(slot);
+	rfx_context_free(slot->rfx);
+	freerdp_bitmap_planar_context_free(slot->planar);
+	if (slot->done)
+		(void)CloseHandle(slot->done);
+}
+
+void shadow_encode_cache_free(rdpShadowEncodeCache* cache)
+{
+	if (!cache)
+		return;
+
+	WLog_DBG(TAG, "%" PRIu64 " frames encoded, %" PRIu64 " encodings shared", cache->encoded,
+	         cache->reused);
+
+	for (size_t x = 0; x < SHADOW_ENCODE_CACHE_SLOTS; x++)
+	{
+		shadow_encode_cache_slot_free(&cache->rfx[x]);
+		shadow_encode_cache_slot_free(&cache->planar[x]);
+	}
+
+	DeleteCriticalSection(&cache->lock);
+	free(cache);
+}
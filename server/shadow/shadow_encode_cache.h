@@ -0,0 +1,84 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_ENCODE_CACHE_H
+#define FREERDP_SERVER_SHADOW_ENCODE_CACHE_H
+
+#include <winpr/wtypes.h>
+#include <winpr/stream.h>
+
+#include <freerdp/codec/rfx.h>
+#include <freerdp/codec/planar.h>
+#include <freerdp/server/shadow.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	void shadow_encode_cache_free(rdpShadowEncodeCache* cache);
+
+	WINPR_ATTR_MALLOC(shadow_encode_cache_free, 1)
+	WINPR_ATTR_NODISCARD
+	rdpShadowEncodeCache* shadow_encode_cache_new(rdpShadowServer* server);
+
+	/**
+	 * @brief Invalidates all cached encodings, called whenever the shared surface was updated
+	 * and before the clients are notified about the new frame.
+	 */
+	void shadow_encode_cache_next_frame(rdpShadowEncodeCache* cache);
+
+	/**
+	 * @brief Writes a RemoteFX message for \b rect of the current frame to \b s
+	 *
+	 * The tiles are encoded once per frame for all clients with identical RemoteFX settings
+	 * (mode and quantization, taken from \b rfx), the message headers and the frame index are
+	 * written with the client context \b rfx. When all cache slots are in use the message is
+	 * encoded with \b rfx.
+	 *
+	 * @return \b TRUE for success, \b FALSE otherwise
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_encode_cache_write_rfx(rdpShadowEncodeCache* cache,
+	                                                        RFX_CONTEXT* rfx, wStream* s,
+	                                                        const RFX_RECT* rect,
+	                                                        const BYTE* pSrcData, UINT32 nWidth,
+	                                                        UINT32 nHeight, UINT32 nSrcStep);
+
+	/**
+	 * @brief Compresses \b pSrcData of the current frame with the planar codec
+	 *
+	 * The bitmap is compressed once per frame for all clients using the same \b planarFlags.
+	 * When all cache slots are in use the bitmap is compressed with the client context
+	 * \b planar.
+	 *
+	 * @return A newly allocated copy of the compressed bitmap or \b nullptr in case of failure
+	 */
+	WINPR_ATTR_NODISCARD BYTE* shadow_encode_cache_compress_planar(
+	    rdpShadowEncodeCache* cache, BITMAP_PLANAR_CONTEXT* planar, DWORD planarFlags,
+	    const BYTE* pSrcData, UINT32 SrcFormat, UINT32 nWidth, UINT32 nHeight, UINT32 nSrcStep,
+	    UINT32* pDstSize);
+
+	/**
+	 * @brief Returns the number of encodings done and the number of encodings shared so far
+	 */
+	void shadow_encode_cache_get_stats(rdpShadowEncodeCache* cache, UINT64* encoded,
+	                                   UINT64* reused);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_ENCODE_CACHE_H */
@@ -27,6 +27,12 @@
 #include <freerdp/log.h>
 #define TAG CLIENT_TAG("shadow")
 
+/* The RemoteFX codec defaults, every quality level raises them by one */
+static const UINT32 shadow_encoder_rfx_quant[] = { 6, 6, 6, 6, 7, 7, 8, 8, 8, 9 };
+
+/* H.264 bit rate floor (in bits per second) of the coarser quality levels */
+#define SHADOW_ENCODER_MIN_BITRATE 250000
+
 UINT32 shadow_encoder_preferred_fps(rdpShadowEncoder* encoder)
 {
 	/* Return preferred fps calculated according to the last
@@ -54,6 +60,10 @@ UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder)
 	UINT32 frameId = 0;
 	UINT32 inFlightFrames = shadow_encoder_inflight_frames(encoder);
 
+	/* The rate control tunes fps itself, see shadow_encoder_update_rate */
+	if (encoder->rate)
+		return ++encoder->frameId;
+
 	/*
 	 * Calculate preferred fps according to how much frames are
 	 * in-progress. Note that it only works when subsystem implementation
@@ -78,6 +88,80 @@ UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder)
 	return frameId;
 }
 
+WINPR_ATTR_NODISCARD
+static BOOL shadow_encoder_apply_rfx_quality(rdpShadowEncoder* encoder)
+{
+	UINT32 quant[ARRAYSIZE(shadow_encoder_rfx_quant)] = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(encoder);
+
+	if (!encoder->rfx)
+		return TRUE;
+
+	for (size_t i = 0; i < ARRAYSIZE(quant); i++)
+		quant[i] = MIN(15, shadow_encoder_rfx_quant[i] + encoder->target.quality);
+	return rfx_context_set_quantization(encoder->rfx, quant, ARRAYSIZE(quant));
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_encoder_apply_h264_rate(rdpShadowEncoder* encoder)
+{
+	WINPR_ASSERT(encoder);
+
+	const rdpShadowServer* server = encoder->server;
+	WINPR_ASSERT(server);
+
+	if (!encoder->h264 || !encoder->rate)
+		return TRUE;
+
+	/* Every quality level halves the bit rate, within what the link was measured to carry */
+	const SHADOW_RATE_TARGET* target = &encoder->target;
+	UINT32 bitRate = server->h264BitRate >> target->quality;
+	if (target->bitRate > 0)
+		bitRate = MIN(bitRate, target->bitRate / 4 * 3);
+	bitRate = MAX(bitRate, MIN(server->h264BitRate, SHADOW_ENCODER_MIN_BITRATE));
+
+	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_BITRATE, bitRate))
+		return FALSE;
+	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_FRAMERATE,
+	                             MAX(1, MIN(server->h264FrameRate, target->fps))))
+		return FALSE;
+
+	if (server->h264RateControlMode == H264_RATECONTROL_CQP)
+	{
+		const UINT32 qp = MIN(51, server->h264QP + 4 * target->quality);
+		if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_QP, qp))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+BOOL shadow_encoder_update_rate(rdpShadowEncoder* encoder, BOOL* refine)
+{
+	SHADOW_RATE_TARGET target = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(encoder);
+	WINPR_ASSERT(refine);
+
+	*refine = FALSE;
+	if (!encoder->rate)
+		return TRUE;
+
+	shadow_rate_control_get_target(encoder->rate, &target);
+	encoder->fps = target.fps;
+
+	if ((target.fps == encoder->target.fps) && (target.quality == encoder->target.quality) &&
+	    (target.bitRate == encoder->target.bitRate))
+		return TRUE;
+
+	*refine = (encoder->target.quality > 0) && (target.quality == 0);
+	encoder->target = target;
+
+	if (!shadow_encoder_apply_rfx_quality(encoder))
+		return FALSE;
+	return shadow_encoder_apply_h264_rate(encoder);
+}
+
 WINPR_ATTR_NODISCARD
 static int shadow_encoder_init_grid(rdpShadowEncoder* encoder)
 {
@@ -149,6 +233,8 @@ static int shadow_encoder_init_rfx(rdpShadowEncoder* encoder)
 			goto fail;
 	}
 	rfx_context_set_pixel_format(encoder->rfx, PIXEL_FORMAT_BGRX32);
+	if (!shadow_encoder_apply_rfx_quality(encoder))
+		goto fail;
 	encoder->codecs |= FREERDP_CODEC_REMOTEFX;
 	return 1;
 fail:
@@ -207,8 +293,9 @@ static int shadow_encoder_init_planar(rdpShadowEncoder* encoder)
 
 	if (!encoder->planar)
 	{
-		encoder->planar = freerdp_bitmap_planar_context_new(planarFlags, encoder->maxTileWidth,
-		                                                    encoder->maxTileHeight);
+		encoder->planar = freerdp_bitmap_planar_context_new_ex(
+		    planarFlags, encoder->maxTileWidth, encoder->maxTileHeight,
+		    freerdp_settings_get_uint32(settings, FreeRDP_ThreadingFlags));
 	}
 
 	if (!encoder->planar)
@@ -218,6 +305,7 @@ static int shadow_encoder_init_planar(rdpShadowEncoder* encoder)
 	                                         encoder->maxTileHeight))
 		goto fail;
 
+	encoder->planarFlags = planarFlags;
 	encoder->codecs |= FREERDP_CODEC_PLANAR;
 	return 1;
 fail:
@@ -267,6 +355,8 @@ static int shadow_encoder_init_h264(rdpShadowEncoder* encoder)
 		goto fail;
 	if (!h264_context_set_option(encoder->h264, H264_CONTEXT_OPTION_QP, encoder->server->h264QP))
 		goto fail;
+	if (!shadow_encoder_apply_h264_rate(encoder))
+		goto fail;
 
 	encoder->codecs |= FREERDP_CODEC_AVC420 | FREERDP_CODEC_AVC444;
 	return 1;
@@ -327,10 +417,38 @@ static int shadow_encoder_init_progressive(rdpShadowEncoder* encoder)
 	if (!progressive_context_reset(encoder->progressive))
 		goto fail;
 
+	WINPR_ASSERT(encoder->server);
+	if (!progressive_compress_set_passes(encoder->progressive,
+	                                     encoder->server->GfxProgressivePasses))
+		goto fail;
+	encoder->progressiveUpgrade = FALSE;
+
 	encoder->codecs |= FREERDP_CODEC_PROGRESSIVE;
 	return 1;
 fail:
 	progressive_context_free(encoder->progressive);
+	encoder->progressive = nullptr;
+	return -1;
+}
+
+WINPR_ATTR_NODISCARD
+static int shadow_encoder_init_clear(rdpShadowEncoder* encoder)
+{
+	WINPR_ASSERT(encoder);
+	if (!encoder->clear)
+		encoder->clear = clear_context_new(TRUE);
+
+	if (!encoder->clear)
+		goto fail;
+
+	if (!clear_context_reset(encoder->clear))
+		goto fail;
+
+	encoder->codecs |= FREERDP_CODEC_CLEARCODEC;
+	return 1;
+fail:
+	clear_context_free(encoder->clear);
+	encoder->clear = nullptr;
 	return -1;
 }
 
@@ -439,6 +557,19 @@ static int shadow_encoder_uninit_progressive(rdpShadowEncoder* encoder)
 	return 1;
 }
 
+static int shadow_encoder_uninit_clear(rdpShadowEncoder* encoder)
+{
+	WINPR_ASSERT(encoder);
+	if (encoder->clear)
+	{
+		clear_context_free(encoder->clear);
+		encoder->clear = nullptr;
+	}
+
+	encoder->codecs &= (UINT32)~FREERDP_CODEC_CLEARCODEC;
+	return 1;
+}
+
 static int shadow_encoder_uninit(rdpShadowEncoder* encoder)
 {
 	shadow_encoder_uninit_grid(encoder);
@@ -462,6 +593,7 @@ static int shadow_encoder_uninit(rdpShadowEncoder* encoder)
 #endif
 
 	shadow_encoder_uninit_progressive(encoder);
+	shadow_encoder_uninit_clear(encoder);
 
 	return 1;
 }
@@ -482,12 +614,18 @@ int shadow_encoder_reset(rdpShadowEncoder* encoder)
 	if (status < 0)
 		return -1;
 
+	if (encoder->rate)
+	{
+		shadow_rate_control_reset(encoder->rate);
+		shadow_rate_control_get_target(encoder->rate, &encoder->target);
+	}
+
 	status = shadow_encoder_prepare(encoder, codecs);
 
 	if (status < 0)
 		return -1;
 
-	encoder->fps = 16;
+	encoder->fps = encoder->rate ? encoder->target.fps : 16;
 	encoder->maxFps = 32;
 	encoder->frameId = 0;
 	encoder->lastAckframeId = 0;
@@ -554,6 +692,15 @@ int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs)
 			return -1;
 	}
 
+	if ((codecs & FREERDP_CODEC_CLEARCODEC) && !(encoder->codecs & FREERDP_CODEC_CLEARCODEC))
+	{
+		WLog_DBG(TAG, "initializing ClearCodec encoder");
+		status = shadow_encoder_init_clear(encoder);
+
+		if (status < 0)
+			return -1;
+	}
+
 #if defined(WITH_GFX_AV1)
 	const UINT32 cmask = codecs & (FREERDP_CODEC_AV1_I420 | FREERDP_CODEC_AV1_I444);
 	const UINT32 emask = encoder->codecs & (FREERDP_CODEC_AV1_I420 | FREERDP_CODEC_AV1_I444);
@@ -584,6 +731,19 @@ rdpShadowEncoder* shadow_encoder_new(rdpShadowClient* client)
 	encoder->fps = 16;
 	encoder->maxFps = 32;
 
+	if (server->RateControl)
+	{
+		encoder->rate = shadow_rate_control_new(encoder->maxFps);
+		if (!encoder->rate)
+		{
+			shadow_encoder_free(encoder);
+			return nullptr;
+		}
+
+		shadow_rate_control_get_target(encoder->rate, &encoder->target);
+		encoder->fps = encoder->target.fps;
+	}
+
 	if (shadow_encoder_init(encoder) < 0)
 	{
 		shadow_encoder_free(encoder);
@@ -599,5 +759,6 @@ void shadow_encoder_free(rdpShadowEncoder* encoder)
 		return;
 
 	shadow_encoder_uninit(encoder);
+	shadow_rate_control_free(encoder->rate);
 	free(encoder);
 }
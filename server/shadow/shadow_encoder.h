@@ -27,6 +27,8 @@
 
 #include <freerdp/server/shadow.h>
 
+#include "shadow_rate.h"
+
 struct rdp_shadow_encoder
 {
 	rdpShadowClient* client;
@@ -48,9 +50,13 @@ struct rdp_shadow_encoder
 	RFX_CONTEXT* rfx;
 	NSC_CONTEXT* nsc;
 	BITMAP_PLANAR_CONTEXT* planar;
+	DWORD planarFlags;
 	BITMAP_INTERLEAVED_CONTEXT* interleaved;
 	H264_CONTEXT* h264;
 	PROGRESSIVE_CONTEXT* progressive;
+	BOOL progressiveUpgrade;       /* tiles sent below full quality wait for a refinement */
+	UINT64 progressiveUpgradeTime; /* tick count the next refinement is due */
+	CLEAR_CONTEXT* clear;
 #if defined(WITH_GFX_AV1)
 	FREERDP_AV1_CONTEXT* av1;
 #endif
@@ -60,6 +66,8 @@ struct rdp_shadow_encoder
 	UINT32 frameId;
 	UINT32 lastAckframeId;
 	UINT32 queueDepth;
+	rdpShadowRateControl* rate;
+	SHADOW_RATE_TARGET target;
 };
 
 #ifdef __cplusplus
@@ -71,6 +79,15 @@ extern "C"
 	WINPR_ATTR_NODISCARD int shadow_encoder_prepare(rdpShadowEncoder* encoder, UINT32 codecs);
 	WINPR_ATTR_NODISCARD UINT32 shadow_encoder_create_frame_id(rdpShadowEncoder* encoder);
 
+	/**
+	 * @brief Applies the current targets of the rate control to the frame rate and the codecs.
+	 *
+	 * @param refine Set to \b TRUE if the quality went back to full quality, the client shows
+	 * coarser content than it would get now
+	 * @return \b TRUE for success, \b FALSE otherwise
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_encoder_update_rate(rdpShadowEncoder* encoder, BOOL* refine);
+
 	void shadow_encoder_free(rdpShadowEncoder* encoder);
 
 	WINPR_ATTR_MALLOC(shadow_encoder_free, 1)
@@ -0,0 +1,364 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/crt.h>
+
+#include <freerdp/log.h>
+
+#include "shadow_motion.h"
+
+#define TAG SERVER_TAG("shadow.motion")
+
+/* Every line votes for at most this many candidate shifts */
+#define SHADOW_MOTION_MAX_CANDIDATES 8
+
+/* A line is a row (vertical moves) or a column (horizontal moves) of the changed area. The
+ * pixel i of line l is at data + l * lineStride + i * pixelStride. */
+typedef struct
+{
+	const BYTE* prev;
+	const BYTE* cur;
+	size_t lineStride;
+	size_t pixelStride;
+	UINT32 lines;
+	UINT32 first;
+	UINT32 last;
+	UINT32 begin;
+	UINT32 end;
+} SHADOW_MOTION_AXIS;
+
+typedef struct
+{
+	UINT64 hash;
+	UINT32 line;
+} SHADOW_MOTION_LINE;
+
+static inline UINT32 shadow_motion_pixel(const SHADOW_MOTION_AXIS* axis, const BYTE* data,
+                                         UINT32 line, UINT32 index)
+{
+	UINT32 pixel = 0;
+	memcpy(&pixel, &data[line * axis->lineStride + index * axis->pixelStride], sizeof(pixel));
+	return pixel;
+}
+
+/* Hashes a line, lines of a single color are flagged as they match any shift */
+static UINT64 shadow_motion_line_hash(const SHADOW_MOTION_AXIS* axis, const BYTE* data,
+                                      UINT32 line, BOOL* uniform)
+{
+	const UINT32 color = shadow_motion_pixel(axis, data, line, axis->begin);
+	UINT64 hash = 0xCBF29CE484222325ull;
+	UINT32 diff = 0;
+
+	for (UINT32 x = axis->begin; x < axis->end; x++)
+	{
+		const UINT32 pixel = shadow_motion_pixel(axis, data, line, x);
+		diff |= pixel ^ color;
+		hash = (hash ^ pixel) * 0x100000001B3ull;
+		hash ^= hash >> 29;
+	}
+
+	*uniform = (diff == 0);
+	return hash;
+}
+
+static BOOL shadow_motion_line_equal(const SHADOW_MOTION_AXIS* axis, UINT32 curLine,
+                                     UINT32 prevLine)
+{
+	if (axis->pixelStride == 4)
+	{
+		const size_t offset = axis->begin * axis->pixelStride;
+		return memcmp(&axis->cur[curLine * axis->lineStride + offset],
+		              &axis->prev[prevLine * axis->lineStride + offset],
+		              (axis->end - axis->begin) * axis->pixelStride) == 0;
+	}
+
+	for (UINT32 x = axis->begin; x < axis->end; x++)
+	{
+		if (shadow_motion_pixel(axis, axis->cur, curLine, x) !=
+		    shadow_motion_pixel(axis, axis->prev, prevLine, x))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static int shadow_motion_line_compare(const void* a, const void* b)
+{
+	const SHADOW_MOTION_LINE* la = a;
+	const SHADOW_MOTION_LINE* lb = b;
+
+	if (la->hash != lb->hash)
+		return (la->hash < lb->hash) ? -1 : 1;
+	if (la->line != lb->line)
+		return (la->line < lb->line) ? -1 : 1;
+	return 0;
+}
+
+/* Lines of the previous frame are sorted by hash, every line of the current frame votes for the
+ * shifts that map it to an identical previous line. */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_motion_vote(const SHADOW_MOTION_AXIS* axis, INT32* pShift)
+{
+	BOOL rc = FALSE;
+	const UINT32 count = axis->last - axis->first;
+	SHADOW_MOTION_LINE* lines = calloc(count, sizeof(SHADOW_MOTION_LINE));
+	UINT32* votes = calloc(2ull * count, sizeof(UINT32));
+	size_t used = 0;
+	UINT32 voters = 0;
+
+	if (!lines || !votes)
+		goto fail;
+
+	for (UINT32 line = axis->first; line < axis->last; line++)
+	{
+		BOOL uniform = FALSE;
+		const UINT64 hash = shadow_motion_line_hash(axis, axis->prev, line, &uniform);
+		if (uniform)
+			continue;
+
+		lines[used].hash = hash;
+		lines[used].line = line;
+		used++;
+	}
+
+	if (used == 0)
+		goto fail;
+
+	qsort(lines, used, sizeof(SHADOW_MOTION_LINE), shadow_motion_line_compare);
+
+	for (UINT32 line = axis->first; line < axis->last; line++)
+	{
+		BOOL uniform = FALSE;
+		const UINT64 hash = shadow_motion_line_hash(axis, axis->cur, line, &uniform);
+		if (uniform)
+			continue;
+
+		/* lower bound of hash */
+		size_t lo = 0;
+		size_t hi = used;
+		while (lo < hi)
+		{
+			const size_t mid = lo + (hi - lo) / 2;
+			if (lines[mid].hash < hash)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		voters++;
+		for (size_t x = lo; (x < used) && (x < lo + SHADOW_MOTION_MAX_CANDIDATES); x++)
+		{
+			if (lines[x].hash != hash)
+				break;
+			if (lines[x].line != line)
+				votes[count + line - lines[x].line]++;
+		}
+	}
+
+	UINT32 best = 0;
+	for (UINT32 x = 1; x < 2 * count; x++)
+	{
+		if (votes[x] > votes[best])
+			best = x;
+	}
+
+	/* A quarter of the distinct lines must agree, otherwise this is not a move */
+	if ((votes[best] >= 8) && (votes[best] * 4 >= voters))
+	{
+		*pShift = (INT32)best - (INT32)count;
+		rc = TRUE;
+	}
+
+fail:
+	free(lines);
+	free(votes);
+	return rc;
+}
+
+/* Finds the longest run of current lines that equal the previous lines shifted by \b shift. The
+ * source lines may lie outside of the changed area. */
+WINPR_ATTR_NODISCARD
+static UINT32 shadow_motion_band(const SHADOW_MOTION_AXIS* axis, INT32 shift, UINT32* pStart)
+{
+	UINT32 bestStart = 0;
+	UINT32 bestLength = 0;
+	UINT32 start = 0;
+	UINT32 length = 0;
+
+	const INT64 first = MAX((INT64)axis->first, shift);
+	const INT64 last = MIN((INT64)axis->last, (INT64)axis->lines + shift);
+
+	for (INT64 line = first; line < last; line++)
+	{
+		if (shadow_motion_line_equal(axis, (UINT32)line, (UINT32)(line - shift)))
+		{
+			if (length == 0)
+				start = (UINT32)line;
+			length++;
+			if (length > bestLength)
+			{
+				bestLength = length;
+				bestStart = start;
+			}
+		}
+		else
+			length = 0;
+	}
+
+	*pStart = bestStart;
+	return bestLength;
+}
+
+WINPR_ATTR_NODISCARD
+static UINT64 shadow_motion_detect_axis(const SHADOW_MOTION_AXIS* axis, INT32* pShift,
+                                        UINT32* pStart, UINT32* pLength)
+{
+	if ((axis->last - axis->first < SHADOW_MOTION_MIN_LINES) ||
+	    (axis->end - axis->begin < SHADOW_MOTION_MIN_LINES))
+		return 0;
+
+	if (!shadow_motion_vote(axis, pShift))
+		return 0;
+
+	*pLength = shadow_motion_band(axis, *pShift, pStart);
+	if (*pLength < SHADOW_MOTION_MIN_LINES)
+		return 0;
+
+	return 1ull * (*pLength) * (axis->end - axis->begin);
+}
+
+/* The bounding box of all pixels that differ between the frames */
+WINPR_ATTR_NODISCARD
+static BOOL shadow_motion_changed_area(const BYTE* pPrevData, const BYTE* pCurData, UINT32 nStep,
+                                       UINT32 nWidth, UINT32 nHeight, RECTANGLE_16* area)
+{
+	UINT32 left = nWidth;
+	UINT32 right = 0;
+	UINT32 top = nHeight;
+	UINT32 bottom = 0;
+
+	for (UINT32 y = 0; y < nHeight; y++)
+	{
+		const UINT32* prev = (const UINT32*)&pPrevData[1ull * y * nStep];
+		const UINT32* cur = (const UINT32*)&pCurData[1ull * y * nStep];
+
+		if (memcmp(prev, cur, nWidth * 4ull) == 0)
+			continue;
+
+		top = MIN(top, y);
+		bottom = y + 1;
+
+		for (UINT32 x = 0; x < left; x++)
+		{
+			if (prev[x] != cur[x])
+			{
+				left = x;
+				break;
+			}
+		}
+
+		for (UINT32 x = nWidth; x > right; x--)
+		{
+			if (prev[x - 1] != cur[x - 1])
+			{
+				right = x;
+				break;
+			}
+		}
+	}
+
+	if (bottom == 0)
+		return FALSE;
+
+	area->left = WINPR_ASSERTING_INT_CAST(UINT16, left);
+	area->top = WINPR_ASSERTING_INT_CAST(UINT16, top);
+	area->right = WINPR_ASSERTING_INT_CAST(UINT16, right);
+	area->bottom = WINPR_ASSERTING_INT_CAST(UINT16, bottom);
+	return TRUE;
+}
+
+BOOL shadow_motion_detect(const BYTE* pPrevData, const BYTE* pCurData, UINT32 nStep,
+                          UINT32 nWidth, UINT32 nHeight, SHADOW_MOTION* motion)
+{
+	RECTANGLE_16 area = WINPR_C_ARRAY_INIT;
+
+	WINPR_ASSERT(pPrevData);
+	WINPR_ASSERT(pCurData);
+	WINPR_ASSERT(motion);
+	WINPR_ASSERT(nWidth <= UINT16_MAX);
+	WINPR_ASSERT(nHeight <= UINT16_MAX);
+
+	if (!shadow_motion_changed_area(pPrevData, pCurData, nStep, nWidth, nHeight, &area))
+		return FALSE;
+
+	const SHADOW_MOTION_AXIS rows = { .prev = pPrevData,
+		                              .cur = pCurData,
+		                              .lineStride = nStep,
+		                              .pixelStride = 4,
+		                              .lines = nHeight,
+		                              .first = area.top,
+		                              .last = area.bottom,
+		                              .begin = area.left,
+		                              .end = area.right };
+	const SHADOW_MOTION_AXIS columns = { .prev = pPrevData,
+		                                 .cur = pCurData,
+		                                 .lineStride = 4,
+		                                 .pixelStride = nStep,
+		                                 .lines = nWidth,
+		                                 .first = area.left,
+		                                 .last = area.right,
+		                                 .begin = area.top,
+		                                 .end = area.bottom };
+
+	INT32 dy = 0;
+	INT32 dx = 0;
+	UINT32 startY = 0;
+	UINT32 startX = 0;
+	UINT32 lengthY = 0;
+	UINT32 lengthX = 0;
+	const UINT64 vertical = shadow_motion_detect_axis(&rows, &dy, &startY, &lengthY);
+	const UINT64 horizontal = shadow_motion_detect_axis(&columns, &dx, &startX, &lengthX);
+
+	if ((vertical == 0) && (horizontal == 0))
+		return FALSE;
+
+	if (vertical >= horizontal)
+	{
+		motion->rectSrc.left = area.left;
+		motion->rectSrc.right = area.right;
+		motion->rectSrc.top = WINPR_ASSERTING_INT_CAST(UINT16, (INT64)startY - dy);
+		motion->rectSrc.bottom = WINPR_ASSERTING_INT_CAST(UINT16, (INT64)startY - dy + lengthY);
+		motion->x = area.left;
+		motion->y = WINPR_ASSERTING_INT_CAST(UINT16, startY);
+	}
+	else
+	{
+		motion->rectSrc.left = WINPR_ASSERTING_INT_CAST(UINT16, (INT64)startX - dx);
+		motion->rectSrc.right = WINPR_ASSERTING_INT_CAST(UINT16, (INT64)startX - dx + lengthX);
+		motion->rectSrc.top = area.top;
+		motion->rectSrc.bottom = area.bottom;
+		motion->x = WINPR_ASSERTING_INT_CAST(UINT16, startX);
+		motion->y = area.top;
+	}
+
+	WLog_DBG(TAG, "moved [%" PRIu16 "x%" PRIu16 "-%" PRIu16 "x%" PRIu16 "] to %" PRIu16
+	              "x%" PRIu16,
+	         motion->rectSrc.left, motion->rectSrc.top, motion->rectSrc.right,
+	         motion->rectSrc.bottom, motion->x, motion->y);
+	return TRUE;
+}
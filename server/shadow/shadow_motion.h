@@ -0,0 +1,57 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_MOTION_H
+#define FREERDP_SERVER_SHADOW_MOTION_H
+
+#include <winpr/wtypes.h>
+
+#include <freerdp/types.h>
+
+/* Moves shorter than this (in the direction of the move) are not worth a SurfaceToSurface */
+#define SHADOW_MOTION_MIN_LINES 64
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	typedef struct
+	{
+		RECTANGLE_16 rectSrc; /**< The area of the previous frame that moved */
+		UINT16 x;             /**< The destination of \b rectSrc in the current frame */
+		UINT16 y;
+	} SHADOW_MOTION;
+
+	/**
+	 * @brief Detects a vertical or horizontal shift of a block of pixels between two frames,
+	 * as caused by scrolling or moving a window.
+	 *
+	 * Both frames are 32bpp with the same stride. The detected area is verified pixel by
+	 * pixel, copying \b motion->rectSrc of \b pPrevData to \b motion->x / \b motion->y
+	 * reproduces that part of \b pCurData exactly.
+	 *
+	 * @return \b TRUE if a move was detected, \b FALSE otherwise
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_motion_detect(const BYTE* pPrevData, const BYTE* pCurData,
+	                                               UINT32 nStep, UINT32 nWidth, UINT32 nHeight,
+	                                               SHADOW_MOTION* motion);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_MOTION_H */
@@ -0,0 +1,492 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/log.h>
+#include <freerdp/types.h>
+
+#include "shadow_rate.h"
+
+#define TAG SERVER_TAG("shadow.rate")
+
+/* Frames in flight that are tracked, more are never sent */
+#define SHADOW_RATE_MAX_FRAMES 64
+
+/* The queueing delay (in milliseconds) tolerated on top of the base latency */
+#define SHADOW_RATE_TARGET_DELAY 50
+
+/* Minimum time (in milliseconds) between two quality reductions or increases */
+#define SHADOW_RATE_DEGRADE_INTERVAL 250
+#define SHADOW_RATE_IMPROVE_INTERVAL 1000
+
+/* Frames not acknowledged within this time (in milliseconds) are given up */
+#define SHADOW_RATE_ACK_TIMEOUT 2000
+
+/* The base latency is the minimum of this window (in milliseconds) */
+#define SHADOW_RATE_BASE_WINDOW 10000
+
+/* Round-trip measurements older than this (in milliseconds) are ignored */
+#define SHADOW_RATE_NETWORK_TIMEOUT 2000
+
+/* Interval (in milliseconds) of the round-trip measurements and the delivery rate samples */
+#define SHADOW_RATE_PROBE_INTERVAL 1000
+#define SHADOW_RATE_SAMPLE_INTERVAL 100
+
+/* The delivery rate is the maximum of this many samples */
+#define SHADOW_RATE_SAMPLES 16
+
+/* Interval (in milliseconds) to retry a dropped frame while frames are in flight */
+#define SHADOW_RATE_POLL_INTERVAL 20
+
+typedef struct
+{
+	UINT32 frameId;
+	UINT64 time;
+	size_t bytes;
+} SHADOW_RATE_FRAME;
+
+struct rdp_shadow_rate_control
+{
+	UINT32 maxFps;
+	UINT32 fps;
+	UINT32 clientFps;
+	UINT32 quality;
+	UINT64 lastChange;
+	BOOL deferred;
+
+	BOOL acknowledge;
+	SHADOW_RATE_FRAME frames[SHADOW_RATE_MAX_FRAMES];
+	size_t head;
+	size_t count;
+	size_t inFlightBytes;
+	size_t pendingBytes;
+	UINT64 lastSent;
+	UINT64 lastAck;
+	UINT64 lastProbe;
+
+	/* Frame latency (send to acknowledgement) in milliseconds */
+	BOOL haveLatency;
+	UINT32 latency;
+	UINT32 baseLatency;
+	UINT64 baseLatencyTime;
+
+	/* Queueing delay seen by the auto-detect round-trip measurements */
+	UINT32 networkDelay;
+	UINT64 networkTime;
+	UINT64 networkBandwidth;
+
+	/* Delivery rate samples in bits per second */
+	UINT64 samples[SHADOW_RATE_SAMPLES];
+	size_t sampleIndex;
+	size_t deliveredBytes;
+	UINT64 sampleTime;
+
+	UINT32 clientTime;
+};
+
+WINPR_ATTR_NODISCARD
+static UINT32 shadow_rate_fps(const rdpShadowRateControl* rate)
+{
+	WINPR_ASSERT(rate);
+	return MAX(1, MIN(rate->fps, rate->clientFps));
+}
+
+WINPR_ATTR_NODISCARD
+static UINT64 shadow_rate_bandwidth(const rdpShadowRateControl* rate)
+{
+	WINPR_ASSERT(rate);
+
+	/* Both are lower bounds, the delivery rate is only as high as the data sent */
+	UINT64 bandwidth = rate->networkBandwidth;
+	for (size_t i = 0; i < SHADOW_RATE_SAMPLES; i++)
+		bandwidth = MAX(bandwidth, rate->samples[i]);
+	return bandwidth;
+}
+
+WINPR_ATTR_NODISCARD
+static UINT32 shadow_rate_queue_delay(const rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	UINT32 delay = 0;
+	if (rate->haveLatency && (rate->latency > rate->baseLatency))
+		delay = rate->latency - rate->baseLatency;
+	if ((rate->networkTime > 0) && (now - rate->networkTime < SHADOW_RATE_NETWORK_TIMEOUT))
+		delay = MAX(delay, rate->networkDelay);
+	return delay;
+}
+
+static void shadow_rate_degrade(rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	/* Quality first, a frame rate reduction does not shorten the transfer of a large frame */
+	if (rate->quality < SHADOW_RATE_QUALITY_MAX)
+		rate->quality++;
+	else
+		rate->fps = MAX(1, rate->fps * 3 / 4);
+
+	rate->lastChange = now;
+	WLog_DBG(TAG, "congestion, quality %" PRIu32 " at %" PRIu32 " fps", rate->quality,
+	         rate->fps);
+}
+
+static void shadow_rate_improve(rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	if (rate->fps < rate->maxFps)
+		rate->fps = MIN(rate->maxFps, rate->fps + MAX(2, rate->fps / 4));
+	else if (rate->quality > 0)
+		rate->quality--;
+	else
+		return;
+
+	rate->lastChange = now;
+	WLog_DBG(TAG, "headroom, quality %" PRIu32 " at %" PRIu32 " fps", rate->quality, rate->fps);
+}
+
+static void shadow_rate_update(rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	const UINT32 delay = shadow_rate_queue_delay(rate, now);
+	const UINT64 elapsed = now - rate->lastChange;
+
+	if (delay > SHADOW_RATE_TARGET_DELAY)
+	{
+		if (elapsed >= SHADOW_RATE_DEGRADE_INTERVAL)
+			shadow_rate_degrade(rate, now);
+	}
+	else if (delay < SHADOW_RATE_TARGET_DELAY / 2)
+	{
+		if (elapsed >= SHADOW_RATE_IMPROVE_INTERVAL)
+			shadow_rate_improve(rate, now);
+	}
+}
+
+static void shadow_rate_clear_frames(rdpShadowRateControl* rate)
+{
+	WINPR_ASSERT(rate);
+
+	rate->head = 0;
+	rate->count = 0;
+	rate->inFlightBytes = 0;
+}
+
+static void shadow_rate_expire(rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	if (rate->count == 0)
+		return;
+
+	/* Some clients skip acknowledgements, do not wait for those forever */
+	const SHADOW_RATE_FRAME* oldest = &rate->frames[rate->head];
+	if (now - oldest->time < SHADOW_RATE_ACK_TIMEOUT)
+		return;
+
+	WLog_DBG(TAG, "frame %" PRIu32 " not acknowledged after %" PRIu64 " ms", oldest->frameId,
+	         now - oldest->time);
+	shadow_rate_clear_frames(rate);
+	shadow_rate_degrade(rate, now);
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_rate_ready(rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	shadow_rate_expire(rate, now);
+
+	/* Allow some jitter of the capture timer */
+	const UINT32 interval = 1000 / shadow_rate_fps(rate);
+	if ((rate->lastSent > 0) && (now - rate->lastSent < interval * 3ull / 4ull))
+		return FALSE;
+
+	if (!rate->acknowledge || (rate->count == 0))
+		return TRUE;
+
+	if (rate->count >= SHADOW_RATE_MAX_FRAMES)
+		return FALSE;
+
+	/* Keep no more in flight than the link delivers within the target latency */
+	const UINT64 window = 1ull * rate->baseLatency + SHADOW_RATE_TARGET_DELAY;
+	if (1ull * rate->count * interval > window)
+		return FALSE;
+
+	const UINT64 bandwidth = shadow_rate_bandwidth(rate);
+	if ((bandwidth > 0) && (8000ull * rate->inFlightBytes > bandwidth * window))
+		return FALSE;
+
+	return TRUE;
+}
+
+BOOL shadow_rate_control_can_send(rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	if (shadow_rate_ready(rate, now))
+		return TRUE;
+
+	rate->deferred = TRUE;
+	return FALSE;
+}
+
+BOOL shadow_rate_control_resume(rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	shadow_rate_expire(rate, now);
+
+	/* Nothing was acknowledged for a while because nothing was sent, the link is idle */
+	if ((rate->count == 0) && (now - rate->lastAck >= SHADOW_RATE_IMPROVE_INTERVAL) &&
+	    (now - rate->lastChange >= SHADOW_RATE_IMPROVE_INTERVAL))
+	{
+		rate->latency = rate->baseLatency;
+		shadow_rate_improve(rate, now);
+	}
+
+	if (!rate->deferred || !shadow_rate_ready(rate, now))
+		return FALSE;
+
+	rate->deferred = FALSE;
+	return TRUE;
+}
+
+DWORD shadow_rate_control_timeout(const rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	if (rate->deferred)
+	{
+		const UINT64 interval = 1000 / shadow_rate_fps(rate);
+		const UINT64 elapsed = now - rate->lastSent;
+		if (elapsed < interval * 3 / 4)
+			return (DWORD)(interval * 3 / 4 - elapsed);
+		return SHADOW_RATE_POLL_INTERVAL;
+	}
+
+	if ((rate->quality > 0) || (rate->fps < rate->maxFps))
+	{
+		const UINT64 elapsed = now - rate->lastChange;
+		if (elapsed < SHADOW_RATE_IMPROVE_INTERVAL)
+			return (DWORD)(SHADOW_RATE_IMPROVE_INTERVAL - elapsed);
+		return SHADOW_RATE_IMPROVE_INTERVAL;
+	}
+
+	return INFINITE;
+}
+
+void shadow_rate_control_add_bytes(rdpShadowRateControl* rate, size_t bytes)
+{
+	WINPR_ASSERT(rate);
+	rate->pendingBytes += bytes;
+}
+
+void shadow_rate_control_frame_sent(rdpShadowRateControl* rate, UINT32 frameId, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	const size_t bytes = rate->pendingBytes;
+	rate->pendingBytes = 0;
+	rate->lastSent = now;
+
+	if (!rate->acknowledge || (frameId == 0))
+		return;
+
+	if (rate->count >= SHADOW_RATE_MAX_FRAMES)
+	{
+		rate->inFlightBytes -= rate->frames[rate->head].bytes;
+		rate->head = (rate->head + 1) % SHADOW_RATE_MAX_FRAMES;
+		rate->count--;
+	}
+
+	SHADOW_RATE_FRAME* frame = &rate->frames[(rate->head + rate->count) % SHADOW_RATE_MAX_FRAMES];
+	frame->frameId = frameId;
+	frame->time = now;
+	frame->bytes = bytes;
+	rate->count++;
+	rate->inFlightBytes += bytes;
+}
+
+static void shadow_rate_sample(rdpShadowRateControl* rate, size_t bytes, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	rate->deliveredBytes += bytes;
+	if (rate->sampleTime == 0)
+	{
+		rate->deliveredBytes = 0;
+		rate->sampleTime = now;
+		return;
+	}
+
+	const UINT64 elapsed = now - rate->sampleTime;
+	if (elapsed < SHADOW_RATE_SAMPLE_INTERVAL)
+		return;
+
+	rate->samples[rate->sampleIndex] = 8000ull * rate->deliveredBytes / elapsed;
+	rate->sampleIndex = (rate->sampleIndex + 1) % SHADOW_RATE_SAMPLES;
+	rate->deliveredBytes = 0;
+	rate->sampleTime = now;
+}
+
+void shadow_rate_control_frame_acked(rdpShadowRateControl* rate, UINT32 frameId, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	BOOL acked = FALSE;
+	UINT64 latency = 0;
+	size_t bytes = 0;
+
+	while (rate->count > 0)
+	{
+		const SHADOW_RATE_FRAME* frame = &rate->frames[rate->head];
+
+		/* frame ids wrap around */
+		if ((INT32)(frame->frameId - frameId) > 0)
+			break;
+
+		acked = TRUE;
+		latency = now - frame->time;
+		bytes += frame->bytes;
+		rate->inFlightBytes -= frame->bytes;
+		rate->head = (rate->head + 1) % SHADOW_RATE_MAX_FRAMES;
+		rate->count--;
+	}
+
+	if (!acked)
+		return;
+
+	rate->lastAck = now;
+	shadow_rate_sample(rate, bytes, now);
+
+	const UINT32 sample = (UINT32)MIN(latency, UINT32_MAX);
+	if (!rate->haveLatency || (sample < rate->baseLatency) ||
+	    (now - rate->baseLatencyTime >= SHADOW_RATE_BASE_WINDOW))
+	{
+		rate->baseLatency = sample;
+		rate->baseLatencyTime = now;
+	}
+
+	/* Follow a draining queue quickly, few frames are acknowledged at a low frame rate */
+	if (!rate->haveLatency)
+		rate->latency = sample;
+	else if (sample < rate->latency)
+		rate->latency = (UINT32)((1ull * rate->latency + sample) / 2ull);
+	else
+		rate->latency = (UINT32)((7ull * rate->latency + sample) / 8ull);
+	rate->haveLatency = TRUE;
+
+	shadow_rate_update(rate, now);
+}
+
+void shadow_rate_control_set_acknowledge(rdpShadowRateControl* rate, BOOL enabled)
+{
+	WINPR_ASSERT(rate);
+
+	if (rate->acknowledge == enabled)
+		return;
+
+	rate->acknowledge = enabled;
+	shadow_rate_clear_frames(rate);
+}
+
+void shadow_rate_control_client_time(rdpShadowRateControl* rate, UINT32 time, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+	WINPR_UNUSED(now);
+
+	rate->clientTime = (rate->clientTime == 0) ? time : (3 * rate->clientTime + time) / 4;
+
+	/* Do not send more frames than the client decodes */
+	rate->clientFps = rate->maxFps;
+	if (rate->clientTime > 0)
+		rate->clientFps = MAX(1, MIN(rate->maxFps, 1000 / rate->clientTime));
+}
+
+void shadow_rate_control_network(rdpShadowRateControl* rate, UINT32 rtt, UINT32 baseRTT,
+                                 UINT32 bandwidth, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	if (bandwidth > 0)
+		rate->networkBandwidth = 1000ull * bandwidth;
+
+	if ((rtt > 0) && (baseRTT > 0))
+	{
+		/* The measurement PDUs queue up behind the graphics data */
+		rate->networkDelay = (rtt > baseRTT) ? rtt - baseRTT : 0;
+		rate->networkTime = now;
+		shadow_rate_update(rate, now);
+	}
+}
+
+BOOL shadow_rate_control_probe(rdpShadowRateControl* rate, UINT64 now)
+{
+	WINPR_ASSERT(rate);
+
+	if (now - rate->lastProbe < SHADOW_RATE_PROBE_INTERVAL)
+		return FALSE;
+
+	rate->lastProbe = now;
+	return TRUE;
+}
+
+void shadow_rate_control_get_target(const rdpShadowRateControl* rate, SHADOW_RATE_TARGET* target)
+{
+	WINPR_ASSERT(rate);
+	WINPR_ASSERT(target);
+
+	target->fps = shadow_rate_fps(rate);
+	target->quality = rate->quality;
+	/* Not the delivery rate, an encoder that follows the rate it produces never recovers */
+	target->bitRate = (UINT32)MIN(rate->networkBandwidth, UINT32_MAX);
+}
+
+void shadow_rate_control_reset(rdpShadowRateControl* rate)
+{
+	WINPR_ASSERT(rate);
+
+	const UINT32 maxFps = rate->maxFps;
+	const BOOL acknowledge = rate->acknowledge;
+	*rate = (rdpShadowRateControl){ .maxFps = maxFps,
+		                            .fps = maxFps,
+		                            .clientFps = maxFps,
+		                            .acknowledge = acknowledge };
+}
+
+rdpShadowRateControl* shadow_rate_control_new(UINT32 maxFps)
+{
+	rdpShadowRateControl* rate = calloc(1, sizeof(rdpShadowRateControl));
+	if (!rate)
+		return nullptr;
+
+	rate->maxFps = MAX(1, maxFps);
+	shadow_rate_control_reset(rate);
+	return rate;
+}
+
+void shadow_rate_control_free(rdpShadowRateControl* rate)
+{
+	free(rate);
+}
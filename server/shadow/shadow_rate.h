@@ -0,0 +1,133 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_RATE_H
+#define FREERDP_SERVER_SHADOW_RATE_H
+
+#include <winpr/wtypes.h>
+
+/* The coarsest quality level, 0 is full quality */
+#define SHADOW_RATE_QUALITY_MAX 4
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	typedef struct rdp_shadow_rate_control rdpShadowRateControl;
+
+	typedef struct
+	{
+		UINT32 fps;     /**< The frame rate the link and the client keep up with */
+		UINT32 quality; /**< 0 for full quality up to \b SHADOW_RATE_QUALITY_MAX */
+		UINT32 bitRate; /**< The measured bandwidth in bits per second, 0 if unknown */
+	} SHADOW_RATE_TARGET;
+
+	void shadow_rate_control_free(rdpShadowRateControl* rate);
+
+	WINPR_ATTR_MALLOC(shadow_rate_control_free, 1)
+	WINPR_ATTR_NODISCARD
+	rdpShadowRateControl* shadow_rate_control_new(UINT32 maxFps);
+
+	/**
+	 * @brief Forgets all measurements and starts over at full quality, called whenever the
+	 * client was (re)activated.
+	 */
+	void shadow_rate_control_reset(rdpShadowRateControl* rate);
+
+	/**
+	 * @brief Decides if a frame may be sent now.
+	 *
+	 * A frame is dropped if it comes earlier than the target frame rate allows or if the
+	 * frames in flight exceed what the link delivers within the target latency. The caller
+	 * keeps the damage of a dropped frame, see shadow_rate_control_resume.
+	 *
+	 * @return \b TRUE if the frame should be sent, \b FALSE if it should be dropped
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_rate_control_can_send(rdpShadowRateControl* rate, UINT64 now);
+
+	/**
+	 * @brief Checks if a dropped frame can be sent now.
+	 *
+	 * @return \b TRUE once after a frame was dropped and the link has room again
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_rate_control_resume(rdpShadowRateControl* rate, UINT64 now);
+
+	/**
+	 * @return The time in milliseconds until shadow_rate_control_resume should be called
+	 * again, \b INFINITE if no frame was dropped
+	 */
+	WINPR_ATTR_NODISCARD DWORD shadow_rate_control_timeout(const rdpShadowRateControl* rate,
+	                                                       UINT64 now);
+
+	/**
+	 * @brief Accounts \b bytes of encoded data to the frame currently being sent.
+	 */
+	void shadow_rate_control_add_bytes(rdpShadowRateControl* rate, size_t bytes);
+
+	/**
+	 * @brief Records the frame currently being sent as complete.
+	 *
+	 * @param frameId The frame id the client acknowledges, \b 0 for frames without
+	 * acknowledgement
+	 */
+	void shadow_rate_control_frame_sent(rdpShadowRateControl* rate, UINT32 frameId, UINT64 now);
+
+	/**
+	 * @brief Records a frame acknowledgement. An acknowledgement covers all earlier frames.
+	 */
+	void shadow_rate_control_frame_acked(rdpShadowRateControl* rate, UINT32 frameId, UINT64 now);
+
+	/**
+	 * @brief Stops or resumes latency tracking, for clients that suspend frame
+	 * acknowledgement.
+	 */
+	void shadow_rate_control_set_acknowledge(rdpShadowRateControl* rate, BOOL enabled);
+
+	/**
+	 * @brief Records the time in milliseconds the client needed to decode and render a frame,
+	 * as reported with RDPGFX_QOE_FRAME_ACKNOWLEDGE_PDU.
+	 */
+	void shadow_rate_control_client_time(rdpShadowRateControl* rate, UINT32 time, UINT64 now);
+
+	/**
+	 * @brief Records the network characteristics measured with auto-detection.
+	 *
+	 * @param rtt The current round-trip time in milliseconds, \b 0 if unknown
+	 * @param baseRTT The lowest round-trip time in milliseconds, \b 0 if unknown
+	 * @param bandwidth The bandwidth in kilobits per second, \b 0 if unknown
+	 */
+	void shadow_rate_control_network(rdpShadowRateControl* rate, UINT32 rtt, UINT32 baseRTT,
+	                                 UINT32 bandwidth, UINT64 now);
+
+	/**
+	 * @brief Rate limits the auto-detect round-trip measurements.
+	 *
+	 * @return \b TRUE if a measurement should be started now
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_rate_control_probe(rdpShadowRateControl* rate, UINT64 now);
+
+	/**
+	 * @brief Returns the current encoding targets.
+	 */
+	void shadow_rate_control_get_target(const rdpShadowRateControl* rate,
+	                                    SHADOW_RATE_TARGET* target);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_RATE_H */
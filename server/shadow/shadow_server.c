@@ -567,6 +567,16 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 				return fail_at(arg, COMMAND_LINE_ERROR);
 		}
 #endif
+		CommandLineSwitchCase(arg, "gfx-progressive-passes")
+		{
+			errno = 0;
+			const unsigned long val = strtoul(arg->Value, nullptr, 0);
+
+			if ((errno != 0) || (val < 1) || (val > 4))
+				return fail_at(arg, COMMAND_LINE_ERROR);
+
+			server->GfxProgressivePasses = (UINT32)val;
+		}
 		CommandLineSwitchCase(arg, "gfx-rfx")
 		{
 			if (!freerdp_settings_set_bool(settings, FreeRDP_RemoteFxCodec, arg->Value != nullptr))
@@ -577,6 +587,18 @@ int shadow_server_parse_command_line(rdpShadowServer* server, int argc, char** a
 			if (!freerdp_settings_set_bool(settings, FreeRDP_GfxPlanar, arg->Value != nullptr))
 				return fail_at(arg, COMMAND_LINE_ERROR);
 		}
+		CommandLineSwitchCase(arg, "gfx-clear")
+		{
+			server->GfxClearCodec = arg->Value != nullptr;
+		}
+		CommandLineSwitchCase(arg, "gfx-cache")
+		{
+			server->GfxTileCache = arg->Value != nullptr;
+		}
+		CommandLineSwitchCase(arg, "rate-control")
+		{
+			server->RateControl = arg->Value != nullptr;
+		}
 		CommandLineSwitchCase(arg, "gfx-avc420")
 		{
 			if (!freerdp_settings_set_bool(settings, FreeRDP_GfxH264, arg->Value != nullptr))
@@ -792,6 +814,22 @@ int shadow_server_start(rdpShadowServer* server)
 		return -1;
 	}
 
+	server->encodeCache = shadow_encode_cache_new(server);
+
+	if (!server->encodeCache)
+	{
+		WLog_ERR(TAG, "encode_cache_new failed");
+		return -1;
+	}
+
+	server->tileFrame = shadow_tile_frame_new();
+
+	if (!server->tileFrame)
+	{
+		WLog_ERR(TAG, "tile_frame_new failed");
+		return -1;
+	}
+
 	/* Bind magic:
 	 *
 	 * empty                 ... bind TCP all
@@ -882,6 +920,12 @@ int shadow_server_stop(rdpShadowServer* server)
 		server->capture = nullptr;
 	}
 
+	shadow_encode_cache_free(server->encodeCache);
+	server->encodeCache = nullptr;
+
+	shadow_tile_frame_free(server->tileFrame);
+	server->tileFrame = nullptr;
+
 	return 0;
 }
 
@@ -1130,6 +1174,8 @@ rdpShadowServer* shadow_server_new(void)
 		return nullptr;
 
 	server->SupportMultiRectBitmapUpdates = TRUE;
+	server->GfxTileCache = TRUE;
+	server->GfxProgressivePasses = 1;
 	server->port = 3389;
 	server->mayView = TRUE;
 	server->mayInteract = TRUE;
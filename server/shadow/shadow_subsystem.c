@@ -292,5 +292,12 @@ int shadow_subsystem_pointer_convert_alpha_pointer_data_to_format(
 
 void shadow_subsystem_frame_update(rdpShadowSubsystem* subsystem)
 {
+	/* The surface content changed, clients must not share encodings of the last frame */
+	if (subsystem->server)
+	{
+		shadow_encode_cache_next_frame(subsystem->server->encodeCache);
+		shadow_tile_frame_next(subsystem->server->tileFrame);
+	}
+
 	shadow_multiclient_publish_and_wait(subsystem->updateEvent);
 }
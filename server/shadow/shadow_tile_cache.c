@@ -0,0 +1,724 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <freerdp/config.h>
+
+#include <winpr/assert.h>
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/codec/color.h>
+#include <freerdp/log.h>
+
+#include "shadow_tile_cache.h"
+
+#define TAG SERVER_TAG("shadow.tilecache")
+
+/* [MS-RDPEGFX] 3.3.1.4 the client cache holds up to 100MB (16MB with the small cache) in
+ * 25600 (4096) slots. Every slot is accounted as a full tile. */
+#define SHADOW_TILE_BYTES (SHADOW_TILE_SIZE * SHADOW_TILE_SIZE * 4ull)
+#define SHADOW_TILE_CACHE_BYTES (100ull * 1024ull * 1024ull)
+#define SHADOW_TILE_CACHE_BYTES_SMALL (16ull * 1024ull * 1024ull)
+#define SHADOW_TILE_CACHE_SLOTS 25600
+#define SHADOW_TILE_CACHE_SLOTS_SMALL 4096
+
+#define SHADOW_TILE_PRIME1 0x9E3779B185EBCA87ull
+#define SHADOW_TILE_PRIME2 0xC2B2AE3D27D4EB4Full
+
+typedef struct
+{
+	UINT64 key;
+	UINT64 frame;
+	BOOL used;
+	BOOL referenced;
+} SHADOW_TILE_SLOT;
+
+typedef struct
+{
+	UINT64 key;
+	BOOL valid;
+} SHADOW_TILE_POSITION;
+
+/* A copy of a frame and the keys of its tiles */
+typedef struct
+{
+	BYTE* data;
+	UINT64* keys;
+	BOOL valid;
+} SHADOW_TILE_BUFFER;
+
+struct rdp_shadow_tile_frame
+{
+	CRITICAL_SECTION lock;
+	UINT64 frame;
+
+	/* The frame the current buffer holds */
+	UINT64 hashed;
+	const BYTE* source;
+	UINT32 sourceStep;
+
+	UINT32 width;
+	UINT32 height;
+	UINT32 format;
+	UINT32 step;
+	UINT32 columns;
+	UINT32 rows;
+
+	/* The current and the previously hashed frame, swapped for every new frame */
+	SHADOW_TILE_BUFFER buffers[2];
+	size_t current;
+
+	/* The move between the previous and the current buffer, detected once per frame */
+	UINT64 motionFrame;
+	BOOL moved;
+	SHADOW_MOTION motion;
+
+	UINT64 passes;
+};
+
+struct rdp_shadow_tile_cache
+{
+	/* Cache slots, index 0 is unused as slot 0 is reserved by the protocol */
+	SHADOW_TILE_SLOT* slots;
+	UINT32 maxSlots;
+	UINT32 hand;
+
+	/* Open addressing key -> slot map with linear probing, 0 marks an empty bucket */
+	UINT16* map;
+	size_t mapMask;
+
+	/* What the client surface shows */
+	SHADOW_TILE_POSITION* positions;
+	UINT32 columns;
+	UINT32 rows;
+	UINT32 width;
+	UINT32 height;
+
+	UINT64 frame;
+	UINT32 stores;
+	UINT32 maxStores;
+
+	UINT64 hits;
+	UINT64 misses;
+	UINT64 unchanged;
+};
+
+static inline UINT64 shadow_tile_rotl(UINT64 value, unsigned bits)
+{
+	return (value << bits) | (value >> (64u - bits));
+}
+
+static inline UINT64 shadow_tile_mix(UINT64 acc, UINT64 value)
+{
+	acc ^= value * SHADOW_TILE_PRIME2;
+	return shadow_tile_rotl(acc, 31) * SHADOW_TILE_PRIME1;
+}
+
+static inline UINT64 shadow_tile_read64(const BYTE* data)
+{
+	UINT64 value = 0;
+	memcpy(&value, data, sizeof(value));
+	return value;
+}
+
+/* A fast non cryptographic hash over the tile pixels. Four independent lanes keep the
+ * multiplier busy, the dimensions and the format are part of the seed. */
+WINPR_ATTR_NODISCARD
+static UINT64 shadow_tile_hash(const BYTE* pSrcData, UINT32 nSrcStep, UINT32 format, UINT32 width,
+                               UINT32 height)
+{
+	const size_t rowBytes = 1ull * width * FreeRDPGetBytesPerPixel(format);
+	UINT64 lanes[4] = { SHADOW_TILE_PRIME1, SHADOW_TILE_PRIME2, format,
+		                ((UINT64)width << 32) | height };
+
+	for (UINT32 y = 0; y < height; y++)
+	{
+		const BYTE* row = &pSrcData[1ull * y * nSrcStep];
+		size_t x = 0;
+
+		for (; x + 32 <= rowBytes; x += 32)
+		{
+			lanes[0] = shadow_tile_mix(lanes[0], shadow_tile_read64(&row[x]));
+			lanes[1] = shadow_tile_mix(lanes[1], shadow_tile_read64(&row[x + 8]));
+			lanes[2] = shadow_tile_mix(lanes[2], shadow_tile_read64(&row[x + 16]));
+			lanes[3] = shadow_tile_mix(lanes[3], shadow_tile_read64(&row[x + 24]));
+		}
+
+		for (; x < rowBytes; x++)
+			lanes[0] = shadow_tile_mix(lanes[0], row[x]);
+	}
+
+	UINT64 hash = shadow_tile_rotl(lanes[0], 1) + shadow_tile_rotl(lanes[1], 7) +
+	              shadow_tile_rotl(lanes[2], 12) + shadow_tile_rotl(lanes[3], 18);
+
+	/* final avalanche */
+	hash ^= hash >> 33;
+	hash *= SHADOW_TILE_PRIME2;
+	hash ^= hash >> 29;
+	hash *= SHADOW_TILE_PRIME1;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+static inline size_t shadow_tile_bucket(const rdpShadowTileCache* cache, UINT64 key)
+{
+	return (size_t)(key ^ (key >> 32)) & cache->mapMask;
+}
+
+WINPR_ATTR_NODISCARD
+static UINT16 shadow_tile_map_get(const rdpShadowTileCache* cache, UINT64 key)
+{
+	for (size_t bucket = shadow_tile_bucket(cache, key);; bucket = (bucket + 1) & cache->mapMask)
+	{
+		const UINT16 slot = cache->map[bucket];
+		if ((slot == 0) || (cache->slots[slot].key == key))
+			return slot;
+	}
+}
+
+static void shadow_tile_map_put(rdpShadowTileCache* cache, UINT64 key, UINT16 slot)
+{
+	size_t bucket = shadow_tile_bucket(cache, key);
+
+	while (cache->map[bucket] != 0)
+		bucket = (bucket + 1) & cache->mapMask;
+	cache->map[bucket] = slot;
+}
+
+/* Backward shift deletion, keeps the probe sequences intact without tombstones */
+static void shadow_tile_map_remove(rdpShadowTileCache* cache, UINT64 key)
+{
+	size_t hole = shadow_tile_bucket(cache, key);
+
+	while (cache->map[hole] != 0)
+	{
+		if (cache->slots[cache->map[hole]].key == key)
+			break;
+		hole = (hole + 1) & cache->mapMask;
+	}
+
+	if (cache->map[hole] == 0)
+		return;
+
+	size_t next = hole;
+	for (;;)
+	{
+		next = (next + 1) & cache->mapMask;
+
+		const UINT16 slot = cache->map[next];
+		if (slot == 0)
+			break;
+
+		const size_t home = shadow_tile_bucket(cache, cache->slots[slot].key);
+		const size_t distNext = (next - home) & cache->mapMask;
+		const size_t distHole = (next - hole) & cache->mapMask;
+		if (distNext >= distHole)
+		{
+			cache->map[hole] = slot;
+			hole = next;
+		}
+	}
+
+	cache->map[hole] = 0;
+}
+
+/* Clock replacement, entries used since the hand passed them get a second chance. Slots stored
+ * in the current frame are never evicted, the client might not have them yet. */
+WINPR_ATTR_NODISCARD
+static UINT16 shadow_tile_cache_evict(rdpShadowTileCache* cache)
+{
+	/* Two rounds clear all reference bits, anything left is pinned by the current frame */
+	for (UINT32 x = 0; x < 2 * cache->maxSlots; x++)
+	{
+		cache->hand = (cache->hand % cache->maxSlots) + 1;
+
+		SHADOW_TILE_SLOT* slot = &cache->slots[cache->hand];
+		if (!slot->used)
+			return (UINT16)cache->hand;
+
+		if (slot->frame == cache->frame)
+			continue;
+
+		if (slot->referenced)
+		{
+			slot->referenced = FALSE;
+			continue;
+		}
+
+		shadow_tile_map_remove(cache, slot->key);
+		slot->used = FALSE;
+		return (UINT16)cache->hand;
+	}
+
+	return 0;
+}
+
+static void shadow_tile_cache_assign(rdpShadowTileCache* cache, UINT16 index, UINT64 key)
+{
+	SHADOW_TILE_SLOT* slot = &cache->slots[index];
+
+	WINPR_ASSERT(!slot->used);
+	slot->key = key;
+	slot->frame = cache->frame;
+	slot->used = TRUE;
+	slot->referenced = FALSE;
+	shadow_tile_map_put(cache, key, index);
+}
+
+BOOL shadow_tile_cache_reset(rdpShadowTileCache* cache, BOOL smallCache)
+{
+	WINPR_ASSERT(cache);
+
+	const UINT64 bytes = smallCache ? SHADOW_TILE_CACHE_BYTES_SMALL : SHADOW_TILE_CACHE_BYTES;
+	const UINT32 maxSlots = smallCache ? SHADOW_TILE_CACHE_SLOTS_SMALL : SHADOW_TILE_CACHE_SLOTS;
+	const UINT32 slots = (UINT32)MIN(maxSlots, bytes / SHADOW_TILE_BYTES);
+
+	size_t buckets = 1;
+	while (buckets < 2ull * slots)
+		buckets <<= 1;
+
+	SHADOW_TILE_SLOT* newSlots = calloc(slots + 1ull, sizeof(SHADOW_TILE_SLOT));
+	UINT16* map = calloc(buckets, sizeof(UINT16));
+	if (!newSlots || !map)
+	{
+		free(newSlots);
+		free(map);
+		return FALSE;
+	}
+
+	free(cache->slots);
+	free(cache->map);
+	cache->slots = newSlots;
+	cache->maxSlots = slots;
+	cache->hand = 0;
+	cache->map = map;
+	cache->mapMask = buckets - 1;
+	return TRUE;
+}
+
+BOOL shadow_tile_cache_set_surface(rdpShadowTileCache* cache, UINT32 width, UINT32 height)
+{
+	WINPR_ASSERT(cache);
+
+	const UINT32 columns = (width + SHADOW_TILE_SIZE - 1) / SHADOW_TILE_SIZE;
+	const UINT32 rows = (height + SHADOW_TILE_SIZE - 1) / SHADOW_TILE_SIZE;
+
+	SHADOW_TILE_POSITION* positions = calloc(1ull * columns * rows, sizeof(SHADOW_TILE_POSITION));
+	if (!positions && (columns * rows > 0))
+		return FALSE;
+
+	free(cache->positions);
+	cache->positions = positions;
+	cache->columns = columns;
+	cache->rows = rows;
+	cache->width = width;
+	cache->height = height;
+	return TRUE;
+}
+
+const BYTE* shadow_tile_cache_get_previous(rdpShadowTileCache* cache, rdpShadowTileFrame* frame)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(frame);
+
+	const SHADOW_TILE_BUFFER* previous = &frame->buffers[frame->current ^ 1];
+	if (!previous->valid || (cache->columns != frame->columns) || (cache->rows != frame->rows))
+		return nullptr;
+
+	for (size_t index = 0; index < 1ull * cache->columns * cache->rows; index++)
+	{
+		const SHADOW_TILE_POSITION* position = &cache->positions[index];
+		if (!position->valid || (position->key != previous->keys[index]))
+			return nullptr;
+	}
+
+	return previous->data;
+}
+
+void shadow_tile_cache_invalidate(rdpShadowTileCache* cache)
+{
+	WINPR_ASSERT(cache);
+
+	for (size_t index = 0; index < 1ull * cache->columns * cache->rows; index++)
+		cache->positions[index].valid = FALSE;
+}
+
+BOOL shadow_tile_cache_move(rdpShadowTileCache* cache, rdpShadowTileFrame* frame,
+                            const RECTANGLE_16* rectSrc, UINT16 x, UINT16 y)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(frame);
+	WINPR_ASSERT(rectSrc);
+
+	const UINT32 width = 1u * rectSrc->right - rectSrc->left;
+	const UINT32 height = 1u * rectSrc->bottom - rectSrc->top;
+	if ((width == 0) || (height == 0) || (rectSrc->right > cache->width) ||
+	    (rectSrc->bottom > cache->height) || (x + width > cache->width) ||
+	    (y + height > cache->height) || (cache->columns != frame->columns) ||
+	    (cache->rows != frame->rows))
+		return FALSE;
+
+	/* The moved area matches the current frame, tiles it covers entirely show the current
+	 * content. The contents of partially covered tiles are not known. */
+	const SHADOW_TILE_BUFFER* current = &frame->buffers[frame->current];
+	const UINT32 lastColumn = (x + width - 1) / SHADOW_TILE_SIZE;
+	const UINT32 lastRow = (y + height - 1) / SHADOW_TILE_SIZE;
+
+	for (UINT32 row = y / SHADOW_TILE_SIZE; row <= lastRow; row++)
+	{
+		for (UINT32 column = x / SHADOW_TILE_SIZE; column <= lastColumn; column++)
+		{
+			const UINT32 left = column * SHADOW_TILE_SIZE;
+			const UINT32 top = row * SHADOW_TILE_SIZE;
+			const UINT32 right = MIN(cache->width, left + SHADOW_TILE_SIZE);
+			const UINT32 bottom = MIN(cache->height, top + SHADOW_TILE_SIZE);
+			const size_t index = 1ull * row * cache->columns + column;
+
+			SHADOW_TILE_POSITION* position = &cache->positions[index];
+			if ((left >= x) && (top >= y) && (right <= x + width) && (bottom <= y + height))
+			{
+				position->key = current->keys[index];
+				position->valid = TRUE;
+			}
+			else
+				position->valid = FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+BOOL shadow_tile_cache_import(rdpShadowTileCache* cache,
+                              const RDPGFX_CACHE_IMPORT_OFFER_PDU* offer,
+                              RDPGFX_CACHE_IMPORT_REPLY_PDU* reply)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(offer);
+	WINPR_ASSERT(reply);
+
+	if (offer->cacheEntriesCount > RDPGFX_CACHE_ENTRY_MAX_COUNT)
+		return FALSE;
+
+	UINT32 imported = 0;
+	reply->importedEntriesCount = offer->cacheEntriesCount;
+
+	for (UINT16 index = 0; index < offer->cacheEntriesCount; index++)
+	{
+		const RDPGFX_CACHE_ENTRY_METADATA* entry = &offer->cacheEntries[index];
+
+		/* Slot 0 tells the client to skip the entry */
+		reply->cacheSlots[index] = 0;
+
+		/* Edge tiles are smaller, their dimensions are part of the key */
+		if ((entry->bitmapLength == 0) || (entry->bitmapLength > SHADOW_TILE_BYTES))
+			continue;
+		if ((cache->maxSlots == 0) || (shadow_tile_map_get(cache, entry->cacheKey) != 0))
+			continue;
+
+		const UINT16 slot = shadow_tile_cache_evict(cache);
+		if (slot == 0)
+			continue;
+
+		shadow_tile_cache_assign(cache, slot, entry->cacheKey);
+		reply->cacheSlots[index] = slot;
+		imported++;
+	}
+
+	WLog_DBG(TAG, "imported %" PRIu32 " of %" PRIu16 " offered cache entries", imported,
+	         offer->cacheEntriesCount);
+	return TRUE;
+}
+
+void shadow_tile_cache_begin_frame(rdpShadowTileCache* cache, UINT32 maxStores)
+{
+	WINPR_ASSERT(cache);
+
+	cache->frame++;
+	cache->stores = 0;
+
+	/* Keep enough slots that can be evicted, a frame must not overwrite its own entries */
+	cache->maxStores = MIN(maxStores, cache->maxSlots / 4);
+}
+
+void shadow_tile_cache_check(rdpShadowTileCache* cache, rdpShadowTileFrame* frame,
+                             SHADOW_TILE* tile)
+{
+	WINPR_ASSERT(cache);
+	WINPR_ASSERT(frame);
+	WINPR_ASSERT(tile);
+
+	const RECTANGLE_16* rect = &tile->rect;
+	const UINT32 column = rect->left / SHADOW_TILE_SIZE;
+	const UINT32 row = rect->top / SHADOW_TILE_SIZE;
+	WINPR_ASSERT(column < cache->columns);
+	WINPR_ASSERT(row < cache->rows);
+	WINPR_ASSERT((cache->columns == frame->columns) && (cache->rows == frame->rows));
+
+	const size_t index = 1ull * row * cache->columns + column;
+	const UINT64 key = frame->buffers[frame->current].keys[index];
+
+	tile->key = key;
+	tile->slot = 0;
+
+	SHADOW_TILE_POSITION* position = &cache->positions[index];
+	if (position->valid && (position->key == key))
+	{
+		cache->unchanged++;
+		tile->state = SHADOW_TILE_UNCHANGED;
+		return;
+	}
+
+	position->key = key;
+	position->valid = TRUE;
+
+	if (cache->maxSlots == 0)
+	{
+		tile->state = SHADOW_TILE_ENCODE;
+		return;
+	}
+
+	const UINT16 slot = shadow_tile_map_get(cache, key);
+	if (slot != 0)
+	{
+		SHADOW_TILE_SLOT* entry = &cache->slots[slot];
+		entry->referenced = TRUE;
+		cache->hits++;
+		tile->slot = slot;
+		tile->state = (entry->frame == cache->frame) ? SHADOW_TILE_PENDING : SHADOW_TILE_CACHED;
+		return;
+	}
+
+	cache->misses++;
+	if (cache->stores >= cache->maxStores)
+	{
+		tile->state = SHADOW_TILE_ENCODE;
+		return;
+	}
+
+	tile->slot = shadow_tile_cache_evict(cache);
+	if (tile->slot == 0)
+	{
+		tile->state = SHADOW_TILE_ENCODE;
+		return;
+	}
+
+	shadow_tile_cache_assign(cache, tile->slot, key);
+	cache->stores++;
+	tile->state = SHADOW_TILE_STORE;
+}
+
+rdpShadowTileCache* shadow_tile_cache_new(void)
+{
+	return (rdpShadowTileCache*)calloc(1, sizeof(rdpShadowTileCache));
+}
+
+void shadow_tile_cache_free(rdpShadowTileCache* cache)
+{
+	if (!cache)
+		return;
+
+	WLog_DBG(TAG, "%" PRIu64 " tiles unchanged, %" PRIu64 " cache hits, %" PRIu64 " misses",
+	         cache->unchanged, cache->hits, cache->misses);
+
+	free(cache->slots);
+	free(cache->map);
+	free(cache->positions);
+	free(cache);
+}
+
+static void shadow_tile_buffer_free(SHADOW_TILE_BUFFER* buffer)
+{
+	WINPR_ASSERT(buffer);
+
+	free(buffer->data);
+	free(buffer->keys);
+	buffer->data = nullptr;
+	buffer->keys = nullptr;
+	buffer->valid = FALSE;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL shadow_tile_frame_resize(rdpShadowTileFrame* frame, UINT32 width, UINT32 height,
+                                     UINT32 format, UINT32 step)
+{
+	WINPR_ASSERT(frame);
+
+	if ((frame->width == width) && (frame->height == height) && (frame->format == format) &&
+	    (frame->step == step))
+		return TRUE;
+
+	const UINT32 columns = (width + SHADOW_TILE_SIZE - 1) / SHADOW_TILE_SIZE;
+	const UINT32 rows = (height + SHADOW_TILE_SIZE - 1) / SHADOW_TILE_SIZE;
+
+	frame->width = 0;
+	frame->height = 0;
+	frame->columns = 0;
+	frame->rows = 0;
+	frame->hashed = 0;
+	frame->motionFrame = 0;
+
+	for (size_t x = 0; x < ARRAYSIZE(frame->buffers); x++)
+	{
+		SHADOW_TILE_BUFFER* buffer = &frame->buffers[x];
+
+		shadow_tile_buffer_free(buffer);
+		buffer->data = calloc(MAX(1, height), step);
+		buffer->keys = calloc(MAX(1ull, 1ull * columns * rows), sizeof(UINT64));
+		if (!buffer->data || !buffer->keys)
+			return FALSE;
+	}
+
+	frame->width = width;
+	frame->height = height;
+	frame->format = format;
+	frame->step = step;
+	frame->columns = columns;
+	frame->rows = rows;
+	return TRUE;
+}
+
+BOOL shadow_tile_frame_begin(rdpShadowTileFrame* frame, const BYTE* pSrcData, UINT32 nSrcStep,
+                             UINT32 format, UINT32 width, UINT32 height)
+{
+	WINPR_ASSERT(frame);
+	WINPR_ASSERT(pSrcData);
+	WINPR_ASSERT(1ull * width * FreeRDPGetBytesPerPixel(format) <= nSrcStep);
+
+	EnterCriticalSection(&frame->lock);
+
+	if ((frame->hashed == frame->frame) && (frame->source == pSrcData) &&
+	    (frame->sourceStep == nSrcStep) && (frame->format == format) && (frame->width == width) &&
+	    (frame->height == height))
+		return TRUE;
+
+	if (!shadow_tile_frame_resize(frame, width, height, format, nSrcStep))
+	{
+		LeaveCriticalSection(&frame->lock);
+		return FALSE;
+	}
+
+	/* The current frame becomes the previous one, the older buffer is updated tile by tile */
+	frame->current ^= 1;
+	SHADOW_TILE_BUFFER* current = &frame->buffers[frame->current];
+	const size_t bpp = FreeRDPGetBytesPerPixel(format);
+
+	for (UINT32 row = 0; row < frame->rows; row++)
+	{
+		for (UINT32 column = 0; column < frame->columns; column++)
+		{
+			const UINT32 left = column * SHADOW_TILE_SIZE;
+			const UINT32 top = row * SHADOW_TILE_SIZE;
+			const UINT32 tileWidth = MIN(SHADOW_TILE_SIZE, width - left);
+			const UINT32 tileHeight = MIN(SHADOW_TILE_SIZE, height - top);
+			const size_t offset = 1ull * top * nSrcStep + bpp * left;
+			const size_t index = 1ull * row * frame->columns + column;
+
+			const UINT64 key =
+			    shadow_tile_hash(&pSrcData[offset], nSrcStep, format, tileWidth, tileHeight);
+			if (current->valid && (current->keys[index] == key))
+				continue;
+
+			current->keys[index] = key;
+			for (UINT32 y = 0; y < tileHeight; y++)
+				memcpy(&current->data[offset + 1ull * y * nSrcStep],
+				       &pSrcData[offset + 1ull * y * nSrcStep], bpp * tileWidth);
+		}
+	}
+
+	current->valid = TRUE;
+	frame->hashed = frame->frame;
+	frame->source = pSrcData;
+	frame->sourceStep = nSrcStep;
+	frame->passes++;
+	return TRUE;
+}
+
+void shadow_tile_frame_end(rdpShadowTileFrame* frame)
+{
+	WINPR_ASSERT(frame);
+	LeaveCriticalSection(&frame->lock);
+}
+
+void shadow_tile_frame_next(rdpShadowTileFrame* frame)
+{
+	if (!frame)
+		return;
+
+	EnterCriticalSection(&frame->lock);
+	frame->frame++;
+	LeaveCriticalSection(&frame->lock);
+}
+
+BOOL shadow_tile_frame_get_motion(rdpShadowTileFrame* frame, SHADOW_MOTION* motion)
+{
+	WINPR_ASSERT(frame);
+	WINPR_ASSERT(motion);
+
+	const SHADOW_TILE_BUFFER* current = &frame->buffers[frame->current];
+	const SHADOW_TILE_BUFFER* previous = &frame->buffers[frame->current ^ 1];
+	if (!current->valid || !previous->valid || (FreeRDPGetBytesPerPixel(frame->format) != 4))
+		return FALSE;
+
+	if (frame->motionFrame != frame->hashed)
+	{
+		frame->moved = shadow_motion_detect(previous->data, current->data, frame->step,
+		                                    frame->width, frame->height, &frame->motion);
+		frame->motionFrame = frame->hashed;
+	}
+
+	*motion = frame->motion;
+	return frame->moved;
+}
+
+UINT64 shadow_tile_frame_get_passes(rdpShadowTileFrame* frame)
+{
+	WINPR_ASSERT(frame);
+
+	EnterCriticalSection(&frame->lock);
+	const UINT64 passes = frame->passes;
+	LeaveCriticalSection(&frame->lock);
+	return passes;
+}
+
+rdpShadowTileFrame* shadow_tile_frame_new(void)
+{
+	rdpShadowTileFrame* frame = (rdpShadowTileFrame*)calloc(1, sizeof(rdpShadowTileFrame));
+	if (!frame)
+		return nullptr;
+
+	if (!InitializeCriticalSectionAndSpinCount(&frame->lock, 4000))
+	{
+		free(frame);
+		return nullptr;
+	}
+
+	/* Frame 0 is never hashed, the first begin always runs a pass */
+	frame->frame = 1;
+	return frame;
+}
+
+void shadow_tile_frame_free(rdpShadowTileFrame* frame)
+{
+	if (!frame)
+		return;
+
+	WLog_DBG(TAG, "%" PRIu64 " hash passes", frame->passes);
+
+	for (size_t x = 0; x < ARRAYSIZE(frame->buffers); x++)
+		shadow_tile_buffer_free(&frame->buffers[x]);
+	DeleteCriticalSection(&frame->lock);
+	free(frame);
+}
@@ -0,0 +1,178 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FREERDP_SERVER_SHADOW_TILE_CACHE_H
+#define FREERDP_SERVER_SHADOW_TILE_CACHE_H
+
+#include <winpr/wtypes.h>
+
+#include <freerdp/types.h>
+#include <freerdp/channels/rdpgfx.h>
+#include <freerdp/server/shadow.h>
+
+#include "shadow_motion.h"
+
+#define SHADOW_TILE_SIZE 64
+
+/* Limits the SurfaceToCache PDUs sent with a single frame */
+#define SHADOW_TILE_CACHE_MAX_STORES 256
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+	typedef enum
+	{
+		SHADOW_TILE_UNCHANGED, /**< The client already shows the tile */
+		SHADOW_TILE_CACHED,    /**< Resident in \b slot since an earlier frame */
+		SHADOW_TILE_PENDING,   /**< Stored to \b slot in this frame, draw after SurfaceToCache */
+		SHADOW_TILE_STORE,     /**< Encode the tile, then SurfaceToCache it to \b slot */
+		SHADOW_TILE_ENCODE     /**< Encode the tile */
+	} SHADOW_TILE_STATE;
+
+	typedef struct
+	{
+		RECTANGLE_16 rect;
+		UINT64 key;
+		UINT16 slot;
+		SHADOW_TILE_STATE state;
+	} SHADOW_TILE;
+
+	void shadow_tile_cache_free(rdpShadowTileCache* cache);
+
+	WINPR_ATTR_MALLOC(shadow_tile_cache_free, 1)
+	WINPR_ATTR_NODISCARD
+	rdpShadowTileCache* shadow_tile_cache_new(void);
+
+	/**
+	 * @brief Forgets all cache slots, called whenever the capabilities were confirmed.
+	 *
+	 * @param smallCache \b TRUE if the client announced RDPGFX_CAPS_FLAG_SMALL_CACHE
+	 * @return \b TRUE for success, \b FALSE otherwise
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_tile_cache_reset(rdpShadowTileCache* cache, BOOL smallCache);
+
+	/**
+	 * @brief Forgets the contents of the client surface, called whenever a new surface was
+	 * created. The cache slots are kept, they are not bound to a surface.
+	 *
+	 * @return \b TRUE for success, \b FALSE otherwise
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_tile_cache_set_surface(rdpShadowTileCache* cache,
+	                                                        UINT32 width, UINT32 height);
+
+	/**
+	 * @brief Returns the previous frame if that is what the client surface shows.
+	 *
+	 * Only valid between shadow_tile_frame_begin and shadow_tile_frame_end.
+	 *
+	 * @return The previous frame with the stride of the current one or \b nullptr
+	 */
+	WINPR_ATTR_NODISCARD const BYTE* shadow_tile_cache_get_previous(rdpShadowTileCache* cache,
+	                                                                rdpShadowTileFrame* frame);
+
+	/**
+	 * @brief Forgets the contents of the client surface, every tile is sent again. Used after
+	 * tiles were sent at reduced quality.
+	 */
+	void shadow_tile_cache_invalidate(rdpShadowTileCache* cache);
+
+	/**
+	 * @brief Records a SurfaceToSurface of \b rectSrc to \b x / \b y on the client surface.
+	 *
+	 * The moved area must match the current frame of \b frame, see
+	 * shadow_tile_frame_get_motion.
+	 *
+	 * @return \b TRUE for success, \b FALSE otherwise
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_tile_cache_move(rdpShadowTileCache* cache,
+	                                                 rdpShadowTileFrame* frame,
+	                                                 const RECTANGLE_16* rectSrc, UINT16 x,
+	                                                 UINT16 y);
+
+	/**
+	 * @brief Accepts the persistent cache entries offered by the client.
+	 *
+	 * Entries of up to a full tile are imported, the keys are the content hashes this cache uses.
+	 *
+	 * @return \b TRUE for success, \b FALSE otherwise
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_tile_cache_import(rdpShadowTileCache* cache,
+	                                                   const RDPGFX_CACHE_IMPORT_OFFER_PDU* offer,
+	                                                   RDPGFX_CACHE_IMPORT_REPLY_PDU* reply);
+
+	/**
+	 * @brief Starts a new frame, at most \b maxStores tiles are stored to the cache per frame.
+	 */
+	void shadow_tile_cache_begin_frame(rdpShadowTileCache* cache, UINT32 maxStores);
+
+	/**
+	 * @brief Decides how the tile \b tile->rect of the current frame of \b frame is sent.
+	 *
+	 * The result is written to \b tile, the tile is expected to be sent unless it is
+	 * \b SHADOW_TILE_UNCHANGED.
+	 */
+	void shadow_tile_cache_check(rdpShadowTileCache* cache, rdpShadowTileFrame* frame,
+	                             SHADOW_TILE* tile);
+
+	void shadow_tile_frame_free(rdpShadowTileFrame* frame);
+
+	WINPR_ATTR_MALLOC(shadow_tile_frame_free, 1)
+	WINPR_ATTR_NODISCARD
+	rdpShadowTileFrame* shadow_tile_frame_new(void);
+
+	/**
+	 * @brief Marks the surface as changed, called whenever the subsystem updated it.
+	 */
+	void shadow_tile_frame_next(rdpShadowTileFrame* frame);
+
+	/**
+	 * @brief Locks the tile keys of the frame in \b pSrcData for the tile pass of a client.
+	 *
+	 * The tiles are hashed once per frame for all clients, a copy of the frame is kept as the
+	 * previous frame of the next one. Must be followed by shadow_tile_frame_end on success.
+	 *
+	 * @return \b TRUE for success, \b FALSE otherwise
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_tile_frame_begin(rdpShadowTileFrame* frame,
+	                                                  const BYTE* pSrcData, UINT32 nSrcStep,
+	                                                  UINT32 format, UINT32 width, UINT32 height);
+
+	void shadow_tile_frame_end(rdpShadowTileFrame* frame);
+
+	/**
+	 * @brief Returns the move from the previous to the current frame, see shadow_motion_detect.
+	 *
+	 * The detection runs once per frame for all clients. Only valid between
+	 * shadow_tile_frame_begin and shadow_tile_frame_end, clients use it if
+	 * shadow_tile_cache_get_previous returns the previous frame.
+	 *
+	 * @return \b TRUE if a move was detected, \b FALSE otherwise
+	 */
+	WINPR_ATTR_NODISCARD BOOL shadow_tile_frame_get_motion(rdpShadowTileFrame* frame,
+	                                                       SHADOW_MOTION* motion);
+
+	/**
+	 * @return The number of hash passes run so far
+	 */
+	WINPR_ATTR_NODISCARD UINT64 shadow_tile_frame_get_passes(rdpShadowTileFrame* frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FREERDP_SERVER_SHADOW_TILE_CACHE_H */
@@ -0,0 +1,318 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shadow server shared encoding cache test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/crypto.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+
+#include <freerdp/codec/color.h>
+
+#include "shadow_encode_cache.h"
+
+#define TEST_WIDTH 128
+#define TEST_HEIGHT 64
+#define TEST_FORMAT PIXEL_FORMAT_BGRX32
+#define TEST_STEP (TEST_WIDTH * 4)
+#define TEST_THREADS 4
+
+static const UINT32 test_quant[10] = { 8, 8, 8, 9, 9, 10, 10, 11, 11, 12 };
+
+typedef struct
+{
+	rdpShadowEncodeCache* cache;
+	RFX_CONTEXT* rfx;
+	const BYTE* data;
+	HANDLE start;
+	BOOL rc;
+} test_thread;
+
+static RFX_CONTEXT* test_rfx_new(RLGR_MODE mode, const UINT32* quant)
+{
+	RFX_CONTEXT* rfx = rfx_context_new(TRUE);
+	if (!rfx)
+		return nullptr;
+
+	rfx_context_set_pixel_format(rfx, TEST_FORMAT);
+	if (!rfx_context_reset(rfx, TEST_WIDTH, TEST_HEIGHT) || !rfx_context_set_mode(rfx, mode) ||
+	    (quant && !rfx_context_set_quantization(rfx, quant, ARRAYSIZE(test_quant))))
+	{
+		rfx_context_free(rfx);
+		return nullptr;
+	}
+	return rfx;
+}
+
+static BOOL test_check_stats(rdpShadowEncodeCache* cache, UINT64 encoded, UINT64 reused)
+{
+	UINT64 e = 0;
+	UINT64 r = 0;
+
+	shadow_encode_cache_get_stats(cache, &e, &r);
+	if ((e == encoded) && (r == reused))
+		return TRUE;
+
+	(void)fprintf(stderr, "expected %" PRIu64 " encoded, %" PRIu64 " reused, got %" PRIu64
+	                      " encoded, %" PRIu64 " reused\n",
+	              encoded, reused, e, r);
+	return FALSE;
+}
+
+/* Writes the cached message for \b rfx and checks it against a message encoded by \b expect */
+static BOOL test_write_rfx(rdpShadowEncodeCache* cache, RFX_CONTEXT* rfx, RFX_CONTEXT* expect,
+                           const BYTE* data)
+{
+	BOOL rc = FALSE;
+	const RFX_RECT rect = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+	wStream* s = Stream_New(nullptr, 1024);
+	wStream* e = Stream_New(nullptr, 1024);
+
+	if (!s || !e)
+		goto fail;
+
+	if (!shadow_encode_cache_write_rfx(cache, rfx, s, &rect, data, TEST_WIDTH, TEST_HEIGHT,
+	                                   TEST_STEP))
+		goto fail;
+	if (!rfx_compose_message(expect, e, &rect, 1, data, TEST_WIDTH, TEST_HEIGHT, TEST_STEP))
+		goto fail;
+
+	/* Same tiles, and the frame index of the client context advanced */
+	rc = (Stream_GetPosition(s) == Stream_GetPosition(e)) &&
+	     (memcmp(Stream_Buffer(s), Stream_Buffer(e), Stream_GetPosition(s)) == 0) &&
+	     (rfx_context_get_frame_idx(rfx) == rfx_context_get_frame_idx(expect));
+fail:
+	Stream_Free(s, TRUE);
+	Stream_Free(e, TRUE);
+	return rc;
+}
+
+static BOOL test_rfx(rdpShadowEncodeCache* cache, BYTE* data)
+{
+	BOOL rc = FALSE;
+	RFX_CONTEXT* a = test_rfx_new(RLGR3, nullptr);
+	RFX_CONTEXT* b = test_rfx_new(RLGR3, nullptr);
+	RFX_CONTEXT* expectA = test_rfx_new(RLGR3, nullptr);
+	RFX_CONTEXT* expectB = test_rfx_new(RLGR3, nullptr);
+
+	if (!a || !b || !expectA || !expectB)
+		goto fail;
+
+	/* The first client encodes, the second one with the same settings reuses */
+	if (!test_write_rfx(cache, a, expectA, data) || !test_check_stats(cache, 1, 0))
+		goto fail;
+	if (!test_write_rfx(cache, b, expectB, data) || !test_check_stats(cache, 1, 1))
+		goto fail;
+
+	/* Changed quantization is a miss, the previous encoding stays available */
+	if (!rfx_context_set_quantization(b, test_quant, ARRAYSIZE(test_quant)) ||
+	    !rfx_context_set_quantization(expectB, test_quant, ARRAYSIZE(test_quant)))
+		goto fail;
+	if (!test_write_rfx(cache, b, expectB, data) || !test_check_stats(cache, 2, 1))
+		goto fail;
+	if (!test_write_rfx(cache, a, expectA, data) || !test_check_stats(cache, 2, 2))
+		goto fail;
+	if (!test_write_rfx(cache, b, expectB, data) || !test_check_stats(cache, 2, 3))
+		goto fail;
+
+	/* Changed mode is a miss */
+	if (!rfx_context_set_mode(b, RLGR1) || !rfx_context_set_mode(expectB, RLGR1))
+		goto fail;
+	if (!test_write_rfx(cache, b, expectB, data) || !test_check_stats(cache, 3, 3))
+		goto fail;
+
+	/* A new frame invalidates everything */
+	if (winpr_RAND(data, TEST_STEP * TEST_HEIGHT) < 0)
+		goto fail;
+	shadow_encode_cache_next_frame(cache);
+	if (!test_write_rfx(cache, a, expectA, data) || !test_check_stats(cache, 4, 3))
+		goto fail;
+	if (!test_write_rfx(cache, b, expectB, data) || !test_check_stats(cache, 5, 3))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	rfx_context_free(a);
+	rfx_context_free(b);
+	rfx_context_free(expectA);
+	rfx_context_free(expectB);
+	return rc;
+}
+
+static DWORD WINAPI test_rfx_thread(LPVOID arg)
+{
+	test_thread* thread = arg;
+	WINPR_ASSERT(thread);
+
+	const RFX_RECT rect = { 0, 0, TEST_WIDTH, TEST_HEIGHT };
+	wStream* s = Stream_New(nullptr, 1024);
+	if (!s)
+		return 0;
+
+	(void)WaitForSingleObject(thread->start, INFINITE);
+	thread->rc = shadow_encode_cache_write_rfx(thread->cache, thread->rfx, s, &rect, thread->data,
+	                                           TEST_WIDTH, TEST_HEIGHT, TEST_STEP);
+	Stream_Free(s, TRUE);
+	return 0;
+}
+
+/* Clients asking for the same encoding at the same time wait for a single encoder */
+static BOOL test_rfx_concurrent(rdpShadowEncodeCache* cache, const BYTE* data)
+{
+	BOOL rc = FALSE;
+	UINT64 encoded = 0;
+	UINT64 reused = 0;
+	HANDLE threads[TEST_THREADS] = WINPR_C_ARRAY_INIT;
+	test_thread args[TEST_THREADS] = WINPR_C_ARRAY_INIT;
+	HANDLE start = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+	if (!start)
+		return FALSE;
+
+	shadow_encode_cache_next_frame(cache);
+	shadow_encode_cache_get_stats(cache, &encoded, &reused);
+
+	size_t count = 0;
+	for (; count < TEST_THREADS; count++)
+	{
+		args[count].cache = cache;
+		args[count].data = data;
+		args[count].start = start;
+		args[count].rfx = test_rfx_new(RLGR3, nullptr);
+		if (!args[count].rfx)
+			break;
+
+		threads[count] = CreateThread(nullptr, 0, test_rfx_thread, &args[count], 0, nullptr);
+		if (!threads[count])
+		{
+			rfx_context_free(args[count].rfx);
+			break;
+		}
+	}
+
+	(void)SetEvent(start);
+
+	rc = (count == TEST_THREADS);
+	for (size_t x = 0; x < count; x++)
+	{
+		(void)WaitForSingleObject(threads[x], INFINITE);
+		(void)CloseHandle(threads[x]);
+		rc &= args[x].rc;
+		rfx_context_free(args[x].rfx);
+	}
+	(void)CloseHandle(start);
+
+	return rc && test_check_stats(cache, encoded + 1, reused + TEST_THREADS - 1);
+}
+
+static BOOL test_planar(rdpShadowEncodeCache* cache, const BYTE* data)
+{
+	BOOL rc = FALSE;
+	UINT32 sizeA = 0;
+	UINT32 sizeB = 0;
+	UINT32 sizeC = 0;
+	BYTE* a = nullptr;
+	BYTE* b = nullptr;
+	BYTE* c = nullptr;
+	UINT64 encoded = 0;
+	UINT64 reused = 0;
+	const DWORD rle = PLANAR_FORMAT_HEADER_RLE;
+	BITMAP_PLANAR_CONTEXT* planar =
+	    freerdp_bitmap_planar_context_new(rle, TEST_WIDTH, TEST_HEIGHT);
+
+	if (!planar)
+		return FALSE;
+
+	shadow_encode_cache_next_frame(cache);
+	shadow_encode_cache_get_stats(cache, &encoded, &reused);
+
+	a = shadow_encode_cache_compress_planar(cache, planar, rle, data, TEST_FORMAT, TEST_WIDTH,
+	                                        TEST_HEIGHT, TEST_STEP, &sizeA);
+	if (!a || !test_check_stats(cache, encoded + 1, reused))
+		goto fail;
+
+	b = shadow_encode_cache_compress_planar(cache, planar, rle, data, TEST_FORMAT, TEST_WIDTH,
+	                                        TEST_HEIGHT, TEST_STEP, &sizeB);
+	if (!b || !test_check_stats(cache, encoded + 1, reused + 1))
+		goto fail;
+
+	/* Every client gets its own copy */
+	if ((a == b) || (sizeA != sizeB) || (memcmp(a, b, sizeA) != 0))
+		goto fail;
+
+	c = shadow_encode_cache_compress_planar(cache, planar, PLANAR_FORMAT_HEADER_NA, data,
+	                                        TEST_FORMAT, TEST_WIDTH, TEST_HEIGHT, TEST_STEP,
+	                                        &sizeC);
+	if (!c || !test_check_stats(cache, encoded + 2, reused + 1))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	free(a);
+	free(b);
+	free(c);
+	freerdp_bitmap_planar_context_free(planar);
+	return rc;
+}
+
+int TestShadowEncodeCache(int argc, char* argv[])
+{
+	int rc = -1;
+	rdpShadowServer server = WINPR_C_ARRAY_INIT;
+	rdpShadowEncodeCache* cache = nullptr;
+	BYTE* data = malloc(TEST_STEP * TEST_HEIGHT);
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	server.settings = freerdp_settings_new(FREERDP_SETTINGS_SERVER_MODE);
+	if (!data || !server.settings)
+		goto fail;
+
+	if (winpr_RAND(data, TEST_STEP * TEST_HEIGHT) < 0)
+		goto fail;
+
+	cache = shadow_encode_cache_new(&server);
+	if (!cache)
+		goto fail;
+
+	if (!test_rfx(cache, data))
+	{
+		(void)fprintf(stderr, "RemoteFX encoding cache failed\n");
+		goto fail;
+	}
+
+	if (!test_rfx_concurrent(cache, data))
+	{
+		(void)fprintf(stderr, "concurrent RemoteFX encoding cache failed\n");
+		goto fail;
+	}
+
+	if (!test_planar(cache, data))
+	{
+		(void)fprintf(stderr, "planar encoding cache failed\n");
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+	shadow_encode_cache_free(cache);
+	freerdp_settings_free(server.settings);
+	free(data);
+	return rc;
+}
@@ -0,0 +1,216 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shadow server motion detection test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include "shadow_motion.h"
+
+#define TEST_WIDTH 320
+#define TEST_HEIGHT 240
+/* Padding at the end of every line, it must not take part in the detection */
+#define TEST_STEP ((TEST_WIDTH + 8) * 4)
+
+typedef enum
+{
+	TEST_MOTION_NONE,  /**< Nothing changes */
+	TEST_MOTION_SHIFT, /**< The area scrolls by dx / dy, the exposed part is new content */
+	TEST_MOTION_NOISE, /**< The area is replaced with new content */
+	TEST_MOTION_FILL   /**< The area is filled with a single color */
+} TEST_MOTION_KIND;
+
+typedef struct
+{
+	const char* name;
+	TEST_MOTION_KIND kind;
+	RECTANGLE_16 area;
+	INT32 dx;
+	INT32 dy;
+	BOOL expect;
+} test_motion_case;
+
+static const test_motion_case test_cases[] = {
+	{ "scroll up", TEST_MOTION_SHIFT, { 0, 0, TEST_WIDTH, TEST_HEIGHT }, 0, -30, TRUE },
+	{ "scroll down in window", TEST_MOTION_SHIFT, { 40, 20, 300, 220 }, 0, 17, TRUE },
+	{ "scroll left", TEST_MOTION_SHIFT, { 0, 0, TEST_WIDTH, TEST_HEIGHT }, -25, 0, TRUE },
+	{ "scroll right in window", TEST_MOTION_SHIFT, { 10, 30, 310, 200 }, 40, 0, TRUE },
+	{ "scroll by one line", TEST_MOTION_SHIFT, { 0, 0, TEST_WIDTH, TEST_HEIGHT }, 0, 1, TRUE },
+	{ "unchanged", TEST_MOTION_NONE, { 0, 0, TEST_WIDTH, TEST_HEIGHT }, 0, 0, FALSE },
+	{ "new content", TEST_MOTION_NOISE, { 0, 0, TEST_WIDTH, TEST_HEIGHT }, 0, 0, FALSE },
+	{ "new content in window", TEST_MOTION_NOISE, { 50, 50, 250, 150 }, 0, 0, FALSE },
+	{ "filled", TEST_MOTION_FILL, { 0, 0, TEST_WIDTH, TEST_HEIGHT }, 0, 0, FALSE },
+	{ "short window", TEST_MOTION_SHIFT, { 0, 100, TEST_WIDTH, 150 }, 0, -10, FALSE },
+	{ "narrow window", TEST_MOTION_SHIFT, { 100, 0, 140, TEST_HEIGHT }, 0, -10, FALSE },
+	{ "scrolled too far", TEST_MOTION_SHIFT, { 0, 0, TEST_WIDTH, TEST_HEIGHT }, 0, -200, FALSE },
+	{ "diagonal", TEST_MOTION_SHIFT, { 0, 0, TEST_WIDTH, TEST_HEIGHT }, 20, 20, FALSE },
+};
+
+/* A texture without repeating lines, every seed gives different content */
+static UINT32 test_texture(UINT32 x, UINT32 y, UINT32 seed)
+{
+	UINT32 value = x * 0x9E3779B1u ^ y * 0x85EBCA77u ^ seed * 0xC2B2AE3Du;
+	value ^= value >> 15;
+	value *= 0x2C1B3C6Du;
+	value ^= value >> 12;
+	return value;
+}
+
+static inline UINT32 test_get(const BYTE* data, UINT32 x, UINT32 y)
+{
+	UINT32 pixel = 0;
+	memcpy(&pixel, &data[1ull * y * TEST_STEP + 4ull * x], sizeof(pixel));
+	return pixel;
+}
+
+static inline void test_set(BYTE* data, UINT32 x, UINT32 y, UINT32 pixel)
+{
+	memcpy(&data[1ull * y * TEST_STEP + 4ull * x], &pixel, sizeof(pixel));
+}
+
+static inline BOOL test_inside(const RECTANGLE_16* rect, INT64 x, INT64 y)
+{
+	return (x >= rect->left) && (x < rect->right) && (y >= rect->top) && (y < rect->bottom);
+}
+
+static void test_generate(const test_motion_case* test, BYTE* prev, BYTE* cur)
+{
+	for (UINT32 y = 0; y < TEST_HEIGHT; y++)
+	{
+		for (UINT32 x = 0; x < TEST_WIDTH; x++)
+			test_set(prev, x, y, test_texture(x, y, 1));
+	}
+
+	/* The padding differs, a detection must not depend on it */
+	memset(cur, 0xA5, 1ull * TEST_STEP * TEST_HEIGHT);
+
+	const RECTANGLE_16* area = &test->area;
+	for (UINT32 y = 0; y < TEST_HEIGHT; y++)
+	{
+		for (UINT32 x = 0; x < TEST_WIDTH; x++)
+		{
+			UINT32 pixel = test_get(prev, x, y);
+
+			if (test_inside(area, x, y))
+			{
+				const INT64 sx = (INT64)x - test->dx;
+				const INT64 sy = (INT64)y - test->dy;
+
+				switch (test->kind)
+				{
+					case TEST_MOTION_SHIFT:
+						if (test_inside(area, sx, sy))
+							pixel = test_get(prev, (UINT32)sx, (UINT32)sy);
+						else
+							pixel = test_texture(x, y, 2);
+						break;
+					case TEST_MOTION_NOISE:
+						pixel = test_texture(x, y, 3);
+						break;
+					case TEST_MOTION_FILL:
+						pixel = 0xFF336699;
+						break;
+					case TEST_MOTION_NONE:
+					default:
+						break;
+				}
+			}
+
+			test_set(cur, x, y, pixel);
+		}
+	}
+}
+
+/* Copying the source rectangle of the previous frame must reproduce the current frame */
+static BOOL test_verify(const test_motion_case* test, const BYTE* prev, const BYTE* cur,
+                        const SHADOW_MOTION* motion)
+{
+	const RECTANGLE_16* src = &motion->rectSrc;
+	const UINT32 width = 1u * src->right - src->left;
+	const UINT32 height = 1u * src->bottom - src->top;
+
+	if ((src->right <= src->left) || (src->bottom <= src->top) || (src->right > TEST_WIDTH) ||
+	    (src->bottom > TEST_HEIGHT) || (motion->x + width > TEST_WIDTH) ||
+	    (motion->y + height > TEST_HEIGHT))
+		return FALSE;
+
+	for (UINT32 y = 0; y < height; y++)
+	{
+		for (UINT32 x = 0; x < width; x++)
+		{
+			if (test_get(prev, src->left + x, src->top + y) !=
+			    test_get(cur, motion->x + x, motion->y + y))
+				return FALSE;
+		}
+	}
+
+	/* The detected shift is the one applied, the whole unexposed part of the area moved */
+	const INT32 dx = (INT32)motion->x - src->left;
+	const INT32 dy = (INT32)motion->y - src->top;
+	const UINT32 areaWidth = 1u * test->area.right - test->area.left;
+	const UINT32 areaHeight = 1u * test->area.bottom - test->area.top;
+	if ((dx != test->dx) || (dy != test->dy))
+		return FALSE;
+	if (test->dy != 0)
+		return (width == areaWidth) && (height == areaHeight - (UINT32)abs(test->dy));
+	return (height == areaHeight) && (width == areaWidth - (UINT32)abs(test->dx));
+}
+
+int TestShadowMotion(int argc, char* argv[])
+{
+	int rc = -1;
+	BYTE* prev = calloc(TEST_HEIGHT, TEST_STEP);
+	BYTE* cur = calloc(TEST_HEIGHT, TEST_STEP);
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!prev || !cur)
+		goto fail;
+
+	for (size_t x = 0; x < ARRAYSIZE(test_cases); x++)
+	{
+		const test_motion_case* test = &test_cases[x];
+		SHADOW_MOTION motion = WINPR_C_ARRAY_INIT;
+
+		test_generate(test, prev, cur);
+		const BOOL detected =
+		    shadow_motion_detect(prev, cur, TEST_STEP, TEST_WIDTH, TEST_HEIGHT, &motion);
+		if (detected != test->expect)
+		{
+			(void)fprintf(stderr, "%s: expected %s, got %s\n", test->name,
+			              test->expect ? "a move" : "no move", detected ? "a move" : "no move");
+			goto fail;
+		}
+
+		if (detected && !test_verify(test, prev, cur, &motion))
+		{
+			(void)fprintf(stderr,
+			              "%s: wrong move [%" PRIu16 "x%" PRIu16 "-%" PRIu16 "x%" PRIu16
+			              "] to %" PRIu16 "x%" PRIu16 "\n",
+			              test->name, motion.rectSrc.left, motion.rectSrc.top,
+			              motion.rectSrc.right, motion.rectSrc.bottom, motion.x, motion.y);
+			goto fail;
+		}
+	}
+
+	rc = 0;
+fail:
+	free(prev);
+	free(cur);
+	return rc;
+}
@@ -0,0 +1,290 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shadow server rate control test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+
+#include <freerdp/types.h>
+
+#include "shadow_rate.h"
+
+#define TEST_FPS 30
+#define TEST_FRAME_SIZE 20000
+#define TEST_BASE_LATENCY 20
+#define TEST_CONGESTED_LATENCY 200
+#define TEST_MAX_ACKS 64
+
+/* A simulated client that acknowledges every frame after a fixed latency */
+typedef struct
+{
+	rdpShadowRateControl* rate;
+	UINT64 now;
+	UINT32 frameId;
+	UINT32 latency;
+	UINT64 ackTime[TEST_MAX_ACKS];
+	UINT32 ackId[TEST_MAX_ACKS];
+	size_t acks;
+	size_t sent;
+	size_t changes;
+	UINT64 lastChange;
+	UINT64 minChangeInterval;
+	BOOL misordered;
+	SHADOW_RATE_TARGET target;
+} test_client;
+
+static void test_client_init(test_client* client, rdpShadowRateControl* rate)
+{
+	*client = (test_client){ .rate = rate, .now = 1000, .latency = TEST_BASE_LATENCY };
+	client->minChangeInterval = UINT64_MAX;
+	shadow_rate_control_get_target(rate, &client->target);
+}
+
+static void test_client_check_target(test_client* client)
+{
+	SHADOW_RATE_TARGET target = WINPR_C_ARRAY_INIT;
+	shadow_rate_control_get_target(client->rate, &target);
+
+	if ((target.fps == client->target.fps) && (target.quality == client->target.quality))
+		return;
+
+	/* Quality is lowered before the frame rate and restored after it */
+	if ((target.fps < client->target.fps) && (client->target.quality < SHADOW_RATE_QUALITY_MAX))
+		client->misordered = TRUE;
+	if ((target.quality < client->target.quality) && (client->target.fps < TEST_FPS))
+		client->misordered = TRUE;
+
+	if (client->changes > 0)
+		client->minChangeInterval =
+		    MIN(client->minChangeInterval, client->now - client->lastChange);
+	client->changes++;
+	client->lastChange = client->now;
+	client->target = target;
+}
+
+/* Runs the capture timer at the target frame rate for \b duration milliseconds */
+static void test_client_run(test_client* client, UINT64 duration)
+{
+	const UINT64 end = client->now + duration;
+	UINT64 nextFrame = client->now;
+
+	for (; client->now < end; client->now++)
+	{
+		while ((client->acks > 0) && (client->ackTime[0] <= client->now))
+		{
+			shadow_rate_control_frame_acked(client->rate, client->ackId[0], client->now);
+			client->acks--;
+			memmove(client->ackTime, &client->ackTime[1], client->acks * sizeof(UINT64));
+			memmove(client->ackId, &client->ackId[1], client->acks * sizeof(UINT32));
+		}
+
+		BOOL send = shadow_rate_control_resume(client->rate, client->now);
+		if (client->now >= nextFrame)
+		{
+			nextFrame = client->now + 1000 / TEST_FPS;
+			send |= shadow_rate_control_can_send(client->rate, client->now);
+		}
+
+		if (send && (client->acks < TEST_MAX_ACKS))
+		{
+			shadow_rate_control_add_bytes(client->rate, TEST_FRAME_SIZE);
+			shadow_rate_control_frame_sent(client->rate, ++client->frameId, client->now);
+			client->ackTime[client->acks] = client->now + client->latency;
+			client->ackId[client->acks] = client->frameId;
+			client->acks++;
+			client->sent++;
+		}
+
+		test_client_check_target(client);
+	}
+}
+
+/* Latency that grows beyond the target lowers quality first, then the frame rate. Once the
+ * queue drains the original targets are restored. */
+static BOOL test_step_response(void)
+{
+	BOOL rc = FALSE;
+	test_client client = WINPR_C_ARRAY_INIT;
+	rdpShadowRateControl* rate = shadow_rate_control_new(TEST_FPS);
+
+	if (!rate)
+		return FALSE;
+
+	shadow_rate_control_set_acknowledge(rate, TRUE);
+	test_client_init(&client, rate);
+
+	/* An uncongested link keeps the full frame rate at full quality */
+	test_client_run(&client, 3000);
+	if ((client.changes != 0) || (client.target.fps != TEST_FPS) || (client.target.quality != 0))
+	{
+		(void)fprintf(stderr, "idle link: %" PRIuz " changes, %" PRIu32 " fps, quality %" PRIu32
+		                      "\n",
+		              client.changes, client.target.fps, client.target.quality);
+		goto fail;
+	}
+	if (client.sent < 3 * TEST_FPS * 9 / 10)
+	{
+		(void)fprintf(stderr, "idle link: only %" PRIuz " frames sent\n", client.sent);
+		goto fail;
+	}
+
+	/* Congestion: quality first, then the frame rate, at most one step per 250 ms */
+	client.latency = TEST_CONGESTED_LATENCY;
+	test_client_run(&client, 3000);
+	if ((client.target.quality != SHADOW_RATE_QUALITY_MAX) || (client.target.fps >= TEST_FPS) ||
+	    client.misordered)
+	{
+		(void)fprintf(stderr, "congested: %" PRIu32 " fps, quality %" PRIu32 "\n",
+		              client.target.fps, client.target.quality);
+		goto fail;
+	}
+	if (client.minChangeInterval < 250)
+	{
+		(void)fprintf(stderr, "congested: changes %" PRIu64 " ms apart\n",
+		              client.minChangeInterval);
+		goto fail;
+	}
+
+	/* Fewer frames in flight than the link could take within the latency */
+	const size_t sent = client.sent;
+	test_client_run(&client, 1000);
+	if (client.sent - sent >= TEST_FPS)
+	{
+		(void)fprintf(stderr, "congested: %" PRIuz " frames sent per second\n",
+		              client.sent - sent);
+		goto fail;
+	}
+
+	/* Recovery: the frame rate first, then quality, at most one step per second */
+	client.latency = TEST_BASE_LATENCY;
+	client.changes = 0;
+	client.minChangeInterval = UINT64_MAX;
+	test_client_run(&client, 20000);
+	if ((client.target.fps != TEST_FPS) || (client.target.quality != 0) || client.misordered)
+	{
+		(void)fprintf(stderr, "recovered: %" PRIu32 " fps, quality %" PRIu32 "\n",
+		              client.target.fps, client.target.quality);
+		goto fail;
+	}
+	if ((client.changes < SHADOW_RATE_QUALITY_MAX) || (client.minChangeInterval < 1000))
+	{
+		(void)fprintf(stderr, "recovered: %" PRIuz " changes, %" PRIu64 " ms apart\n",
+		              client.changes, client.minChangeInterval);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	shadow_rate_control_free(rate);
+	return rc;
+}
+
+/* Frames that are never acknowledged are given up and count as congestion */
+static BOOL test_lost_acknowledge(void)
+{
+	BOOL rc = FALSE;
+	UINT64 now = 1000;
+	SHADOW_RATE_TARGET target = WINPR_C_ARRAY_INIT;
+	rdpShadowRateControl* rate = shadow_rate_control_new(TEST_FPS);
+
+	if (!rate)
+		return FALSE;
+
+	shadow_rate_control_set_acknowledge(rate, TRUE);
+
+	UINT32 frameId = 0;
+	for (; now < 1500; now += 1000 / TEST_FPS)
+	{
+		if (shadow_rate_control_can_send(rate, now))
+			shadow_rate_control_frame_sent(rate, ++frameId, now);
+	}
+
+	/* The frames in flight are stuck, nothing more is sent */
+	if ((frameId == 0) || shadow_rate_control_can_send(rate, now) ||
+	    (shadow_rate_control_timeout(rate, now) == INFINITE))
+		goto fail;
+
+	now += 2000;
+	if (!shadow_rate_control_resume(rate, now))
+		goto fail;
+
+	shadow_rate_control_get_target(rate, &target);
+	rc = (target.quality == 1) && (target.fps == TEST_FPS);
+fail:
+	shadow_rate_control_free(rate);
+	return rc;
+}
+
+/* The frame rate follows the time the client needs per frame, without acknowledgement only
+ * the frame interval is enforced */
+static BOOL test_client_time(void)
+{
+	BOOL rc = FALSE;
+	SHADOW_RATE_TARGET target = WINPR_C_ARRAY_INIT;
+	rdpShadowRateControl* rate = shadow_rate_control_new(TEST_FPS);
+
+	if (!rate)
+		return FALSE;
+
+	shadow_rate_control_client_time(rate, 100, 1000);
+	shadow_rate_control_get_target(rate, &target);
+	if (target.fps != 10)
+		goto fail;
+
+	if (!shadow_rate_control_can_send(rate, 1000))
+		goto fail;
+	shadow_rate_control_frame_sent(rate, 1, 1000);
+	if (shadow_rate_control_can_send(rate, 1050))
+		goto fail;
+	if (shadow_rate_control_resume(rate, 1060) || !shadow_rate_control_resume(rate, 1080))
+		goto fail;
+
+	shadow_rate_control_reset(rate);
+	shadow_rate_control_get_target(rate, &target);
+	rc = (target.fps == TEST_FPS) && (target.quality == 0) &&
+	     (shadow_rate_control_timeout(rate, 2000) == INFINITE);
+fail:
+	shadow_rate_control_free(rate);
+	return rc;
+}
+
+int TestShadowRate(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!test_step_response())
+	{
+		(void)fprintf(stderr, "rate control step response failed\n");
+		return -1;
+	}
+
+	if (!test_lost_acknowledge())
+	{
+		(void)fprintf(stderr, "rate control acknowledge timeout failed\n");
+		return -1;
+	}
+
+	if (!test_client_time())
+	{
+		(void)fprintf(stderr, "rate control client time failed\n");
+		return -1;
+	}
+
+	return 0;
+}
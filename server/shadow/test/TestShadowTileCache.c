@@ -0,0 +1,442 @@
+/**
+ * FreeRDP: A Remote Desktop Protocol Implementation
+ * Shadow server GFX tile cache test
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+
+#include <winpr/crt.h>
+
+#include <freerdp/codec/color.h>
+
+#include "shadow_tile_cache.h"
+
+/* 16x4 tiles, the last column and row are partial */
+#define TEST_WIDTH (15 * SHADOW_TILE_SIZE + 20)
+#define TEST_HEIGHT (3 * SHADOW_TILE_SIZE + 10)
+#define TEST_COLUMNS 16
+#define TEST_ROWS 4
+#define TEST_TILES (TEST_COLUMNS * TEST_ROWS)
+#define TEST_FORMAT PIXEL_FORMAT_BGRX32
+#define TEST_STEP (TEST_WIDTH * 4)
+
+/* The small cache holds 16MB of 64x64 tiles */
+#define TEST_SMALL_SLOTS 1024
+
+typedef struct
+{
+	rdpShadowTileFrame* frame;
+	BYTE* data;
+	SHADOW_TILE tiles[TEST_TILES];
+} test_frame;
+
+/* Fills tile \b index with a pattern unique to \b value */
+static void test_fill_tile(BYTE* data, size_t index, UINT32 value)
+{
+	const size_t left = (index % TEST_COLUMNS) * SHADOW_TILE_SIZE;
+	const size_t top = (index / TEST_COLUMNS) * SHADOW_TILE_SIZE;
+
+	for (size_t y = top; y < MIN(TEST_HEIGHT, top + SHADOW_TILE_SIZE); y++)
+	{
+		for (size_t x = left; x < MIN(TEST_WIDTH, left + SHADOW_TILE_SIZE); x++)
+		{
+			const UINT32 pixel = value * 0x01000193u + (UINT32)((y - top) * 64 + (x - left));
+			memcpy(&data[y * TEST_STEP + x * 4], &pixel, sizeof(pixel));
+		}
+	}
+}
+
+/* Runs the tile pass of \b cache for the current surface */
+static BOOL test_check(test_frame* frame, rdpShadowTileCache* cache, UINT32 maxStores)
+{
+	if (!shadow_tile_frame_begin(frame->frame, frame->data, TEST_STEP, TEST_FORMAT, TEST_WIDTH,
+	                             TEST_HEIGHT))
+		return FALSE;
+
+	shadow_tile_cache_begin_frame(cache, maxStores);
+	for (size_t index = 0; index < TEST_TILES; index++)
+	{
+		SHADOW_TILE* tile = &frame->tiles[index];
+		tile->rect.left = (UINT16)((index % TEST_COLUMNS) * SHADOW_TILE_SIZE);
+		tile->rect.top = (UINT16)((index / TEST_COLUMNS) * SHADOW_TILE_SIZE);
+		tile->rect.right = (UINT16)MIN(TEST_WIDTH, tile->rect.left + SHADOW_TILE_SIZE);
+		tile->rect.bottom = (UINT16)MIN(TEST_HEIGHT, tile->rect.top + SHADOW_TILE_SIZE);
+		shadow_tile_cache_check(cache, frame->frame, tile);
+	}
+
+	shadow_tile_frame_end(frame->frame);
+	return TRUE;
+}
+
+static size_t test_count(const test_frame* frame, SHADOW_TILE_STATE state)
+{
+	size_t count = 0;
+	for (size_t index = 0; index < TEST_TILES; index++)
+	{
+		if (frame->tiles[index].state == state)
+			count++;
+	}
+	return count;
+}
+
+static rdpShadowTileCache* test_cache_new(BOOL smallCache)
+{
+	rdpShadowTileCache* cache = shadow_tile_cache_new();
+	if (!cache)
+		return nullptr;
+
+	if (!shadow_tile_cache_reset(cache, smallCache) ||
+	    !shadow_tile_cache_set_surface(cache, TEST_WIDTH, TEST_HEIGHT))
+	{
+		shadow_tile_cache_free(cache);
+		return nullptr;
+	}
+	return cache;
+}
+
+/* The key depends on the tile content and dimensions only, not on its position */
+static BOOL test_hash(test_frame* frame)
+{
+	BOOL rc = FALSE;
+	rdpShadowTileCache* cache = test_cache_new(FALSE);
+	if (!cache)
+		return FALSE;
+
+	for (size_t index = 0; index < TEST_TILES; index++)
+		test_fill_tile(frame->data, index, (UINT32)(index % 4));
+
+	shadow_tile_frame_next(frame->frame);
+	if (!test_check(frame, cache, 0))
+		goto fail;
+
+	const SHADOW_TILE* tiles = frame->tiles;
+	if ((tiles[0].key != tiles[4].key) || (tiles[0].key == tiles[1].key) ||
+	    (tiles[1].key != tiles[5].key))
+		goto fail;
+
+	/* Edge tiles with the same leading pixels differ from full tiles */
+	if ((tiles[TEST_COLUMNS - 1].key == tiles[3].key) ||
+	    (tiles[TEST_TILES - TEST_COLUMNS].key == tiles[0].key))
+		goto fail;
+
+	/* A single pixel changes the key */
+	const UINT64 key = tiles[0].key;
+	frame->data[63 * TEST_STEP + 63 * 4] ^= 1;
+	shadow_tile_frame_next(frame->frame);
+	if (!test_check(frame, cache, 0) || (frame->tiles[0].key == key) ||
+	    (frame->tiles[4].key != tiles[4].key) || (test_count(frame, SHADOW_TILE_UNCHANGED) != 63))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	shadow_tile_cache_free(cache);
+	return rc;
+}
+
+/* Clients share the hash pass of a frame, each keeps track of what it was sent */
+static BOOL test_hit_miss(test_frame* frame)
+{
+	BOOL rc = FALSE;
+	rdpShadowTileCache* a = test_cache_new(FALSE);
+	rdpShadowTileCache* b = test_cache_new(FALSE);
+
+	if (!a || !b)
+		goto fail;
+
+	/* Two tiles per content, the second of each pair is a duplicate within the frame */
+	for (size_t index = 0; index < TEST_TILES; index++)
+		test_fill_tile(frame->data, index, (UINT32)(100 + index / 2));
+
+	shadow_tile_frame_next(frame->frame);
+	const UINT64 passes = shadow_tile_frame_get_passes(frame->frame);
+	if (!test_check(frame, a, SHADOW_TILE_CACHE_MAX_STORES))
+		goto fail;
+	/* The last pair of every row has an edge tile, which has a key of its own */
+	if ((test_count(frame, SHADOW_TILE_STORE) != TEST_TILES / 2 + TEST_ROWS) ||
+	    (test_count(frame, SHADOW_TILE_PENDING) != TEST_TILES / 2 - TEST_ROWS))
+		goto fail;
+
+	/* Without a store budget new tiles are just encoded */
+	if (!test_check(frame, b, 0) || (test_count(frame, SHADOW_TILE_ENCODE) != TEST_TILES))
+		goto fail;
+	if (shadow_tile_frame_get_passes(frame->frame) != passes + 1)
+		goto fail;
+
+	/* Nothing changed */
+	shadow_tile_frame_next(frame->frame);
+	if (!test_check(frame, a, SHADOW_TILE_CACHE_MAX_STORES) ||
+	    (test_count(frame, SHADOW_TILE_UNCHANGED) != TEST_TILES))
+		goto fail;
+
+	/* After invalidation every tile is drawn from the cache */
+	shadow_tile_cache_invalidate(a);
+	shadow_tile_frame_next(frame->frame);
+	if (!test_check(frame, a, SHADOW_TILE_CACHE_MAX_STORES) ||
+	    (test_count(frame, SHADOW_TILE_CACHED) != TEST_TILES))
+		goto fail;
+
+	/* A tile changing back to earlier content is a hit */
+	test_fill_tile(frame->data, 0, 1000);
+	shadow_tile_frame_next(frame->frame);
+	if (!test_check(frame, a, SHADOW_TILE_CACHE_MAX_STORES) ||
+	    (frame->tiles[0].state != SHADOW_TILE_STORE))
+		goto fail;
+	test_fill_tile(frame->data, 0, 100);
+	shadow_tile_frame_next(frame->frame);
+	if (!test_check(frame, a, SHADOW_TILE_CACHE_MAX_STORES) ||
+	    (frame->tiles[0].state != SHADOW_TILE_CACHED) ||
+	    (test_count(frame, SHADOW_TILE_UNCHANGED) != TEST_TILES - 1))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	shadow_tile_cache_free(a);
+	shadow_tile_cache_free(b);
+	return rc;
+}
+
+/* Clock replacement evicts entries not used since the hand passed, referenced entries and the
+ * entries stored in the current frame stay */
+static BOOL test_eviction(test_frame* frame)
+{
+	BOOL rc = FALSE;
+	rdpShadowTileCache* cache = test_cache_new(TRUE);
+	if (!cache)
+		return FALSE;
+
+	/* Tile 0 alternates between two contents and is looked up in every frame */
+	UINT32 value = 0;
+	const size_t rounds = 3 * TEST_SMALL_SLOTS / (TEST_TILES - 1);
+	for (size_t round = 0; round < rounds; round++)
+	{
+		test_fill_tile(frame->data, 0, (UINT32)(round % 2));
+		for (size_t index = 1; index < TEST_TILES; index++)
+			test_fill_tile(frame->data, index, 10 + value++);
+
+		shadow_tile_frame_next(frame->frame);
+		if (!test_check(frame, cache, SHADOW_TILE_CACHE_MAX_STORES))
+			goto fail;
+
+		/* Every new tile gets a slot, none of this frame is handed out twice */
+		if (test_count(frame, SHADOW_TILE_STORE) + test_count(frame, SHADOW_TILE_CACHED) !=
+		    TEST_TILES)
+			goto fail;
+
+		for (size_t x = 0; x < TEST_TILES; x++)
+		{
+			for (size_t y = x + 1; y < TEST_TILES; y++)
+			{
+				if (frame->tiles[x].slot == frame->tiles[y].slot)
+					goto fail;
+			}
+		}
+
+		if ((round >= 2) && (frame->tiles[0].state != SHADOW_TILE_CACHED))
+		{
+			(void)fprintf(stderr, "referenced tile evicted in round %" PRIuz "\n", round);
+			goto fail;
+		}
+	}
+
+	/* The tiles of the first rounds are gone */
+	shadow_tile_cache_invalidate(cache);
+	for (size_t index = 1; index < TEST_TILES; index++)
+		test_fill_tile(frame->data, index, (UINT32)(10 + index - 1));
+
+	shadow_tile_frame_next(frame->frame);
+	if (!test_check(frame, cache, SHADOW_TILE_CACHE_MAX_STORES) ||
+	    (test_count(frame, SHADOW_TILE_CACHED) != 1))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	shadow_tile_cache_free(cache);
+	return rc;
+}
+
+/* Persistent cache entries of full and edge tiles are imported with the content hash as key */
+static BOOL test_import(test_frame* frame)
+{
+	BOOL rc = FALSE;
+	RDPGFX_CACHE_IMPORT_OFFER_PDU* offer = calloc(1, sizeof(RDPGFX_CACHE_IMPORT_OFFER_PDU));
+	RDPGFX_CACHE_IMPORT_REPLY_PDU* reply = calloc(1, sizeof(RDPGFX_CACHE_IMPORT_REPLY_PDU));
+	rdpShadowTileCache* a = test_cache_new(FALSE);
+	rdpShadowTileCache* b = test_cache_new(FALSE);
+
+	if (!offer || !reply || !a || !b)
+		goto fail;
+
+	for (size_t index = 0; index < TEST_TILES; index++)
+		test_fill_tile(frame->data, index, (UINT32)(5000 + index));
+
+	shadow_tile_frame_next(frame->frame);
+	if (!test_check(frame, a, 0))
+		goto fail;
+
+	const SHADOW_TILE* full = &frame->tiles[0];
+	const SHADOW_TILE* edge = &frame->tiles[TEST_COLUMNS - 1];
+	const SHADOW_TILE* corner = &frame->tiles[TEST_TILES - 1];
+
+	offer->cacheEntriesCount = 6;
+	offer->cacheEntries[0] = (RDPGFX_CACHE_ENTRY_METADATA){ full->key, 64 * 64 * 4 };
+	offer->cacheEntries[1] = (RDPGFX_CACHE_ENTRY_METADATA){ edge->key, 20 * 64 * 4 };
+	offer->cacheEntries[2] = (RDPGFX_CACHE_ENTRY_METADATA){ corner->key, 20 * 10 * 4 };
+	offer->cacheEntries[3] = (RDPGFX_CACHE_ENTRY_METADATA){ 0x1234, 0 };
+	offer->cacheEntries[4] = (RDPGFX_CACHE_ENTRY_METADATA){ 0x5678, 64 * 64 * 4 + 4 };
+	offer->cacheEntries[5] = (RDPGFX_CACHE_ENTRY_METADATA){ full->key, 64 * 64 * 4 };
+
+	if (!shadow_tile_cache_import(b, offer, reply) || (reply->importedEntriesCount != 6))
+		goto fail;
+
+	/* Slot 0 skips an entry: empty, oversized and duplicate entries */
+	if ((reply->cacheSlots[0] == 0) || (reply->cacheSlots[1] == 0) ||
+	    (reply->cacheSlots[2] == 0) || (reply->cacheSlots[3] != 0) ||
+	    (reply->cacheSlots[4] != 0) || (reply->cacheSlots[5] != 0))
+		goto fail;
+
+	/* The imported tiles are drawn from the cache in the first frame */
+	const UINT16 slots[3] = { reply->cacheSlots[0], reply->cacheSlots[1], reply->cacheSlots[2] };
+	if (!test_check(frame, b, 0) || (test_count(frame, SHADOW_TILE_CACHED) != 3) ||
+	    (full->slot != slots[0]) || (edge->slot != slots[1]) || (corner->slot != slots[2]))
+		goto fail;
+
+	offer->cacheEntriesCount = RDPGFX_CACHE_ENTRY_MAX_COUNT + 1;
+	if (shadow_tile_cache_import(b, offer, reply))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	shadow_tile_cache_free(a);
+	shadow_tile_cache_free(b);
+	free(offer);
+	free(reply);
+	return rc;
+}
+
+/* A client showing the previous frame gets it for motion detection, moved tiles are known */
+static BOOL test_previous(test_frame* frame)
+{
+	BOOL rc = FALSE;
+	rdpShadowTileCache* a = test_cache_new(FALSE);
+	rdpShadowTileCache* b = test_cache_new(FALSE);
+
+	if (!a || !b)
+		goto fail;
+
+	for (size_t index = 0; index < TEST_TILES; index++)
+		test_fill_tile(frame->data, index, (UINT32)(7000 + index));
+
+	shadow_tile_frame_next(frame->frame);
+	if (!test_check(frame, a, 0))
+		goto fail;
+
+	/* Shift the first row left by one tile */
+	for (size_t index = 0; index + 1 < TEST_COLUMNS - 1; index++)
+		test_fill_tile(frame->data, index, (UINT32)(7000 + index + 1));
+
+	shadow_tile_frame_next(frame->frame);
+	if (!shadow_tile_frame_begin(frame->frame, frame->data, TEST_STEP, TEST_FORMAT, TEST_WIDTH,
+	                             TEST_HEIGHT))
+		goto fail;
+
+	/* Only a client that shows the previous frame can use it */
+	const BYTE* previous = shadow_tile_cache_get_previous(a, frame->frame);
+	const BOOL unknown = shadow_tile_cache_get_previous(b, frame->frame) == nullptr;
+
+	/* The row moved left, the tile right of it has the content of the last moved one */
+	SHADOW_MOTION motion = WINPR_C_ARRAY_INIT;
+	const BOOL detected = shadow_tile_frame_get_motion(frame->frame, &motion) &&
+	                      (motion.rectSrc.left == SHADOW_TILE_SIZE) && (motion.rectSrc.top == 0) &&
+	                      (motion.rectSrc.right == 15 * SHADOW_TILE_SIZE) &&
+	                      (motion.rectSrc.bottom == SHADOW_TILE_SIZE) && (motion.x == 0) &&
+	                      (motion.y == 0);
+
+	/* A smaller move leaves a partially covered tile */
+	BOOL moved = FALSE;
+	if (previous)
+	{
+		const RECTANGLE_16 rect = { SHADOW_TILE_SIZE, 0, 14 * SHADOW_TILE_SIZE + 10,
+			                        SHADOW_TILE_SIZE };
+		moved = (memcmp(&previous[SHADOW_TILE_SIZE * 4], frame->data, 4 * SHADOW_TILE_SIZE) ==
+		         0) &&
+		        shadow_tile_cache_move(a, frame->frame, &rect, 0, 0);
+	}
+	shadow_tile_frame_end(frame->frame);
+
+	if (!previous || !unknown || !detected || !moved)
+		goto fail;
+
+	/* Fully covered tiles are up to date, the partially covered one is sent */
+	if (!test_check(frame, a, 0) ||
+	    (test_count(frame, SHADOW_TILE_UNCHANGED) != TEST_TILES - 1) ||
+	    (frame->tiles[13].state != SHADOW_TILE_ENCODE))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	shadow_tile_cache_free(a);
+	shadow_tile_cache_free(b);
+	return rc;
+}
+
+int TestShadowTileCache(int argc, char* argv[])
+{
+	int rc = -1;
+	test_frame frame = WINPR_C_ARRAY_INIT;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	frame.frame = shadow_tile_frame_new();
+	frame.data = calloc(TEST_HEIGHT, TEST_STEP);
+	if (!frame.frame || !frame.data)
+		goto fail;
+
+	if (!test_hash(&frame))
+	{
+		(void)fprintf(stderr, "tile hash failed\n");
+		goto fail;
+	}
+
+	if (!test_hit_miss(&frame))
+	{
+		(void)fprintf(stderr, "tile cache hit/miss failed\n");
+		goto fail;
+	}
+
+	if (!test_eviction(&frame))
+	{
+		(void)fprintf(stderr, "tile cache eviction failed\n");
+		goto fail;
+	}
+
+	if (!test_import(&frame))
+	{
+		(void)fprintf(stderr, "tile cache import failed\n");
+		goto fail;
+	}
+
+	if (!test_previous(&frame))
+	{
+		(void)fprintf(stderr, "tile cache previous frame failed\n");
+		goto fail;
+	}
+
+	rc = 0;
+fail:
+	shadow_tile_frame_free(frame.frame);
+	free(frame.data);
+	return rc;
+}
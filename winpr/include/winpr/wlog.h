@@ -373,6 +373,56 @@ typedef struct
 	WINPR_ATTR_NODISCARD
 	WINPR_API BOOL WLog_ConfigureAppender(wLogAppender* appender, const char* setting, void* value);
 
+	/** @brief What an asynchronous appender does with messages while its queue is full
+	 *  @since version 3.32.0
+	 */
+	typedef enum
+	{
+		WLOG_ASYNC_OVERFLOW_BLOCK = 0, /**< wait for the writer thread to catch up */
+		WLOG_ASYNC_OVERFLOW_DROP = 1   /**< drop the message and count it */
+	} wLogAsyncOverflow;
+
+	/** @brief Statistics of an asynchronous appender
+	 *  @since version 3.32.0
+	 */
+	typedef struct
+	{
+		size_t capacity; /**< number of messages the queue holds */
+		size_t queued;   /**< messages waiting for the writer thread */
+		UINT64 written;  /**< messages passed to the appender */
+		UINT64 dropped;  /**< messages lost because the queue was full */
+	} wLogAsyncStats;
+
+	/** @brief Write text messages of an appender on a dedicated thread
+	 *
+	 *  The calling thread only copies the format string and its arguments (including the
+	 *  content of strings) to the queue. Formatting, the layout prefix and the output are done
+	 *  by the writer thread. Formats with conversions that can not be copied (such as wide
+	 *  strings or positional arguments) are formatted by the calling thread. Data, image and
+	 *  packet messages are still written synchronously once the queue is empty. Changing the
+	 *  mode must not race with logging from other threads, the \b WLOG_ASYNC and
+	 *  \b WLOG_ASYNC_OVERFLOW environment variables configure the root appender on startup.
+	 *
+	 *  @param appender The appender to configure
+	 *  @param capacity The queue size in messages, rounded up to a power of 2. \b 0 writes all
+	 *  queued messages and switches back to synchronous writes
+	 *  @param overflow What to do while the queue is full
+	 *
+	 *  @return \b TRUE for success, \b FALSE otherwise
+	 *  @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	WINPR_API BOOL WLog_SetAppenderAsync(wLogAppender* appender, size_t capacity,
+	                                     wLogAsyncOverflow overflow);
+
+	/** @brief Get the statistics of an asynchronous appender
+	 *
+	 *  @return \b TRUE for success, \b FALSE if the appender is synchronous
+	 *  @since version 3.32.0
+	 */
+	WINPR_ATTR_NODISCARD
+	WINPR_API BOOL WLog_GetAppenderAsyncStats(wLogAppender* appender, wLogAsyncStats* stats);
+
 	/** @brief Set a custom context for an appender type
 	 *
 	 *  @note The context must stay valid until wLog is terminated!
@@ -19,10 +19,18 @@
 
 #include <winpr/config.h>
 
+#include <winpr/assert.h>
 #include <winpr/crt.h>
 #include <winpr/sysinfo.h>
 #include <winpr/pool.h>
 #include <winpr/library.h>
+#include <winpr/interlocked.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "pool.h"
 
@@ -52,45 +60,201 @@ static BOOL CALLBACK init_module(PINIT_ONCE once, PVOID param, PVOID* context)
 #endif
 
 static TP_POOL DEFAULT_POOL = {
-	0,       /* DWORD Minimum */
-	500,     /* DWORD Maximum */
-	nullptr, /* wArrayList* Threads */
-	nullptr, /* wQueue* PendingQueue */
-	nullptr, /* HANDLE TerminateEvent */
-	nullptr, /* wCountdownEvent* WorkComplete */
+	0,                  /* DWORD Minimum */
+	500,                /* DWORD Maximum */
+	nullptr,            /* wArrayList* Threads */
+	nullptr,            /* TP_WORK_QUEUE* Queues */
+	0,                  /* size_t QueueCount */
+	0,                  /* LONG NextQueue */
+	0,                  /* LONG NextWorker */
+	0,                  /* LONG IdleWorkers */
+	0,                  /* LONG WakeSequence */
+	0,                  /* LONG Terminate */
+	nullptr,            /* HANDLE WakeSemaphore */
+	0,                  /* LONG Pending */
+	WINPR_C_ARRAY_INIT, /* CRITICAL_SECTION PendingLock */
+	nullptr,            /* HANDLE WorkComplete */
 };
 
-static DWORD WINAPI thread_pool_work_func(LPVOID arg)
+#define WORK_QUEUE_INITIAL_CAPACITY 64
+#define WORK_QUEUE_MAX_COUNT 64
+
+static BOOL work_queue_init(TP_WORK_QUEUE* queue)
+{
+	WINPR_ASSERT(queue);
+
+	if (!InitializeCriticalSectionAndSpinCount(&queue->Lock, 4000))
+		return FALSE;
+
+	queue->Items = (PTP_WORK*)calloc(WORK_QUEUE_INITIAL_CAPACITY, sizeof(PTP_WORK));
+	if (!queue->Items)
+	{
+		DeleteCriticalSection(&queue->Lock);
+		return FALSE;
+	}
+
+	queue->Capacity = WORK_QUEUE_INITIAL_CAPACITY;
+	queue->Head = 0;
+	queue->Count = 0;
+	return TRUE;
+}
+
+static void work_queue_uninit(TP_WORK_QUEUE* queue)
+{
+	WINPR_ASSERT(queue);
+
+	if (!queue->Items)
+		return;
+
+	DeleteCriticalSection(&queue->Lock);
+	free((void*)queue->Items);
+	queue->Items = nullptr;
+}
+
+static BOOL work_queue_push(TP_WORK_QUEUE* queue, PTP_WORK work)
+{
+	BOOL rc = FALSE;
+
+	WINPR_ASSERT(queue);
+	EnterCriticalSection(&queue->Lock);
+
+	if (queue->Count == queue->Capacity)
+	{
+		const size_t capacity = queue->Capacity * 2;
+		PTP_WORK* items = (PTP_WORK*)calloc(capacity, sizeof(PTP_WORK));
+		if (!items)
+			goto fail;
+
+		for (size_t x = 0; x < queue->Count; x++)
+			items[x] = queue->Items[(queue->Head + x) % queue->Capacity];
+
+		free((void*)queue->Items);
+		queue->Items = items;
+		queue->Capacity = capacity;
+		queue->Head = 0;
+	}
+
+	queue->Items[(queue->Head + queue->Count) % queue->Capacity] = work;
+	queue->Count++;
+	rc = TRUE;
+fail:
+	LeaveCriticalSection(&queue->Lock);
+	return rc;
+}
+
+/* The owning worker takes the oldest item, thieves take the newest one. */
+static PTP_WORK work_queue_pop(TP_WORK_QUEUE* queue, BOOL steal)
 {
-	DWORD status = 0;
-	PTP_POOL pool = nullptr;
 	PTP_WORK work = nullptr;
-	HANDLE events[2];
-	PTP_CALLBACK_INSTANCE callbackInstance = nullptr;
 
-	pool = (PTP_POOL)arg;
+	WINPR_ASSERT(queue);
+	EnterCriticalSection(&queue->Lock);
+
+	if (queue->Count > 0)
+	{
+		if (steal)
+			work = queue->Items[(queue->Head + queue->Count - 1) % queue->Capacity];
+		else
+		{
+			work = queue->Items[queue->Head];
+			queue->Head = (queue->Head + 1) % queue->Capacity;
+		}
+		queue->Count--;
+	}
+
+	LeaveCriticalSection(&queue->Lock);
+	return work;
+}
 
-	events[0] = pool->TerminateEvent;
-	events[1] = Queue_Event(pool->PendingQueue);
+static PTP_WORK threadpool_next_work(PTP_POOL pool, size_t home)
+{
+	WINPR_ASSERT(pool);
 
-	while (1)
+	for (size_t x = 0; x < pool->QueueCount; x++)
 	{
-		status = WaitForMultipleObjects(2, events, FALSE, INFINITE);
+		const size_t index = (home + x) % pool->QueueCount;
+		PTP_WORK work = work_queue_pop(&pool->Queues[index], x != 0);
+		if (work)
+			return work;
+	}
+
+	return nullptr;
+}
+
+#if defined(__linux__)
+static void threadpool_park(PTP_POOL pool, LONG sequence)
+{
+	(void)syscall(SYS_futex, &pool->WakeSequence, FUTEX_WAIT_PRIVATE, sequence, nullptr,
+	              nullptr, 0);
+}
+
+static void threadpool_unpark(PTP_POOL pool, BOOL all)
+{
+	(void)InterlockedIncrement(&pool->WakeSequence);
+	(void)syscall(SYS_futex, &pool->WakeSequence, FUTEX_WAKE_PRIVATE, all ? INT32_MAX : 1,
+	              nullptr, nullptr, 0);
+}
+#else
+static void threadpool_park(PTP_POOL pool, WINPR_ATTR_UNUSED LONG sequence)
+{
+	(void)WaitForSingleObject(pool->WakeSemaphore, INFINITE);
+}
+
+static void threadpool_unpark(PTP_POOL pool, BOOL all)
+{
+	LONG count = 1;
+	if (all)
+		count = WINPR_ASSERTING_INT_CAST(LONG, ArrayList_Count(pool->Threads));
+	if (count > 0)
+		(void)ReleaseSemaphore(pool->WakeSemaphore, count, nullptr);
+}
+#endif
+
+static void threadpool_work_done(PTP_POOL pool)
+{
+	if (InterlockedDecrement(&pool->Pending) != 0)
+		return;
+
+	EnterCriticalSection(&pool->PendingLock);
+	if (InterlockedCompareExchange(&pool->Pending, 0, 0) == 0)
+		(void)SetEvent(pool->WorkComplete);
+	LeaveCriticalSection(&pool->PendingLock);
+}
 
-		if (status == WAIT_OBJECT_0)
-			break;
+static DWORD WINAPI thread_pool_work_func(LPVOID arg)
+{
+	PTP_POOL pool = (PTP_POOL)arg;
+	WINPR_ASSERT(pool);
 
-		if (status != (WAIT_OBJECT_0 + 1))
-			break;
+	const size_t home =
+	    (size_t)(InterlockedIncrement(&pool->NextWorker) - 1) % pool->QueueCount;
+
+	while (!InterlockedCompareExchange(&pool->Terminate, 0, 0))
+	{
+		PTP_WORK work = threadpool_next_work(pool, home);
 
-		callbackInstance = (PTP_CALLBACK_INSTANCE)Queue_Dequeue(pool->PendingQueue);
+		if (!work)
+		{
+			/* Announce that we are going to sleep before checking the queues a last time,
+			 * submitters check IdleWorkers after queueing so no wakeup can get lost. */
+			const LONG sequence = InterlockedCompareExchange(&pool->WakeSequence, 0, 0);
+			(void)InterlockedIncrement(&pool->IdleWorkers);
+
+			if (!InterlockedCompareExchange(&pool->Terminate, 0, 0))
+			{
+				work = threadpool_next_work(pool, home);
+				if (!work)
+					threadpool_park(pool, sequence);
+			}
+
+			(void)InterlockedDecrement(&pool->IdleWorkers);
+		}
 
-		if (callbackInstance)
+		if (work)
 		{
-			work = callbackInstance->Work;
-			work->WorkCallback(callbackInstance, work->CallbackParameter, work);
-			CountdownEvent_Signal(pool->WorkComplete, 1);
-			free(callbackInstance);
+			TP_CALLBACK_INSTANCE callbackInstance = { work };
+			work->WorkCallback(&callbackInstance, work->CallbackParameter, work);
+			threadpool_work_done(pool);
 		}
 	}
 
@@ -104,6 +268,80 @@ static void threads_close(void* thread)
 	(void)CloseHandle(thread);
 }
 
+static void threadpool_stop_workers(PTP_POOL pool)
+{
+	ArrayList_Lock(pool->Threads);
+	(void)InterlockedIncrement(&pool->Terminate);
+	threadpool_unpark(pool, TRUE);
+	ArrayList_Clear(pool->Threads);
+	(void)InterlockedDecrement(&pool->Terminate);
+	ArrayList_Unlock(pool->Threads);
+}
+
+BOOL ThreadpoolEnqueueWork(PTP_POOL pool, PTP_WORK work)
+{
+	WINPR_ASSERT(pool);
+	WINPR_ASSERT(work);
+
+	if (InterlockedIncrement(&pool->Pending) == 1)
+	{
+		EnterCriticalSection(&pool->PendingLock);
+		if (InterlockedCompareExchange(&pool->Pending, 0, 0) != 0)
+			(void)ResetEvent(pool->WorkComplete);
+		LeaveCriticalSection(&pool->PendingLock);
+	}
+
+	const size_t index = (size_t)(ULONG)InterlockedIncrement(&pool->NextQueue) % pool->QueueCount;
+	if (!work_queue_push(&pool->Queues[index], work))
+	{
+		threadpool_work_done(pool);
+		return FALSE;
+	}
+
+	if (InterlockedCompareExchange(&pool->IdleWorkers, 0, 0) > 0)
+		threadpool_unpark(pool, FALSE);
+	return TRUE;
+}
+
+BOOL ThreadpoolWaitForPendingWork(PTP_POOL pool)
+{
+	WINPR_ASSERT(pool);
+	return WaitForSingleObject(pool->WorkComplete, INFINITE) == WAIT_OBJECT_0;
+}
+
+static void UninitializeThreadpool(PTP_POOL pool)
+{
+	WINPR_ASSERT(pool);
+
+	if (pool->Threads)
+	{
+		threadpool_stop_workers(pool);
+		ArrayList_Free(pool->Threads);
+		pool->Threads = nullptr;
+	}
+
+	if (pool->Queues)
+	{
+		for (size_t x = 0; x < pool->QueueCount; x++)
+			work_queue_uninit(&pool->Queues[x]);
+		free(pool->Queues);
+		pool->Queues = nullptr;
+	}
+
+	if (pool->WorkComplete)
+	{
+		(void)CloseHandle(pool->WorkComplete);
+		DeleteCriticalSection(&pool->PendingLock);
+		pool->WorkComplete = nullptr;
+	}
+
+	if (pool->WakeSemaphore)
+	{
+		(void)CloseHandle(pool->WakeSemaphore);
+		pool->WakeSemaphore = nullptr;
+	}
+}
+
 static BOOL InitializeThreadpool(PTP_POOL pool)
 {
 	BOOL rc = FALSE;
@@ -112,15 +350,40 @@ static BOOL InitializeThreadpool(PTP_POOL pool)
 	if (pool->Threads)
 		return TRUE;
 
-	if (!(pool->PendingQueue = Queue_New(TRUE, -1, -1)))
+	{
+		SYSTEM_INFO info = WINPR_C_ARRAY_INIT;
+		GetSystemInfo(&info);
+
+		pool->QueueCount = info.dwNumberOfProcessors;
+		if (pool->QueueCount < 1)
+			pool->QueueCount = 1;
+		if (pool->QueueCount > WORK_QUEUE_MAX_COUNT)
+			pool->QueueCount = WORK_QUEUE_MAX_COUNT;
+	}
+
+	if (!(pool->Queues = (TP_WORK_QUEUE*)calloc(pool->QueueCount, sizeof(TP_WORK_QUEUE))))
 		goto fail;
 
-	if (!(pool->WorkComplete = CountdownEvent_New(0)))
+	for (size_t x = 0; x < pool->QueueCount; x++)
+	{
+		if (!work_queue_init(&pool->Queues[x]))
+			goto fail;
+	}
+
+#if !defined(__linux__)
+	if (!(pool->WakeSemaphore = CreateSemaphore(nullptr, 0, INT32_MAX, nullptr)))
 		goto fail;
+#endif
 
-	if (!(pool->TerminateEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr)))
+	if (!InitializeCriticalSectionAndSpinCount(&pool->PendingLock, 4000))
 		goto fail;
 
+	if (!(pool->WorkComplete = CreateEvent(nullptr, TRUE, TRUE, nullptr)))
+	{
+		DeleteCriticalSection(&pool->PendingLock);
+		goto fail;
+	}
+
 	if (!(pool->Threads = ArrayList_New(TRUE)))
 		goto fail;
 
@@ -156,6 +419,8 @@ static BOOL InitializeThreadpool(PTP_POOL pool)
 	rc = TRUE;
 
 fail:
+	if (!rc)
+		UninitializeThreadpool(pool);
 	return rc;
 }
 
@@ -203,12 +468,7 @@ VOID winpr_CloseThreadpool(PTP_POOL ptpp)
 		return;
 	}
 #endif
-	(void)SetEvent(ptpp->TerminateEvent);
-
-	ArrayList_Free(ptpp->Threads);
-	Queue_Free(ptpp->PendingQueue);
-	CountdownEvent_Free(ptpp->WorkComplete);
-	(void)CloseHandle(ptpp->TerminateEvent);
+	UninitializeThreadpool(ptpp);
 
 	{
 		TP_POOL empty = WINPR_C_ARRAY_INIT;
@@ -266,11 +526,7 @@ VOID winpr_SetThreadpoolThreadMaximum(PTP_POOL ptpp, DWORD cthrdMost)
 
 	ArrayList_Lock(ptpp->Threads);
 	if (ArrayList_Count(ptpp->Threads) > ptpp->Maximum)
-	{
-		(void)SetEvent(ptpp->TerminateEvent);
-		ArrayList_Clear(ptpp->Threads);
-		(void)ResetEvent(ptpp->TerminateEvent);
-	}
+		threadpool_stop_workers(ptpp);
 	ArrayList_Unlock(ptpp->Threads);
 	winpr_SetThreadpoolThreadMinimum(ptpp, ptpp->Minimum);
 }
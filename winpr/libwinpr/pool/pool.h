@@ -33,14 +33,31 @@ struct S_TP_CALLBACK_INSTANCE
 	PTP_WORK Work;
 };
 
+typedef struct
+{
+	CRITICAL_SECTION Lock;
+	PTP_WORK* Items;
+	size_t Capacity;
+	size_t Head;
+	size_t Count;
+} TP_WORK_QUEUE;
+
 struct S_TP_POOL
 {
 	DWORD Minimum;
 	DWORD Maximum;
 	wArrayList* Threads;
-	wQueue* PendingQueue;
-	HANDLE TerminateEvent;
-	wCountdownEvent* WorkComplete;
+	TP_WORK_QUEUE* Queues; /* one work queue per worker, idle workers steal from the others */
+	size_t QueueCount;
+	LONG NextQueue;   /* round robin queue index for submissions */
+	LONG NextWorker;  /* home queue index for new workers */
+	LONG IdleWorkers; /* workers about to sleep, submitters only wake if this is set */
+	LONG WakeSequence;
+	LONG Terminate;
+	HANDLE WakeSemaphore; /* only used where futex is not available */
+	LONG Pending;
+	CRITICAL_SECTION PendingLock;
+	HANDLE WorkComplete;
 };
 
 struct S_TP_WORK
@@ -77,14 +94,31 @@ struct S_TP_CALLBACK_INSTANCE
 	PTP_WORK Work;
 };
 
+typedef struct
+{
+	CRITICAL_SECTION Lock;
+	PTP_WORK* Items;
+	size_t Capacity;
+	size_t Head;
+	size_t Count;
+} TP_WORK_QUEUE;
+
 struct S_TP_POOL
 {
 	DWORD Minimum;
 	DWORD Maximum;
 	wArrayList* Threads;
-	wQueue* PendingQueue;
-	HANDLE TerminateEvent;
-	wCountdownEvent* WorkComplete;
+	TP_WORK_QUEUE* Queues; /* one work queue per worker, idle workers steal from the others */
+	size_t QueueCount;
+	LONG NextQueue;   /* round robin queue index for submissions */
+	LONG NextWorker;  /* home queue index for new workers */
+	LONG IdleWorkers; /* workers about to sleep, submitters only wake if this is set */
+	LONG WakeSequence;
+	LONG Terminate;
+	HANDLE WakeSemaphore; /* only used where futex is not available */
+	LONG Pending;
+	CRITICAL_SECTION PendingLock;
+	HANDLE WorkComplete;
 };
 
 struct S_TP_WORK
@@ -118,5 +152,7 @@ struct S_TP_CLEANUP_GROUP
 #endif
 
 PTP_POOL GetDefaultThreadpool(void);
+BOOL ThreadpoolEnqueueWork(PTP_POOL pool, PTP_WORK work);
+BOOL ThreadpoolWaitForPendingWork(PTP_POOL pool);
 
 #endif /* WINPR_POOL_PRIVATE_H */
@@ -3,8 +3,10 @@
 #include <winpr/crt.h>
 #include <winpr/pool.h>
 #include <winpr/interlocked.h>
+#include <winpr/sysinfo.h>
 
 static LONG count = 0;
+static LONG tiles = 0;
 
 static void CALLBACK test_WorkCallback(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work)
 {
@@ -118,6 +120,97 @@ fail:
 	return rc;
 }
 
+static void CALLBACK test_TileCallback(PTP_CALLBACK_INSTANCE instance, void* context,
+                                       PTP_WORK work)
+{
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+
+	BYTE tile[64 * 4] = WINPR_C_ARRAY_INIT;
+	FillMemory(tile, ARRAYSIZE(tile), *(BYTE*)context);
+	(void)InterlockedIncrement(&tiles);
+}
+
+static void CALLBACK test_SpawnCallback(PTP_CALLBACK_INSTANCE instance, void* context,
+                                        PTP_WORK work)
+{
+	WINPR_UNUSED(instance);
+	WINPR_UNUSED(work);
+
+	/* submit from a worker thread, the nested work must be waited for as well */
+	for (int index = 0; index < 8; index++)
+		SubmitThreadpoolWork((PTP_WORK)context);
+}
+
+/* Submit and complete a lot of tiny work items, like the codecs do per tile */
+static BOOL test3(void)
+{
+	BOOL rc = FALSE;
+	BYTE value = 0x42;
+	const LONG rounds = 100;
+	const LONG perRound = 1024;
+	PTP_WORK spawn = nullptr;
+	PTP_WORK work = CreateThreadpoolWork(test_TileCallback, &value, nullptr);
+
+	if (!work)
+	{
+		printf("CreateThreadpoolWork failure\n");
+		return FALSE;
+	}
+
+	tiles = 0;
+	UINT64 worst = 0;
+	const UINT64 start = winpr_GetTickCount64NS();
+	for (LONG round = 0; round < rounds; round++)
+	{
+		const UINT64 submit = winpr_GetTickCount64NS();
+		for (LONG index = 0; index < perRound; index++)
+			SubmitThreadpoolWork(work);
+
+		WaitForThreadpoolWorkCallbacks(work, FALSE);
+		const UINT64 latency = winpr_GetTickCount64NS() - submit;
+		if (latency > worst)
+			worst = latency;
+	}
+	const UINT64 duration = winpr_GetTickCount64NS() - start;
+
+	if (tiles != rounds * perRound)
+	{
+		printf("expected %" PRId32 " tiles, got %" PRId32 "\n", rounds * perRound, tiles);
+		goto fail;
+	}
+
+	printf("%" PRId32 " tiles in %" PRIu64 "us, %.0f tiles/s, worst batch latency %" PRIu64
+	       "us\n",
+	       tiles, duration / 1000, 1000000000.0 * tiles / (double)(duration ? duration : 1),
+	       worst / 1000);
+
+	spawn = CreateThreadpoolWork(test_SpawnCallback, work, nullptr);
+	if (!spawn)
+	{
+		printf("CreateThreadpoolWork failure\n");
+		goto fail;
+	}
+
+	tiles = 0;
+	for (int index = 0; index < perRound; index++)
+		SubmitThreadpoolWork(spawn);
+
+	WaitForThreadpoolWorkCallbacks(spawn, FALSE);
+	if (tiles != perRound * 8)
+	{
+		printf("expected %" PRId32 " nested tiles, got %" PRId32 "\n", perRound * 8, tiles);
+		goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	if (spawn)
+		CloseThreadpoolWork(spawn);
+	CloseThreadpoolWork(work);
+	return rc;
+}
+
 int TestPoolWork(int argc, char* argv[])
 {
 
@@ -130,5 +223,8 @@ int TestPoolWork(int argc, char* argv[])
 	if (!test2())
 		return -1;
 
+	if (!test3())
+		return -1;
+
 	return 0;
 }
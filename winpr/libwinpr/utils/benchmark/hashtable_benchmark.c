@@ -0,0 +1,166 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * HashTable throughput and memory benchmarking tool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include <winpr/crt.h>
+#include <winpr/sysinfo.h>
+#include <winpr/collections.h>
+
+#define HASHTABLE_BENCHMARK_ROUNDS 5
+
+typedef struct
+{
+	const char* name;
+	BOOL strings;
+	size_t count;
+} hashtable_benchmark;
+
+/* Heap bytes in use, 0 if the C library does not tell */
+static size_t hashtable_benchmark_heap(void)
+{
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+	const struct mallinfo2 info = mallinfo2();
+	return info.uordblks;
+#else
+	return 0;
+#endif
+}
+
+/* Visits the keys in a scrambled order, count must be a power of two */
+static size_t hashtable_benchmark_key(const hashtable_benchmark* bench, size_t x)
+{
+	return (x * 2654435761u) & (bench->count - 1);
+}
+
+static double hashtable_benchmark_ns(UINT64 start, size_t count)
+{
+	return (double)(winpr_GetTickCount64NS() - start) / (double)count;
+}
+
+static BOOL hashtable_benchmark_run(const hashtable_benchmark* bench)
+{
+	BOOL rc = FALSE;
+	wHashTable* table = nullptr;
+	char** keys = calloc(2 * bench->count, sizeof(char*));
+
+	if (!keys)
+		return FALSE;
+
+	/* The second half of the keys is never inserted and used for failing lookups */
+	for (size_t x = 0; x < 2 * bench->count; x++)
+	{
+		char buffer[32] = WINPR_C_ARRAY_INIT;
+		(void)_snprintf(buffer, sizeof(buffer), "channel-%08" PRIxz, x * 2654435761u);
+		keys[x] = _strdup(buffer);
+		if (!keys[x])
+			goto fail;
+	}
+
+	double insert = 0.0;
+	double hit = 0.0;
+	double miss = 0.0;
+	double removal = 0.0;
+	double bytes = 0.0;
+
+	for (size_t round = 0; round < HASHTABLE_BENCHMARK_ROUNDS; round++)
+	{
+		const size_t heap = hashtable_benchmark_heap();
+
+		table = HashTable_New(FALSE);
+		if (!table)
+			goto fail;
+		if (bench->strings && !HashTable_SetupForStringData(table, FALSE))
+			goto fail;
+
+		UINT64 start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < bench->count; x++)
+		{
+			if (!HashTable_Insert(table, keys[x], keys[x]))
+				goto fail;
+		}
+		insert += hashtable_benchmark_ns(start, bench->count);
+		bytes += (double)(hashtable_benchmark_heap() - heap) / (double)bench->count;
+
+		start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < bench->count; x++)
+		{
+			const size_t key = hashtable_benchmark_key(bench, x);
+			if (HashTable_GetItemValue(table, keys[key]) != keys[key])
+				goto fail;
+		}
+		hit += hashtable_benchmark_ns(start, bench->count);
+
+		start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < bench->count; x++)
+		{
+			const size_t key = bench->count + hashtable_benchmark_key(bench, x);
+			if (HashTable_GetItemValue(table, keys[key]))
+				goto fail;
+		}
+		miss += hashtable_benchmark_ns(start, bench->count);
+
+		start = winpr_GetTickCount64NS();
+		for (size_t x = 0; x < bench->count; x++)
+		{
+			if (!HashTable_Remove(table, keys[hashtable_benchmark_key(bench, x)]))
+				goto fail;
+		}
+		removal += hashtable_benchmark_ns(start, bench->count);
+
+		HashTable_Free(table);
+		table = nullptr;
+	}
+
+	printf("%-8s %8" PRIuz " entries: insert %6.1fns, hit %6.1fns, miss %6.1fns, remove %6.1fns, "
+	       "%5.1f bytes/entry\n",
+	       bench->name, bench->count, insert / HASHTABLE_BENCHMARK_ROUNDS,
+	       hit / HASHTABLE_BENCHMARK_ROUNDS, miss / HASHTABLE_BENCHMARK_ROUNDS,
+	       removal / HASHTABLE_BENCHMARK_ROUNDS, bytes / HASHTABLE_BENCHMARK_ROUNDS);
+
+	rc = TRUE;
+fail:
+	HashTable_Free(table);
+	for (size_t x = 0; x < 2 * bench->count; x++)
+		free(keys[x]);
+	free((void*)keys);
+	return rc;
+}
+
+int main(int argc, char* argv[])
+{
+	const hashtable_benchmark benchmarks[] = {
+		{ "pointer", FALSE, 64 }, { "pointer", FALSE, 4096 }, { "pointer", FALSE, 262144 },
+		{ "string", TRUE, 64 },   { "string", TRUE, 4096 },   { "string", TRUE, 262144 },
+	};
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	for (size_t x = 0; x < ARRAYSIZE(benchmarks); x++)
+	{
+		if (!hashtable_benchmark_run(&benchmarks[x]))
+			return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,176 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * WLog caller latency benchmarking tool
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <winpr/crt.h>
+#include <winpr/file.h>
+#include <winpr/path.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/wlog.h>
+
+#define WLOG_BENCHMARK_THREADS 4
+#define WLOG_BENCHMARK_MESSAGES 20000
+#define WLOG_BENCHMARK_FILE "wlog-benchmark.log"
+
+typedef struct
+{
+	wLog* log;
+	size_t thread;
+	UINT64* latency;
+} wlog_benchmark_thread;
+
+static DWORD WINAPI wlog_benchmark_run_thread(LPVOID arg)
+{
+	wlog_benchmark_thread* ctx = arg;
+
+	for (size_t x = 0; x < WLOG_BENCHMARK_MESSAGES; x++)
+	{
+		const UINT64 start = winpr_GetTickCount64NS();
+		WLog_Print(ctx->log, WLOG_DEBUG, "thread %" PRIuz " message %" PRIuz ": %s %08" PRIx32,
+		           ctx->thread, x, "some decoder state", (UINT32)(x * 2654435761u));
+		ctx->latency[x] = winpr_GetTickCount64NS() - start;
+	}
+
+	return 0;
+}
+
+static int wlog_benchmark_compare(const void* pva, const void* pvb)
+{
+	const UINT64* a = pva;
+	const UINT64* b = pvb;
+
+	if (*a < *b)
+		return -1;
+	return (*a > *b) ? 1 : 0;
+}
+
+static BOOL wlog_benchmark_run(wLog* log, const char* name)
+{
+	BOOL rc = FALSE;
+	const size_t count = WLOG_BENCHMARK_THREADS * WLOG_BENCHMARK_MESSAGES;
+	HANDLE threads[WLOG_BENCHMARK_THREADS] = WINPR_C_ARRAY_INIT;
+	wlog_benchmark_thread ctx[WLOG_BENCHMARK_THREADS] = WINPR_C_ARRAY_INIT;
+	UINT64* latency = calloc(count, sizeof(UINT64));
+
+	if (!latency)
+		return FALSE;
+
+	const UINT64 start = winpr_GetTickCount64NS();
+	for (size_t x = 0; x < WLOG_BENCHMARK_THREADS; x++)
+	{
+		ctx[x].log = log;
+		ctx[x].thread = x;
+		ctx[x].latency = &latency[x * WLOG_BENCHMARK_MESSAGES];
+		threads[x] = CreateThread(nullptr, 0, wlog_benchmark_run_thread, &ctx[x], 0, nullptr);
+		if (!threads[x])
+			goto fail;
+	}
+
+	for (size_t x = 0; x < WLOG_BENCHMARK_THREADS; x++)
+		(void)WaitForSingleObject(threads[x], INFINITE);
+	const UINT64 duration = winpr_GetTickCount64NS() - start;
+
+	qsort(latency, count, sizeof(UINT64), wlog_benchmark_compare);
+
+	UINT64 sum = 0;
+	for (size_t x = 0; x < count; x++)
+		sum += latency[x];
+
+	printf("%-16s avg %6" PRIu64 "ns, p50 %6" PRIu64 "ns, p99 %8" PRIu64 "ns, max %9" PRIu64
+	       "ns, %.0f messages/s\n",
+	       name, sum / count, latency[count / 2], latency[count * 99 / 100], latency[count - 1],
+	       1000000000.0 * (double)count / (double)duration);
+
+	{
+		wLogAsyncStats stats = WINPR_C_ARRAY_INIT;
+		if (WLog_GetAppenderAsyncStats(WLog_GetLogAppender(log), &stats))
+			printf("%-16s %" PRIu64 " messages dropped\n", "", stats.dropped);
+	}
+
+	rc = TRUE;
+fail:
+	for (size_t x = 0; x < WLOG_BENCHMARK_THREADS; x++)
+	{
+		if (threads[x])
+		{
+			(void)WaitForSingleObject(threads[x], INFINITE);
+			(void)CloseHandle(threads[x]);
+		}
+	}
+	free(latency);
+	return rc;
+}
+
+int main(int argc, char* argv[])
+{
+	int rc = -1;
+	char* path = GetKnownPath(KNOWN_PATH_TEMP);
+	char* file = nullptr;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!path)
+		goto fail;
+
+	file = GetCombinedPath(path, WLOG_BENCHMARK_FILE);
+	if (!file)
+		goto fail;
+
+	wLog* root = WLog_GetRoot();
+	if (!WLog_SetLogAppenderType(root, WLOG_APPENDER_FILE))
+		goto fail;
+
+	wLogAppender* appender = WLog_GetLogAppender(root);
+	if (!WLog_ConfigureAppender(appender, "outputfilename", WLOG_BENCHMARK_FILE) ||
+	    !WLog_ConfigureAppender(appender, "outputfilepath", path))
+		goto fail;
+
+	wLog* log = WLog_Get("com.winpr.benchmark");
+	if (!WLog_SetLogLevel(log, WLOG_DEBUG) || !WLog_OpenAppender(root))
+		goto fail;
+
+	printf("%d threads writing %d messages each to %s\n", WLOG_BENCHMARK_THREADS,
+	       WLOG_BENCHMARK_MESSAGES, file);
+
+	if (!wlog_benchmark_run(log, "synchronous"))
+		goto fail;
+
+	if (!WLog_SetAppenderAsync(appender, 4096, WLOG_ASYNC_OVERFLOW_BLOCK) ||
+	    !wlog_benchmark_run(log, "async block"))
+		goto fail;
+
+	if (!WLog_SetAppenderAsync(appender, 4096, WLOG_ASYNC_OVERFLOW_DROP) ||
+	    !wlog_benchmark_run(log, "async drop"))
+		goto fail;
+
+	if (!WLog_SetAppenderAsync(appender, 0, WLOG_ASYNC_OVERFLOW_BLOCK) ||
+	    !WLog_CloseAppender(root))
+		goto fail;
+
+	rc = 0;
+fail:
+	if (file)
+		(void)winpr_DeleteFile(file);
+	free(file);
+	free(path);
+	return rc;
+}
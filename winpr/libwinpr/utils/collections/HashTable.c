@@ -25,35 +25,41 @@
 #include <winpr/collections.h>
 
 /**
- * This implementation is based on the public domain
- * hash table implementation made by Keith Pomakis:
+ * Open addressing hash table with linear probing.
  *
- * http://www.pomakis.com/hashtable/hashtable.c
- * http://www.pomakis.com/hashtable/hashtable.h
+ * Keys and values are stored inline in a power of two sized slot array, a separate control
+ * byte per slot holds the state of the slot and some bits of the hash, so most probes of
+ * non-matching slots never touch the slot array or call the compare function.
+ *
+ * Slots are only moved when the table is rehashed, which never happens during a
+ * HashTable_Foreach, so the callback may insert and remove entries.
  */
 
-typedef struct s_wKeyValuePair wKeyValuePair;
+#define HASH_TABLE_CTRL_HASH_MASK 0x3F
+#define HASH_TABLE_CTRL_PENDING 0x40 /* removed during HashTable_Foreach, disposed afterwards */
+#define HASH_TABLE_CTRL_EMPTY 0x80
+#define HASH_TABLE_CTRL_DELETED 0x81
+
+#define HASH_TABLE_MIN_CAPACITY 16
+#define HASH_TABLE_MAX_CAPACITY (1ull << 31)
 
-struct s_wKeyValuePair
+typedef struct
 {
 	void* key;
 	void* value;
-
-	wKeyValuePair* next;
-	BOOL markedForRemove;
-};
+} wKeyValuePair;
 
 struct s_wHashTable
 {
 	BOOL synchronized;
 	CRITICAL_SECTION lock;
 
-	size_t numOfBuckets;
+	size_t capacity;
 	size_t numOfElements;
-	float idealRatio;
-	float lowerRehashThreshold;
-	float upperRehashThreshold;
-	wKeyValuePair** bucketArray;
+	size_t numOfDeleted;
+	UINT32 shift;
+	BYTE* ctrl;
+	wKeyValuePair* slots;
 
 	HASH_TABLE_HASH_FN hash;
 	wObject key;
@@ -105,108 +111,186 @@ void HashTable_StringFree(void* str)
 }
 
 WINPR_ATTR_NODISCARD
-static inline BOOL HashTable_IsProbablePrime(size_t oddNumber)
+static inline BOOL HashTable_IsUsed(BYTE ctrl)
 {
-	for (size_t i = 3; i < 51; i += 2)
-	{
-		if (oddNumber == i)
-			return TRUE;
-		else if (oddNumber % i == 0)
-			return FALSE;
-	}
+	return ctrl <= HASH_TABLE_CTRL_HASH_MASK;
+}
 
-	return TRUE; /* maybe */
+WINPR_ATTR_NODISCARD
+static inline BOOL HashTable_IsPending(BYTE ctrl)
+{
+	return (ctrl & ~HASH_TABLE_CTRL_HASH_MASK) == HASH_TABLE_CTRL_PENDING;
 }
 
+/**
+ * Spreads the hash of a key, the upper bits select the slot and the lower bits are kept in the
+ * control byte.
+ */
+
 WINPR_ATTR_NODISCARD
-static inline size_t HashTable_CalculateIdealNumOfBuckets(wHashTable* table)
+static inline UINT32 HashTable_Hash(wHashTable* table, const void* key)
 {
 	WINPR_ASSERT(table);
+	WINPR_ASSERT(table->hash);
+	return table->hash(key) * 0x9E3779B1u;
+}
 
-	const float numOfElements = (float)table->numOfElements;
-	const float tmp = (numOfElements / table->idealRatio);
-	size_t idealNumOfBuckets = (size_t)tmp;
+WINPR_ATTR_NODISCARD
+static inline size_t HashTable_Index(wHashTable* table, UINT32 hashValue)
+{
+	WINPR_ASSERT(table);
+	return (size_t)(hashValue >> table->shift);
+}
 
-	if (idealNumOfBuckets < 5)
-		idealNumOfBuckets = 5;
-	else
-		idealNumOfBuckets |= 0x01;
+WINPR_ATTR_NODISCARD
+static inline BOOL HashTable_Equals(wHashTable* table, const wKeyValuePair* pair, const void* key)
+{
+	WINPR_ASSERT(table);
+	WINPR_ASSERT(pair);
+	WINPR_ASSERT(key);
+	return table->key.fnObjectEquals(key, pair->key);
+}
 
-	while (!HashTable_IsProbablePrime(idealNumOfBuckets))
-		idealNumOfBuckets += 2;
+/**
+ * Get the slot of a key, \b table->capacity if not found
+ *
+ * Slots pending removal are only returned if \b pending is set.
+ */
 
-	return idealNumOfBuckets;
+WINPR_ATTR_NODISCARD
+static inline size_t HashTable_Get(wHashTable* table, const void* key, UINT32 hashValue,
+                                   BOOL pending)
+{
+	WINPR_ASSERT(table);
+
+	const BYTE tag = (BYTE)(hashValue & HASH_TABLE_CTRL_HASH_MASK);
+	const size_t mask = table->capacity - 1;
+
+	/* There is always at least one empty slot */
+	for (size_t index = HashTable_Index(table, hashValue);; index = (index + 1) & mask)
+	{
+		const BYTE ctrl = table->ctrl[index];
+
+		if (ctrl == HASH_TABLE_CTRL_EMPTY)
+			return table->capacity;
+
+		if (ctrl == tag)
+		{
+			if (HashTable_Equals(table, &table->slots[index], key))
+				return index;
+		}
+		else if (pending && (ctrl == (tag | HASH_TABLE_CTRL_PENDING)))
+		{
+			if (HashTable_Equals(table, &table->slots[index], key))
+				return index;
+		}
+	}
 }
 
-static inline void HashTable_Rehash(wHashTable* table, size_t numOfBuckets)
+/**
+ * Get the first empty or deleted slot for a hash value
+ */
+
+WINPR_ATTR_NODISCARD
+static inline size_t HashTable_GetFree(wHashTable* table, UINT32 hashValue)
 {
-	UINT32 hashValue = 0;
-	wKeyValuePair* nextPair = nullptr;
-	wKeyValuePair** newBucketArray = nullptr;
+	WINPR_ASSERT(table);
+
+	const size_t mask = table->capacity - 1;
+	size_t index = HashTable_Index(table, hashValue);
+
+	while ((table->ctrl[index] != HASH_TABLE_CTRL_EMPTY) &&
+	       (table->ctrl[index] != HASH_TABLE_CTRL_DELETED))
+		index = (index + 1) & mask;
 
+	return index;
+}
+
+WINPR_ATTR_NODISCARD
+static inline BOOL HashTable_Rehash(wHashTable* table, size_t capacity)
+{
 	WINPR_ASSERT(table);
-	if (numOfBuckets == 0)
-		numOfBuckets = HashTable_CalculateIdealNumOfBuckets(table);
+	WINPR_ASSERT(table->pendingRemoves == 0);
 
-	if (numOfBuckets == table->numOfBuckets)
-		return; /* already the right size! */
+	UINT32 shift = 32;
+	for (size_t x = 1; x < capacity; x <<= 1)
+		shift--;
 
-	newBucketArray = (wKeyValuePair**)calloc(numOfBuckets, sizeof(wKeyValuePair*));
+	BYTE* ctrl = (BYTE*)malloc(capacity);
+	wKeyValuePair* slots = (wKeyValuePair*)calloc(capacity, sizeof(wKeyValuePair));
 
-	if (!newBucketArray)
+	if (!ctrl || !slots)
 	{
 		/*
 		 * Couldn't allocate memory for the new array.
-		 * This isn't a fatal error; we just can't perform the rehash.
+		 * This isn't a fatal error as long as there are free slots left.
 		 */
-		return;
+		free(ctrl);
+		free((void*)slots);
+		return FALSE;
 	}
 
-	for (size_t index = 0; index < table->numOfBuckets; index++)
+	memset(ctrl, HASH_TABLE_CTRL_EMPTY, capacity);
+
+	BYTE* oldCtrl = table->ctrl;
+	wKeyValuePair* oldSlots = table->slots;
+	const size_t oldCapacity = table->capacity;
+
+	table->ctrl = ctrl;
+	table->slots = slots;
+	table->capacity = capacity;
+	table->shift = shift;
+	table->numOfDeleted = 0;
+
+	for (size_t index = 0; index < oldCapacity; index++)
 	{
-		wKeyValuePair* pair = table->bucketArray[index];
+		if (!HashTable_IsUsed(oldCtrl[index]))
+			continue;
 
-		while (pair)
-		{
-			nextPair = pair->next;
-			hashValue = table->hash(pair->key) % numOfBuckets;
-			pair->next = newBucketArray[hashValue];
-			newBucketArray[hashValue] = pair;
-			pair = nextPair;
-		}
+		const UINT32 hashValue = HashTable_Hash(table, oldSlots[index].key);
+		const size_t slot = HashTable_GetFree(table, hashValue);
+		table->ctrl[slot] = (BYTE)(hashValue & HASH_TABLE_CTRL_HASH_MASK);
+		table->slots[slot] = oldSlots[index];
 	}
 
-	free((void*)table->bucketArray);
-	table->bucketArray = newBucketArray;
-	table->numOfBuckets = numOfBuckets;
+	free(oldCtrl);
+	free((void*)oldSlots);
+	return TRUE;
 }
 
+/**
+ * Number of slots neither used nor deleted, must not drop below 1 to terminate lookups.
+ */
+
 WINPR_ATTR_NODISCARD
-static inline BOOL HashTable_Equals(wHashTable* table, const wKeyValuePair* pair, const void* key)
+static inline size_t HashTable_EmptySlots(wHashTable* table)
 {
 	WINPR_ASSERT(table);
-	WINPR_ASSERT(pair);
-	WINPR_ASSERT(key);
-	return table->key.fnObjectEquals(key, pair->key);
+	return table->capacity - table->numOfElements - table->pendingRemoves - table->numOfDeleted;
 }
 
-WINPR_ATTR_NODISCARD
-static inline wKeyValuePair* HashTable_Get(wHashTable* table, const void* key)
-{
-	UINT32 hashValue = 0;
-	wKeyValuePair* pair = nullptr;
+/**
+ * Make room for one more element, keeping the load below 7/8
+ */
 
+static inline void HashTable_Reserve(wHashTable* table)
+{
 	WINPR_ASSERT(table);
-	if (!key)
-		return nullptr;
 
-	hashValue = table->hash(key) % table->numOfBuckets;
-	pair = table->bucketArray[hashValue];
+	if (table->foreachRecursionLevel)
+		return;
 
-	while (pair && !HashTable_Equals(table, pair, key))
-		pair = pair->next;
+	const size_t load = table->numOfElements + table->numOfDeleted + 1;
+	if (load <= table->capacity / 8 * 7)
+		return;
+
+	/* Mostly deleted slots are cleaned up without growing the table */
+	size_t capacity = table->capacity;
+	if ((table->numOfElements + 1 > capacity / 2) && (capacity < HASH_TABLE_MAX_CAPACITY))
+		capacity *= 2;
 
-	return pair;
+	const BOOL rc = HashTable_Rehash(table, capacity);
+	WINPR_UNUSED(rc);
 }
 
 static inline void disposeKey(wHashTable* table, void* key)
@@ -230,7 +314,30 @@ static inline void disposePair(wHashTable* table, wKeyValuePair* pair)
 		return;
 	disposeKey(table, pair->key);
 	disposeValue(table, pair->value);
-	free(pair);
+
+	const wKeyValuePair empty = WINPR_C_ARRAY_INIT;
+	*pair = empty;
+}
+
+/**
+ * Disposes the pair of a slot and marks it deleted. A slot followed by an empty one is no part
+ * of any probe sequence and can be marked empty instead.
+ */
+
+static inline void disposeSlot(wHashTable* table, size_t index)
+{
+	WINPR_ASSERT(table);
+	WINPR_ASSERT(index < table->capacity);
+
+	disposePair(table, &table->slots[index]);
+
+	if (table->ctrl[(index + 1) & (table->capacity - 1)] == HASH_TABLE_CTRL_EMPTY)
+		table->ctrl[index] = HASH_TABLE_CTRL_EMPTY;
+	else
+	{
+		table->ctrl[index] = HASH_TABLE_CTRL_DELETED;
+		table->numOfDeleted++;
+	}
 }
 
 static inline void setKey(wHashTable* table, wKeyValuePair* pair, const void* key)
@@ -311,9 +418,6 @@ int HashTable_Add(wHashTable* table, const void* key, const void* value)
 BOOL HashTable_Insert(wHashTable* table, const void* key, const void* value)
 {
 	BOOL rc = FALSE;
-	UINT32 hashValue = 0;
-	wKeyValuePair* pair = nullptr;
-	wKeyValuePair* newPair = nullptr;
 
 	WINPR_ASSERT(table);
 	if (!key || !value)
@@ -322,19 +426,18 @@ BOOL HashTable_Insert(wHashTable* table, const void* key, const void* value)
 	if (table->synchronized)
 		EnterCriticalSection(&table->lock);
 
-	hashValue = table->hash(key) % table->numOfBuckets;
-	pair = table->bucketArray[hashValue];
+	const UINT32 hashValue = HashTable_Hash(table, key);
+	size_t index = HashTable_Get(table, key, hashValue, TRUE);
 
-	while (pair && !HashTable_Equals(table, pair, key))
-		pair = pair->next;
-
-	if (pair)
+	if (index < table->capacity)
 	{
-		if (pair->markedForRemove)
+		wKeyValuePair* pair = &table->slots[index];
+
+		if (HashTable_IsPending(table->ctrl[index]))
 		{
 			/* this entry was set to be removed but will be recycled instead */
 			table->pendingRemoves--;
-			pair->markedForRemove = FALSE;
+			table->ctrl[index] = (BYTE)(hashValue & HASH_TABLE_CTRL_HASH_MASK);
 			table->numOfElements++;
 		}
 
@@ -351,29 +454,22 @@ BOOL HashTable_Insert(wHashTable* table, const void* key, const void* value)
 	}
 	else
 	{
-		newPair = (wKeyValuePair*)calloc(1, sizeof(wKeyValuePair));
-
-		if (newPair)
-		{
-			setKey(table, newPair, key);
-			setValue(table, newPair, value);
-			newPair->next = table->bucketArray[hashValue];
-			newPair->markedForRemove = FALSE;
-			table->bucketArray[hashValue] = newPair;
-			table->numOfElements++;
-
-			if (!table->foreachRecursionLevel && table->upperRehashThreshold > table->idealRatio)
-			{
-				float elementToBucketRatio =
-				    (float)table->numOfElements / (float)table->numOfBuckets;
-
-				if (elementToBucketRatio > table->upperRehashThreshold)
-					HashTable_Rehash(table, 0);
-			}
-			rc = TRUE;
-		}
+		HashTable_Reserve(table);
+
+		index = HashTable_GetFree(table, hashValue);
+		if (table->ctrl[index] == HASH_TABLE_CTRL_DELETED)
+			table->numOfDeleted--;
+		else if (HashTable_EmptySlots(table) < 2)
+			goto out;
+
+		table->ctrl[index] = (BYTE)(hashValue & HASH_TABLE_CTRL_HASH_MASK);
+		setKey(table, &table->slots[index], key);
+		setValue(table, &table->slots[index], value);
+		table->numOfElements++;
+		rc = TRUE;
 	}
 
+out:
 	if (table->synchronized)
 		LeaveCriticalSection(&table->lock);
 
@@ -386,10 +482,7 @@ BOOL HashTable_Insert(wHashTable* table, const void* key, const void* value)
 
 BOOL HashTable_Remove(wHashTable* table, const void* key)
 {
-	UINT32 hashValue = 0;
 	BOOL status = TRUE;
-	wKeyValuePair* pair = nullptr;
-	wKeyValuePair* previousPair = nullptr;
 
 	WINPR_ASSERT(table);
 	if (!key)
@@ -398,16 +491,10 @@ BOOL HashTable_Remove(wHashTable* table, const void* key)
 	if (table->synchronized)
 		EnterCriticalSection(&table->lock);
 
-	hashValue = table->hash(key) % table->numOfBuckets;
-	pair = table->bucketArray[hashValue];
+	const UINT32 hashValue = HashTable_Hash(table, key);
+	const size_t index = HashTable_Get(table, key, hashValue, FALSE);
 
-	while (pair && !HashTable_Equals(table, pair, key))
-	{
-		previousPair = pair;
-		pair = pair->next;
-	}
-
-	if (!pair)
+	if (index >= table->capacity)
 	{
 		status = FALSE;
 		goto out;
@@ -416,28 +503,15 @@ BOOL HashTable_Remove(wHashTable* table, const void* key)
 	if (table->foreachRecursionLevel)
 	{
 		/* if we are running a HashTable_Foreach, just mark the entry for removal */
-		pair->markedForRemove = TRUE;
+		table->ctrl[index] = (BYTE)(table->ctrl[index] | HASH_TABLE_CTRL_PENDING);
 		table->pendingRemoves++;
 		table->numOfElements--;
 		goto out;
 	}
 
-	if (previousPair)
-		previousPair->next = pair->next;
-	else
-		table->bucketArray[hashValue] = pair->next;
-
-	disposePair(table, pair);
+	disposeSlot(table, index);
 	table->numOfElements--;
 
-	if (!table->foreachRecursionLevel && table->lowerRehashThreshold > 0.0f)
-	{
-		float elementToBucketRatio = (float)table->numOfElements / (float)table->numOfBuckets;
-
-		if (elementToBucketRatio < table->lowerRehashThreshold)
-			HashTable_Rehash(table, 0);
-	}
-
 out:
 	if (table->synchronized)
 		LeaveCriticalSection(&table->lock);
@@ -452,7 +526,6 @@ out:
 void* HashTable_GetItemValue(wHashTable* table, const void* key)
 {
 	void* value = nullptr;
-	wKeyValuePair* pair = nullptr;
 
 	WINPR_ASSERT(table);
 	if (!key)
@@ -461,10 +534,10 @@ void* HashTable_GetItemValue(wHashTable* table, const void* key)
 	if (table->synchronized)
 		EnterCriticalSection(&table->lock);
 
-	pair = HashTable_Get(table, key);
+	const size_t index = HashTable_Get(table, key, HashTable_Hash(table, key), FALSE);
 
-	if (pair && !pair->markedForRemove)
-		value = pair->value;
+	if (index < table->capacity)
+		value = table->slots[index].value;
 
 	if (table->synchronized)
 		LeaveCriticalSection(&table->lock);
@@ -479,7 +552,6 @@ void* HashTable_GetItemValue(wHashTable* table, const void* key)
 BOOL HashTable_SetItemValue(wHashTable* table, const void* key, const void* value)
 {
 	BOOL status = TRUE;
-	wKeyValuePair* pair = nullptr;
 
 	WINPR_ASSERT(table);
 	if (!key)
@@ -488,13 +560,13 @@ BOOL HashTable_SetItemValue(wHashTable* table, const void* key, const void* valu
 	if (table->synchronized)
 		EnterCriticalSection(&table->lock);
 
-	pair = HashTable_Get(table, key);
+	const size_t index = HashTable_Get(table, key, HashTable_Hash(table, key), FALSE);
 
-	if (!pair || pair->markedForRemove)
+	if (index >= table->capacity)
 		status = FALSE;
 	else
 	{
-		setValue(table, pair, value);
+		setValue(table, &table->slots[index], value);
 	}
 
 	if (table->synchronized)
@@ -509,40 +581,38 @@ BOOL HashTable_SetItemValue(wHashTable* table, const void* key, const void* valu
 
 void HashTable_Clear(wHashTable* table)
 {
-	wKeyValuePair* nextPair = nullptr;
-
 	WINPR_ASSERT(table);
 
 	if (table->synchronized)
 		EnterCriticalSection(&table->lock);
 
-	for (size_t index = 0; index < table->numOfBuckets; index++)
+	for (size_t index = 0; index < table->capacity; index++)
 	{
-		wKeyValuePair* pair = table->bucketArray[index];
+		if (!HashTable_IsUsed(table->ctrl[index]))
+			continue;
 
-		while (pair)
+		if (table->foreachRecursionLevel)
 		{
-			nextPair = pair->next;
-
-			if (table->foreachRecursionLevel)
-			{
-				/* if we're in a foreach we just mark the entry for removal */
-				pair->markedForRemove = TRUE;
-				table->pendingRemoves++;
-			}
-			else
-			{
-				disposePair(table, pair);
-				pair = nextPair;
-			}
+			/* if we're in a foreach we just mark the entry for removal */
+			table->ctrl[index] = (BYTE)(table->ctrl[index] | HASH_TABLE_CTRL_PENDING);
+			table->pendingRemoves++;
 		}
-
-		table->bucketArray[index] = nullptr;
+		else
+			disposePair(table, &table->slots[index]);
 	}
 
 	table->numOfElements = 0;
 	if (table->foreachRecursionLevel == 0)
-		HashTable_Rehash(table, 5);
+	{
+		memset(table->ctrl, HASH_TABLE_CTRL_EMPTY, table->capacity);
+		table->numOfDeleted = 0;
+
+		if (table->capacity > HASH_TABLE_MIN_CAPACITY)
+		{
+			const BOOL rc = HashTable_Rehash(table, HASH_TABLE_MIN_CAPACITY);
+			WINPR_UNUSED(rc);
+		}
+	}
 
 	if (table->synchronized)
 		LeaveCriticalSection(&table->lock);
@@ -557,7 +627,6 @@ size_t HashTable_GetKeys(wHashTable* table, ULONG_PTR** ppKeys)
 	size_t iKey = 0;
 	size_t count = 0;
 	ULONG_PTR* pKeys = nullptr;
-	wKeyValuePair* nextPair = nullptr;
 
 	WINPR_ASSERT(table);
 
@@ -587,17 +656,10 @@ size_t HashTable_GetKeys(wHashTable* table, ULONG_PTR** ppKeys)
 		return 0;
 	}
 
-	for (size_t index = 0; index < table->numOfBuckets; index++)
+	for (size_t index = 0; index < table->capacity; index++)
 	{
-		wKeyValuePair* pair = table->bucketArray[index];
-
-		while (pair)
-		{
-			nextPair = pair->next;
-			if (!pair->markedForRemove)
-				pKeys[iKey++] = (ULONG_PTR)pair->key;
-			pair = nextPair;
-		}
+		if (HashTable_IsUsed(table->ctrl[index]))
+			pKeys[iKey++] = (ULONG_PTR)table->slots[index].key;
 	}
 
 	if (table->synchronized)
@@ -621,15 +683,16 @@ BOOL HashTable_Foreach(wHashTable* table, HASH_TABLE_FOREACH_FN fn, VOID* arg)
 		EnterCriticalSection(&table->lock);
 
 	table->foreachRecursionLevel++;
-	for (size_t index = 0; index < table->numOfBuckets; index++)
+	for (size_t index = 0; index < table->capacity; index++)
 	{
-		for (wKeyValuePair* pair = table->bucketArray[index]; pair; pair = pair->next)
+		if (!HashTable_IsUsed(table->ctrl[index]))
+			continue;
+
+		wKeyValuePair* pair = &table->slots[index];
+		if (!fn(pair->key, pair->value, arg))
 		{
-			if (!pair->markedForRemove && !fn(pair->key, pair->value, arg))
-			{
-				ret = FALSE;
-				goto out;
-			}
+			ret = FALSE;
+			break;
 		}
 	}
 	table->foreachRecursionLevel--;
@@ -637,31 +700,14 @@ BOOL HashTable_Foreach(wHashTable* table, HASH_TABLE_FOREACH_FN fn, VOID* arg)
 	if (!table->foreachRecursionLevel && table->pendingRemoves)
 	{
 		/* if we're the last recursive foreach call, let's do the cleanup if needed */
-		wKeyValuePair** prevPtr = nullptr;
-		for (size_t index = 0; index < table->numOfBuckets; index++)
+		for (size_t index = table->capacity; index > 0; index--)
 		{
-			wKeyValuePair* nextPair = nullptr;
-			prevPtr = &table->bucketArray[index];
-			for (wKeyValuePair* pair = table->bucketArray[index]; pair;)
-			{
-				nextPair = pair->next;
-
-				if (pair->markedForRemove)
-				{
-					disposePair(table, pair);
-					*prevPtr = nextPair;
-				}
-				else
-				{
-					prevPtr = &pair->next;
-				}
-				pair = nextPair;
-			}
+			if (HashTable_IsPending(table->ctrl[index - 1]))
+				disposeSlot(table, index - 1);
 		}
 		table->pendingRemoves = 0;
 	}
 
-out:
 	if (table->synchronized)
 		LeaveCriticalSection(&table->lock);
 	return ret;
@@ -674,7 +720,6 @@ out:
 BOOL HashTable_Contains(wHashTable* table, const void* key)
 {
 	BOOL status = 0;
-	wKeyValuePair* pair = nullptr;
 
 	WINPR_ASSERT(table);
 	if (!key)
@@ -683,8 +728,7 @@ BOOL HashTable_Contains(wHashTable* table, const void* key)
 	if (table->synchronized)
 		EnterCriticalSection(&table->lock);
 
-	pair = HashTable_Get(table, key);
-	status = (pair && !pair->markedForRemove);
+	status = HashTable_Get(table, key, HashTable_Hash(table, key), FALSE) < table->capacity;
 
 	if (table->synchronized)
 		LeaveCriticalSection(&table->lock);
@@ -698,23 +742,7 @@ BOOL HashTable_Contains(wHashTable* table, const void* key)
 
 BOOL HashTable_ContainsKey(wHashTable* table, const void* key)
 {
-	BOOL status = 0;
-	wKeyValuePair* pair = nullptr;
-
-	WINPR_ASSERT(table);
-	if (!key)
-		return FALSE;
-
-	if (table->synchronized)
-		EnterCriticalSection(&table->lock);
-
-	pair = HashTable_Get(table, key);
-	status = (pair && !pair->markedForRemove);
-
-	if (table->synchronized)
-		LeaveCriticalSection(&table->lock);
-
-	return status;
+	return HashTable_Contains(table, key);
 }
 
 /**
@@ -732,23 +760,17 @@ BOOL HashTable_ContainsValue(wHashTable* table, const void* value)
 	if (table->synchronized)
 		EnterCriticalSection(&table->lock);
 
-	for (size_t index = 0; index < table->numOfBuckets; index++)
-	{
-		wKeyValuePair* pair = table->bucketArray[index];
+	OBJECT_EQUALS_FN equals = table->value.fnObjectEquals;
+	if (!equals)
+		equals = HashTable_PointerCompare;
 
-		while (pair)
+	for (size_t index = 0; index < table->capacity; index++)
+	{
+		if (HashTable_IsUsed(table->ctrl[index]) && equals(value, table->slots[index].value))
 		{
-			if (!pair->markedForRemove && HashTable_Equals(table, pair, value))
-			{
-				status = TRUE;
-				break;
-			}
-
-			pair = pair->next;
-		}
-
-		if (status)
+			status = TRUE;
 			break;
+		}
 	}
 
 	if (table->synchronized)
@@ -771,20 +793,14 @@ wHashTable* HashTable_New(BOOL synchronized)
 	table->synchronized = synchronized;
 	if (!InitializeCriticalSectionAndSpinCount(&(table->lock), 4000))
 		goto fail;
-	table->numOfBuckets = 64;
-	table->numOfElements = 0;
-	table->bucketArray = (wKeyValuePair**)calloc(table->numOfBuckets, sizeof(wKeyValuePair*));
 
-	if (!table->bucketArray)
-		goto fail;
-
-	table->idealRatio = 3.0f;
-	table->lowerRehashThreshold = 0.0f;
-	table->upperRehashThreshold = 15.0f;
 	table->hash = HashTable_PointerHash;
 	table->key.fnObjectEquals = HashTable_PointerCompare;
 	table->value.fnObjectEquals = HashTable_PointerCompare;
 
+	if (!HashTable_Rehash(table, HASH_TABLE_MIN_CAPACITY))
+		goto fail;
+
 	return table;
 fail:
 	WINPR_PRAGMA_DIAG_PUSH
@@ -796,28 +812,19 @@ fail:
 
 void HashTable_Free(wHashTable* table)
 {
-	wKeyValuePair* pair = nullptr;
-	wKeyValuePair* nextPair = nullptr;
-
 	if (!table)
 		return;
 
-	if (table->bucketArray)
+	if (table->ctrl)
 	{
-		for (size_t index = 0; index < table->numOfBuckets; index++)
+		for (size_t index = 0; index < table->capacity; index++)
 		{
-			pair = table->bucketArray[index];
-
-			while (pair)
-			{
-				nextPair = pair->next;
-
-				disposePair(table, pair);
-				pair = nextPair;
-			}
+			if (HashTable_IsUsed(table->ctrl[index]) || HashTable_IsPending(table->ctrl[index]))
+				disposePair(table, &table->slots[index]);
 		}
-		free((void*)table->bucketArray);
 	}
+	free(table->ctrl);
+	free((void*)table->slots);
 	DeleteCriticalSection(&(table->lock));
 
 	free(table);
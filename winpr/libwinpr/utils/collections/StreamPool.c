@@ -21,6 +21,9 @@
 
 #include <winpr/crt.h>
 #include <winpr/wlog.h>
+#include <winpr/intrin.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
 
 #include <winpr/collections.h>
 
@@ -28,32 +31,79 @@
 #include "../log.h"
 #define XTAG WINPR_TAG("utils.streampool")
 
+/* Streams are cached in power of two size classes from 64 bytes to 64 MiB,
+ * larger streams are allocated on demand and freed when returned. */
+#define STREAMPOOL_MIN_CLASS 6
+#define STREAMPOOL_MAX_CLASS 26
+#define STREAMPOOL_CLASSES (STREAMPOOL_MAX_CLASS - STREAMPOOL_MIN_CLASS + 1)
+
+#define STREAMPOOL_MAX_SHARDS 16
+
+/* Every class keeps at least this many available streams */
+#define STREAMPOOL_MIN_CACHED 4
+
+/* The high-water mark of a class decays after this number of takes */
+#define STREAMPOOL_TRIM_INTERVAL 1024
+
+typedef struct s_StreamPoolEntry wStreamPoolEntry;
+
+/* Streams of the pool are allocated as part of an entry, which allows taking and returning
+ * them without searching for the bookkeeping data. */
 struct s_StreamPoolEntry
 {
+	wStream s; /* must be the first member */
+	wStreamPoolEntry* prev;
+	wStreamPoolEntry* next;
+	size_t shard;
+	size_t sizeClass; /* class the stream was taken for */
+	size_t accounted; /* capacity counted as used bytes */
+	BOOL used;
 #if defined(WITH_STREAMPOOL_DEBUG)
 	char** msg;
 	size_t lines;
 #endif
-	wStream* s;
 };
 
-struct s_wStreamPool
+typedef struct
 {
+	wStreamPoolEntry* available; /* linked through next */
 	size_t aSize;
-	size_t aCapacity;
-	struct s_StreamPoolEntry* aArray;
-
 	size_t uSize;
-	size_t uCapacity;
-	struct s_StreamPoolEntry* uArray;
+	size_t highWater;
+	size_t takes;
+} wStreamPoolClass;
 
+/* Threads use the shard selected by their thread id, a stream is always returned to the shard
+ * it was taken from. */
+typedef struct
+{
 	CRITICAL_SECTION lock;
+	wStreamPoolClass classes[STREAMPOOL_CLASSES];
+	wStreamPoolEntry* used;
+	size_t uSize;
+	size_t aSize;
+	size_t uBytes;
+	size_t aBytes;
+	UINT64 hits;
+	UINT64 misses;
+	UINT64 trimmed;
+} wStreamPoolShard;
+
+struct s_wStreamPool
+{
+	wStreamPoolShard* shards;
+	size_t shardCount;
 	BOOL synchronized;
 	size_t defaultSize;
 	wLog* log;
 };
 
-static void discard_entry(struct s_StreamPoolEntry* entry, BOOL discardStream)
+static wStreamPoolEntry* StreamPool_GetEntry(wStream* s)
+{
+	return (wStreamPoolEntry*)s;
+}
+
+static void StreamPool_EntryFree(wStreamPoolEntry* entry)
 {
 	if (!entry)
 		return;
@@ -62,207 +112,277 @@ static void discard_entry(struct s_StreamPoolEntry* entry, BOOL discardStream)
 	free((void*)entry->msg);
 #endif
 
-	if (discardStream && entry->s)
-		Stream_Free(entry->s, entry->s->isAllocatedStream);
+	if (entry->s.isOwner)
+		free(entry->s.buffer);
+	free(entry);
+}
 
-	const struct s_StreamPoolEntry empty = WINPR_C_ARRAY_INIT;
-	*entry = empty;
+static wStreamPoolEntry* StreamPool_EntryNew(size_t size)
+{
+	wStreamPoolEntry* entry = calloc(1, sizeof(wStreamPoolEntry));
+	if (!entry)
+		return nullptr;
+
+	BYTE* buffer = calloc(size, sizeof(BYTE));
+	if (!buffer)
+	{
+		free(entry);
+		return nullptr;
+	}
+
+	(void)Stream_StaticInit(&entry->s, buffer, size);
+	entry->s.isOwner = TRUE;
+	entry->s.isAllocatedStream = TRUE;
+	return entry;
 }
 
-static struct s_StreamPoolEntry add_entry(wStream* s)
+static void StreamPool_EntryTrace(wStreamPoolEntry* entry)
 {
-	struct s_StreamPoolEntry entry = WINPR_C_ARRAY_INIT;
+	WINPR_ASSERT(entry);
 
 #if defined(WITH_STREAMPOOL_DEBUG)
+	free((void*)entry->msg);
+	entry->msg = nullptr;
+	entry->lines = 0;
+
 	void* stack = winpr_backtrace(20);
 	if (stack)
-		entry.msg = winpr_backtrace_symbols(stack, &entry.lines);
+		entry->msg = winpr_backtrace_symbols(stack, &entry->lines);
 	winpr_backtrace_free(stack);
+#else
+	WINPR_UNUSED(entry);
 #endif
-
-	entry.s = s;
-	return entry;
 }
 
 /**
- * Lock the stream pool
+ * Lock a shard of the stream pool
  */
 
-static inline void StreamPool_Lock(wStreamPool* pool)
+static inline void StreamPool_Lock(wStreamPool* pool, wStreamPoolShard* shard)
 {
 	WINPR_ASSERT(pool);
+	WINPR_ASSERT(shard);
 	if (pool->synchronized)
-		EnterCriticalSection(&pool->lock);
+		EnterCriticalSection(&shard->lock);
 }
 
 /**
- * Unlock the stream pool
+ * Unlock a shard of the stream pool
  */
 
-static inline void StreamPool_Unlock(wStreamPool* pool)
+static inline void StreamPool_Unlock(wStreamPool* pool, wStreamPoolShard* shard)
 {
 	WINPR_ASSERT(pool);
+	WINPR_ASSERT(shard);
 	if (pool->synchronized)
-		LeaveCriticalSection(&pool->lock);
+		LeaveCriticalSection(&shard->lock);
 }
 
-static BOOL StreamPool_EnsureCapacity(wStreamPool* pool, size_t count, BOOL usedOrAvailable)
+static size_t StreamPool_ShardIndex(const wStreamPool* pool)
 {
 	WINPR_ASSERT(pool);
 
-	size_t* cap = (usedOrAvailable) ? &pool->uCapacity : &pool->aCapacity;
-	size_t* size = (usedOrAvailable) ? &pool->uSize : &pool->aSize;
-	struct s_StreamPoolEntry** array = (usedOrAvailable) ? &pool->uArray : &pool->aArray;
+	if (pool->shardCount < 2)
+		return 0;
 
-	size_t new_cap = 0;
-	if (*cap == 0)
-		new_cap = *size + count;
-	else if (*size + count > *cap)
-		new_cap = (*size + count + 2) / 2 * 3;
-	else if ((*size + count) < *cap / 3)
-		new_cap = *cap / 2;
+	const UINT32 hash = GetCurrentThreadId() * 0x9E3779B1u;
+	return (hash >> 16) & (pool->shardCount - 1);
+}
 
-	if (new_cap > 0)
-	{
-		struct s_StreamPoolEntry* new_arr = nullptr;
+/**
+ * Size class a stream of \b size bytes is taken from, STREAMPOOL_CLASSES if it is not cached
+ */
 
-		if (*cap < *size + count)
-			*cap += count;
+static size_t StreamPool_TakeClass(size_t size)
+{
+	if (size <= (1ull << STREAMPOOL_MIN_CLASS))
+		return 0;
+	if (size > (1ull << STREAMPOOL_MAX_CLASS))
+		return STREAMPOOL_CLASSES;
 
-		new_arr =
-		    (struct s_StreamPoolEntry*)realloc(*array, sizeof(struct s_StreamPoolEntry) * new_cap);
-		if (!new_arr)
-			return FALSE;
-		*cap = new_cap;
-		*array = new_arr;
-	}
-	return TRUE;
+	const UINT32 bits = 32 - __lzcnt((UINT32)(size - 1));
+	return bits - STREAMPOOL_MIN_CLASS;
 }
 
 /**
- * Methods
+ * Size class a stream with \b capacity bytes is cached in, STREAMPOOL_CLASSES if it is not cached
+ *
+ * The capacity of a stream might have grown while in use, so the class is recalculated.
  */
 
-static void StreamPool_ShiftUsed(wStreamPool* pool, size_t index)
+static size_t StreamPool_ReturnClass(size_t capacity)
 {
-	WINPR_ASSERT(pool);
+	if ((capacity < (1ull << STREAMPOOL_MIN_CLASS)) || (capacity >= (2ull << STREAMPOOL_MAX_CLASS)))
+		return STREAMPOOL_CLASSES;
 
-	const size_t pcount = 1;
-	const size_t off = index + pcount;
-	if (pool->uSize >= off)
-	{
-		for (size_t x = 0; x < pcount; x++)
-		{
-			struct s_StreamPoolEntry* cur = &pool->uArray[index + x];
-			discard_entry(cur, FALSE);
-		}
-		MoveMemory(&pool->uArray[index], &pool->uArray[index + pcount],
-		           (pool->uSize - index - pcount) * sizeof(struct s_StreamPoolEntry));
-		pool->uSize -= pcount;
-	}
+	const UINT32 bits = 31 - __lzcnt((UINT32)capacity);
+	return bits - STREAMPOOL_MIN_CLASS;
 }
 
-/**
- * Adds a used stream to the pool.
- */
+static size_t StreamPool_CacheLimit(const wStreamPoolClass* cls)
+{
+	WINPR_ASSERT(cls);
+	if (cls->highWater < STREAMPOOL_MIN_CACHED)
+		return STREAMPOOL_MIN_CACHED;
+	return cls->highWater;
+}
 
-static void StreamPool_AddUsed(wStreamPool* pool, wStream* s)
+static wStreamPoolEntry* StreamPool_PopAvailable(wStreamPoolShard* shard, wStreamPoolClass* cls)
 {
-	StreamPool_EnsureCapacity(pool, 1, TRUE);
-	pool->uArray[pool->uSize] = add_entry(s);
-	pool->uSize++;
+	WINPR_ASSERT(shard);
+	WINPR_ASSERT(cls);
+
+	wStreamPoolEntry* entry = cls->available;
+	if (!entry)
+		return nullptr;
+
+	cls->available = entry->next;
+	cls->aSize--;
+	shard->aSize--;
+	shard->aBytes -= Stream_Capacity(&entry->s);
+	entry->next = nullptr;
+	return entry;
 }
 
 /**
- * Removes a used stream from the pool.
+ * Frees available streams exceeding the high-water mark of a class
  */
 
-static void StreamPool_RemoveUsed(wStreamPool* pool, wStream* s)
+static void StreamPool_Trim(wStreamPoolShard* shard, wStreamPoolClass* cls)
 {
-	WINPR_ASSERT(pool);
-	for (size_t index = 0; index < pool->uSize; index++)
+	WINPR_ASSERT(cls);
+
+	while (cls->available && (cls->aSize + cls->uSize > StreamPool_CacheLimit(cls)))
 	{
-		struct s_StreamPoolEntry* cur = &pool->uArray[index];
-		if (cur->s == s)
-		{
-			StreamPool_ShiftUsed(pool, index);
-			break;
-		}
+		StreamPool_EntryFree(StreamPool_PopAvailable(shard, cls));
+		shard->trimmed++;
 	}
 }
 
-static void StreamPool_ShiftAvailable(wStreamPool* pool, size_t index)
+static void StreamPool_AddUsed(wStreamPoolShard* shard, wStreamPoolEntry* entry)
 {
-	WINPR_ASSERT(pool);
-
-	const size_t pcount = 1;
-	const size_t off = index + pcount;
-	if (pool->aSize >= off)
-	{
-		for (size_t x = 0; x < pcount; x++)
-		{
-			struct s_StreamPoolEntry* cur = &pool->aArray[index + x];
-			discard_entry(cur, FALSE);
-		}
+	WINPR_ASSERT(shard);
+	WINPR_ASSERT(entry);
+
+	entry->prev = nullptr;
+	entry->next = shard->used;
+	if (shard->used)
+		shard->used->prev = entry;
+	shard->used = entry;
+	entry->used = TRUE;
+	entry->accounted = Stream_Capacity(&entry->s);
+
+	shard->uSize++;
+	shard->uBytes += entry->accounted;
+}
 
-		MoveMemory(&pool->aArray[index], &pool->aArray[index + pcount],
-		           (pool->aSize - index - pcount) * sizeof(struct s_StreamPoolEntry));
-		pool->aSize -= pcount;
-	}
+static void StreamPool_RemoveUsed(wStreamPoolShard* shard, wStreamPoolEntry* entry)
+{
+	WINPR_ASSERT(shard);
+	WINPR_ASSERT(entry);
+
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		shard->used = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	entry->prev = nullptr;
+	entry->next = nullptr;
+	entry->used = FALSE;
+
+	shard->uSize--;
+	shard->uBytes -= entry->accounted;
+	if (entry->sizeClass < STREAMPOOL_CLASSES)
+		shard->classes[entry->sizeClass].uSize--;
 }
 
+/**
+ * Methods
+ */
+
 /**
  * Gets a stream from the pool.
  */
 
 wStream* StreamPool_Take(wStreamPool* pool, size_t size)
 {
-	BOOL found = FALSE;
-	size_t foundIndex = 0;
-	wStream* s = nullptr;
-
-	StreamPool_Lock(pool);
+	WINPR_ASSERT(pool);
 
 	if (size == 0)
 		size = pool->defaultSize;
+	if (size == 0)
+		return nullptr;
 
-	for (size_t index = 0; index < pool->aSize; index++)
+	const size_t index = StreamPool_ShardIndex(pool);
+	wStreamPoolShard* shard = &pool->shards[index];
+	const size_t sizeClass = StreamPool_TakeClass(size);
+	wStreamPoolEntry* entry = nullptr;
+
+	StreamPool_Lock(pool, shard);
+	if (sizeClass < STREAMPOOL_CLASSES)
 	{
-		struct s_StreamPoolEntry* cur = &pool->aArray[index];
-		s = cur->s;
+		wStreamPoolClass* cls = &shard->classes[sizeClass];
 
-		if (Stream_Capacity(s) >= size)
+		cls->uSize++;
+		if (cls->uSize > cls->highWater)
+			cls->highWater = cls->uSize;
+		if (++cls->takes >= STREAMPOOL_TRIM_INTERVAL)
 		{
-			found = TRUE;
-			foundIndex = index;
-			break;
+			cls->takes = 0;
+			cls->highWater /= 2;
+			if (cls->highWater < cls->uSize)
+				cls->highWater = cls->uSize;
+			StreamPool_Trim(shard, cls);
 		}
+
+		entry = StreamPool_PopAvailable(shard, cls);
 	}
 
-	if (!found)
+	if (entry)
 	{
-		s = Stream_New(nullptr, size);
-		if (!s)
-			goto out_fail;
+		shard->hits++;
+		entry->shard = index;
+		entry->sizeClass = sizeClass;
+		StreamPool_AddUsed(shard, entry);
 	}
-	else if (s)
+	else
+		shard->misses++;
+	StreamPool_Unlock(pool, shard);
+
+	if (!entry)
 	{
-		Stream_ResetPosition(s);
-		if (!Stream_SetLength(s, Stream_Capacity(s)))
-			goto out_fail;
-		StreamPool_ShiftAvailable(pool, foundIndex);
+		if (sizeClass < STREAMPOOL_CLASSES)
+			size = 1ull << (sizeClass + STREAMPOOL_MIN_CLASS);
+
+		entry = StreamPool_EntryNew(size);
+
+		StreamPool_Lock(pool, shard);
+		if (entry)
+		{
+			entry->shard = index;
+			entry->sizeClass = sizeClass;
+			StreamPool_AddUsed(shard, entry);
+		}
+		else if (sizeClass < STREAMPOOL_CLASSES)
+			shard->classes[sizeClass].uSize--;
+		StreamPool_Unlock(pool, shard);
+
+		if (!entry)
+			return nullptr;
 	}
 
-	if (s)
+	wStream* s = &entry->s;
+	s->pool = pool;
+	s->count = 1;
+	Stream_ResetPosition(s);
+	if (!Stream_SetLength(s, Stream_Capacity(s)))
 	{
-		s->pool = pool;
-		s->count = 1;
-		StreamPool_AddUsed(pool, s);
+		StreamPool_Return(pool, s);
+		return nullptr;
 	}
 
-out_fail:
-	StreamPool_Unlock(pool);
-
+	StreamPool_EntryTrace(entry);
 	return s;
 }
 
@@ -272,23 +392,52 @@ out_fail:
 
 static void StreamPool_Remove(wStreamPool* pool, wStream* s)
 {
-	StreamPool_EnsureCapacity(pool, 1, FALSE);
+	WINPR_ASSERT(pool);
+	WINPR_ASSERT(s);
+
+	wStreamPoolEntry* entry = StreamPool_GetEntry(s);
+	WINPR_ASSERT(entry->shard < pool->shardCount);
+	wStreamPoolShard* shard = &pool->shards[entry->shard];
+
 	Stream_EnsureValidity(s);
-	for (size_t x = 0; x < pool->aSize; x++)
+
+	StreamPool_Lock(pool, shard);
+
+	/* Already returned */
+	if (!entry->used)
 	{
-		wStream* cs = pool->aArray[x].s;
-		if (cs == s)
-			return;
+		StreamPool_Unlock(pool, shard);
+		return;
+	}
+
+	StreamPool_RemoveUsed(shard, entry);
+
+	const size_t sizeClass = s->isOwner ? StreamPool_ReturnClass(Stream_Capacity(s))
+	                                    : STREAMPOOL_CLASSES;
+	if (sizeClass < STREAMPOOL_CLASSES)
+	{
+		wStreamPoolClass* cls = &shard->classes[sizeClass];
+		if (cls->aSize + cls->uSize < StreamPool_CacheLimit(cls))
+		{
+			entry->next = cls->available;
+			cls->available = entry;
+			cls->aSize++;
+			shard->aSize++;
+			shard->aBytes += Stream_Capacity(s);
+			entry = nullptr;
+		}
 	}
-	pool->aArray[(pool->aSize)++] = add_entry(s);
-	StreamPool_RemoveUsed(pool, s);
+
+	if (entry)
+		shard->trimmed++;
+	StreamPool_Unlock(pool, shard);
+
+	StreamPool_EntryFree(entry);
 }
 
 static void StreamPool_ReleaseOrReturn(wStreamPool* pool, wStream* s)
 {
-	StreamPool_Lock(pool);
 	StreamPool_Remove(pool, s);
-	StreamPool_Unlock(pool);
 }
 
 void StreamPool_Return(wStreamPool* pool, wStream* s)
@@ -297,9 +446,20 @@ void StreamPool_Return(wStreamPool* pool, wStream* s)
 	if (!s)
 		return;
 
-	StreamPool_Lock(pool);
+	if (!s->pool)
+	{
+		/* Only streams allocated by a pool can be cached */
+		Stream_Free(s, TRUE);
+		return;
+	}
+
+	if (s->pool != pool)
+	{
+		WLog_Print(pool->log, WLOG_WARN, "Returning a stream taken from a different pool");
+		pool = s->pool;
+	}
+
 	StreamPool_Remove(pool, s);
-	StreamPool_Unlock(pool);
 }
 
 /**
@@ -337,24 +497,27 @@ void Stream_Release(wStream* s)
 
 wStream* StreamPool_Find(wStreamPool* pool, const BYTE* ptr)
 {
-	wStream* s = nullptr;
+	WINPR_ASSERT(pool);
 
-	StreamPool_Lock(pool);
+	wStream* s = nullptr;
 
-	for (size_t index = 0; index < pool->uSize; index++)
+	for (size_t x = 0; !s && (x < pool->shardCount); x++)
 	{
-		struct s_StreamPoolEntry* cur = &pool->uArray[index];
+		wStreamPoolShard* shard = &pool->shards[x];
 
-		if ((ptr >= Stream_Buffer(cur->s)) &&
-		    (ptr < (Stream_Buffer(cur->s) + Stream_Capacity(cur->s))))
+		StreamPool_Lock(pool, shard);
+		for (wStreamPoolEntry* cur = shard->used; cur; cur = cur->next)
 		{
-			s = cur->s;
-			break;
+			if ((ptr >= Stream_Buffer(&cur->s)) &&
+			    (ptr < (Stream_Buffer(&cur->s) + Stream_Capacity(&cur->s))))
+			{
+				s = &cur->s;
+				break;
+			}
 		}
+		StreamPool_Unlock(pool, shard);
 	}
 
-	StreamPool_Unlock(pool);
-
 	return s;
 }
 
@@ -364,36 +527,49 @@ wStream* StreamPool_Find(wStreamPool* pool, const BYTE* ptr)
 
 void StreamPool_Clear(wStreamPool* pool)
 {
-	StreamPool_Lock(pool);
+	WINPR_ASSERT(pool);
 
-	for (size_t x = 0; x < pool->aSize; x++)
+	for (size_t x = 0; x < pool->shardCount; x++)
 	{
-		struct s_StreamPoolEntry* cur = &pool->aArray[x];
-		discard_entry(cur, TRUE);
-	}
-	pool->aSize = 0;
+		wStreamPoolShard* shard = &pool->shards[x];
 
-	if (pool->uSize > 0)
-	{
-		WLog_Print(pool->log, WLOG_WARN,
-		           "Clearing StreamPool, but there are %" PRIuz " streams currently in use",
-		           pool->uSize);
-		for (size_t x = 0; x < pool->uSize; x++)
+		StreamPool_Lock(pool, shard);
+		for (size_t y = 0; y < STREAMPOOL_CLASSES; y++)
 		{
-			struct s_StreamPoolEntry* cur = &pool->uArray[x];
-			discard_entry(cur, TRUE);
+			wStreamPoolClass* cls = &shard->classes[y];
+			while (cls->available)
+				StreamPool_EntryFree(StreamPool_PopAvailable(shard, cls));
 		}
-		pool->uSize = 0;
-	}
 
-	StreamPool_Unlock(pool);
+		if (shard->uSize > 0)
+		{
+			WLog_Print(pool->log, WLOG_WARN,
+			           "Clearing StreamPool, but there are %" PRIuz " streams currently in use",
+			           shard->uSize);
+			while (shard->used)
+			{
+				wStreamPoolEntry* cur = shard->used;
+				StreamPool_RemoveUsed(shard, cur);
+				StreamPool_EntryFree(cur);
+			}
+		}
+		StreamPool_Unlock(pool, shard);
+	}
 }
 
 size_t StreamPool_UsedCount(wStreamPool* pool)
 {
-	StreamPool_Lock(pool);
-	size_t usize = pool->uSize;
-	StreamPool_Unlock(pool);
+	WINPR_ASSERT(pool);
+
+	size_t usize = 0;
+	for (size_t x = 0; x < pool->shardCount; x++)
+	{
+		wStreamPoolShard* shard = &pool->shards[x];
+
+		StreamPool_Lock(pool, shard);
+		usize += shard->uSize;
+		StreamPool_Unlock(pool, shard);
+	}
 	return usize;
 }
 
@@ -415,14 +591,30 @@ wStreamPool* StreamPool_New(BOOL synchronized, size_t defaultSize)
 	pool->synchronized = synchronized;
 	pool->defaultSize = defaultSize;
 
-	if (!StreamPool_EnsureCapacity(pool, 32, FALSE))
-		goto fail;
-	if (!StreamPool_EnsureCapacity(pool, 32, TRUE))
-		goto fail;
+	/* A shard per processor, rounded to a power of two */
+	pool->shardCount = 1;
+	if (synchronized)
+	{
+		SYSTEM_INFO info = WINPR_C_ARRAY_INIT;
+		GetSystemInfo(&info);
+		while ((pool->shardCount < info.dwNumberOfProcessors) &&
+		       (pool->shardCount < STREAMPOOL_MAX_SHARDS))
+			pool->shardCount <<= 1;
+	}
 
-	if (!InitializeCriticalSectionAndSpinCount(&pool->lock, 4000))
+	pool->shards = calloc(pool->shardCount, sizeof(wStreamPoolShard));
+	if (!pool->shards)
 		goto fail;
 
+	for (size_t x = 0; x < pool->shardCount; x++)
+	{
+		if (!InitializeCriticalSectionAndSpinCount(&pool->shards[x].lock, 4000))
+		{
+			pool->shardCount = x;
+			goto fail;
+		}
+	}
+
 	return pool;
 fail:
 	WINPR_PRAGMA_DIAG_PUSH
@@ -437,12 +629,14 @@ void StreamPool_Free(wStreamPool* pool)
 	if (!pool)
 		return;
 
-	StreamPool_Clear(pool);
-
-	DeleteCriticalSection(&pool->lock);
+	if (pool->shards)
+	{
+		StreamPool_Clear(pool);
 
-	free(pool->aArray);
-	free(pool->uArray);
+		for (size_t x = 0; x < pool->shardCount; x++)
+			DeleteCriticalSection(&pool->shards[x].lock);
+		free(pool->shards);
+	}
 
 	WLog_Discard(pool->log);
 	free(pool);
@@ -455,53 +649,83 @@ char* StreamPool_GetStatistics(wStreamPool* pool, char* buffer, size_t size)
 	if (!buffer || (size < 1))
 		return nullptr;
 
+	size_t aSize = 0;
+	size_t uSize = 0;
+	size_t aBytes = 0;
+	size_t uBytes = 0;
+	UINT64 hits = 0;
+	UINT64 misses = 0;
+	UINT64 trimmed = 0;
+
+	for (size_t x = 0; x < pool->shardCount; x++)
+	{
+		wStreamPoolShard* shard = &pool->shards[x];
+
+		StreamPool_Lock(pool, shard);
+		aSize += shard->aSize;
+		uSize += shard->uSize;
+		aBytes += shard->aBytes;
+		uBytes += shard->uBytes;
+		hits += shard->hits;
+		misses += shard->misses;
+		trimmed += shard->trimmed;
+		StreamPool_Unlock(pool, shard);
+	}
+
 	size_t used = 0;
 	int offset = _snprintf(buffer, size - 1,
-	                       "aSize    =%" PRIuz ", uSize    =%" PRIuz ", aCapacity=%" PRIuz
-	                       ", uCapacity=%" PRIuz,
-	                       pool->aSize, pool->uSize, pool->aCapacity, pool->uCapacity);
+	                       "aSize    =%" PRIuz ", uSize    =%" PRIuz ", aBytes   =%" PRIuz
+	                       ", uBytes   =%" PRIuz ", hits     =%" PRIu64 ", misses   =%" PRIu64
+	                       ", trimmed  =%" PRIu64 ", shards   =%" PRIuz,
+	                       aSize, uSize, aBytes, uBytes, hits, misses, trimmed, pool->shardCount);
 	if ((offset > 0) && ((size_t)offset < size))
 		used += (size_t)offset;
 
 #if defined(WITH_STREAMPOOL_DEBUG)
-	StreamPool_Lock(pool);
-
 	offset = _snprintf(&buffer[used], size - 1 - used, "\n-- dump used array take locations --\n");
 	if ((offset > 0) && ((size_t)offset < size - used))
 		used += (size_t)offset;
-	for (size_t x = 0; x < pool->uSize; x++)
+
+	size_t index = 0;
+	for (size_t x = 0; x < pool->shardCount; x++)
 	{
-		const struct s_StreamPoolEntry* cur = &pool->uArray[x];
-		WINPR_ASSERT(cur->msg || (cur->lines == 0));
+		wStreamPoolShard* shard = &pool->shards[x];
 
-		for (size_t y = 0; y < cur->lines; y++)
+		StreamPool_Lock(pool, shard);
+		for (const wStreamPoolEntry* cur = shard->used; cur; cur = cur->next)
 		{
-			offset = _snprintf(&buffer[used], size - 1 - used, "[%" PRIuz " | %" PRIuz "]: %s\n", x,
-			                   y, cur->msg[y]);
-			if ((offset > 0) && ((size_t)offset < size - used))
-				used += (size_t)offset;
+			WINPR_ASSERT(cur->msg || (cur->lines == 0));
+
+			for (size_t y = 0; y < cur->lines; y++)
+			{
+				offset = _snprintf(&buffer[used], size - 1 - used,
+				                   "[%" PRIuz " | %" PRIuz "]: %s\n", index, y, cur->msg[y]);
+				if ((offset > 0) && ((size_t)offset < size - used))
+					used += (size_t)offset;
+			}
+			index++;
 		}
+		StreamPool_Unlock(pool, shard);
 	}
 
 	offset = _snprintf(&buffer[used], size - 1 - used, "\n-- statistics called from --\n");
 	if ((offset > 0) && ((size_t)offset < size - used))
 		used += (size_t)offset;
 
-	struct s_StreamPoolEntry entry = WINPR_C_ARRAY_INIT;
+	size_t lines = 0;
+	char** msg = nullptr;
 	void* stack = winpr_backtrace(20);
 	if (stack)
-		entry.msg = winpr_backtrace_symbols(stack, &entry.lines);
+		msg = winpr_backtrace_symbols(stack, &lines);
 	winpr_backtrace_free(stack);
 
-	for (size_t x = 0; x < entry.lines; x++)
+	for (size_t x = 0; x < lines; x++)
 	{
-		const char* msg = entry.msg[x];
-		offset = _snprintf(&buffer[used], size - 1 - used, "[%" PRIuz "]: %s\n", x, msg);
+		offset = _snprintf(&buffer[used], size - 1 - used, "[%" PRIuz "]: %s\n", x, msg[x]);
 		if ((offset > 0) && ((size_t)offset < size - used))
 			used += (size_t)offset;
 	}
-	free((void*)entry.msg);
-	StreamPool_Unlock(pool);
+	free((void*)msg);
 #endif
 	buffer[used] = '\0';
 	return buffer;
@@ -429,6 +429,77 @@ out:
 	return retCode;
 }
 
+static BOOL foreachFn4(const void* key, void* value, void* arg)
+{
+	wHashTable* table = arg;
+	const size_t x = (size_t)value;
+
+	WINPR_UNUSED(key);
+
+	/* Inserting and removing while iterating must neither grow nor move entries */
+	if ((x % 2) == 0)
+		return HashTable_Remove(table, (const void*)(x * 16));
+	return HashTable_Insert(table, (const void*)((x + 10000) * 16), (const void*)x);
+}
+
+static int test_hash_table_churn(void)
+{
+	int rc = -1;
+	const size_t count = 5000;
+	wHashTable* table = HashTable_New(FALSE);
+
+	if (!table)
+		return -1;
+
+	/* Values start at 1, keys are spaced like heap pointers */
+	for (size_t round = 0; round < 4; round++)
+	{
+		for (size_t x = 1; x <= count; x++)
+		{
+			if (!HashTable_Insert(table, (const void*)(x * 16), (const void*)x))
+				goto fail;
+		}
+
+		for (size_t x = 1; x <= count; x += 2)
+		{
+			if (!HashTable_Remove(table, (const void*)(x * 16)))
+				goto fail;
+		}
+
+		if (HashTable_Count(table) != count / 2)
+			goto fail;
+
+		for (size_t x = 1; x <= count; x++)
+		{
+			const void* value = HashTable_GetItemValue(table, (const void*)(x * 16));
+			if (value != (((x % 2) == 0) ? (const void*)x : nullptr))
+				goto fail;
+		}
+	}
+
+	if (!HashTable_ContainsValue(table, (const void*)count) ||
+	    HashTable_ContainsValue(table, (const void*)(count - 1)))
+		goto fail;
+
+	/* Every even entry is removed, every odd entry added during the iteration */
+	if (!HashTable_Insert(table, (const void*)(3 * 16), (const void*)3))
+		goto fail;
+	if (!HashTable_Foreach(table, foreachFn4, table))
+		goto fail;
+	if (!HashTable_Contains(table, (const void*)(10003 * 16)) ||
+	    HashTable_Contains(table, (const void*)(2 * 16)) || (HashTable_Count(table) != 2))
+		goto fail;
+
+	HashTable_Clear(table);
+	if (HashTable_Count(table) != 0)
+		goto fail;
+
+	rc = 1;
+fail:
+	HashTable_Free(table);
+	return rc;
+}
+
 int TestHashTable(int argc, char* argv[])
 {
 	WINPR_UNUSED(argc);
@@ -442,5 +513,8 @@ int TestHashTable(int argc, char* argv[])
 
 	if (test_hash_foreach() < 0)
 		return 3;
+
+	if (test_hash_table_churn() < 0)
+		return 4;
 	return 0;
 }
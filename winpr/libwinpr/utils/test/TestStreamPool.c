@@ -76,6 +76,25 @@ int TestStreamPool(int argc, char* argv[])
 	Stream_Release(s[3]);
 	Stream_Release(s[4]);
 
+	/* Requests of the same size class reuse a returned stream, even after it grew */
+	s[0] = StreamPool_Take(pool, 1000);
+	if (!s[0] || (Stream_Capacity(s[0]) < 1000))
+		return -1;
+	if (!Stream_EnsureCapacity(s[0], 100000))
+		return -1;
+	Stream_Release(s[0]);
+
+	s[1] = StreamPool_Take(pool, 60000);
+	if ((s[1] != s[0]) || (Stream_GetPosition(s[1]) != 0) ||
+	    (Stream_Length(s[1]) != Stream_Capacity(s[1])))
+		return -1;
+	Stream_Release(s[1]);
+
+	if (StreamPool_UsedCount(pool) != 0)
+		return -1;
+
+	printf("%s\n", StreamPool_GetStatistics(pool, buffer, sizeof(buffer)));
+
 	StreamPool_Free(pool);
 
 	return 0;
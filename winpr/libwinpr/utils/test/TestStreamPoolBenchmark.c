@@ -0,0 +1,127 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/stream.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+#include <winpr/collections.h>
+
+#define TEST_THREADS 4
+#define TEST_ITERATIONS 50000
+#define TEST_SLOTS 8
+
+static PVOID volatile slots[TEST_SLOTS] = WINPR_C_ARRAY_INIT;
+static LONG failed = 0;
+
+static wStream* exchange_slot(size_t index, wStream* s)
+{
+	PVOID cur = slots[index];
+	for (;;)
+	{
+		PVOID prev = InterlockedCompareExchangePointer(&slots[index], s, cur);
+		if (prev == cur)
+			return cur;
+		cur = prev;
+	}
+}
+
+static DWORD WINAPI pool_thread(LPVOID arg)
+{
+	wStreamPool* pool = arg;
+	UINT32 seed = GetCurrentThreadId();
+
+	for (size_t x = 0; x < TEST_ITERATIONS; x++)
+	{
+		seed = seed * 1103515245u + 12345u;
+
+		/* PDU sized requests between 16 bytes and 32 kB */
+		const size_t size = 16 + ((seed >> 8) & 0x7FFF);
+		wStream* s = StreamPool_Take(pool, size);
+		if (!s || (Stream_Capacity(s) < size) || (Stream_GetPosition(s) != 0))
+		{
+			(void)InterlockedIncrement(&failed);
+			return 1;
+		}
+		Stream_Write_UINT32(s, seed);
+
+		/* Every fourth stream is released by another thread */
+		if ((seed & 0x30000) == 0)
+			s = exchange_slot((seed >> 20) % TEST_SLOTS, s);
+
+		if (s)
+			Stream_Release(s);
+	}
+
+	return 0;
+}
+
+static BOOL run_benchmark(BOOL synchronized)
+{
+	BOOL rc = FALSE;
+	char buffer[8192] = WINPR_C_ARRAY_INIT;
+	HANDLE threads[TEST_THREADS] = WINPR_C_ARRAY_INIT;
+	const size_t count = synchronized ? TEST_THREADS : 1;
+	wStreamPool* pool = StreamPool_New(synchronized, 4096);
+
+	if (!pool)
+		return FALSE;
+
+	const UINT64 start = winpr_GetTickCount64NS();
+	if (synchronized)
+	{
+		for (size_t x = 0; x < count; x++)
+		{
+			threads[x] = CreateThread(nullptr, 0, pool_thread, pool, 0, nullptr);
+			if (!threads[x])
+				goto fail;
+		}
+
+		for (size_t x = 0; x < count; x++)
+			(void)WaitForSingleObject(threads[x], INFINITE);
+	}
+	else if (pool_thread(pool) != 0)
+		goto fail;
+	const UINT64 duration = winpr_GetTickCount64NS() - start;
+
+	for (size_t x = 0; x < TEST_SLOTS; x++)
+	{
+		wStream* s = exchange_slot(x, nullptr);
+		if (s)
+			Stream_Release(s);
+	}
+
+	printf("%-14s %" PRIuz " threads, %.0f take/release per second\n",
+	       synchronized ? "synchronized" : "unsynchronized", count,
+	       1000000000.0 * (double)(count * TEST_ITERATIONS) / (double)(duration + 1));
+	printf("%s\n", StreamPool_GetStatistics(pool, buffer, sizeof(buffer)));
+
+	if (failed || (StreamPool_UsedCount(pool) != 0))
+		goto fail;
+
+	rc = TRUE;
+fail:
+	for (size_t x = 0; x < TEST_THREADS; x++)
+	{
+		if (threads[x])
+		{
+			(void)WaitForSingleObject(threads[x], INFINITE);
+			(void)CloseHandle(threads[x]);
+		}
+	}
+	StreamPool_Free(pool);
+	return rc;
+}
+
+int TestStreamPoolBenchmark(int argc, char* argv[])
+{
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	if (!run_benchmark(FALSE))
+		return -1;
+	if (!run_benchmark(TRUE))
+		return -1;
+	return 0;
+}
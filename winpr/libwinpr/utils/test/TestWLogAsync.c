@@ -0,0 +1,325 @@
+#include <stdio.h>
+
+#include <winpr/crt.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/wlog.h>
+
+#define TEST_THREADS 4
+#define TEST_MESSAGES 2000
+#define TEST_DROP_CAPACITY 16
+#define TEST_DROP_MESSAGES 100
+
+static const char* channel = "com.test.async";
+static const char* formatChannel = "com.test.async.format";
+
+#define TEST_FORMATS 8
+
+static char expected[TEST_FORMATS][256] = WINPR_C_ARRAY_INIT;
+static LONG formatted = 0;
+
+static LONG received = 0;
+static BOOL success = TRUE;
+static int lastMessage[TEST_THREADS] = WINPR_C_ARRAY_INIT;
+static HANDLE blockEvent = nullptr;
+
+static BOOL CallbackAppenderMessage(const wLogMessage* msg)
+{
+	int thread = -1;
+	int message = -1;
+
+	if (blockEvent)
+		(void)WaitForSingleObject(blockEvent, INFINITE);
+
+	if (msg && (strcmp(msg->PrefixString, formatChannel) == 0))
+	{
+		const LONG index = InterlockedIncrement(&formatted) - 1;
+		if ((index >= TEST_FORMATS) || (strcmp(msg->TextString, expected[index]) != 0))
+		{
+			(void)fprintf(stderr, "got '%s', expected '%s'\n", msg->TextString,
+			              (index < TEST_FORMATS) ? expected[index] : "");
+			success = FALSE;
+		}
+		return TRUE;
+	}
+
+	/* Other modules might log to the root appender as well */
+	if (!msg || (strcmp(msg->PrefixString, channel) != 0))
+		return TRUE;
+
+	if (sscanf(msg->TextString, "thread %d message %d", &thread, &message) != 2)
+		success = FALSE;
+	else if ((thread < 0) || (thread >= TEST_THREADS))
+		success = FALSE;
+	else
+	{
+		/* Messages of one thread must keep their order */
+		if (message != lastMessage[thread] + 1)
+			success = FALSE;
+		lastMessage[thread] = message;
+	}
+
+	(void)InterlockedIncrement(&received);
+	return TRUE;
+}
+
+static BOOL CallbackAppenderOther(const wLogMessage* msg)
+{
+	WINPR_UNUSED(msg);
+	return TRUE;
+}
+
+static DWORD WINAPI log_thread(LPVOID arg)
+{
+	const int thread = (int)(size_t)arg;
+	wLog* log = WLog_Get(channel);
+
+	for (int x = 0; x < TEST_MESSAGES; x++)
+		WLog_Print(log, WLOG_INFO, "thread %d message %d", thread, x);
+	return 0;
+}
+
+static BOOL wait_written(wLogAppender* appender, UINT64 count)
+{
+	const UINT64 end = GetTickCount64() + 10000;
+
+	while (GetTickCount64() < end)
+	{
+		wLogAsyncStats stats = WINPR_C_ARRAY_INIT;
+		if (!WLog_GetAppenderAsyncStats(appender, &stats))
+			return FALSE;
+		if (stats.written + stats.dropped >= count)
+			return TRUE;
+		Sleep(1);
+	}
+
+	return FALSE;
+}
+
+static BOOL test_block(wLogAppender* appender)
+{
+	HANDLE threads[TEST_THREADS] = WINPR_C_ARRAY_INIT;
+	BOOL rc = FALSE;
+
+	if (!WLog_SetAppenderAsync(appender, 64, WLOG_ASYNC_OVERFLOW_BLOCK))
+		return FALSE;
+
+	for (size_t x = 0; x < TEST_THREADS; x++)
+	{
+		lastMessage[x] = -1;
+		threads[x] = CreateThread(nullptr, 0, log_thread, (void*)x, 0, nullptr);
+		if (!threads[x])
+			goto fail;
+	}
+
+	for (size_t x = 0; x < TEST_THREADS; x++)
+		(void)WaitForSingleObject(threads[x], INFINITE);
+
+	if (!wait_written(appender, TEST_THREADS * TEST_MESSAGES))
+		goto fail;
+
+	{
+		wLogAsyncStats stats = WINPR_C_ARRAY_INIT;
+		if (!WLog_GetAppenderAsyncStats(appender, &stats))
+			goto fail;
+
+		if ((stats.capacity != 64) || (stats.dropped != 0) ||
+		    (stats.written < TEST_THREADS * TEST_MESSAGES))
+		{
+			(void)fprintf(stderr, "unexpected statistics %" PRIu64 " written, %" PRIu64
+			                      " dropped\n",
+			              stats.written, stats.dropped);
+			goto fail;
+		}
+	}
+
+	if (received != TEST_THREADS * TEST_MESSAGES)
+		goto fail;
+
+	for (size_t x = 0; x < TEST_THREADS; x++)
+	{
+		if (lastMessage[x] != TEST_MESSAGES - 1)
+			goto fail;
+	}
+
+	rc = TRUE;
+fail:
+	for (size_t x = 0; x < TEST_THREADS; x++)
+	{
+		if (threads[x])
+		{
+			(void)WaitForSingleObject(threads[x], INFINITE);
+			(void)CloseHandle(threads[x]);
+		}
+	}
+	return rc;
+}
+
+static BOOL test_drop(wLogAppender* appender)
+{
+	BOOL rc = FALSE;
+	wLog* log = WLog_Get(channel);
+
+	blockEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!blockEvent)
+		return FALSE;
+
+	if (!WLog_SetAppenderAsync(appender, TEST_DROP_CAPACITY, WLOG_ASYNC_OVERFLOW_DROP))
+		goto fail;
+
+	/* The writer thread is stuck in the first message, the queue takes the capacity */
+	received = 0;
+	lastMessage[0] = -1;
+	for (int x = 0; x < TEST_DROP_MESSAGES; x++)
+		WLog_Print(log, WLOG_INFO, "thread %d message %d", 0, x);
+
+	(void)SetEvent(blockEvent);
+	if (!wait_written(appender, TEST_DROP_MESSAGES))
+		goto fail;
+
+	{
+		wLogAsyncStats stats = WINPR_C_ARRAY_INIT;
+		if (!WLog_GetAppenderAsyncStats(appender, &stats))
+			goto fail;
+
+		if ((stats.written != TEST_DROP_CAPACITY) ||
+		    (stats.dropped != TEST_DROP_MESSAGES - TEST_DROP_CAPACITY))
+		{
+			(void)fprintf(stderr, "unexpected statistics %" PRIu64 " written, %" PRIu64
+			                      " dropped\n",
+			              stats.written, stats.dropped);
+			goto fail;
+		}
+	}
+
+	rc = TRUE;
+fail:
+	if (!WLog_SetAppenderAsync(appender, 0, WLOG_ASYNC_OVERFLOW_BLOCK))
+		rc = FALSE;
+	(void)CloseHandle(blockEvent);
+	blockEvent = nullptr;
+	return rc;
+}
+
+/* The writer thread formats the messages, the arguments must be captured when logging */
+static BOOL test_format(wLogAppender* appender)
+{
+	BOOL rc = FALSE;
+	wLog* log = WLog_Get(formatChannel);
+	const INT64 big = -1234567890123ll;
+	const size_t size = 4242;
+	const double pi = 3.14159;
+	const void* ptr = &size;
+	char* str = _strdup("a string freed before it is written");
+
+	blockEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!blockEvent || !str)
+		goto fail;
+
+	if (!WLog_SetAppenderAsync(appender, 64, WLOG_ASYNC_OVERFLOW_BLOCK))
+		goto fail;
+
+	formatted = 0;
+
+	/* The writer thread is blocked in the first message until all are queued */
+	(void)_snprintf(expected[0], sizeof(expected[0]), "first");
+	WLog_Print(log, WLOG_INFO, "first");
+
+	(void)_snprintf(expected[1], sizeof(expected[1]), "[%s] [%.6s] [%-12s|]", str, str, "left");
+	WLog_Print(log, WLOG_INFO, "[%s] [%.6s] [%-12s|]", str, str, "left");
+
+	(void)_snprintf(expected[2], sizeof(expected[2]), "%*d|%-*d|%.*s|%.*s", 6, 42, -6, 42, 3,
+	                "abcdef", -1, "abc");
+	WLog_Print(log, WLOG_INFO, "%*d|%-*d|%.*s|%.*s", 6, 42, -6, 42, 3, "abcdef", -1, "abc");
+
+	(void)_snprintf(expected[3], sizeof(expected[3]), "%" PRId64 " %" PRIuz " %08" PRIx32 " %hhu",
+	                big, size, UINT32_C(0xBEEF), 300);
+	WLog_Print(log, WLOG_INFO, "%" PRId64 " %" PRIuz " %08" PRIx32 " %hhu", big, size,
+	           UINT32_C(0xBEEF), 300);
+
+	(void)_snprintf(expected[4], sizeof(expected[4]), "%.3f %e %g %c %p 100%%", pi, pi, pi, 'x',
+	                ptr);
+	WLog_Print(log, WLOG_INFO, "%.3f %e %g %c %p 100%%", pi, pi, pi, 'x', ptr);
+
+	/* Wide strings are not captured, the caller formats these */
+	(void)_snprintf(expected[5], sizeof(expected[5]), "%ls %d", L"wide", 5);
+	WLog_Print(log, WLOG_INFO, "%ls %d", L"wide", 5);
+
+	(void)_snprintf(expected[6], sizeof(expected[6]), "%s", "");
+	WLog_Print(log, WLOG_INFO, "%s", "");
+
+	(void)_snprintf(expected[7], sizeof(expected[7]), "last %s", str);
+	WLog_Print(log, WLOG_INFO, "last %s", str);
+
+	memset(str, 'X', strlen(str));
+	free(str);
+	str = nullptr;
+
+	(void)SetEvent(blockEvent);
+	if (!WLog_SetAppenderAsync(appender, 0, WLOG_ASYNC_OVERFLOW_BLOCK))
+		goto fail;
+
+	rc = (formatted == TEST_FORMATS);
+fail:
+	if (blockEvent)
+		(void)SetEvent(blockEvent);
+	(void)WLog_SetAppenderAsync(appender, 0, WLOG_ASYNC_OVERFLOW_BLOCK);
+	(void)CloseHandle(blockEvent);
+	blockEvent = nullptr;
+	free(str);
+	return rc;
+}
+
+int TestWLogAsync(int argc, char* argv[])
+{
+	wLogCallbacks callbacks = WINPR_C_ARRAY_INIT;
+
+	WINPR_UNUSED(argc);
+	WINPR_UNUSED(argv);
+
+	wLog* root = WLog_GetRoot();
+	if (!WLog_SetLogAppenderType(root, WLOG_APPENDER_CALLBACK))
+		return -1;
+
+	wLogAppender* appender = WLog_GetLogAppender(root);
+
+	callbacks.data = CallbackAppenderOther;
+	callbacks.image = CallbackAppenderOther;
+	callbacks.message = CallbackAppenderMessage;
+	callbacks.package = CallbackAppenderOther;
+
+	if (!WLog_ConfigureAppender(appender, "callbacks", (void*)&callbacks))
+		return -1;
+
+	wLogLayout* layout = WLog_GetLogLayout(root);
+	if (!WLog_Layout_SetPrefixFormat(root, layout, "%mn"))
+		return -1;
+
+	if (!WLog_SetLogLevel(WLog_Get(channel), WLOG_INFO) ||
+	    !WLog_SetLogLevel(WLog_Get(formatChannel), WLOG_INFO))
+		return -1;
+
+	if (!test_block(appender))
+	{
+		(void)fprintf(stderr, "test_block failed\n");
+		return -1;
+	}
+
+	if (!test_drop(appender))
+	{
+		(void)fprintf(stderr, "test_drop failed\n");
+		return -1;
+	}
+
+	if (!test_format(appender))
+	{
+		(void)fprintf(stderr, "test_format failed\n");
+		return -1;
+	}
+
+	if (!WLog_CloseAppender(root))
+		return -1;
+
+	return success ? 0 : -1;
+}
@@ -20,12 +20,17 @@
 #include <winpr/config.h>
 
 #include "Appender.h"
+#include "AsyncQueue.h"
 
 void WLog_Appender_Free(wLog* log, wLogAppender* appender)
 {
 	if (!appender)
 		return;
 
+	/* Write the queued messages before the appender goes away */
+	WLog_AsyncQueue_Free(appender->async);
+	appender->async = nullptr;
+
 	if (appender->Layout)
 	{
 		WLog_Layout_Free(log, appender->Layout);
@@ -82,10 +87,15 @@ BOOL WLog_CloseAppender(wLog* log)
 	if (!appender->Close)
 		return TRUE;
 
+	WLog_AsyncQueue_Flush(appender->async);
+
 	if (appender->active)
 	{
+		/* The asynchronous writer thread might still flush the output */
+		EnterCriticalSection(&appender->lock);
 		status = appender->Close(log, appender);
 		appender->active = FALSE;
+		LeaveCriticalSection(&appender->lock);
 	}
 
 	return status;
@@ -180,6 +190,39 @@ BOOL WLog_ConfigureAppender(wLogAppender* appender, const char* setting, void* v
 		return FALSE;
 }
 
+BOOL WLog_SetAppenderAsync(wLogAppender* appender, size_t capacity, wLogAsyncOverflow overflow)
+{
+	if (!appender)
+		return FALSE;
+
+	switch (overflow)
+	{
+		case WLOG_ASYNC_OVERFLOW_BLOCK:
+		case WLOG_ASYNC_OVERFLOW_DROP:
+			break;
+		default:
+			return FALSE;
+	}
+
+	WLog_AsyncQueue_Free(appender->async);
+	appender->async = nullptr;
+
+	if (capacity == 0)
+		return TRUE;
+
+	appender->async = WLog_AsyncQueue_New(appender, capacity, overflow);
+	return appender->async != nullptr;
+}
+
+BOOL WLog_GetAppenderAsyncStats(wLogAppender* appender, wLogAsyncStats* stats)
+{
+	if (!appender || !stats || !appender->async)
+		return FALSE;
+
+	WLog_AsyncQueue_GetStats(appender->async, stats);
+	return TRUE;
+}
+
 BOOL WLog_SetAppenderContext(wLogAppender* appender, wLogMessageType type, void* context)
 {
 	if (!appender)
@@ -0,0 +1,850 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * WinPR Logger
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <winpr/config.h>
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <winpr/crt.h>
+#include <winpr/assert.h>
+#include <winpr/synch.h>
+#include <winpr/thread.h>
+#include <winpr/sysinfo.h>
+#include <winpr/interlocked.h>
+
+#include "AsyncQueue.h"
+
+#ifndef MIN
+#define MIN(x, y) (((x) < (y)) ? (x) : (y))
+#endif
+
+#ifndef MAX
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+#endif
+
+#define WLOG_ASYNC_MIN_CAPACITY 16
+#define WLOG_ASYNC_MAX_CAPACITY (1 << 20)
+
+/* Records longer than this are copied to a heap allocation */
+#define WLOG_ASYNC_INLINE_SIZE 496
+
+/* Longest conversion specification formatted by the writer thread */
+#define WLOG_ASYNC_MAX_SPEC 32
+
+/* Argument types captured for formatting on the writer thread */
+typedef enum
+{
+	WLOG_ASYNC_ARG_NONE, /* %% */
+	WLOG_ASYNC_ARG_INT,
+	WLOG_ASYNC_ARG_LONG,
+	WLOG_ASYNC_ARG_LLONG,
+	WLOG_ASYNC_ARG_INTMAX,
+	WLOG_ASYNC_ARG_SIZE,
+	WLOG_ASYNC_ARG_PTRDIFF,
+	WLOG_ASYNC_ARG_DOUBLE,
+	WLOG_ASYNC_ARG_LDOUBLE,
+	WLOG_ASYNC_ARG_POINTER,
+	WLOG_ASYNC_ARG_STRING,
+	WLOG_ASYNC_ARG_INVALID /* not supported, the caller formats the message */
+} wLogAsyncArg;
+
+typedef struct
+{
+	const char* start; /* the '%' */
+	const char* end;   /* past the conversion character */
+	BOOL starWidth;
+	BOOL starPrecision;
+	int precision; /* -1 if none was given */
+	wLogAsyncArg arg;
+} wLogAsyncSpec;
+
+typedef struct
+{
+	/* Slot state of the bounded queue: equal to the enqueue position while free, position + 1
+	 * once the message is published and position + capacity after the writer released it */
+	LONG volatile sequence;
+	wLog* log;
+	DWORD level;
+	size_t line;
+	LPCSTR file;
+	LPCSTR function;
+	LPCSTR format;
+	wLogMessageOrigin origin;
+	/* The copied format string followed by the captured arguments if deferred, the formatted
+	 * text otherwise */
+	BOOL deferred;
+	size_t length;
+	BYTE* heap;
+	size_t heapSize;
+	BYTE data[WLOG_ASYNC_INLINE_SIZE];
+} wLogAsyncRecord;
+
+struct s_wLogAsyncQueue
+{
+	wLogAppender* appender;
+	wLogAsyncOverflow overflow;
+	ULONG capacity;
+	ULONG mask;
+	wLogAsyncRecord* records;
+
+	LONG volatile enqueuePos;
+	LONG volatile dequeuePos; /* only written by the writer thread */
+	LONG volatile sleeping;   /* writer thread waits for dataEvent */
+	LONG volatile blocked;    /* producers waiting for spaceEvent */
+	LONG volatile terminate;
+	LONGLONG volatile written;
+	LONGLONG volatile dropped;
+
+	HANDLE dataEvent;
+	HANDLE spaceEvent;
+	HANDLE thread;
+	DWORD threadId;
+
+	char* text; /* formatting buffer of the writer thread */
+};
+
+static LONG wlog_async_read(LONG volatile* value)
+{
+	return InterlockedCompareExchange(value, 0, 0);
+}
+
+static void wlog_async_write(LONG volatile* target, LONG value)
+{
+	const LONG prev = InterlockedExchange(target, value);
+	WINPR_UNUSED(prev);
+}
+
+static LONG wlog_async_diff(LONG a, LONG b)
+{
+	return (LONG)((ULONG)a - (ULONG)b);
+}
+
+static void wlog_async_add64(LONGLONG volatile* value, LONGLONG add)
+{
+	LONGLONG cur = *value;
+	for (;;)
+	{
+		const LONGLONG prev = InterlockedCompareExchange64(value, cur + add, cur);
+		if (prev == cur)
+			return;
+		cur = prev;
+	}
+}
+
+static BOOL wlog_async_drop(wLogAsyncQueue* queue)
+{
+	wlog_async_add64(&queue->dropped, 1);
+	return FALSE;
+}
+
+static BYTE* wlog_async_record_data(wLogAsyncRecord* record)
+{
+	return record->heap ? record->heap : record->data;
+}
+
+static void wlog_async_record_clear(wLogAsyncRecord* record)
+{
+	free(record->heap);
+	record->heap = nullptr;
+	record->heapSize = 0;
+	record->length = 0;
+}
+
+WINPR_ATTR_NODISCARD
+static BOOL wlog_async_record_append(wLogAsyncRecord* record, const void* data, size_t length)
+{
+	const size_t size = record->heap ? record->heapSize : sizeof(record->data);
+
+	if (size - record->length < length)
+	{
+		const size_t required = record->length + length;
+		if (required > 4 * WLOG_MAX_STRING_SIZE)
+			return FALSE;
+
+		const size_t heapSize = MAX(2 * size, required);
+		BYTE* heap = realloc(record->heap, heapSize);
+		if (!heap)
+			return FALSE;
+		if (!record->heap)
+			memcpy(heap, record->data, record->length);
+		record->heap = heap;
+		record->heapSize = heapSize;
+	}
+
+	memcpy(&wlog_async_record_data(record)[record->length], data, length);
+	record->length += length;
+	return TRUE;
+}
+
+static BOOL wlog_async_is_digit(char c)
+{
+	return (c >= '0') && (c <= '9');
+}
+
+/* Finds the next conversion specification in \b format, returns nullptr if there is none */
+static const char* wlog_async_parse_spec(const char* format, wLogAsyncSpec* spec)
+{
+	const char* cur = strchr(format, '%');
+	if (!cur)
+		return nullptr;
+
+	spec->start = cur++;
+	spec->starWidth = FALSE;
+	spec->starPrecision = FALSE;
+	spec->precision = -1;
+	spec->arg = WLOG_ASYNC_ARG_INVALID;
+
+	if (*cur == '%')
+	{
+		spec->arg = WLOG_ASYNC_ARG_NONE;
+		spec->end = cur + 1;
+		return spec->end;
+	}
+
+	while ((*cur != '\0') && strchr("-+ #0", *cur))
+		cur++;
+
+	if (*cur == '*')
+	{
+		spec->starWidth = TRUE;
+		cur++;
+	}
+	else
+	{
+		while (wlog_async_is_digit(*cur))
+			cur++;
+	}
+
+	if (*cur == '.')
+	{
+		cur++;
+		if (*cur == '*')
+		{
+			spec->starPrecision = TRUE;
+			cur++;
+		}
+		else
+		{
+			spec->precision = 0;
+			while (wlog_async_is_digit(*cur))
+			{
+				if (spec->precision < WLOG_MAX_STRING_SIZE)
+					spec->precision = spec->precision * 10 + (*cur - '0');
+				cur++;
+			}
+		}
+	}
+
+	/* Length modifier, hh and h arguments are promoted to int */
+	char length = '\0';
+	switch (*cur)
+	{
+		case 'h':
+			cur += (cur[1] == 'h') ? 2 : 1;
+			length = 'h';
+			break;
+		case 'l':
+			length = (cur[1] == 'l') ? 'q' : 'l';
+			cur += (cur[1] == 'l') ? 2 : 1;
+			break;
+		case 'j':
+		case 'z':
+		case 't':
+		case 'L':
+			length = *cur++;
+			break;
+		default:
+			break;
+	}
+
+	switch (*cur)
+	{
+		case 'd':
+		case 'i':
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			switch (length)
+			{
+				case 'l':
+					spec->arg = WLOG_ASYNC_ARG_LONG;
+					break;
+				case 'q':
+					spec->arg = WLOG_ASYNC_ARG_LLONG;
+					break;
+				case 'j':
+					spec->arg = WLOG_ASYNC_ARG_INTMAX;
+					break;
+				case 'z':
+					spec->arg = WLOG_ASYNC_ARG_SIZE;
+					break;
+				case 't':
+					spec->arg = WLOG_ASYNC_ARG_PTRDIFF;
+					break;
+				case 'L':
+					break;
+				default:
+					spec->arg = WLOG_ASYNC_ARG_INT;
+					break;
+			}
+			break;
+		case 'c':
+			if (length == '\0')
+				spec->arg = WLOG_ASYNC_ARG_INT;
+			break;
+		case 's':
+			if (length == '\0')
+				spec->arg = WLOG_ASYNC_ARG_STRING;
+			break;
+		case 'p':
+			if (length == '\0')
+				spec->arg = WLOG_ASYNC_ARG_POINTER;
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			if ((length == '\0') || (length == 'l'))
+				spec->arg = WLOG_ASYNC_ARG_DOUBLE;
+			else if (length == 'L')
+				spec->arg = WLOG_ASYNC_ARG_LDOUBLE;
+			break;
+		default:
+			/* %n, %m, wide characters and positional arguments */
+			break;
+	}
+
+	spec->end = (*cur != '\0') ? cur + 1 : cur;
+	if (spec->end - spec->start > WLOG_ASYNC_MAX_SPEC)
+		spec->arg = WLOG_ASYNC_ARG_INVALID;
+	return spec->end;
+}
+
+#define WLOG_ASYNC_CAPTURE(record, args, type)                        \
+	do                                                                \
+	{                                                                 \
+		const type value = va_arg(args, type);                        \
+		if (!wlog_async_record_append(record, &value, sizeof(value))) \
+			return FALSE;                                             \
+	} while (0)
+
+/**
+ * Copies the format string and its arguments to the record, the expensive number and string
+ * formatting is left to the writer thread. Strings are copied as the caller may free them
+ * once the message was queued.
+ *
+ * @return \b FALSE if the format is not supported, the caller has to format the message then
+ */
+WINPR_ATTR_NODISCARD
+static BOOL wlog_async_capture(wLogAsyncRecord* record, const char* format, va_list args)
+{
+	wLogAsyncSpec spec = WINPR_C_ARRAY_INIT;
+
+	record->length = 0;
+	if (!wlog_async_record_append(record, format, strlen(format) + 1))
+		return FALSE;
+
+	const char* cur = format;
+	while ((cur = wlog_async_parse_spec(cur, &spec)))
+	{
+		if (spec.starWidth)
+			WLOG_ASYNC_CAPTURE(record, args, int);
+		if (spec.starPrecision)
+		{
+			const int value = va_arg(args, int);
+			if (!wlog_async_record_append(record, &value, sizeof(value)))
+				return FALSE;
+			spec.precision = (value < 0) ? -1 : value;
+		}
+
+		switch (spec.arg)
+		{
+			case WLOG_ASYNC_ARG_NONE:
+				break;
+			case WLOG_ASYNC_ARG_INT:
+				WLOG_ASYNC_CAPTURE(record, args, int);
+				break;
+			case WLOG_ASYNC_ARG_LONG:
+				WLOG_ASYNC_CAPTURE(record, args, long);
+				break;
+			case WLOG_ASYNC_ARG_LLONG:
+				WLOG_ASYNC_CAPTURE(record, args, long long);
+				break;
+			case WLOG_ASYNC_ARG_INTMAX:
+				WLOG_ASYNC_CAPTURE(record, args, intmax_t);
+				break;
+			case WLOG_ASYNC_ARG_SIZE:
+				WLOG_ASYNC_CAPTURE(record, args, size_t);
+				break;
+			case WLOG_ASYNC_ARG_PTRDIFF:
+				WLOG_ASYNC_CAPTURE(record, args, ptrdiff_t);
+				break;
+			case WLOG_ASYNC_ARG_DOUBLE:
+				WLOG_ASYNC_CAPTURE(record, args, double);
+				break;
+			case WLOG_ASYNC_ARG_LDOUBLE:
+				WLOG_ASYNC_CAPTURE(record, args, long double);
+				break;
+			case WLOG_ASYNC_ARG_POINTER:
+				WLOG_ASYNC_CAPTURE(record, args, void*);
+				break;
+			case WLOG_ASYNC_ARG_STRING:
+			{
+				/* SIZE_MAX marks a null pointer */
+				const char* str = va_arg(args, const char*);
+				size_t max = WLOG_MAX_STRING_SIZE - 1;
+				if (spec.precision >= 0)
+					max = MIN(max, (size_t)spec.precision);
+
+				const size_t length = str ? strnlen(str, max) : SIZE_MAX;
+				if (!wlog_async_record_append(record, &length, sizeof(length)))
+					return FALSE;
+				if (str && (!wlog_async_record_append(record, str, length) ||
+				            !wlog_async_record_append(record, "", 1)))
+					return FALSE;
+				break;
+			}
+			case WLOG_ASYNC_ARG_INVALID:
+			default:
+				return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static const BYTE* wlog_async_read_arg(const BYTE* data, void* value, size_t length)
+{
+	memcpy(value, data, length);
+	return &data[length];
+}
+
+/* Appends \b length characters of \b str, the output is truncated like vsnprintf would */
+static void wlog_async_text_append(char* text, size_t* offset, const char* str, size_t length)
+{
+	const size_t left = WLOG_MAX_STRING_SIZE - 1 - *offset;
+	length = MIN(length, left);
+	memcpy(&text[*offset], str, length);
+	*offset += length;
+}
+
+static void wlog_async_text_advance(size_t* offset, int rc)
+{
+	if (rc > 0)
+		*offset += MIN((size_t)rc, WLOG_MAX_STRING_SIZE - 1 - *offset);
+}
+
+#define WLOG_ASYNC_FORMAT(text, offset, fmt, data, type)                                 \
+	do                                                                                   \
+	{                                                                                    \
+		type value = WINPR_C_ARRAY_INIT;                                                 \
+		(data) = wlog_async_read_arg((data), &value, sizeof(value));                     \
+		const int rc = snprintf(&(text)[offset], WLOG_MAX_STRING_SIZE - (offset), fmt, value); \
+		wlog_async_text_advance(&(offset), rc);                                          \
+	} while (0)
+
+/* Formats a record captured by \b wlog_async_capture on the writer thread */
+static const char* wlog_async_format(wLogAsyncQueue* queue, wLogAsyncRecord* record)
+{
+	char* text = queue->text;
+	size_t offset = 0;
+	wLogAsyncSpec spec = WINPR_C_ARRAY_INIT;
+
+	const char* format = (const char*)wlog_async_record_data(record);
+	const BYTE* data = (const BYTE*)&format[strlen(format) + 1];
+	const char* cur = format;
+
+	for (;;)
+	{
+		const char* next = wlog_async_parse_spec(cur, &spec);
+		const char* literal = next ? spec.start : &cur[strlen(cur)];
+		wlog_async_text_append(text, &offset, cur, (size_t)(literal - cur));
+		if (!next)
+			break;
+		cur = next;
+
+		/* The captured width and precision replace the asterisks */
+		char fmt[WLOG_ASYNC_MAX_SPEC + 32] = WINPR_C_ARRAY_INIT;
+		size_t pos = 0;
+		for (const char* c = spec.start; c < spec.end; c++)
+		{
+			if (*c != '*')
+				fmt[pos++] = *c;
+			else
+			{
+				int value = 0;
+				data = wlog_async_read_arg(data, &value, sizeof(value));
+
+				/* A negative precision is taken as if it was omitted */
+				if ((c > spec.start) && (c[-1] == '.') && (value < 0))
+					pos--;
+				else
+				{
+					const int rc = snprintf(&fmt[pos], sizeof(fmt) - pos, "%lld", 1ll * value);
+					if (rc > 0)
+						pos += (size_t)rc;
+				}
+			}
+		}
+
+		WINPR_PRAGMA_DIAG_PUSH
+		WINPR_PRAGMA_DIAG_IGNORED_FORMAT_NONLITERAL
+		switch (spec.arg)
+		{
+			case WLOG_ASYNC_ARG_NONE:
+				wlog_async_text_append(text, &offset, "%", 1);
+				break;
+			case WLOG_ASYNC_ARG_INT:
+				WLOG_ASYNC_FORMAT(text, offset, fmt, data, int);
+				break;
+			case WLOG_ASYNC_ARG_LONG:
+				WLOG_ASYNC_FORMAT(text, offset, fmt, data, long);
+				break;
+			case WLOG_ASYNC_ARG_LLONG:
+				WLOG_ASYNC_FORMAT(text, offset, fmt, data, long long);
+				break;
+			case WLOG_ASYNC_ARG_INTMAX:
+				WLOG_ASYNC_FORMAT(text, offset, fmt, data, intmax_t);
+				break;
+			case WLOG_ASYNC_ARG_SIZE:
+				WLOG_ASYNC_FORMAT(text, offset, fmt, data, size_t);
+				break;
+			case WLOG_ASYNC_ARG_PTRDIFF:
+				WLOG_ASYNC_FORMAT(text, offset, fmt, data, ptrdiff_t);
+				break;
+			case WLOG_ASYNC_ARG_DOUBLE:
+				WLOG_ASYNC_FORMAT(text, offset, fmt, data, double);
+				break;
+			case WLOG_ASYNC_ARG_LDOUBLE:
+				WLOG_ASYNC_FORMAT(text, offset, fmt, data, long double);
+				break;
+			case WLOG_ASYNC_ARG_POINTER:
+				WLOG_ASYNC_FORMAT(text, offset, fmt, data, void*);
+				break;
+			case WLOG_ASYNC_ARG_STRING:
+			{
+				size_t length = 0;
+				data = wlog_async_read_arg(data, &length, sizeof(length));
+
+				const char* str = "(null)";
+				if (length != SIZE_MAX)
+				{
+					str = (const char*)data;
+					data = &data[length + 1];
+				}
+
+				wlog_async_text_advance(
+				    &offset, snprintf(&text[offset], WLOG_MAX_STRING_SIZE - offset, fmt, str));
+				break;
+			}
+			case WLOG_ASYNC_ARG_INVALID:
+			default:
+				break;
+		}
+		WINPR_PRAGMA_DIAG_POP
+	}
+
+	text[offset] = '\0';
+	return text;
+}
+
+static void wlog_async_write_record(wLogAsyncQueue* queue, wLogAsyncRecord* record)
+{
+	wLogAppender* appender = queue->appender;
+
+	/* Formatting outside of the appender lock keeps synchronous writers going */
+	const char* text = record->deferred ? wlog_async_format(queue, record)
+	                                    : (const char*)wlog_async_record_data(record);
+	const char* format =
+	    record->deferred ? (const char*)wlog_async_record_data(record) : record->format;
+
+	const wLogMessage message = { .Type = WLOG_MESSAGE_TEXT,
+		                          .Level = record->level,
+		                          .FormatString = format,
+		                          .TextString = text,
+		                          .LineNumber = record->line,
+		                          .FileName = record->file,
+		                          .FunctionName = record->function };
+
+	EnterCriticalSection(&appender->lock);
+	if (appender->WriteMessage && !appender->recursive)
+	{
+		appender->recursive = TRUE;
+		appender->Layout->Origin = &record->origin;
+		const BOOL rc = appender->WriteMessage(record->log, appender, &message);
+		WINPR_UNUSED(rc);
+		appender->Layout->Origin = nullptr;
+		appender->recursive = FALSE;
+	}
+	LeaveCriticalSection(&appender->lock);
+}
+
+static BOOL wlog_async_pop(wLogAsyncQueue* queue)
+{
+	const LONG pos = queue->dequeuePos;
+	wLogAsyncRecord* record = &queue->records[(ULONG)pos & queue->mask];
+
+	if (wlog_async_diff(wlog_async_read(&record->sequence), pos) <= 0)
+		return FALSE;
+
+	wlog_async_write_record(queue, record);
+	wlog_async_record_clear(record);
+
+	wlog_async_write(&queue->dequeuePos, (LONG)((ULONG)pos + 1));
+	wlog_async_write(&record->sequence, (LONG)((ULONG)pos + queue->capacity));
+	wlog_async_add64(&queue->written, 1);
+
+	/* Blocked producers are woken once half of the queue is free. They queue a batch then
+	 * instead of taking turns with the writer thread for every message. */
+	if (wlog_async_read(&queue->blocked))
+	{
+		const LONG queued = wlog_async_diff(wlog_async_read(&queue->enqueuePos),
+		                                    (LONG)((ULONG)pos + 1));
+		if (queued <= (LONG)(queue->capacity / 2))
+			(void)SetEvent(queue->spaceEvent);
+	}
+	return TRUE;
+}
+
+static BOOL wlog_async_empty(wLogAsyncQueue* queue)
+{
+	return wlog_async_read(&queue->enqueuePos) == wlog_async_read(&queue->dequeuePos);
+}
+
+static DWORD WINAPI wlog_async_thread(LPVOID arg)
+{
+	wLogAsyncQueue* queue = arg;
+	WINPR_ASSERT(queue);
+
+	for (;;)
+	{
+		while (wlog_async_pop(queue))
+			;
+
+		if (queue->appender->Flush)
+		{
+			EnterCriticalSection(&queue->appender->lock);
+			queue->appender->Flush(queue->appender);
+			LeaveCriticalSection(&queue->appender->lock);
+		}
+
+		if (wlog_async_read(&queue->terminate) && wlog_async_empty(queue))
+			break;
+
+		/* Producers check the flag after publishing, so either they signal or we see the data */
+		(void)ResetEvent(queue->dataEvent);
+		wlog_async_write(&queue->sleeping, 1);
+		if (wlog_async_empty(queue) && !wlog_async_read(&queue->terminate))
+			(void)WaitForSingleObject(queue->dataEvent, INFINITE);
+		wlog_async_write(&queue->sleeping, 0);
+	}
+
+	return 0;
+}
+
+BOOL WLog_AsyncQueue_Push(wLogAsyncQueue* queue, wLog* log, const wLogMessage* message,
+                          va_list args)
+{
+	WINPR_ASSERT(queue);
+	WINPR_ASSERT(message);
+
+	/* Messages logged by the appender itself could wait for a slot forever */
+	if (GetCurrentThreadId() == queue->threadId)
+		return wlog_async_drop(queue);
+
+	wLogAsyncRecord* record = nullptr;
+	LONG pos = wlog_async_read(&queue->enqueuePos);
+
+	for (;;)
+	{
+		record = &queue->records[(ULONG)pos & queue->mask];
+		const LONG diff = wlog_async_diff(wlog_async_read(&record->sequence), pos);
+
+		if (diff == 0)
+		{
+			const LONG cur =
+			    InterlockedCompareExchange(&queue->enqueuePos, (LONG)((ULONG)pos + 1), pos);
+			if (cur == pos)
+				break;
+			pos = cur;
+		}
+		else if (diff < 0)
+		{
+			if (queue->overflow == WLOG_ASYNC_OVERFLOW_DROP)
+				return wlog_async_drop(queue);
+
+			/* The timeout covers a wakeup reset by another blocked producer */
+			(void)InterlockedIncrement(&queue->blocked);
+			(void)ResetEvent(queue->spaceEvent);
+			if (wlog_async_diff(wlog_async_read(&record->sequence), pos) < 0)
+				(void)WaitForSingleObject(queue->spaceEvent, 1);
+			(void)InterlockedDecrement(&queue->blocked);
+			pos = wlog_async_read(&queue->enqueuePos);
+		}
+		else
+			pos = wlog_async_read(&queue->enqueuePos);
+	}
+
+	record->log = log;
+	record->level = message->Level;
+	record->line = message->LineNumber;
+	record->file = message->FileName;
+	record->function = message->FunctionName;
+	record->format = message->FormatString;
+	record->origin.tid = WLog_Layout_GetThreadId();
+	GetLocalTime(&record->origin.time);
+
+	int rc = 0;
+	va_list copy = WINPR_C_ARRAY_INIT;
+	va_copy(copy, args);
+	record->deferred = wlog_async_capture(record, message->FormatString, copy);
+	va_end(copy);
+
+	if (!record->deferred)
+	{
+		wlog_async_record_clear(record);
+
+		va_copy(copy, args);
+		WINPR_PRAGMA_DIAG_PUSH
+		WINPR_PRAGMA_DIAG_IGNORED_FORMAT_NONLITERAL
+		rc = vsnprintf((char*)record->data, sizeof(record->data), message->FormatString, copy);
+		va_end(copy);
+
+		if (rc < 0)
+			record->data[0] = '\0';
+		else if ((size_t)rc >= sizeof(record->data))
+		{
+			const size_t size = MIN((size_t)rc + 1, WLOG_MAX_STRING_SIZE);
+			record->heap = malloc(size);
+
+			/* Without memory the truncated inline text is logged */
+			if (record->heap)
+			{
+				record->heapSize = size;
+				(void)vsnprintf((char*)record->heap, size, message->FormatString, args);
+			}
+		}
+		WINPR_PRAGMA_DIAG_POP
+	}
+
+	wlog_async_write(&record->sequence, (LONG)((ULONG)pos + 1));
+
+	if (wlog_async_read(&queue->sleeping))
+		(void)SetEvent(queue->dataEvent);
+	return rc >= 0;
+}
+
+void WLog_AsyncQueue_Flush(wLogAsyncQueue* queue)
+{
+	if (!queue || (GetCurrentThreadId() == queue->threadId))
+		return;
+
+	const LONG pos = wlog_async_read(&queue->enqueuePos);
+	while (wlog_async_diff(pos, wlog_async_read(&queue->dequeuePos)) > 0)
+	{
+		(void)SetEvent(queue->dataEvent);
+		Sleep(1);
+	}
+}
+
+void WLog_AsyncQueue_GetStats(wLogAsyncQueue* queue, wLogAsyncStats* stats)
+{
+	WINPR_ASSERT(queue);
+	WINPR_ASSERT(stats);
+
+	const LONG queued =
+	    wlog_async_diff(wlog_async_read(&queue->enqueuePos), wlog_async_read(&queue->dequeuePos));
+
+	stats->capacity = queue->capacity;
+	stats->queued = (queued > 0) ? (size_t)queued : 0;
+	stats->written = (UINT64)InterlockedCompareExchange64(&queue->written, 0, 0);
+	stats->dropped = (UINT64)InterlockedCompareExchange64(&queue->dropped, 0, 0);
+}
+
+void WLog_AsyncQueue_Free(wLogAsyncQueue* queue)
+{
+	if (!queue)
+		return;
+
+	if (queue->thread)
+	{
+		wlog_async_write(&queue->terminate, 1);
+		(void)SetEvent(queue->dataEvent);
+		(void)WaitForSingleObject(queue->thread, INFINITE);
+		(void)CloseHandle(queue->thread);
+	}
+
+	if (queue->records)
+	{
+		for (size_t x = 0; x < queue->capacity; x++)
+			wlog_async_record_clear(&queue->records[x]);
+	}
+
+	if (queue->dataEvent)
+		(void)CloseHandle(queue->dataEvent);
+	if (queue->spaceEvent)
+		(void)CloseHandle(queue->spaceEvent);
+	free(queue->records);
+	free(queue->text);
+	free(queue);
+}
+
+wLogAsyncQueue* WLog_AsyncQueue_New(wLogAppender* appender, size_t capacity,
+                                    wLogAsyncOverflow overflow)
+{
+	WINPR_ASSERT(appender);
+
+	wLogAsyncQueue* queue = calloc(1, sizeof(wLogAsyncQueue));
+	if (!queue)
+		return nullptr;
+
+	queue->appender = appender;
+	queue->overflow = overflow;
+	queue->capacity = WLOG_ASYNC_MIN_CAPACITY;
+	while ((queue->capacity < capacity) && (queue->capacity < WLOG_ASYNC_MAX_CAPACITY))
+		queue->capacity <<= 1;
+	queue->mask = queue->capacity - 1;
+
+	queue->records = calloc(queue->capacity, sizeof(wLogAsyncRecord));
+	queue->text = calloc(WLOG_MAX_STRING_SIZE, sizeof(char));
+	if (!queue->records || !queue->text)
+		goto fail;
+
+	for (ULONG x = 0; x < queue->capacity; x++)
+		queue->records[x].sequence = (LONG)x;
+
+	queue->dataEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	queue->spaceEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	if (!queue->dataEvent || !queue->spaceEvent)
+		goto fail;
+
+	queue->thread = CreateThread(nullptr, 0, wlog_async_thread, queue, 0, &queue->threadId);
+	if (!queue->thread)
+		goto fail;
+
+	return queue;
+fail:
+	WLog_AsyncQueue_Free(queue);
+	return nullptr;
+}
@@ -0,0 +1,43 @@
+/**
+ * WinPR: Windows Portable Runtime
+ * WinPR Logger
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef WINPR_WLOG_ASYNC_QUEUE_PRIVATE_H
+#define WINPR_WLOG_ASYNC_QUEUE_PRIVATE_H
+
+#include <stdarg.h>
+
+#include "wlog.h"
+
+WINPR_LOCAL void WLog_AsyncQueue_Free(wLogAsyncQueue* queue);
+
+WINPR_ATTR_MALLOC(WLog_AsyncQueue_Free, 1)
+WINPR_ATTR_NODISCARD
+WINPR_LOCAL wLogAsyncQueue* WLog_AsyncQueue_New(wLogAppender* appender, size_t capacity,
+                                                wLogAsyncOverflow overflow);
+
+/* Queues a text message for the writer thread, which formats it unless the format needs
+ * conversions the queue can not capture */
+WINPR_ATTR_NODISCARD
+WINPR_LOCAL BOOL WLog_AsyncQueue_Push(wLogAsyncQueue* queue, wLog* log, const wLogMessage* message,
+                                      va_list args);
+
+/* Waits until the writer thread wrote all messages queued so far */
+WINPR_LOCAL void WLog_AsyncQueue_Flush(wLogAsyncQueue* queue);
+
+WINPR_LOCAL void WLog_AsyncQueue_GetStats(wLogAsyncQueue* queue, wLogAsyncStats* stats);
+
+#endif /* WINPR_WLOG_ASYNC_QUEUE_PRIVATE_H */
@@ -23,6 +23,7 @@
 #include "Message.h"
 
 #include <winpr/crt.h>
+#include <winpr/assert.h>
 #include <winpr/environment.h>
 #include <winpr/file.h>
 #include <winpr/path.h>
@@ -135,10 +136,22 @@ static BOOL WLog_FileAppender_WriteMessage(wLog* log, wLogAppender* appender,
 	char prefix[WLOG_MAX_PREFIX_SIZE] = WINPR_C_ARRAY_INIT;
 	WLog_Layout_GetMessagePrefix(log, appender->Layout, cmessage, prefix, sizeof(prefix));
 	(void)fprintf(fp, "%s%s\n", prefix, cmessage->TextString);
-	(void)fflush(fp); /* slow! */
+
+	/* The asynchronous writer flushes once its queue ran empty */
+	if (!appender->async)
+		(void)fflush(fp); /* slow! */
 	return TRUE;
 }
 
+static void WLog_FileAppender_Flush(wLogAppender* appender)
+{
+	wLogFileAppender* fileAppender = (wLogFileAppender*)appender;
+	WINPR_ASSERT(fileAppender);
+
+	if (fileAppender->FileDescriptor)
+		(void)fflush(fileAppender->FileDescriptor);
+}
+
 static int g_DataId = 0;
 
 static BOOL WLog_FileAppender_WriteDataMessage(wLog* log, wLogAppender* appender,
@@ -220,6 +233,7 @@ wLogAppender* WLog_FileAppender_New(WINPR_ATTR_UNUSED wLog* log)
 	FileAppender->common.WriteImageMessage = WLog_FileAppender_WriteImageMessage;
 	FileAppender->common.Free = WLog_FileAppender_Free;
 	FileAppender->common.Set = WLog_FileAppender_Set;
+	FileAppender->common.Flush = WLog_FileAppender_Flush;
 	name = "WLOG_FILEAPPENDER_OUTPUT_FILE_PATH";
 	nSize = GetEnvironmentVariableA(name, nullptr, 0);
 
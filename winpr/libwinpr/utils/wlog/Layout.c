@@ -47,6 +47,7 @@ struct format_option_recurse;
 struct format_tid_arg
 {
 	char tid[32];
+	const wLogMessageOrigin* origin;
 };
 
 struct format_option
@@ -97,18 +98,22 @@ static void WLog_PrintMessagePrefix(char* prefix, size_t prefixlen,
 	va_end(args);
 }
 
-static const char* get_tid(void* arg)
+size_t WLog_Layout_GetThreadId(void)
 {
-	struct format_tid_arg* targ = arg;
-	WINPR_ASSERT(targ);
-
-	size_t tid = 0;
 #if defined __linux__ && !defined ANDROID
 	/* On Linux we prefer to see the LWP id */
-	tid = (size_t)syscall(SYS_gettid);
+	return (size_t)syscall(SYS_gettid);
 #else
-	tid = (size_t)GetCurrentThreadId();
+	return (size_t)GetCurrentThreadId();
 #endif
+}
+
+static const char* get_tid(void* arg)
+{
+	struct format_tid_arg* targ = arg;
+	WINPR_ASSERT(targ);
+
+	const size_t tid = targ->origin ? targ->origin->tid : WLog_Layout_GetThreadId();
 	(void)_snprintf(targ->tid, sizeof(targ->tid), "%08" PRIxz, tid);
 	return targ->tid;
 }
@@ -250,10 +255,13 @@ BOOL WLog_Layout_GetMessagePrefix(wLog* log, wLogLayout* layout, const wLogMessa
 	WINPR_ASSERT(message);
 	WINPR_ASSERT(prefix);
 
-	struct format_tid_arg targ = WINPR_C_ARRAY_INIT;
+	struct format_tid_arg targ = { .tid = WINPR_C_ARRAY_INIT, .origin = layout->Origin };
 
 	SYSTEMTIME localTime = WINPR_C_ARRAY_INIT;
-	GetLocalTime(&localTime);
+	if (layout->Origin)
+		localTime = layout->Origin->time;
+	else
+		GetLocalTime(&localTime);
 
 	struct format_option_recurse recurse = {
 		.options = nullptr, .nroptions = 0, .log = log, .layout = layout, .message = message
@@ -20,19 +20,32 @@
 #ifndef WINPR_WLOG_LAYOUT_PRIVATE_H
 #define WINPR_WLOG_LAYOUT_PRIVATE_H
 
+#include <winpr/sysinfo.h>
+
 #include "wlog.h"
 
 /**
  * Log Layout
  */
 
+/* Time and thread a message was logged from, for messages written by another thread */
+typedef struct
+{
+	SYSTEMTIME time;
+	size_t tid;
+} wLogMessageOrigin;
+
 struct s_wLogLayout
 {
 	DWORD Type;
 
 	LPSTR FormatString;
+	const wLogMessageOrigin* Origin; /* set while the appender lock is held, nullptr otherwise */
 };
 
+WINPR_ATTR_NODISCARD
+WINPR_LOCAL size_t WLog_Layout_GetThreadId(void);
+
 WINPR_LOCAL void WLog_Layout_Free(wLog* log, wLogLayout* layout);
 
 WINPR_ATTR_MALLOC(WLog_Layout_Free, 2)
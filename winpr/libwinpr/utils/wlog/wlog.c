@@ -20,6 +20,7 @@
 #include <winpr/config.h>
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <string.h>
@@ -38,10 +39,9 @@
 #endif
 
 #include "wlog.h"
+#include "AsyncQueue.h"
 #include "../log.h"
 
-#define WLOG_MAX_STRING_SIZE 16384
-
 typedef struct
 {
 	DWORD Level;
@@ -109,6 +109,42 @@ static void WLog_Unlock(wLog* log)
 	LeaveCriticalSection(&log->lock);
 }
 
+/* WLOG_ASYNC=<queue size> and WLOG_ASYNC_OVERFLOW=BLOCK|DROP enable the asynchronous writer */
+static BOOL WLog_InitializeAsync(wLog* root)
+{
+	BOOL rc = FALSE;
+	wLogAsyncOverflow overflow = WLOG_ASYNC_OVERFLOW_BLOCK;
+	char* capacity = GetEnvAlloc("WLOG_ASYNC");
+	char* policy = GetEnvAlloc("WLOG_ASYNC_OVERFLOW");
+
+	if (!capacity)
+	{
+		rc = TRUE;
+		goto out;
+	}
+
+	errno = 0;
+	const unsigned long long size = strtoull(capacity, nullptr, 0);
+	if (errno != 0)
+		goto out;
+
+	if (policy)
+	{
+		if (_stricmp(policy, "DROP") == 0)
+			overflow = WLOG_ASYNC_OVERFLOW_DROP;
+		else if (_stricmp(policy, "BLOCK") != 0)
+			goto out;
+	}
+
+	rc = WLog_SetAppenderAsync(WLog_GetLogAppender(root), (size_t)size, overflow);
+out:
+	if (!rc)
+		(void)fprintf(stderr, "Invalid WLOG_ASYNC configuration, using synchronous logging\n");
+	free(capacity);
+	free(policy);
+	return rc;
+}
+
 static BOOL CALLBACK WLog_InitializeRoot(PINIT_ONCE InitOnce, PVOID Parameter, PVOID* Context)
 {
 	char* env = nullptr;
@@ -167,6 +203,8 @@ static BOOL CALLBACK WLog_InitializeRoot(PINIT_ONCE InitOnce, PVOID Parameter, P
 	if (!WLog_SetLogAppenderType(g_RootLog, logAppenderType))
 		goto fail;
 
+	(void)WLog_InitializeAsync(g_RootLog);
+
 	if (!WLog_ParseFilters(g_RootLog))
 		goto fail;
 
@@ -273,6 +311,9 @@ static BOOL WLog_WriteData(wLog* log, const wLogMessage* message)
 	if (!appender->WriteDataMessage)
 		return FALSE;
 
+	/* Keep the order with queued text messages */
+	WLog_AsyncQueue_Flush(appender->async);
+
 	EnterCriticalSection(&appender->lock);
 
 	if (appender->recursive)
@@ -304,6 +345,9 @@ static BOOL WLog_WriteImage(wLog* log, wLogMessage* message)
 	if (!appender->WriteImageMessage)
 		return FALSE;
 
+	/* Keep the order with queued text messages */
+	WLog_AsyncQueue_Flush(appender->async);
+
 	EnterCriticalSection(&appender->lock);
 
 	if (appender->recursive)
@@ -335,6 +379,9 @@ static BOOL WLog_WritePacket(wLog* log, wLogMessage* message)
 	if (!appender->WritePacketMessage)
 		return FALSE;
 
+	/* Keep the order with queued text messages */
+	WLog_AsyncQueue_Flush(appender->async);
+
 	EnterCriticalSection(&appender->lock);
 
 	if (appender->recursive)
@@ -350,10 +397,27 @@ static BOOL WLog_WritePacket(wLog* log, wLogMessage* message)
 	return status;
 }
 
+static BOOL WLog_PrintTextMessageAsync(wLog* log, wLogAppender* appender,
+                                       const wLogMessage* cmessage, va_list args)
+{
+	WINPR_ASSERT(appender);
+
+	if (!appender->active)
+		if (!WLog_OpenAppender(log))
+			return FALSE;
+
+	return WLog_AsyncQueue_Push(appender->async, log, cmessage, args);
+}
+
 static BOOL WLog_PrintTextMessageInternal(wLog* log, const wLogMessage* cmessage, va_list args)
 {
 	assert(cmessage);
 
+	/* The writer thread formats queued messages, skip the buffer on the stack */
+	wLogAppender* appender = WLog_GetLogAppender(log);
+	if (appender && appender->async)
+		return WLog_PrintTextMessageAsync(log, appender, cmessage, args);
+
 	char formattedLogMessage[WLOG_MAX_STRING_SIZE] = WINPR_C_ARRAY_INIT;
 	wLogMessage message = *cmessage;
 	message.TextString = formattedLogMessage;
@@ -23,6 +23,9 @@
 #include <winpr/wlog.h>
 
 #define WLOG_MAX_PREFIX_SIZE 512
+#define WLOG_MAX_STRING_SIZE 16384
+
+typedef struct s_wLogAsyncQueue wLogAsyncQueue;
 
 typedef BOOL (*WLOG_APPENDER_OPEN_FN)(wLog* log, wLogAppender* appender);
 typedef BOOL (*WLOG_APPENDER_CLOSE_FN)(wLog* log, wLogAppender* appender);
@@ -36,6 +39,7 @@ typedef BOOL (*WLOG_APPENDER_WRITE_PACKET_MESSAGE_FN)(wLog* log, wLogAppender* a
                                                       const wLogMessage* message);
 typedef BOOL (*WLOG_APPENDER_SET)(wLogAppender* appender, const char* setting, void* value);
 typedef void (*WLOG_APPENDER_FREE)(wLogAppender* appender);
+typedef void (*WLOG_APPENDER_FLUSH_FN)(wLogAppender* appender);
 
 struct s_wLogAppender
 {
@@ -56,6 +60,8 @@ struct s_wLogAppender
 	WINPR_ATTR_NODISCARD WLOG_APPENDER_WRITE_PACKET_MESSAGE_FN WritePacketMessage;
 	WLOG_APPENDER_FREE Free;
 	WLOG_APPENDER_SET Set;
+	WLOG_APPENDER_FLUSH_FN Flush; /* optional, called when the async queue ran empty */
+	wLogAsyncQueue* async;        /* nullptr for synchronous writes */
 };
 
 struct s_wLog